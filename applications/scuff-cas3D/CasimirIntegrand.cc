@@ -47,14 +47,38 @@ using namespace scuff;
 
 /***************************************************************/
 /* compute \log \det \{ M^{-1} MInfinity \}                    */
+/*                                                             */
+/* if SC3D->StochasticSamples is nonzero (and the sweep solver */
+/* is not in use) the log-determinant is estimated by          */
+/* GetStochasticLNDet(); in this case M must not yet have been */
+/* LU-factorized, and the standard error of the estimate is    */
+/* returned in StdErr.                                         */
 /***************************************************************/
-double GetLNDetMInvMInf(SC3Data *SC3D)
+double GetLNDetMInvMInf(SC3Data *SC3D, double *StdErr=0)
 { 
   HMatrix *M              = SC3D->M;
   int N                   = SC3D->N;
 
   double LNDet=0.0;
-  if (SC3D->NewEnergyMethod==false)
+  if (StdErr) *StdErr=0.0;
+  if (SC3D->SS)
+   { 
+     /*--------------------------------------------------------------*/
+     /*- with the sweep solver, M = MInf + W*Z and the ratio of the  */
+     /*- determinants is that of the capacitance matrix             -*/
+     /*--------------------------------------------------------------*/
+     LNDet = -1.0*SC3D->SS->GetLogDetRatio();
+   }
+  else if (SC3D->StochasticSamples>0)
+   { 
+     /*--------------------------------------------------------------*/
+     /*- stochastic estimate of log |det MInf^{-1} M| ---------------*/
+     /*--------------------------------------------------------------*/
+     double Err;
+     LNDet = -1.0*GetStochasticLNDet(SC3D, &Err);
+     if (StdErr) *StdErr = Err/(2.0*M_PI);
+   }
+  else if (SC3D->NewEnergyMethod==false)
    {  
      /*--------------------------------------------------------------*/
      /*- calculation method 1  --------------------------------------*/
@@ -96,8 +120,12 @@ double GetLNDetMInvMInf(SC3Data *SC3D)
 /***************************************************************/
 /* compute \trace \{ M^{-1} dMdAlpha\},                        */
 /* where Alpha=x, y, z                                         */
+/*                                                             */
+/* if SC3D->StochasticSamples is nonzero the trace is          */
+/* estimated by Hutch++ and its standard error is returned     */
+/* in StdErr.                                                  */
 /***************************************************************/
-double GetTraceMInvdM(SC3Data *SC3D, char XYZT)
+double GetTraceMInvdM(SC3Data *SC3D, char XYZT, double *StdErr=0)
 { 
   /***************************************************************/
   /* unpack fields from workspace structure **********************/
@@ -130,12 +158,24 @@ double GetTraceMInvdM(SC3Data *SC3D, char XYZT)
   for(int ns=1; ns<G->NumSurfaces; ns++)
    dM->InsertBlockAdjoint(dUBlocks[ 6*(ns-1) + Mu ], G->BFIndexOffset[ns], 0);
 
-  M->LUSolve(dM);
-
   double Trace=0.0;
-  for(int n=0; n<dM->NC; n++)
-   Trace+=dM->GetEntryD(n,n);
-  Trace*=2.0;
+  if (StdErr) *StdErr=0.0;
+  if (SC3D->StochasticSamples>0)
+   { double Err;
+     Trace = 2.0*real( GetStochasticTrace(SC3D, &Err) );
+     if (StdErr) *StdErr = 2.0*Err/(2.0*M_PI);
+   }
+  else
+   { 
+     if (SC3D->SS)
+      SC3D->SS->LUSolve(dM);
+     else
+      M->LUSolve(dM);
+
+     for(int n=0; n<dM->NC; n++)
+      Trace+=dM->GetEntryD(n,n);
+     Trace*=2.0;
+   };
 
   // paraphrasing the physicists of the 1930s, 'just because
   // something is infinite doesn't mean that it's zero.' and yet...
@@ -145,15 +185,106 @@ double GetTraceMInvdM(SC3Data *SC3D, char XYZT)
   return -Trace/(2.0*M_PI);
 } 
 
+/***************************************************************/
+/* compute \trace \{ M^{-1} dMdAlpha \} for all requested     */
+/* force and torque components at once.                        */
+/*                                                             */
+/* the trace we want is that of the upper N1 x N1 block of     */
+/* M^{-1} dM. since the nonzero entries of dM lie only in its  */
+/* lower rows (those of surfaces 2, 3, ...), cyclicity gives   */
+/*                                                             */
+/*  Tr = \sum_{b<N1} \sum_{j>=N1} [M^{-1}]_{bj} dM_{jb}         */
+/*                                                             */
+/* so every component needs the same upper-right block of      */
+/* M^{-1}, which we get from a single solve, after which each  */
+/* trace is just an entrywise product with the dU blocks.      */
+/*                                                             */
+/* the block of M^{-1} is obtained either from its columns     */
+/* (solving M X = [0 ; 1], N-N1 right-hand sides) or from its  */
+/* rows (solving M^T Y = [1 ; 0], N1 right-hand sides),        */
+/* whichever is cheaper; the sweep solver does not support     */
+/* transposed solves, so in that case we always use columns.   */
+/*                                                             */
+/* on return, Traces[0..NumComponents-1] are the integrand     */
+/* values for the requested components in XYZ123 order.        */
+/***************************************************************/
+void GetTracesMInvdM(SC3Data *SC3D, double *Traces)
+{ 
+  RWGGeometry *G     = SC3D->G;
+  HMatrix **dUBlocks = SC3D->dUBlocks;
+  int N              = SC3D->N;
+  int N1             = SC3D->N1;
+  int RC             = SC3D->M->RealComplex;
+
+  bool UseRows = (SC3D->SS==0 && N1 < N-N1);
+  int NRHS     = UseRows ? N1 : N-N1;
+
+  if ( SC3D->MInvBlock==0 || SC3D->MInvBlock->NC!=NRHS )
+   { if (SC3D->MInvBlock) delete SC3D->MInvBlock;
+     SC3D->MInvBlock = new HMatrix(N, NRHS, RC);
+   };
+  HMatrix *X = SC3D->MInvBlock;
+
+  Log("  Computing all force/torque components (%i right-hand sides)...",NRHS);
+
+  X->Zero();
+  for(int n=0; n<NRHS; n++)
+   X->SetEntry( UseRows ? n : N1+n, n, 1.0);
+
+  if (SC3D->SS)
+   SC3D->SS->LUSolve(X);
+  else if (UseRows)
+   SC3D->M->LUSolve(X,'T');
+  else
+   SC3D->M->LUSolve(X);
+
+  /***************************************************************/
+  /* dM_{jb} = conj(dU_{b,a}) with j = BFIndexOffset[ns] + a,    */
+  /* and [M^{-1}]_{bj} = X_{b,j-N1} (columns) or X_{j,b} (rows)  */
+  /***************************************************************/
+  int nc=0;
+  for(int Mu=0; Mu<6; Mu++)
+   { 
+     if ( !(SC3D->WhichQuantities & (QUANTITY_XFORCE<<Mu)) )
+      continue;
+
+     double Trace=0.0;
+     for(int ns=1; ns<G->NumSurfaces; ns++)
+      { HMatrix *dU = dUBlocks[ 6*(ns-1) + Mu ];
+        int Offset  = G->BFIndexOffset[ns];
+        for(int a=0; a<dU->NC; a++)
+         for(int b=0; b<N1; b++)
+          { cdouble MInvbj = UseRows ? X->GetEntry(Offset+a, b)
+                                     : X->GetEntry(b, Offset+a-N1);
+            Trace += real( MInvbj * conj(dU->GetEntry(b,a)) );
+          };
+      };
+     Trace*=2.0;
+
+     // paraphrasing the physicists of the 1930s, 'just because
+     // something is infinite doesn't mean that it's zero.' and yet...
+     if (!IsFinite(Trace))
+      Trace=0.0;
+
+     Traces[nc++] = -Trace/(2.0*M_PI);
+   };
+} 
+
 
 /***************************************************************/
-/* stamp T and U blocks into the BEM matrix, then LU-factorize.*/
+/* stamp T and U blocks into the BEM matrix, then LU-factorize */
+/* (unless StampOnly is true).                                 */
 /***************************************************************/
-void Factorize(SC3Data *SC3D)
+void Factorize(SC3Data *SC3D, bool StampOnly=false)
 { 
   RWGGeometry *G = SC3D->G;
   HMatrix *M     = SC3D->M;
 
+  if (SC3D->SS)
+   { SC3D->SS->Factorize(SC3D->UBlocks);
+     return;
+   };
+
   /***************************************************************/
   /* stamp blocks into M matrix                                  */
   /***************************************************************/
@@ -179,7 +310,8 @@ void Factorize(SC3Data *SC3D)
   /***************************************************************/
   /* LU factorize                                                */
   /***************************************************************/
-  M->LUFactorize();
+  if (!StampOnly)
+   M->LUFactorize();
 
 } 
 
@@ -226,6 +358,25 @@ void ExportHDF5Data(SC3Data *SC3D, double Xi, double *kBloch, char *Tag)
 }
  
 
+/***************************************************************/
+/* write the integrand values for all transformations at one   */
+/* (Xi,kBloch) point to the .byXikBloch file                   */
+/***************************************************************/
+void WriteByXiKData(SC3Data *SC3D, double Xi, double *kBloch, double *EFT)
+{
+  FILE *f=fopen(SC3D->ByXiKFileName,"a");
+  if (!f) return;
+  for(int ntnq=0, nt=0; nt<SC3D->NumTransformations; nt++)
+   { fprintf(f,"%s %6e ",SC3D->GTCs[nt]->Tag,Xi);
+     for(int d=0; d<SC3D->G->LDim; d++)
+      fprintf(f,"%6e ",kBloch[d]);
+     for(int nq=0; nq<SC3D->NumQuantities; nq++, ntnq++)
+      fprintf(f,"%.8e ",EFT[ntnq]);
+     fprintf(f,"\n");
+   };
+  fclose(f);
+}
+
 /***************************************************************/
 /* evaluate the casimir energy, force, and/or torque integrand */
 /* at a single Xi point, or a single (Xi,kBloch) point for PBC */
@@ -263,10 +414,14 @@ void GetCasimirIntegrand(void *pSC3D, cdouble Omega,
 
   /***************************************************************/
   /* attempt to bypass the calculation by reading data from a    */
-  /* cache file                                                  */
+  /* cache file; values found in the result store are written to */
+  /* the .byXikBloch file just as if they had been computed      */
   /***************************************************************/
   if ( CacheRead(SC3D, Xi, kBloch, EFT) )
-   return;
+   { if (SC3D->RS && kBloch)
+      WriteByXiKData(SC3D, Xi, kBloch, EFT);
+     return;
+   };
 
   RWGGeometry *G = SC3D->G;
   bool PBC = (G->LDim > 0);
@@ -311,13 +466,24 @@ void GetCasimirIntegrand(void *pSC3D, cdouble Omega,
 
    }; // for(ns=0; ns<G->NumSurfaces; ns++)
 
+  /***************************************************************/
+  /* with the sweep solver, the T blocks are factorized once     */
+  /* here and reused for all transformations                     */
+  /***************************************************************/
+  if (SC3D->SS)
+   SC3D->SS->SetTBlocks(SC3D->TBlocks);
+
   /***************************************************************/
   /* if an energy calculation was requested, compute and save    */
   /* the diagonals of the LU factorization of the T blocks       */
   /* (which collectively constitute the diagonal of the LU       */
   /* factorization of the M_{\infinity} matrix).                 */
   /***************************************************************/
-  if ( SC3D->WhichQuantities & QUANTITY_ENERGY )
+  bool Stochastic = (SC3D->StochasticSamples>0);
+  bool Schur      = UseSchurComplement(SC3D);
+  if ( ((SC3D->WhichQuantities & QUANTITY_ENERGY) || Schur) && !SC3D->SS && Stochastic )
+   FactorizeTBlocks(SC3D);
+  else if ( (SC3D->WhichQuantities & QUANTITY_ENERGY) && !SC3D->SS )
    {
      HMatrix *M=SC3D->M;
      HVector *V=SC3D->MInfLUDiagonal;
@@ -371,6 +537,8 @@ void GetCasimirIntegrand(void *pSC3D, cdouble Omega,
   /* transformation, then calculate all quantities requested.    */
   /***************************************************************/
   FILE *ByXiKFile = (G->LDim==0) ? 0 : fopen(SC3D->ByXiKFileName,"a");
+  FILE *ErrFile   = Stochastic ? fopen(SC3D->StochasticErrorFileName,"a") : 0;
+  double *StdErr  = new double[SC3D->NumQuantities];
   int NT=SC3D->NumTransformations;
   for(int ntnq=0, nt=0; nt<NT; nt++)
    { 
@@ -456,21 +624,53 @@ void GetCasimirIntegrand(void *pSC3D, cdouble Omega,
      /***************************************************************/
      /* factorize the M matrix and compute casimir quantities       */
      /***************************************************************/
-     Factorize(SC3D);
-     if ( SC3D->WhichQuantities & QUANTITY_ENERGY )
-      EFT[ntnq++]=GetLNDetMInvMInf(SC3D);
-     if ( SC3D->WhichQuantities & QUANTITY_XFORCE )
-      EFT[ntnq++]=GetTraceMInvdM(SC3D,'X');
-     if ( SC3D->WhichQuantities & QUANTITY_YFORCE )
-      EFT[ntnq++]=GetTraceMInvdM(SC3D,'Y');
-     if ( SC3D->WhichQuantities & QUANTITY_ZFORCE )
-      EFT[ntnq++]=GetTraceMInvdM(SC3D,'Z');
-     if ( SC3D->WhichQuantities & QUANTITY_TORQUE1 )
-      EFT[ntnq++]=GetTraceMInvdM(SC3D,'1');
-     if ( SC3D->WhichQuantities & QUANTITY_TORQUE2 )
-      EFT[ntnq++]=GetTraceMInvdM(SC3D,'2');
-     if ( SC3D->WhichQuantities & QUANTITY_TORQUE3 )
-      EFT[ntnq++]=GetTraceMInvdM(SC3D,'3');
+     /* the stochastic energy estimate needs the unfactorized M, */
+     /* so in that case we factorize only after computing it;    */
+     /* in the Schur-complement case we never factorize M        */
+     int WQ=SC3D->WhichQuantities, nqe=0;
+     bool DelayLU = Stochastic && (WQ & QUANTITY_ENERGY) && !SC3D->SS && !Schur;
+     Factorize(SC3D, DelayLU || Schur);
+     if ( WQ & QUANTITY_ENERGY )
+      EFT[ntnq++]=GetLNDetMInvMInf(SC3D, StdErr + nqe++);
+     if ( DelayLU && (WQ & ~QUANTITY_ENERGY) )
+      SC3D->M->LUFactorize();
+
+     /* in exact mode, all force and torque components share a      */
+     /* single solve; the stochastic estimators work per component  */
+     if ( !Stochastic )
+      { if ( WQ & ~QUANTITY_ENERGY )
+         { GetTracesMInvdM(SC3D, EFT + ntnq);
+           ntnq += SC3D->NumQuantities - nqe;
+         };
+      }
+     else
+      { if ( WQ & QUANTITY_XFORCE )
+         EFT[ntnq++]=GetTraceMInvdM(SC3D,'X', StdErr + nqe++);
+        if ( WQ & QUANTITY_YFORCE )
+         EFT[ntnq++]=GetTraceMInvdM(SC3D,'Y', StdErr + nqe++);
+        if ( WQ & QUANTITY_ZFORCE )
+         EFT[ntnq++]=GetTraceMInvdM(SC3D,'Z', StdErr + nqe++);
+        if ( WQ & QUANTITY_TORQUE1 )
+         EFT[ntnq++]=GetTraceMInvdM(SC3D,'1', StdErr + nqe++);
+        if ( WQ & QUANTITY_TORQUE2 )
+         EFT[ntnq++]=GetTraceMInvdM(SC3D,'2', StdErr + nqe++);
+        if ( WQ & QUANTITY_TORQUE3 )
+         EFT[ntnq++]=GetTraceMInvdM(SC3D,'3', StdErr + nqe++);
+      };
+
+     /******************************************************************/
+     /* with stochastic estimators, write the estimated standard       */
+     /* errors of all quantities to the .StochasticErrors file         */
+     /******************************************************************/
+     if (ErrFile)
+      { fprintf(ErrFile,"%s %6e ",Tag,Xi);
+        for(int d=0; d<G->LDim; d++)
+         fprintf(ErrFile,"%6e ",kBloch[d]);
+        for(int nq=SC3D->NumQuantities; nq>0; nq--)
+         fprintf(ErrFile,"%.8e %.2e ",EFT[ntnq-nq],StdErr[SC3D->NumQuantities-nq]);
+        fprintf(ErrFile,"\n");
+        fflush(ErrFile);
+      };
 
      /******************************************************************/
      /* for periodic geometries, write bloch-vector-resolved data      */
@@ -483,6 +683,9 @@ void GetCasimirIntegrand(void *pSC3D, cdouble Omega,
         fflush(ByXiKFile);
       };
 
+     if (SC3D->RS)
+      SC3D->RS->Append(Tag, Xi, kBloch, EFT + ntnq - SC3D->NumQuantities);
+
      if (SC3D->WriteHDF5Files)
       ExportHDF5Data(SC3D, Xi, kBloch, (NT==1 ? 0 : Tag) );
 
@@ -495,6 +698,9 @@ void GetCasimirIntegrand(void *pSC3D, cdouble Omega,
 
   if (ByXiKFile)
    fclose(ByXiKFile);
+  if (ErrFile)
+   fclose(ErrFile);
+  delete[] StdErr;
 
   /***************************************************************/
   /***************************************************************/
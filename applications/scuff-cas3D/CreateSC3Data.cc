@@ -149,6 +149,17 @@ SC3Data *CreateSC3Data(RWGGeometry *G, char *TransFile,
   SC3D->M           = new HMatrix(N,  N,  RealComplex);
   SC3D->dM          = new HMatrix(N,  N1, RealComplex);
   SC3D->NewEnergyMethod  = NewEnergyMethod;
+  SC3D->SS               = 0;
+
+  // stochastic estimators are disabled by default; the caller
+  // enables them by setting StochasticSamples after we return
+  SC3D->StochasticSamples       = 0;
+  SC3D->SeriesTerms             = 100;
+  SC3D->StochasticSeed          = 0x5C0FFEEULL;
+  SC3D->TLU                     = 0;
+  SC3D->StochasticErrorFileName = 0;
+  SC3D->MInvBlock               = 0;
+  SC3D->RS                      = 0;
 
   if (WhichQuantities & QUANTITY_ENERGY)
    { SC3D->MInfLUDiagonal = new HVector(G->TotalBFs);
@@ -0,0 +1,402 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * StochasticEstimators.cc -- randomized estimators for the log-determinant
+ *                         -- and trace quantities entering the Casimir
+ *                         -- energy, force, and torque integrands
+ *
+ * These avoid forming M^{-1}*MInf or M^{-1}*dM explicitly. For two
+ * bodies, with M = [T1 U; U' T2] (U' = U^\dagger), both are expressed
+ * in terms of the Schur complement S = I - K, K = T1^{-1} U T2^{-1} U',
+ * which acts on the N1-dimensional space of the first body and is
+ * close to the identity for well-separated bodies:
+ *
+ *  -- log |det (MInf^{-1} M)| = log |det S| = Re Tr log (I-K).
+ *
+ *  -- Tr (M^{-1} dM), where M^{-1} is applied by solving with S.
+ *
+ * Both traces are estimated by Hutch++ (a low-rank sketch of the
+ * operator plus Hutchinson's estimator for the remainder), with
+ * log (I-K) and (I-K)^{-1} applied to the probe vectors by summing
+ * their series in K. Since K is small, so is the variance, and M
+ * itself is never LU-factorized.
+ *
+ * Each application of K costs one solve with each of the (already
+ * LU-factorized) T blocks and one product with U and with U'.
+ * With more than two bodies, the log-determinant series is taken
+ * in K = I - MInf^{-1} M over the full space, and Tr (M^{-1} dM) uses
+ * the LU factorization of M.
+ *
+ * The random probe vectors are Rademacher vectors generated from a
+ * fixed seed on every call, so that the estimates are smooth
+ * functions of Xi and kBloch as required by the outer quadratures.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "scuff-cas3D.h"
+
+using namespace scuff;
+
+// relative size of the last term at which the series
+// expansions in K are truncated
+#define SERIES_TOL 1.0e-10
+
+/***************************************************************/
+/* random-number generation: splitmix64, seeded identically on */
+/* every call                                                  */
+/***************************************************************/
+static unsigned long long NextRandom(unsigned long long *State)
+{
+  unsigned long long z = (*State += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z>>30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z>>27)) * 0x94D049BB133111EBULL;
+  return z ^ (z>>31);
+}
+
+static void FillRademacher(HMatrix *Z, unsigned long long *State)
+{
+  for(int nc=0; nc<Z->NC; nc++)
+   for(int nr=0; nr<Z->NR; nr++)
+    Z->SetEntry(nr, nc, (NextRandom(State)>>63) ? 1.0 : -1.0);
+}
+
+/***************************************************************/
+/* column operations on real or complex HMatrices              */
+/***************************************************************/
+// conj(A_{:,ca}) . B_{:,cb}
+static cdouble ColDot(HMatrix *A, int ca, HMatrix *B, int cb)
+{
+  size_t N=A->NR;
+  if (A->RealComplex==LHM_REAL)
+   { double *a=A->DM + ca*N, *b=B->DM + cb*N, Sum=0.0;
+     for(size_t n=0; n<N; n++) Sum+=a[n]*b[n];
+     return Sum;
+   };
+  cdouble *a=A->ZM + ca*N, *b=B->ZM + cb*N, Sum=0.0;
+  for(size_t n=0; n<N; n++) Sum+=conj(a[n])*b[n];
+  return Sum;
+}
+
+// Y_{:,cy} += Alpha * X_{:,cx}
+static void ColAXPY(HMatrix *Y, int cy, cdouble Alpha, HMatrix *X, int cx)
+{
+  size_t N=Y->NR;
+  if (Y->RealComplex==LHM_REAL)
+   { double *y=Y->DM + cy*N, *x=X->DM + cx*N, a=real(Alpha);
+     for(size_t n=0; n<N; n++) y[n]+=a*x[n];
+   }
+  else
+   { cdouble *y=Y->ZM + cy*N, *x=X->ZM + cx*N;
+     for(size_t n=0; n<N; n++) y[n]+=Alpha*x[n];
+   };
+}
+
+static void ColScale(HMatrix *X, int c, double Alpha)
+{
+  size_t N=X->NR;
+  if (X->RealComplex==LHM_REAL)
+   for(size_t n=0; n<N; n++) X->DM[c*N + n]*=Alpha;
+  else
+   for(size_t n=0; n<N; n++) X->ZM[c*N + n]*=Alpha;
+}
+
+static double ColNorm(HMatrix *X, int c)
+{ return sqrt( real(ColDot(X, c, X, c)) ); }
+
+// copy rows RowOffset...RowOffset+Dest->NR-1 of Src into Dest (or back)
+static void CopyRows(HMatrix *Src, int RowOffset, HMatrix *Dest, bool Back=false)
+{
+  size_t ES = (Src->RealComplex==LHM_REAL) ? sizeof(double) : sizeof(cdouble);
+  char *S   = (Src->RealComplex==LHM_REAL)  ? (char *)Src->DM  : (char *)Src->ZM;
+  char *D   = (Dest->RealComplex==LHM_REAL) ? (char *)Dest->DM : (char *)Dest->ZM;
+  for(int nc=0; nc<Dest->NC; nc++)
+   { char *s = S + ES*( ((size_t)nc)*Src->NR + RowOffset );
+     char *d = D + ES*( ((size_t)nc)*Dest->NR );
+     if (Back)
+      memcpy(s, d, ES*Dest->NR);
+     else
+      memcpy(d, s, ES*Dest->NR);
+   };
+}
+
+/***************************************************************/
+/* LU-factorize the T blocks, whose direct sum is MInf         */
+/***************************************************************/
+void FactorizeTBlocks(SC3Data *SC3D)
+{
+  RWGGeometry *G = SC3D->G;
+  int NS         = G->NumSurfaces;
+
+  if (SC3D->TLU==0)
+   { SC3D->TLU = (HMatrix **)mallocEC(NS*sizeof(HMatrix *));
+     for(int ns=0; ns<NS; ns++)
+      { int nsp=G->Mate[ns];
+        SC3D->TLU[ns] = (nsp==-1) ? new HMatrix(SC3D->TBlocks[ns]) : SC3D->TLU[nsp];
+      };
+   };
+
+  for(int ns=0; ns<NS; ns++)
+   if (G->Mate[ns]==-1)
+    { SC3D->TLU[ns]->Copy(SC3D->TBlocks[ns]);
+      SC3D->TLU[ns]->LUFactorize();
+    };
+}
+
+/***************************************************************/
+/* X <- MInf^{-1} X                                            */
+/***************************************************************/
+static void ApplyMInfInverse(SC3Data *SC3D, HMatrix *X)
+{
+  RWGGeometry *G = SC3D->G;
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   {
+     HMatrix *TLU = SC3D->TLU[ns];
+     HMatrix XBlock(TLU->NR, X->NC, X->RealComplex);
+     CopyRows(X, G->BFIndexOffset[ns], &XBlock);
+     TLU->LUSolve(&XBlock);
+     CopyRows(X, G->BFIndexOffset[ns], &XBlock, true);
+   };
+}
+
+/***************************************************************/
+/* the Schur-complement formulation is used for two-body       */
+/* geometries unless the sweep solver is in use                */
+/***************************************************************/
+bool UseSchurComplement(SC3Data *SC3D)
+{
+  return     SC3D->StochasticSamples>0
+          && SC3D->SS==0
+          && SC3D->G->NumSurfaces==2;
+}
+
+/***************************************************************/
+/* Y <- K X, where K = T1^{-1} U T2^{-1} U' (X, Y are N1 x nc) */
+/* in the Schur-complement case, or K = I - MInf^{-1} M        */
+/* (X, Y are N x nc) otherwise                                 */
+/***************************************************************/
+static void ApplyK(SC3Data *SC3D, HMatrix *X, HMatrix *Y)
+{
+  if (UseSchurComplement(SC3D))
+   { HMatrix *U = SC3D->UBlocks[0];
+     HMatrix Temp(U->NC, X->NC, X->RealComplex);
+     U->Multiply(X, &Temp, "--transA C");
+     SC3D->TLU[1]->LUSolve(&Temp);
+     U->Multiply(&Temp, Y);
+     SC3D->TLU[0]->LUSolve(Y);
+   }
+  else
+   { SC3D->M->Multiply(X, Y);
+     ApplyMInfInverse(SC3D, Y);
+     for(int nc=0; nc<X->NC; nc++)
+      { ColScale(Y, nc, -1.0);
+        ColAXPY(Y, nc, 1.0, X, nc);
+      };
+   };
+}
+
+/***************************************************************/
+/* Y <- f(K) X, where f(K) is either                           */
+/*  (I-K)^{-1} = \sum_{p>=0} K^p          (Log=false)  or      */
+/*  log (I-K)  = -\sum_{p>=1} K^p / p     (Log=true),          */
+/* by summing the series until the last term is negligible     */
+/* for every column of X.                                      */
+/***************************************************************/
+static void ApplySeries(SC3Data *SC3D, HMatrix *X, HMatrix *Y, bool Log)
+{
+  HMatrix *V  = new HMatrix(X);
+  HMatrix *KV = new HMatrix(X->NR, X->NC, X->RealComplex);
+  if (Log)
+   Y->Zero();
+  else
+   Y->Copy(X);
+
+  int P=SC3D->SeriesTerms, p;
+  for(p=1; p<=P; p++)
+   { ApplyK(SC3D, V, KV);
+     HMatrix *Swap=V; V=KV; KV=Swap;
+     double c = Log ? -1.0/((double)p) : 1.0;
+     bool Converged=true;
+     for(int nc=0; nc<X->NC; nc++)
+      { ColAXPY(Y, nc, c, V, nc);
+        if ( fabs(c)*ColNorm(V, nc) > SERIES_TOL*ColNorm(Y, nc) )
+         Converged=false;
+      };
+     if (Converged)
+      break;
+   };
+  if (p>P)
+   Warn("%s series not converged after %i terms",Log ? "log(I-K)" : "(I-K)^{-1}",P);
+
+  delete V;
+  delete KV;
+}
+
+static void ApplyLogSeries(SC3Data *SC3D, HMatrix *X, HMatrix *Y)
+{ ApplySeries(SC3D, X, Y, true); }
+
+/***************************************************************/
+/* Y <- first N1 rows of M^{-1} dM X (X, Y are N1 x nc)        */
+/***************************************************************/
+static void ApplyTraceOperator(SC3Data *SC3D, HMatrix *X, HMatrix *Y)
+{
+  HMatrix DX(SC3D->N, X->NC, X->RealComplex);
+  SC3D->dM->Multiply(X, &DX);
+  if (UseSchurComplement(SC3D))
+   { 
+     // dM X = [0; R], and the first N1 rows of M^{-1} [0; R]
+     // are -(I-K)^{-1} T1^{-1} U T2^{-1} R
+     HMatrix *U = SC3D->UBlocks[0];
+     HMatrix R(U->NC, X->NC, X->RealComplex);
+     HMatrix C(U->NR, X->NC, X->RealComplex);
+     CopyRows(&DX, SC3D->N1, &R);
+     SC3D->TLU[1]->LUSolve(&R);
+     U->Multiply(&R, &C);
+     SC3D->TLU[0]->LUSolve(&C);
+     ApplySeries(SC3D, &C, Y, false);
+     for(int nc=0; nc<Y->NC; nc++)
+      ColScale(Y, nc, -1.0);
+     return;
+   };
+
+  if (SC3D->SS)
+   SC3D->SS->LUSolve(&DX);
+  else
+   SC3D->M->LUSolve(&DX);
+  CopyRows(&DX, 0, Y);
+}
+
+/***************************************************************/
+/* Hutch++ estimate of the trace of the N x N operator Op,     */
+/* called as Op(SC3D, X, Y) to compute Y <- Op X for N x nc    */
+/* matrices X, Y. the standard error of the estimate is        */
+/* returned in StdErr.                                         */
+/*                                                             */
+/* with NS samples, NS/3 probes build a sketch Q of the range  */
+/* of the operator, NS/3 compute Tr(Q' A Q) exactly, and the   */
+/* rest estimate the trace of the deflated remainder.          */
+/***************************************************************/
+typedef void (*TraceOperator)(SC3Data *SC3D, HMatrix *X, HMatrix *Y);
+
+static cdouble GetHutchPPTrace(SC3Data *SC3D, TraceOperator Op, int N,
+                               double *StdErr)
+{
+  int NS = SC3D->StochasticSamples;
+  int RC = SC3D->M->RealComplex;
+
+  int NSketch  = (NS>=6) ? NS/3 : 0;
+  if (NSketch>N) NSketch=N;
+  int NHutch   = NS - 2*NSketch;
+  if (NHutch<1) NHutch=1;
+
+  unsigned long long State=SC3D->StochasticSeed;
+
+  /*--------------------------------------------------------------*/
+  /*- low-rank part: Q = orth(A S), Trace += Tr(Q' A Q)           */
+  /*--------------------------------------------------------------*/
+  cdouble Trace=0.0;
+  HMatrix *Q=0;
+  if (NSketch>0)
+   { HMatrix S(N, NSketch, RC);
+     Q = new HMatrix(N, NSketch, RC);
+     FillRademacher(&S, &State);
+     Op(SC3D, &S, Q);
+
+     // modified Gram-Schmidt, twice for stability
+     for(int nc=0; nc<NSketch; nc++)
+      { for(int Pass=0; Pass<2; Pass++)
+         for(int ncp=0; ncp<nc; ncp++)
+          ColAXPY(Q, nc, -ColDot(Q, ncp, Q, nc), Q, ncp);
+        double Norm=ColNorm(Q, nc);
+        if (Norm>0.0)
+         ColScale(Q, nc, 1.0/Norm);
+      };
+
+     HMatrix AQ(N, NSketch, RC);
+     Op(SC3D, Q, &AQ);
+     for(int nc=0; nc<NSketch; nc++)
+      Trace += ColDot(Q, nc, &AQ, nc);
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- Hutchinson estimate for the remainder, with probe vectors   */
+  /*- projected onto the orthogonal complement of Q               */
+  /*--------------------------------------------------------------*/
+  HMatrix G(N, NHutch, RC), AG(N, NHutch, RC);
+  FillRademacher(&G, &State);
+  if (Q)
+   for(int nc=0; nc<NHutch; nc++)
+    for(int ncp=0; ncp<NSketch; ncp++)
+     ColAXPY(&G, nc, -ColDot(Q, ncp, &G, nc), Q, ncp);
+  Op(SC3D, &G, &AG);
+
+  cdouble Sum=0.0;
+  double Sum2=0.0;
+  for(int nc=0; nc<NHutch; nc++)
+   { cdouble Sample = ColDot(&G, nc, &AG, nc);
+     Sum  += Sample;
+     Sum2 += norm(Sample);
+   };
+  cdouble Mean = Sum/((double)NHutch);
+  double Var   = (NHutch>1) ? (Sum2 - NHutch*norm(Mean))/(NHutch-1) : 0.0;
+  if (Var<0.0) Var=0.0;
+  Trace += Mean;
+
+  if (Q) delete Q;
+
+  if (StdErr) *StdErr = sqrt(Var/NHutch);
+  return Trace;
+}
+
+/***************************************************************/
+/* stochastic estimate of                                      */
+/*  log |det (MInf^{-1} M)| = Re Tr log (I-K).                 */
+/* on entry, SC3D->M must contain the (unfactorized) BEM       */
+/* matrix and FactorizeTBlocks() must have been called.        */
+/* the standard error of the estimate is returned in StdErr.  */
+/***************************************************************/
+double GetStochasticLNDet(SC3Data *SC3D, double *StdErr)
+{
+  bool Schur = UseSchurComplement(SC3D);
+  Log(" Estimating log det of %s (%i samples)...",
+       Schur ? "Schur complement" : "MInf^{-1} M",SC3D->StochasticSamples);
+
+  double Err;
+  double LNDet=real( GetHutchPPTrace(SC3D, ApplyLogSeries,
+                                     Schur ? SC3D->N1 : SC3D->N, &Err) );
+  Log(" ...log |det A| = %e +/- %e",LNDet,Err);
+  if (StdErr) *StdErr=Err;
+  return LNDet;
+}
+
+/***************************************************************/
+/* Hutch++ estimate of the trace of the upper N1 x N1 block of */
+/* M^{-1} dM (the block whose diagonal GetTraceMInvdM sums).   */
+/* on entry, SC3D->dM must hold the stamped derivative matrix  */
+/* and, unless UseSchurComplement() is true, SC3D->M (or       */
+/* SC3D->SS) the LU factorization of M. the standard error of  */
+/* the estimate is returned in StdErr.                         */
+/***************************************************************/
+cdouble GetStochasticTrace(SC3Data *SC3D, double *StdErr)
+{
+  return GetHutchPPTrace(SC3D, ApplyTraceOperator, SC3D->N1, StdErr);
+}
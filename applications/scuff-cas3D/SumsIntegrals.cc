@@ -75,14 +75,24 @@ bool LineMatches(char *Line, char *Tag, double *Keys, int NumKeys,
 
 /***************************************************************/
 /* CacheRead: attempt to bypass an entire GetXiIntegrand       */
-/* calculation by reading results from the .byXi or .byXikbloch*/
-/* file. Returns true if successful (which means the values of */
+/* calculation by reading results from the result store, or    */
+/* (if there is none) from the .byXi or .byXikbloch file.      */
+/* Returns true if successful (which means the values of       */
 /* the energy/force/torque integrand for ALL transformations   */
 /* at this value of Xi were successfully read from the file)   */
 /* or false on failure.                                        */
 /***************************************************************/
 bool CacheRead(SC3Data *SC3D, double Xi, double *kBloch, double *EFT)
 { 
+  if (SC3D->RS)
+   { int NQ = SC3D->NumQuantities;
+     for(int nt=0; nt<SC3D->NumTransformations; nt++)
+      if ( !SC3D->RS->Lookup(SC3D->GTCs[nt]->Tag, Xi, kBloch, EFT + nt*NQ) )
+       return false;
+     Log("...found data for all transforms in result store");
+     return true;
+   };
+
   if (SC3D->UseExistingData==false)
    return false;
    
@@ -105,6 +105,10 @@ int main(int argc, char *argv[])
   bool UseExistingData = false;
   bool NewEnergyMethod = false;
   bool WriteHDF5Files  = false;
+  double SweepSolverTol = 0.0;
+  int StochasticSamples = 0;
+  int SeriesTerms       = 100;
+  char *ResultStoreFile = 0;
 
 //
   /* name               type    #args  max_instances  storage           count         description*/
@@ -137,10 +141,14 @@ int main(int argc, char *argv[])
      {"WriteCache",     PA_STRING,  1, 1,       (void *)&WriteCache,    0,             "write cache"},
 //
      {"UseExistingData", PA_BOOL,   0, 1,       (void *)&UseExistingData, 0,           "reuse data from existing .byXi files"},
+     {"ResultStore",    PA_STRING,  1, 1,       (void *)&ResultStoreFile, 0,           "binary file of computed integrand values for resuming runs"},
 //
      {"NewEnergyMethod", PA_BOOL,   0, 1,       (void *)&NewEnergyMethod, 0,           "use alternative method for energy calculation"},
 //
      {"WriteHDF5Files", PA_BOOL,    1, 1,       (void *)&WriteHDF5Files,0,             "write BEM matrices to .hdf5 files"},
+     {"SweepSolverTol", PA_DOUBLE,  1, 1,       (void *)&SweepSolverTol,0,             "reuse T-block factorizations across transformations, compressing U blocks to this tolerance"},
+     {"StochasticSamples", PA_INT,  1, 1,       (void *)&StochasticSamples, 0,         "estimate log determinants and traces using this many random probe vectors"},
+     {"SeriesTerms",    PA_INT,     1, 1,       (void *)&SeriesTerms,   0,             "maximum number of terms in the series expansions used by the stochastic estimators"},
      {0,0,0,0,0,0,0}
    };
   ProcessOptions(argc, argv, OSArray);
@@ -278,6 +286,48 @@ int main(int argc, char *argv[])
   SC3D->MaxXiPoints        = MaxXiPoints;
   SC3D->XiMin              = XiMin;
 
+  if (SweepSolverTol>0.0)
+   { if (G->LDim>0)
+      ErrExit("--SweepSolverTol is not available for periodic geometries");
+     SC3D->SS = new SweepSolver(G, SC3D->M->RealComplex, true, SweepSolverTol);
+   };
+
+  if (StochasticSamples>0)
+   { if (SeriesTerms<1)
+      ErrExit("--SeriesTerms must be positive");
+     if (NewEnergyMethod)
+      Warn("--NewEnergyMethod is ignored when --StochasticSamples is specified");
+     SC3D->StochasticSamples = StochasticSamples;
+     SC3D->SeriesTerms       = SeriesTerms;
+     SC3D->StochasticErrorFileName = vstrdup("%s.StochasticErrors",SC3D->FileBase);
+     FILE *f=fopen(SC3D->StochasticErrorFileName,"w");
+     if (!f)
+      ErrExit("could not open file %s",SC3D->StochasticErrorFileName);
+     fprintf(f,"# stochastic estimates (%i samples) and their standard errors\n",StochasticSamples);
+     fprintf(f,"# columns: tag, xi, %s(value, standard error) for each quantity\n",
+                G->LDim==0 ? "" : G->LDim==1 ? "kx, " : "kx, ky, ");
+     fclose(f);
+   };
+
+  /*******************************************************************/
+  /* open the result store. with --UseExistingData, the store        */
+  /* defaults to FileBase.results, and the first time through it is  */
+  /* seeded with the data in the text output files of earlier runs.  */
+  /*******************************************************************/
+  if (UseExistingData && !ResultStoreFile)
+   ResultStoreFile=vstrdup("%s.results",SC3D->FileBase);
+  if (ResultStoreFile)
+   { uint64_t ContextHash=GetGeometryHash(G);
+     ContextHash=HashBytes(&WhichQuantities, sizeof(int), ContextHash);
+     ContextHash=HashBytes(TorqueAxes, 3*nTorque*sizeof(double), ContextHash);
+     ContextHash=HashBytes(&StochasticSamples, sizeof(int), ContextHash);
+     if (StochasticSamples>0)
+      ContextHash=HashBytes(&SeriesTerms, sizeof(int), ContextHash);
+     SC3D->RS=new ResultStore(ResultStoreFile, ContextHash, NumQuantities, G->LDim);
+     if (UseExistingData && SC3D->RS->GetNumRecords()==0)
+      SC3D->RS->Import( G->LDim>0 ? SC3D->ByXiKFileName : SC3D->ByXiFileName );
+   };
+
   if (G->LDim>=1)
    { UpdateBZIArgs(BZIArgs, G->RLBasis, G->RLVolume);
      BZIArgs->BZIFunc  = GetCasimirIntegrand;
@@ -344,6 +394,8 @@ int main(int argc, char *argv[])
    };
 
   delete[] EFT;
+  if (SC3D->RS)
+   delete SC3D->RS;
 
   /***************************************************************/
   /***************************************************************/
@@ -69,6 +69,11 @@ typedef struct SC3Data
    int *ipiv;
    HVector *MInfLUDiagonal;
 
+   // if non-null, the BEM system is solved by factorizing the
+   // T blocks once per frequency and applying low-rank updates
+   // for the U blocks at each transformation (see SweepSolver.h)
+   SweepSolver *SS;
+
    // matrix-block-assembly accelerators for PBC geometries
    void **TAccelerators, ***UAccelerators;
 
@@ -110,6 +115,27 @@ typedef struct SC3Data
    bool NewEnergyMethod;
    HMatrix *MM1MInf;
 
+   // if StochasticSamples>0, the log-determinant and trace
+   // quantities are estimated by randomized methods (Hutchinson
+   // and Hutch++ estimators applied to series expansions in the
+   // Schur complement) instead of being computed exactly; the
+   // series are truncated after at most SeriesTerms terms, TLU
+   // are the LU-factorized T blocks, and per-sample standard
+   // errors are written to StochasticErrorFileName
+   int StochasticSamples, SeriesTerms;
+   unsigned long long StochasticSeed;
+   HMatrix **TLU;
+   char *StochasticErrorFileName;
+
+   // upper-right block of M^{-1} (or its transpose), shared by
+   // all force and torque components (see GetTracesMInvdM)
+   HMatrix *MInvBlock;
+
+   // if non-null, integrand values at each (Tag, Xi, kBloch) are
+   // appended to this store as they are computed, and looked up
+   // there (instead of in the text output files) by CacheRead
+   ResultStore *RS;
+
    // various other miscellaneous items
    bool UseExistingData;
    bool WriteHDF5Files;
@@ -152,4 +178,10 @@ void GetXiIntegral_Cliff(SC3Data *SC3D, double *EFT, double *Error);
 void GetMatsubaraSum(SC3Data *SC3D, double Temperature, double *EFT, double *Error);
 bool CacheRead(SC3Data *SC3D, double Xi, double *kBloch, double *EFT);
 
+// StochasticEstimators.cc
+void FactorizeTBlocks(SC3Data *SC3D);
+bool UseSchurComplement(SC3Data *SC3D);
+double GetStochasticLNDet(SC3Data *SC3D, double *StdErr);
+cdouble GetStochasticTrace(SC3Data *SC3D, double *StdErr);
+
 #endif // #define SCUFFCAS3D_H
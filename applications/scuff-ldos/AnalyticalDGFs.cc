@@ -247,13 +247,10 @@ void GetHalfSpaceDGFs_BZ(HMatrix *XMatrix,
                          int MaxCells,
                          HMatrix *GMatrix)
 { 
+  // not a static buffer, since this may be called for several
+  // kBloch points at once
   int IDim = 18*XMatrix->NR;
-  static int IDimSave=0;
-  static cdouble *Sum=0;
-  if (IDimSave<IDim)
-   { IDimSave=IDim;
-     Sum = (cdouble *)reallocEC(Sum, IDim*sizeof(cdouble));
-   };
+  cdouble *Sum = (cdouble *)mallocEC(IDim*sizeof(cdouble));
 
   cdouble Epsilon=0.0, Mu=0.0;
   if (MP && MP->IsPEC() == false )
@@ -278,6 +275,8 @@ void GetHalfSpaceDGFs_BZ(HMatrix *XMatrix,
   for(int nx=0; nx<NX; nx++)
    for(int ng=0; ng<18; ng++)
     GMatrix->SetEntry(nx, ng, BZVolume*Sum[18*nx + ng]);
+
+  free(Sum);
 }
 
 /***************************************************************/
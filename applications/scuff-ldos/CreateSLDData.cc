@@ -93,7 +93,8 @@ void WriteFilePreamble(char *FileName, int FileType, int LDim,
 /***************************************************************/
 /***************************************************************/
 SLDData *CreateSLDData(char *GeoFile, char *TransFile,
-                       char **EPFiles, int nEPFiles)
+                       char **EPFiles, int nEPFiles,
+                       double CompressionTol)
 {
   SetDefaultCD2SFormat("%.8e %.8e");
 
@@ -108,7 +109,15 @@ SLDData *CreateSLDData(char *GeoFile, char *TransFile,
   /* read in geometry and allocate BEM matrix and RHS vector     */
   /***************************************************************/
   RWGGeometry *G = Data->G = new RWGGeometry(GeoFile);
-  Data->M = G->AllocateBEMMatrix();
+  Data->M  = 0;
+  Data->CM = 0;
+  if (CompressionTol>0.0)
+   { if (G->LDim>0)
+      ErrExit("--CompressionTol is not available for periodic geometries");
+     Data->CM = G->AllocateCompressedBEMMatrix(CompressionTol);
+   }
+  else
+   Data->M = G->AllocateBEMMatrix();
 
   /***************************************************************/
   /* read in geometrical transformation file if any **************/
@@ -121,7 +130,7 @@ SLDData *CreateSLDData(char *GeoFile, char *TransFile,
   bool HaveGTCList = (TransFile!=0);
 
   Data->TBlocks=Data->UBlocks=0;
-  if (HaveGTCList)
+  if (HaveGTCList && !Data->CM)
    { int NS=G->NumSurfaces;
      int NADB = NS*(NS-1)/2; // number of above-diagonal blocks
      HMatrix **TBlocks = Data->TBlocks = (HMatrix **)mallocEC(NS*sizeof(HMatrix *));
@@ -175,6 +184,7 @@ SLDData *CreateSLDData(char *GeoFile, char *TransFile,
   Data->EPFileBases     = EPFileBases;
   Data->NumXMatrices    = NumXMatrices;
   Data->TotalEvalPoints = TotalEvalPoints;
+  Data->RS              = 0;
 
   Data->WrotePreamble[0] = (bool *)mallocEC(NumXMatrices*sizeof(bool));
   Data->WrotePreamble[1] = (bool *)mallocEC(NumXMatrices*sizeof(bool));
@@ -208,9 +218,51 @@ SLDData *CreateSLDData(char *GeoFile, char *TransFile,
        Data->ABMBCache[nb]=G->CreateABMBAccelerator(nsa, nsb, false, false);
    };
 
+  Data->NumWorkspaces = 1;
+  Data->WMatrices     = 0;
+  Data->WGMatrices    = 0;
+  Data->WRFBuffers    = (HMatrix **)mallocEC(2*sizeof(HMatrix *));
+  Data->WRFBuffers[0] = Data->WRFBuffers[1] = 0;
+
   /***************************************************************/
   /***************************************************************/
   /***************************************************************/
   return Data;
 }
 
+/***************************************************************/
+/* allocate additional BEM matrices and DGF buffers so that    */
+/* GetLDOS can run at NumWorkspaces kBloch points at once.     */
+/* The kBloch-independent matrix-block caches are shared by    */
+/* all workspaces.                                             */
+/***************************************************************/
+void AllocateWorkspaces(SLDData *Data, int NumWorkspaces)
+{
+  if (NumWorkspaces<=Data->NumWorkspaces)
+   return;
+
+  RWGGeometry *G      = Data->G;
+  int NumXMatrices    = Data->NumXMatrices;
+  int NumGMatrices    = NumXMatrices * Data->NumTransforms;
+
+  Data->WMatrices
+   = (HMatrix **)reallocEC(Data->WMatrices, NumWorkspaces*sizeof(HMatrix *));
+  Data->WGMatrices
+   = (HMatrix ***)reallocEC(Data->WGMatrices, NumWorkspaces*sizeof(HMatrix **));
+  Data->WRFBuffers
+   = (HMatrix **)reallocEC(Data->WRFBuffers, 2*NumWorkspaces*sizeof(HMatrix *));
+  Data->WMatrices[0]  = Data->M;
+  Data->WGMatrices[0] = Data->GMatrices;
+  for(int nw=Data->NumWorkspaces; nw<NumWorkspaces; nw++)
+   { Data->WRFBuffers[2*nw + 0] = Data->WRFBuffers[2*nw + 1] = 0;
+     Data->WMatrices[nw] = G->AllocateBEMMatrix();
+     Data->WGMatrices[nw] = (HMatrix **)mallocEC(NumGMatrices*sizeof(HMatrix *));
+     for(int ng=0; ng<NumGMatrices; ng++)
+      Data->WGMatrices[nw][ng]
+       = new HMatrix(Data->XMatrices[ng%NumXMatrices]->NR, 18, LHM_COMPLEX);
+   };
+  Data->NumWorkspaces = NumWorkspaces;
+
+  Log("Allocated %i BEM workspaces for concurrent BZ integration",NumWorkspaces);
+}
+
@@ -108,21 +108,55 @@ void WriteData(SLDData *Data, cdouble Omega, double *kBloch,
     WriteData(Data, Omega, kBloch, FileType, nt, nm, Result, Error);
 }
 
+/***************************************************************/
+/* write the results at a single (Omega, kBloch) point to the  */
+/* kBloch-resolved data file for PBC geometries, or to the     */
+/* LDOS data file otherwise                                    */
+/***************************************************************/
+static void WriteResults(SLDData *Data, cdouble Omega, double *kBloch,
+                         double *Result)
+{
+  for(int nt=0; nt<Data->NumTransforms; nt++)
+   for(int nm=0; nm<Data->NumXMatrices; nm++)
+    if (Data->G->LDim>0)
+     {
+#ifdef USE_OPENMP
+#pragma omp critical(LDOSOutput)
+#endif
+       WriteData(Data, Omega, kBloch, FILETYPE_BYK, nt, nm, Result, 0);
+     }
+    else
+     WriteData(Data, Omega, 0,      FILETYPE_LDOS, nt, nm, Result, 0);
+}
+
 /***************************************************************/
 /* routine to compute the LDOS at a single (Omega, kBloch)     */
 /* point (but typically multiple spatial evaluation points)    */
 /***************************************************************/
 void GetLDOS(void *pData, cdouble Omega, double *kBloch,
              double *Result)
+{
+  GetLDOS(pData, 0, Omega, kBloch, Result);
+}
+
+/***************************************************************/
+/* same as above, but using BEM workspace nw; calls with       */
+/* different values of nw may run concurrently (periodic       */
+/* geometries without transformations only)                    */
+/***************************************************************/
+void GetLDOS(void *pData, int nw, cdouble Omega, double *kBloch,
+             double *Result)
 {
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   SLDData *Data        = (SLDData *)pData;
   RWGGeometry *G       = Data->G;
-  HMatrix *M           = Data->M;
+  HMatrix *M           = nw==0 ? Data->M : Data->WMatrices[nw];
+  CompressedBEMMatrix *CM = Data->CM;
   HMatrix **XMatrices  = Data->XMatrices;
-  HMatrix **GMatrices  = Data->GMatrices;
+  HMatrix **GMatrices  = nw==0 ? Data->GMatrices : Data->WGMatrices[nw];
+  HMatrix **RFBuffers  = Data->WRFBuffers + 2*nw;
   int NumXMatrices     = Data->NumXMatrices;
   void **ABMBCache     = Data->ABMBCache;
   MatProp *HalfSpaceMP = Data->HalfSpaceMP;
@@ -145,6 +179,15 @@ void GetLDOS(void *pData, cdouble Omega, double *kBloch,
      case 2: Log("Computing LDOS at (Omega,kx,ky)=(%s,%e,%e),",z2s(Omega),kBloch[0],kBloch[1]);
    };
 
+  /*--------------------------------------------------------------*/
+  /*- skip the calculation if it was done by an earlier run       */
+  /*--------------------------------------------------------------*/
+  if ( Data->RS && Data->RS->Lookup("LDOS", Omega, kBloch, Result) )
+   { Log(" ...found in result store");
+     WriteResults(Data, Omega, kBloch, Result);
+     return;
+   };
+
   /*--------------------------------------------------------------*/
   /*- assemble the BEM matrix at this frequency and Bloch vector, */
   /*- then get DGFs at all evaluation points                      */
@@ -163,6 +206,27 @@ void GetLDOS(void *pData, cdouble Omega, double *kBloch,
       GetGroundPlaneDGFs(XMatrices[nm], Omega, kBloch,
                          LBasis, GMatrices[nm]);
    }
+  else if (CM)
+   { 
+     // compressed BEM matrix: reassemble from scratch at each transformation
+     for(int nt=0; nt<NumTransforms; nt++)
+      { 
+        if (NumTransforms>1)
+         { G->Transform(Data->GTCs[nt]);
+           Log("Working at transformation %s...",Data->GTCs[nt]->Tag);
+         };
+
+        G->AssembleCompressedBEMMatrix(Omega, CM);
+        CM->LUFactorize();
+        for(int nm=0; nm<NumXMatrices; nm++)
+         G->GetDyadicGFs(Omega, kBloch, XMatrices[nm], CM,
+                         GMatrices[nt*NumXMatrices + nm],
+                         ScatteringOnly, RFBuffers);
+
+        if (NumTransforms>1)
+         G->UnTransform();
+      };
+   }
   else if (NumTransforms==1)
    { 
      if (LDim==0)
@@ -187,7 +251,7 @@ void GetLDOS(void *pData, cdouble Omega, double *kBloch,
      M->LUFactorize();
      for(int nm=0; nm<NumXMatrices; nm++)
       G->GetDyadicGFs(Omega, kBloch, XMatrices[nm], M, GMatrices[nm],
-                      ScatteringOnly);
+                      ScatteringOnly, RFBuffers);
    }
   else 
    {
@@ -225,7 +289,7 @@ void GetLDOS(void *pData, cdouble Omega, double *kBloch,
         for(int nm=0; nm<NumXMatrices; nm++)
          G->GetDyadicGFs(Omega, kBloch, XMatrices[nm], M,
                          GMatrices[nt*NumXMatrices + nm],
-                         ScatteringOnly);
+                         ScatteringOnly, RFBuffers);
 
         G->UnTransform();
       };
@@ -242,7 +306,7 @@ void GetLDOS(void *pData, cdouble Omega, double *kBloch,
    for(int nm=0; nm<NumXMatrices; nm++)
     { 
       HMatrix *XMatrix = Data->XMatrices[nm];
-      HMatrix *GMatrix = Data->GMatrices[nt*NumXMatrices + nm];
+      HMatrix *GMatrix = GMatrices[nt*NumXMatrices + nm];
       for(int nx=0; nx<XMatrix->NR; nx++)
        { cdouble GE[3][3], GM[3][3];
          for(int i=0; i<3; i++)
@@ -270,15 +334,11 @@ void GetLDOS(void *pData, cdouble Omega, double *kBloch,
  
        }; // for(int nx=0; nx<XMatrix->NR; nx++)
  
-    /***************************************************************/
-    /* write output to kBloch-resolved data file for PBC geometries*/
-    /*  or the tput to kBloch-resolved data file for PBC geometries*/
-    /***************************************************************/
-    if (LDim>0)
-     WriteData(Data, Omega, kBloch, FILETYPE_BYK, nt, nm, Result, 0);
-    else
-     WriteData(Data, Omega, 0,      FILETYPE_LDOS, nt, nm, Result, 0);
-
    }; // for(int nm=0; nm<NumXMatrices; nm++)
 
+  WriteResults(Data, Omega, kBloch, Result);
+
+  if (Data->RS)
+   Data->RS->Append("LDOS", Omega, kBloch, Result);
+
 }
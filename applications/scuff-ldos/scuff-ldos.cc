@@ -80,6 +80,10 @@ int main(int argc, char *argv[])
   char *FileBase=0;
   bool LDOSOnly=false;
   bool FullTPDGF=false;
+/**/
+  double CompressionTol=0.0;
+/**/
+  char *ResultStoreFile=0;
 /**/
   /* name        type    #args  max_instances  storage    count  description*/
   OptStruct OSArray[]=
@@ -106,6 +110,9 @@ int main(int argc, char *argv[])
      {"FileBase",    PA_STRING,  1, 1, (void *)&FileBase,      0,  "base name for output files"},
      {"LDOSOnly",    PA_BOOL,    0, 1, (void *)&LDOSOnly,      0,  "omit DGF components from Brillouin-zone integration"},
      {"FullTPDGF",   PA_BOOL,    0, 1, (void *)&FullTPDGF,     0,  "compute full (bare+scattered) two-point DGF (default is scattering part only)"},
+/**/
+     {"CompressionTol", PA_DOUBLE, 1, 1, (void *)&CompressionTol, 0, "use H-matrix (ACA) compressed BEM matrix with this relative tolerance"},
+     {"ResultStore", PA_STRING,  1, 1, (void *)&ResultStoreFile, 0,  "binary file of computed results for resuming runs"},
      {0,0,0,0,0,0,0}
    };
   ProcessOptions(argc, argv, OSArray);
@@ -158,7 +165,7 @@ int main(int argc, char *argv[])
   /* computational routines                                      */
   /***************************************************************/
   SLDData *Data     = CreateSLDData(GeoFile, TransFile, 
-                                    EPFiles, nEPFiles);
+                                    EPFiles, nEPFiles, CompressionTol);
   Data->RelTol      = RelTol;
   Data->AbsTol      = AbsTol;
   Data->MaxEvals    = MaxEvals;
@@ -184,6 +191,26 @@ int main(int argc, char *argv[])
   int FDim       = NX*NFun;
   double *Result = (double *)mallocEC(FDim*sizeof(double));
 
+  /***************************************************************/
+  /* open the result store, keyed by everything that affects the */
+  /* values returned by GetLDOS                                  */
+  /***************************************************************/
+  if (ResultStoreFile)
+   { uint64_t ContextHash=GetGeometryHash(Data->G);
+     for(int nm=0; nm<Data->NumXMatrices; nm++)
+      { HMatrix *X=Data->XMatrices[nm];
+        ContextHash=HashBytes(X->DM, X->NR*X->NC*sizeof(double), ContextHash);
+      };
+     for(int nt=0; nt<Data->NumTransforms; nt++)
+      ContextHash=HashBytes(Data->GTCs[nt]->Tag, strlen(Data->GTCs[nt]->Tag), ContextHash);
+     bool Flags[3]={Data->LDOSOnly, Data->ScatteringOnly, GroundPlane};
+     ContextHash=HashBytes(Flags, sizeof(Flags), ContextHash);
+     if (HalfSpace)
+      ContextHash=HashBytes(HalfSpace, strlen(HalfSpace), ContextHash);
+     Data->RS=new ResultStore(ResultStoreFile, ContextHash,
+                              Data->NumTransforms*FDim, LDim);
+   };
+
   /***************************************************************/
   /* now switch off to figure out what to do:                    */
   /*  1. if we have a non-periodic geometry, simply evaluate     */
@@ -238,7 +265,14 @@ int main(int argc, char *argv[])
      BZIArgs->BZIFunc     = GetLDOS;
      BZIArgs->UserData    = (void *)Data;
      BZIArgs->FDim        = FDim;
+
+     // kBloch points may be evaluated concurrently except when
+     // we have geometrical transformations, which modify G
+     if (Data->NumTransforms==1)
+      BZIArgs->BZIFuncW   = GetLDOS;
      UpdateBZIArgs(BZIArgs, Data->G->RLBasis, Data->G->RLVolume);
+     if (BZIArgs->NumWorkspaces>1)
+      AllocateWorkspaces(Data, BZIArgs->NumWorkspaces);
 
      /***************************************************************/
      /***************************************************************/
@@ -251,4 +285,7 @@ int main(int argc, char *argv[])
       };
    };
 
+  if (Data->RS)
+   delete Data->RS;
+
 }
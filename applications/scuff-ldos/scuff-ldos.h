@@ -45,6 +45,7 @@ typedef struct SLDData
    // data on the BEM geometry and linear algebra workspaces
    RWGGeometry *G;
    HMatrix *M;
+   CompressedBEMMatrix *CM; // if non-NULL, used instead of M
 
    // data on evaluation points and DGFs at evaluation points
    HMatrix **XMatrices, **GMatrices;
@@ -61,6 +62,19 @@ typedef struct SLDData
    // fields relevant for periodic geometries
    void **ABMBCache;
 
+   // additional BEM matrices and DGF buffers for concurrent
+   // Brillouin-zone integration; workspace 0 is M, GMatrices.
+   // WRFBuffers[2*nw + 0,1] are the reduced-field buffers
+   // passed to GetDyadicGFs by workspace nw (including nw=0)
+   int NumWorkspaces;
+   HMatrix **WMatrices;
+   HMatrix ***WGMatrices;
+   HMatrix **WRFBuffers;
+
+   // if non-null, results at each (Omega, kBloch) are saved
+   // here and looked up before being recomputed
+   ResultStore *RS;
+
    // other miscellaneous options
    char *FileBase;
    double RelTol, AbsTol;
@@ -84,7 +98,9 @@ typedef struct SLDData
 void WriteFilePreamble(char *FileName, int FileType, int LDim, 
                        bool HaveGTCList, bool TwoPointDGF);
 SLDData *CreateSLDData(char *GeoFile, char *TransFile,
-                       char **EPFiles, int nEPFiles);
+                       char **EPFiles, int nEPFiles,
+                       double CompressionTol=0.0);
+void AllocateWorkspaces(SLDData *Data, int NumWorkspaces);
 
 // GetLDOS.cc
 void WriteData(SLDData *Data, cdouble Omega, double *kBloch,
@@ -94,6 +110,8 @@ void WriteData(SLDData *Data, cdouble Omega, double *kBloch,
                int FileType, double *Result, double *Error);
 void GetLDOS(void *Data, cdouble Omega, double *kBloch, 
              double *Result);
+void GetLDOS(void *Data, int nw, cdouble Omega, double *kBloch,
+             double *Result);
 
 /***************************************************************/
 // AnalyticalDGFs.cc
@@ -73,11 +73,13 @@ void WriteSIFluxFilePreamble(SNEQData *SNEQD, char *FileName, bool ByRegion=fals
 /***************************************************************/
 SNEQData *CreateSNEQData(char *GeoFile, char *TransFile,
                          int *PFTMethods, int NumPFTMethods,
-                         char *EPFile, char *pFileBase)
+                         char *EPFile, char *pFileBase,
+                         double CompressionTol)
 {
 
   SNEQData *SNEQD=(SNEQData *)mallocEC(sizeof(*SNEQD));
   SNEQD->WriteCache=0;
+  SNEQD->RS=0;
   SNEQD->SourceOnly=-1;
   SNEQD->DestOnly=-1;
 
@@ -86,6 +88,7 @@ SNEQData *CreateSNEQData(char *GeoFile, char *TransFile,
   /*--------------------------------------------------------------*/
   RWGGeometry *G=new RWGGeometry(GeoFile);
   SNEQD->G=G;
+  SNEQD->CM = CompressionTol>0.0 ? G->AllocateCompressedBEMMatrix(CompressionTol) : 0;
   
   if (pFileBase)
    SNEQD->FileBase = strdup(pFileBase);
@@ -199,7 +202,7 @@ SNEQData *CreateSNEQData(char *GeoFile, char *TransFile,
 
      for(int nsp=ns+1; nsp<G->NumSurfaces; nsp++, nb++)
       { int NBFp=G->Surfaces[nsp]->NumBFs;
-        SNEQD->U[nb] = new HMatrix(NBF, NBFp, LHM_COMPLEX);
+        SNEQD->U[nb] = SNEQD->CM ? 0 : new HMatrix(NBF, NBFp, LHM_COMPLEX);
       };
    };
   Log("After T, U blocks: mem=%3.1f GB",GetMemoryUsage()/1.0e9);
@@ -207,7 +210,7 @@ SNEQData *CreateSNEQData(char *GeoFile, char *TransFile,
   /*--------------------------------------------------------------*/
   /*- allocate BEM matrix and dressed Rytov matrix ---------------*/
   /*--------------------------------------------------------------*/
-  SNEQD->M        = new HMatrix(G->TotalBFs, G->TotalBFs, LHM_COMPLEX );
+  SNEQD->M        = SNEQD->CM ? 0 : new HMatrix(G->TotalBFs, G->TotalBFs, LHM_COMPLEX );
   SNEQD->DRMatrix = new HMatrix(G->TotalBFs, G->TotalBFs, LHM_COMPLEX );
   Log("After W, Rytov: mem=%3.1f GB",GetMemoryUsage()/1.0e9);
 
@@ -44,6 +44,35 @@ void UndoSCUFFMatrixTransformation(HMatrix *M)
     };
 }
 
+/***************************************************************/
+/* Replace X with M\X, where M is the BEM matrix with the SCUFF */
+/* matrix transformation undone. For the dense matrix this was */
+/* done explicitly before factorization; for the compressed    */
+/* matrix and the sweep solver, which store the untransformed  */
+/* matrix, we instead rescale the rows of X before and after   */
+/* the solve.                                                  */
+/***************************************************************/
+void LUSolveUndone(SNEQData *SNEQD, HMatrix *X)
+{
+  if (SNEQD->CM==0 && SNEQD->SS==0)
+   { SNEQD->M->LUSolve(X);
+     return;
+   };
+
+  for(int nr=0; nr<X->NR; nr+=2)
+   for(int nc=0; nc<X->NC; nc++)
+    X->SetEntry(nr, nc, X->GetEntry(nr,nc)/ZVAC);
+
+  if (SNEQD->CM)
+   SNEQD->CM->LUSolve(X);
+  else
+   SNEQD->SS->LUSolve(X);
+
+  for(int nr=1; nr<X->NR; nr+=2)
+   for(int nc=0; nc<X->NC; nc++)
+    X->SetEntry(nr, nc, -1.0*ZVAC*X->GetEntry(nr,nc));
+}
+
 /***************************************************************/
 /* Compute the dressed Rytov matrix for sources contained in   */
 /* SourceSurface. The matrix is stored in the DRMatrix         */
@@ -55,7 +84,6 @@ void ComputeDRMatrix(SNEQData *SNEQD, int SourceSurface)
   Log("...computing DR matrix");
 
   RWGGeometry *G  = SNEQD->G;
-  HMatrix *M      = SNEQD->M;
   HMatrix *DR     = SNEQD->DRMatrix;
 
   int NBFS        = G->Surfaces[SourceSurface]->NumBFs;
@@ -103,9 +131,9 @@ void ComputeDRMatrix(SNEQData *SNEQD, int SourceSurface)
   /* set DR = W * DR * W' ****************************************/
   /* by computing DR = M \ (M \ DR)'       ***********************/
   /***************************************************************/
-  M->LUSolve(DR);
+  LUSolveUndone(SNEQD, DR);
   DR->Adjoint();
-  M->LUSolve(DR);
+  LUSolveUndone(SNEQD, DR);
 
   Log("...done with DR matrix");
 }
@@ -197,6 +225,125 @@ int GetSIFlux(SNEQData *SNEQD, int SourceSurface, cdouble Omega,
 
 } 
 
+/***************************************************************/
+/* write the spatially-integrated fluxes from source surface   */
+/* nss into all destination surfaces, as computed by PFT method*/
+/* npm, to the SIFlux file, and add them to the region-resolved*/
+/* totals if those were requested                              */
+/***************************************************************/
+void WriteSIFluxData(SNEQData *SNEQD, char *Tag, cdouble Omega, double *kBloch,
+                     int nss, int npm, HMatrix *PFTMatrix)
+{
+  RWGGeometry *G = SNEQD->G;
+  int NS         = G->NumSurfaces;
+  int NR         = G->NumRegions;
+
+  FILE *f=vfopen(SNEQD->SIFluxFileNames[npm],"a");
+  for(int nsd=0; nsd<NS; nsd++)
+   { 
+     fprintf(f,"%s %e ",Tag,real(Omega));
+     if (kBloch) fprintVec(f,kBloch,G->LDim);
+     fprintf(f,"%i%i ",nss+1,nsd+1);
+     for(int nq=0; nq<NUMPFT; nq++)
+      fprintf(f,"%+.8e ",PFTMatrix->GetEntryD(nsd,nq));
+     fprintf(f,"\n");
+   };
+  fclose(f);
+
+  HMatrix *PFTByRegion     = SNEQD->PFTByRegion;
+  HMatrix *RegionRegionPFT = SNEQD->RegionRegionPFT ? SNEQD->RegionRegionPFT[npm] : 0;
+  if (PFTByRegion && RegionRegionPFT)
+   { GetPFTByRegion(G, PFTMatrix, PFTByRegion);
+     int nsr1 = G->Surfaces[nss]->RegionIndices[0]; // source region 1
+     int nsr2 = G->Surfaces[nss]->RegionIndices[1]; // source region 2
+     for(int ndr=0; ndr<NR; ndr++) // ndr = destination region
+      for(int nq=0; nq<NUMPFT; nq++)
+       { double PFT = PFTByRegion->GetEntryD(ndr, nq);
+         if (nsr1!=0)
+          RegionRegionPFT->AddEntry( (nsr1+1)*(NR+1) + ndr+1, nq, PFT);
+         if (nsr2!=0)
+          RegionRegionPFT->AddEntry( (nsr2+1)*(NR+1) + ndr+1, nq, PFT);
+       };
+   };
+}
+
+/***************************************************************/
+/* add up the region-resolved totals accumulated by            */
+/* WriteSIFluxData and write them to the .byRegion files       */
+/***************************************************************/
+void WriteByRegionData(SNEQData *SNEQD, char *Tag, cdouble Omega, double *kBloch)
+{
+  RWGGeometry *G = SNEQD->G;
+  int NR         = G->NumRegions;
+
+  for(int npm=0; npm<SNEQD->NumPFTMethods; npm++)
+   { 
+     HMatrix *RegionRegionPFT = SNEQD->RegionRegionPFT[npm];
+     for(int nsr=0; nsr<NR; nsr++)
+      for(int ndr=0; ndr<NR; ndr++)
+       for(int nq=0; nq<NUMPFT; nq++)
+        { double PFT=RegionRegionPFT->GetEntryD( (nsr+1)*(NR+1) + ndr+1, nq);
+          RegionRegionPFT->AddEntry( 0*(NR+1) + ndr+1, nq, PFT );
+          RegionRegionPFT->AddEntry( 0*(NR+1) +     0, nq, PFT );
+        };
+
+     FILE *f=vfopen("%s.byRegion","a",SNEQD->SIFluxFileNames[npm]);
+     for(int nsr=0; nsr<=NR; nsr++) // ndr = number of destination region
+      for(int ndr=0; ndr<=NR; ndr++) // ndr = number of destination region
+       { fprintf(f,"%s %e ",Tag,real(Omega));
+         if (kBloch) fprintVec(f,kBloch,G->LDim);
+         fprintf(f,"%i%i ",nsr,ndr);
+         for(int nq=0; nq<NUMPFT; nq++)
+          fprintf(f,"%+.8e ",RegionRegionPFT->GetEntryD( nsr*(NR+1) + ndr, nq));
+         fprintf(f,"\n");
+       };
+     fclose(f);
+   };
+}
+
+/***************************************************************/
+/* write the SIFlux and .byRegion output for transformation #nt*/
+/* from the values found in the result store, skipping the     */
+/* same (source, method) pairs as the calculation itself       */
+/***************************************************************/
+void WriteStoredFlux(SNEQData *SNEQD, int nt, cdouble Omega, double *kBloch,
+                     double *RSValues)
+{
+  RWGGeometry *G = SNEQD->G;
+  int NS         = G->NumSurfaces;
+  char *Tag      = SNEQD->GTCs[nt]->Tag;
+  if ( !SNEQD->RS->Lookup(Tag, Omega, kBloch, RSValues) )
+   return;
+
+  if (SNEQD->RegionRegionPFT)
+   for(int npm=0; npm<SNEQD->NumPFTMethods; npm++)
+    SNEQD->RegionRegionPFT[npm]->Zero();
+
+  HMatrix *PFTMatrix = SNEQD->PFTMatrix;
+  for(int nss=0; nss<NS; nss++)
+   { 
+     if ( SNEQD->SourceOnly!=-1 && nss!=SNEQD->SourceOnly )
+      continue;
+     if (G->Surfaces[nss]->IsPEC) 
+      continue;
+
+     for(int npm=0; npm<SNEQD->NumPFTMethods; npm++)
+      { 
+        if (    SNEQD->PFTMethods[npm]==SCUFF_PFT_DSI
+             && !DoDSIAtThisFrequency(SNEQD, Omega)
+           ) continue;
+
+        for(int nsd=0; nsd<NS; nsd++)
+         PFTMatrix->SetEntriesD(nsd, ":",
+                                RSValues + ((npm*NS + nss)*NS + nsd)*NUMPFT);
+        WriteSIFluxData(SNEQD, Tag, Omega, kBloch, nss, npm, PFTMatrix);
+      };
+   };
+
+  if (SNEQD->RegionRegionPFT)
+   WriteByRegionData(SNEQD, Tag, Omega, kBloch);
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -212,9 +359,41 @@ void WriteFlux(SNEQData *SNEQD, cdouble Omega, double *kBloch)
   HMatrix **U         = SNEQD->U;
   int NS              = SNEQD->G->NumSurfaces;
   char *FileBase      = SNEQD->FileBase;
+  int NT              = SNEQD->NumTransformations;
+  ResultStore *RS     = SNEQD->RS;
 
   Log("Computing neq quantities at omega=%s...",z2s(Omega));
 
+  /***************************************************************/
+  /* if a result store is present, find out which transforms     */
+  /* were already done by an earlier run; if all of them were,    */
+  /* we don't need to assemble anything at this frequency.        */
+  /* the SIFlux values for a single transform are stored as one   */
+  /* record, indexed [npm][nss][nsd][nq].                         */
+  /***************************************************************/
+  int NumPFTMethods = SNEQD->NumPFTMethods;
+  int RSDim         = NumPFTMethods*NS*NS*NUMPFT;
+  double *RSValues  = 0;
+  bool *Done        = 0;
+  if (RS)
+   { RSValues = (double *)mallocEC(RSDim*sizeof(double));
+     Done     = (bool *)mallocEC(NT*sizeof(bool));
+     int NumDone=0;
+     for(int nt=0; nt<NT; nt++)
+      if ( (Done[nt]=RS->Lookup(SNEQD->GTCs[nt]->Tag, Omega, kBloch, RSValues)) )
+       NumDone++;
+     if (NumDone==NT)
+      { Log(" ...all transforms found in result store");
+        for(int nt=0; nt<NT; nt++)
+         WriteStoredFlux(SNEQD, nt, Omega, kBloch, RSValues);
+        free(RSValues);
+        free(Done);
+        return;
+      };
+     if (NumDone>0)
+      Log(" %i/%i transforms found in result store",NumDone,NT);
+   };
+
   /***************************************************************/
   /* preinitialize an argument structure for the BEM matrix      */
   /* block assembly routine                                      */
@@ -239,25 +418,29 @@ void WriteFlux(SNEQData *SNEQD, cdouble Omega, double *kBloch)
      else
       Log(" Assembling self contributions to T(%i)...",ns);
 
-     if ( !(G->Surfaces[ns]->IsPEC) )
-      { G->RegionMPs[ G->Surfaces[ns]->RegionIndices[1] ]->UnZero();
-        G->AssembleBEMMatrixBlock(ns, ns, Omega, kBloch, TInt[ns]);
-        G->RegionMPs[ G->Surfaces[ns]->RegionIndices[1] ]->Zero();
-      };
-
-     G->RegionMPs[ G->Surfaces[ns]->RegionIndices[0] ]->UnZero();
-     G->AssembleBEMMatrixBlock(ns, ns, Omega, kBloch, TExt[ns]);
-     G->RegionMPs[ G->Surfaces[ns]->RegionIndices[0] ]->Zero();
+     G->AssembleSelfBlocks(ns, Omega, kBloch, TExt[ns], TInt[ns]);
    };
   for(int nr=0; nr<G->NumRegions; nr++)
    G->RegionMPs[nr]->UnZero();
 
+  // with the sweep solver, the diagonal blocks are factorized
+  // once here and reused for all transformations
+  if (SNEQD->SS)
+   for(int ns=0; ns<NS; ns++)
+    SNEQD->SS->SetTBlock(ns, TExt[ns], G->Surfaces[ns]->IsPEC ? 0 : TInt[ns]);
+
   /***************************************************************/
   /* now loop over transformations.                              */
   /* note: 'gtc' stands for 'geometrical transformation complex' */
   /***************************************************************/
-  for(int nt=0; nt<SNEQD->NumTransformations; nt++)
+  bool UAssembled=false;
+  for(int nt=0; nt<NT; nt++)
    { 
+     if (Done && Done[nt])
+      { WriteStoredFlux(SNEQD, nt, Omega, kBloch, RSValues);
+        continue;
+      };
+
      /*--------------------------------------------------------------*/
      /*- transform the geometry -------------------------------------*/
      /*--------------------------------------------------------------*/
@@ -266,37 +449,57 @@ void WriteFlux(SNEQData *SNEQD, cdouble Omega, double *kBloch)
      Log(" Computing quantities at geometrical transform %s",Tag);
 
      /*--------------------------------------------------------------*/
-     /* assemble off-diagonal matrix blocks.                         */
-     /* note that not all off-diagonal blocks necessarily need to    */
-     /* be recomputed for all transformations; this is what the 'if' */
-     /* statement here is checking for.                              */
+     /*- with the compressed BEM matrix, the full matrix is         -*/
+     /*- reassembled and refactorized at each transformation        -*/
      /*--------------------------------------------------------------*/
-     Args->Symmetric=0;
-     for(int nb=0, ns=0; ns<NS; ns++)
-      for(int nsp=ns+1; nsp<NS; nsp++, nb++)
-       if ( nt==0 || G->SurfaceMoved[ns] || G->SurfaceMoved[nsp] )
-        G->AssembleBEMMatrixBlock(ns, nsp, Omega, kBloch, U[nb]);
-     Log("...SN done with ABMB");
+     if (SNEQD->CM)
+      { G->AssembleCompressedBEMMatrix(Omega, SNEQD->CM);
+        Log("LU factorizing compressed BEM matrix...");
+        SNEQD->CM->LUFactorize();
+      }
+     else
+      {
 
-     /*--------------------------------------------------------------*/
-     /*- stamp all blocks into the BEM matrix and LU-factorize      -*/
-     /*--------------------------------------------------------------*/
-     for(int nb=0, ns=0; ns<NS; ns++)
-      { 
-        int RowOffset=G->BFIndexOffset[ns];
-        M->InsertBlock(TExt[ns], RowOffset, RowOffset);
-        if( !(G->Surfaces[ns]->IsPEC) )
-         M->AddBlock(TInt[ns], RowOffset, RowOffset);
-
-        for(int nsp=ns+1; nsp<NS; nsp++, nb++)
-         { int ColOffset=G->BFIndexOffset[nsp];
-           M->InsertBlock(U[nb], RowOffset, ColOffset);
-           M->InsertBlockTranspose(U[nb], ColOffset, RowOffset);
+        /*--------------------------------------------------------------*/
+        /* assemble off-diagonal matrix blocks.                         */
+        /* note that not all off-diagonal blocks necessarily need to    */
+        /* be recomputed for all transformations; this is what the 'if' */
+        /* statement here is checking for.                              */
+        /*--------------------------------------------------------------*/
+        Args->Symmetric=0;
+        for(int nb=0, ns=0; ns<NS; ns++)
+         for(int nsp=ns+1; nsp<NS; nsp++, nb++)
+          if ( !UAssembled || G->SurfaceMoved[ns] || G->SurfaceMoved[nsp] )
+           G->AssembleBEMMatrixBlock(ns, nsp, Omega, kBloch, U[nb]);
+        UAssembled=true;
+        Log("...SN done with ABMB");
+
+        /*--------------------------------------------------------------*/
+        /*- the sweep solver only needs to compress the U blocks and   -*/
+        /*- update its factorization; otherwise, stamp all blocks into -*/
+        /*- the BEM matrix and LU-factorize                            -*/
+        /*--------------------------------------------------------------*/
+        if (SNEQD->SS)
+         SNEQD->SS->Factorize(U);
+        else
+         { for(int nb=0, ns=0; ns<NS; ns++)
+            { 
+              int RowOffset=G->BFIndexOffset[ns];
+              M->InsertBlock(TExt[ns], RowOffset, RowOffset);
+              if( !(G->Surfaces[ns]->IsPEC) )
+               M->AddBlock(TInt[ns], RowOffset, RowOffset);
+
+              for(int nsp=ns+1; nsp<NS; nsp++, nb++)
+               { int ColOffset=G->BFIndexOffset[nsp];
+                 M->InsertBlock(U[nb], RowOffset, ColOffset);
+                 M->InsertBlockTranspose(U[nb], ColOffset, RowOffset);
+               };
+            };
+           UndoSCUFFMatrixTransformation(M);
+           Log("LU factorizing...");
+           M->LUFactorize();
          };
-      };
-     UndoSCUFFMatrixTransformation(M);
-     Log("LU factorizing...");
-     M->LUFactorize();
+      }; // if (SNEQD->CM) ... else ...
 
      /*--------------------------------------------------------------*/
      /*- compute the requested quantities for all objects           -*/
@@ -304,15 +507,14 @@ void WriteFlux(SNEQData *SNEQD, cdouble Omega, double *kBloch)
      /*-       nsd = 'num surface, destination'                     -*/
      /*--------------------------------------------------------------*/
      int SourceOnly            = SNEQD->SourceOnly;
-     int NumPFTMethods         = SNEQD->NumPFTMethods;
      int *PFTMethods           = SNEQD->PFTMethods;
      HMatrix *PFTMatrix        = SNEQD->PFTMatrix;
-     HMatrix *PFTByRegion      = SNEQD->PFTByRegion;
      HMatrix **RegionRegionPFT = SNEQD->RegionRegionPFT;
-     int NR = G->NumRegions;
      if (RegionRegionPFT)
       for(int npm=0; npm<NumPFTMethods; npm++)
        RegionRegionPFT[npm]->Zero();
+     if (RSValues)
+      memset(RSValues, 0, RSDim*sizeof(double));
      for(int nss=0; nss<NS; nss++)
       {
         if ( SourceOnly!=-1 && nss!=SourceOnly )
@@ -334,31 +536,12 @@ void WriteFlux(SNEQData *SNEQD, cdouble Omega, double *kBloch)
            if (Status==0)
             continue;
 
-           FILE *f=vfopen(SNEQD->SIFluxFileNames[npm],"a");
-           for(int nsd=0; nsd<NS; nsd++)
-            { 
-              fprintf(f,"%s %e ",Tag,real(Omega));
-              if (kBloch) fprintVec(f,kBloch,G->LDim);
-              fprintf(f,"%i%i ",nss+1,nsd+1);
-              for(int nq=0; nq<NUMPFT; nq++)
-               fprintf(f,"%+.8e ",PFTMatrix->GetEntryD(nsd,nq));
-              fprintf(f,"\n");
-            };
-           fclose(f);
-
-           if (PFTByRegion)
-            { GetPFTByRegion(G, PFTMatrix, PFTByRegion);
-              int nsr1 = G->Surfaces[nss]->RegionIndices[0]; // source region 1
-              int nsr2 = G->Surfaces[nss]->RegionIndices[1]; // source region 2
-              for(int ndr=0; ndr<NR; ndr++) // ndr = destination region
-               for(int nq=0; nq<NUMPFT; nq++)
-                { double PFT = PFTByRegion->GetEntryD(ndr, nq);
-                  if (nsr1!=0)
-                   RegionRegionPFT[npm]->AddEntry( (nsr1+1)*(NR+1) + ndr+1, nq, PFT);
-                  if (nsr2!=0)
-                   RegionRegionPFT[npm]->AddEntry( (nsr2+1)*(NR+1) + ndr+1, nq, PFT);
-                };
-            };
+           WriteSIFluxData(SNEQD, Tag, Omega, kBloch, nss, npm, PFTMatrix);
+
+           if (RSValues)
+            for(int nsd=0; nsd<NS; nsd++)
+             PFTMatrix->GetEntriesD(nsd, ":",
+                                    RSValues + ((npm*NS + nss)*NS + nsd)*NUMPFT);
          };
 
         // compute spatially-resolved flux quantities for
@@ -390,35 +573,15 @@ void WriteFlux(SNEQData *SNEQD, cdouble Omega, double *kBloch)
 
       }; // for(int nss=0; nss<NS; nss++)
 
-     if (PFTByRegion)
-      for(int npm=0; npm<NumPFTMethods; npm++)
-       { 
-         for(int nsr=0; nsr<NR; nsr++)
-          for(int ndr=0; ndr<NR; ndr++)
-           for(int nq=0; nq<NUMPFT; nq++)
-            { double PFT=RegionRegionPFT[npm]->GetEntryD( (nsr+1)*(NR+1) + ndr+1, nq);
-              RegionRegionPFT[npm]->AddEntry( 0*(NR+1) + ndr+1, nq, PFT );
-              RegionRegionPFT[npm]->AddEntry( 0*(NR+1) +     0, nq, PFT );
-            };
-
-         FILE *f=vfopen("%s.byRegion","a",SNEQD->SIFluxFileNames[npm]);
-         for(int nsr=0; nsr<=NR; nsr++) // ndr = number of destination region
-          for(int ndr=0; ndr<=NR; ndr++) // ndr = number of destination region
-           { fprintf(f,"%s %e ",Tag,real(Omega));
-             if (kBloch) fprintVec(f,kBloch,G->LDim);
-             fprintf(f,"%i%i ",nsr,ndr);
-             for(int nq=0; nq<NUMPFT; nq++)
-              fprintf(f,"%+.8e ",RegionRegionPFT[npm]->GetEntryD( nsr*(NR+1) + ndr, nq));
-             fprintf(f,"\n");
-           };
-          fclose(f);
-       };
-         
+     if (RegionRegionPFT)
+      WriteByRegionData(SNEQD, Tag, Omega, kBloch);
 
      /*--------------------------------------------------------------*/
      /* untransform the geometry                                     */
      /*--------------------------------------------------------------*/
      G->UnTransform();
+     if (RS)
+      RS->Append(Tag, Omega, kBloch, RSValues);
      Log(" ...done!");
 
   }; // for (nt=0; nt<SNEQD->NumTransformations... )
@@ -433,4 +596,9 @@ void WriteFlux(SNEQData *SNEQD, cdouble Omega, double *kBloch)
      SNEQD->WriteCache=0;
    };
 
+  if (RS)
+   { free(RSValues);
+     free(Done);
+   };
+
 }
@@ -98,11 +98,18 @@ int main(int argc, char *argv[])
   bool PlotFlux=false;
   bool OmitSelfTerms=false;
 
+  /*--------------------------------------------------------------*/
+  double CompressionTol=0.0;
+  double SweepSolverTol=0.0;
+
   /*--------------------------------------------------------------*/
   char *Cache=0;
   char *ReadCache[MAXCACHE];         int nReadCache;
   char *WriteCache=0;
 
+  /*--------------------------------------------------------------*/
+  char *ResultStoreFile=0;
+
   /* name               type    #args  max_instances  storage           count         description*/
   OptStruct OSArray[]=
    { 
@@ -131,10 +138,15 @@ int main(int argc, char *argv[])
      {"DSIPoints2",     PA_INT,     1, 1,       (void *)&DSIPoints2, 0,             "number of cubature points for DSIPFT second opinion"},
      {"DSIMesh",        PA_STRING,  1, 1,       (void *)&DSIMesh,    0,             "bounding surface .msh file for DSIPFT"},
      {"DSIOmegaFile",   PA_STRING,  1, 1,       (void *)&DSIOmegaFile,  0,          "list of frequencies at which to perform DSI calculations"},
+/**/
+     {"CompressionTol", PA_DOUBLE,  1, 1,       (void *)&CompressionTol, 0,         "use H-matrix (ACA) compressed BEM matrix with this relative tolerance"},
+     {"SweepSolverTol", PA_DOUBLE,  1, 1,       (void *)&SweepSolverTol, 0,         "reuse T-block factorizations across transformations, compressing U blocks to this tolerance"},
 /**/
      {"Cache",          PA_STRING,  1, 1,       (void *)&Cache,      0,             "read/write cache"},
      {"ReadCache",      PA_STRING,  1, MAXCACHE,(void *)ReadCache,   &nReadCache,   "read cache"},
      {"WriteCache",     PA_STRING,  1, 1,       (void *)&WriteCache, 0,             "write cache"},
+/**/     
+     {"ResultStore",    PA_STRING,  1, 1,       (void *)&ResultStoreFile, 0,        "binary file of computed results for resuming runs"},
 /**/     
      {0,0,0,0,0,0,0}
    };
@@ -223,7 +235,7 @@ int main(int argc, char *argv[])
   /*******************************************************************/
   SNEQData *SNEQD=CreateSNEQData(GeoFile, TransFile,
                                  PFTMethods, NumPFTMethods,
-                                 EPFile, FileBase);
+                                 EPFile, FileBase, CompressionTol);
   RWGGeometry *G=SNEQD->G;
   SNEQD->PlotFlux                = PlotFlux;
   SNEQD->OmitSelfTerms           = OmitSelfTerms;
@@ -232,6 +244,16 @@ int main(int argc, char *argv[])
   SNEQD->PFTOpts.DSIFarField     = DSIFarField;
   SNEQD->DSIOmegaPoints          = DSIOmegaFile ? new HVector(DSIOmegaFile) : 0;
 
+  if (SweepSolverTol>0.0)
+   { if (CompressionTol>0.0)
+      ErrExit("--SweepSolverTol and --CompressionTol are mutually exclusive");
+     if (G->LDim>0)
+      ErrExit("--SweepSolverTol is not available for periodic geometries");
+     SNEQD->SS = new SweepSolver(G, LHM_COMPLEX, false, SweepSolverTol);
+     delete SNEQD->M;
+     SNEQD->M=0;
+   };
+
   if (OmegaKBPoints && !G->LBasis)
    ErrExit("--OmegaKBPoints may only be used with extended geometries");
   else if (G->LBasis && !OmegaKBPoints==0)
@@ -264,6 +286,33 @@ int main(int argc, char *argv[])
   if (Cache) WriteCache=Cache;
   SNEQD->WriteCache = WriteCache;
 
+  /*******************************************************************/
+  /* open the result store; records are only reused by runs with the */
+  /* same geometry and the same choice of output quantities          */
+  /*******************************************************************/
+  if (ResultStoreFile)
+   { uint64_t ContextHash=GetGeometryHash(G);
+     ContextHash=HashBytes(PFTMethods, NumPFTMethods*sizeof(int), ContextHash);
+     int IntOptions[3]={SNEQD->SourceOnly, SNEQD->DestOnly, OmitSelfTerms ? 1 : 0};
+     ContextHash=HashBytes(IntOptions, sizeof(IntOptions), ContextHash);
+     double DSIOptions[2]={DSIRadius, DSIFarField ? 1.0 : 0.0};
+     ContextHash=HashBytes(DSIOptions, sizeof(DSIOptions), ContextHash);
+     if (DSIMesh)
+      ContextHash=HashBytes(DSIMesh, strlen(DSIMesh), ContextHash);
+     if (DSIOmegaFile)
+      ContextHash=HashBytes(DSIOmegaFile, strlen(DSIOmegaFile), ContextHash);
+     // spatially-resolved and by-region outputs are written only
+     // for transforms that are actually computed, so runs that
+     // request them must not reuse records from runs that did not
+     if (EPFile)
+      ContextHash=HashBytes(EPFile, strlen(EPFile), ContextHash);
+     if (SNEQD->PFTByRegion)
+      ContextHash=HashBytes("ByRegion", 8, ContextHash);
+     SNEQD->RS=new ResultStore(ResultStoreFile, ContextHash,
+                               NumPFTMethods*G->NumSurfaces*G->NumSurfaces*NUMPFT,
+                               G->LDim);
+   };
+
   /*******************************************************************/
   /* now switch off based on the requested frequency behavior to     */
   /* perform the actual calculations.                                */
@@ -283,6 +332,9 @@ int main(int argc, char *argv[])
    for (int nFreq=0; nFreq<NumFreqs; nFreq++)
     WriteFlux(SNEQD, OmegaPoints->GetEntry(nFreq));
 
+  if (SNEQD->RS)
+   delete SNEQD->RS;
+
   /***************************************************************/
   /***************************************************************/
   /***************************************************************/
@@ -109,6 +109,8 @@ typedef struct SNEQData
    HMatrix **TInt;    // TInt[ns], TExt[ns] = interior and exterior
    HMatrix **TExt;    // contributions to BEM block for surface #ns
    HMatrix **U;       // U[nb] = // off-diagonal U-matrix block #nb 
+   CompressedBEMMatrix *CM; // if non-NULL, used instead of M and U
+   SweepSolver *SS;         // if non-NULL, used instead of M
 
    /*--------------------------------------------------------------*/
    /*- miscellaneous other options                                -*/
@@ -119,6 +121,11 @@ typedef struct SNEQData
    bool OmitSelfTerms;
    int SourceOnly, DestOnly;
 
+   // if non-null, SIFlux results for each (Tag, Omega, kBloch)
+   // are saved here, and transformations found in the store
+   // are skipped
+   ResultStore *RS;
+
  } SNEQData;
 
 /*--------------------------------------------------------------*/
@@ -126,7 +133,8 @@ typedef struct SNEQData
 /*--------------------------------------------------------------*/
 SNEQData *CreateSNEQData(char *GeoFile, char *TransFile,
                          int *PFTMethods, int NumPFTMethods,
-                         char *EPFile, char *pFileBase);
+                         char *EPFile, char *pFileBase,
+                         double CompressionTol=0.0);
 
 /*--------------------------------------------------------------*/
 /*- in GetFlux.cc ----------------------------------------------*/
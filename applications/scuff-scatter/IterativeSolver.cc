@@ -0,0 +1,388 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * IterativeSolver.cc -- krylov-subspace (GMRES, BiCGStab) solution of
+ *                    -- the BEM system with block-diagonal preconditioning,
+ *                    -- using either a dense or an MLFMA BEM matrix
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "scuff-scatter.h"
+
+#define GMRES_RESTART 50
+#define LOG_INTERVAL  10
+
+/***************************************************************/
+/* vector helpers **********************************************/
+/***************************************************************/
+static cdouble Dot(int N, cdouble *X, cdouble *Y) // X' * Y
+{ cdouble Sum=0.0;
+  for(int n=0; n<N; n++)
+   Sum += conj(X[n])*Y[n];
+  return Sum;
+}
+
+static double Norm(int N, cdouble *X)
+{ double Sum=0.0;
+  for(int n=0; n<N; n++)
+   Sum += norm(X[n]);
+  return sqrt(Sum);
+}
+
+/***************************************************************/
+/* the system operator: either a dense BEM matrix M with the   */
+/* surface-diagonal preconditioner PBlocks, or an MLFMA matrix */
+/* FM with its own near-field preconditioner                   */
+/***************************************************************/
+typedef struct SystemOperator
+ { RWGGeometry *G;
+   HMatrix *M;
+   HMatrix **PBlocks;
+   MLFMAMatrix *FM;
+   int N;
+ } SystemOperator;
+
+// Y = A*X
+static void MatVec(SystemOperator *Op, cdouble *X, cdouble *Y)
+{ HVector XV(Op->N, LHM_COMPLEX, (void *)X);
+  HVector YV(Op->N, LHM_COMPLEX, (void *)Y);
+  if (Op->FM)
+   Op->FM->Apply(&XV, &YV);
+  else
+   Op->M->Apply(&XV, &YV);
+}
+
+/***************************************************************/
+/* allocate storage for the preconditioner, which consists of  */
+/* LU-factorized copies of the diagonal (T) blocks of the BEM  */
+/* matrix. surfaces with a mate share their mate's block.      */
+/***************************************************************/
+HMatrix **CreatePreconditioner(RWGGeometry *G)
+{
+  int NS = G->NumSurfaces;
+  HMatrix **PBlocks = (HMatrix **)mallocEC(NS*sizeof(HMatrix *));
+  for(int ns=0; ns<NS; ns++)
+   { int nsMate = G->Mate[ns];
+     if (nsMate!=-1)
+      PBlocks[ns] = PBlocks[nsMate];
+     else
+      { int NBF = G->Surfaces[ns]->NumBFs;
+        PBlocks[ns] = new HMatrix(NBF, NBF, LHM_COMPLEX);
+      };
+   };
+  return PBlocks;
+}
+
+/***************************************************************/
+/* copy the diagonal blocks of M (which must have been         */
+/* assembled but not LU-factorized) into the preconditioner    */
+/* blocks and LU-factorize them. the diagonal blocks do not    */
+/* change under geometrical transformations, so this need only */
+/* be done once per frequency.                                 */
+/***************************************************************/
+void FactorizePreconditioner(RWGGeometry *G, HMatrix *M, HMatrix **PBlocks)
+{
+  Log("  LU-factorizing preconditioner blocks...");
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   { if (G->Mate[ns]!=-1) continue;
+     int Offset = G->BFIndexOffset[ns];
+     M->ExtractBlock(Offset, Offset, PBlocks[ns]);
+     PBlocks[ns]->LUFactorize();
+   };
+}
+
+/***************************************************************/
+/* X <- P^{-1} X, with P the block-diagonal preconditioner     */
+/***************************************************************/
+static void Precondition(SystemOperator *Op, cdouble *X)
+{
+  if (Op->FM)
+   { HVector XV(Op->N, LHM_COMPLEX, (void *)X);
+     Op->FM->Precondition(&XV);
+     return;
+   };
+
+  RWGGeometry *G=Op->G;
+  HMatrix **PBlocks=Op->PBlocks;
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   { int NBF    = G->Surfaces[ns]->NumBFs;
+     int Offset = G->BFIndexOffset[ns];
+     HVector XBlock(NBF, LHM_COMPLEX, (void *)(X + Offset));
+     PBlocks[ns]->LUSolve(&XBlock);
+   };
+}
+
+/***************************************************************/
+/* restarted GMRES with right preconditioning. on entry X is   */
+/* the RHS vector B; on return it is the solution.             */
+/* returns the number of iterations, or -1 if not converged.   */
+/***************************************************************/
+static int GMRES(SystemOperator *Op, cdouble *X, double Tol, int MaxIters)
+{
+  int Restart=GMRES_RESTART;
+  CheckEnv("SCUFF_GMRES_RESTART", &Restart);
+
+  int N     = Op->N;
+  int NM    = Restart;
+  cdouble *B  = (cdouble *)mallocEC(N*sizeof(cdouble));
+  cdouble *R  = (cdouble *)mallocEC(N*sizeof(cdouble));
+  cdouble *Z  = (cdouble *)mallocEC(N*sizeof(cdouble));
+  cdouble *V  = (cdouble *)mallocEC((NM+1)*N*sizeof(cdouble));
+  cdouble *H  = (cdouble *)mallocEC((NM+1)*NM*sizeof(cdouble));
+  cdouble *g  = (cdouble *)mallocEC((NM+1)*sizeof(cdouble));
+  cdouble *sn = (cdouble *)mallocEC(NM*sizeof(cdouble));
+  double *cs  = (double *)mallocEC(NM*sizeof(double));
+#define HH(i,j) H[ (i) + (j)*(NM+1) ]
+
+  memcpy(B, X, N*sizeof(cdouble));
+  memcpy(R, X, N*sizeof(cdouble));
+  memset(X, 0, N*sizeof(cdouble));
+  double BNorm = Norm(N, B);
+  if (BNorm==0.0) BNorm=1.0;
+
+  int Iters=0;
+  double Residual=Norm(N,R)/BNorm;
+  while( Residual>Tol && Iters<MaxIters )
+   {
+     /*--------------------------------------------------------------*/
+     /*- one restart cycle of Arnoldi iteration ---------------------*/
+     /*--------------------------------------------------------------*/
+     double Beta=Norm(N,R);
+     for(int n=0; n<N; n++)
+      V[n] = R[n]/Beta;
+     memset(g, 0, (NM+1)*sizeof(cdouble));
+     g[0]=Beta;
+
+     int k=0;
+     while( k<NM && Iters<MaxIters )
+      {
+        cdouble *Vk=V + k*N, *W=V + (k+1)*N;
+        memcpy(Z, Vk, N*sizeof(cdouble));
+        Precondition(Op, Z);
+        MatVec(Op, Z, W);
+
+        // modified Gram-Schmidt
+        for(int i=0; i<=k; i++)
+         { cdouble *Vi=V + i*N;
+           HH(i,k)=Dot(N, Vi, W);
+           for(int n=0; n<N; n++)
+            W[n] -= HH(i,k)*Vi[n];
+         };
+        HH(k+1,k)=Norm(N,W);
+        if ( abs(HH(k+1,k))!=0.0 )
+         for(int n=0; n<N; n++)
+          W[n] /= HH(k+1,k);
+
+        // apply previous Givens rotations to the new column, then
+        // compute and apply a new one to annihilate HH(k+1,k)
+        for(int i=0; i<k; i++)
+         { cdouble h1 = cs[i]*HH(i,k) + sn[i]*HH(i+1,k);
+           cdouble h2 = -conj(sn[i])*HH(i,k) + cs[i]*HH(i+1,k);
+           HH(i,k)=h1;
+           HH(i+1,k)=h2;
+         };
+        double a=abs(HH(k,k)), b=abs(HH(k+1,k)), r=sqrt(a*a+b*b);
+        if (a==0.0)
+         { cs[k]=0.0; sn[k]=1.0; }
+        else
+         { cs[k]=a/r; sn[k]=(HH(k,k)/a)*conj(HH(k+1,k))/r; };
+        HH(k,k)   = cs[k]*HH(k,k) + sn[k]*HH(k+1,k);
+        HH(k+1,k) = 0.0;
+        g[k+1]    = -conj(sn[k])*g[k];
+        g[k]      = cs[k]*g[k];
+
+        k++;
+        Iters++;
+        Residual = abs(g[k])/BNorm;
+        if ( Iters%LOG_INTERVAL == 0 )
+         Log("  GMRES iteration %4i: residual %.3e",Iters,Residual);
+        if (Residual<=Tol)
+         break;
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- update the solution: X += P^{-1} * V * y, y = H \ g         */
+     /*--------------------------------------------------------------*/
+     for(int i=k-1; i>=0; i--)
+      { for(int j=i+1; j<k; j++)
+         g[i] -= HH(i,j)*g[j];
+        g[i] /= HH(i,i);
+      };
+     memset(Z, 0, N*sizeof(cdouble));
+     for(int i=0; i<k; i++)
+      for(int n=0; n<N; n++)
+       Z[n] += g[i]*V[i*N + n];
+     Precondition(Op, Z);
+     for(int n=0; n<N; n++)
+      X[n] += Z[n];
+
+     /*--------------------------------------------------------------*/
+     /*- recompute the true residual before restarting ---------------*/
+     /*--------------------------------------------------------------*/
+     MatVec(Op, X, R);
+     for(int n=0; n<N; n++)
+      R[n] = B[n] - R[n];
+     Residual=Norm(N,R)/BNorm;
+   };
+#undef HH
+
+  free(B); free(R); free(Z); free(V); free(H); free(g); free(sn); free(cs);
+
+  Log("  GMRES: %i iterations, residual %.3e",Iters,Residual);
+  return Residual<=Tol ? Iters : -1;
+}
+
+/***************************************************************/
+/* BiCGStab with right preconditioning. calling convention as  */
+/* for GMRES above.                                            */
+/***************************************************************/
+static int BiCGStab(SystemOperator *Op, cdouble *X, double Tol, int MaxIters)
+{
+  int N=Op->N;
+  cdouble *Work  = (cdouble *)mallocEC(8*N*sizeof(cdouble));
+  cdouble *R     = Work + 0*N;
+  cdouble *RHat  = Work + 1*N;
+  cdouble *P     = Work + 2*N;
+  cdouble *PHat  = Work + 3*N;
+  cdouble *V     = Work + 4*N;
+  cdouble *S     = Work + 5*N;
+  cdouble *SHat  = Work + 6*N;
+  cdouble *T     = Work + 7*N;
+
+  memcpy(R,    X, N*sizeof(cdouble));
+  memcpy(RHat, X, N*sizeof(cdouble));
+  memset(X, 0, N*sizeof(cdouble));
+  double BNorm = Norm(N, R);
+  if (BNorm==0.0) BNorm=1.0;
+
+  cdouble Rho=1.0, Alpha=1.0, Omega=1.0;
+  int Iters=0;
+  double Residual=Norm(N,R)/BNorm;
+  while( Residual>Tol && Iters<MaxIters )
+   {
+     Iters++;
+     cdouble RhoNew = Dot(N, RHat, R);
+     if ( abs(RhoNew)==0.0 || abs(Omega)==0.0 )
+      { Warn("BiCGStab breakdown at iteration %i",Iters);
+        break;
+      };
+     cdouble Beta = (RhoNew/Rho)*(Alpha/Omega);
+     Rho=RhoNew;
+     for(int n=0; n<N; n++)
+      P[n] = R[n] + Beta*(P[n] - Omega*V[n]);
+
+     memcpy(PHat, P, N*sizeof(cdouble));
+     Precondition(Op, PHat);
+     MatVec(Op, PHat, V);
+     Alpha = Rho / Dot(N, RHat, V);
+     for(int n=0; n<N; n++)
+      S[n] = R[n] - Alpha*V[n];
+
+     Residual=Norm(N,S)/BNorm;
+     if (Residual<=Tol)
+      { for(int n=0; n<N; n++)
+         X[n] += Alpha*PHat[n];
+        break;
+      };
+
+     memcpy(SHat, S, N*sizeof(cdouble));
+     Precondition(Op, SHat);
+     MatVec(Op, SHat, T);
+     Omega = Dot(N, T, S) / Dot(N, T, T);
+     for(int n=0; n<N; n++)
+      { X[n] += Alpha*PHat[n] + Omega*SHat[n];
+        R[n]  = S[n] - Omega*T[n];
+      };
+
+     Residual=Norm(N,R)/BNorm;
+     if ( Iters%LOG_INTERVAL == 0 )
+      Log("  BiCGStab iteration %4i: residual %.3e",Iters,Residual);
+   };
+
+  free(Work);
+
+  Log("  BiCGStab: %i iterations, residual %.3e",Iters,Residual);
+  return Residual<=Tol ? Iters : -1;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+static int SolveSystem(SystemOperator *Op, HVector *KN,
+                       int Solver, double Tol, int MaxIters)
+{
+  if (KN->RealComplex!=LHM_COMPLEX)
+   ErrExit("%s:%i: iterative solver requires complex matrix and vector",__FILE__,__LINE__);
+
+  double Time=Secs();
+  int Iters;
+  if (Solver==SCUFF_SOLVER_BICGSTAB)
+   Iters=BiCGStab(Op, KN->ZV, Tol, MaxIters);
+  else
+   Iters=GMRES(Op, KN->ZV, Tol, MaxIters);
+  Time=Secs()-Time;
+
+  if (Iters<0)
+   Warn("iterative solver did not converge to tolerance %e in %i iterations",Tol,MaxIters);
+  else
+   Log("  iterative solve converged in %i iterations (%.2f s)",Iters,Time);
+
+  return Iters;
+}
+
+/***************************************************************/
+/* solve M*X=B iteratively. on entry KN contains the RHS B;    */
+/* on return it contains the solution. PBlocks must have been  */
+/* prepared by FactorizePreconditioner.                        */
+/***************************************************************/
+int IterativeSolve(RWGGeometry *G, HMatrix *M, HMatrix **PBlocks,
+                   HVector *KN, int Solver, double Tol, int MaxIters)
+{
+  if (M->RealComplex!=LHM_COMPLEX)
+   ErrExit("%s:%i: iterative solver requires complex matrix and vector",__FILE__,__LINE__);
+
+  SystemOperator Op;
+  Op.G=G;
+  Op.M=M;
+  Op.PBlocks=PBlocks;
+  Op.FM=0;
+  Op.N=M->NR;
+  return SolveSystem(&Op, KN, Solver, Tol, MaxIters);
+}
+
+/***************************************************************/
+/* as above, with matrix-vector products and preconditioning   */
+/* by an MLFMA matrix that has been assembled at the current   */
+/* frequency and geometrical transformation                    */
+/***************************************************************/
+int IterativeSolve(RWGGeometry *G, MLFMAMatrix *FM, HVector *KN,
+                   int Solver, double Tol, int MaxIters)
+{
+  SystemOperator Op;
+  Op.G=G;
+  Op.M=0;
+  Op.PBlocks=0;
+  Op.FM=FM;
+  Op.N=FM->N;
+  return SolveSystem(&Op, KN, Solver, Tol, MaxIters);
+}
@@ -115,6 +115,18 @@ int main(int argc, char *argv[])
   bool PlotSurfaceCurrents=false;
 //
   char *HDF5File=0;
+  double CompressionTol=0.0;
+  double MLFMATol=0.0;
+  double SweepSolverTol=0.0;
+  bool MixedPrecisionLU=false;
+  double FieldsFMMTol=0.0;
+  int InterpolationNodes=0;
+  double InterpolationTol=BMI_DEFAULT_RELTOL;
+//
+  char *Solver=0;
+  double SolverTol=1.0e-6;
+  int MaxIters=1000;
+//
   char *Cache=0;
   char *ReadCache[MAXCACHE];         int nReadCache;
   char *WriteCache=0;
@@ -171,6 +183,19 @@ int main(int argc, char *argv[])
      {"PlotSurfaceCurrents", PA_BOOL, 0, 1,     (void *)&PlotSurfaceCurrents,  0,   "generate surface current visualization files\n"},
 /**/
      {"HDF5File",       PA_STRING,  1, 1,       (void *)&HDF5File,   0,             "name of HDF5 file for BEM matrix/vector export\n"},
+/**/
+     {"CompressionTol", PA_DOUBLE,  1, 1,       (void *)&CompressionTol, 0,         "use H-matrix (ACA) compressed BEM matrix with this relative tolerance"},
+     {"MLFMATol",       PA_DOUBLE,  1, 1,       (void *)&MLFMATol,   0,             "use multilevel fast multipole matrix-vector products with this relative tolerance (requires --Solver GMRES or BiCGStab)\n"},
+     {"SweepSolverTol", PA_DOUBLE,  1, 1,       (void *)&SweepSolverTol, 0,         "reuse T-block factorizations across transformations, compressing U blocks to this tolerance"},
+     {"FieldsFMMTol",   PA_DOUBLE,  1, 1,       (void *)&FieldsFMMTol, 0,           "compute scattered fields at evaluation points by multipole expansions with this relative tolerance\n"},
+/**/
+     {"InterpolationNodes", PA_INT, 1, 1,       (void *)&InterpolationNodes, 0,     "interpolate the BEM matrix in frequency using this many Chebyshev nodes per interval"},
+     {"InterpolationTol", PA_DOUBLE, 1, 1,      (void *)&InterpolationTol, 0,       "relative error tolerance for BEM matrix interpolation\n"},
+/**/
+     {"Solver",         PA_STRING,  1, 1,       (void *)&Solver,     0,             "LU | GMRES | BiCGStab"},
+     {"SolverTol",      PA_DOUBLE,  1, 1,       (void *)&SolverTol,  0,             "relative residual tolerance for iterative solvers"},
+     {"MaxIters",       PA_INT,     1, 1,       (void *)&MaxIters,   0,             "maximum number of iterations for iterative solvers"},
+     {"MixedPrecisionLU", PA_BOOL,  0, 1,       (void *)&MixedPrecisionLU, 0,       "LU-factorize the BEM matrix in single precision and refine solutions in double precision\n"},
 /**/
      {"LogLevel",       PA_STRING,  1, 1,       (void *)&LogLevel,   0,             "none | terse | verbose | verbose2\n"},
 /**/
@@ -188,6 +213,26 @@ int main(int argc, char *argv[])
   if (FileBase==0) 
    FileBase=vstrdup(GetFileBase(GeoFile));
 
+  int SolverType=SCUFF_SOLVER_LU;
+  if (Solver==0 || !strcasecmp(Solver,"LU"))
+   SolverType=SCUFF_SOLVER_LU;
+  else if (!strcasecmp(Solver,"GMRES"))
+   SolverType=SCUFF_SOLVER_GMRES;
+  else if (!strcasecmp(Solver,"BiCGStab"))
+   SolverType=SCUFF_SOLVER_BICGSTAB;
+  else
+   OSUsage(argv[0], VERSION, OSArray, "unknown --Solver %s",Solver);
+  if (SolverType!=SCUFF_SOLVER_LU && CompressionTol>0.0)
+   ErrExit("--Solver %s is incompatible with --CompressionTol",Solver);
+  if (MLFMATol>0.0 && SolverType==SCUFF_SOLVER_LU)
+   ErrExit("--MLFMATol requires --Solver GMRES or --Solver BiCGStab");
+  if (MLFMATol>0.0 && CompressionTol>0.0)
+   ErrExit("--MLFMATol is incompatible with --CompressionTol");
+  if (MixedPrecisionLU && (SolverType!=SCUFF_SOLVER_LU || CompressionTol>0.0 || MLFMATol>0.0 || SweepSolverTol>0.0) )
+   Warn("--MixedPrecisionLU only applies to dense LU solves; ignoring");
+  if (SweepSolverTol>0.0 && (SolverType!=SCUFF_SOLVER_LU || CompressionTol>0.0 || MLFMATol>0.0) )
+   ErrExit("--SweepSolverTol requires --Solver LU and is incompatible with --CompressionTol and --MLFMATol");
+
   /*******************************************************************/
   /* process frequency-related options                               */
   /*******************************************************************/
@@ -288,9 +333,18 @@ int main(int argc, char *argv[])
   SSData MySSData, *SSD=&MySSData;
 
   RWGGeometry *G      = SSD->G   = new RWGGeometry(GeoFile);
-  HMatrix *M          = SSD->M   = G->AllocateBEMMatrix();
+  if (FieldsFMMTol>0.0)
+   RWGGeometry::FieldsFMMTol=FieldsFMMTol;
+  CompressedBEMMatrix *CM = 0;
+  if (CompressionTol>0.0)
+   CM = G->AllocateCompressedBEMMatrix(CompressionTol);
+  MLFMAMatrix *FM = 0;
+  if (MLFMATol>0.0)
+   FM = G->AllocateMLFMAMatrix(MLFMATol);
+  HMatrix *M          = SSD->M   = (CM || FM) ? 0 : G->AllocateBEMMatrix();
   HVector *RHS        = SSD->RHS = G->AllocateRHSVector();
   HVector *KN         = SSD->KN  = G->AllocateRHSVector();
+  HMatrix **PBlocks   = (SolverType==SCUFF_SOLVER_LU || FM) ? 0 : CreatePreconditioner(G);
   double *kBloch      = SSD->kBloch = 0;
   SSD->IF             = 0;
   SSD->TransformLabel = 0;
@@ -312,6 +366,42 @@ int main(int argc, char *argv[])
   if (ErrMsg)
    ErrExit("file %s: %s",TransFile,ErrMsg);
 
+  /*******************************************************************/
+  /* if requested, set up frequency interpolation of the BEM matrix  */
+  /* over the range spanned by the frequency list, which must lie on */
+  /* the real or the imaginary axis                                  */
+  /*******************************************************************/
+  BEMMatrixInterpolator *BMI=0;
+  if (InterpolationNodes>0 && OmegaList->N<2)
+   Warn("--InterpolationNodes ignored for single-frequency calculation");
+  else if (InterpolationNodes>0)
+   { if (CM)
+      ErrExit("--InterpolationNodes is incompatible with --CompressionTol");
+     if (FM)
+      ErrExit("--InterpolationNodes is incompatible with --MLFMATol");
+     if (G->LDim>0)
+      ErrExit("--InterpolationNodes is not available for periodic geometries");
+     if (NumTransformations>1)
+      ErrExit("--InterpolationNodes is not available with multiple geometrical transformations");
+
+     bool AllReal=true, AllImag=true;
+     double OMin=HUGE_VAL, OMax=-HUGE_VAL;
+     for(int nFreq=0; nFreq<OmegaList->N; nFreq++)
+      { cdouble Omega = OmegaList->GetEntry(nFreq);
+        if (imag(Omega)!=0.0) AllReal=false;
+        if (real(Omega)!=0.0) AllImag=false;
+        double O = AllReal ? real(Omega) : imag(Omega);
+        OMin=fmin(OMin,O);
+        OMax=fmax(OMax,O);
+      };
+     if (!AllReal && !AllImag)
+      ErrExit("--InterpolationNodes requires all frequencies to be real or all imaginary");
+     cdouble Scale = AllReal ? 1.0 : cdouble(0.0,1.0);
+     BMI = G->BMInterpolator
+         = new BEMMatrixInterpolator(G, Scale*OMin, Scale*OMax,
+                                     InterpolationNodes, InterpolationTol);
+   };
+
   /*******************************************************************/
   /* for periodic geometries, all incident field sources that are    */
   /* active at a given time must involve  single incident field      */
@@ -344,14 +434,20 @@ int main(int argc, char *argv[])
   void *HDF5Context=0;
   if (HDF5File)
    HDF5Context=HMatrix::OpenHDF5Context(HDF5File);
+  if (HDF5File && CM)
+   Warn("BEM matrix export is not available with --CompressionTol (exporting vectors only)");
+  if (HDF5File && FM)
+   Warn("BEM matrix export is not available with --MLFMATol (exporting vectors only)");
 
   /*******************************************************************/
   /* if we have more than one geometrical transformation,            */
-  /* allocate storage for BEM matrix blocks                          */
+  /* allocate storage for BEM matrix blocks (the compressed and      */
+  /* MLFMA matrices are instead reassembled from scratch at each     */
+  /* transformation)                                                 */
   /*******************************************************************/
   HMatrix **TBlocks=0, **UBlocks=0;
   int NS=G->NumSurfaces;
-  if (NumTransformations>1)
+  if (NumTransformations>1 && !CM && !FM)
    { int NADB = NS*(NS-1)/2; // number of above-diagonal blocks
      TBlocks  = (HMatrix **)mallocEC(NS*sizeof(HMatrix *));
      UBlocks  = (HMatrix **)mallocEC(NADB*sizeof(HMatrix *));
@@ -373,6 +469,21 @@ int main(int argc, char *argv[])
       };
    };
 
+  /*******************************************************************/
+  /* with the sweep solver, the diagonal blocks are factorized once  */
+  /* per frequency and each transformation only requires a low-rank  */
+  /* update for the off-diagonal blocks                              */
+  /*******************************************************************/
+  SweepSolver *SS=0;
+  if (SweepSolverTol>0.0)
+   { if (G->LDim>0)
+      ErrExit("--SweepSolverTol is not available for periodic geometries");
+     if (NumTransformations==1)
+      Warn("--SweepSolverTol ignored for single-transformation calculation");
+     else
+      SS = new SweepSolver(G, M->RealComplex, true, SweepSolverTol);
+   };
+
   /*******************************************************************/
   /* loop over frequencies *******************************************/
   /*******************************************************************/
@@ -402,12 +513,23 @@ int main(int argc, char *argv[])
      /* matrix blocks at this frequency; otherwise just assemble the    */
      /* whole matrix                                                    */
      /*******************************************************************/
-     if (NumTransformations==1)
+     if (CM)
+      { if (NumTransformations==1)
+         G->AssembleCompressedBEMMatrix(Omega, CM);
+      }
+     else if (FM)
+      { if (NumTransformations==1)
+         G->AssembleMLFMAMatrix(Omega, FM);
+      }
+     else if (NumTransformations==1)
       G->AssembleBEMMatrix(Omega, kBloch, M);
      else
-      for(int ns=0; ns<G->NumSurfaces; ns++)
-       if (G->Mate[ns]==-1)
-        G->AssembleBEMMatrixBlock(ns, ns, Omega, kBloch, TBlocks[ns]);
+      { for(int ns=0; ns<G->NumSurfaces; ns++)
+         if (G->Mate[ns]==-1)
+          G->AssembleBEMMatrixBlock(ns, ns, Omega, kBloch, TBlocks[ns]);
+        if (SS && NeedIncidentField)
+         SS->SetTBlocks(TBlocks);
+      };
 
      /*******************************************************************/
      /* dump the scuff cache to a cache storage file if requested. note */
@@ -438,26 +560,33 @@ int main(int argc, char *argv[])
         /*******************************************************************/
         /* assemble and insert off-diagonal blocks as necessary ************/
         /*******************************************************************/
-        if (NumTransformations>1)
+        if (CM && NumTransformations>1)
+         G->AssembleCompressedBEMMatrix(Omega, CM);
+        else if (FM && NumTransformations>1)
+         G->AssembleMLFMAMatrix(Omega, FM);
+        else if (NumTransformations>1)
          { for(int ns=0, nb=0; ns<G->NumSurfaces; ns++)
             for(int nsp=ns+1; nsp<G->NumSurfaces; nsp++, nb++)
              G->AssembleBEMMatrixBlock(ns, nsp, Omega, kBloch, UBlocks[nb]);
 
-           for(int ns=0, nb=0; ns<G->NumSurfaces; ns++)
-            { int RowOffset=G->BFIndexOffset[ns];
-              M->InsertBlock(TBlocks[ns], RowOffset, RowOffset);
-              for(int nsp=ns+1; nsp<G->NumSurfaces; nsp++, nb++)
-               { int ColOffset=G->BFIndexOffset[nsp];
-                 M->InsertBlock(UBlocks[nb], RowOffset, ColOffset);
-                 M->InsertBlockAdjoint(UBlocks[nb], ColOffset, RowOffset);
-               };
-            };
+           // the sweep solver works directly with the blocks, so
+           // the full matrix is only needed for HDF5 export
+           if (SS==0 || HDF5Context)
+            for(int ns=0, nb=0; ns<G->NumSurfaces; ns++)
+             { int RowOffset=G->BFIndexOffset[ns];
+               M->InsertBlock(TBlocks[ns], RowOffset, RowOffset);
+               for(int nsp=ns+1; nsp<G->NumSurfaces; nsp++, nb++)
+                { int ColOffset=G->BFIndexOffset[nsp];
+                  M->InsertBlock(UBlocks[nb], RowOffset, ColOffset);
+                  M->InsertBlockAdjoint(UBlocks[nb], ColOffset, RowOffset);
+                };
+             };
          };
 
         /*******************************************************************/
         /* export BEM matrix to a binary .hdf5 file if that was requested  */
         /*******************************************************************/
-        if (HDF5Context)
+        if (HDF5Context && M)
          M->ExportToHDF5(HDF5Context,"M_%s%s",OmegaStr,TransformStr);
 
         /*******************************************************************/
@@ -470,10 +599,23 @@ int main(int argc, char *argv[])
 
         /*******************************************************************/
         /* LU-factorize the BEM matrix to prepare for solving scattering   */
-        /* problems                                                        */
+        /* problems (for iterative solves we instead factorize only the    */
+        /* diagonal blocks, which are independent of the transformation;   */
+        /* the MLFMA matrix prepares its own preconditioner on assembly)   */
         /*******************************************************************/
-        Log("  LU-factorizing BEM matrix...");
-        M->LUFactorize();
+        if (PBlocks)
+         { if (nt==0)
+            FactorizePreconditioner(G, M, PBlocks);
+         }
+        else if (!FM)
+         { Log("  LU-factorizing BEM matrix...");
+           if (CM)
+            CM->LUFactorize();
+           else if (SS)
+            SS->Factorize(UBlocks);
+           else
+            M->LUFactorize(MixedPrecisionLU);
+         };
 
         /***************************************************************/
         /* loop over incident fields                                   */
@@ -496,7 +638,16 @@ int main(int argc, char *argv[])
            G->AssembleRHSVector(Omega, kBloch, IF, KN);
            RHS->Copy(KN); // copy RHS vector for later 
            Log("  Solving the BEM system...");
-           M->LUSolve(KN);
+           if (FM)
+            IterativeSolve(G, FM, KN, SolverType, SolverTol, MaxIters);
+           else if (PBlocks)
+            IterativeSolve(G, M, PBlocks, KN, SolverType, SolverTol, MaxIters);
+           else if (CM)
+            CM->LUSolve(KN);
+           else if (SS)
+            SS->LUSolve(KN);
+           else
+            M->LUSolve(KN);
    
            if (HDF5Context)
             { RHS->ExportToHDF5(HDF5Context,"RHS_%s%s%s",OmegaStr,TransformStr,IFStr);
@@ -577,6 +728,8 @@ int main(int argc, char *argv[])
   /***************************************************************/
   if (HDF5Context)
    HMatrix::CloseHDF5Context(HDF5Context);
+  if (BMI)
+   delete BMI;
   printf("Thank you for your support.\n");
    
 }
@@ -62,4 +62,18 @@ void ProcessEPFile(SSData *SSData, char *EPFileName);
 void VisualizeFields(SSData *SSData, 
                      char *FVMesh, char *FVMeshTransFile, char *FuncList);
 
+/***************************************************************/
+/* iterative (krylov-subspace) solution of the BEM system      */
+/***************************************************************/
+#define SCUFF_SOLVER_LU       0
+#define SCUFF_SOLVER_GMRES    1
+#define SCUFF_SOLVER_BICGSTAB 2
+
+HMatrix **CreatePreconditioner(RWGGeometry *G);
+void FactorizePreconditioner(RWGGeometry *G, HMatrix *M, HMatrix **PBlocks);
+int IterativeSolve(RWGGeometry *G, HMatrix *M, HMatrix **PBlocks,
+                   HVector *KN, int Solver, double Tol, int MaxIters);
+int IterativeSolve(RWGGeometry *G, MLFMAMatrix *FM, HVector *KN,
+                   int Solver, double Tol, int MaxIters);
+
 #endif
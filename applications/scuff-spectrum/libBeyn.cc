@@ -24,6 +24,10 @@
  * Homer Reid      -- 6/2016
  *
  */
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
@@ -40,7 +44,7 @@ cdouble zrandN(double Sigma=1.0, double Mu=0.0)
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
-BeynSolver *CreateBeynSolver(int M, int L)
+BeynSolver *CreateBeynSolver(int M, int L, int NumWorkspaces)
 {
   BeynSolver *Solver= (BeynSolver *)mallocEC(sizeof(*Solver));
 
@@ -75,6 +79,18 @@ BeynSolver *CreateBeynSolver(int M, int L)
  
   Solver->Workspace = (cdouble *)mallocEC( WorkspaceSize );
 
+  // buffers for quadrature points evaluated concurrently
+  if (NumWorkspaces<1) NumWorkspaces=1;
+  Solver->NumWorkspaces = NumWorkspaces;
+  Solver->MInvVHatW     = (HMatrix **)mallocEC(NumWorkspaces*sizeof(HMatrix *));
+  Solver->MInvVHatW[0]  = Solver->MInvVHat;
+  for(int nw=1; nw<NumWorkspaces; nw++)
+   Solver->MInvVHatW[nw] = new HMatrix(M,L,LHM_COMPLEX);
+
+  Solver->Cache       = 0;
+  Solver->A0Error     = Solver->A1Error = 0.0;
+  Solver->NumRejected = 0;
+
   return Solver;
   
 }
@@ -98,7 +114,13 @@ void DestroyBeynSolver(BeynSolver *Solver)
 
   free(Solver->Workspace);
 
-  delete Solver;
+  for(int nw=1; nw<Solver->NumWorkspaces; nw++)
+   delete Solver->MInvVHatW[nw];
+  free(Solver->MInvVHatW);
+
+  SetBeynCacheSize(Solver, 0);
+
+  free(Solver);
 }
 
 /***************************************************************/
@@ -108,12 +130,83 @@ void ReRandomize(BeynSolver *Solver, unsigned int RandSeed)
 {
   if (RandSeed==0) 
    RandSeed=time(0);
+  Log("Beyn: initializing VHat with random seed %u",RandSeed);
   srandom(RandSeed);
   HMatrix *VHat=Solver->VHat;
   for(int nr=0; nr<VHat->NR; nr++)
    for(int nc=0; nc<VHat->NC; nc++)
     VHat->SetEntry(nr,nc,zrandN());
 
+  // cached data were computed with the old VHat
+  if (Solver->Cache)
+   Solver->Cache->NumPoints=0;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void SetBeynCacheSize(BeynSolver *Solver, int MaxPoints)
+{
+  BeynPointCache *Cache=Solver->Cache;
+  if (Cache)
+   { for(int np=0; np<Cache->MaxPoints; np++)
+      if (Cache->MInvVHat[np]) delete Cache->MInvVHat[np];
+     free(Cache->MInvVHat);
+     free(Cache->z);
+     free(Cache);
+     Solver->Cache=0;
+   };
+
+  if (MaxPoints<=0)
+   return;
+
+  Cache=(BeynPointCache *)mallocEC(sizeof(BeynPointCache));
+  Cache->MaxPoints = MaxPoints;
+  Cache->NumPoints = 0;
+  Cache->z         = (cdouble *)mallocEC(MaxPoints*sizeof(cdouble));
+  Cache->MInvVHat  = (HMatrix **)mallocEC(MaxPoints*sizeof(HMatrix *)); // allocated on first use
+  Cache->NumHits   = Cache->NumMisses = 0;
+  Solver->Cache    = Cache;
+}
+
+/***************************************************************/
+/* return the index of the cache entry for z, or -1            */
+/***************************************************************/
+static int LookupCache(BeynPointCache *Cache, cdouble z)
+{
+  if (Cache==0)
+   return -1;
+  for(int np=0; np<Cache->NumPoints; np++)
+   if (Cache->z[np]==z)
+    return np;
+  return -1;
+}
+
+/***************************************************************/
+/* add an entry to the cache if there is room                  */
+/***************************************************************/
+static void AddToCache(BeynPointCache *Cache, cdouble z, HMatrix *MInvVHat)
+{
+  if (Cache==0 || Cache->NumPoints==Cache->MaxPoints)
+   return;
+  int np=Cache->NumPoints++;
+  if (Cache->MInvVHat[np]==0)
+   Cache->MInvVHat[np]=new HMatrix(MInvVHat->NR, MInvVHat->NC, LHM_COMPLEX);
+  Cache->z[np]=z;
+  Cache->MInvVHat[np]->Copy(MInvVHat);
+}
+
+/***************************************************************/
+/* call whichever flavor of user function we were given        */
+/***************************************************************/
+static void CallBeynFunc(BeynFunction UserFunc, BeynFunctionW UserFuncW,
+                         void *UserData, int nw, cdouble z,
+                         HMatrix *VHat, HMatrix *MVHat)
+{
+  if (UserFuncW)
+   UserFuncW(z, UserData, nw, VHat, MVHat);
+  else
+   UserFunc(z, UserData, VHat, MVHat);
 }
 
 /***************************************************************/
@@ -121,9 +214,11 @@ void ReRandomize(BeynSolver *Solver, unsigned int RandSeed)
 /* matrices (obtained via numerical quadrature) to extract     */
 /* eigenvalues and eigenvectors                                */
 /***************************************************************/
-int ProcessAMatrices(BeynSolver *Solver, BeynFunction UserFunc, void *UserData,
+int ProcessAMatrices(BeynSolver *Solver, BeynFunction UserFunc,
+                     BeynFunctionW UserFuncW, void *UserData,
                      HMatrix *A0, HMatrix *A1, cdouble z0,
-                     HVector *Eigenvalues, HMatrix *Eigenvectors=0)
+                     HVector *Eigenvalues, HMatrix *Eigenvectors=0,
+                     int *NumRejected=0)
 {
   int M          = Solver->M;
   int L          = Solver->L;
@@ -155,6 +250,7 @@ int ProcessAMatrices(BeynSolver *Solver, BeynFunction UserFunc, void *UserData,
       K++;
    }
   Log(" Beyn: %i/%i relevant singular values",K,L);
+  if (NumRejected) *NumRejected=0;
   if (K==0)
    { Warn("no singular values found in Beyn eigensolver");
      return 0;
@@ -202,11 +298,14 @@ int ProcessAMatrices(BeynSolver *Solver, BeynFunction UserFunc, void *UserData,
      if (ResTol>0.0)
       { HMatrix Vk(M,1,V);
         HMatrix MVk(M,1,MLBuffers[0]);
-        UserFunc(z, UserData, &Vk, &MVk);
+        CallBeynFunc(UserFunc, UserFuncW, UserData, 0, z, &Vk, &MVk);
         Residual=VecNorm(MVk.ZM, M);
         if (Verbose) Log("Beyn: Residual(%i)=%e",k,Residual);
       }
-     if (ResTol>0.0 && Residual>ResTol) continue;
+     if (ResTol>0.0 && Residual>ResTol)
+      { if (NumRejected) (*NumRejected)++;
+        continue;
+      };
 
     Eigenvalues->SetEntry(KRetained, z);
     if (Eigenvectors) 
@@ -219,31 +318,49 @@ int ProcessAMatrices(BeynSolver *Solver, BeynFunction UserFunc, void *UserData,
 }
 
 /***************************************************************/
+/* quadrature point n of N on the elliptical contour: z0+z1 is */
+/* the point and dz its weight                                 */
+/***************************************************************/
+static void GetContourPoint(int n, int N, double Rx, double Ry,
+                            cdouble *z1, cdouble *dz)
+{
+  double DeltaTheta = 2.0*M_PI / ((double)N);
+  double Theta = ((double)n)*DeltaTheta;
+  double CT    = cos(Theta), ST=sin(Theta);
+  *z1 = Rx*CT + II*Ry*ST;
+  *dz = (II*Rx*ST + Ry*CT)/((double)N);
+}
+
 /***************************************************************/
+/* evaluate the contour integrals for A0, A1 (and their coarse */
+/* versions) given the quadrature points z[n] = z0 + z1[n] and */
+/* fine and coarse weights W[n], WC[n], then extract the       */
+/* eigenvalues.                                                */
+/*                                                             */
+/* the quadrature points are processed in batches of up to     */
+/* NumWorkspaces points. within a batch, point n0+nb is        */
+/* evaluated in workspace nb, concurrently with the other      */
+/* points in the batch; once the whole batch is done, its      */
+/* contributions are added to A0, A1, etc. serially in order   */
+/* of increasing n, so the sums are formed in the same order   */
+/* no matter how many workspaces or threads there are.         */
 /***************************************************************/
-int BeynSolve(BeynSolver *Solver,
-              BeynFunction UserFunc, void *UserData,
-              cdouble z0, double Rx, double Ry, int N)
+static int BeynSolve(BeynSolver *Solver,
+                     BeynFunction UserFunc, BeynFunctionW UserFuncW,
+                     void *UserData, cdouble z0, int NP, cdouble *z,
+                     cdouble *z1, cdouble *W, cdouble *WC)
 {  
-  /***************************************************************/
-  /* force N to be even so we can simultaneously evaluate        */
-  /* the integral with N/2 quadrature points                     */
-  /***************************************************************/
-  if ( (N%2)==1 ) N++;
-
-  if (Rx==Ry)
-   Log("Applying Beyn method with z0=%s,R=%e,N=%i...",z2s(z0),Rx,N);
-  else
-   Log("Applying Beyn method with z0=%s,Rx=%e,Ry=%e,N=%i...",z2s(z0),Rx,Ry,N);
-
   int M                 = Solver->M;
   int L                 = Solver->L;
   HMatrix *A0           = Solver->A0;
   HMatrix *A1           = Solver->A1;
   HMatrix *A0Coarse     = Solver->A0Coarse;
   HMatrix *A1Coarse     = Solver->A1Coarse;
-  HMatrix *MInvVHat     = Solver->MInvVHat;
+  HMatrix **MInvVHatW   = Solver->MInvVHatW;
   HMatrix *VHat         = Solver->VHat;
+  BeynPointCache *Cache = Solver->Cache;
+
+  int NumWorkspaces = UserFuncW ? Solver->NumWorkspaces : 1;
 
   /***************************************************************/
   /* evaluate contour integrals by numerical quadrature to get   */
@@ -253,27 +370,72 @@ int BeynSolve(BeynSolver *Solver,
   A1->Zero();
   A0Coarse->Zero();
   A1Coarse->Zero();
-  double DeltaTheta = 2.0*M_PI / ((double)N);
-  Log(" Evaluating contour integral (%i points)...",N);
-  for(int n=0; n<N; n++)
+  double Scale0=0.0, Scale1=0.0;
+  if (NumWorkspaces>1)
+   Log(" Evaluating contour integral (%i points, %i at a time)...",NP,NumWorkspaces);
+  else
+   Log(" Evaluating contour integral (%i points)...",NP);
+  int *CachedSlot = new int[NumWorkspaces];
+  for(int n0=0; n0<NP; n0+=NumWorkspaces)
    { 
-     double Theta = ((double)n)*DeltaTheta;
-     double CT    = cos(Theta), ST=sin(Theta);
-     cdouble z1   = Rx*CT + II*Ry*ST;
-     cdouble dz   = (II*Rx*ST + Ry*CT)/((double)N);
-
-     MInvVHat->Copy(VHat);
-     UserFunc(z0+z1, UserData, MInvVHat, 0);
-
-     VecPlusEquals(A0->ZM, dz,    MInvVHat->ZM, M*L);
-     VecPlusEquals(A1->ZM, z1*dz, MInvVHat->ZM, M*L);
-
-     if ( (n%2)==0 )
-      { VecPlusEquals(A0Coarse->ZM, 2.0*dz,    MInvVHat->ZM, M*L);
-        VecPlusEquals(A1Coarse->ZM, 2.0*z1*dz, MInvVHat->ZM, M*L);
-      }
+     int NB = (NP-n0 < NumWorkspaces) ? NP-n0 : NumWorkspaces;
+     int NumThreads = (NB < GetNumThreads()) ? NB : GetNumThreads();
+     if (NumThreads<1) NumThreads=1;
+     for(int nb=0; nb<NB; nb++)
+      CachedSlot[nb]=LookupCache(Cache, z[n0+nb]);
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1) num_threads(NumThreads) if(NB>1)
+#endif
+     for(int nb=0; nb<NB; nb++)
+      { if (CachedSlot[nb]>=0)
+         MInvVHatW[nb]->Copy(Cache->MInvVHat[CachedSlot[nb]]);
+        else
+         { MInvVHatW[nb]->Copy(VHat);
+           CallBeynFunc(UserFunc, UserFuncW, UserData, nb, z[n0+nb], MInvVHatW[nb], 0);
+         };
+      };
+
+     for(int nb=0; nb<NB; nb++)
+      { int n=n0+nb;
+        cdouble *MInvVHat = MInvVHatW[nb]->ZM;
+
+        if (Cache)
+         { if (CachedSlot[nb]>=0)
+            Cache->NumHits++;
+           else
+            { Cache->NumMisses++;
+              AddToCache(Cache, z[n], MInvVHatW[nb]);
+            };
+         };
+
+        VecPlusEquals(A0->ZM, W[n],       MInvVHat, M*L);
+        VecPlusEquals(A1->ZM, z1[n]*W[n], MInvVHat, M*L);
+
+        if ( WC[n]!=0.0 )
+         { VecPlusEquals(A0Coarse->ZM, WC[n],       MInvVHat, M*L);
+           VecPlusEquals(A1Coarse->ZM, z1[n]*WC[n], MInvVHat, M*L);
+         };
+
+        double XNorm = VecNorm(MInvVHat, M*L);
+        Scale0 += abs(W[n])*XNorm;
+        Scale1 += abs(z1[n]*W[n])*XNorm;
+      };
    }
 
+  /***************************************************************/
+  /* estimate the quadrature error in A0, A1 from the difference */
+  /* between the fine and coarse rules                           */
+  /***************************************************************/
+  double dA0=0.0, dA1=0.0;
+  for(int n=0; n<M*L; n++)
+   { dA0 += norm(A0->ZM[n] - A0Coarse->ZM[n]);
+     dA1 += norm(A1->ZM[n] - A1Coarse->ZM[n]);
+   };
+  delete[] CachedSlot;
+  Solver->A0Error = (Scale0>0.0) ? sqrt(dA0)/Scale0 : 0.0;
+  Solver->A1Error = (Scale1>0.0) ? sqrt(dA1)/Scale1 : 0.0;
+  Log(" Beyn: quadrature error estimates {A0,A1}={%.1e,%.1e}",Solver->A0Error,Solver->A1Error);
+
   /***************************************************************/
   /***************************************************************/
   /***************************************************************/
@@ -281,8 +443,8 @@ int BeynSolve(BeynSolver *Solver,
   HVector *EVErrors     = Solver->EVErrors;
   HMatrix *Eigenvectors = Solver->Eigenvectors;
   
-  int K       = ProcessAMatrices(Solver, UserFunc, UserData, A0,       A1,       z0, Eigenvalues, Eigenvectors);
-  int KCoarse = ProcessAMatrices(Solver, UserFunc, UserData, A0Coarse, A1Coarse, z0, EVErrors);
+  int K       = ProcessAMatrices(Solver, UserFunc, UserFuncW, UserData, A0,       A1,       z0, Eigenvalues, Eigenvectors, &(Solver->NumRejected));
+  int KCoarse = ProcessAMatrices(Solver, UserFunc, UserFuncW, UserData, A0Coarse, A1Coarse, z0, EVErrors);
   Log("{K,KCoarse}={%i,%i}",K,KCoarse);
   for(int k=0; k<EVErrors->N && k<Eigenvalues->N; k++)
    { EVErrors->ZV[k] -= Eigenvalues->ZV[k];
@@ -298,9 +460,275 @@ int BeynSolve(BeynSolver *Solver,
 }
 
 /***************************************************************/
+/* elliptical contour: N-point trapezoidal rule in the angle,  */
+/* with the N/2-point rule on the even points as coarse rule   */
 /***************************************************************/
+static int BeynSolve(BeynSolver *Solver,
+                     BeynFunction UserFunc, BeynFunctionW UserFuncW,
+                     void *UserData, cdouble z0, double Rx, double Ry, int N)
+{  
+  /***************************************************************/
+  /* force N to be even so we can simultaneously evaluate        */
+  /* the integral with N/2 quadrature points                     */
+  /***************************************************************/
+  if ( (N%2)==1 ) N++;
+
+  if (Rx==Ry)
+   Log("Applying Beyn method with z0=%s,R=%e,N=%i...",z2s(z0),Rx,N);
+  else
+   Log("Applying Beyn method with z0=%s,Rx=%e,Ry=%e,N=%i...",z2s(z0),Rx,Ry,N);
+
+  cdouble *z  = new cdouble[4*N];
+  cdouble *z1 = z  + N;
+  cdouble *W  = z1 + N;
+  cdouble *WC = W  + N;
+  for(int n=0; n<N; n++)
+   { GetContourPoint(n, N, Rx, Ry, z1+n, W+n);
+     z[n]  = z0 + z1[n];
+     WC[n] = ( (n%2)==0 ) ? 2.0*W[n] : 0.0;
+   };
+
+  int K=BeynSolve(Solver, UserFunc, UserFuncW, UserData, z0, N, z, z1, W, WC);
+
+  delete[] z;
+  return K;
+}
+
+/***************************************************************/
+/* nodes u[k] and weights w[k], k=0..NE, of the NE-interval    */
+/* Clenshaw-Curtis rule on [0,1] (NE even). the endpoints are  */
+/* exactly 0 and 1, and u[2k] for NE is bitwise equal to u[k]  */
+/* for NE/2, so that refined contours reuse cached points.     */
+/***************************************************************/
+static void GetCCRule(int NE, double *u, double *w)
+{
+  for(int k=0; k<=NE; k++)
+   { double Theta = (M_PI*k)/NE;
+     u[k] = (k==0) ? 0.0 : (k==NE) ? 1.0 : 0.5*(1.0-cos(Theta));
+     double Sum=0.0;
+     for(int j=1; j<=NE/2; j++)
+      Sum += ((2*j==NE) ? 1.0 : 2.0) * cos(2.0*j*Theta) / (4.0*j*j-1.0);
+     w[k] = 0.5*((k==0 || k==NE) ? 1.0 : 2.0)*(1.0-Sum)/NE;
+   };
+}
+
+/***************************************************************/
+/* rectangular contour, traversed counterclockwise starting    */
+/* at the lower-left corner, with NE-interval Clenshaw-Curtis  */
+/* rules on each edge and the NE/2-interval rules (on every    */
+/* other point) as coarse rule.                                */
 /***************************************************************/
+int BeynSolveRectangle(BeynSolver *Solver,
+                       BeynFunctionW UserFunc, void *UserData,
+                       cdouble zMin, cdouble zMax, int NE)
+{
+  if (NE<2) NE=2;
+  if ( (NE%2)==1 ) NE++;
+
+  Log("Applying Beyn method with rectangular contour %s -- %s, NE=%i...",
+       z2s(zMin),z2s(zMax),NE);
+
+  double x0=real(zMin), x1=real(zMax);
+  double y0=imag(zMin), y1=imag(zMax);
+  cdouble z0 = 0.5*(zMin + zMax);
+
+  double *u  = new double[2*(NE+1)], *w  = u  + (NE+1);
+  double *uc = new double[2*(NE/2+1)], *wc = uc + (NE/2+1);
+  GetCCRule(NE, u, w);
+  GetCCRule(NE/2, uc, wc);
+
+  int NP = 4*NE;
+  cdouble *z  = new cdouble[4*NP];
+  cdouble *z1 = z  + NP;
+  cdouble *W  = z1 + NP;
+  cdouble *WC = W  + NP;
+  for(int n=0; n<NP; n++)
+   W[n]=WC[n]=0.0;
+
+  // edges: bottom (left to right), right (upward), top (right to
+  // left), left (downward). node positions are always computed 
+  // from the lower/left end of the edge so that they agree 
+  // exactly with the corresponding nodes of adjacent tiles.
+  cdouble EdgeFactor[4];
+  EdgeFactor[0] =      (x1-x0) / (2.0*M_PI*II);
+  EdgeFactor[1] =   II*(y1-y0) / (2.0*M_PI*II);
+  EdgeFactor[2] =     -(x1-x0) / (2.0*M_PI*II);
+  EdgeFactor[3] =  -II*(y1-y0) / (2.0*M_PI*II);
+  for(int e=0; e<4; e++)
+   for(int k=0; k<=NE; k++)
+    { int n = (e*NE + k) % NP;
+      int j = (e<2) ? k : NE-k;
+      double x = (j==0) ? x0 : (j==NE) ? x1 : x0 + (x1-x0)*u[j];
+      double y = (j==0) ? y0 : (j==NE) ? y1 : y0 + (y1-y0)*u[j];
+      if (e==0) z[n] = cdouble(x,  y0);
+      if (e==1) z[n] = cdouble(x1, y );
+      if (e==2) z[n] = cdouble(x,  y1);
+      if (e==3) z[n] = cdouble(x0, y );
+      W[n] += EdgeFactor[e]*w[j];
+      if ( (j%2)==0 )
+       WC[n] += EdgeFactor[e]*wc[j/2];
+    };
+  for(int n=0; n<NP; n++)
+   z1[n] = z[n] - z0;
+
+  int K=BeynSolve(Solver, 0, UserFunc, UserData, z0, NP, z, z1, W, WC);
+
+  delete[] z;
+  delete[] u;
+  delete[] uc;
+  return K;
+}
+
+/***************************************************************/
+/* coordinate of the ith of N+1 tile boundaries between a and b*/
+/***************************************************************/
+static double TileBoundary(double a, double b, int i, int N)
+{ return (i==0) ? a : (i==N) ? b : a + i*((b-a)/N); }
+
+static bool OnTileBoundary(cdouble z, double xa, double xb, double ya, double yb)
+{
+  double x=real(z), y=imag(z);
+  if ( (x==xa || x==xb) && ya<=y && y<=yb ) return true;
+  if ( (y==ya || y==yb) && xa<=x && x<=xb ) return true;
+  return false;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int BeynSweep(BeynSolver *Solver,
+              BeynFunctionW UserFunc, void *UserData,
+              cdouble zMin, cdouble zMax, int NX, int NY,
+              BeynTileFunction TileFunc, void *TileData,
+              double Tol, int NEMin, int NEMax, int MaxCachedPoints)
+{
+  if (NX<1) NX=1;
+  if (NY<1) NY=1;
+  if (NEMin<2) NEMin=2;
+  if (NEMax<NEMin) NEMax=NEMin;
+
+  double x0=real(zMin), x1=real(zMax);
+  double y0=imag(zMin), y1=imag(zMax);
+
+  bool OwnCache = (Solver->Cache==0 && MaxCachedPoints>0);
+  if (OwnCache)
+   SetBeynCacheSize(Solver, MaxCachedPoints);
+  BeynPointCache *Cache=Solver->Cache;
+
+  HVector *Eigenvalues  = Solver->Eigenvalues;
+  HVector *EVErrors     = Solver->EVErrors;
+  HVector *Residuals    = Solver->Residuals;
+  HMatrix *Eigenvectors = Solver->Eigenvectors;
+
+  int NumModes=0;
+  for(int iy=0; iy<NY; iy++)
+   for(int ix=0; ix<NX; ix++)
+    { 
+      int nTile = iy*NX + ix;
+      double xa=TileBoundary(x0,x1,ix,NX), xb=TileBoundary(x0,x1,ix+1,NX);
+      double ya=TileBoundary(y0,y1,iy,NY), yb=TileBoundary(y0,y1,iy+1,NY);
+      cdouble za(xa,ya), zb(xb,yb);
+      Log("Beyn sweep: tile %i/%i (%s -- %s)",nTile+1,NX*NY,z2s(za),z2s(zb));
+
+      /*--------------------------------------------------------------*/
+      /*- refine the quadrature until the fine and coarse estimates  -*/
+      /*- agree and all eigenvalue candidates have small residuals   -*/
+      /*--------------------------------------------------------------*/
+      int NE=NEMin, K=0;
+      bool Converged=false;
+      for(;;)
+       { K=BeynSolveRectangle(Solver, UserFunc, UserData, za, zb, NE);
+         Converged = (    Solver->A0Error<=Tol 
+                       && Solver->A1Error<=Tol
+                       && Solver->NumRejected==0
+                     );
+         if (Converged || 2*NE>NEMax)
+          break;
+         Log(" Beyn sweep: refining tile %i to NE=%i",nTile+1,2*NE);
+         NE*=2;
+       };
+      if (!Converged)
+       Warn("Beyn sweep: tile %i not converged at NE=%i (errors %.1e, %.1e, %i rejected)",
+             nTile+1,NE,Solver->A0Error,Solver->A1Error,Solver->NumRejected);
+
+      /*--------------------------------------------------------------*/
+      /*- keep only eigenvalues inside the tile. tiles are half-open -*/
+      /*- (except at the outer edges of the sweep region) so that   -*/
+      /*- eigenvalues on shared edges are only reported once.       -*/
+      /*--------------------------------------------------------------*/
+      int KIn=0;
+      for(int k=0; k<K; k++)
+       { cdouble Lambda=Eigenvalues->GetEntry(k);
+         double x=real(Lambda), y=imag(Lambda);
+         if ( x<xa || x>xb || (x==xb && ix<NX-1) ) continue;
+         if ( y<ya || y>yb || (y==yb && iy<NY-1) ) continue;
+         if (KIn<k)
+          { Eigenvalues->SetEntry(KIn, Lambda);
+            EVErrors->SetEntry(KIn, EVErrors->GetEntry(k));
+            Residuals->SetEntry(KIn, Residuals->GetEntry(k));
+            Eigenvectors->SetEntries(":", KIn, (cdouble *)Eigenvectors->GetColumnPointer(k));
+          };
+         KIn++;
+       };
+      Log(" Beyn sweep: %i eigenvalues in tile %i (NE=%i)",KIn,nTile+1,NE);
+
+      if (TileFunc)
+       TileFunc(TileData, Solver, nTile, za, zb, NE, KIn);
+      NumModes+=KIn;
+
+      /*--------------------------------------------------------------*/
+      /*- discard cached points that no later tile will need; the   -*/
+      /*- discarded entries' buffers are kept for reuse             -*/
+      /*--------------------------------------------------------------*/
+      if (Cache)
+       { int NumKept=0;
+         for(int np=0; np<Cache->NumPoints; np++)
+          { bool Needed=false;
+            for(int nt=nTile+1; nt<NX*NY && !Needed; nt++)
+             { int jx=nt%NX, jy=nt/NX;
+               Needed=OnTileBoundary(Cache->z[np],
+                                     TileBoundary(x0,x1,jx,NX), TileBoundary(x0,x1,jx+1,NX),
+                                     TileBoundary(y0,y1,jy,NY), TileBoundary(y0,y1,jy+1,NY));
+             };
+            if (!Needed) continue;
+            HMatrix *Temp=Cache->MInvVHat[NumKept];
+            Cache->MInvVHat[NumKept]=Cache->MInvVHat[np];
+            Cache->MInvVHat[np]=Temp;
+            Cache->z[NumKept++]=Cache->z[np];
+          };
+         Cache->NumPoints=NumKept;
+       };
+    };
+
+  if (Cache)
+   Log("Beyn sweep: %i modes, %i quadrature points computed, %i reused",
+        NumModes,Cache->NumMisses,Cache->NumHits);
+
+  if (OwnCache)
+   SetBeynCacheSize(Solver, 0);
+
+  return NumModes;
+}
+
+/***************************************************************/
+/* public entry points *****************************************/
+/***************************************************************/
+int BeynSolve(BeynSolver *Solver,
+              BeynFunction UserFunction, void *UserData,
+              cdouble z0, double Rx, double Ry, int N)
+{ return BeynSolve(Solver, UserFunction, 0, UserData, z0, Rx, Ry, N); }
+
 int BeynSolve(BeynSolver *Solver,
               BeynFunction UserFunction, void *UserData,
               cdouble z0, double R, int N)
-{ return BeynSolve(Solver, UserFunction, UserData, z0, R, R, N); }
+{ return BeynSolve(Solver, UserFunction, 0, UserData, z0, R, R, N); }
+
+int BeynSolve(BeynSolver *Solver,
+              BeynFunctionW UserFunction, void *UserData,
+              cdouble z0, double Rx, double Ry, int N)
+{ return BeynSolve(Solver, 0, UserFunction, UserData, z0, Rx, Ry, N); }
+
+int BeynSolve(BeynSolver *Solver,
+              BeynFunctionW UserFunction, void *UserData,
+              cdouble z0, double R, int N)
+{ return BeynSolve(Solver, 0, UserFunction, UserData, z0, R, R, N); }
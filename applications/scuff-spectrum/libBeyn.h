@@ -46,6 +46,32 @@
 /***************************************************************/
 typedef void (*BeynFunction)(cdouble z, void *UserData, HMatrix *VHat, HMatrix *MVHat);
 
+/***************************************************************/
+/* alternative prototype for user functions that can be called */
+/* concurrently at several quadrature points. nw, which ranges */
+/* from 0 to Solver->NumWorkspaces-1, identifies the workspace */
+/* (BEM matrix etc.) the function should use; no two          */
+/* concurrent calls are ever passed the same value of nw.      */
+/***************************************************************/
+typedef void (*BeynFunctionW)(cdouble z, void *UserData, int nw, HMatrix *VHat, HMatrix *MVHat);
+
+/***************************************************************/
+/* cache of Inverse[M(z)]*VHat matrices at quadrature points,  */
+/* keyed by the exact value of z, so that points shared by     */
+/* adjacent contours (or by successive refinements of the same */
+/* contour) are only computed once. entries are only valid for */
+/* the VHat matrix they were computed with, so ReRandomize()   */
+/* empties the cache.                                          */
+/***************************************************************/
+typedef struct BeynPointCache
+{
+   int MaxPoints, NumPoints;
+   cdouble *z;
+   HMatrix **MInvVHat;
+   int NumHits, NumMisses;
+
+ } BeynPointCache;
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -61,16 +87,40 @@ typedef struct BeynSolver
    HVector *Sigma;
    cdouble *Workspace;
 
+   // number of quadrature points evaluated concurrently by 
+   // BeynSolve() with a BeynFunctionW, and their MInvVHat buffers
+   // (MInvVHatW[0] = MInvVHat)
+   int NumWorkspaces;
+   HMatrix **MInvVHatW;
+
+   // optional cache of quadrature-point data (see above)
+   BeynPointCache *Cache;
+
+   // diagnostics from the most recent solve: discrepancy between
+   // the fine and coarse quadrature estimates of A0 and A1, each 
+   // normalized to the sum of |weight| * |integrand|, and the
+   // number of eigenvalue candidates rejected by the residual test
+   double A0Error, A1Error;
+   int NumRejected;
+
  } BeynSolver;
 
 // constructor, destructor
-BeynSolver *CreateBeynSolver(int M, int L);
+// NumWorkspaces bounds the number of quadrature points in flight
+// at once, and thus the memory footprint, of BeynSolve() with a 
+// BeynFunctionW (each in-flight point needs an MxL buffer here 
+// and whatever workspace the user function needs)
+BeynSolver *CreateBeynSolver(int M, int L, int NumWorkspaces=1);
 void DestroyBeynSolver(BeynSolver *Solver);
 
-// reset the random matrix VHat used in the Beyn algorithm
-// 
+// reset the random matrix VHat used in the Beyn algorithm;
+// RandSeed=0 means seed the generator with the current time
 void ReRandomize(BeynSolver *Solver, unsigned int RandSeed=0);
 
+// allocate (or, with MaxPoints=0, discard) a cache for up to 
+// MaxPoints quadrature points
+void SetBeynCacheSize(BeynSolver *Solver, int MaxPoints);
+
 // for both of the following routines,
 // the return value is the number of eigenvalues found,
 // and the eigenvalues and eigenvectors are stored in the
@@ -88,4 +138,56 @@ int BeynSolve(BeynSolver *Solver,
               BeynFunction UserFunction, void *UserData,
               cdouble z0, double Rx, double Ry, int N=25);
 
+// versions of the above for user functions that may be called
+// concurrently at up to Solver->NumWorkspaces quadrature points;
+// the A0/A1 contributions are always summed in the same order,
+// so the results do not depend on the number of threads
+int BeynSolve(BeynSolver *Solver,
+              BeynFunctionW UserFunction, void *UserData,
+              cdouble z0, double R, int N=25);
+
+int BeynSolve(BeynSolver *Solver,
+              BeynFunctionW UserFunction, void *UserData,
+              cdouble z0, double Rx, double Ry, int N=25);
+
+// Beyn method for the rectangular contour with lower-left and
+// upper-right corners zMin, zMax, using NE-interval Clenshaw-Curtis
+// quadrature on each edge (NE is rounded up to an even number).
+// the rules are nested and the nodes include the corners, so
+// contours that share corners or edges, or that differ only in 
+// a power-of-2 factor of NE, share quadrature points; with a
+// cache these are computed only once.
+int BeynSolveRectangle(BeynSolver *Solver,
+                       BeynFunctionW UserFunction, void *UserData,
+                       cdouble zMin, cdouble zMax, int NE=8);
+
+/***************************************************************/
+/* spectral sweep: search the rectangle with corners zMin,     */
+/* zMax for eigenvalues by tiling it with NX x NY rectangular  */
+/* contours. for each tile, NE starts at NEMin and is doubled  */
+/* (up to NEMax) until the fine and coarse estimates of A0, A1 */
+/* agree to within relative tolerance Tol and no eigenvalue    */
+/* candidate fails the SCUFF_BEYN_RES_TOL residual test.       */
+/*                                                             */
+/* for each tile, the eigenvalues lying within the tile (and   */
+/* their errors, residuals, eigenvectors) are left in Solver,  */
+/* and TileFunc is called with the number K of such           */
+/* eigenvalues before moving on to the next tile.              */
+/*                                                             */
+/* quadrature points on edges shared with tiles still to come  */
+/* are cached; MaxCachedPoints bounds the cache size.          */
+/*                                                             */
+/* the return value is the total number of eigenvalues found.  */
+/***************************************************************/
+typedef void (*BeynTileFunction)(void *TileData, BeynSolver *Solver,
+                                 int nTile, cdouble zMin, cdouble zMax,
+                                 int NE, int K);
+
+int BeynSweep(BeynSolver *Solver,
+              BeynFunctionW UserFunction, void *UserData,
+              cdouble zMin, cdouble zMax, int NX, int NY,
+              BeynTileFunction TileFunc, void *TileData,
+              double Tol=1.0e-6, int NEMin=8, int NEMax=128,
+              int MaxCachedPoints=1000);
+
 #endif
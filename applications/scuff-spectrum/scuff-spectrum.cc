@@ -48,17 +48,17 @@ void WriteSphericalMoments(RWGGeometry *G, HVector *KN, cdouble Omega, int LMax,
 typedef struct BFData
  { 
    RWGGeometry *G;
-   HMatrix *M;
+   HMatrix **MW;       // one BEM matrix per Beyn workspace
    double kBloch[2];
    FILE *LogFile;
  } BFData;
 
-void BeynFunc(cdouble Omega, void *UserData, HMatrix *VHat, HMatrix *MVHat)
+void BeynFunc(cdouble Omega, void *UserData, int nw, HMatrix *VHat, HMatrix *MVHat)
 {
   BFData *Data   = (BFData *)UserData;
 
   RWGGeometry *G = Data->G;
-  HMatrix *M     = Data->M;
+  HMatrix *M     = Data->MW[nw];
   double *kBloch = Data->kBloch;
   FILE *LogFile  = Data->LogFile;
 
@@ -69,13 +69,21 @@ void BeynFunc(cdouble Omega, void *UserData, HMatrix *VHat, HMatrix *MVHat)
   if (G->LDim==2)
    Log(" assembling BEM matrix at k={%e,%e},Omega=%s", kBloch[0],kBloch[1],CD2S(Omega));
 
+  // with several workspaces this runs concurrently at different
+  // frequencies, so leave the geometry's cached eps/mu values
+  // alone; WriteModes() refreshes them for each mode
   if (G->LDim==0)
-   G->AssembleBEMMatrix(Omega, M);
+   G->AssembleBEMMatrix(Omega, M, false);
   else
-   G->AssembleBEMMatrix(Omega, kBloch, M);
+   G->AssembleBEMMatrix(Omega, kBloch, M, false);
 
   if (LogFile)
-   fprintf(LogFile,"%e %e\n",real(Omega),imag(Omega));
+   { 
+#ifdef USE_OPENMP
+#pragma omp critical(BeynLogFile)
+#endif
+     fprintf(LogFile,"%e %e\n",real(Omega),imag(Omega));
+   };
 
   if (MVHat)
    M->Multiply(VHat, MVHat);
@@ -87,6 +95,118 @@ void BeynFunc(cdouble Omega, void *UserData, HMatrix *VHat, HMatrix *MVHat)
    }
 }
 
+/***************************************************************/
+/* data needed to write output files for the modes found in a  */
+/* contour                                                     */
+/***************************************************************/
+typedef struct ModeOutputData
+ {
+   RWGGeometry *G;
+   double *kBloch;
+   char *FileBase;
+   char *CartesianMomentFile;
+   char *SphericalMomentFile;
+   int LMax;
+   bool PlotSurfaceCurrents, PlotSurfaceFields;
+   char **EPFiles;                    int nEPFiles;
+   double *FVScreens;                 int nFVScreens;
+   char **FVMeshes, **FVMeshTransFiles; int nFVMeshes;
+ } ModeOutputData;
+
+/***************************************************************/
+/* write eigenfrequencies to the .ModeFrequencies file and do  */
+/* any requested post-processing of the eigenvectors           */
+/***************************************************************/
+void WriteModes(ModeOutputData *Data, BeynSolver *Solver, int NumModes,
+                const char *ContourLabel, const char *ContourDescription)
+{
+  RWGGeometry *G = Data->G;
+  double *kBloch = Data->kBloch;
+  char *FileBase = Data->FileBase;
+  int D          = G->TotalBFs;
+
+  HVector *Eigenvalues  = Solver->Eigenvalues;
+  HVector *EVErrors     = Solver->EVErrors;
+  HMatrix *Eigenvectors = Solver->Eigenvectors;
+  HVector *Residuals    = Solver->Residuals;
+
+  /***************************************************************/
+  /* write eigenfrequency results to .ModeFrequencies file       */
+  /***************************************************************/
+  FILE *f=vfopen("%s.ModeFrequencies","a",FileBase);
+  fprintf(f,"# For contour %s",ContourDescription);
+  if (kBloch)
+   { fprintf(f,", kBloch=");
+     fprintVec(f,kBloch,G->LDim);
+   }
+  fprintf(f,":\n");
+  fprintf(f,"# re(w) im(w)   estimated error in re(w), im(w)    residual\n");
+  for(int n=0; n<NumModes; n++)
+   { fprintf(f,"%+12e %+12e  ",real(Eigenvalues->GetEntry(n)), imag(Eigenvalues->GetEntry(n)));
+     if (n<EVErrors->N)
+      fprintf(f,"%+12e %+12e  ",real(EVErrors->GetEntry(n)), imag(EVErrors->GetEntry(n)));
+     fprintf(f,"%+e ",Residuals->GetEntryD(n));
+     fprintf(f,"\n");
+   }
+  fclose(f);
+
+  /***************************************************************/
+  /* post-processing of eigenvector data                         */
+  /***************************************************************/
+  for(int nm=0; nm<NumModes; nm++)
+   { 
+     char OutFileBase[100];
+     snprintf(OutFileBase,100,"%s_%s_Mode%i",FileBase,ContourLabel,nm);
+
+     cdouble Omega = Eigenvalues->GetEntry(nm);
+     G->UpdateCachedEpsMuValues(Omega);
+     HVector KN(D, LHM_COMPLEX, (cdouble *)Eigenvectors->GetColumnPointer(nm));
+
+     // write cartesian multiple moments
+     if (Data->CartesianMomentFile)
+      WriteCartesianMoments(G, &KN, Omega, kBloch, Data->CartesianMomentFile);
+
+     // write cartesian multiple moments
+     if (Data->SphericalMomentFile)
+      WriteSphericalMoments(G, &KN, Omega, Data->LMax, Data->SphericalMomentFile);
+
+     // write surface-current visualization files
+     if (Data->PlotSurfaceCurrents)
+      G->PlotSurfaceCurrents(&KN, Omega, kBloch, "%s.pp", OutFileBase);
+
+     if (Data->PlotSurfaceFields)
+      VisualizeSurfaceFields(G, &KN, Omega, kBloch, OutFileBase);
+
+     // process user-specified lists of field-evaluation points
+     for(int nepf=0; nepf<Data->nEPFiles; nepf++)
+      ProcessEPFile(G, &KN, Omega, kBloch, Data->EPFiles[nepf], OutFileBase);
+
+     // process user-specified field-visualization meshes
+     for(int nfm=0; nfm<Data->nFVMeshes; nfm++)
+      VisualizeFields(G, &KN, Omega, kBloch, OutFileBase, Data->FVMeshes[nfm], Data->FVMeshTransFiles[nfm]);
+     for(int ns=0; ns<Data->nFVScreens; ns++)
+      { char VFFileBase[100];
+        snprintf(VFFileBase,100,"%s.Screen%i",OutFileBase,ns);
+        VisualizeFields(G, &KN, Omega, kBloch, VFFileBase, Data->FVScreens + 11*ns);
+      }
+   }
+}
+
+/***************************************************************/
+/* called by BeynSweep() after each tile of a spectral sweep   */
+/***************************************************************/
+void SweepTileFunc(void *TileData, BeynSolver *Solver,
+                   int nTile, cdouble zMin, cdouble zMax, int NE, int K)
+{
+  ModeOutputData *Data = (ModeOutputData *)TileData;
+
+  char ContourLabel[100], ContourDescription[200];
+  snprintf(ContourLabel, 100, "T%i",nTile);
+  snprintf(ContourDescription, 200, "T%i (rectangle w=%s -- %s, NE=%i)",
+           nTile,z2s(zMin),z2s(zMax),NE);
+  WriteModes(Data, Solver, K, ContourLabel, ContourDescription);
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -108,6 +228,15 @@ int main(int argc, char *argv[])
   double kx        = 0.0;  int nkx;
   double ky        = 0.0;  int nky;
   char *ContourFile=0;
+  int NumWorkspaces=1;
+  int RandSeed=0;
+//
+  cdouble SweepMin=0.0;     int nSweepMin;
+  cdouble SweepMax=0.0;     int nSweepMax;
+  int SweepNX=1, SweepNY=1;
+  double SweepTol=1.0e-6;
+  int SweepNEMin=8, SweepNEMax=128;
+  int SweepCachePoints=1000;
 //
   char *FileBase=0;
 //
@@ -132,10 +261,21 @@ int main(int argc, char *argv[])
      {"N",                  PA_INT,     1, 1, (void *)&N,                  0,    "number of quadrature points"},
      {"L",                  PA_INT,     1, 1, (void *)&L,                  0,    "upper bound on expected number of eigenvalues in contour "},
 //
-     {"kx",                 PA_INT,     1, 1, (void *)&kx,                 &nkx, "x component of bloch vector"},
-     {"ky",                 PA_INT,     1, 1, (void *)&ky,                 &nky, "y component of bloch vector"},
+     {"kx",                 PA_DOUBLE,  1, 1, (void *)&kx,                 &nkx, "x component of bloch vector"},
+     {"ky",                 PA_DOUBLE,  1, 1, (void *)&ky,                 &nky, "y component of bloch vector"},
 //
      {"ContourFile",        PA_STRING,  1, 1, (void *)&ContourFile,        0,   "list of contours"},
+     {"NumWorkspaces",      PA_INT,     1, 1, (void *)&NumWorkspaces,      0,   "number of contour points to evaluate concurrently (each needs its own BEM matrix)"},
+     {"RandSeed",           PA_INT,     1, 1, (void *)&RandSeed,           0,   "seed for the random matrix used in Beyn's method (default: current time)"},
+//
+     {"SweepMin",           PA_CDOUBLE, 1, 1, (void *)&SweepMin,           &nSweepMin, "lower-left corner of spectral sweep region"},
+     {"SweepMax",           PA_CDOUBLE, 1, 1, (void *)&SweepMax,           &nSweepMax, "upper-right corner of spectral sweep region"},
+     {"SweepNX",            PA_INT,     1, 1, (void *)&SweepNX,            0,   "number of sweep tiles in the re(w) direction"},
+     {"SweepNY",            PA_INT,     1, 1, (void *)&SweepNY,            0,   "number of sweep tiles in the im(w) direction"},
+     {"SweepTol",           PA_DOUBLE,  1, 1, (void *)&SweepTol,           0,   "relative quadrature-error tolerance for sweep tiles"},
+     {"SweepNEMin",         PA_INT,     1, 1, (void *)&SweepNEMin,         0,   "initial number of quadrature intervals per tile edge"},
+     {"SweepNEMax",         PA_INT,     1, 1, (void *)&SweepNEMax,         0,   "maximum number of quadrature intervals per tile edge"},
+     {"SweepCachePoints",   PA_INT,     1, 1, (void *)&SweepCachePoints,   0,   "maximum number of quadrature points to cache for reuse by adjacent tiles"},
 //
      {"PlotContours",       PA_BOOL,    0, 1, (void *)&PlotContours,       0,   "plot contours for visualization"},
 //
@@ -167,9 +307,23 @@ int main(int argc, char *argv[])
   /* initialize RWGGeometry, read list of contours               */
   /***************************************************************/
   RWGGeometry *G         = new RWGGeometry(GeoFile);
-  HMatrix *M             = G->AllocateBEMMatrix();
   int D = G->TotalBFs;
 
+  // concurrent assembly is only safe if it doesn't modify the
+  // geometry: surface-impedance expressions and the substrate
+  // Green's-function accelerator are shared by all workspaces
+  if (NumWorkspaces<1) NumWorkspaces=1;
+  if (NumWorkspaces>1)
+   { if (G->Substrate)
+      ErrExit("--NumWorkspaces > 1 is incompatible with substrate geometries");
+     for(int ns=0; ns<G->NumSurfaces; ns++)
+      if (G->Surfaces[ns]->SurfaceZeta)
+       ErrExit("--NumWorkspaces > 1 is incompatible with surface impedances (surface %s)",G->Surfaces[ns]->Label);
+   };
+  HMatrix **MW = (HMatrix **)mallocEC(NumWorkspaces*sizeof(HMatrix *));
+  for(int nw=0; nw<NumWorkspaces; nw++)
+   MW[nw] = G->AllocateBEMMatrix();
+
   /***************************************************************/
   /* process contour specifications ******************************/
   /***************************************************************/
@@ -196,15 +350,68 @@ int main(int argc, char *argv[])
   fclose(f);
 
   /***************************************************************/
-  /* apply Beyn's method to each user-specified contour          */
+  /* data needed for writing output files ************************/
+  /***************************************************************/
+  ModeOutputData MOData;
+  MOData.G                   = G;
+  MOData.kBloch              = 0;
+  MOData.FileBase            = FileBase;
+  MOData.CartesianMomentFile = CartesianMomentFile;
+  MOData.SphericalMomentFile = SphericalMomentFile;
+  MOData.LMax                = LMax;
+  MOData.PlotSurfaceCurrents = PlotSurfaceCurrents;
+  MOData.PlotSurfaceFields   = PlotSurfaceFields;
+  MOData.EPFiles             = EPFiles;          MOData.nEPFiles   = nEPFiles;
+  MOData.FVScreens           = FVScreens;        MOData.nFVScreens = nFVScreens;
+  MOData.FVMeshes            = FVMeshes;         MOData.nFVMeshes  = nFVMeshes;
+  MOData.FVMeshTransFiles    = FVMeshTransFiles;
+
+  /***************************************************************/
+  /* if a sweep region was specified, tile it with rectangular   */
+  /* contours, refining each until converged                     */
   /***************************************************************/
   SetDefaultCD2SFormat("%.8e %.8e");
+  if (nSweepMin || nSweepMax)
+   { 
+     if ( !(nSweepMin && nSweepMax) )
+      ErrExit("--SweepMin and --SweepMax must be specified together");
+     if ( real(SweepMax)<=real(SweepMin) || imag(SweepMax)<=imag(SweepMin) )
+      ErrExit("--SweepMax must lie above and to the right of --SweepMin");
+     if (ContourFile)
+      Warn("--ContourFile ignored for spectral sweep");
+
+     struct BFData MyBFData = {G, MW, {kx,ky}, 0};
+     MOData.kBloch = (G->LDim > 0) ? MyBFData.kBloch : 0;
+
+     if (PlotContours)
+      { MyBFData.LogFile = vfopen("%s.contours","a",FileBase);
+        fprintf(MyBFData.LogFile,"\n\n# sweep %s -- %s\n",CD2S(SweepMin),CD2S(SweepMax));
+      }
+
+     BeynSolver *Solver = CreateBeynSolver(D, L, NumWorkspaces);
+     if (RandSeed)
+      ReRandomize(Solver, RandSeed);
+     int NumModes=BeynSweep(Solver, BeynFunc, (void *)&MyBFData,
+                            SweepMin, SweepMax, SweepNX, SweepNY,
+                            SweepTileFunc, (void *)&MOData,
+                            SweepTol, SweepNEMin, SweepNEMax, SweepCachePoints);
+     Log("Found %i modes in sweep region.",NumModes);
+     DestroyBeynSolver(Solver);
+
+     if (PlotContours)
+      fclose(MyBFData.LogFile);
+     return 0;
+   };
+
+  /***************************************************************/
+  /* apply Beyn's method to each user-specified contour          */
+  /***************************************************************/
   for(int nr=0; nr<ContourMatrix->NR; nr++)
    {
      /***************************************************************/
      /* extract information on the contour **************************/
      /***************************************************************/
-     struct BFData MyBFData = {G, M, {0,0}, 0};
+     struct BFData MyBFData = {G, MW, {0,0}, 0};
      double *kBloch = (G->LDim > 0) ? MyBFData.kBloch : 0;
      for(int d=0; d<G->LDim; d++) 
       MyBFData.kBloch[d] = ContourMatrix->GetEntryD(nr, d);
@@ -233,75 +440,21 @@ int main(int argc, char *argv[])
      /***************************************************************/
      /* run Beyn's algorithm for this contour                       */
      /***************************************************************/
-     BeynSolver *Solver    = CreateBeynSolver(D, L);
-     HVector *Eigenvalues  = Solver->Eigenvalues;
-     HVector *EVErrors     = Solver->EVErrors;
-     HMatrix *Eigenvectors = Solver->Eigenvectors;
-     HVector *Residuals    = Solver->Residuals;
+     BeynSolver *Solver    = CreateBeynSolver(D, L, NumWorkspaces);
+     if (RandSeed)
+      ReRandomize(Solver, RandSeed);
      int NumModes=BeynSolve(Solver, BeynFunc, (void *)&MyBFData, Omega0, Rx, Ry, N);
 
      if (PlotContours)
       fclose(MyBFData.LogFile);
 
      /***************************************************************/
-     /* write eigenfrequency results to .ModeFrequencies file       */
+     /* write eigenfrequencies and post-process eigenvectors        */
      /***************************************************************/
-     f=vfopen("%s.ModeFrequencies","a",FileBase);
-     fprintf(f,"# For contour w0=%s, Rx=%e, Ry=%e, N=%i, L=%i",z2s(Omega0),Rx,Ry,N,L);
-     if (kBloch)
-      { fprintf(f,", kBloch=");
-        fprintVec(f,kBloch,G->LDim);
-      }
-     fprintf(f,":\n");
-     fprintf(f,"# re(w) im(w)   estimated error in re(w), im(w)    residual\n");
-     for(int n=0; n<NumModes; n++)
-      { fprintf(f,"%+12e %+12e  ",real(Eigenvalues->GetEntry(n)), imag(Eigenvalues->GetEntry(n)));
-        if (n<EVErrors->N)
-         fprintf(f,"%+12e %+12e  ",real(EVErrors->GetEntry(n)), imag(EVErrors->GetEntry(n)));
-        fprintf(f,"%+e ",Residuals->GetEntryD(n));
-        fprintf(f,"\n");
-      }
-     fclose(f);
-
-     /***************************************************************/
-     /* post-processing of eigenvector data                         */
-     /***************************************************************/
-     for(int nm=0; nm<NumModes; nm++)
-      { 
-        char OutFileBase[100];
-        snprintf(OutFileBase,100,"%s_%s_Mode%i",FileBase,ContourLabel,nm);
-
-        cdouble Omega = Eigenvalues->GetEntry(nm);
-        HVector KN(D, LHM_COMPLEX, (cdouble *)Eigenvectors->GetColumnPointer(nm));
-
-        // write cartesian multiple moments
-        if (CartesianMomentFile)
-         WriteCartesianMoments(G, &KN, Omega, kBloch, CartesianMomentFile);
-
-        // write cartesian multiple moments
-        if (SphericalMomentFile)
-         WriteSphericalMoments(G, &KN, Omega, LMax, SphericalMomentFile);
-
-        // write surface-current visualization files
-        if (PlotSurfaceCurrents)
-         G->PlotSurfaceCurrents(&KN, Omega, kBloch, "%s.pp", OutFileBase);
-
-        if (PlotSurfaceFields)
-         VisualizeSurfaceFields(G, &KN, Omega, kBloch, OutFileBase);
-
-        // process user-specified lists of field-evaluation points
-        for(int nepf=0; nepf<nEPFiles; nepf++)
-         ProcessEPFile(G, &KN, Omega, kBloch, EPFiles[nepf], OutFileBase);
-
-        // process user-specified field-visualization meshes
-        for(int nfm=0; nfm<nFVMeshes; nfm++)
-         VisualizeFields(G, &KN, Omega, kBloch, OutFileBase, FVMeshes[nfm], FVMeshTransFiles[nfm]);
-        for(int ns=0; ns<nFVScreens; ns++)
-         { char VFFileBase[100];
-           snprintf(VFFileBase,100,"%s.Screen%i",OutFileBase,ns);
-           VisualizeFields(G, &KN, Omega, kBloch, VFFileBase, FVScreens + 11*ns);
-         }
-      }
+     char ContourDescription[200];
+     snprintf(ContourDescription,200,"w0=%s, Rx=%e, Ry=%e, N=%i, L=%i",z2s(Omega0),Rx,Ry,N,L);
+     MOData.kBloch = kBloch;
+     WriteModes(&MOData, Solver, NumModes, ContourLabel, ContourDescription);
 
      DestroyBeynSolver(Solver);
 
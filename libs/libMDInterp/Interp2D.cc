@@ -223,6 +223,33 @@ Interp2D::Interp2D(double *pX1Points, int pN1,
 
 }
 
+/****************************************************************/
+/* class constructor 1b: construct the class from a user-       */
+/* supplied table of function values and derivatives on a       */
+/* nonuniform grid (same layout as the table computed by        */
+/* InitInterp2D from a user-supplied function)                  */
+/****************************************************************/
+Interp2D::Interp2D(double *PhiVDTable,
+                   double *pX1Points, int pN1,
+                   double *pX2Points, int pN2,
+                   int pnFun, int pLogLevel)
+{
+   if (pN1<2 || pN2<2)
+    ErrExit("Interp2D: grid must have 2 or more points in every dimension");
+   N1=pN1; 
+   N2=pN2;
+   X1Points=(double *)memdup(pX1Points, N1*sizeof(double));
+   X2Points=(double *)memdup(pX2Points, N2*sizeof(double));
+   nFun=pnFun;
+   LogLevel=pLogLevel;
+
+   CTable=(double *)mallocEC((N1-1)*(N2-1)*nFun*NCOEFF*sizeof(double));
+   if (!CTable)
+    ErrExit("%s:%i:out of memory",__FILE__,__LINE__);
+
+   InitInterp2D(0, 0, PhiVDTable);
+}
+
 /****************************************************************/
 /* class constructor 2: construct the class from user-supplied  */
 /* uniform grids                                                */
@@ -278,7 +305,7 @@ Interp2D::Interp2D(double pX1Min, double X1Max, int pN1,
 /****************************************************************/
 /* main body of class constructor for the above two entry points*/
 /****************************************************************/
-void Interp2D::InitInterp2D(Phi2D PhiFunc, void *UserData)
+void Interp2D::InitInterp2D(Phi2D PhiFunc, void *UserData, double *PhiVDTable)
 {
    if (LogLevel>=LMDI_LOGLEVEL_TERSE)
     Log("Creating interpolation grid with %i grid points...",N1*N2);
@@ -299,72 +326,77 @@ void Interp2D::InitInterp2D(Phi2D PhiFunc, void *UserData)
    /*- is a pointer to an array of NDATA doubles which are the     */
    /*- value and derivatives of function #nf at grid point (n1,n2).*/
    /*--------------------------------------------------------------*/
-   double *PhiVDTable=(double *)mallocEC(N1*N2*nFun*NDATA*sizeof(double));
-   if (!PhiVDTable)
-    ErrExit("%s:%i:out of memory",__FILE__,__LINE__);
-
-   /*--------------------------------------------------------------*/
-   /*- fire off threads that will call the user's function to     -*/
-   /*- populate the PVDTable table.                               -*/
-   /*--------------------------------------------------------------*/
-   if (LogLevel>=LMDI_LOGLEVEL_VERBOSE)
-    Log("Computing user function at grid points...");
    int nThread=GetNumThreads();
+   bool OwnsPhiVDTable = false;
+   if (PhiVDTable==0)
+    { OwnsPhiVDTable=true;
+      PhiVDTable=(double *)mallocEC(N1*N2*nFun*NDATA*sizeof(double));
+      if (!PhiVDTable)
+       ErrExit("%s:%i:out of memory",__FILE__,__LINE__);
+
+      /*--------------------------------------------------------------*/
+      /*- fire off threads that will call the user's function to     -*/
+      /*- populate the PVDTable table.                               -*/
+      /*--------------------------------------------------------------*/
+      if (LogLevel>=LMDI_LOGLEVEL_VERBOSE)
+       Log("Computing user function at grid points...");
 
 #ifdef USE_PTHREAD
-   ThreadData *TDs = new ThreadData[nThread], *TD;
-   pthread_t *Threads = new pthread_t[nThread];
+      ThreadData *TDs = new ThreadData[nThread], *TD;
+      pthread_t *Threads = new pthread_t[nThread];
 #endif
-   ThreadData TD1;
-   int nt;
-
-   TD1.X1Points=X1Points;
-   TD1.X2Points=X2Points;
-   TD1.N1=N1;
-   TD1.N2=N2;
-   TD1.X1Min=X1Min;
-   TD1.X2Min=X2Min;
-   TD1.DX1=DX1;
-   TD1.DX2=DX2;
-   TD1.nFun=nFun;
-   TD1.PhiFunc=PhiFunc;
-   TD1.UserData=UserData;
-   TD1.PhiVDTable=PhiVDTable;
-   TD1.nThread=nThread;
-   TD1.LogLevel=LogLevel;
+      ThreadData TD1;
+      int nt;
+
+      TD1.X1Points=X1Points;
+      TD1.X2Points=X2Points;
+      TD1.N1=N1;
+      TD1.N2=N2;
+      TD1.X1Min=X1Min;
+      TD1.X2Min=X2Min;
+      TD1.DX1=DX1;
+      TD1.DX2=DX2;
+      TD1.nFun=nFun;
+      TD1.PhiFunc=PhiFunc;
+      TD1.UserData=UserData;
+      TD1.PhiVDTable=PhiVDTable;
+      TD1.nThread=nThread;
+      TD1.LogLevel=LogLevel;
 #ifdef USE_OPENMP
 #pragma omp parallel for firstprivate(TD1), schedule(static,1), num_threads(nThread)
 #endif
-   for(nt=0; nt<nThread; nt++)
-    {
+      for(nt=0; nt<nThread; nt++)
+       {
 #ifdef USE_PTHREAD
-      TD=&(TDs[nt]);
-      *TD = TD1;
+         TD=&(TDs[nt]);
+         *TD = TD1;
 #else
-      ThreadData *TD=&TD1;
+         ThreadData *TD=&TD1;
 #endif
-      TD->nt=nt;
+         TD->nt=nt;
 #ifdef USE_PTHREAD
-      if (nt+1 == nThread)
-	GetPhiVD_Thread((void *)TD);
-      else
-	pthread_create( &(Threads[nt]), 0, GetPhiVD_Thread, (void *)TD);
+         if (nt+1 == nThread)
+            GetPhiVD_Thread((void *)TD);
+         else
+            pthread_create( &(Threads[nt]), 0, GetPhiVD_Thread, (void *)TD);
 #else
-      GetPhiVD_Thread((void *)TD);
+         GetPhiVD_Thread((void *)TD);
 #endif
-    };
+       };
 
 #ifdef USE_PTHREAD
-   /*--------------------------------------------------------------*/
-   /*- wait for threads to terminate ------------------------------*/
-   /*--------------------------------------------------------------*/ 
-   for(nt=0; nt<nThread-1; nt++)
-    pthread_join(Threads[nt],0);
+      /*--------------------------------------------------------------*/
+      /*- wait for threads to terminate ------------------------------*/
+      /*--------------------------------------------------------------*/ 
+      for(nt=0; nt<nThread-1; nt++)
+       pthread_join(Threads[nt],0);
 
-   delete[] Threads;
-   delete[] TDs;
+      delete[] Threads;
+      delete[] TDs;
 #endif
 
+    }; // if (PhiVDTable==0)
+
    /*--------------------------------------------------------------*/
    /*- construct the matrix whose inverse maps a vector of        -*/
    /*- phi values and derivatives into polynomial coefficients.   -*/
@@ -413,54 +445,60 @@ void Interp2D::InitInterp2D(Phi2D PhiFunc, void *UserData)
    /*--------------------------------------------------------------*/
    /*- now go through and solve a linear system for each grid      */
    /*- cell to compute the coefficients of the interpolating       */
-   /*- polynomial in that cell                                     */
+   /*- polynomial in that cell. the cells are independent, so this */
+   /*- is done in parallel, with the LU-factorized M shared        */
+   /*- read-only by all threads.                                   */
    /*--------------------------------------------------------------*/
-   // int nPoints=0, TotalPoints=(N1-1)*(N2-1), pc;
-   int n1, dn1, n2, dn2;
-   int nf;
-   double *P;
-   HVector *C = new HVector(NCOEFF);
-
    if (LogLevel>=LMDI_LOGLEVEL_VERBOSE)
     Log("Computing coefficients of interpolating polynomials...");
-   for(n1=0; n1<(N1-1); n1++)
-    for(n2=0; n2<(N2-1); n2++)
-     { 
-       if (X1Points)
-        { DX1=X1Points[n1+1]-X1Points[n1];
-          DX2=X2Points[n2+1]-X2Points[n2];
-        };
-
-       /* separately compute interpolation coefficients for each function  */
-       for(nf=0; nf<nFun; nf++)
-        { 
-          /* construct the RHS vector by extracting from PhiVDTable the 4 data */
-          /* values for each of the 4 corners of this grid cell.               */
-          for(ncp=0, dn1=0; dn1<=1; dn1++)
-           for(dn2=0; dn2<=1; dn2++, ncp++)
-            { P=PhiVDTable + GetPhiVDTableOffset(nf, nFun, n1+dn1, N1, n2+dn2, N2);
-              C->SetEntry( NDATA*ncp + 0, P[0]);
-              C->SetEntry( NDATA*ncp + 1, DX1*P[1]);
-              C->SetEntry( NDATA*ncp + 2, DX2*P[2]);
-              C->SetEntry( NDATA*ncp + 3, DX1*DX2*P[3]);
-            };
-
-          /* solve the 16x16 system */
-          M->LUSolve(C);
-
-          /* store the coefficients in the appropriate place in CTable */
-          P=CTable + GetCTableOffset(nf, nFun, n1, N1, n2, N2);
-          memcpy(P, C->DV, NCOEFF*sizeof(double));
-        };
+   int NumCells=(N1-1)*(N2-1);
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(static,64), num_threads(nThread)
+#endif
+   for(int nCell=0; nCell<NumCells; nCell++)
+    { 
+      int n1 = nCell / (N2-1);
+      int n2 = nCell % (N2-1);
 
-     };
+      double dX1=DX1, dX2=DX2;
+      if (X1Points)
+       { dX1=X1Points[n1+1]-X1Points[n1];
+         dX2=X2Points[n2+1]-X2Points[n2];
+       };
+
+      double CBuffer[NCOEFF];
+      HVector C(NCOEFF, LHM_REAL, (void *)CBuffer);
+
+      /* separately compute interpolation coefficients for each function  */
+      for(int nf=0; nf<nFun; nf++)
+       { 
+         /* construct the RHS vector by extracting from PhiVDTable the 4 data */
+         /* values for each of the 4 corners of this grid cell.               */
+         int ncp=0;
+         for(int dn1=0; dn1<=1; dn1++)
+          for(int dn2=0; dn2<=1; dn2++, ncp++)
+           { double *P=PhiVDTable + GetPhiVDTableOffset(nf, nFun, n1+dn1, N1, n2+dn2, N2);
+             C.SetEntry( NDATA*ncp + 0, P[0]);
+             C.SetEntry( NDATA*ncp + 1, dX1*P[1]);
+             C.SetEntry( NDATA*ncp + 2, dX2*P[2]);
+             C.SetEntry( NDATA*ncp + 3, dX1*dX2*P[3]);
+           };
+
+         /* solve the 16x16 system */
+         M->LUSolve(&C);
+
+         /* store the coefficients in the appropriate place in CTable */
+         double *P=CTable + GetCTableOffset(nf, nFun, n1, N1, n2, N2);
+         memcpy(P, CBuffer, NCOEFF*sizeof(double));
+       };
+    };
 
    /*--------------------------------------------------------------*/
    /*--------------------------------------------------------------*/
    /*--------------------------------------------------------------*/
-   delete C;
    delete M;
-   free(PhiVDTable);
+   if (OwnsPhiVDTable)
+    free(PhiVDTable);
    if (LogLevel>=LMDI_LOGLEVEL_VERBOSE)
     Log("...interpolation table constructed!");
 
@@ -469,9 +507,9 @@ void Interp2D::InitInterp2D(Phi2D PhiFunc, void *UserData)
 /****************************************************************/
 /****************************************************************/
 /****************************************************************/
-void Interp2D::ReInitialize(Phi2D PhiFunc, void *UserData)
+void Interp2D::ReInitialize(Phi2D PhiFunc, void *UserData, double *PhiVDTable)
 { 
-  InitInterp2D(PhiFunc, UserData);
+  InitInterp2D(PhiFunc, UserData, PhiVDTable);
 }
 
 /****************************************************************/
@@ -480,12 +518,14 @@ void Interp2D::ReInitialize(Phi2D PhiFunc, void *UserData)
 /****************************************************************/
 Interp2D::Interp2D(const char *FileName)
 {
+   LogLevel=LMDI_LOGLEVEL_TERSE;
+
    if (LogLevel>=LMDI_LOGLEVEL_TERSE)
     Log("Attempting to read interpolation table from file %s...",FileName);
 
    FILE *f=fopen(FileName,"r");
    if (!f)
-    ErrExit("could not open file %s");
+    ErrExit("could not open file %s",FileName);
    
    freadEC(&N1  , sizeof(int), 1, f, FileName);
    freadEC(&N2  , sizeof(int), 1, f, FileName);
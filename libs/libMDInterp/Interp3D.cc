@@ -434,66 +434,64 @@ void Interp3D::ReInitialize(Phi3D PhiFunc, void *UserData, double *PhiVDTable)
    /*--------------------------------------------------------------*/
    /*- now go through and solve a linear system for each grid      */
    /*- cell to compute the coefficients of the interpolating       */
-   /*- polynomial in that cell                                     */
+   /*- polynomial in that cell. the cells are independent, so this */
+   /*- is done in parallel, with the LU-factorized M shared        */
+   /*- read-only by all threads.                                   */
    /*--------------------------------------------------------------*/
-   //   int nPoints=0, TotalPoints=(N1-1)*(N2-1)*(N3-1), pc;
-   int n1, dn1, n2, dn2, n3, dn3;
-   int nf;
-   double *P;
-   HVector *C = new HVector(NCOEFF);
-
    if (LogLevel >= LMDI_LOGLEVEL_VERBOSE)
     Log("Computing coefficients of interpolating polynomials...");
-   for(n1=0; n1<(N1-1); n1++)
-    for(n2=0; n2<(N2-1); n2++)
-     for(n3=0; n3<(N3-1); n3++)
-      { 
-#if 0  
-        for(pc=10; pc<=90; pc++)
-         if ( nPoints++ == pc*TotalPoints/100 )
-          Log("...%i %%...\n",pc);
+   int NumCells=(N1-1)*(N2-1)*(N3-1);
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(static,64), num_threads(GetNumThreads())
 #endif
+   for(int nCell=0; nCell<NumCells; nCell++)
+    { 
+      int n1 = nCell / ( (N2-1)*(N3-1) );
+      int n2 = (nCell / (N3-1)) % (N2-1);
+      int n3 = nCell % (N3-1);
+
+      double dX1=DX1, dX2=DX2, dX3=DX3;
+      if (X1Points)
+       { dX1=X1Points[n1+1]-X1Points[n1];
+         dX2=X2Points[n2+1]-X2Points[n2];
+         dX3=X3Points[n3+1]-X3Points[n3];
+       };
 
-        if (X1Points)
-         { DX1=X1Points[n1+1]-X1Points[n1];
-           DX2=X2Points[n2+1]-X2Points[n2];
-           DX3=X3Points[n3+1]-X3Points[n3];
-         };
-
-        /* separately compute interpolation coefficients for each function  */
-        for(nf=0; nf<nFun; nf++)
-         { 
-           
-           /* construct the RHS vector by extracting from PhiVDTable the 8 data */
-           /* values for each of the 8 corners of this grid cell                */
-           for(ncp=0, dn1=0; dn1<=1; dn1++)
-            for(dn2=0; dn2<=1; dn2++)
-             for(dn3=0; dn3<=1; dn3++, ncp++)
-              { P=PhiVDTable + GetPhiVDTableOffset(nf, nFun, n1+dn1, N1, n2+dn2, N2, n3+dn3, N3);
-                C->SetEntry( NDATA*ncp + 0, P[0]);
-                C->SetEntry( NDATA*ncp + 1, DX1*P[1]);
-                C->SetEntry( NDATA*ncp + 2, DX2*P[2]);
-                C->SetEntry( NDATA*ncp + 3, DX3*P[3]);
-                C->SetEntry( NDATA*ncp + 4, DX1*DX2*P[4]);
-                C->SetEntry( NDATA*ncp + 5, DX1*DX3*P[5]);
-                C->SetEntry( NDATA*ncp + 6, DX2*DX3*P[6]);
-                C->SetEntry( NDATA*ncp + 7, DX1*DX2*DX3*P[7]);
-              };
-
-           /* solve the 64x64 system */
-           M->LUSolve(C);
-
-           /* store the coefficients in the appropriate place in CTable */
-           P=CTable + GetCTableOffset(nf, nFun, n1, N1, n2, N2, n3, N3);
-           memcpy(P,C->DV, NCOEFF*sizeof(double));
-         };
-
-      };
+      double CBuffer[NCOEFF];
+      HVector C(NCOEFF, LHM_REAL, (void *)CBuffer);
+
+      /* separately compute interpolation coefficients for each function  */
+      for(int nf=0; nf<nFun; nf++)
+       { 
+         /* construct the RHS vector by extracting from PhiVDTable the 8 data */
+         /* values for each of the 8 corners of this grid cell                */
+         int ncp=0;
+         for(int dn1=0; dn1<=1; dn1++)
+          for(int dn2=0; dn2<=1; dn2++)
+           for(int dn3=0; dn3<=1; dn3++, ncp++)
+            { double *P=PhiVDTable + GetPhiVDTableOffset(nf, nFun, n1+dn1, N1, n2+dn2, N2, n3+dn3, N3);
+              C.SetEntry( NDATA*ncp + 0, P[0]);
+              C.SetEntry( NDATA*ncp + 1, dX1*P[1]);
+              C.SetEntry( NDATA*ncp + 2, dX2*P[2]);
+              C.SetEntry( NDATA*ncp + 3, dX3*P[3]);
+              C.SetEntry( NDATA*ncp + 4, dX1*dX2*P[4]);
+              C.SetEntry( NDATA*ncp + 5, dX1*dX3*P[5]);
+              C.SetEntry( NDATA*ncp + 6, dX2*dX3*P[6]);
+              C.SetEntry( NDATA*ncp + 7, dX1*dX2*dX3*P[7]);
+            };
+
+         /* solve the 64x64 system */
+         M->LUSolve(&C);
+
+         /* store the coefficients in the appropriate place in CTable */
+         double *P=CTable + GetCTableOffset(nf, nFun, n1, N1, n2, N2, n3, N3);
+         memcpy(P,CBuffer, NCOEFF*sizeof(double));
+       };
+    };
 
    /*--------------------------------------------------------------*/
    /*--------------------------------------------------------------*/
    /*--------------------------------------------------------------*/
-   delete C;
    delete M;
    if (OwnsPhiVDTable)
     free(PhiVDTable);
@@ -507,13 +505,15 @@ void Interp3D::ReInitialize(Phi3D PhiFunc, void *UserData, double *PhiVDTable)
 /* generated by a previous call to Interp3D::WriteToFile()      */
 /****************************************************************/
 Interp3D::Interp3D(const char *FileName)
-{ 
+{
+   LogLevel=LMDI_LOGLEVEL_TERSE;
+
    if (LogLevel >= LMDI_LOGLEVEL_TERSE)
     Log("Attempting to read interpolation table from file %s...",FileName);
 
    FILE *f=fopen(FileName,"r");
    if (!f)
-    ErrExit("could not open file %s");
+    ErrExit("could not open file %s",FileName);
    
    freadEC(&N1  , sizeof(int), 1, f, FileName);
    freadEC(&N2  , sizeof(int), 1, f, FileName);
@@ -270,6 +270,13 @@ class Interp2D
              int nFun, Phi2D PhiFunc=0, void *UserData=0,
              int LogLevel=LMDI_LOGLEVEL_TERSE);
 
+    /*--------------------------------------------------------------*/
+    /*- user-supplied data table, nonuniform grid                   */
+    /*--------------------------------------------------------------*/
+    Interp2D(double *PhiVDTable,
+             double *X1Points, int N1, double *X2Points, int N2,
+             int nFun, int LogLevel=LMDI_LOGLEVEL_TERSE);
+
     /*--------------------------------------------------------------*/
     /*- class constructor 2: construct from a user-supplied function*/
     /*- and uniform grid                                            */
@@ -283,13 +290,13 @@ class Interp2D
     /*- the body of the class constructor for the above two entry  -*/
     /*- points                                                     -*/
     /*--------------------------------------------------------------*/
-    void InitInterp2D(Phi2D PhiFunc, void *UserData);
+    void InitInterp2D(Phi2D PhiFunc, void *UserData, double *PhiVDTable=0);
 
     /*--------------------------------------------------------------*/
     /*- reinitialize an Interp2D object using the same interpolation*/
     /*- grid but with a different function and/or different data    */
     /*--------------------------------------------------------------*/
-    void ReInitialize(Phi2D PhiFunc, void *UserData);
+    void ReInitialize(Phi2D PhiFunc, void *UserData, double *PhiVDTable=0);
 
     /*--------------------------------------------------------------*/
     /*- class constructor 3: construct from a data file previously  */
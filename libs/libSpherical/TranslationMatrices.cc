@@ -222,3 +222,98 @@ void GetTranslationMatrices(double Xij[3], cdouble k, int LMax,
   delete[] Ylm;
 
 }
+
+/***************************************************************/
+/* The scalar translation matrix alone, computed more cheaply  */
+/* than by GetTranslationMatrices above for use in fast        */
+/* multipole methods, where many such matrices are needed.     */
+/*                                                             */
+/* The angular factors in the sum over LC (the products of     */
+/* 3j symbols and normalization constants) depend only on the  */
+/* indices, not on Xij or k, so they may be precomputed once   */
+/* by CreateScalarTranslationTable() and passed to any number  */
+/* of subsequent calls to GetScalarTranslationMatrix().        */
+/*                                                             */
+/* WaveType = LS_OUTGOING gives the matrix A of                */
+/* GetTranslationMatrices; WaveType = LS_REGULAR gives instead */
+/* the matrix that expresses regular waves about xSource as    */
+/* linear combinations of regular waves about xOrigin, which   */
+/* is also the matrix that expresses outgoing waves about      */
+/* xSource as linear combinations of outgoing waves about      */
+/* xOrigin at points with |xDest-xOrigin| > |Xij|.             */
+/*                                                             */
+/* The matrix has (LMaxA+1)^2 rows and (LMaxB+1)^2 columns;    */
+/* on entry A must point to a complex HMatrix of this size.    */
+/***************************************************************/
+double *CreateScalarTranslationTable(int LMaxA, int LMaxB)
+{
+  size_t Size=0;
+  for(int LA=0; LA<=LMaxA; LA++)
+   for(int LB=0; LB<=LMaxB; LB++)
+    Size += (2*LA+1)*(2*LB+1)*( (LA<LB ? LA : LB) + 1 );
+
+  double *Table = new double[Size];
+  size_t n=0;
+  for(int LA=0; LA<=LMaxA; LA++)
+   for(int MA=-LA; MA<=LA; MA++)
+    for(int LB=0; LB<=LMaxB; LB++)
+     for(int MB=-LB; MB<=LB; MB++)
+      { int MC = MA-MB;
+        // only terms with LA+LB+LC even survive
+        for(int LC=abs(LA-LB); LC<=LA+LB; LC+=2)
+         Table[n++] = ( abs(MC)>LC ) ? 0.0 :
+                        4.0*M_PI*M1POW(MA)
+                        *sqrt((2*LA+1)*(2*LB+1)*(2*LC+1)/(4.0*M_PI))
+                        *ThreeJSymbol(LA,LB,LC,0,0,0)
+                        *ThreeJSymbol(LA,LB,LC,-MA,MB,MC);
+      };
+  return Table;
+}
+
+void GetScalarTranslationMatrix(double Xij[3], cdouble k,
+                                int LMaxA, int LMaxB, int WaveType,
+                                HMatrix *A, double *Table)
+{
+  A->Zero();
+  if ( WaveType==LS_OUTGOING && abs(k)*VecNorm(Xij) < 1.0e-6 )
+   { for(int Alpha=0; Alpha<A->NR && Alpha<A->NC; Alpha++)
+      A->SetEntry(Alpha,Alpha,1.0);
+     return;
+   };
+
+  double *MyTable=0;
+  if (Table==0)
+   Table = MyTable = CreateScalarTranslationTable(LMaxA, LMaxB);
+
+  int LCMax=LMaxA+LMaxB;
+  cdouble *R   = new cdouble[LCMax+2];
+  cdouble *Ylm = new cdouble[(LCMax+1)*(LCMax+1)];
+  double r, Theta, Phi;
+  CoordinateC2S(Xij, &r, &Theta, &Phi);
+  if (r==0.0)
+   { // regular waves at zero displacement: only R[0] survives
+     memset(R, 0, (LCMax+2)*sizeof(cdouble));
+     R[0]=1.0;
+     Theta=Phi=0.0;
+   }
+  else
+   GetRadialFunctions(LCMax, k, r, WaveType, R, 0);
+  GetYlmArray(LCMax, Theta, Phi, Ylm);
+
+  size_t n=0;
+  for(int Alpha=0, LA=0; LA<=LMaxA; LA++)
+   for(int MA=-LA; MA<=LA; MA++, Alpha++)
+    for(int Beta=0, LB=0; LB<=LMaxB; LB++)
+     for(int MB=-LB; MB<=LB; MB++, Beta++)
+      { int MC = MA-MB;
+        cdouble AA=0.0;
+        for(int LC=abs(LA-LB); LC<=LA+LB; LC+=2, n++)
+         if (Table[n]!=0.0)
+          AA += Table[n]*IIPOW(LA-LB+LC)*R[LC]*Ylm[LM2ALPHA(LC,MC)];
+        A->SetEntry(Alpha,Beta,AA);
+      };
+
+  delete[] R;
+  delete[] Ylm;
+  if (MyTable) delete[] MyTable;
+}
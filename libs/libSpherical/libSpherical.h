@@ -176,6 +176,11 @@ double GetdzVSWCoefficient(int L,  int M,  int T,
 void GetTranslationMatrices(double Xij[3], cdouble k, int lMax, 
                             HMatrix *A, HMatrix *B, HMatrix *C);
 
+double *CreateScalarTranslationTable(int LMaxA, int LMaxB);
+void GetScalarTranslationMatrix(double Xij[3], cdouble k,
+                                int LMaxA, int LMaxB, int WaveType,
+                                HMatrix *A, double *Table=0);
+
 /***************************************************************/
 /* stuff below this line is legacy, replaced by stuff in new   */
 /* file VectorSphericalWaves.cc, and should eventually be      */
@@ -29,6 +29,10 @@
  *
  */
 
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
 #include "libhrutil.h"
 #include "libTriInt.h"
 #include "BZIntegration.h"
@@ -87,22 +91,27 @@ void GetOctantImage(double kBloch[2], int n, double Image[2])
 }
 
 /***************************************************************/
-/* BZ integrand function passed to clenshaw-curtis cubature    */
-/* routines                                                    */
+/* call whichever form of the integrand the caller supplied,   */
+/* using workspace 0 for the workspace-aware form              */
 /***************************************************************/
-int BZIntegrand_CCCubature(unsigned ndim, const double *u,
-                           void *pArgs, unsigned fdim,
-                           double *BZIntegrand)
+static void CallBZIFunc(GetBZIArgStruct *Args, cdouble Omega,
+                        double *kBloch, double *BZIntegrand)
 {
-  (void) ndim; // unused
+  if (Args->BZIFunc)
+   Args->BZIFunc(Args->UserData, Omega, kBloch, BZIntegrand);
+  else
+   Args->BZIFuncW(Args->UserData, 0, Omega, kBloch, BZIntegrand);
+}
 
-  /*--------------------------------------------------------------*/
-  /*- unpack fields from user data structure ---------------------*/
-  /*--------------------------------------------------------------*/
-  GetBZIArgStruct *Args  = (GetBZIArgStruct *)pArgs;
-  cdouble Omega          = Args->Omega;
-  BZIFunction BZIFunc    = Args->BZIFunc;
-  void *UserData         = Args->UserData;
+/***************************************************************/
+/* map a point u in the clenshaw-curtis integration domain to  */
+/* a kBloch point and a cubature weight. Returns false if the  */
+/* point lies outside the irreducible zone and is to be        */
+/* skipped (i.e. its contribution is zero).                    */
+/***************************************************************/
+static bool GetCCBZPoint(GetBZIArgStruct *Args, const double *u,
+                         double kBloch[3], double *pWeight)
+{
   HMatrix *RLBasis       = Args->RLBasis;
   int SymmetryFactor     = Args->SymmetryFactor;
   int LDim               = RLBasis->NC;
@@ -130,24 +139,41 @@ int BZIntegrand_CCCubature(unsigned ndim, const double *u,
         else if (u[1]<u[0])
          Weight*=1.0;
         else // ky>kx
-         { memset(BZIntegrand, 0, fdim*sizeof(double));
-           return 0;
-         };
+         return false;
       };
    };
+  *pWeight=Weight;
 
   /*--------------------------------------------------------------*/
   /*- convert (ux, uy) variable to kBloch ------------------------*/
   /*--------------------------------------------------------------*/
-  double kBloch[3]={0.0, 0.0, 0.0};
+  kBloch[0]=kBloch[1]=kBloch[2]=0.0;
   for(int nd=0; nd<LDim; nd++)
    for(int nc=0; nc<3; nc++)
     kBloch[nc] += uVector[nd]*RLBasis->GetEntryD(nc,nd);
 
-  /*--------------------------------------------------------------*/
-  /*--------------------------------------------------------------*/
-  /*--------------------------------------------------------------*/
-  BZIFunc(UserData, Omega, kBloch, BZIntegrand);
+  return true;
+}
+
+/***************************************************************/
+/* BZ integrand function passed to clenshaw-curtis cubature    */
+/* routines                                                    */
+/***************************************************************/
+int BZIntegrand_CCCubature(unsigned ndim, const double *u,
+                           void *pArgs, unsigned fdim,
+                           double *BZIntegrand)
+{
+  (void) ndim; // unused
+
+  GetBZIArgStruct *Args  = (GetBZIArgStruct *)pArgs;
+
+  double kBloch[3], Weight;
+  if ( !GetCCBZPoint(Args, u, kBloch, &Weight) )
+   { memset(BZIntegrand, 0, fdim*sizeof(double));
+     return 0;
+   };
+
+  CallBZIFunc(Args, Args->Omega, kBloch, BZIntegrand);
   VecScale(BZIntegrand, Weight, fdim);
   
   Args->NumCalls++;
@@ -155,6 +181,68 @@ int BZIntegrand_CCCubature(unsigned ndim, const double *u,
   return 0;
 }
 
+/***************************************************************/
+/* vectorized version of the above, used for concurrent BZ     */
+/* integration: the npt points are distributed over            */
+/* NumWorkspaces threads, each of which passes its own thread  */
+/* index to the integrand as the workspace index.              */
+/*                                                             */
+/* The first sample at each new frequency is evaluated by      */
+/* itself, before the workspaces start running concurrently,   */
+/* so that any frequency-dependent but kBloch-independent data */
+/* the integrand caches (such as the inner-cell matrix blocks  */
+/* stored in the accelerators for AssembleBEMMatrixBlock) are  */
+/* computed once, with full inner parallelism, and are then    */
+/* only read by the concurrent calls.                          */
+/***************************************************************/
+int BZIntegrand_CCCubature_v(unsigned ndim, size_t npt,
+                             const double *u, void *pArgs,
+                             unsigned fdim, double *BZIntegrands)
+{
+  GetBZIArgStruct *Args  = (GetBZIArgStruct *)pArgs;
+  cdouble Omega          = Args->Omega;
+  BZIFunctionW BZIFuncW  = Args->BZIFuncW;
+  void *UserData         = Args->UserData;
+  int NumWorkspaces      = Args->NumWorkspaces;
+  int NumPoints          = (int)npt;
+
+  double *kBlochs = (double *)mallocEC(4*NumPoints*sizeof(double));
+  double *Weights = kBlochs + 3*NumPoints;
+  bool *Skip      = (bool *)mallocEC(NumPoints*sizeof(bool));
+  int NumCalls=0;
+  for(int np=0; np<NumPoints; np++)
+   { Skip[np] = !GetCCBZPoint(Args, u + np*ndim, kBlochs + 3*np, Weights + np);
+     if (Skip[np])
+      memset(BZIntegrands + np*fdim, 0, fdim*sizeof(double));
+     else
+      NumCalls++;
+   };
+
+  for(int np=0; np<NumPoints && !(Args->Primed); np++)
+   if (!Skip[np])
+    { BZIFuncW(UserData, 0, Omega, kBlochs + 3*np, BZIntegrands + np*fdim);
+      Skip[np]=true;
+      Args->Primed=true;
+    };
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumWorkspaces)
+#endif
+  for(int np=0; np<NumPoints; np++)
+   if (!Skip[np])
+    BZIFuncW(UserData, GetThreadNum(), Omega, kBlochs + 3*np,
+             BZIntegrands + np*fdim);
+
+  for(int np=0; np<NumPoints; np++)
+   VecScale(BZIntegrands + np*fdim, Weights[np], fdim);
+
+  Args->NumCalls += NumCalls;
+
+  free(kBlochs);
+  free(Skip);
+  return 0;
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -192,9 +280,15 @@ void GetBZIntegral_CC(GetBZIArgStruct *Args,
              Upper[0]=0.5; Upper[1]=(Order==0) ? 1.0 : 0.5;
              break;
    };
-  CCCubature(Order, FDim, BZIntegrand_CCCubature, (void *)Args, LDim,
-	     Lower, Upper, MaxEvals, AbsTol, RelTol,
-	     ERROR_INDIVIDUAL, BZIntegral, DataBuffer[0]);
+  if (Args->BZIFuncW && Args->NumWorkspaces>1)
+   CCCubature_v(Order, FDim, BZIntegrand_CCCubature_v, (void *)Args, LDim,
+	        Lower, Upper, MaxEvals, AbsTol, RelTol,
+	        ERROR_INDIVIDUAL, BZIntegral, DataBuffer[0],
+                4*Args->NumWorkspaces);
+  else
+   CCCubature(Order, FDim, BZIntegrand_CCCubature, (void *)Args, LDim,
+	      Lower, Upper, MaxEvals, AbsTol, RelTol,
+	      ERROR_INDIVIDUAL, BZIntegral, DataBuffer[0]);
   VecScale(BZIntegral, SymmetryFactor, FDim);
  
 }
@@ -209,8 +303,6 @@ void BZIntegrand_TC(double *u, void *pArgs, double *BZIntegrand)
   /*--------------------------------------------------------------*/
   GetBZIArgStruct *Args  = (GetBZIArgStruct *)pArgs;
   cdouble Omega          = Args->Omega;
-  BZIFunction BZIFunc    = Args->BZIFunc;
-  void *UserData         = Args->UserData;
   int FDim               = Args->FDim;
   int SymmetryFactor     = Args->SymmetryFactor;
   HMatrix *RLBasis       = Args->RLBasis;
@@ -238,7 +330,7 @@ void BZIntegrand_TC(double *u, void *pArgs, double *BZIntegrand)
      double RkB[3]={0.0, 0.0, 0.0};
      GetOctantImage(kBloch, n, RkB);
      double *DeltaBZI=DataBuffer[0];
-     BZIFunc(UserData, Omega, RkB, DeltaBZI);
+     CallBZIFunc(Args, Omega, RkB, DeltaBZI);
      VecPlusEquals(BZIntegrand, 1.0, DeltaBZI, FDim);
      Args->NumCalls++;
    };
@@ -305,8 +397,6 @@ int BZIntegrand_Angular(unsigned ndim, const double *u, void *pArgs,
 
   GetBZIArgStruct *Args=(GetBZIArgStruct *)pArgs;
 
-  BZIFunction BZIFunc = Args->BZIFunc;
-  void *UserData      = Args->UserData;
   int FDim            = Args->FDim;
   double kRhoHat      = Args->kRhoHat;
   HMatrix *RLBasis    = Args->RLBasis;
@@ -328,7 +418,7 @@ int BZIntegrand_Angular(unsigned ndim, const double *u, void *pArgs,
    { 
      double RkB[3]={0.0, 0.0, 0.0};
      GetOctantImage(kBloch, n, RkB);
-     BZIFunc(UserData, Omega, RkB, DeltaBZI);
+     CallBZIFunc(Args, Omega, RkB, DeltaBZI);
      VecPlusEquals(BZIntegrand, 1.0, DeltaBZI, FDim);
      Args->NumCalls++;
    };  
@@ -400,8 +490,6 @@ int BZIntegrand_Radial(unsigned ndim, const double *u, void *pArgs,
    }
   else if ( (AngularOrder%2)==0 )
    { 
-     BZIFunction BZIFunc = Args->BZIFunc;
-     void *UserData      = Args->UserData;
      double kBloch[3]={0.0, 0.0, 0.0};
      switch(AngularOrder)
       { case 2:  kBloch[0] = kRhoHat*Gamma; break;
@@ -409,7 +497,7 @@ int BZIntegrand_Radial(unsigned ndim, const double *u, void *pArgs,
         case 6: 
         default: kBloch[0] = kBloch[1] = kRhoHat*Gamma/(M_SQRT2); break;
       };
-     BZIFunc(UserData, Omega, kBloch, BZIntegrand);
+     CallBZIFunc(Args, Omega, kBloch, BZIntegrand);
      VecScale(BZIntegrand, 2.0*M_PI, FDim);
      Args->NumCalls++;
    }
@@ -523,7 +611,13 @@ void GetBZIntegral(GetBZIArgStruct *Args, cdouble Omega,
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
+  if (Args->BZIFunc==0 && Args->BZIFuncW==0)
+   ErrExit("no integrand function specified in GetBZIntegral");
+  if (Args->NumWorkspaces<1)
+   Args->NumWorkspaces=1;
+
   Args->NumCalls=0;
+  Args->Primed=false;
   memset(Args->DataBuffer[0],0,FDim*sizeof(double));
   switch(Args->BZIMethod)
    { 
@@ -634,11 +728,15 @@ const char *BZIOptionsString=
  "  --BZIRelTol   xx \n"
  "  --BZIMaxEvals xx \n"
  "  --BZSymmetryFactor [1|2|4|8]\n"
+ "  --BZIWorkspaces xx \n"
  "\n"
  "   allowed values for --BZIOrder: \n"
  "   CC: [0|11|13|...|99]\n"
  "   TC: [1|2|4|5|7|9|13|14|16|20|25]\n"
  "   Polar: 100*M + N, M=N=[11|13|...|99]\n"
+ "\n"
+ "   --BZIWorkspaces N evaluates up to N kBloch points at once\n"
+ "   (CC schemes only; default $SCUFF_BZI_WORKSPACES or 1)\n"
  "\n";
 
 /***************************************************************/
@@ -676,6 +774,7 @@ GetBZIArgStruct *InitBZIArgs(int argc, char **argv)
   GetBZIArgStruct *BZIArgs = (GetBZIArgStruct *)mallocEC(sizeof(*BZIArgs));
 
   BZIArgs->BZIFunc=0;
+  BZIArgs->BZIFuncW=0;
   BZIArgs->UserData=0;
   BZIArgs->FDim=0;
   BZIArgs->RLBasis=0;
@@ -687,9 +786,12 @@ GetBZIArgStruct *InitBZIArgs(int argc, char **argv)
   BZIArgs->RelTol         = DEF_BZIRELTOL;
   BZIArgs->AbsTol         = DEF_BZIABSTOL;
   BZIArgs->SymmetryFactor = 1;
+  BZIArgs->NumWorkspaces  = 1;
+  CheckEnv("SCUFF_BZI_WORKSPACES", &(BZIArgs->NumWorkspaces));
 
   BZIArgs->BufSize = 0;
   memset(BZIArgs->DataBuffer, 0, 4*sizeof(double *));
+  BZIArgs->Primed  = false;
 
   /***************************************************************/
   /***************************************************************/
@@ -764,6 +866,17 @@ GetBZIArgStruct *InitBZIArgs(int argc, char **argv)
         continue;
       };
 
+     if ( !strcasecmp(Arg,"--BZIWorkspaces") )
+      { if (Option==0)
+         ErrExit("--BZIWorkspaces requires an argument");
+        if (    1!=sscanf(Option,"%i",&(BZIArgs->NumWorkspaces))
+             || BZIArgs->NumWorkspaces<1
+           )
+         ErrExit("invalid BZIWorkspaces %s",Option);
+        argv[narg]=argv[narg+1]=0;
+        continue;
+      };
+
      if ( !strcasecmp(Arg,"--BZIMaxEvals") )
       { if (Option==0)
          ErrExit("--BZIMaxEvals requires an argument");
@@ -827,4 +940,16 @@ void UpdateBZIArgs(GetBZIArgStruct *Args,
    LogC("polar cubature 2, radial order %i, angular order %i}",
          Args->Order/100, Args->Order%100);
 
+  if (Args->NumWorkspaces>1)
+   { if (Args->BZIMethod!=BZI_CC || Args->BZIFuncW==0)
+      { if (Args->BZIMethod!=BZI_CC)
+         Warn("--BZIWorkspaces is only supported by CC cubature (ignoring)");
+        else
+         Warn("this code does not support concurrent BZ integration (ignoring --BZIWorkspaces)");
+        Args->NumWorkspaces=1;
+      }
+     else
+      Log("Evaluating up to %i kBloch points concurrently",Args->NumWorkspaces);
+   };
+
 }
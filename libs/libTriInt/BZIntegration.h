@@ -48,6 +48,19 @@ typedef void (*BZIFunction)(void *UserData,
                             cdouble Omega, double *kBloch,
                             double *BZIntegrand);
 
+/***************************************************************/
+/* BZIFunctionW is an alternative form of the integrand that   */
+/* additionally receives the index nw (0 <= nw < NumWorkspaces)*/
+/* of a BEM workspace the caller has set aside for the call.   */
+/* If the caller supplies one of these and NumWorkspaces>1,    */
+/* the Clenshaw-Curtis schemes evaluate batches of kBloch      */
+/* points concurrently, with calls that have different values  */
+/* of nw running at the same time.                             */
+/***************************************************************/
+typedef void (*BZIFunctionW)(void *UserData, int nw,
+                             cdouble Omega, double *kBloch,
+                             double *BZIntegrand);
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -59,6 +72,10 @@ typedef struct GetBZIArgStruct
   int FDim;            // number of doubles in the integrand vector
   int SymmetryFactor;  // either 1, 2, 4, or 8
 
+  // optional workspace-aware integrand for concurrent evaluation
+  BZIFunctionW BZIFuncW;
+  int NumWorkspaces;   // number of independent workspaces
+
   // information on the lattice geometry
   // RLBasis = "reciprocal lattice basis"
   //         = 3 x D matrix, columns = reciprocal lattice vectors
@@ -79,6 +96,7 @@ typedef struct GetBZIArgStruct
   cdouble Omega;
   int BufSize;
   double *DataBuffer[4]; // internally allocated
+  bool Primed;           // first sample at this Omega done
 
   // return values 
   int NumCalls;       // actual # integrand samples (return value)
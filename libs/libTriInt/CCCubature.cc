@@ -93,6 +93,104 @@ int CCCubature(int Order, unsigned fdim, integrand f, void *fdata,
   return nCalls;
 }
 
+/***************************************************************/
+/* adapter used to pass a vectorized integrand to routines     */
+/* that evaluate one point at a time                           */
+/***************************************************************/
+typedef struct VIntegrandData
+ { integrand_v f;
+   void *fdata;
+ } VIntegrandData;
+
+static int VIntegrand(unsigned ndim, const double *x, void *pData,
+                      unsigned fdim, double *fval)
+{ VIntegrandData *Data = (VIntegrandData *)pData;
+  return Data->f(ndim, 1, x, Data->fdata, fdim, fval);
+}
+
+/***************************************************************/
+/* Same as CCCubature, but for a vectorized integrand. For     */
+/* fixed-order rules the cubature points are handed to f in    */
+/* batches of up to MaxBatch points, so that f may evaluate    */
+/* them concurrently.                                          */
+/***************************************************************/
+int CCCubature_v(int Order, unsigned fdim, integrand_v f, void *fdata,
+	         unsigned dim, const double *xmin, const double *xmax, 
+	         size_t maxEval, double reqAbsError, double reqRelError,
+                 error_norm norm, double *Integral, double *Error,
+                 int MaxBatch)
+{
+  if (Order==0)
+   return pcubature_v(fdim, f, fdata, dim, xmin, xmax, maxEval,
+                      reqAbsError, reqRelError, norm, Integral, Error);
+
+  if (Order<0)
+   { VIntegrandData Data;
+     Data.f     = f;
+     Data.fdata = fdata;
+     return RRCubature(-Order, 0, fdim, VIntegrand, (void *)&Data,
+                       dim, xmin, xmax, Integral, Error);
+   };
+
+  double *CCQR = GetCCRule(Order);
+  if (!CCQR) 
+   ErrExit("invalid CCRule order (%i) in CCCubature_v",Order);
+
+  if (dim>MAXDIM) 
+   ErrExit("dimension too high in CCCubature_v");
+
+  if (MaxBatch<1) MaxBatch=1;
+
+  double uAvg[MAXDIM], uDelta[MAXDIM];
+  for(unsigned d=0; d<dim; d++)
+   { uAvg[d]   = 0.5*(xmax[d] + xmin[d]);
+     uDelta[d] = 0.5*(xmax[d] - xmin[d]);
+   };
+
+  int ncp[MAXDIM];
+  memset(ncp, 0, dim*sizeof(int));
+
+  double *u         = (double *)mallocEC(MaxBatch*dim*sizeof(double));
+  double *w         = (double *)mallocEC(MaxBatch*sizeof(double));
+  double *Integrand = (double *)mallocEC(MaxBatch*fdim*sizeof(double));
+
+  memset(Integral, 0, fdim*sizeof(double));
+  if (Error) memset(Error, 0, fdim*sizeof(double));
+  bool Done=false;
+  int nCalls=0;
+  while(!Done)
+   { 
+     // gather a batch of d-dimensional cubature points and weights
+     int NumPoints=0;
+     while(!Done && NumPoints<MaxBatch)
+      { double *uPoint = u + NumPoints*dim;
+        w[NumPoints]=1.0;
+        for(unsigned nd=0; nd<dim; nd++)
+         { uPoint[nd]  = uAvg[nd] - uDelta[nd]*CCQR[2*ncp[nd] + 0];
+           w[NumPoints] *=          uDelta[nd]*CCQR[2*ncp[nd] + 1];
+         }; 
+        NumPoints++;
+
+        for(unsigned nd=0; nd<dim; nd++)
+         { ncp[nd] = (ncp[nd]+1)%Order;
+           if(ncp[nd]) break;
+           if(nd==(dim-1)) Done=true;
+         };
+      };
+
+     f(dim, NumPoints, u, fdata, fdim, Integrand);
+     for(int np=0; np<NumPoints; np++)
+      VecPlusEquals(Integral, w[np], Integrand + np*fdim, fdim);
+     nCalls+=NumPoints;
+   };
+
+  free(u);
+  free(w);
+  free(Integrand);
+
+  return nCalls;
+}
+
 
 /***************************************************************/
 /* embedded clenshaw-curtis cubature in two dimensions.        */
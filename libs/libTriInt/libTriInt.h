@@ -104,6 +104,15 @@ int CCCubature(int Order, unsigned fdim, integrand f, void *fdata,
 	       size_t maxEval, double reqAbsError, double reqRelError,
                error_norm norm, double *Integral, double *Error);
 
+// as CCCubature, but with a vectorized integrand, which is
+// handed up to MaxBatch points at a time (for Order<0, which
+// has no vectorized form, f is called one point at a time)
+int CCCubature_v(int Order, unsigned fdim, integrand_v f, void *fdata,
+	         unsigned dim, const double *xmin, const double *xmax, 
+	         size_t maxEval, double reqAbsError, double reqRelError,
+                 error_norm norm, double *Integral, double *Error,
+                 int MaxBatch=256);
+
 int RRCubature(int Order, int *Orders, 
                int FDim, integrand f, void *UserData,
 	       int IDim, const double *Lower, const double *Upper,
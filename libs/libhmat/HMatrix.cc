@@ -82,6 +82,7 @@ void HMatrix::InitHMatrix(int NRows, int NCols, int pRealComplex,
    RealComplex=pRealComplex;
    StorageType=pStorageType;
    ipiv=0;
+   SPLU=0;
    lwork=0;
    work=0;
    liwork=0;
@@ -117,6 +118,7 @@ void HMatrix::InitHMatrix(int NRows, int NCols, int pRealComplex,
     };
 
   ipiv=0; // this is only allocated when needed 
+  SPLU=0;
  
 }
 
@@ -163,6 +165,7 @@ void HMatrix::ReadFromFile(const char *FileName, int FileType, const char *Optio
   DM=0;
   ZM=0;
   ipiv=0;
+  SPLU=0;
   lwork=0;
   work=0;
   liwork=0;
@@ -209,6 +212,7 @@ HMatrix::HMatrix(SMatrix *S)
    RealComplex=S->RealComplex;
    StorageType=LHM_NORMAL;
    ipiv=0;
+   SPLU=0;
    lwork=0;
    work=0;
    liwork=0;
@@ -258,6 +262,7 @@ HMatrix::~HMatrix()
     if (ZM) free(ZM);
   }
   if (ipiv) free(ipiv);
+  if (SPLU) free(SPLU);
   if (ErrMsg) free(ErrMsg);
   if (work) free(work);
 }
@@ -148,14 +148,49 @@ void HMatrix::GetMatrixProductDiagonal(HMatrix *B, HVector *DAB)
 
 /***************************************************************/
 /* replace the matrix with its LU factorization ****************/
+/*                                                             */
+/* in mixed-precision mode the matrix is left unchanged and    */
+/* its single-precision LU factors are stored in SPLU instead; */
+/* if the single-precision factorization fails we fall through */
+/* to the usual double-precision factorization.                */
 /***************************************************************/
-int HMatrix::LUFactorize()
+int HMatrix::LUFactorize(bool MixedPrecision)
 { 
   int info;
 
   if (ipiv==0)
    ipiv=(int *)mallocEC(NR*sizeof(int));
 
+  if (SPLU)
+   { free(SPLU);
+     SPLU=0;
+   };
+
+  if ( MixedPrecision && StorageType==LHM_NORMAL && NR==NC )
+   { size_t NE=NumEntries();
+     if (RealComplex==LHM_REAL)
+      { float *SM=(float *)mallocEC(NE*sizeof(float));
+        for(size_t n=0; n<NE; n++)
+         SM[n]=(float)DM[n];
+        sgetrf_(&NR, &NC, SM, &NR, ipiv, &info);
+        SPLU=(void *)SM;
+      }
+     else
+      { cfloat *SM=(cfloat *)mallocEC(NE*sizeof(cfloat));
+        for(size_t n=0; n<NE; n++)
+         SM[n]=(cfloat)ZM[n];
+        cgetrf_(&NR, &NC, SM, &NR, ipiv, &info);
+        SPLU=(void *)SM;
+      };
+
+     if (info==0)
+      return 0;
+
+     Warn("single-precision LU factorization failed (info=%i): using double precision",info);
+     free(SPLU);
+     SPLU=0;
+   };
+
   if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
    dgetrf_(&NR, &NC, DM, &NR, ipiv, &info); 
   else if ( RealComplex==LHM_REAL && StorageType==LHM_SYMMETRIC )
@@ -171,6 +206,166 @@ int HMatrix::LUFactorize()
   return info;
 }
 
+/***************************************************************/
+/* helper routines for mixed-precision LU solves: overloaded   */
+/* wrappers around the real and complex LAPACK/BLAS routines,  */
+/* plus a templated driver that does the iterative refinement  */
+/***************************************************************/
+#define MAX_REFINE_STEPS 30
+
+static int SPGETRS(char Trans, int N, int nrhs, float *LU, int *ipiv, float *B)
+{ int info;
+  sgetrs_(&Trans, &N, &nrhs, LU, &N, ipiv, B, &N, &info);
+  return info;
+}
+
+static int SPGETRS(char Trans, int N, int nrhs, cfloat *LU, int *ipiv, cfloat *B)
+{ int info;
+  cgetrs_(&Trans, &N, &nrhs, LU, &N, ipiv, B, &N, &info);
+  return info;
+}
+
+// R -= op(A)*X
+static void SubtractProduct(char Trans, int N, int nrhs, double *A, double *X, double *R)
+{ double dOne=1.0, dMinusOne=-1.0;
+  char TransA[2]={Trans, 0};
+  dgemm_(TransA, "N", &N, &nrhs, &N, &dMinusOne, A, &N, X, &N, &dOne, R, &N);
+}
+
+static void SubtractProduct(char Trans, int N, int nrhs, cdouble *A, cdouble *X, cdouble *R)
+{ cdouble zOne=1.0, zMinusOne=-1.0;
+  char TransA[2]={Trans, 0};
+  zgemm_(TransA, "N", &N, &nrhs, &N, &zMinusOne, A, &N, X, &N, &zOne, R, &N);
+}
+
+// infinity norm of op(A) 
+static double GetOpNorm(char Trans, int N, double *A, double *rwork)
+{ char Norm = (Trans=='N') ? 'I' : '1';
+  return dlange_(&Norm, &N, &N, A, &N, rwork);
+}
+
+static double GetOpNorm(char Trans, int N, cdouble *A, double *rwork)
+{ char Norm = (Trans=='N') ? 'I' : '1';
+  return zlange_(&Norm, &N, &N, A, &N, rwork);
+}
+
+/***************************************************************/
+/* solve op(A)*X=B given the single-precision LU factors of A, */
+/* refining the solution against the double-precision A until */
+/* the residual of each column satisfies the LAPACK xCGESV     */
+/* criterion  |R|_inf <= |X|_inf |A|_inf eps sqrt(N).          */
+/*                                                             */
+/* on entry X holds B. on successful return X holds the        */
+/* solution and the return value is 0; otherwise X is restored */
+/* to B and the return value is nonzero.                       */
+/*                                                             */
+/* on return, NumSteps and Residual are the number of          */
+/* refinement steps and the largest normwise relative residual */
+/* |R|_inf / (|A|_inf |X|_inf) over all columns.               */
+/***************************************************************/
+template<typename DT, typename FT>
+static int RefinedLUSolve(char Trans, int N, int nrhs, DT *A, FT *LU, int *ipiv,
+                          DT *X, int *NumSteps, double *Residual)
+{
+  size_t NE = ((size_t)N)*nrhs;
+  DT *B = (DT *)mallocEC(NE*sizeof(DT));
+  DT *R = (DT *)mallocEC(NE*sizeof(DT));
+  FT *S = (FT *)mallocEC(NE*sizeof(FT));
+  double *rwork = (double *)mallocEC(N*sizeof(double));
+  memcpy(B, X, NE*sizeof(DT));
+
+  double ANorm = GetOpNorm(Trans, N, A, rwork);
+  double Tol   = ANorm * dlamch_("E") * sqrt((double)N);
+
+  // initial single-precision solve
+  for(size_t n=0; n<NE; n++)
+   S[n]=(FT)B[n];
+  int Status=SPGETRS(Trans, N, nrhs, LU, ipiv, S);
+  for(size_t n=0; n<NE; n++)
+   X[n]=(DT)S[n];
+
+  int Step=0;
+  double MaxRelResidual=0.0;
+  while (Status==0)
+   { 
+     // R = B - op(A)*X in double precision
+     memcpy(R, B, NE*sizeof(DT));
+     SubtractProduct(Trans, N, nrhs, A, X, R);
+
+     bool Converged=true;
+     MaxRelResidual=0.0;
+     for(int nc=0; nc<nrhs; nc++)
+      { double XNorm=0.0, RNorm=0.0;
+        for(int nr=0; nr<N; nr++)
+         { size_t n = ((size_t)nc)*N + nr;
+           XNorm = fmax(XNorm, std::abs(X[n]));
+           RNorm = fmax(RNorm, std::abs(R[n]));
+         };
+        if ( RNorm > XNorm*Tol )
+         Converged=false;
+        if ( XNorm*ANorm > 0.0 )
+         MaxRelResidual = fmax(MaxRelResidual, RNorm / (XNorm*ANorm));
+      };
+     if (Converged)
+      break;
+
+     if (Step==MAX_REFINE_STEPS)
+      { Status=1;
+        break;
+      };
+
+     // X += op(A)^{-1} R, with the correction computed in single precision
+     for(size_t n=0; n<NE; n++)
+      S[n]=(FT)R[n];
+     Status=SPGETRS(Trans, N, nrhs, LU, ipiv, S);
+     for(size_t n=0; n<NE; n++)
+      X[n]+=(DT)S[n];
+     Step++;
+   };
+
+  if (Status!=0)
+   memcpy(X, B, NE*sizeof(DT));
+
+  free(B);
+  free(R);
+  free(S);
+  free(rwork);
+
+  *NumSteps=Step;
+  *Residual=MaxRelResidual;
+  return Status;
+}
+
+/***************************************************************/
+/* solve op(M)*X=B for nrhs right-hand sides stored in XData   */
+/* using the single-precision LU factors computed by           */
+/* LUFactorize(true). if the refinement does not converge,     */
+/* the matrix is refactorized in double precision, XData is    */
+/* left holding B, and the return value is nonzero so that the */
+/* caller can redo the solve.                                  */
+/***************************************************************/
+int HMatrix::MixedLUSolve(char Trans, int nrhs, void *XData)
+{
+  int Status, NumSteps;
+  double Residual;
+
+  if (RealComplex==LHM_REAL)
+   Status=RefinedLUSolve(Trans, NR, nrhs, DM, (float *)SPLU, ipiv,
+                         (double *)XData, &NumSteps, &Residual);
+  else
+   Status=RefinedLUSolve(Trans, NR, nrhs, ZM, (cfloat *)SPLU, ipiv,
+                         (cdouble *)XData, &NumSteps, &Residual);
+
+  if (Status==0)
+   { Log("mixed-precision LU solve: %i refinement steps, residual %.2e",NumSteps,Residual);
+     return 0;
+   };
+
+  Warn("mixed-precision LU solve did not converge (%i refinement steps, residual %.2e): refactorizing in double precision",NumSteps,Residual);
+  LUFactorize(false);
+  return Status;
+}
+
 /***************************************************************/
 /* solve linear system using LU factorization ******************/
 /***************************************************************/
@@ -187,6 +382,9 @@ int HMatrix::LUSolve(HVector *X)
   if (ipiv==0)  
    ErrExit("LUFactorize() must be called before LUSolve()");
 
+  if ( SPLU && MixedLUSolve('N', 1, RealComplex==LHM_REAL ? (void *)X->DV : (void *)X->ZV)==0 )
+   return 0;
+
   if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
    dgetrs_("N", &NR, &iOne, DM, &NR, ipiv, X->DV, &NR, &info);
   else if ( RealComplex==LHM_REAL && StorageType==LHM_SYMMETRIC )
@@ -222,6 +420,10 @@ int HMatrix::LUSolve(HMatrix *X, char Trans, int nrhs)
    ErrExit("LUFactorize() must be called before LUSolve()");
   if ( Trans!='N' && StorageType!=LHM_NORMAL )
    ErrExit("transposed LU-solves not available for packed matrices");
+
+  if ( SPLU && MixedLUSolve(Trans, nrhs, RealComplex==LHM_REAL ? (void *)X->DM : (void *)X->ZM)==0 )
+   return 0;
+
 if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
    dgetrs_(&Trans, &NR, &nrhs, DM, &NR, ipiv, X->DM, &NR, &info);
   else if ( RealComplex==LHM_REAL && StorageType==LHM_SYMMETRIC )
@@ -267,6 +469,10 @@ int HMatrix::LUInvert()
   if (ipiv==0)  
    ErrExit("LUFactorize() must be called before LUInvert()");
 
+  // inversion needs the double-precision LU factors
+  if (SPLU)
+   LUFactorize(false);
+
   int MinusOne=-1;
   if ( RealComplex==LHM_REAL && StorageType==LHM_NORMAL )
    {
@@ -844,9 +1050,9 @@ HVector *HMatrix::SVD(HVector *Sigma, HMatrix *U, HMatrix *VT)
              U ? U->ZM : 0, &LDU, VT ? VT->ZM : 0, &LDVT, 
              &zlworkOptimal, &MinusOne, rwork, &info);
 
-     lworkOptimal = 2*(int)(real(zlworkOptimal));
+     lworkOptimal = (int)(real(zlworkOptimal));
      if (lworkOptimal > lwork)
-      { work=realloc(work,lworkOptimal*sizeof(double));
+      { work=realloc(work,lworkOptimal*sizeof(cdouble));
         lwork=lworkOptimal;
       };
 
@@ -914,6 +1120,10 @@ double HMatrix::GetRCond(double ANorm, bool UseInfinityNorm)
   char *Norm = const_cast<char *> (UseInfinityNorm ? "I" : "1");
   double RCond;
 
+  // the condition estimate needs the double-precision LU factors
+  if (SPLU)
+   LUFactorize(false);
+
   /***************************************************************/
   /***************************************************************/
   /***************************************************************/
@@ -307,14 +307,25 @@ class HMatrix
    void Apply(HVector *X, HVector *Y, char Trans=0);
    
    /* routines for LU-factorizing, solving, inverting */
-   /* (xgetrf, xgetrs, xgetri) */
-   int LUFactorize();
+   /* (xgetrf, xgetrs, xgetri)                         */
+   /*                                                  */
+   /* if MixedPrecision is true, the LU factorization  */
+   /* is computed in single precision (sgetrf/cgetrf)  */
+   /* and stored separately, leaving the matrix itself */
+   /* untouched; LUSolve() then refines the single-    */
+   /* precision solution against the double-precision  */
+   /* matrix, falling back to a full double-precision  */
+   /* factorization if the refinement fails. (Only     */
+   /* available for square LHM_NORMAL matrices; others */
+   /* are always factorized in double precision.)      */
+   int LUFactorize(bool MixedPrecision=false);
    int LUSolve(HVector *X);
    int LUSolve(HMatrix *X);
    int LUSolve(HMatrix *X, int nrhs);
    int LUSolve(HMatrix *X, char Trans);
    int LUSolve(HMatrix *X, char Trans, int nrhs);
    int LUInvert();
+   int MixedLUSolve(char Trans, int nrhs, void *XData);
 
    /* routines for cholesky-factorizing, solving, inverting */
    /* (xpotrf, xpotrs, xpotri) */
@@ -354,6 +365,10 @@ class HMatrix
    int StorageType;
    int *ipiv;
 
+   // single-precision LU factors (float or cfloat), allocated 
+   // only by LUFactorize(true)
+   void *SPLU;
+
    // pointers to the actual data storage. only one of these is 
    // used in a given instance so if i wanted to save 8 bytes i 
    // could put them into a union
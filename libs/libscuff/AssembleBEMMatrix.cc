@@ -36,8 +36,11 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <vector>
+
 #include "libscuff.h"
 #include "libscuffInternals.h"
+#include "TBlockStore.h"
 
 #include "cmatheval.h"
 
@@ -113,139 +116,15 @@ void StampInNeighborBlock(HMatrix *B, HMatrix **GradB,
    };
 }
 
-/***************************************************************/
-/* this is a simple quick-and-dirty mechanism for saving       */
-/* and retrieving diagonal T-matrix blocks to disk.            */
-/***************************************************************/
-#define TBCOP_READ  0
-#define TBCOP_WRITE 1
-bool TBlockCacheOp(int Op, RWGGeometry *G, int ns,
-                   cdouble Omega, double *kBloch,
-                   HMatrix *M, int RowOffset, int ColOffset)
-{
-  char *Dir = getenv("SCUFF_TBLOCK_PATH");
-  if (Dir==0 && Op==TBCOP_READ)
-   Dir = getenv("SCUFF_TBLOCK_READPATH");
-  if (!Dir) return false;
-
-  /*--------------------------------------------------------------*/
-  /*--------------------------------------------------------------*/
-  /*--------------------------------------------------------------*/
-  char K4VStr[50];
-  if (imag(Omega)==0.0)
-   sprintf(K4VStr,"%.6e",real(Omega));
-  else if (real(Omega)==0.0)
-   sprintf(K4VStr,"%.6eI",imag(Omega));
-  else 
-   sprintf(K4VStr,"%.6e+%.6eI",real(Omega),imag(Omega));
-  if (G->LDim>=1)
-   vstrappend(K4VStr,"_%.6e",kBloch[0]);
-  if (G->LDim>=2)
-   vstrappend(K4VStr,"_%.6e",kBloch[1]);
-
-  RWGSurface *S=G->Surfaces[ns];
-  int nr1=S->RegionIndices[0];
-  int nr2=S->RegionIndices[1];
-  if (G->RegionMPs[nr1]->Zeroed)
-   strcat(K4VStr,"_Interior");
-  else if (nr2!=-1 && G->RegionMPs[nr2]->Zeroed)
-   strcat(K4VStr,"_Exterior");
-    
-  char *FileBase = GetFileBase(S->MeshFileName); 
-  int MeshTag    = S->MeshTag;
-  char FileName[200];
-  if (MeshTag != -1)
-   snprintf(FileName,200,"%s/%s_%i_%s.hdf5",Dir,FileBase,MeshTag,K4VStr);
-  else
-   snprintf(FileName,200,"%s/%s_%s.hdf5",Dir,FileBase,K4VStr);
-
-  /***************************************************************/
-  /***************************************************************/
-  /***************************************************************/
-  int NBF        = G->Surfaces[ns]->NumBFs;
-  bool IsComplex = (M->RealComplex==LHM_COMPLEX);
-  off_t DataSize = NBF*NBF*(IsComplex ? sizeof(double) : sizeof(cdouble) );
-
-  /***************************************************************/
-  /* if the block we are reading/writing is a proper subblock of */
-  /* M, then we will need to allocate an HMatrix for just that   */
-  /* block, but we hold off on doing that until necessary        */
-  /***************************************************************/
-  HMatrix *B=0;
-  bool OwnsB=false;
-  if ( RowOffset==0 && ColOffset==0 && (M->NR==NBF) && (M->NC==NBF) )
-   B=M;
-
-  bool Success=false;
-  FILE *f=0;
-  if (Op==TBCOP_READ)	
-   {
-     Log("Attempting to read T-block (%s,%s) from file %s...",FileBase,z2s(Omega),FileName);
-     struct stat st;
-     int Status=stat(FileName, &st);
-     f=fopen(FileName,"r");
-     if (Status!=0 || f==0)
-      Log("...could not access file");
-     else if (st.st_size!=DataSize)
-      Log("...file had incorrect size %lu (should be %lu)",st.st_size,DataSize);
-     else 
-      { 
-        if (B==0)
-         { OwnsB=true;
-           B=new HMatrix(NBF,NBF,M->RealComplex);
-           if (B->ErrMsg)
-            { Log("...could not allocate matrix (%s)",B->ErrMsg);
-              delete B;
-              fclose(f);
-              return false;
-            };
-         };
-
-        void *DataBuffer = (IsComplex ? ((void *)(B->ZM)) : ((void *)(B->DM)));
-        ssize_t SizeToRead = (ssize_t)DataSize;
-        ssize_t SizeRead = read(fileno(f), DataBuffer, SizeToRead);
-        Success = (SizeRead==SizeToRead);
-        if (Success)
-         { Log("...success!");
-           if (OwnsB)
-            M->InsertBlock(B, RowOffset, ColOffset);
-         }
-        else
-         Log("...failed to read full size (%lu)",SizeToRead);
-      };
-   }
-  else //(Op==TBCOP_WRITE)
-   { 
-     Log("Attempting to write T-block (%s,%s) to file %s...",FileBase,z2s(Omega),FileName);
-     if (B==0)
-      { OwnsB=true;
-        B=new HMatrix(NBF,NBF,M->RealComplex);
-        if (B->ErrMsg)
-         { Log("...could not allocate matrix (%s)",B->ErrMsg);
-           delete B;
-           return false;
-         };
-        M->ExtractBlock(RowOffset, ColOffset, B);
-      };
-     void *DataBuffer = (IsComplex ? ((void *)(B->ZM)) : ((void *)(B->DM)));
-     f=fopen(FileName,"w");
-     if (!f) 
-      Log("...could not access file");
-     else if (DataSize != write(fileno(f), DataBuffer, DataSize))
-      Log("...failed to write full file");
-     else
-      { Log("...success!");
-        Success=true;
-      };
-   };
-
-  if (B && OwnsB) delete B;
-  if (f) fclose(f);
-  return Success; 
-}
-
 /***************************************************************/
 /* KBIMBCache = 'kBloch-independent matrix-block cache.'       */
+/*                                                             */
+/* A single cache may be shared by calls to                    */
+/* AssembleBEMMatrixBlock running concurrently at different    */
+/* kBloch points: the cache is refilled by one thread at a time*/
+/* under Lock, and Omega is only updated once the blocks are   */
+/* complete, so a call that finds the cache clean only ever    */
+/* reads from it.                                              */
 /***************************************************************/
 typedef struct KBMIMBCache
  {
@@ -254,12 +133,16 @@ typedef struct KBMIMBCache
    bool NeedZDerivative;
    void *Storage;
    HMatrix *B[9], *dBdZ[9];
+#ifdef USE_OPENMP
+   omp_lock_t Lock;
+#endif
 
  } KBIMBCache;
 
 void *RWGGeometry::CreateABMBAccelerator(int nsa, int nsb,
                                          bool PureImagFreq,
-                                         bool NeedZDerivative)
+                                         bool NeedZDerivative,
+                                         bool Verbose)
 {
   if (LBasis==0)
    return 0;
@@ -285,14 +168,15 @@ void *RWGGeometry::CreateABMBAccelerator(int nsa, int nsb,
   /*--------------------------------------------------------------*/
   /*- attempt to allocate enough storage for the full cache       */
   /*--------------------------------------------------------------*/
-  Log("Trying to allocate accelerator for (%i,%i) matrix-block assembly...",nsa,nsb);
+  if (Verbose)
+   Log("Trying to allocate accelerator for (%i,%i) matrix-block assembly...",nsa,nsb);
   int MatricesNeeded = NeedZDerivative ? 2*NumMatrices : NumMatrices;
   void *Storage = malloc( MatricesNeeded * MatrixSize );
   if (Storage==0) 
-   { Log("...failed! not enough memory.");
+   { if (Verbose) Log("...failed! not enough memory.");
      return 0;
    };
-  Log("...success!");
+  if (Verbose) Log("...success!");
 
   void *Buffers[18];
   Buffers[0] = Storage;
@@ -312,25 +196,258 @@ void *RWGGeometry::CreateABMBAccelerator(int nsa, int nsb,
      if (NeedZDerivative)
       Cache->dBdZ[nm] = new HMatrix(NR, NC, RC, LHM_NORMAL, Buffers[nb++]);
    };
+#ifdef USE_OPENMP
+  omp_init_lock(&(Cache->Lock));
+#endif
 
   return (void *)Cache;
  
 }
 
-void RWGGeometry::DestroyABMBAccelerator(void *pCache)
+static void DestroyKBIMBCache(KBIMBCache *Cache)
 {
-  if (pCache==0) return;
-
-  KBIMBCache *Cache    = (KBIMBCache *)pCache;
   int NumMatrices      = Cache->NumMatrices;
   bool NeedZDerivative = Cache->NeedZDerivative;
   for(int nm=0; nm<NumMatrices; nm++)
    { delete Cache->B[nm];
      if (NeedZDerivative) delete Cache->dBdZ[nm];
    };
+#ifdef USE_OPENMP
+  omp_destroy_lock(&(Cache->Lock));
+#endif
   free(Cache->Storage);
   free(Cache);
+}
+
+void RWGGeometry::DestroyABMBAccelerator(void *pCache)
+{
+  if (pCache==0) return;
+  DestroyKBIMBCache( (KBIMBCache *)pCache );
+}
+
+/***************************************************************/
+/* KBIMBStore is a collection of KBIMBCaches, one for each     */
+/* combination of surface pair, frequency, and whatever else   */
+/* the inner-cell blocks depend on, that RWGGeometry maintains */
+/* for PBC geometries so that every code that assembles the    */
+/* BEM matrix at many kBloch points for a fixed frequency      */
+/* reuses the inner-cell blocks automatically. The total size  */
+/* of the store is bounded by SCUFF_KBIMB_CACHE_MB megabytes   */
+/* (default 1024; 0 disables the store); once that is reached, */
+/* the least recently used caches are evicted. Caches that are */
+/* checked out by a call to AssembleBEMMatrixBlock are never   */
+/* evicted, so the store may be used from concurrent threads.  */
+/***************************************************************/
+#define KBIMBSTORE_DEFAULT_MB 1024
+
+typedef struct KBIMBKey
+ { cdouble Omega;
+   int nsa, nsb;
+   int NeedZDerivative;
+   int Zeroed[2];          // of the common regions
+   cdouble EpsMu[4];       // of the common regions
+   double GT[2][12];       // current transformations of the surfaces
+ } KBIMBKey;
+
+typedef struct KBIMBStoreEntry
+ { KBIMBKey Key;
+   KBIMBCache *Cache;
+   size_t Bytes;
+   unsigned long LastUsed;
+   int Users;
+ } KBIMBStoreEntry;
+
+typedef struct KBIMBStoreData
+ { std::vector<KBIMBStoreEntry> Entries;
+   size_t Bytes, MaxBytes;
+   unsigned long Clock, Hits, Misses, Evicted;
+#ifdef USE_OPENMP
+   omp_lock_t Lock;
+#endif
+ } KBIMBStoreData;
+
+/***************************************************************/
+/* the inner-cell blocks for a pair of surfaces depend on the  */
+/* frequency, the material properties and zeroing status of    */
+/* the regions they have in common, and the positions of the   */
+/* surfaces relative to each other and to the lattice. (For a  */
+/* surface interacting with itself, rigid displacements don't  */
+/* matter, but rotations do, since the lattice stays fixed.)   */
+/***************************************************************/
+static void InitKBIMBKey(RWGGeometry *G, int nsa, int nsb, cdouble Omega,
+                         bool NeedZDerivative, int nr1, int nr2,
+                         KBIMBKey *Key)
+{
+  *Key = KBIMBKey();
+  Key->Omega           = Omega;
+  Key->nsa             = nsa;
+  Key->nsb             = nsb;
+  Key->NeedZDerivative = NeedZDerivative ? 1 : 0;
+
+  int CR[2];
+  CR[0]=nr1;
+  CR[1]=nr2;
+  for(int n=0; n<2; n++)
+   { if (CR[n]==-1) continue;
+     MatProp *MP = G->RegionMPs[CR[n]];
+     Key->Zeroed[n] = MP->Zeroed ? 1 : 0;
+     MP->GetEpsMu(Omega, Key->EpsMu + 2*n + 0, Key->EpsMu + 2*n + 1);
+   };
+
+  int ns[2];
+  ns[0]=nsa;
+  ns[1]=nsb;
+  for(int n=0; n<2; n++)
+   { GTransformation *GT = G->Surfaces[ns[n]]->GT;
+     if (GT==0) continue;
+     for(int i=0; i<3; i++)
+      for(int j=0; j<3; j++)
+       Key->GT[n][3*i+j] = GT->M[i][j];
+     if (nsa!=nsb)
+      memcpy(Key->GT[n] + 9, GT->DX, 3*sizeof(double));
+   };
+}
+
+static bool SameKBIMBKey(const KBIMBKey *K1, const KBIMBKey *K2)
+{
+  if (    K1->Omega!=K2->Omega || K1->nsa!=K2->nsa || K1->nsb!=K2->nsb
+       || K1->NeedZDerivative!=K2->NeedZDerivative
+     ) return false;
+  for(int n=0; n<2; n++)
+   if (K1->Zeroed[n]!=K2->Zeroed[n])
+    return false;
+  for(int n=0; n<4; n++)
+   if (K1->EpsMu[n]!=K2->EpsMu[n])
+    return false;
+  for(int n=0; n<2; n++)
+   for(int i=0; i<12; i++)
+    if (K1->GT[n][i]!=K2->GT[n][i])
+     return false;
+  return true;
+}
+
+/***************************************************************/
+/* get a cache for the given surface pair and frequency from   */
+/* the store, creating the store and/or the cache if necessary.*/
+/* The cache is marked as in use until it is returned by       */
+/* CheckInKBIMBCache(). Returns 0 if the store is disabled or  */
+/* the cache would not fit.                                    */
+/***************************************************************/
+static KBIMBCache *CheckOutKBIMBCache(RWGGeometry *G, int nsa, int nsb,
+                                      cdouble Omega, bool NeedZDerivative,
+                                      int nr1, int nr2)
+{
+  KBIMBStoreData *Store;
+#ifdef USE_OPENMP
+#pragma omp critical(KBIMBStore)
+#endif
+  { if (G->KBIMBStore==0)
+     { int MaxMB=KBIMBSTORE_DEFAULT_MB;
+       CheckEnv("SCUFF_KBIMB_CACHE_MB", &MaxMB);
+       KBIMBStoreData *NewStore = new KBIMBStoreData;
+       NewStore->Bytes    = 0;
+       NewStore->MaxBytes = ((size_t)(MaxMB>0 ? MaxMB : 0))<<20;
+       NewStore->Clock    = NewStore->Hits = NewStore->Misses = NewStore->Evicted = 0;
+#ifdef USE_OPENMP
+       omp_init_lock(&(NewStore->Lock));
+#endif
+       G->KBIMBStore = (void *)NewStore;
+     };
+    Store = (KBIMBStoreData *)G->KBIMBStore;
+  }
+  if (Store->MaxBytes==0)
+   return 0;
+
+  size_t NumMatrices = (G->LDim==1) ? (nsa==nsb ? 2 : 3) : (nsa==nsb ? 5 : 9);
+  if (NeedZDerivative) NumMatrices*=2;
+  size_t Bytes = NumMatrices * sizeof(cdouble)
+                 * ((size_t)G->Surfaces[nsa]->NumBFs)
+                 * ((size_t)G->Surfaces[nsb]->NumBFs);
+
+  KBIMBCache *Cache=0;
+#ifdef USE_OPENMP
+  omp_set_lock(&(Store->Lock));
+#endif
+  KBIMBKey Key;
+  InitKBIMBKey(G, nsa, nsb, Omega, NeedZDerivative, nr1, nr2, &Key);
+  std::vector<KBIMBStoreEntry> &Entries = Store->Entries;
+  Store->Clock++;
+  for(size_t n=0; n<Entries.size() && Cache==0; n++)
+   if ( SameKBIMBKey(&(Entries[n].Key), &Key) )
+    { Entries[n].Users++;
+      Entries[n].LastUsed=Store->Clock;
+      Cache=Entries[n].Cache;
+      Store->Hits++;
+    };
+
+  if (Cache==0 && Bytes<=Store->MaxBytes)
+   { 
+     // make room by evicting the least recently used idle caches
+     while( Store->Bytes + Bytes > Store->MaxBytes )
+      { int nLRU=-1;
+        for(size_t n=0; n<Entries.size(); n++)
+         if ( Entries[n].Users==0 && (nLRU==-1 || Entries[n].LastUsed < Entries[nLRU].LastUsed) )
+          nLRU=n;
+        if (nLRU==-1) break;
+        DestroyKBIMBCache(Entries[nLRU].Cache);
+        Store->Bytes -= Entries[nLRU].Bytes;
+        Entries.erase(Entries.begin() + nLRU);
+        Store->Evicted++;
+      };
+
+     if ( Store->Bytes + Bytes <= Store->MaxBytes )
+      Cache=(KBIMBCache *)G->CreateABMBAccelerator(nsa, nsb, false,
+                                                   NeedZDerivative, false);
+     if (Cache)
+      { KBIMBStoreEntry Entry;
+        Entry.Key      = Key;
+        Entry.Cache    = Cache;
+        Entry.Bytes    = Bytes;
+        Entry.LastUsed = Store->Clock;
+        Entry.Users    = 1;
+        Entries.push_back(Entry);
+        Store->Bytes += Bytes;
+        Store->Misses++;
+      };
+   };
 
+  if (G->LogLevel>=SCUFF_VERBOSELOGGING)
+   Log("KBIMB store: %lu hits, %lu misses, %lu evicted, %lu MB in %i caches",
+        Store->Hits, Store->Misses, Store->Evicted,
+        (unsigned long)(Store->Bytes>>20), (int)Entries.size());
+#ifdef USE_OPENMP
+  omp_unset_lock(&(Store->Lock));
+#endif
+
+  return Cache;
+}
+
+static void CheckInKBIMBCache(RWGGeometry *G, KBIMBCache *Cache)
+{
+  KBIMBStoreData *Store = (KBIMBStoreData *)G->KBIMBStore;
+#ifdef USE_OPENMP
+  omp_set_lock(&(Store->Lock));
+#endif
+  for(size_t n=0; n<Store->Entries.size(); n++)
+   if (Store->Entries[n].Cache==Cache)
+    { Store->Entries[n].Users--;
+      break;
+    };
+#ifdef USE_OPENMP
+  omp_unset_lock(&(Store->Lock));
+#endif
+}
+
+void DestroyKBIMBStore(void *pStore)
+{
+  if (pStore==0) return;
+  KBIMBStoreData *Store = (KBIMBStoreData *)pStore;
+  for(size_t n=0; n<Store->Entries.size(); n++)
+   DestroyKBIMBCache(Store->Entries[n].Cache);
+#ifdef USE_OPENMP
+  omp_destroy_lock(&(Store->Lock));
+#endif
+  delete Store;
 }
 
 /***************************************************************/
@@ -359,7 +476,7 @@ void RWGGeometry::AssembleBEMMatrixBlock(int nsa, int nsb,
 
   if (    nsa==nsb
        && GradM==0
-       && TBlockCacheOp(TBCOP_READ, this, nsa, Omega, kBloch, M, RowOffset, ColOffset)
+       && ReadTBlock(this, nsa, Omega, kBloch, M, RowOffset, ColOffset)
      ) return;
 
   if (LogLevel>=SCUFF_VERBOSELOGGING)
@@ -386,7 +503,7 @@ void RWGGeometry::AssembleBEMMatrixBlock(int nsa, int nsb,
      Args->ColOffset=ColOffset;
      GetSurfaceSurfaceInteractions(Args);
      if (nsa==nsb)
-      TBlockCacheOp(TBCOP_WRITE, this, nsa, Omega, kBloch, M, RowOffset, ColOffset);
+      WriteTBlock(this, nsa, Omega, kBloch, M, RowOffset, ColOffset);
      return;
    }
 
@@ -402,10 +519,6 @@ void RWGGeometry::AssembleBEMMatrixBlock(int nsa, int nsb,
   if ( GradM && (GradM[0] || GradM[1]) )
    ErrExit("x,y derivatives of BEM matrix not supported for periodic geometries");
 
-  KBIMBCache *Cache = (KBIMBCache *)Accelerator;
-  bool HaveCache = (Cache!=0);
-  bool HaveCleanCache = HaveCache && EqualFloat(Cache->Omega, Omega);
-  if (HaveCache) Cache->Omega=Omega;
 
   int NumCommonRegions, CRIndices[2];
   double Signs[2];
@@ -415,6 +528,24 @@ void RWGGeometry::AssembleBEMMatrixBlock(int nsa, int nsb,
   int nr1=CRIndices[0];
   int nr2=NumCommonRegions==2 ? CRIndices[1] : -1;
 
+  KBIMBCache *Cache = (KBIMBCache *)Accelerator;
+  bool StoredCache = false;
+  if (Cache==0)
+   { Cache = CheckOutKBIMBCache(this, nsa, nsb, Omega,
+                                (GradM && GradM[2]), nr1, nr2);
+     StoredCache = (Cache!=0);
+   };
+  bool HaveCache = (Cache!=0);
+  bool HaveCleanCache = HaveCache && EqualFloat(Cache->Omega, Omega);
+#ifdef USE_OPENMP
+  bool LockedCache = (HaveCache && !HaveCleanCache);
+  if (LockedCache)
+   { omp_set_lock(&(Cache->Lock));
+     // another thread may have refilled the cache while we waited
+     HaveCleanCache = EqualFloat(Cache->Omega, Omega);
+   };
+#endif
+
   int NBFA=Surfaces[nsa]->NumBFs;
   int NBFB=Surfaces[nsb]->NumBFs;
 
@@ -515,6 +646,15 @@ done:
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
+  if (HaveCache && !HaveCleanCache)
+   Cache->Omega=Omega;
+#ifdef USE_OPENMP
+  if (LockedCache)
+   omp_unset_lock(&(Cache->Lock));
+#endif
+  if (StoredCache)
+   CheckInKBIMBCache(this, Cache);
+
   if (!HaveCache)
    { delete Args->B;
      if (Args->GradB) delete Args->GradB[2];
@@ -560,10 +700,81 @@ done:
   if (Args->GBA2) DestroyGBarAccelerator(Args->GBA2);
 
   if (nsa==nsb)
-   TBlockCacheOp(TBCOP_WRITE, this, nsa, Omega, kBloch, M, RowOffset, ColOffset);
+   WriteTBlock(this, nsa, Omega, kBloch, M, RowOffset, ColOffset);
 
 }
 
+/***************************************************************/
+/* Compute separately the contributions of the exterior and    */
+/* interior regions of surface #ns to its self-interaction     */
+/* block, storing them in TExt and TInt respectively (TInt is  */
+/* ignored for PEC surfaces). This is equivalent to calling    */
+/* AssembleBEMMatrixBlock(ns,ns,...) twice with all but one    */
+/* region zeroed, but for compact geometries the two blocks    */
+/* are computed in a single pass over edge pairs, so that the  */
+/* geometric parts of the panel-panel integrals are shared.    */
+/*                                                             */
+/* On return, the Zeroed flags of the two regions are restored */
+/* to their values on entry.                                   */
+/***************************************************************/
+void RWGGeometry::AssembleSelfBlocks(int ns, cdouble Omega, double *kBloch,
+                                     HMatrix *TExt, HMatrix *TInt)
+{
+  RWGSurface *S = Surfaces[ns];
+  int nrExt = S->RegionIndices[0];
+  int nrInt = S->RegionIndices[1];
+  if (S->IsPEC) TInt=0;
+
+  int ExtZeroed = RegionMPs[nrExt]->Zeroed;
+  int IntZeroed = nrInt==-1 ? 1 : RegionMPs[nrInt]->Zeroed;
+
+  bool Batch = (LBasis==0 && TInt!=0 && S->SurfaceZeta==0);
+  if (Batch)
+   { 
+     // look for both blocks in the T-block store first
+     RegionMPs[nrExt]->UnZero(); RegionMPs[nrInt]->Zero();
+     bool HaveExt = ReadTBlock(this, ns, Omega, kBloch, TExt, 0, 0);
+     RegionMPs[nrExt]->Zero(); RegionMPs[nrInt]->UnZero();
+     bool HaveInt = ReadTBlock(this, ns, Omega, kBloch, TInt, 0, 0);
+
+     if ( !HaveExt || !HaveInt )
+      { 
+        RegionMPs[nrExt]->UnZero(); RegionMPs[nrInt]->UnZero();
+
+        GetSSIArgStruct GetSSIArgs, *Args=&GetSSIArgs;
+        InitGetSSIArgs(Args);
+        Args->G=this;
+        Args->Sa=Args->Sb=S;
+        Args->Omega=Omega;
+        Args->Symmetric=true;
+        Args->B=TExt;
+        Args->B2=TInt;
+        GetSurfaceSurfaceInteractions(Args);
+
+        RegionMPs[nrExt]->UnZero(); RegionMPs[nrInt]->Zero();
+        WriteTBlock(this, ns, Omega, kBloch, TExt, 0, 0);
+        RegionMPs[nrExt]->Zero(); RegionMPs[nrInt]->UnZero();
+        WriteTBlock(this, ns, Omega, kBloch, TInt, 0, 0);
+      };
+   }
+  else
+   { 
+     RegionMPs[nrExt]->UnZero();
+     if (nrInt!=-1) RegionMPs[nrInt]->Zero();
+     AssembleBEMMatrixBlock(ns, ns, Omega, kBloch, TExt);
+
+     if (TInt)
+      { RegionMPs[nrExt]->Zero();
+        RegionMPs[nrInt]->UnZero();
+        AssembleBEMMatrixBlock(ns, ns, Omega, kBloch, TInt);
+      };
+   };
+
+  RegionMPs[nrExt]->Zeroed=ExtZeroed;
+  if (nrInt!=-1) RegionMPs[nrInt]->Zeroed=IntZeroed;
+  UpdateCachedEpsMuValues(Omega);
+}
+
 /***************************************************************/
 /* determine whether or not edge #ne on surface #ns is part of */
 /* a multi-material junction.                                  */
@@ -681,8 +892,12 @@ void RWGGeometry::ApplyMMJTransformation(HMatrix *M, HVector *RHS)
 /* appropriate size is allocated and returned. Otherwise, the  */
 /* return value is M.                                          */
 /***************************************************************/
-HMatrix *RWGGeometry::AssembleBEMMatrix(cdouble Omega, double *kBloch, HMatrix *M)
+HMatrix *RWGGeometry::AssembleBEMMatrix(cdouble Omega, double *kBloch, HMatrix *M,
+                                        bool UpdateEpsMuCache)
 { 
+  if ( BMInterpolator && LDim==0 && BMInterpolator->Contains(Omega) )
+   return BMInterpolator->Evaluate(Omega, M);
+
   if (CheckEnv("SCUFF_MATRIX_2018") && LDim==0 )
    return AssembleBEMMatrix2018(this, Omega, kBloch, M);
 
@@ -714,7 +929,17 @@ HMatrix *RWGGeometry::AssembleBEMMatrix(cdouble Omega, double *kBloch, HMatrix *
   else if (LDim==2)
    Log("Assembling BEM matrix at {Omega,kx,ky}={%s,%g,%g}",z2s(Omega),kBloch[0],kBloch[1]);
 
-  // the overall BEM matrix is symmetric as long as we 
+  // the assembly routines evaluate epsilon and mu for themselves
+  // and don't read the cached values, but routines like GetFields()
+  // that are called after AssembleBEMMatrix() expect them to be
+  // up-to-date for this frequency. callers that assemble at several
+  // frequencies concurrently (BeynSolve or BZ-integration workspaces)
+  // pass UpdateEpsMuCache=false, since the cache is shared by all
+  // threads, and refresh it themselves once the assemblies are done
+  if (UpdateEpsMuCache)
+   UpdateCachedEpsMuValues(Omega);
+
+  // the overall BEM matrix is symmetric as long as we
   // don't have a nonzero bloch wavevector.
   bool MatrixIsSymmetric = ( !kBloch || (kBloch[0]==0.0 && kBloch[1]==0.0) );
 
@@ -767,9 +992,10 @@ HMatrix *RWGGeometry::AssembleBEMMatrix(cdouble Omega, double *kBloch, HMatrix *
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
-HMatrix *RWGGeometry::AssembleBEMMatrix(cdouble Omega, HMatrix *M)
+HMatrix *RWGGeometry::AssembleBEMMatrix(cdouble Omega, HMatrix *M,
+                                        bool UpdateEpsMuCache)
 {
-  return AssembleBEMMatrix(Omega, 0, M); 
+  return AssembleBEMMatrix(Omega, 0, M, UpdateEpsMuCache);
 }
 
 /***************************************************************/
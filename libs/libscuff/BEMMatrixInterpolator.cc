@@ -0,0 +1,489 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * BEMMatrixInterpolator.cc -- Chebyshev interpolation of the BEM matrix
+ *                          -- in frequency, with adaptive refinement
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <libhmat.h>
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "BEMMatrixInterpolator.h"
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
+#define II cdouble(0,1)
+
+namespace scuff {
+
+/***************************************************************/
+/* an interval [tMin, tMax] of the normalized frequency        */
+/* variable t, where Omega = OmegaMid + t*OmegaHalfWidth and   */
+/* -1 <= t <= 1 over the full range of the interpolator.       */
+/*                                                             */
+/* F[nn] is the phase-stripped BEM matrix at the nnth node of  */
+/* the interval, stored column-major as an N x N array; F is   */
+/* NULL if the interval has not been built yet, or if it was   */
+/* built but its node matrices were later discarded to save    */
+/* memory. Intervals with Kids are refined and never used      */
+/* directly.                                                   */
+/***************************************************************/
+typedef struct BMIInterval
+ { double tMin, tMax;
+   int Depth;
+   bool Accepted;
+   double ErrorEstimate;
+   cdouble **F;
+   unsigned long LastUsed;
+   struct BMIInterval *Kids[2];
+ } BMIInterval;
+
+typedef struct BMIData
+ {
+   BMIInterval *Root;
+   int NumStoredIntervals;
+   unsigned long Clock;
+
+   // Chebyshev nodes on [-1,1] and barycentric weights
+   double *xNodes, *wNodes;
+
+   // centroid and surface index of the edge associated with
+   // each basis function
+   double *BFX;
+   int *BFSurface;
+
+   // index of the region whose wavenumber defines the phase
+   // factor for each pair of surfaces (-1 if they don't interact)
+   int NS;
+   int *PhaseRegion;
+
+   // wavenumbers of all regions at the current frequency
+   cdouble *k;
+
+ } BMIData;
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+static BMIInterval *NewInterval(double tMin, double tMax, int Depth)
+{
+  BMIInterval *I = (BMIInterval *)mallocEC(sizeof(BMIInterval));
+  I->tMin=tMin;
+  I->tMax=tMax;
+  I->Depth=Depth;
+  I->Accepted=false;
+  I->ErrorEstimate=0.0;
+  I->F=0;
+  I->LastUsed=0;
+  I->Kids[0]=I->Kids[1]=0;
+  return I;
+}
+
+static void FreeNodeMatrices(BMIInterval *I, int NumNodes)
+{
+  if (!I->F) return;
+  for(int nn=0; nn<NumNodes; nn++)
+   free(I->F[nn]);
+  free(I->F);
+  I->F=0;
+}
+
+static void DestroyInterval(BMIInterval *I, int NumNodes)
+{
+  if (!I) return;
+  DestroyInterval(I->Kids[0], NumNodes);
+  DestroyInterval(I->Kids[1], NumNodes);
+  FreeNodeMatrices(I, NumNodes);
+  free(I);
+}
+
+// find the least-recently-used interval that has node matrices
+static void FindLRUInterval(BMIInterval *I, BMIInterval **LRU)
+{
+  if (!I) return;
+  if ( I->F && ( *LRU==0 || I->LastUsed < (*LRU)->LastUsed ) )
+   *LRU=I;
+  FindLRUInterval(I->Kids[0], LRU);
+  FindLRUInterval(I->Kids[1], LRU);
+}
+
+/***************************************************************/
+/* wavenumbers of all regions at frequency Omega               */
+/***************************************************************/
+static void GetRegionWavenumbers(RWGGeometry *G, cdouble Omega, cdouble *k)
+{
+  G->UpdateCachedEpsMuValues(Omega);
+  for(int nr=0; nr<G->NumRegions; nr++)
+   k[nr] = csqrt2(G->EpsTF[nr]*G->MuTF[nr])*Omega;
+}
+
+/***************************************************************/
+/* phase factor exp(ikR) for the (nr,nc) matrix element        */
+/***************************************************************/
+static inline cdouble GetPhase(BMIData *Data, int nr, int nc)
+{
+  int Region=Data->PhaseRegion[ Data->BFSurface[nr]*Data->NS + Data->BFSurface[nc] ];
+  if (Region==-1) return 1.0;
+  double *Xr=Data->BFX + 3*nr, *Xc=Data->BFX + 3*nc;
+  double R=VecDistance(Xr, Xc);
+  return exp(II*Data->k[Region]*R);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+BEMMatrixInterpolator::BEMMatrixInterpolator(RWGGeometry *pG,
+                                             cdouble OmegaMin,
+                                             cdouble OmegaMax,
+                                             int pNumNodes,
+                                             double pRelTol,
+                                             int pMaxDepth)
+{
+  G=pG;
+  if (G->LDim!=0)
+   ErrExit("BEM matrix interpolation is not available for periodic geometries");
+  if (OmegaMin==OmegaMax)
+   ErrExit("BEM matrix interpolation requires a nonempty frequency range");
+  if (pNumNodes<2)
+   ErrExit("BEM matrix interpolation requires at least 2 nodes per interval");
+
+  N=G->TotalBFs;
+  OmegaMid=0.5*(OmegaMax+OmegaMin);
+  OmegaHalfWidth=0.5*(OmegaMax-OmegaMin);
+  NumNodes=pNumNodes;
+  RelTol=pRelTol;
+  MaxDepth=pMaxDepth;
+  MaxStoredIntervals=2;
+  CheckEnv("SCUFF_BMI_MAXINTERVALS", &MaxStoredIntervals);
+  if (MaxStoredIntervals<1) MaxStoredIntervals=1;
+  NumAssemblies=NumEvaluations=0;
+  Busy=false;
+
+  BMIData *D = (BMIData *)mallocEC(sizeof(BMIData));
+  Data=(void *)D;
+  D->Root=NewInterval(-1.0, 1.0, 0);
+  D->NumStoredIntervals=0;
+  D->Clock=0;
+
+  /*--------------------------------------------------------------*/
+  /*- Chebyshev nodes of the first kind and their barycentric     */
+  /*- interpolation weights                                       */
+  /*--------------------------------------------------------------*/
+  D->xNodes=(double *)mallocEC(2*NumNodes*sizeof(double));
+  D->wNodes=D->xNodes + NumNodes;
+  for(int nn=0; nn<NumNodes; nn++)
+   { double Theta = M_PI*(nn+0.5)/((double)NumNodes);
+     D->xNodes[nn] = cos(Theta);
+     D->wNodes[nn] = (nn%2 ? -1.0 : 1.0)*sin(Theta);
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- edge centroids and phase regions ---------------------------*/
+  /*--------------------------------------------------------------*/
+  D->BFX=(double *)mallocEC(3*N*sizeof(double));
+  D->BFSurface=(int *)mallocEC(N*sizeof(int));
+  int nbf=0;
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   { RWGSurface *S=G->Surfaces[ns];
+     int BFsPerEdge = S->IsPEC ? 1 : 2;
+     for(int ne=0; ne<S->NumEdges; ne++)
+      for(int nkn=0; nkn<BFsPerEdge; nkn++, nbf++)
+       { memcpy(D->BFX + 3*nbf, S->Edges[ne]->Centroid, 3*sizeof(double));
+         D->BFSurface[nbf]=ns;
+       };
+   };
+  if (nbf!=N)
+   ErrExit("%s:%i: internal error (%i!=%i)",__FILE__,__LINE__,nbf,N);
+
+  int NS = D->NS = G->NumSurfaces;
+  D->PhaseRegion=(int *)mallocEC(NS*NS*sizeof(int));
+  for(int nsa=0; nsa<NS; nsa++)
+   for(int nsb=0; nsb<NS; nsb++)
+    { int CRIndices[2];
+      double Signs[2];
+      int NumCommonRegions
+       =CountCommonRegions(G->Surfaces[nsa], G->Surfaces[nsb], CRIndices, Signs);
+      D->PhaseRegion[nsa*NS + nsb] = (NumCommonRegions==0 ? -1 : CRIndices[0]);
+    };
+
+  D->k=(cdouble *)mallocEC(G->NumRegions*sizeof(cdouble));
+
+  Log("Created BEM matrix interpolator on [%s,%s] (%i nodes/interval, tolerance %.1e)",
+       z2s(OmegaMin),z2s(OmegaMax),NumNodes,RelTol);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+BEMMatrixInterpolator::~BEMMatrixInterpolator()
+{
+  BMIData *D=(BMIData *)Data;
+  Log("BEM matrix interpolator: %i matrix assemblies for %i evaluations",
+       NumAssemblies, NumEvaluations);
+  DestroyInterval(D->Root, NumNodes);
+  free(D->xNodes);
+  free(D->BFX);
+  free(D->BFSurface);
+  free(D->PhaseRegion);
+  free(D->k);
+  free(D);
+}
+
+/***************************************************************/
+/* t-value of Omega; returns false if Omega does not lie on    */
+/* the segment [OmegaMin, OmegaMax]                            */
+/***************************************************************/
+static bool GetT(BEMMatrixInterpolator *BMI, cdouble Omega, double *t)
+{
+  cdouble tz = (Omega - BMI->OmegaMid) / BMI->OmegaHalfWidth;
+  *t = real(tz);
+  return    fabs(imag(tz)) <= 1.0e-10*(1.0+fabs(*t))
+         && fabs(*t) <= 1.0 + 1.0e-12;
+}
+
+bool BEMMatrixInterpolator::Contains(cdouble Omega)
+{
+  double t;
+  return !Busy && GetT(this, Omega, &t);
+}
+
+/***************************************************************/
+/* assemble the node matrices for an interval and estimate the */
+/* interpolation error from the size of the last two Chebyshev */
+/* coefficients relative to the largest.                       */
+/***************************************************************/
+static void BuildInterval(BEMMatrixInterpolator *BMI, BMIInterval *I,
+                          bool EstimateError)
+{
+  BMIData *D      = (BMIData *)BMI->Data;
+  RWGGeometry *G  = BMI->G;
+  int N           = BMI->N;
+  int NumNodes    = BMI->NumNodes;
+  size_t N2       = ((size_t)N)*N;
+
+  /*--------------------------------------------------------------*/
+  /*- make room if we are at the limit of stored intervals        */
+  /*--------------------------------------------------------------*/
+  while( D->NumStoredIntervals >= BMI->MaxStoredIntervals )
+   { BMIInterval *LRU=0;
+     FindLRUInterval(D->Root, &LRU);
+     if (!LRU) break;
+     FreeNodeMatrices(LRU, NumNodes);
+     D->NumStoredIntervals--;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- assemble the BEM matrix at each node and strip the phase    */
+  /*--------------------------------------------------------------*/
+  HMatrix *M=G->AllocateBEMMatrix();
+  I->F=(cdouble **)mallocEC(NumNodes*sizeof(cdouble *));
+  double tMid = 0.5*(I->tMax + I->tMin), tHalf=0.5*(I->tMax - I->tMin);
+  BMI->Busy=true;
+  for(int nn=0; nn<NumNodes; nn++)
+   {
+     cdouble Omega = BMI->OmegaMid + (tMid + tHalf*D->xNodes[nn])*BMI->OmegaHalfWidth;
+     G->AssembleBEMMatrix(Omega, M);
+     BMI->NumAssemblies++;
+
+     GetRegionWavenumbers(G, Omega, D->k);
+     cdouble *F = I->F[nn] = (cdouble *)mallocEC(N2*sizeof(cdouble));
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(static), num_threads(GetNumThreads())
+#endif
+     for(int nc=0; nc<N; nc++)
+      for(int nr=0; nr<N; nr++)
+       F[nr + ((size_t)nc)*N] = M->GetEntry(nr,nc) / GetPhase(D, nr, nc);
+   };
+  BMI->Busy=false;
+  delete M;
+  D->NumStoredIntervals++;
+
+  if (!EstimateError)
+   return;
+
+  /*--------------------------------------------------------------*/
+  /*- Chebyshev coefficients c_m = (2/n) \sum_j F_j cos(m*theta_j)*/
+  /*- (halved for m=0); we only need their Frobenius norms.       */
+  /*--------------------------------------------------------------*/
+  double *CNorm2 = (double *)mallocEC(NumNodes*sizeof(double));
+  double *CosTable = (double *)mallocEC(NumNodes*NumNodes*sizeof(double));
+  memset(CNorm2, 0, NumNodes*sizeof(double));
+  for(int m=0; m<NumNodes; m++)
+   for(int nn=0; nn<NumNodes; nn++)
+    CosTable[m*NumNodes + nn]
+     = (m==0 ? 1.0 : 2.0)*cos(m*M_PI*(nn+0.5)/((double)NumNodes))/((double)NumNodes);
+
+  for(size_t n=0; n<N2; n++)
+   for(int m=0; m<NumNodes; m++)
+    { cdouble c=0.0;
+      for(int nn=0; nn<NumNodes; nn++)
+       c += CosTable[m*NumNodes + nn]*I->F[nn][n];
+      CNorm2[m] += norm(c);
+    };
+
+  double MaxNorm=0.0;
+  for(int m=0; m<NumNodes; m++)
+   MaxNorm=fmax(MaxNorm, sqrt(CNorm2[m]));
+  I->ErrorEstimate = (MaxNorm==0.0) ? 0.0 :
+   ( sqrt(CNorm2[NumNodes-1]) + sqrt(CNorm2[NumNodes-2]) ) / MaxNorm;
+
+  free(CosTable);
+  free(CNorm2);
+}
+
+/***************************************************************/
+/* find (building and refining as necessary) the interval that */
+/* will be used to interpolate at t                            */
+/***************************************************************/
+static BMIInterval *GetInterval(BEMMatrixInterpolator *BMI, double t)
+{
+  BMIData *D = (BMIData *)BMI->Data;
+  BMIInterval *I=D->Root;
+
+  while(true)
+   {
+     if (I->Kids[0])
+      { I = ( t <= I->Kids[0]->tMax ) ? I->Kids[0] : I->Kids[1];
+        continue;
+      };
+
+     cdouble OmegaMin = BMI->OmegaMid + I->tMin*BMI->OmegaHalfWidth;
+     cdouble OmegaMax = BMI->OmegaMid + I->tMax*BMI->OmegaHalfWidth;
+     if (I->Accepted)
+      { if (!I->F) // previously discarded; reassemble
+         { Log("Reassembling BEM matrix interpolation nodes on [%s,%s]",
+                z2s(OmegaMin),z2s(OmegaMax));
+           BuildInterval(BMI, I, false);
+         };
+        return I;
+      };
+
+     Log("Building BEM matrix interpolant on [%s,%s]...",
+          z2s(OmegaMin),z2s(OmegaMax));
+     BuildInterval(BMI, I, true);
+     if ( I->ErrorEstimate<=BMI->RelTol || I->Depth>=BMI->MaxDepth )
+      { Log(" ...estimated relative error %.2e (accepted)",I->ErrorEstimate);
+        if (I->ErrorEstimate>BMI->RelTol)
+         Warn("BEM matrix interpolation error %.2e on [%s,%s] exceeds tolerance %.2e at maximum refinement depth",
+               I->ErrorEstimate,z2s(OmegaMin),z2s(OmegaMax),BMI->RelTol);
+        I->Accepted=true;
+        return I;
+      };
+
+     Log(" ...estimated relative error %.2e (refining)",I->ErrorEstimate);
+     FreeNodeMatrices(I, BMI->NumNodes);
+     D->NumStoredIntervals--;
+     double tMid=0.5*(I->tMin + I->tMax);
+     I->Kids[0]=NewInterval(I->tMin, tMid, I->Depth+1);
+     I->Kids[1]=NewInterval(tMid, I->tMax, I->Depth+1);
+   };
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+HMatrix *BEMMatrixInterpolator::Evaluate(cdouble Omega, HMatrix *M)
+{
+  double t;
+  if ( !GetT(this, Omega, &t) )
+   ErrExit("%s:%i: frequency %s is outside the range of the BEM matrix interpolator",
+            __FILE__,__LINE__,z2s(Omega));
+  if (t<-1.0) t=-1.0;
+  if (t>+1.0) t=+1.0;
+
+  if (M==NULL)
+   M=G->AllocateBEMMatrix();
+  else if ( M->NR != N || M->NC != N )
+   { Warn("wrong-size matrix passed to AssembleBEMMatrix; reallocating...");
+     M=G->AllocateBEMMatrix();
+   };
+
+  BMIData *D=(BMIData *)Data;
+  BMIInterval *I=GetInterval(this, t);
+  I->LastUsed = ++(D->Clock);
+  NumEvaluations++;
+
+  Log("Interpolating BEM matrix at Omega=%s",z2s(Omega));
+
+  /*--------------------------------------------------------------*/
+  /*- barycentric interpolation weights at x = the position of t  */
+  /*- within the interval, scaled to [-1,1]                       */
+  /*--------------------------------------------------------------*/
+  double x = (2.0*t - I->tMax - I->tMin) / (I->tMax - I->tMin);
+  double *Weights=new double[NumNodes];
+  int nnExact=-1;
+  double Sum=0.0;
+  for(int nn=0; nn<NumNodes && nnExact==-1; nn++)
+   { if ( x==D->xNodes[nn] )
+      nnExact=nn;
+     else
+      Sum += (Weights[nn] = D->wNodes[nn] / (x - D->xNodes[nn]));
+   };
+  for(int nn=0; nn<NumNodes; nn++)
+   Weights[nn] = (nnExact==-1) ? Weights[nn]/Sum : (nn==nnExact ? 1.0 : 0.0);
+
+  /*--------------------------------------------------------------*/
+  /*- interpolate and restore the phase at this frequency         */
+  /*--------------------------------------------------------------*/
+  GetRegionWavenumbers(G, Omega, D->k);
+  bool Packed = (M->StorageType!=LHM_NORMAL);
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(static), num_threads(GetNumThreads())
+#endif
+  for(int nc=0; nc<N; nc++)
+   for(int nr=0; nr<(Packed ? nc+1 : N); nr++)
+    { size_t n = nr + ((size_t)nc)*N;
+      cdouble F=0.0;
+      for(int nn=0; nn<NumNodes; nn++)
+       F += Weights[nn]*I->F[nn][n];
+      M->SetEntry(nr, nc, F*GetPhase(D, nr, nc));
+    };
+
+  delete[] Weights;
+  return M;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+double BEMMatrixInterpolator::GetErrorEstimate(cdouble Omega)
+{
+  double t;
+  if ( !GetT(this, Omega, &t) )
+   return HUGE_VAL;
+
+  BMIData *D=(BMIData *)Data;
+  BMIInterval *I=D->Root;
+  while(I->Kids[0])
+   I = ( t <= I->Kids[0]->tMax ) ? I->Kids[0] : I->Kids[1];
+  return I->Accepted ? I->ErrorEstimate : HUGE_VAL;
+}
+
+} // namespace scuff
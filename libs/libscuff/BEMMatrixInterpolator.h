@@ -0,0 +1,113 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * BEMMatrixInterpolator.h -- frequency interpolation of the BEM matrix
+ *                         -- for dense frequency sweeps
+ */
+
+#ifndef BEM_MATRIX_INTERPOLATOR_H
+#define BEM_MATRIX_INTERPOLATOR_H
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include <libhmat.h>
+
+namespace scuff {
+
+class RWGGeometry; // forward declaration
+
+#define BMI_DEFAULT_NUMNODES  8
+#define BMI_DEFAULT_RELTOL    1.0e-4
+#define BMI_DEFAULT_MAXDEPTH  6
+
+/***************************************************************/
+/* A BEMMatrixInterpolator stands in for full BEM matrix       */
+/* assembly at frequencies Omega on the straight line segment  */
+/* [OmegaMin, OmegaMax] of the complex plane.                  */
+/*                                                             */
+/* The segment is divided into intervals; on each interval,    */
+/* the BEM matrix is assembled at NumNodes Chebyshev nodes,    */
+/* and M(Omega) anywhere in the interval is obtained by        */
+/* element-wise polynomial interpolation. Before interpolating */
+/* we factor out of each matrix element the phase exp(ikR),    */
+/* where R is the distance between the centroids of the two    */
+/* edges and k is the wavenumber of the medium through which   */
+/* they interact, so that what remains is a slowly-varying     */
+/* function of frequency even for widely-separated edges.      */
+/*                                                             */
+/* The interpolation error on each interval is estimated from  */
+/* the decay of the Chebyshev coefficients of the interpolant; */
+/* intervals whose relative error estimate exceeds RelTol are  */
+/* bisected (up to MaxDepth times). Intervals are constructed  */
+/* lazily, the first time a frequency inside them is requested,*/
+/* and at most MaxStoredIntervals sets of node matrices are    */
+/* kept in memory at once (least-recently-used are discarded   */
+/* first, to be reassembled if needed again).                  */
+/*                                                             */
+/* To use it, create an instance and set G->BMInterpolator to  */
+/* point to it; thereafter G->AssembleBEMMatrix(Omega, M) will */
+/* interpolate instead of assembling whenever Omega lies in    */
+/* the range of the interpolator. The interpolator refers to   */
+/* the geometry in its current configuration, so it must not   */
+/* be used across geometrical transformations.                 */
+/***************************************************************/
+class BEMMatrixInterpolator
+ {
+public:
+   BEMMatrixInterpolator(RWGGeometry *G, cdouble OmegaMin, cdouble OmegaMax,
+                         int NumNodes=BMI_DEFAULT_NUMNODES,
+                         double RelTol=BMI_DEFAULT_RELTOL,
+                         int MaxDepth=BMI_DEFAULT_MAXDEPTH);
+   ~BEMMatrixInterpolator();
+
+   // true if Omega lies within the range of the interpolator
+   bool Contains(cdouble Omega);
+
+   // compute M(Omega) by interpolation; if M is NULL on entry a new
+   // matrix is allocated and returned, as for AssembleBEMMatrix
+   HMatrix *Evaluate(cdouble Omega, HMatrix *M=0);
+
+   // estimated relative error of the interpolant at Omega
+   double GetErrorEstimate(cdouble Omega);
+
+// private data fields
+// private:
+   RWGGeometry *G;
+   int N;
+   cdouble OmegaMid, OmegaHalfWidth;
+   int NumNodes;
+   double RelTol;
+   int MaxDepth;
+   int MaxStoredIntervals;
+
+   // statistics
+   int NumAssemblies, NumEvaluations;
+
+   // true while we are assembling node matrices, so that
+   // AssembleBEMMatrix does not try to call back into us
+   bool Busy;
+
+   void *Data;
+ };
+
+} // namespace scuff
+#endif // #ifndef BEM_MATRIX_INTERPOLATOR_H
@@ -0,0 +1,1273 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * CompressedBEMMatrix.cc -- hierarchically-compressed (H-matrix) storage,
+ *                        -- assembly, and direct solution of the BEM
+ *                        -- system for large compact geometries
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <libhmat.h>
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+#include "CompressedBEMMatrix.h"
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
+#define II cdouble(0,1)
+
+namespace scuff {
+
+/***************************************************************/
+/* a node in the cluster tree. each cluster is a contiguous    */
+/* range [Offset, Offset+NumBFs) of basis functions in cluster */
+/* ordering; the sphere (Center, Radius) encloses all of its   */
+/* edges.                                                      */
+/***************************************************************/
+typedef struct CBMCluster
+ { int Offset, NumBFs;
+   int Level;
+   double Center[3], Radius;
+   struct CBMCluster *Kids[2];
+ } CBMCluster;
+
+/***************************************************************/
+/* a node in the block tree, describing the block of the BEM   */
+/* matrix whose rows and columns are the basis functions of    */
+/* clusters RC and CC. there are three types of blocks:        */
+/*                                                             */
+/*  CBM_LOWRANK: admissible blocks, stored as U*VT (U and VT   */
+/*               are NULL if the block vanishes identically)   */
+/*  CBM_DENSE:   inadmissible blocks for which RC or CC is a   */
+/*               leaf, and admissible blocks whose rank is too */
+/*               high to save storage, stored as the dense     */
+/*               matrix D                                      */
+/*  CBM_HIER:    all other inadmissible blocks, subdivided     */
+/*               into Kids[2*i+j] = (RC->Kids[i], CC->Kids[j]) */
+/*                                                             */
+/* LUFactorize() overwrites the blocks with the H-LU factors:  */
+/* blocks below the diagonal hold L (with unit diagonal),      */
+/* blocks above it hold U, and the dense diagonal blocks hold  */
+/* both in the LAPACK layout, with their row pivots in D->ipiv.*/
+/***************************************************************/
+#define CBM_LOWRANK 0
+#define CBM_DENSE   1
+#define CBM_HIER    2
+
+typedef struct CBMBlock
+ { int Type;
+   CBMCluster *RC, *CC;
+   HMatrix *D;
+   HMatrix *U, *VT;
+   struct CBMBlock *Kids[4];
+ } CBMBlock;
+
+typedef struct CBMData
+ {
+   std::vector<CBMCluster *> Clusters; // all clusters, parents before children
+   CBMCluster *Root;
+   int NumLevels;
+
+   std::vector<CBMBlock *> Blocks;     // all blocks, parents before children
+   CBMBlock *RootBlock;
+
+   // surface index, edge index, and K/N index of each
+   // basis function in cluster ordering
+   int *BFSurface, *BFEdge, *BFKN;
+
+   // wavenumbers and prefactors for the (up to two) regions
+   // shared by each pair of surfaces at the present frequency;
+   // index is 2*(nsa*NS + nsb) + nr
+   int NS;
+   int *NumCommonRegions;
+   cdouble *k, *PreFac1, *PreFac2, *PreFac3;
+
+ } CBMData;
+
+/***************************************************************/
+/* sorting helper for the cluster-tree construction            */
+/***************************************************************/
+typedef struct CBMEdge
+ { double X[3], Radius;
+   int ns, ne;
+ } CBMEdge;
+
+struct CBMEdgeCmp
+ { int Axis;
+   CBMEdgeCmp(int _Axis) : Axis(_Axis) {}
+   bool operator()(const CBMEdge &E1, const CBMEdge &E2) const
+    { return E1.X[Axis] < E2.X[Axis]; }
+ };
+
+/***************************************************************/
+/* recursive bisection of the edge list [First, Last) along    */
+/* the longest side of its bounding box.                       */
+/***************************************************************/
+CBMCluster *BuildCluster(RWGGeometry *G, CBMData *Data, std::vector<CBMEdge> &Edges,
+                         int First, int Last, int *Offset, int Level, int LeafSize)
+{
+  CBMCluster *C = (CBMCluster *)mallocEC(sizeof(CBMCluster));
+  memset(C, 0, sizeof(CBMCluster));
+  Data->Clusters.push_back(C);
+  C->Offset = *Offset;
+  C->Level  = Level;
+  if (Level+1 > Data->NumLevels) Data->NumLevels=Level+1;
+
+  int NumBFs=0;
+  double XMin[3]={ HUGE_VAL,  HUGE_VAL,  HUGE_VAL};
+  double XMax[3]={-HUGE_VAL, -HUGE_VAL, -HUGE_VAL};
+  for(int n=First; n<Last; n++)
+   { NumBFs += G->Surfaces[Edges[n].ns]->IsPEC ? 1 : 2;
+     for(int i=0; i<3; i++)
+      { XMin[i] = fmin(XMin[i], Edges[n].X[i]);
+        XMax[i] = fmax(XMax[i], Edges[n].X[i]);
+      };
+   };
+  C->NumBFs = NumBFs;
+
+  for(int i=0; i<3; i++)
+   C->Center[i] = 0.5*(XMin[i] + XMax[i]);
+  C->Radius=0.0;
+  for(int n=First; n<Last; n++)
+   C->Radius = fmax(C->Radius, VecDistance(C->Center, Edges[n].X) + Edges[n].Radius);
+
+  if ( NumBFs<=LeafSize || (Last-First)<2 )
+   { for(int n=First; n<Last; n++)
+      { int ns = Edges[n].ns, ne = Edges[n].ne;
+        int NBF = G->Surfaces[ns]->IsPEC ? 1 : 2;
+        for(int nbf=0; nbf<NBF; nbf++, (*Offset)++)
+         { Data->BFSurface[*Offset] = ns;
+           Data->BFEdge[*Offset]    = ne;
+           Data->BFKN[*Offset]      = nbf;
+         };
+      };
+     return C;
+   };
+
+  int Axis=0;
+  for(int i=1; i<3; i++)
+   if ( (XMax[i]-XMin[i]) > (XMax[Axis]-XMin[Axis]) )
+    Axis=i;
+  int Middle = (First+Last)/2;
+  std::nth_element(Edges.begin()+First, Edges.begin()+Middle, Edges.begin()+Last, CBMEdgeCmp(Axis));
+
+  C->Kids[0] = BuildCluster(G, Data, Edges, First, Middle, Offset, Level+1, LeafSize);
+  C->Kids[1] = BuildCluster(G, Data, Edges, Middle, Last,  Offset, Level+1, LeafSize);
+  return C;
+}
+
+/***************************************************************/
+/* two clusters are admissible (their interaction block is     */
+/* approximated in low-rank form) if the distance between      */
+/* their bounding spheres is at least 1/Eta times the smaller  */
+/* of their diameters.                                         */
+/***************************************************************/
+static bool IsAdmissible(CBMCluster *C1, CBMCluster *C2, double Eta)
+{
+  double Distance = VecDistance(C1->Center, C2->Center) - C1->Radius - C2->Radius;
+  double Diameter = 2.0*fmin(C1->Radius, C2->Radius);
+  return Distance>0.0 && Diameter <= Eta*Distance;
+}
+
+static CBMBlock *NewBlock(int Type, CBMCluster *RC, CBMCluster *CC)
+{
+  CBMBlock *B = (CBMBlock *)mallocEC(sizeof(CBMBlock));
+  memset(B, 0, sizeof(CBMBlock));
+  B->Type = Type;
+  B->RC   = RC;
+  B->CC   = CC;
+  return B;
+}
+
+/***************************************************************/
+/* build the block tree below the block for clusters (RC, CC)  */
+/***************************************************************/
+CBMBlock *BuildBlock(CBMData *Data, CBMCluster *RC, CBMCluster *CC, double Eta)
+{
+  int Type;
+  if ( RC!=CC && IsAdmissible(RC, CC, Eta) )
+   Type=CBM_LOWRANK;
+  else if ( RC->Kids[0]==0 || CC->Kids[0]==0 )
+   Type=CBM_DENSE;
+  else
+   Type=CBM_HIER;
+
+  CBMBlock *B = NewBlock(Type, RC, CC);
+  Data->Blocks.push_back(B);
+  if (Type==CBM_HIER)
+   for(int i=0; i<2; i++)
+    for(int j=0; j<2; j++)
+     B->Kids[2*i+j] = BuildBlock(Data, RC->Kids[i], CC->Kids[j], Eta);
+  return B;
+}
+
+// frees the data of block B but not its kids
+void DestroyBlock(CBMBlock *B)
+{
+  if (B->D)  delete B->D;
+  if (B->U)  delete B->U;
+  if (B->VT) delete B->VT;
+  free(B);
+}
+
+/***************************************************************/
+/* compute the 2x2 block of BEM matrix entries describing the  */
+/* interaction of edges (nsa,nea) and (nsb,neb); MB[2*a+b] is  */
+/* the entry for K/N index a on edge #nea and K/N index b on   */
+/* edge #neb. (For PEC surfaces only the a,b=0 entries are     */
+/* meaningful.)                                                */
+/***************************************************************/
+void GetEdgePairBlock(CBMData *Data, GetEEIArgStruct *Args,
+                      RWGGeometry *G, int nsa, int nea, int nsb, int neb,
+                      cdouble MB[4])
+{
+  MB[0]=MB[1]=MB[2]=MB[3]=0.0;
+
+  int nsab = nsa*Data->NS + nsb;
+  if (Data->NumCommonRegions[nsab]==0)
+   return;
+
+  Args->Sa  = G->Surfaces[nsa];
+  Args->Sb  = G->Surfaces[nsb];
+  Args->nea = nea;
+  Args->neb = neb;
+  cdouble *GC=Args->GC;
+  for(int nr=0; nr<Data->NumCommonRegions[nsab]; nr++)
+   { int Index = 2*nsab + nr;
+     Args->k = Data->k[Index];
+     GetEdgeEdgeInteractions(Args);
+     MB[0] += Data->PreFac1[Index]*GC[0];
+     MB[1] += Data->PreFac2[Index]*GC[1];
+     MB[2] += Data->PreFac2[Index]*GC[1];
+     MB[3] += Data->PreFac3[Index]*GC[0];
+   };
+}
+
+/***************************************************************/
+/* fetch the NRxNC block of the BEM matrix (in cluster         */
+/* ordering) whose upper-left entry is (RowOffset, ColOffset)  */
+/* into column-major storage Dest with leading dimension LDD.  */
+/* the basis functions of a single edge are always adjacent in */
+/* cluster ordering, so each edge pair is visited only once.   */
+/***************************************************************/
+void GetCBMBlock(CBMData *Data, GetEEIArgStruct *Args, RWGGeometry *G,
+                 int RowOffset, int NR, int ColOffset, int NC,
+                 cdouble *Dest, int LDD)
+{
+  int *BFSurface=Data->BFSurface, *BFEdge=Data->BFEdge, *BFKN=Data->BFKN;
+  cdouble MB[4];
+  for(int c=0; c<NC; )
+   { int pc=ColOffset + c;
+     int CSpan=1;
+     if ( c+1<NC && BFSurface[pc+1]==BFSurface[pc] && BFEdge[pc+1]==BFEdge[pc] )
+      CSpan=2;
+
+     for(int r=0; r<NR; )
+      { int pr=RowOffset + r;
+        int RSpan=1;
+        if ( r+1<NR && BFSurface[pr+1]==BFSurface[pr] && BFEdge[pr+1]==BFEdge[pr] )
+         RSpan=2;
+
+        GetEdgePairBlock(Data, Args, G, BFSurface[pr], BFEdge[pr], BFSurface[pc], BFEdge[pc], MB);
+        for(int dr=0; dr<RSpan; dr++)
+         for(int dc=0; dc<CSpan; dc++)
+          Dest[ (r+dr) + (c+dc)*LDD ] = MB[ 2*BFKN[pr+dr] + BFKN[pc+dc] ];
+
+        r+=RSpan;
+      };
+     c+=CSpan;
+   };
+}
+
+/***************************************************************/
+/* adaptive cross approximation with partial pivoting of the   */
+/* MxN block with upper-left entry (RowOffset, ColOffset).     */
+/* On return, *pU and *pVT are the MxR and RxN factors, or     */
+/* NULL if the block vanishes identically.                     */
+/***************************************************************/
+void ACABlock(CBMData *Data, GetEEIArgStruct *Args, RWGGeometry *G,
+              int RowOffset, int M, int ColOffset, int N, double Tol,
+              HMatrix **pU, HMatrix **pVT)
+{
+  int MaxRank = (M < N ? M : N);
+  std::vector<bool> RowUsed(M, false);
+  std::vector<cdouble> Us, Vs; // Us[k*M + m], Vs[k*N + n]
+  std::vector<cdouble> Row(N), Col(M);
+
+  double Norm2=0.0;
+  int Rank=0, iStar=0;
+  while( Rank<MaxRank )
+   {
+     /*--------------------------------------------------------------*/
+     /*- get residual of row iStar and choose column pivot          -*/
+     /*--------------------------------------------------------------*/
+     GetCBMBlock(Data, Args, G, RowOffset+iStar, 1, ColOffset, N, &(Row[0]), 1);
+     for(int k=0; k<Rank; k++)
+      { cdouble Uki = Us[k*M + iStar];
+        for(int n=0; n<N; n++)
+         Row[n] -= Uki*Vs[k*N + n];
+      };
+     RowUsed[iStar]=true;
+
+     int jStar=0;
+     for(int n=1; n<N; n++)
+      if ( abs(Row[n]) > abs(Row[jStar]) )
+       jStar=n;
+
+     if ( abs(Row[jStar])==0.0 )
+      { // this row is already represented exactly; try the next unused row
+        iStar=-1;
+        for(int m=0; m<M && iStar==-1; m++)
+         if (!RowUsed[m]) iStar=m;
+        if (iStar==-1) break;
+        continue;
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- get residual of column jStar                               -*/
+     /*--------------------------------------------------------------*/
+     cdouble Pivot=Row[jStar];
+     for(int n=0; n<N; n++)
+      Row[n]/=Pivot;
+     GetCBMBlock(Data, Args, G, RowOffset, M, ColOffset+jStar, 1, &(Col[0]), M);
+     for(int k=0; k<Rank; k++)
+      { cdouble Vkj = Vs[k*N + jStar];
+        for(int m=0; m<M; m++)
+         Col[m] -= Vkj*Us[k*M + m];
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- update the Frobenius norm of the approximant:              -*/
+     /*- |S + uv|^2 = |S|^2 + |u|^2|v|^2 + 2 Re \sum (u_k'u)(v_k'v) -*/
+     /*--------------------------------------------------------------*/
+     double uu=0.0, vv=0.0;
+     for(int m=0; m<M; m++) uu+=norm(Col[m]);
+     for(int n=0; n<N; n++) vv+=norm(Row[n]);
+     cdouble Cross=0.0;
+     for(int k=0; k<Rank; k++)
+      { cdouble uku=0.0, vkv=0.0;
+        for(int m=0; m<M; m++) uku += conj(Us[k*M+m])*Col[m];
+        for(int n=0; n<N; n++) vkv += conj(Vs[k*N+n])*Row[n];
+        Cross += uku*vkv;
+      };
+     Norm2 += uu*vv + 2.0*real(Cross);
+
+     Us.insert(Us.end(), Col.begin(), Col.end());
+     Vs.insert(Vs.end(), Row.begin(), Row.end());
+     Rank++;
+
+     if ( sqrt(uu*vv) <= Tol*sqrt(fabs(Norm2)) )
+      break;
+
+     /*--------------------------------------------------------------*/
+     /*- next row pivot is the largest entry of the new column      -*/
+     /*--------------------------------------------------------------*/
+     iStar=-1;
+     for(int m=0; m<M; m++)
+      if ( !RowUsed[m] && (iStar==-1 || abs(Col[m]) > abs(Col[iStar])) )
+       iStar=m;
+     if (iStar==-1) break;
+   };
+
+  if (Rank==0)
+   { *pU=*pVT=0;
+     return;
+   };
+
+  HMatrix *U  = new HMatrix(M, Rank, LHM_COMPLEX);
+  HMatrix *VT = new HMatrix(Rank, N, LHM_COMPLEX);
+  memcpy(U->ZM, &(Us[0]), M*Rank*sizeof(cdouble));
+  for(int k=0; k<Rank; k++)
+   for(int n=0; n<N; n++)
+    VT->ZM[k + n*Rank] = Vs[k*N + n];
+  *pU=U;
+  *pVT=VT;
+}
+
+/***************************************************************/
+/* return a newly-allocated matrix C=A*B                       */
+/***************************************************************/
+static HMatrix *Product(HMatrix *A, HMatrix *B)
+{
+  HMatrix *C = new HMatrix(A->NR, B->NC, LHM_COMPLEX);
+  A->Multiply(B, C);
+  return C;
+}
+
+/***************************************************************/
+/* return a newly-allocated NRxNC copy of the block of X whose */
+/* upper-left entry is (RowOffset, ColOffset), or copy B back  */
+/* into that position                                          */
+/***************************************************************/
+static HMatrix *GetBlock(HMatrix *X, int RowOffset, int NR, int ColOffset, int NC)
+{
+  HMatrix *B = new HMatrix(NR, NC, LHM_COMPLEX);
+  for(int nc=0; nc<NC; nc++)
+   memcpy(B->ZM + nc*NR, X->ZM + RowOffset + (ColOffset+nc)*X->NR, NR*sizeof(cdouble));
+  return B;
+}
+
+static void PutBlock(HMatrix *B, HMatrix *X, int RowOffset, int ColOffset)
+{
+  for(int nc=0; nc<B->NC; nc++)
+   memcpy(X->ZM + RowOffset + (ColOffset+nc)*X->NR, B->ZM + nc*B->NR, B->NR*sizeof(cdouble));
+}
+
+/***************************************************************/
+/* recompress the low-rank product U*VT by discarding singular */
+/* values smaller than Tol times the largest. U and VT are     */
+/* replaced by the new factors, or by NULL if the product      */
+/* vanishes.                                                   */
+/***************************************************************/
+void Truncate(HMatrix **pU, HMatrix **pVT, double Tol)
+{
+  HMatrix *U=*pU, *VT=*pVT;
+  if (U==0) return;
+  int M=U->NR, N=VT->NC, K=U->NC;
+
+  // U = Q1 * S1 * W1 (the SVD overwrites its argument)
+  int R1 = (M<K ? M : K);
+  HMatrix *Q1 = new HMatrix(M, R1, LHM_COMPLEX);
+  HMatrix *W1 = new HMatrix(R1, K, LHM_COMPLEX);
+  HVector *S1 = new HVector(R1, LHM_REAL);
+  HMatrix *UCopy = new HMatrix(U);
+  UCopy->SVD(S1, Q1, W1);
+  delete UCopy;
+
+  // S1*W1*VT = Q2 * S2 * W2
+  for(int k=0; k<K; k++)
+   for(int r=0; r<R1; r++)
+    W1->ZM[r + k*R1] *= S1->DV[r];
+  HMatrix *Core = Product(W1, VT);
+  int R2 = (R1<N ? R1 : N);
+  HMatrix *Q2 = new HMatrix(R1, R2, LHM_COMPLEX);
+  HMatrix *W2 = new HMatrix(R2, N, LHM_COMPLEX);
+  HVector *S2 = new HVector(R2, LHM_REAL);
+  Core->SVD(S2, Q2, W2);
+
+  int Rank=0;
+  while( Rank<R2 && S2->DV[Rank] > Tol*S2->DV[0] )
+   Rank++;
+
+  delete U;
+  delete VT;
+  if (Rank==0)
+   *pU=*pVT=0;
+  else
+   { HMatrix *Q2S = GetBlock(Q2, 0, R1, 0, Rank);
+     for(int r=0; r<Rank; r++)
+      for(int m=0; m<R1; m++)
+       Q2S->ZM[m + r*R1] *= S2->DV[r];
+     *pU  = Product(Q1, Q2S);
+     *pVT = GetBlock(W2, 0, Rank, 0, N);
+     delete Q2S;
+   };
+
+  delete Q1; delete W1; delete S1;
+  delete Core; delete Q2; delete W2; delete S2;
+}
+
+/***************************************************************/
+/* a low-rank block whose rank is too high to save storage     */
+/* is converted to a dense block                               */
+/***************************************************************/
+static void DensifyIfCheaper(CBMBlock *B)
+{
+  if (B->Type!=CBM_LOWRANK || B->U==0)
+   return;
+  int M=B->U->NR, N=B->VT->NC, K=B->U->NC;
+  if ( K*(M+N) < M*N )
+   return;
+  B->D = Product(B->U, B->VT);
+  delete B->U;
+  delete B->VT;
+  B->U=B->VT=0;
+  B->Type=CBM_DENSE;
+}
+
+/***************************************************************/
+/* triangular solves with the LU factors of a dense diagonal   */
+/* block D, as computed by D->LUFactorize():                   */
+/*  LeafLowerSolve:      X <- L^{-1} P^T X                     */
+/*  LeafUpperSolve:      X <- U^{-1} X                         */
+/*  LeafUpperSolveRight: X <- X U^{-1}                         */
+/***************************************************************/
+static void LeafLowerSolve(HMatrix *D, HMatrix *X)
+{
+  int N=D->NR;
+  cdouble *LU=D->ZM;
+  for(int nc=0; nc<X->NC; nc++)
+   { cdouble *x = X->ZM + nc*N;
+     for(int i=0; i<N; i++)
+      { int p=D->ipiv[i]-1;
+        if (p!=i)
+         { cdouble t=x[i]; x[i]=x[p]; x[p]=t; };
+      };
+     for(int j=0; j<N; j++)
+      { cdouble xj=x[j];
+        if (xj==0.0) continue;
+        for(int i=j+1; i<N; i++)
+         x[i] -= LU[i + j*N]*xj;
+      };
+   };
+}
+
+static void LeafUpperSolve(HMatrix *D, HMatrix *X)
+{
+  int N=D->NR;
+  cdouble *LU=D->ZM;
+  for(int nc=0; nc<X->NC; nc++)
+   { cdouble *x = X->ZM + nc*N;
+     for(int j=N-1; j>=0; j--)
+      { x[j] /= LU[j + j*N];
+        cdouble xj=x[j];
+        if (xj==0.0) continue;
+        for(int i=0; i<j; i++)
+         x[i] -= LU[i + j*N]*xj;
+      };
+   };
+}
+
+static void LeafUpperSolveRight(HMatrix *D, HMatrix *X)
+{
+  int N=D->NR, M=X->NR;
+  cdouble *LU=D->ZM;
+  for(int j=0; j<N; j++)
+   { cdouble *xj = X->ZM + j*M;
+     for(int i=0; i<j; i++)
+      { cdouble Uij=LU[i + j*N];
+        if (Uij==0.0) continue;
+        cdouble *xi = X->ZM + i*M;
+        for(int m=0; m<M; m++)
+         xj[m] -= xi[m]*Uij;
+      };
+     cdouble Ujj=LU[j + j*N];
+     for(int m=0; m<M; m++)
+      xj[m] /= Ujj;
+   };
+}
+
+/***************************************************************/
+/* Y += Alpha * B * X, where X has as many rows as B has       */
+/* columns and Y has as many rows as B                         */
+/***************************************************************/
+void HApply(CBMBlock *B, HMatrix *X, HMatrix *Y, cdouble Alpha=1.0)
+{
+  if (B->Type==CBM_DENSE)
+   { HMatrix *BX = Product(B->D, X);
+     Y->Add(BX, Alpha);
+     delete BX;
+   }
+  else if (B->Type==CBM_LOWRANK)
+   { if (B->U==0) return;
+     HMatrix *VX  = Product(B->VT, X);
+     HMatrix *UVX = Product(B->U, VX);
+     Y->Add(UVX, Alpha);
+     delete UVX;
+     delete VX;
+   }
+  else
+   { int NRHS = X->NC;
+     int NR0 = B->RC->Kids[0]->NumBFs, NR1 = B->RC->Kids[1]->NumBFs;
+     int NC0 = B->CC->Kids[0]->NumBFs, NC1 = B->CC->Kids[1]->NumBFs;
+     HMatrix *X0 = GetBlock(X, 0,   NC0, 0, NRHS);
+     HMatrix *X1 = GetBlock(X, NC0, NC1, 0, NRHS);
+     HMatrix *Y0 = GetBlock(Y, 0,   NR0, 0, NRHS);
+     HMatrix *Y1 = GetBlock(Y, NR0, NR1, 0, NRHS);
+     HApply(B->Kids[0], X0, Y0, Alpha);
+     HApply(B->Kids[1], X1, Y0, Alpha);
+     HApply(B->Kids[2], X0, Y1, Alpha);
+     HApply(B->Kids[3], X1, Y1, Alpha);
+     PutBlock(Y0, Y, 0,   0);
+     PutBlock(Y1, Y, NR0, 0);
+     delete X0; delete X1; delete Y0; delete Y1;
+   };
+}
+
+/***************************************************************/
+/* Y += Alpha * X * B, where X has as many columns as B has    */
+/* rows and Y has as many columns as B                         */
+/***************************************************************/
+void HApplyRight(CBMBlock *B, HMatrix *X, HMatrix *Y, cdouble Alpha=1.0)
+{
+  if (B->Type==CBM_DENSE)
+   { HMatrix *XB = Product(X, B->D);
+     Y->Add(XB, Alpha);
+     delete XB;
+   }
+  else if (B->Type==CBM_LOWRANK)
+   { if (B->U==0) return;
+     HMatrix *XU   = Product(X, B->U);
+     HMatrix *XUVT = Product(XU, B->VT);
+     Y->Add(XUVT, Alpha);
+     delete XUVT;
+     delete XU;
+   }
+  else
+   { int NX = X->NR;
+     int NR0 = B->RC->Kids[0]->NumBFs, NR1 = B->RC->Kids[1]->NumBFs;
+     int NC0 = B->CC->Kids[0]->NumBFs, NC1 = B->CC->Kids[1]->NumBFs;
+     HMatrix *X0 = GetBlock(X, 0, NX, 0,   NR0);
+     HMatrix *X1 = GetBlock(X, 0, NX, NR0, NR1);
+     HMatrix *Y0 = GetBlock(Y, 0, NX, 0,   NC0);
+     HMatrix *Y1 = GetBlock(Y, 0, NX, NC0, NC1);
+     HApplyRight(B->Kids[0], X0, Y0, Alpha);
+     HApplyRight(B->Kids[2], X1, Y0, Alpha);
+     HApplyRight(B->Kids[1], X0, Y1, Alpha);
+     HApplyRight(B->Kids[3], X1, Y1, Alpha);
+     PutBlock(Y0, Y, 0, 0);
+     PutBlock(Y1, Y, 0, NC0);
+     delete X0; delete X1; delete Y0; delete Y1;
+   };
+}
+
+/***************************************************************/
+/* C += U*VT, recompressing low-rank blocks to tolerance Tol   */
+/***************************************************************/
+void AddLowRank(CBMBlock *C, HMatrix *U, HMatrix *VT, double Tol)
+{
+  if (C->Type==CBM_DENSE)
+   { HMatrix *UVT = Product(U, VT);
+     C->D->Add(UVT);
+     delete UVT;
+   }
+  else if (C->Type==CBM_LOWRANK)
+   { int M=U->NR, N=VT->NC, K0=C->U ? C->U->NC : 0, K=K0 + U->NC;
+     HMatrix *NewU  = new HMatrix(M, K, LHM_COMPLEX);
+     HMatrix *NewVT = new HMatrix(K, N, LHM_COMPLEX);
+     if (K0)
+      { PutBlock(C->U,  NewU,  0, 0);
+        PutBlock(C->VT, NewVT, 0, 0);
+        delete C->U;
+        delete C->VT;
+      };
+     PutBlock(U,  NewU,  0,  K0);
+     PutBlock(VT, NewVT, K0, 0);
+     Truncate(&NewU, &NewVT, Tol);
+     C->U=NewU;
+     C->VT=NewVT;
+     DensifyIfCheaper(C);
+   }
+  else
+   { int K=U->NC;
+     for(int i=0; i<2; i++)
+      for(int j=0; j<2; j++)
+       { CBMCluster *RC=C->RC->Kids[i], *CC=C->CC->Kids[j];
+         HMatrix *Ui  = GetBlock(U,  RC->Offset - C->RC->Offset, RC->NumBFs, 0, K);
+         HMatrix *VTj = GetBlock(VT, 0, K, CC->Offset - C->CC->Offset, CC->NumBFs);
+         AddLowRank(C->Kids[2*i+j], Ui, VTj, Tol);
+         delete Ui;
+         delete VTj;
+       };
+   };
+}
+
+/***************************************************************/
+/* C += Alpha*A*B, where the row cluster of A is that of C,    */
+/* the column cluster of B is that of C, and the column        */
+/* cluster of A is the row cluster of B.                       */
+/***************************************************************/
+void MulAdd(CBMBlock *C, CBMBlock *A, CBMBlock *B, cdouble Alpha, double Tol)
+{
+  /*--------------------------------------------------------------*/
+  /*- if either factor is low-rank, so is the product            -*/
+  /*--------------------------------------------------------------*/
+  if (A->Type==CBM_LOWRANK || B->Type==CBM_LOWRANK)
+   { HMatrix *U, *VT;
+     if (A->Type==CBM_LOWRANK)
+      { if (A->U==0) return;
+        U  = new HMatrix(A->U);
+        VT = new HMatrix(A->VT->NR, B->CC->NumBFs, LHM_COMPLEX);
+        HApplyRight(B, A->VT, VT);
+      }
+     else
+      { if (B->U==0) return;
+        U  = new HMatrix(A->RC->NumBFs, B->U->NC, LHM_COMPLEX);
+        HApply(A, B->U, U);
+        VT = new HMatrix(B->VT);
+      };
+     U->Scale(Alpha);
+     AddLowRank(C, U, VT, Tol);
+     delete U;
+     delete VT;
+     return;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- if both factors are subdivided, recurse; if the target is  -*/
+  /*- not, it is split into a temporary 2x2 grid of blocks of    -*/
+  /*- the same type. (Low-rank products are accumulated in the   -*/
+  /*- grid and added to the target all at once.)                 -*/
+  /*--------------------------------------------------------------*/
+  if (A->Type==CBM_HIER && B->Type==CBM_HIER)
+   {
+     CBMBlock *T = C;
+     if (C->Type!=CBM_HIER)
+      { T = NewBlock(CBM_HIER, C->RC, C->CC);
+        for(int i=0; i<2; i++)
+         for(int j=0; j<2; j++)
+          { CBMCluster *RC=C->RC->Kids[i], *CC=C->CC->Kids[j];
+            CBMBlock *TK = NewBlock(C->Type, RC, CC);
+            if (C->Type==CBM_DENSE)
+             TK->D = GetBlock(C->D, RC->Offset - C->RC->Offset, RC->NumBFs,
+                                    CC->Offset - C->CC->Offset, CC->NumBFs);
+            T->Kids[2*i+j] = TK;
+          };
+      };
+
+     for(int i=0; i<2; i++)
+      for(int j=0; j<2; j++)
+       for(int l=0; l<2; l++)
+        MulAdd(T->Kids[2*i+j], A->Kids[2*i+l], B->Kids[2*l+j], Alpha, Tol);
+
+     if (T!=C && C->Type==CBM_DENSE)
+      { for(int n=0; n<4; n++)
+         { CBMBlock *TK=T->Kids[n];
+           PutBlock(TK->D, C->D, TK->RC->Offset - C->RC->Offset, TK->CC->Offset - C->CC->Offset);
+           DestroyBlock(TK);
+         };
+        DestroyBlock(T);
+      }
+     else if (T!=C)
+      { // sub-blocks that were converted to dense form along the
+        // way enter as D*I
+        int K=0;
+        for(int n=0; n<4; n++)
+         { CBMBlock *TK=T->Kids[n];
+           if (TK->U) K+=TK->U->NC;
+           if (TK->D) K+=TK->D->NC;
+         };
+        if (K>0)
+         { HMatrix *U  = new HMatrix(C->RC->NumBFs, K, LHM_COMPLEX);
+           HMatrix *VT = new HMatrix(K, C->CC->NumBFs, LHM_COMPLEX);
+           for(int n=0, k=0; n<4; n++)
+            { CBMBlock *TK=T->Kids[n];
+              int RowOffset = TK->RC->Offset - C->RC->Offset;
+              int ColOffset = TK->CC->Offset - C->CC->Offset;
+              if (TK->U)
+               { PutBlock(TK->U,  U,  RowOffset, k);
+                 PutBlock(TK->VT, VT, k, ColOffset);
+                 k+=TK->U->NC;
+               }
+              else if (TK->D)
+               { PutBlock(TK->D, U, RowOffset, k);
+                 for(int nc=0; nc<TK->D->NC; nc++)
+                  VT->SetEntry(k+nc, ColOffset+nc, 1.0);
+                 k+=TK->D->NC;
+               };
+            };
+           AddLowRank(C, U, VT, Tol);
+           delete U;
+           delete VT;
+         };
+        for(int n=0; n<4; n++)
+         DestroyBlock(T->Kids[n]);
+        DestroyBlock(T);
+      };
+     return;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- otherwise at least one factor is dense, and the product    -*/
+  /*- is formed explicitly                                       -*/
+  /*--------------------------------------------------------------*/
+  int NR=A->RC->NumBFs, NC=B->CC->NumBFs;
+  HMatrix *P = new HMatrix(NR, NC, LHM_COMPLEX);
+  if (A->Type==CBM_DENSE)
+   HApplyRight(B, A->D, P, Alpha);
+  else
+   HApply(A, B->D, P, Alpha);
+
+  if (C->Type==CBM_DENSE)
+   C->D->Add(P);
+  else
+   { // write P as a low-rank product with an identity factor
+     int K = (NR<NC ? NR : NC);
+     HMatrix *I = new HMatrix(K, K, LHM_COMPLEX);
+     for(int k=0; k<K; k++)
+      I->SetEntry(k, k, 1.0);
+     if (NR<NC)
+      AddLowRank(C, I, P, Tol);
+     else
+      AddLowRank(C, P, I, Tol);
+     delete I;
+   };
+  delete P;
+}
+
+/***************************************************************/
+/* triangular solves with the H-LU factors of diagonal block   */
+/* A, with a dense right-hand side X:                          */
+/*  HLowerSolve:      X <- L^{-1} X                            */
+/*  HUpperSolve:      X <- U^{-1} X                            */
+/*  HUpperSolveRight: X <- X U^{-1}                            */
+/***************************************************************/
+void HLowerSolve(CBMBlock *A, HMatrix *X)
+{
+  if (A->Type==CBM_DENSE)
+   { LeafLowerSolve(A->D, X);
+     return;
+   };
+  int NRHS=X->NC;
+  int N0=A->RC->Kids[0]->NumBFs, N1=A->RC->Kids[1]->NumBFs;
+  HMatrix *X0 = GetBlock(X, 0,  N0, 0, NRHS);
+  HMatrix *X1 = GetBlock(X, N0, N1, 0, NRHS);
+  HLowerSolve(A->Kids[0], X0);
+  HApply(A->Kids[2], X0, X1, -1.0);
+  HLowerSolve(A->Kids[3], X1);
+  PutBlock(X0, X, 0,  0);
+  PutBlock(X1, X, N0, 0);
+  delete X0;
+  delete X1;
+}
+
+void HUpperSolve(CBMBlock *A, HMatrix *X)
+{
+  if (A->Type==CBM_DENSE)
+   { LeafUpperSolve(A->D, X);
+     return;
+   };
+  int NRHS=X->NC;
+  int N0=A->RC->Kids[0]->NumBFs, N1=A->RC->Kids[1]->NumBFs;
+  HMatrix *X0 = GetBlock(X, 0,  N0, 0, NRHS);
+  HMatrix *X1 = GetBlock(X, N0, N1, 0, NRHS);
+  HUpperSolve(A->Kids[3], X1);
+  HApply(A->Kids[1], X1, X0, -1.0);
+  HUpperSolve(A->Kids[0], X0);
+  PutBlock(X0, X, 0,  0);
+  PutBlock(X1, X, N0, 0);
+  delete X0;
+  delete X1;
+}
+
+void HUpperSolveRight(CBMBlock *A, HMatrix *X)
+{
+  if (A->Type==CBM_DENSE)
+   { LeafUpperSolveRight(A->D, X);
+     return;
+   };
+  int NX=X->NR;
+  int N0=A->RC->Kids[0]->NumBFs, N1=A->RC->Kids[1]->NumBFs;
+  HMatrix *X0 = GetBlock(X, 0, NX, 0,  N0);
+  HMatrix *X1 = GetBlock(X, 0, NX, N0, N1);
+  HUpperSolveRight(A->Kids[0], X0);
+  HApplyRight(A->Kids[1], X0, X1, -1.0);
+  HUpperSolveRight(A->Kids[3], X1);
+  PutBlock(X0, X, 0, 0);
+  PutBlock(X1, X, 0, N0);
+  delete X0;
+  delete X1;
+}
+
+/***************************************************************/
+/* the same, with a block of the block tree as right-hand side */
+/*  HLowerSolveBlock:      B <- L^{-1} B (L from block A)      */
+/*  HUpperSolveRightBlock: B <- B U^{-1} (U from block A)      */
+/***************************************************************/
+void HLowerSolveBlock(CBMBlock *A, CBMBlock *B, double Tol)
+{
+  if (B->Type==CBM_DENSE)
+   HLowerSolve(A, B->D);
+  else if (B->Type==CBM_LOWRANK)
+   { if (B->U) HLowerSolve(A, B->U); }
+  else
+   for(int j=0; j<2; j++)
+    { HLowerSolveBlock(A->Kids[0], B->Kids[j], Tol);
+      MulAdd(B->Kids[2+j], A->Kids[2], B->Kids[j], -1.0, Tol);
+      HLowerSolveBlock(A->Kids[3], B->Kids[2+j], Tol);
+    };
+}
+
+void HUpperSolveRightBlock(CBMBlock *A, CBMBlock *B, double Tol)
+{
+  if (B->Type==CBM_DENSE)
+   HUpperSolveRight(A, B->D);
+  else if (B->Type==CBM_LOWRANK)
+   { if (B->VT) HUpperSolveRight(A, B->VT); }
+  else
+   for(int i=0; i<2; i++)
+    { HUpperSolveRightBlock(A->Kids[0], B->Kids[2*i], Tol);
+      MulAdd(B->Kids[2*i+1], B->Kids[2*i], A->Kids[1], -1.0, Tol);
+      HUpperSolveRightBlock(A->Kids[3], B->Kids[2*i+1], Tol);
+    };
+}
+
+/***************************************************************/
+/* replace diagonal block A with its H-LU factorization:       */
+/*  A00 = P0 L00 U00                                           */
+/*  A01 <- L00^{-1} P0^T A01                                   */
+/*  A10 <- A10 U00^{-1}                                        */
+/*  A11 <- A11 - A10*A01, then factorize                       */
+/* returns nonzero (LAPACK info > 0) if a block was singular.  */
+/***************************************************************/
+int HLUFactorize(CBMBlock *A, double Tol)
+{
+  if (A->Type==CBM_DENSE)
+   return A->D->LUFactorize();
+
+  int Info=HLUFactorize(A->Kids[0], Tol);
+  HLowerSolveBlock(A->Kids[0], A->Kids[1], Tol);
+  HUpperSolveRightBlock(A->Kids[0], A->Kids[2], Tol);
+  MulAdd(A->Kids[3], A->Kids[2], A->Kids[1], -1.0, Tol);
+  int Info1=HLUFactorize(A->Kids[3], Tol);
+  return Info ? Info : Info1;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+CompressedBEMMatrix::CompressedBEMMatrix(RWGGeometry *_G, double _ACATol, int _LeafSize)
+ : G(_G), ACATol(_ACATol), LeafSize(_LeafSize)
+{
+  if (G->LDim>0)
+   ErrExit("compressed BEM matrices not supported for periodic geometries");
+  if (G->Substrate)
+   ErrExit("compressed BEM matrices not supported for geometries with substrates");
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   if (G->Surfaces[ns]->SurfaceZeta)
+    ErrExit("compressed BEM matrices not supported for surfaces with finite conductivity");
+  if (RWGGeometry::UseHRWGFunctions && G->NumMMJs>0)
+   ErrExit("compressed BEM matrices not supported for multi-material junctions");
+
+  Eta=CBM_DEFAULT_ETA;
+  CheckEnv("SCUFF_CBM_LEAFSIZE", &LeafSize);
+  CheckEnv("SCUFF_CBM_ACATOL",   &ACATol);
+  CheckEnv("SCUFF_CBM_ETA",      &Eta);
+  if (LeafSize<=0) LeafSize=CBM_DEFAULT_LEAFSIZE;
+  if (ACATol<=0.0) ACATol=CBM_DEFAULT_ACATOL;
+  if (Eta<=0.0)    Eta=CBM_DEFAULT_ETA;
+
+  N=G->TotalBFs;
+  Factorized=false;
+  Perm=(int *)mallocEC(N*sizeof(int));
+
+  int NS=G->NumSurfaces;
+  CBMData *CD = new CBMData;
+  CD->Root=0;
+  CD->RootBlock=0;
+  CD->NumLevels=0;
+  CD->BFSurface        = (int *)mallocEC(3*N*sizeof(int));
+  CD->BFEdge           = CD->BFSurface + N;
+  CD->BFKN             = CD->BFSurface + 2*N;
+  CD->NS               = NS;
+  CD->NumCommonRegions = (int *)mallocEC(NS*NS*sizeof(int));
+  CD->k                = (cdouble *)mallocEC(4*2*NS*NS*sizeof(cdouble));
+  CD->PreFac1          = CD->k + 2*NS*NS;
+  CD->PreFac2          = CD->k + 4*NS*NS;
+  CD->PreFac3          = CD->k + 6*NS*NS;
+  Data=(void *)CD;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+static void DestroyTrees(CBMData *CD)
+{
+  for(size_t nb=0; nb<CD->Blocks.size(); nb++)
+   DestroyBlock(CD->Blocks[nb]);
+  CD->Blocks.clear();
+  CD->RootBlock=0;
+  for(size_t nc=0; nc<CD->Clusters.size(); nc++)
+   free(CD->Clusters[nc]);
+  CD->Clusters.clear();
+  CD->Root=0;
+  CD->NumLevels=0;
+}
+
+CompressedBEMMatrix::~CompressedBEMMatrix()
+{
+  CBMData *CD=(CBMData *)Data;
+  DestroyTrees(CD);
+  free(CD->BFSurface);
+  free(CD->NumCommonRegions);
+  free(CD->k);
+  delete CD;
+  free(Perm);
+}
+
+/***************************************************************/
+/* (re)build the cluster and block trees and fill in all dense */
+/* and low-rank blocks at frequency Omega. The trees are       */
+/* rebuilt on every call so that geometrical transformations   */
+/* applied since the last call are accounted for.              */
+/***************************************************************/
+void CompressedBEMMatrix::Assemble(cdouble Omega)
+{
+  CBMData *CD=(CBMData *)Data;
+  double Time0=Secs();
+
+  /*--------------------------------------------------------------*/
+  /*- build the cluster tree and the block tree ------------------*/
+  /*--------------------------------------------------------------*/
+  DestroyTrees(CD);
+
+  std::vector<CBMEdge> Edges;
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   for(int ne=0; ne<G->Surfaces[ns]->NumEdges; ne++)
+    { CBMEdge E;
+      RWGEdge *RE = G->Surfaces[ns]->Edges[ne];
+      memcpy(E.X, RE->Centroid, 3*sizeof(double));
+      E.Radius=RE->Radius;
+      E.ns=ns;
+      E.ne=ne;
+      Edges.push_back(E);
+    };
+  int Offset=0;
+  CD->Root=BuildCluster(G, CD, Edges, 0, Edges.size(), &Offset, 0, LeafSize);
+  for(int np=0; np<N; np++)
+   { int ns=CD->BFSurface[np], ne=CD->BFEdge[np];
+     Perm[np] = G->BFIndexOffset[ns] + (G->Surfaces[ns]->IsPEC ? ne : 2*ne + CD->BFKN[np]);
+   };
+  CD->RootBlock=BuildBlock(CD, CD->Root, CD->Root, Eta);
+
+  /*--------------------------------------------------------------*/
+  /*- precompute region data for all surface pairs               -*/
+  /*--------------------------------------------------------------*/
+  G->UpdateCachedEpsMuValues(Omega);
+  int NS=CD->NS;
+  for(int nsa=0; nsa<NS; nsa++)
+   for(int nsb=0; nsb<NS; nsb++)
+    { int nsab=nsa*NS+nsb, CRIndices[2];
+      double Signs[2];
+      CD->NumCommonRegions[nsab]
+       =CountCommonRegions(G->Surfaces[nsa], G->Surfaces[nsb], CRIndices, Signs);
+      for(int nr=0; nr<CD->NumCommonRegions[nsab]; nr++)
+       { cdouble Eps = G->EpsTF[ CRIndices[nr] ];
+         cdouble Mu  = G->MuTF[ CRIndices[nr] ];
+         int Index   = 2*nsab + nr;
+         CD->k[Index]       = csqrt2(Eps*Mu)*Omega;
+         CD->PreFac1[Index] =  Signs[nr]*II*Mu*Omega;
+         CD->PreFac2[Index] = -Signs[nr]*II*CD->k[Index];
+         CD->PreFac3[Index] = -Signs[nr]*II*Eps*Omega;
+       };
+    };
+
+  /*--------------------------------------------------------------*/
+  /*- fill in the dense and low-rank blocks on and above the     -*/
+  /*- diagonal in parallel. The BEM matrix of a compact geometry -*/
+  /*- is symmetric, so the blocks below the diagonal are the     -*/
+  /*- transposes of their mirror images.                         -*/
+  /*--------------------------------------------------------------*/
+  std::vector<CBMBlock *> Upper, Lower;
+  std::map< std::pair<CBMCluster *, CBMCluster *>, CBMBlock *> BlockMap;
+  for(size_t nb=0; nb<CD->Blocks.size(); nb++)
+   { CBMBlock *B=CD->Blocks[nb];
+     if (B->Type==CBM_HIER) continue;
+     if (B->RC->Offset <= B->CC->Offset)
+      { Upper.push_back(B);
+        BlockMap[ std::make_pair(B->RC, B->CC) ] = B;
+      }
+     else
+      Lower.push_back(B);
+   };
+
+  Log("Assembling compressed BEM matrix at Omega=%s (%i clusters, %i levels, %i blocks)",
+       z2s(Omega),CD->Clusters.size(),CD->NumLevels,CD->Blocks.size());
+  int NumUpper=Upper.size();
+  int NumThreads=GetNumThreads();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int nb=0; nb<NumUpper; nb++)
+   {
+     CBMBlock *B=Upper[nb];
+     GetEEIArgStruct MyEEIArgs, *EEIArgs=&MyEEIArgs;
+     InitGetEEIArgs(EEIArgs);
+
+     CBMCluster *RC=B->RC, *CC=B->CC;
+     if (B->Type==CBM_DENSE)
+      { B->D = new HMatrix(RC->NumBFs, CC->NumBFs, LHM_COMPLEX);
+        GetCBMBlock(CD, EEIArgs, G, RC->Offset, RC->NumBFs, CC->Offset, CC->NumBFs,
+                    B->D->ZM, RC->NumBFs);
+      }
+     else
+      { ACABlock(CD, EEIArgs, G, RC->Offset, RC->NumBFs, CC->Offset, CC->NumBFs,
+                 ACATol, &(B->U), &(B->VT));
+        Truncate(&(B->U), &(B->VT), ACATol);
+        DensifyIfCheaper(B);
+      };
+   };
+
+  for(size_t nb=0; nb<Lower.size(); nb++)
+   { CBMBlock *B=Lower[nb];
+     CBMBlock *BT=BlockMap[ std::make_pair(B->CC, B->RC) ];
+     if (BT==0)
+      ErrExit("%s:%i: internal error",__FILE__,__LINE__);
+     B->Type=BT->Type;
+     if (B->Type==CBM_DENSE)
+      { B->D = new HMatrix(BT->D);
+        B->D->Transpose();
+      }
+     else if (BT->U)
+      { B->U  = new HMatrix(BT->VT); B->U->Transpose();
+        B->VT = new HMatrix(BT->U);  B->VT->Transpose();
+      };
+   };
+  Factorized=false;
+
+  /*--------------------------------------------------------------*/
+  /*- report statistics ------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  int MaxRank=0, NumDense=0, NumLowRank=0;
+  double AvgRank=0.0;
+  for(size_t nb=0; nb<CD->Blocks.size(); nb++)
+   { CBMBlock *B=CD->Blocks[nb];
+     if (B->Type==CBM_DENSE) NumDense++;
+     if (B->Type!=CBM_LOWRANK) continue;
+     int Rank = B->U ? B->U->NC : 0;
+     if (Rank>MaxRank) MaxRank=Rank;
+     AvgRank+=Rank;
+     NumLowRank++;
+   };
+  if (NumLowRank>0) AvgRank/=NumLowRank;
+  Log("...assembled in %.1f s: %i dense, %i low-rank blocks (ranks avg %.1f, max %i); compression %.2f %%",
+       Secs()-Time0, NumDense, NumLowRank, AvgRank, MaxRank, 100.0*GetCompressionRatio());
+}
+
+/***************************************************************/
+/* H-LU factorization in place, with low-rank blocks updated   */
+/* by truncated arithmetic to tolerance ACATol.                */
+/***************************************************************/
+int CompressedBEMMatrix::LUFactorize()
+{
+  if (Factorized)
+   ErrExit("%s:%i: compressed matrix is already factorized (reassemble first)",__FILE__,__LINE__);
+
+  CBMData *CD=(CBMData *)Data;
+  double Time0=Secs();
+  int Info=HLUFactorize(CD->RootBlock, ACATol);
+  Factorized=true;
+  Log("Factorized compressed BEM matrix in %.1f s (compression %.2f %%)",
+       Secs()-Time0, 100.0*GetCompressionRatio());
+  return Info;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int CompressedBEMMatrix::LUSolve(HMatrix *X)
+{
+  if (!Factorized)
+   ErrExit("%s:%i: LUSolve called on unfactorized compressed matrix",__FILE__,__LINE__);
+  if (X->NR!=N || X->RealComplex!=LHM_COMPLEX)
+   ErrExit("%s:%i: invalid matrix passed to LUSolve",__FILE__,__LINE__);
+
+  CBMData *CD=(CBMData *)Data;
+  HMatrix *XP=new HMatrix(N, X->NC, LHM_COMPLEX);
+  for(int nc=0; nc<X->NC; nc++)
+   for(int np=0; np<N; np++)
+    XP->SetEntry(np, nc, X->GetEntry(Perm[np], nc));
+  HLowerSolve(CD->RootBlock, XP);
+  HUpperSolve(CD->RootBlock, XP);
+  for(int nc=0; nc<X->NC; nc++)
+   for(int np=0; np<N; np++)
+    X->SetEntry(Perm[np], nc, XP->GetEntry(np, nc));
+  delete XP;
+  return 0;
+}
+
+int CompressedBEMMatrix::LUSolve(HVector *X)
+{
+  if (X->RealComplex!=LHM_COMPLEX)
+   ErrExit("%s:%i: invalid vector passed to LUSolve",__FILE__,__LINE__);
+  HMatrix XMatrix(X->N, 1, X->ZV);
+  return LUSolve(&XMatrix);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void CompressedBEMMatrix::Apply(HMatrix *X, HMatrix *Y)
+{
+  if (Factorized)
+   ErrExit("%s:%i: Apply called on factorized compressed matrix",__FILE__,__LINE__);
+  if (X->NR!=N || Y->NR!=N || X->NC!=Y->NC)
+   ErrExit("%s:%i: dimension mismatch",__FILE__,__LINE__);
+
+  CBMData *CD=(CBMData *)Data;
+  HMatrix *XP=new HMatrix(N, X->NC, LHM_COMPLEX);
+  HMatrix *YP=new HMatrix(N, X->NC, LHM_COMPLEX);
+  for(int nc=0; nc<X->NC; nc++)
+   for(int np=0; np<N; np++)
+    XP->SetEntry(np, nc, X->GetEntry(Perm[np], nc));
+  HApply(CD->RootBlock, XP, YP);
+  for(int nc=0; nc<X->NC; nc++)
+   for(int np=0; np<N; np++)
+    Y->SetEntry(Perm[np], nc, YP->GetEntry(np, nc));
+  delete XP;
+  delete YP;
+}
+
+void CompressedBEMMatrix::Apply(HVector *X, HVector *Y)
+{
+  if (X->RealComplex!=LHM_COMPLEX || Y->RealComplex!=LHM_COMPLEX)
+   ErrExit("%s:%i: invalid vector passed to Apply",__FILE__,__LINE__);
+  HMatrix XMatrix(X->N, 1, X->ZV);
+  HMatrix YMatrix(Y->N, 1, Y->ZV);
+  Apply(&XMatrix, &YMatrix);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+double CompressedBEMMatrix::GetCompressionRatio()
+{
+  CBMData *CD=(CBMData *)Data;
+  double NumEntries=0.0;
+  for(size_t nb=0; nb<CD->Blocks.size(); nb++)
+   { CBMBlock *B=CD->Blocks[nb];
+     if (B->D)
+      NumEntries += ((double)B->D->NR)*((double)B->D->NC);
+     if (B->U)
+      NumEntries += ((double)B->U->NC)*((double)(B->U->NR + B->VT->NC));
+   };
+  return NumEntries / ( ((double)N)*((double)N) );
+}
+
+/***************************************************************/
+/* RWGGeometry entry points, paralleling the dense versions    */
+/***************************************************************/
+CompressedBEMMatrix *RWGGeometry::AllocateCompressedBEMMatrix(double ACATol)
+{
+  return new CompressedBEMMatrix(this, ACATol);
+}
+
+CompressedBEMMatrix *RWGGeometry::AssembleCompressedBEMMatrix(cdouble Omega, CompressedBEMMatrix *M)
+{
+  if (M==0)
+   M=AllocateCompressedBEMMatrix();
+  M->Assemble(Omega);
+  return M;
+}
+
+} // namespace scuff
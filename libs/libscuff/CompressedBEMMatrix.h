@@ -0,0 +1,106 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * CompressedBEMMatrix.h -- definitions for the hierarchically-compressed
+ *                       -- (H-matrix) representation of the BEM matrix
+ */
+
+#ifndef COMPRESSED_BEM_MATRIX_H
+#define COMPRESSED_BEM_MATRIX_H
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include <libhmat.h>
+
+namespace scuff {
+
+class RWGGeometry; // forward declaration
+
+#define CBM_DEFAULT_ACATOL   1.0e-4
+#define CBM_DEFAULT_LEAFSIZE 256
+#define CBM_DEFAULT_ETA      2.0
+
+/***************************************************************/
+/* A CompressedBEMMatrix stores the BEM matrix of a compact    */
+/* geometry as a hierarchical (H-) matrix: basis functions are */
+/* sorted into a binary cluster tree by recursive bisection of */
+/* the cloud of edge centroids, and the matrix is subdivided   */
+/* into a tree of blocks coupling pairs of clusters. A block   */
+/* whose clusters are well separated,                          */
+/*                                                             */
+/*  min(diam(C1), diam(C2)) <= Eta * dist(C1, C2),             */
+/*                                                             */
+/* (with diameters and distances computed from the bounding    */
+/* spheres of the clusters) is stored as low-rank factors U*VT */
+/* computed by adaptive cross approximation (ACA) and          */
+/* recompressed to relative tolerance ACATol; other blocks are */
+/* subdivided further, down to dense blocks at the leaves of   */
+/* the cluster tree.                                           */
+/*                                                             */
+/* LUFactorize() overwrites the blocks with an H-LU            */
+/* factorization computed in truncated arithmetic; thereafter  */
+/* LUSolve() replaces its argument with the solution of the    */
+/* BEM system, exactly as for the dense HMatrix routines of    */
+/* the same names, but Apply() is no longer available until    */
+/* the matrix is reassembled.                                  */
+/*                                                             */
+/* LeafSize, ACATol, and Eta may be overridden by the          */
+/* environment variables SCUFF_CBM_LEAFSIZE, SCUFF_CBM_ACATOL, */
+/* and SCUFF_CBM_ETA.                                          */
+/***************************************************************/
+class CompressedBEMMatrix
+ {
+public:
+   CompressedBEMMatrix(RWGGeometry *G, double ACATol=CBM_DEFAULT_ACATOL,
+                       int LeafSize=CBM_DEFAULT_LEAFSIZE);
+   ~CompressedBEMMatrix();
+
+   void Assemble(cdouble Omega);
+   int LUFactorize();
+   int LUSolve(HVector *X);
+   int LUSolve(HMatrix *X);
+
+   // Y = M*X, with M the (unfactorized) BEM matrix
+   void Apply(HVector *X, HVector *Y);
+   void Apply(HMatrix *X, HMatrix *Y);
+
+   // number of stored matrix entries relative to the dense matrix
+   double GetCompressionRatio();
+
+// private data fields
+// private:
+   RWGGeometry *G;
+   int N;
+   double ACATol;
+   int LeafSize;
+   double Eta;
+   bool Factorized;
+
+   // Perm[np] is the index within the usual BEM system vector
+   // of the npth basis function in cluster-tree ordering
+   int *Perm;
+
+   void *Data;
+ };
+
+} // namespace scuff
+#endif // #ifndef COMPRESSED_BEM_MATRIX_H
@@ -44,6 +44,82 @@ namespace scuff {
 // DBFTHRESHOLD * the larger of the radii of the two basis functions
 #define DBFTHRESHOLD 10.0
 
+/***************************************************************/
+/* batched version of GetEdgeEdgeInteractions() for several    */
+/* wavenumbers at once (Args->NumKs>0). each of the (up to)    */
+/* four panel-panel interactions is computed for all           */
+/* wavenumbers in a single call, so the panel lookup, vertex   */
+/* ordering, cubature points and FIPPI lookups are shared.     */
+/***************************************************************/
+static void GetBatchedEdgeEdgeInteractions(GetEEIArgStruct *Args)
+{
+  if (Args->NumGradientComponents>0 || Args->NumTorqueAxes>0)
+   ErrExit("%s:%i: derivatives not supported for batched EEIs",__FILE__,__LINE__);
+  if (Args->NumKs>PPI_MAXKS)
+   ErrExit("%s:%i: too many wavenumbers (%i)",__FILE__,__LINE__,Args->NumKs);
+
+  RWGSurface *Sa=Args->Sa, *Sb=Args->Sb;
+  RWGEdge *Ea=Sa->GetEdgeByIndex(Args->nea);
+  RWGEdge *Eb=Sb->GetEdgeByIndex(Args->neb);
+
+  GetPPIArgStruct MyGetPPIArgs, *GetPPIArgs=&MyGetPPIArgs;
+  InitGetPPIArgs(GetPPIArgs);
+  GetPPIArgs->Sa             = Sa;
+  GetPPIArgs->Sb             = Sb;
+  GetPPIArgs->opFC           = Args->opFC;
+  GetPPIArgs->Displacement   = Args->Displacement;
+  GetPPIArgs->ForceFullEwald = Args->ForceFullEwald;
+
+  /*--------------------------------------------------------------*/
+  /*- as in the unbatched case, interactions at k==0 are zero;    */
+  /*- KIndex[n] is the index in Args->Ks of the nth wavenumber    */
+  /*- that we actually compute                                    */
+  /*--------------------------------------------------------------*/
+  int KIndex[PPI_MAXKS], NumKs=0;
+  for(int nk=0; nk<Args->NumKs; nk++)
+   { Args->GCs[2*nk+0]=Args->GCs[2*nk+1]=0.0;
+     if ( real(Args->Ks[nk])==0.0 && imag(Args->Ks[nk])==0.0 )
+      continue;
+     GetPPIArgs->Ks[NumKs]   = Args->Ks[nk];
+     GetPPIArgs->GBAs[NumKs] = Args->GBAs[nk];
+     KIndex[NumKs++]         = nk;
+   };
+  GetPPIArgs->NumKs=NumKs;
+  if (NumKs==0)
+   return;
+
+  /*--------------------------------------------------------------*/
+  /*- positive-positive, positive-negative, etc. -----------------*/
+  /*--------------------------------------------------------------*/
+  int npa[2]={Ea->iPPanel, Ea->iMPanel}, iQa[2]={Ea->PIndex, Ea->MIndex};
+  int npb[2]={Eb->iPPanel, Eb->iMPanel}, iQb[2]={Eb->PIndex, Eb->MIndex};
+  cdouble H[18*PPI_MAXKS];
+  for(int ia=0; ia<2; ia++)
+   for(int ib=0; ib<2; ib++)
+    { if (npa[ia]==-1 || npb[ib]==-1) continue;
+      GetPPIArgs->npa = npa[ia];
+      GetPPIArgs->npb = npb[ib];
+      int nv = 3*iQa[ia] + iQb[ib];
+      GetPanelPanelInteractions(GetPPIArgs, 1<<nv, H);
+      double Sign = (ia==ib) ? 1.0 : -1.0;
+      for(int n=0; n<NumKs; n++)
+       { Args->GCs[2*KIndex[n]+0] += Sign*H[18*n + 2*nv + 0];
+         Args->GCs[2*KIndex[n]+1] += Sign*H[18*n + 2*nv + 1];
+         Args->PPIAlgorithmCount[GetPPIArgs->WhichAlgorithms[n]]++;
+       };
+    };
+
+  /*--------------------------------------------------------------*/
+  /*- assemble the final quantities ------------------------------*/
+  /*--------------------------------------------------------------*/
+  double GPreFac = Ea->Length*Eb->Length;
+  for(int n=0; n<NumKs; n++)
+   { int nk=KIndex[n];
+     Args->GCs[2*nk+0] *= GPreFac;
+     Args->GCs[2*nk+1] *= GPreFac / (II*Args->Ks[nk]);
+   };
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -63,6 +139,11 @@ void GetEdgeEdgeInteractions(GetEEIArgStruct *Args)
   RWGEdge *Ea=Sa->GetEdgeByIndex(nea);
   RWGEdge *Eb=Sb->GetEdgeByIndex(neb);
 
+  if (Args->NumKs>0)
+   { GetBatchedEdgeEdgeInteractions(Args);
+     return;
+   };
+
   /***************************************************************/
   /* Since this code doesn't work at DC anyway, we don't bother  */
   /* to compute the edge--edge interactions at k==0, but instead */
@@ -305,6 +386,7 @@ void InitGetEEIArgs(GetEEIArgStruct *Args)
   Args->Force=EEI_NOFORCE;
   Args->GBA=0;
   Args->ForceFullEwald=false;
+  Args->NumKs=0;
   memset(Args->PPIAlgorithmCount, 0, NUMPPIALGORITHMS*sizeof(unsigned));
 }
 
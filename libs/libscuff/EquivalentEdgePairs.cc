@@ -32,11 +32,17 @@
 #include <unistd.h>
 #include <set>
 #include <map>
+#include <vector>
+#include <algorithm>
 
 #ifdef HAVE_CONFIG_H
   #include "config.h"
 #endif
 
+#ifdef USE_OPENMP
+  #include <omp.h>
+#endif
+
 #include "EquivalentEdgePairs.h"
 #include "PanelCubature.h"
 
@@ -171,25 +177,6 @@ struct EdgePairHash
   };
 
 
-bool GetCanonicalPairIndices(int neaParent, int neaChild, int nebParent, int nebChild,
-                             EdgePair *ParentPair, EdgePair *ChildPair)
-{
-  //if (neaParent > neaChild)  { ISWAP(neaParent, neaChild); }
-  //if (nebParent > nebChild)  { ISWAP(nebParent, nebChild); }
-  bool Modified=false;
-  if (neaParent > nebParent) { ISWAP(neaParent, nebParent); Modified=true; }
-  if (neaChild > nebChild)   { ISWAP(neaChild, nebChild);   Modified=true; }
-
-  if ( neaParent>neaChild || (neaParent==neaChild && nebParent<nebChild) )
-   { Modified=true;
-     EdgePair *Temp=ParentPair; ParentPair=ChildPair; ChildPair=Temp;
-   }
-
-  ParentPair->nea = neaParent; ParentPair->neb = nebParent;
-  ChildPair->nea = neaChild; ChildPair->neb = nebChild;
-  return Modified;
-}
-
 /*****************************************************************/
 /* Part 2: Routines for detecting and collecting similar edges.  */
 /*  "Similarity" of edges is a coarse version of "equivalence".  */
@@ -220,35 +207,6 @@ EdgeSignature GetEdgeSignature(RWGSurface *S, int ne)
    return ES;
 }
 
-bool Less(EdgeSignature ES1, EdgeSignature ES2)
-{ for(int n=0; n<EDGESIGLEN; n++) 
-   if (ES1.Data[n] < ES2.Data[n]) 
-    return true;
-  return false;
-}
-
-// Given two edges {Ea,Eb}, this routine computes an inexpensive hash value H(Ea,Eb)
-// that is guaranteed to have the same value for all equivalent pairs, i.e. if
-// {Ea,Eb} <--> {EaPrime,EbPrime} then H(Ea,Eb) = H(EaPrime,EbPrime).
-long GetEdgePairHash(RWGSurface *Sa, int nea, RWGSurface *Sb, int neb)
-{
- // EdgePairData = (greater signature) + (lesser signature) + (centroid-centroid distance)
-  float EdgePairData[2*EDGESIGLEN + 1];
-
-  EdgeSignature ES[2];
-  ES[0] = GetEdgeSignature(Sa, nea);
-  ES[1] = GetEdgeSignature(Sb, neb);
-  int iLesser = ( Less(ES[0], ES[1]) ? 0 : 1 ), iGreater = 1-iLesser;
-  for(int n=0; n<EDGESIGLEN; n++)
-   { EdgePairData[0*EDGESIGLEN + n] = ES[iGreater].Data[n];
-     EdgePairData[1*EDGESIGLEN + n] = ES[iLesser].Data[n];
-   }
-  EdgePairData[2*EDGESIGLEN + 0] 
-   = Quantize(VecDistance(Sa->Edges[nea]->Centroid, Sb->Edges[neb]->Centroid), 1.0e-6);
-  long HashVal=scuff::JenkinsHash( (const char *)EdgePairData, sizeof(EdgePairData) ); return HashVal<0 ? -HashVal : HashVal;
-  return HashVal<0 ? -HashVal : HashVal;
-}
-
 /*****************************************************************/
 /* Part 3: Routines for characterizing equivalent edge pairs.    */
 /*****************************************************************/
@@ -349,10 +307,9 @@ typedef struct EquivalentEdgePairSubTable
  { RWGSurface *Sa, *Sb;
    ChildPairMap   Children;
    ParentPairMap  Parents;
-   EPSigMap       EPRepresentatives;
  } EquivalentEdgePairSubTable;
 
-void ExportEEPSubTable(EquivalentEdgePairSubTable *Table, const char *FileName)
+void ExportEEPSubTable(EquivalentEdgePairSubTable *Table, const char *FileName, long Key)
 {
   FILE *f = (!strcmp(FileName,"stdout") ? stdout : fopen(FileName,"w"));
   if (!f) 
@@ -361,6 +318,7 @@ void ExportEEPSubTable(EquivalentEdgePairSubTable *Table, const char *FileName)
    }
   fprintf(f,"%s %i \n",Table->Sa->MeshFileName,Table->Sa->NumEdges);
   fprintf(f,"%s %i \n",Table->Sb->MeshFileName,Table->Sb->NumEdges);
+  fprintf(f,"KEY %li \n",Key);
   for(ChildPairMap::iterator it=Table->Children.begin(); it!=Table->Children.end(); it++)
    { EdgePair ParentPair  = it->first;
      EdgePairSet Children = it->second;
@@ -370,7 +328,7 @@ void ExportEEPSubTable(EquivalentEdgePairSubTable *Table, const char *FileName)
         ChildrenBySign[SignPatternIndex]++;
       }
      fprintf(f,"#_%s_[%lu:%i,%i,%i,%i]\n",ParentPair.Str()+2,Children.size(),ChildrenBySign[0],ChildrenBySign[1],ChildrenBySign[2],ChildrenBySign[3]);
-     fprintf(f,"%s ",ParentPair.Str()+2);
+     fprintf(f,"%s ",ParentPair.Str());
      for(EdgePairSet::iterator p=Children.begin(); p!=Children.end(); p++)
        fprintf(f,"%s ",p->Str());
      fprintf(f,"\n");
@@ -397,24 +355,6 @@ bool ChildInTable(EquivalentEdgePairSubTable *Table, EdgePair ChildPair,
   return true;
 }
 
-bool PairInTable(EquivalentEdgePairSubTable *Table, EdgePair Pair,
-                 EdgePairSet **ChildPairs=0, EdgePair *ParentPair=0)
-{
-  if (ChildPairs) *ChildPairs=0;
-
-  ChildPairMap::iterator it1 = Table->Children.find(Pair);
-  if (it1!=Table->Children.end())
-   { if (ChildPairs) *ChildPairs = &(it1->second);
-     return true;
-   }
-  ParentPairMap::iterator it2 = Table->Parents.find(Pair);
-  if (it2!=Table->Parents.end())
-   { if (ParentPair) *ParentPair = it2->second;
-     return true;
-   }
-  return false;
-}
-
 void AddChildPair(EquivalentEdgePairSubTable *Table, EdgePair ParentPair, EdgePair ChildPair, EdgePairSet *ChildPairs=0)
 { 
   if (ChildPairs==0) ChildPairs = &(Table->Children[ParentPair]);
@@ -422,93 +362,299 @@ void AddChildPair(EquivalentEdgePairSubTable *Table, EdgePair ParentPair, EdgePa
   Table->Parents[ChildPair]=ParentPair;
 }
 
-void ReParent(EquivalentEdgePairSubTable *Table, EdgePair ExistingParentPair, EdgePair NewParentPair)
+/******************************************************************/
+/* Key identifying the geometry for which a table is valid. For a */
+/* surface paired with itself, equivalences are unaffected by     */
+/* rigid motions of the surface, so the key only involves         */
+/* quantities that are invariant under such motions; for pairs of */
+/* distinct surfaces the equivalences depend on the relative      */
+/* placement of the surfaces, so the key involves the vertex      */
+/* coordinates themselves.                                        */
+/******************************************************************/
+long GetEEPTableKey(RWGSurface *Sa, RWGSurface *Sb)
 {
-  EdgePairSet *OldChildPairs =&(Table->Children[ExistingParentPair]);
-  EdgePairSet NewChildPairs = EdgePairSet( *OldChildPairs ); 
-  for(EdgePairSet::iterator it=NewChildPairs.begin(); it!=NewChildPairs.end(); it++)
-   Table->Parents[*it]=NewParentPair;
-  Table->Children.erase(ExistingParentPair);
-  Table->Children[NewParentPair] = NewChildPairs;
-  AddChildPair(Table, NewParentPair, ExistingParentPair);
-
-  EdgePairSignature EPSig = GetEdgePairSignature(Table->Sa, NewParentPair.nea, Table->Sb, NewParentPair.neb);
-  Table->EPRepresentatives[EPSig]=NewParentPair;
+  long Key=0;
+  for(int ns=0; ns<(Sa==Sb ? 1 : 2); ns++)
+   { RWGSurface *S = (ns==0 ? Sa : Sb);
+     vector<float> Data;
+     Data.push_back( (float)S->NumEdges );
+     Data.push_back( (float)S->NumPanels );
+     for(int ne=0; ne<S->NumEdges; ne++)
+      { EdgeSignature ES=GetEdgeSignature(S, ne);
+        for(int n=0; n<EDGESIGLEN; n++)
+         Data.push_back( Quantize(ES.Data[n], 1.0e-6) );
+      }
+     if (Sa!=Sb)
+      for(int nv=0; nv<3*S->NumVertices; nv++)
+       Data.push_back( Quantize(S->Vertices[nv], 1.0e-6) );
+     Key = 31*Key + JenkinsHash( (const char *)&(Data[0]), Data.size()*sizeof(float) );
+   }
+  return Key<0 ? -Key : Key;
 }
 
-bool AddEquivalentPair(EquivalentEdgePairSubTable *Table, EdgePair ParentPair, EdgePair ChildPair)
+/******************************************************************/
+/* Read a table written by ExportEEPSubTable. Returns 0 if the    */
+/* file does not exist, cannot be parsed, or was written for a    */
+/* different geometry.                                            */
+/******************************************************************/
+EquivalentEdgePairSubTable *ImportEEPSubTable(RWGSurface *Sa, RWGSurface *Sb,
+                                              const char *FileName, long Key)
 {
-  if ( ParentPair.Equal(ChildPair) ) return false;
-
-  EdgePairSet *ChildrenOfParentInTable;
-  EdgePair ParentOfParentInTable;
-  bool ParentInTable=PairInTable(Table, ParentPair, &ChildrenOfParentInTable, &ParentOfParentInTable);
-  bool ParentInTableAsParent = ParentInTable && (ChildrenOfParentInTable != 0);
-  bool ParentInTableAsChild  = ParentInTable && !ParentInTableAsParent;
-
-  EdgePairSet *ChildrenOfChildInTable;
-  EdgePair ParentOfChildInTable;
-  bool ChildInTable=PairInTable(Table, ChildPair, &ChildrenOfChildInTable, &ParentOfChildInTable);
-  bool ChildInTableAsParent = ChildInTable && (ChildrenOfChildInTable != 0);
-
-  if (ParentInTable && ChildInTable)
-   return false;
-  else if (!ParentInTable && !ChildInTable)
-   AddChildPair(Table, ParentPair, ChildPair);
-  else if (ParentInTableAsParent)
-   AddChildPair(Table, ParentPair, ChildPair, ChildrenOfParentInTable);
-  else if (ParentInTableAsChild)
-   AddChildPair(Table, ParentOfParentInTable, ChildPair);
-  else // Child in table, either as parent or child
-   { EdgePair ParentPairInTable = ChildInTableAsParent ? ChildPair : ParentOfChildInTable;
-     if ( ParentPairInTable.LessThan(ParentPair) )
-      AddChildPair(Table, ParentPairInTable, ParentPair);
+  FILE *f=fopen(FileName,"r");
+  if (!f) return 0;
+
+  char Line[1000];
+  for(int n=0; n<3; n++)
+   { char LineShouldBe[1000];
+     if (n<2)
+      { RWGSurface *S = (n==0 ? Sa : Sb);
+        snprintf(LineShouldBe,1000,"%s %i \n",S->MeshFileName,S->NumEdges);
+      }
      else
-      ReParent(Table, ParentPairInTable, ParentPair);
+      snprintf(LineShouldBe,1000,"KEY %li \n",Key);
+     if ( !fgets(Line,1000,f) || strcmp(Line,LineShouldBe) )
+      { Log("edge-pair table file %s does not match geometry (ignoring)",FileName);
+        fclose(f);
+        return 0;
+      }
    }
-  return true;
+
+  EquivalentEdgePairSubTable *Table = new EquivalentEdgePairSubTable;
+  Table->Sa=Sa;
+  Table->Sb=Sb;
+
+  // the file is a sequence of whitespace-separated tokens; a token
+  // beginning with '#' announces a new parent pair, which is the
+  // next token, and all subsequent tokens are its children
+  char Token[100], s0, s1;
+  EdgePair ParentPair;
+  bool HaveParent=false, NextIsParent=false, Error=false;
+  while( fscanf(f," %99s",Token)==1 )
+   { if (Token[0]=='#')
+      { NextIsParent=true;
+        continue;
+      }
+     EdgePair Pair;
+     if (    sscanf(Token,"%c%c{%i,%i}",&s0,&s1,&(Pair.nea),&(Pair.neb))!=4
+          || Pair.nea<0 || Pair.nea>=Sa->NumEdges
+          || Pair.neb<0 || Pair.neb>=Sb->NumEdges
+          || (!NextIsParent && !HaveParent)
+        )
+      { Error=true;
+        break;
+      }
+     Pair.Signs.Flipped[GKERNEL]   = (s0=='-');
+     Pair.Signs.Flipped[IKCKERNEL] = (s1=='-');
+     if (NextIsParent)
+      { ParentPair=Pair;
+        Table->Children[ParentPair] = EdgePairSet(); // empty
+        HaveParent=true;
+        NextIsParent=false;
+      }
+     else
+      AddChildPair(Table, ParentPair, Pair);
+   }
+  fclose(f);
+
+  if (Error)
+   { Warn("%s: syntax error (ignoring edge-pair table file)",FileName);
+     delete Table;
+     return 0;
+   }
+  return Table;
 }
 
-bool AddEquivalentPair(EquivalentEdgePairSubTable *Table,
-                       int nea1, int nea2, int neb1, int neb2,
-                       bool *RearrangedIndices)
-{
-  EdgePair ParentPair, ChildPair;
-  bool Swapped=GetCanonicalPairIndices(nea1, nea2, neb1, neb2, &ParentPair, &ChildPair);
-  if (RearrangedIndices) *RearrangedIndices=Swapped;
-  return AddEquivalentPair(Table, ParentPair, ChildPair);
+/*****************************************************************/
+/* Part 5: Parallel construction of the table.                   */
+/*                                                               */
+/* Two edge pairs can only be equivalent if the edges of one     */
+/* pair are congruent to those of the other and the distances    */
+/* between the edge centroids agree. So we first sort all edges  */
+/* into classes of congruent edges (edges with equal quantized   */
+/* edge signatures), and then give each edge pair a key derived  */
+/* from the unordered pair of edge classes and the quantized     */
+/* centroid-centroid distance. This is a spatial hash of the     */
+/* edge pairs: only pairs with equal keys can be equivalent, so  */
+/* the expensive edge-pair signature is only computed for pairs  */
+/* that share their key with at least one other pair, and pairs  */
+/* of edges that both lie in singleton classes (which cannot     */
+/* have any equivalent pairs) are never even keyed.              */
+/*                                                               */
+/* Phase 1: the threads divide the rows of the edge-pair matrix  */
+/*          among themselves, compute keys, and deposit each     */
+/*          (key, pair) record in an outbox for the partition    */
+/*          that owns the key (key % NumPartitions).             */
+/* Phase 2: the threads divide the partitions among themselves;  */
+/*          each partition's records are sorted by key and pairs */
+/*          within runs of equal keys are compared. All pairs    */
+/*          that could be equivalent to one another land in the  */
+/*          same partition, so the subtables built for different */
+/*          partitions are disjoint and merging them is a simple */
+/*          union, with no locking needed anywhere.              */
+/*****************************************************************/
+struct EdgeSignatureCmp
+{ bool operator() (const EdgeSignature &ES1, const EdgeSignature &ES2) const
+   { for(int n=0; n<EDGESIGLEN; n++)
+      if (ES1.Data[n]!=ES2.Data[n])
+       return ES1.Data[n] < ES2.Data[n];
+     return false;
+   }
+};
+
+typedef struct EdgePairRecord
+ { unsigned long Key;
+   int nea, neb;
+ } EdgePairRecord;
+
+static bool RecordLess(const EdgePairRecord &R1, const EdgePairRecord &R2)
+{ if (R1.Key!=R2.Key) return R1.Key < R2.Key;
+  if (R1.nea!=R2.nea) return R1.nea < R2.nea;
+  return R1.neb < R2.neb;
 }
 
-void MergeEEPSubTables(EquivalentEdgePairSubTable *Tree,
-                       EquivalentEdgePairSubTable *Branch)
+// assign each edge to a class of congruent edges. edges are
+// indexed by ne for edges of Sa, and by NEA+ne for edges of Sb
+// if Sb is distinct from Sa.
+static void GetEdgeClasses(RWGSurface *Sa, RWGSurface *Sb, float Unit,
+                           iVec &Classes, iVec &ClassSizes)
 {
-  for(ChildPairMap::iterator it=Branch->Children.begin(); it!=Branch->Children.end(); it++)
-   { 
-     EdgePair BranchParentPair     = it->first;
-     EdgePairSet *BranchChildPairs = &(it->second);
-
-     int neaBranch, nebBranch; BranchParentPair.Resolve(&neaBranch, &nebBranch);
-     EdgePairSignature BranchEPSig = GetEdgePairSignature(Tree->Sa, neaBranch, Tree->Sb, nebBranch);
-     EdgePair TreeParentPair = BranchParentPair;
-     EPSigMap::iterator TreeRepresentative = Tree->EPRepresentatives.find(BranchEPSig);
-     if (TreeRepresentative!=Tree->EPRepresentatives.end())
-      { 
-        TreeParentPair = TreeRepresentative->second;
-        if (BranchParentPair.LessThan(TreeParentPair))
-         { ReParent(Tree, TreeParentPair, BranchParentPair);
-           TreeParentPair=BranchParentPair;
+  map<EdgeSignature, int, EdgeSignatureCmp> ClassMap;
+  for(int ns=0; ns<(Sa==Sb ? 1 : 2); ns++)
+   { RWGSurface *S = (ns==0 ? Sa : Sb);
+     for(int ne=0; ne<S->NumEdges; ne++)
+      { EdgeSignature ES = GetEdgeSignature(S, ne);
+        for(int n=0; n<EDGESIGLEN; n++)
+         ES.Data[n] = Quantize(ES.Data[n], Unit);
+        map<EdgeSignature, int, EdgeSignatureCmp>::iterator it=ClassMap.find(ES);
+        int Class;
+        if (it==ClassMap.end())
+         { Class = ClassMap.size();
+           ClassMap[ES] = Class;
+           ClassSizes.push_back(0);
          }
+        else
+         Class = it->second;
+        Classes.push_back(Class);
+        ClassSizes[Class]++;
       }
+   }
+}
+
+static unsigned long GetEdgePairKey(int ClassA, int ClassB, float Distance)
+{ struct { int C1, C2; float D; } KeyData;
+  KeyData.C1 = ClassA < ClassB ? ClassA : ClassB;
+  KeyData.C2 = ClassA < ClassB ? ClassB : ClassA;
+  KeyData.D  = Distance;
+  return (unsigned long)JenkinsHash( (const char *)&KeyData, sizeof(KeyData) );
+}
+
+static void ProcessEdgePairRun(EquivalentEdgePairSubTable *Table,
+                               EdgePairRecord *Records, int NumRecords)
+{
+  EPSigMap Representatives;
+  for(int nr=0; nr<NumRecords; nr++)
+   { EdgePair Pair(Records[nr].nea, Records[nr].neb);
+     EdgePairSignature EPSig = GetEdgePairSignature(Table->Sa, Pair.nea, Table->Sb, Pair.neb, &(Pair.Signs));
+     EPSigMap::iterator Representative = Representatives.find(EPSig);
+     if (Representative==Representatives.end())
+      Representatives[EPSig]=Pair;
      else
-      Tree->EPRepresentatives[BranchEPSig]=BranchParentPair;
-     
-     for(EdgePairSet::iterator ChildPair=BranchChildPairs->begin(); ChildPair!=BranchChildPairs->end(); ChildPair++)
-      AddEquivalentPair(Tree, TreeParentPair, *ChildPair);
+      AddChildPair(Table, Representative->second, Pair);
+   }
+}
+
+EquivalentEdgePairSubTable *BuildEEPSubTable(RWGSurface *Sa, RWGSurface *Sb, int NumThreads)
+{
+  int NEA=Sa->NumEdges, NEB=Sb->NumEdges;
+  bool SameSurface = (Sa==Sb);
+
+  /*--------------------------------------------------------------*/
+  /*- classify edges; quantities are quantized in units of       -*/
+  /*- EEPRelTol times the average edge length                    -*/
+  /*--------------------------------------------------------------*/
+  double AvgLength=0.0;
+  for(int ne=0; ne<NEA; ne++)
+   AvgLength += Sa->Edges[ne]->Length / ((double)NEA);
+  float Unit = (float)(EEPRelTol*AvgLength);
 
-     if ( !TreeParentPair.Equal(BranchParentPair) )
-      AddEquivalentPair(Tree, TreeParentPair, BranchParentPair);
+  iVec Classes, ClassSizes;
+  GetEdgeClasses(Sa, Sb, Unit, Classes, ClassSizes);
+  int OffsetB = SameSurface ? 0 : NEA;
+
+  /*--------------------------------------------------------------*/
+  /*- phase 1: key all candidate pairs ---------------------------*/
+  /*--------------------------------------------------------------*/
+  int NumPartitions = (NumThreads==1 ? 1 : 8*NumThreads);
+  vector< vector< vector<EdgePairRecord> > > Outboxes(NumThreads);
+  for(int nt=0; nt<NumThreads; nt++)
+   Outboxes[nt].resize(NumPartitions);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int nea=0; nea<NEA; nea++)
+   { 
+     int nt=0;
+#ifdef USE_OPENMP
+     nt = omp_get_thread_num();
+#endif
+     int ClassA = Classes[nea];
+     double *XA = Sa->Edges[nea]->Centroid;
+     for(int neb=(SameSurface ? nea : 0); neb<NEB; neb++)
+      { int ClassB = Classes[OffsetB + neb];
+        if ( ClassSizes[ClassA]==1 && ClassSizes[ClassB]==1 ) 
+         continue;
+        float Distance = Quantize( VecDistance(XA, Sb->Edges[neb]->Centroid), Unit);
+        EdgePairRecord Record;
+        Record.Key = GetEdgePairKey(ClassA, ClassB, Distance);
+        Record.nea = nea;
+        Record.neb = neb;
+        Outboxes[nt][Record.Key % NumPartitions].push_back(Record);
+      }
+   }
+
+  /*--------------------------------------------------------------*/
+  /*- phase 2: compare pairs with equal keys ---------------------*/
+  /*--------------------------------------------------------------*/
+  vector<EquivalentEdgePairSubTable *> SubTables(NumPartitions);
+  size_t NumCandidates=0, NumSignatures=0;
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads), reduction(+:NumCandidates,NumSignatures)
+#endif
+  for(int np=0; np<NumPartitions; np++)
+   { 
+     vector<EdgePairRecord> Records;
+     for(int nt=0; nt<NumThreads; nt++)
+      { Records.insert(Records.end(), Outboxes[nt][np].begin(), Outboxes[nt][np].end());
+        vector<EdgePairRecord>().swap(Outboxes[nt][np]);
+      }
+     std::sort(Records.begin(), Records.end(), RecordLess);
+     NumCandidates+=Records.size();
+
+     EquivalentEdgePairSubTable *Table = SubTables[np] = new EquivalentEdgePairSubTable;
+     Table->Sa=Sa;
+     Table->Sb=Sb;
+     for(size_t Start=0, Stop=0; Start<Records.size(); Start=Stop)
+      { for(Stop=Start+1; Stop<Records.size() && Records[Stop].Key==Records[Start].Key; Stop++)
+         ;
+        if (Stop-Start < 2) continue;
+        ProcessEdgePairRun(Table, &(Records[Start]), Stop-Start);
+        NumSignatures += Stop-Start;
+      }
    }
-  delete Branch;
+  Log(" %i edge classes; %lu candidate pairs, %lu edge-pair signatures computed",
+        (int)ClassSizes.size(), NumCandidates, NumSignatures);
+
+  /*--------------------------------------------------------------*/
+  /*- merge the (disjoint) subtables -----------------------------*/
+  /*--------------------------------------------------------------*/
+  EquivalentEdgePairSubTable *Table = SubTables[0];
+  for(int np=1; np<NumPartitions; np++)
+   { Table->Children.insert(SubTables[np]->Children.begin(), SubTables[np]->Children.end());
+     Table->Parents.insert(SubTables[np]->Parents.begin(), SubTables[np]->Parents.end());
+     delete SubTables[np];
+   }
+  return Table;
 }
 
 /******************************************************************/
@@ -527,76 +673,35 @@ EquivalentEdgePairTable::EquivalentEdgePairTable(RWGGeometry *_G, int _nsa, int
   //double DistanceQuantum=0.1*GetMinPanelRadius(G);
 
   // try to import table from file
-#if 1
-(void) EEPTFileName;
-#else
+  Key = GetEEPTableKey(Sa, Sb);
   if (EEPTFileName)
-   { char *ErrMsg=Import(EEPTFileName);
-     if (ErrMsg) 
-      Warn(ErrMsg);
-     else
-      { Log("successfully read EEPTable from file %s",EEPTFileName);
+   { EquivalentEdgePairSubTable *Table=ImportEEPSubTable(Sa, Sb, EEPTFileName, Key);
+     if (Table)
+      { Log("Read edge-pair table for surfaces (%i,%i) from file %s (%lu parents, %lu children)",
+             nsa,nsb,EEPTFileName,Table->Children.size(),Table->Parents.size());
+        MasterTable = (void *)Table;
         return;
       }
    }
-#endif
 
   int NumThreads = GetNumThreads();
-  vector<EquivalentEdgePairSubTable *> BranchTables(NumThreads);
-  for(int nt=0; nt<NumThreads; nt++)
-   { BranchTables[nt] = new EquivalentEdgePairSubTable;
-     BranchTables[nt]->Sa = G->Surfaces[nsa];
-     BranchTables[nt]->Sb = G->Surfaces[nsb];
-   }
-
   Log("Identifying equivalent pairs (%i threads...)",NumThreads);
-#ifdef USE_OPENMP
-#pragma omp parallel for num_threads(NumThreads)
-#endif
-  for(int nt=0; nt<NumThreads; nt++)
-   for(int nea=0; nea<Sa->NumEdges; nea++)
-    for(int neb=((nsa==nsb) ? nea: 0); neb<Sb->NumEdges; neb++)
-     {
-       int nTask = GetEdgePairHash(Sa, nea, Sb, neb) % NumThreads;
-       if (nt != nTask) continue;
-
-       EdgePair Pair(nea, neb);
-       if (ChildInTable(BranchTables[nt],Pair)) continue;
-
-       EdgePairSignature EPSig           = GetEdgePairSignature(Sa, nea, Sb, neb, &(Pair.Signs));
-       EPSigMap::iterator Representative = BranchTables[nt]->EPRepresentatives.find(EPSig);
-       if (Representative==BranchTables[nt]->EPRepresentatives.end())
-        { BranchTables[nt]->EPRepresentatives[EPSig]=Pair;
-          BranchTables[nt]->Children[Pair] = EdgePairSet(); // empty
-        }
-       else
-        { EdgePair TablePair = Representative->second;
-          AddEquivalentPair(BranchTables[nt], TablePair, Pair);
-        }
-     }
-
-  for(int nt=0; nt<NumThreads; nt++)
-   { int NumParentPairs      = BranchTables[nt]->Children.size();
-     int NumChildPairs       = BranchTables[nt]->Parents.size();
-     Log("Thread %i: %i/%i parents/children",nt,NumParentPairs,NumChildPairs);
-     if (nt==0) continue;
-     MergeEEPSubTables(BranchTables[0], BranchTables[nt]);
-   }
-   
- // FIXME
- // Log("Before pruning: %lu parents",BranchTables[0]->Children.size());
- // for(ChildPairMap::iterator it=BranchTables[0]->Children.begin(); it!=BranchTables[0]->Children.end(); it++)
- // if ( it->second.size() == 0)
- //   BranchTables[0]->Children.erase(it);
- // Log("After pruning: %lu parents",BranchTables[0]->Children.size());
+  EquivalentEdgePairSubTable *Table = BuildEEPSubTable(Sa, Sb, NumThreads);
 
   int NEPairs = (nsa==nsb ? NEA*(NEA+1)/2 : NEA*NEB);
-  int NumParentPairs     = BranchTables[0]->Children.size();
-  int NumChildPairs      = BranchTables[0]->Parents.size();
+  int NumParentPairs     = Table->Children.size();
+  int NumChildPairs      = Table->Parents.size();
   Log(" Of %i total edge-edge pairs on surfaces (%i,%i) (%s,%s):",NEPairs,nsa,nsb,Sa->Label,Sb->Label);
   Log("    %i are children (savings of %.0f %%)",NumChildPairs,100.0*((double)NumChildPairs)/((double)NEPairs));
   Log("    %i are parents (%.1f %%)",NumParentPairs, 100.0*((double)NumParentPairs) / ((double)NEPairs));
-  MasterTable = (void *)BranchTables[0];
+  MasterTable = (void *)Table;
+
+  if (EEPTFileName)
+   Export(EEPTFileName);
+}
+
+EquivalentEdgePairTable::~EquivalentEdgePairTable()
+{ delete (EquivalentEdgePairSubTable *)MasterTable;
 }
 
 /***************************************************************/
@@ -656,7 +761,7 @@ char *GetStandardEEPTFilePath(RWGSurface *Sa, RWGSurface *Sb)
   if ( !strcmp(Sa->MeshFileName, Sb->MeshFileName) )
    snprintf(Path,1000,"%s/%s.EEPTable",Dir,GetFileBase(Sa->MeshFileName));
   else
-   snprintf(Path,100,"%s/%s_%s.EEPTable",Dir,GetFileBase(Sa->MeshFileName),GetFileBase(Sb->MeshFileName));
+   snprintf(Path,1000,"%s/%s_%s.EEPTable",Dir,GetFileBase(Sa->MeshFileName),GetFileBase(Sb->MeshFileName));
   return Path;
 }
 
@@ -665,104 +770,9 @@ char *GetStandardEEPTFilePath(RWGSurface *Sa, RWGSurface *Sb)
 /***************************************************************/
 void EquivalentEdgePairTable::Export(const char *FileName)
 { if (FileName==0) FileName=GetStandardEEPTFilePath(G->Surfaces[nsa], G->Surfaces[nsb]);
-  ExportEEPSubTable( (EquivalentEdgePairSubTable *)MasterTable, FileName); 
+  ExportEEPSubTable( (EquivalentEdgePairSubTable *)MasterTable, FileName, Key);
   Log("Exported EEPTable(%i,%i) to file %s.\n",nsa,nsb,FileName);
 }
 
-/***************************************************************/
-/***************************************************************/
-/***************************************************************/
-// read a string of the form {n1,n2} or %c%c{n1,n2} from f.
-// return codes:
-// 0: fail because end of file
-// 1: fail for other reason
-// 2: success, at end of file
-// 3: success, at end of line
-// 4: success, neither of the above
-#if 0
-int ReadIndexPair(FILE *f, bool AtTopOfLine, int *n1, int *n2, bool *SignFlip)
-{
-  bool Success;
-  char SignChar;
-  int nPos, nNeg;
-  if( AtTopOfLine )
-   Success = ( fscanf(f," {%i,%i} %i %i ",n1,n2,&nPos,&nNeg)==4 );
-  else
-   Success = ( fscanf(f," %c{%i,%i}",&SignChar,n1,n2)==3 );
-  if (!Success)
-   return feof(f) ? 0 : 1;
-
-  if (SignChar=='-')
-   *SignFlip=true;
-  else if (SignChar=='+')
-   *SignFlip=false;
-  else 
-   return 1;
-
-  char c=' ';
-  while ( isspace(c) && c!='\n' )
-   c=fgetc(f);
-  if (feof(f))
-   return 2;
-  if (c=='\n')
-   return 3;
-  ungetc(c,f);
-  return 4;
-}
-
-/***************************************************************/
-/***************************************************************/
-/***************************************************************/
-bool EquivalentEdgePairTable::Import(const char *FileName)
-{ 
-  /*--------------------------------------------------------------*/
-  /* try to open file and check header ---------------------------*/
-  /*--------------------------------------------------------------*/
-  if (FileName==0) FileName=GetStandardEEPTFilePath(Sa, Sb);
-  Log("Trying to import EEPTable from %s...",FileName);
-  FILE *f=fopen(FileName,"r");
-  if (f==0) return false;
-  char Line[1000]; 
-  for(int ns=0; ns<2; ns++)
-   { char LineShouldBe[1000];
-     RWGSurface *S = (ns==0) ? Sa : Sb;
-     snprintf(LineShouldBe,1000,"%s %i\n",S->MeshFileName,S->NumEdges);
-     if ( !fgets(Line,1000,f) || strcmp(Line, LineShouldBe) )
-      { Log("failed: line %i is %s, should be %s",ns+1,Line,LineShouldBe);
-        fclose(f); 
-        return false;
-      }
-   }
- 
-  /*--------------------------------------------------------------*/
-  /*--------------------------------------------------------------*/
-  /*--------------------------------------------------------------*/
-  int LineNum=3;
-  bool AtTopOfLine=true;
-  int neaParent, nebParent;
-  char *ErrMsg=0;
-  while( !feof(f) )
-   { int nea, neb;
-     SignPattern Signs[2];
-     int Status=ReadIndexPair(f, AtTopOfLine, &nea, &neb, &SignPattern);
-     if (Status==1)
-      ErrMsg=vstrdup("%s:%i: syntax error",FileName,LineNum);
-     if (Status<=1)
-      break;
-     if (AtTopOfLine)
-      neaParent=nea, nebParent=neb;
-     else
-      AddEquivalentPair(EPSMap, neaParent, nebParent, nea, neb, SignFlip);
-      //AddEquivalentPair(FileEPS, neaParent, nebParent, nea, neb, SignFlip);
-     if (Status==2) break;
-      Warn("%s:%i: internal error A",__FILE__,__LINE__);
-     AtTopOfLine=(Status==3);
-     if (AtTopOfLine) LineNum++;
-   }
-  fclose(f);
-  //MergeEPSMaps(&EPSMap, &FileEPS);
-  return ErrMsg;
-}
-#endif
 
 } // namespace scuff
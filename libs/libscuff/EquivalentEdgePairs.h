@@ -57,7 +57,11 @@ typedef vector<ChildPairData> ChildPairList;
 class EquivalentEdgePairTable
  {
 public:
+    // if EEPTFile is given, the table is read from that file if it
+    // exists and matches the geometry; otherwise it is computed from
+    // scratch and written to that file
     EquivalentEdgePairTable(RWGGeometry *G, int nsa, int nsb, char *EEPTFile=0);
+    ~EquivalentEdgePairTable();
     void Export(const char *EEPTFile=0);
 
     bool HasParent(int neaChild, int nebChild, int *neaParent=0, int *nebParent=0, SignPattern *Signs=0);
@@ -70,8 +74,13 @@ public:
 // private:
    RWGGeometry *G;
    int nsa, nsb;
+   long Key;  // identifies the geometry for which the table was computed
    void *MasterTable;
  };
 
+class RWGSurface;
+long GetEEPTableKey(RWGSurface *Sa, RWGSurface *Sb);
+char *GetStandardEEPTFilePath(RWGSurface *Sa, RWGSurface *Sb);
+
 } // namespace scuff 
 #endif // #ifndef EQUIVALENT_EDGE_PAIRS_H
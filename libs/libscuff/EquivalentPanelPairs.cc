@@ -0,0 +1,375 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * EquivalentPanelPairs.cc -- detection of pairs of panels on a surface
+ *                         -- that are rigid translates of each other
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef HAVE_CONFIG_H
+  #include "config.h"
+#endif
+
+#ifdef USE_OPENMP
+  #include <omp.h>
+#endif
+
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "EquivalentPanelPairs.h"
+
+namespace scuff {
+
+long JenkinsHash(const char *key, size_t len); // in FIBBICache.cc
+
+bool PanelPairKey::operator<(const PanelPairKey &K) const
+{
+  if (ClassA!=K.ClassA) return ClassA<K.ClassA;
+  if (ClassB!=K.ClassB) return ClassB<K.ClassB;
+  if (NCV!=K.NCV) return NCV<K.NCV;
+  for(int i=0; i<3; i++)
+   if (Displacement[i]!=K.Displacement[i])
+    return Displacement[i]<K.Displacement[i];
+  return false;
+}
+
+/***************************************************************/
+/* identifies the mesh topology and the panel shapes, but not  */
+/* the position or orientation of the surface, neither of      */
+/* which affects the table                                     */
+/***************************************************************/
+long GetEPPTableKey(RWGSurface *S)
+{
+  std::vector<float> Data;
+  Data.push_back( (float)S->NumPanels );
+  Data.push_back( (float)S->NumEdges );
+  for(int np=0; np<S->NumPanels; np++)
+   { int *VI = S->Panels[np]->VI;
+     for(int i=0; i<3; i++)
+      { Data.push_back( (float)VI[i] );
+        double *V1=S->Vertices + 3*VI[i], *V2=S->Vertices + 3*VI[(i+1)%3];
+        Data.push_back( (float)VecDistance(V1,V2) );
+      };
+   };
+  for(int ne=0; ne<S->NumEdges; ne++)
+   { Data.push_back( (float)S->Edges[ne]->iPPanel );
+     Data.push_back( (float)S->Edges[ne]->iMPanel );
+   };
+  long Key=JenkinsHash( (const char *)&(Data[0]), Data.size()*sizeof(float) );
+  return Key<0 ? -Key : Key;
+}
+
+char *GetStandardEPPTFilePath(RWGSurface *S)
+{
+  static char Path[1000];
+  char PWD[2]=".";
+  char *Dir = S->MeshFileDir;
+  if (Dir==0) Dir=PWD;
+  snprintf(Path,1000,"%s/%s.EPPTable",Dir,GetFileBase(S->MeshFileName));
+  return Path;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+EquivalentPanelPairTable::EquivalentPanelPairTable(RWGSurface *pS, const char *EPPTFile)
+{
+  S=pS;
+  Key=GetEPPTableKey(S);
+
+  double RelTol=1.0e-10;
+  CheckEnv("SCUFF_EPP_RELTOL", &RelTol);
+  double MinRadius=HUGE_VAL;
+  for(int np=0; np<S->NumPanels; np++)
+   MinRadius=fmin(MinRadius, S->Panels[np]->Radius);
+  Quantum=RelTol*MinRadius;
+
+  if ( EPPTFile && Import(EPPTFile) )
+   { Log("Read panel-pair table for surface %s from file %s (%i parents, %li children)",
+          S->Label,EPPTFile,NumParents,NumChildren);
+     return;
+   };
+
+  Build();
+  Log(" Of %li panel pairs on surface %s, %li are children (savings of %.0f %%)",
+        NumPairs, S->Label, NumChildren,
+        NumPairs==0 ? 0.0 : 100.0*((double)NumChildren)/((double)NumPairs));
+
+  if (EPPTFile && NumChildren>0)
+   Export(EPPTFile);
+}
+
+/***************************************************************/
+/* returns false if either panel has no translates elsewhere on*/
+/* the surface, in which case the pair is not equivalent to any*/
+/* other pair                                                  */
+/***************************************************************/
+bool EquivalentPanelPairTable::GetKey(int npa, int npb, PanelPairKey *K)
+{
+  if ( Class[npa]==-1 || Class[npb]==-1 )
+   return false;
+
+  K->ClassA=Class[npa];
+  K->ClassB=Class[npb];
+
+  int *VIa=S->Panels[npa]->VI, *VIb=S->Panels[npb]->VI;
+  K->NCV=0;
+  for(int i=0; i<3; i++)
+   for(int j=0; j<3; j++)
+    if (VIa[i]==VIb[j]) K->NCV++;
+
+  for(int i=0; i<3; i++)
+   K->Displacement[i] = QRef[3*npb+i] - QRef[3*npa+i];
+  return true;
+}
+
+int EquivalentPanelPairTable::GetParent(int npa, int npb)
+{
+  PanelPairKey K;
+  if (NumParents==0 || !GetKey(npa, npb, &K))
+   return -1;
+  std::map<PanelPairKey, int>::iterator it=ParentIndices.find(K);
+  return it==ParentIndices.end() ? -1 : it->second;
+}
+
+/***************************************************************/
+/* the shape of a panel is the pair of vectors from its first  */
+/* vertex to its second and third vertices                     */
+/***************************************************************/
+typedef struct PanelShape
+ { long long Data[6];
+   bool operator<(const PanelShape &P) const
+    { for(int n=0; n<6; n++)
+       if (Data[n]!=P.Data[n]) return Data[n]<P.Data[n];
+      return false;
+    };
+ } PanelShape;
+
+typedef struct PairClassData
+ { long Count;
+   int npa, npb;   // first pair in the class
+ } PairClassData;
+
+void EquivalentPanelPairTable::Build()
+{
+  int NP=S->NumPanels;
+
+  /*--------------------------------------------------------------*/
+  /*- only panels that carry at least one basis function matter   */
+  /*--------------------------------------------------------------*/
+  std::vector<bool> HasEdges(NP, false);
+  for(int ne=0; ne<S->NumEdges; ne++)
+   { RWGEdge *E=S->Edges[ne];
+     HasEdges[E->iPPanel]=true;
+     if (E->iMPanel!=-1) HasEdges[E->iMPanel]=true;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- sort panels into classes of translates of each other        */
+  /*--------------------------------------------------------------*/
+  Class.assign(NP, -1);
+  QRef.assign(3*NP, 0);
+  std::vector<PanelShape> Shapes(NP);
+  for(int np=0; np<NP; np++)
+   { int *VI=S->Panels[np]->VI;
+     double *V0=S->Vertices + 3*VI[0];
+     for(int n=1; n<3; n++)
+      { double *V=S->Vertices + 3*VI[n];
+        for(int i=0; i<3; i++)
+         Shapes[np].Data[3*(n-1)+i] = llround( (V[i]-V0[i])/Quantum );
+      };
+     for(int i=0; i<3; i++)
+      QRef[3*np+i] = llround(V0[i]/Quantum);
+   };
+
+  std::map<PanelShape, int> ShapeCounts;
+  for(int np=0; np<NP; np++)
+   if (HasEdges[np])
+    ShapeCounts[Shapes[np]]++;
+  std::map<PanelShape, int> ShapeClasses;
+  int NumClasses=0;
+  for(std::map<PanelShape, int>::iterator it=ShapeCounts.begin(); it!=ShapeCounts.end(); it++)
+   if (it->second>1)
+    ShapeClasses[it->first]=NumClasses++;
+  int NumClassPanels=0;
+  for(int np=0; np<NP; np++)
+   if (HasEdges[np] && ShapeClasses.count(Shapes[np]))
+    { Class[np]=ShapeClasses[Shapes[np]];
+      NumClassPanels++;
+    };
+
+  long NumEdgePanels=0;
+  for(int np=0; np<NP; np++)
+   if (HasEdges[np]) NumEdgePanels++;
+  NumPairs=NumEdgePanels*NumEdgePanels;
+
+  /*--------------------------------------------------------------*/
+  /*- classify all pairs of panels that both have translates; the */
+  /*- rows of the table are divided among threads, and the first  */
+  /*- pair (in row-major order) of each class becomes its parent  */
+  /*--------------------------------------------------------------*/
+  NumParents=0;
+  NumChildren=0;
+  Parents.clear();
+  ParentIndices.clear();
+  if (NumClassPanels<2)
+   return;
+
+  int NumThreads=GetNumThreads();
+  Log("Identifying equivalent panel pairs on surface %s (%i threads...)",S->Label,NumThreads);
+  std::vector< std::map<PanelPairKey, PairClassData> > ThreadClasses(NumThreads);
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int npa=0; npa<NP; npa++)
+   {
+     int nt=0;
+#ifdef USE_OPENMP
+     nt=omp_get_thread_num();
+#endif
+     std::map<PanelPairKey, PairClassData> &Classes=ThreadClasses[nt];
+     PanelPairKey K;
+     for(int npb=0; npb<NP; npb++)
+      { if ( !GetKey(npa, npb, &K) ) continue;
+        std::map<PanelPairKey, PairClassData>::iterator it=Classes.find(K);
+        if (it==Classes.end())
+         { PairClassData Data={1, npa, npb};
+           Classes[K]=Data;
+         }
+        else
+         it->second.Count++;
+      };
+   };
+
+  std::map<PanelPairKey, PairClassData> &Classes=ThreadClasses[0];
+  for(int nt=1; nt<NumThreads; nt++)
+   { std::map<PanelPairKey, PairClassData>::iterator it;
+     for(it=ThreadClasses[nt].begin(); it!=ThreadClasses[nt].end(); it++)
+      { std::map<PanelPairKey, PairClassData>::iterator jt=Classes.find(it->first);
+        if (jt==Classes.end())
+         Classes.insert(*it);
+        else
+         { PairClassData &D=jt->second, &DT=it->second;
+           D.Count+=DT.Count;
+           if ( DT.npa<D.npa || (DT.npa==D.npa && DT.npb<D.npb) )
+            { D.npa=DT.npa; D.npb=DT.npb; }
+         };
+      };
+     ThreadClasses[nt].clear();
+   };
+
+  std::map<PanelPairKey, PairClassData>::iterator it;
+  for(it=Classes.begin(); it!=Classes.end(); it++)
+   if (it->second.Count>1)
+    { ParentIndices[it->first]=NumParents++;
+      Parents.push_back(it->second.npa);
+      Parents.push_back(it->second.npb);
+      NumChildren += it->second.Count - 1;
+    };
+}
+
+/***************************************************************/
+/* file format: a header line identifying the surface, then    */
+/* one line per panel (class and quantized coordinates of the  */
+/* first vertex), then one line per parent pair. the classes   */
+/* of all pairs are recomputed from the panel data on import.  */
+/***************************************************************/
+void EquivalentPanelPairTable::Export(const char *FileName)
+{
+  FILE *f=fopen(FileName,"w");
+  if (!f)
+   { Log("could not open file %s (not saving panel-pair table)",FileName);
+     return;
+   };
+  fprintf(f,"%s %i %i KEY %li QUANTUM %.16e\n",
+             S->MeshFileName,S->NumPanels,S->NumEdges,Key,Quantum);
+  for(int np=0; np<S->NumPanels; np++)
+   fprintf(f,"%i %lli %lli %lli\n",Class[np],
+              QRef[3*np+0],QRef[3*np+1],QRef[3*np+2]);
+  fprintf(f,"PARENTS %i %li %li\n",NumParents,NumChildren,NumPairs);
+  for(int n=0; n<NumParents; n++)
+   fprintf(f,"%i %i\n",Parents[2*n+0],Parents[2*n+1]);
+  fclose(f);
+  Log("Exported panel-pair table for surface %s to file %s.",S->Label,FileName);
+}
+
+bool EquivalentPanelPairTable::Import(const char *FileName)
+{
+  FILE *f=fopen(FileName,"r");
+  if (!f) return false;
+
+  char Line[1000], LineShouldBe[1000];
+  snprintf(LineShouldBe,1000,"%s %i %i KEY %li QUANTUM %.16e\n",
+                              S->MeshFileName,S->NumPanels,S->NumEdges,Key,Quantum);
+  if ( !fgets(Line,1000,f) || strcmp(Line,LineShouldBe) )
+   { Log("panel-pair table file %s does not match geometry (ignoring)",FileName);
+     fclose(f);
+     return false;
+   };
+
+  int NP=S->NumPanels;
+  Class.assign(NP, -1);
+  QRef.assign(3*NP, 0);
+  Parents.clear();
+  ParentIndices.clear();
+  bool Error=false;
+  for(int np=0; np<NP && !Error; np++)
+   { long long *Q=&(QRef[3*np]);
+     if (    fscanf(f,"%i %lli %lli %lli",&(Class[np]),Q+0,Q+1,Q+2)!=4
+          || Class[np]<-1
+        ) Error=true;
+   };
+
+  if (    !Error
+       && fscanf(f," PARENTS %i %li %li",&NumParents,&NumChildren,&NumPairs)==3
+     )
+   for(int n=0; n<NumParents && !Error; n++)
+    { int npa, npb;
+      PanelPairKey K;
+      if (    fscanf(f,"%i %i",&npa,&npb)!=2
+           || npa<0 || npa>=NP || npb<0 || npb>=NP
+           || !GetKey(npa, npb, &K)
+         )
+       Error=true;
+      else
+       { ParentIndices[K]=n;
+         Parents.push_back(npa);
+         Parents.push_back(npb);
+       };
+    }
+  else
+   Error=true;
+  fclose(f);
+
+  if (Error)
+   { Warn("%s: syntax error (ignoring panel-pair table file)",FileName);
+     NumParents=0;
+     Parents.clear();
+     ParentIndices.clear();
+     return false;
+   };
+  return true;
+}
+
+} // namespace scuff
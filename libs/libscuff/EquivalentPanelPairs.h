@@ -0,0 +1,111 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * EquivalentPanelPairs.h -- detection of pairs of panels on a surface
+ *                        -- that are rigid translates of each other
+ */
+#ifndef EQUIVALENT_PANEL_PAIRS_H
+#define EQUIVALENT_PANEL_PAIRS_H
+
+#include <map>
+#include <vector>
+
+namespace scuff {
+
+class RWGSurface;
+
+/***************************************************************/
+/* Two panel pairs (npa,npb) and (npa',npb') on the same       */
+/* surface are equivalent if there is a single translation     */
+/* vector that carries vertex #i of npa onto vertex #i of npa' */
+/* and vertex #i of npb onto vertex #i of npb' (i=0,1,2). The  */
+/* panel-panel integrals of equivalent pairs for each pair of  */
+/* source vertices are then identical, since the kernel        */
+/* depends only on the displacement between the source and     */
+/* destination points; this holds for periodic kernels and for */
+/* an overall displacement of one copy of the surface as well. */
+/* (Translates whose vertices are listed in a different order  */
+/* are not matched up, since the cubature rules are not        */
+/* invariant under permutations of the vertices and the        */
+/* integrals would only agree to within the cubature error.)   */
+/*                                                             */
+/* Each class of two or more equivalent panel pairs has one    */
+/* 'parent,' the pair in the class with the smallest indices;  */
+/* the others are its 'children.' Only panels carrying at least*/
+/* one basis function are considered.                          */
+/*                                                             */
+/* Panels are first sorted into classes of translates of each  */
+/* other; a panel pair is then identified by the classes of    */
+/* its panels, the number of vertices they share, and the      */
+/* displacement between the first vertices of the two panels.  */
+/* Coordinates are compared after rounding to a quantum of    */
+/* SCUFF_EPP_RELTOL (default 1e-10) times the smallest panel   */
+/* radius.                                                     */
+/*                                                             */
+/* Tables for which some pairs have parents are written next   */
+/* to the mesh file as MeshFile.EPPTable and read back by      */
+/* later runs.                                                 */
+/***************************************************************/
+typedef struct PanelPairKey
+ { int ClassA, ClassB, NCV;
+   long long Displacement[3];
+   bool operator<(const PanelPairKey &K) const;
+ } PanelPairKey;
+
+class EquivalentPanelPairTable
+ {
+public:
+   // if EPPTFile is given, the table is read from that file if it
+   // exists and matches the surface; otherwise it is computed from
+   // scratch and, if any pair has a parent, written to that file
+   EquivalentPanelPairTable(RWGSurface *S, const char *EPPTFile=0);
+
+   // returns the index (0..NumParents-1) of the parent of the
+   // class containing panel pair (npa,npb), or -1 if the pair is
+   // not equivalent to any other pair
+   int GetParent(int npa, int npb);
+
+   void Export(const char *EPPTFile);
+
+   RWGSurface *S;
+   long Key;                  // identifies the surface for which the table was computed
+   double Quantum;
+
+   int NumParents;
+   std::vector<int> Parents;  // Parents[2*n+0,1] = (npa,npb) for parent #n
+   long NumChildren;          // total number of child pairs
+   long NumPairs;             // total number of pairs of panels with basis functions
+
+private:
+   void Build();
+   bool Import(const char *EPPTFile);
+   bool GetKey(int npa, int npb, PanelPairKey *K);
+
+   std::vector<int> Class;        // Class[np] = -1 if panel np has no translates
+   std::vector<long long> QRef;   // quantized coordinates of vertex 0 of each panel
+   std::map<PanelPairKey, int> ParentIndices;
+ };
+
+long GetEPPTableKey(RWGSurface *S);
+char *GetStandardEPPTFilePath(RWGSurface *S);
+
+} // namespace scuff
+
+#endif // #ifndef EQUIVALENT_PANEL_PAIRS_H
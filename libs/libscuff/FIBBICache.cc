@@ -47,6 +47,7 @@
 
 #include <libhrutil.h>
 #include "libscuff.h"
+#include "MappedCacheFile.h"
 
 namespace scuff {
 
@@ -63,6 +64,7 @@ void ComputeFIBBIData(RWGSurface *Sa, int nea,
 #define MAXSTR 256
 
 #define SUFFIX "scuffcache"
+#define FIBBICF_TYPE "FIBBI"
 
 /*--------------------------------------------------------------*/
 /*- note: i found this on wikipedia ... ------------------------*/
@@ -145,6 +147,9 @@ public:
    int Hits, Misses;
    void *opTable;
 
+   // read-only memory-mapped cache file, if any
+   MappedCacheFile *MCF;
+
    pthread_rwlock_t lock;
 
    char *LastFileName;
@@ -159,6 +164,7 @@ FIBBICache::FIBBICache(char *MeshFileName)
 {
   KDMap *KDM=new KDMap;
   opTable = (void *)KDM;
+  MCF=0;
 
   pthread_rwlock_init(&lock,0);
 
@@ -203,6 +209,7 @@ FIBBICache::~FIBBICache()
   KDMap *KDM = (KDMap *)opTable;
   delete KDM;
 
+  if (MCF) delete MCF;
 } 
 
 /***************************************************************/
@@ -286,6 +293,15 @@ void FIBBICache::GetFIBBIData(RWGSurface *SA, int neA,
 
   KDMap *KDM    = (KDMap *)opTable;
   bool Found;
+
+  // the mapped file is read-only and needs no locking
+  const void *MappedData = MCF ? MCF->Lookup(Key.Key) : 0;
+  if (MappedData)
+   { memcpy(FIBBIs, MappedData, DATASIZE);
+     Hits++;
+     return;
+   };
+
   pthread_rwlock_rdlock(&lock);
   KDMap::iterator p=KDM->find(Key);
   Found = (p != (KDM->end()) );
@@ -323,8 +339,14 @@ void FIBBICache::GetFIBBIData(RWGSurface *SA, int neA,
 /* if that environment variable is defined, and otherwise to   */
 /* the current working directory.                              */
 /*                                                             */
-/* the file format is pretty simple (and non-portable w.r.t.   */
-/* endianness):                                                */
+/* Cache files are written in the memory-mappable format       */
+/* described in MappedCacheFile.h. On preloading, such a file  */
+/* is mapped read-only and queried in place; records computed  */
+/* thereafter go to the in-memory table, and Store() writes a  */
+/* new file containing both sets of records.                   */
+/*                                                             */
+/* Older cache files can still be preloaded; their format is   */
+/* pretty simple (and non-portable w.r.t. endianness):         */
 /*  bytes 0--11:   'FIBBI_CACHE' + 0                           */
 /*  next xx bytes:  first record                               */ 
 /*  next xx bytes:  second record                              */
@@ -359,7 +381,7 @@ void FIBBICache::Store(const char *MeshFileName)
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
-  unsigned int NumRecords = KDM->size();
+  unsigned int NumRecords = KDM->size() + (MCF ? MCF->NumRecords : 0);
   if (    NumRecords==NumRecordsInFile
        && LastFileName 
        && !strcmp(FileName, LastFileName)
@@ -367,7 +389,6 @@ void FIBBICache::Store(const char *MeshFileName)
    { Log("FC::S FIBBI cache unchanged since last disk operation (skipping cache dump)");
      return;
    };
-Log("I checked and: (%i,%i), (%s,%s)",NumRecords,NumRecordsInFile,FileName,(LastFileName ? "" : LastFileName));
   if (LastFileName) free(LastFileName);
   LastFileName=strdup(FileName);
 
@@ -375,42 +396,29 @@ Log("I checked and: (%i,%i), (%s,%s)",NumRecords,NumRecordsInFile,FileName,(Last
   /*- i assume that Preload() and Store() won't be called from    */
   /*- multithreaded code sections.                                */
   /*--------------------------------------------------------------*/
-  //FCLock.read_lock();
-
-  FILE *f=fopen(FileName,"w");
-  if (!f)
-   { Log("FC::S warning: could not open file %s (aborting cache dump)...",FileName);
-     return;
-   };
-  Log("FC::S Writing FIBBI cache to file %s...",FileName);
-
-  /*---------------------------------------------------------------------*/
-  /*- write file signature ----------------------------------------------*/
-  /*---------------------------------------------------------------------*/
-  fwrite(FIBBICF_GSignature, FIBBICF_SIGSIZE,1,f);
-
-  /*---------------------------------------------------------------------*/
-  /*- iterate through the table and write entries to the file one-by-one */
-  /*---------------------------------------------------------------------*/
-  NumRecordsInFile=0;
-  KDMap::iterator it;
-  for ( it = KDM->begin(); it != KDM->end(); it++ )
-   { 
-     const float *Key   = it->first.Key;
-     double *Data = it->second.Data;
-     if (    (1 != fwrite(Key,  KEYSIZE,  1, f )) 
-          || (1 != fwrite(Data, DATASIZE, 1, f ))
-        ) break;
-     NumRecordsInFile++;
+  const void **Keys = (const void **)mallocEC((NumRecords+1)*sizeof(void *));
+  const void **Data = (const void **)mallocEC((NumRecords+1)*sizeof(void *));
+  unsigned int nr=0;
+  if (MCF)
+   for(; nr<MCF->NumRecords; nr++)
+    { Keys[nr]=MCF->GetKey(nr);
+      Data[nr]=MCF->GetData(nr);
+    };
+  for(KDMap::iterator it=KDM->begin(); it!=KDM->end(); it++, nr++)
+   { Keys[nr]=it->first.Key;
+     Data[nr]=it->second.Data;
    };
 
-  /*---------------------------------------------------------------------*/
-  /*- and that's it -----------------------------------------------------*/
-  /*---------------------------------------------------------------------*/
-  fclose(f);
-  Log("FC::S ...wrote %i/%i FIBBI records.",NumRecordsInFile,NumRecords);
+  Log("FC::S Writing FIBBI cache to file %s...",FileName);
+  int Status=WriteMappedCacheFile(FileName, FIBBICF_TYPE, KEYSIZE, DATASIZE,
+                                  NumRecords, Keys, Data);
+  free(Keys);
+  free(Data);
+  if (Status!=0)
+   return;
 
-  //FCLock.read_unlock();
+  NumRecordsInFile=NumRecords;
+  Log("FC::S ...wrote %i FIBBI records.",NumRecordsInFile);
 }
 
 /***************************************************************/
@@ -427,6 +435,40 @@ int FIBBICache::PreLoad(const char *FileName)
      return 1;
    };
 
+  /*--------------------------------------------------------------*/
+  /*- files in the current format are mapped if we don't already -*/
+  /*- have a mapped file, and otherwise copied into the table     -*/
+  /*--------------------------------------------------------------*/
+  if ( IsMappedCacheFile(FileName) )
+   { fclose(f);
+     MappedCacheFile *NewMCF
+      = new MappedCacheFile(FileName, FIBBICF_TYPE, KEYSIZE, DATASIZE);
+     if (NewMCF->ErrMsg)
+      { Log("FC::P warning: file %s: %s (skipping cache preload)",FileName,NewMCF->ErrMsg);
+        delete NewMCF;
+        return 1;
+      };
+     if (MCF==0)
+      MCF=NewMCF;
+     else
+      { KDMap *KDM = (KDMap *)opTable;
+        for(unsigned int nr=0; nr<NewMCF->NumRecords; nr++)
+         { KeyStruct Key;
+           DataStruct Data; 
+           memcpy(Key.Key,   NewMCF->GetKey(nr),  KEYSIZE);
+           memcpy(Data.Data, NewMCF->GetData(nr), DATASIZE);
+           if (!MCF->Lookup(Key.Key))
+            KDM->insert( KDPair(Key,Data) );
+         };
+        delete NewMCF;
+      };
+     if (LastFileName) free(LastFileName);
+     LastFileName=strdupEC(FileName);
+     NumRecordsInFile=MCF->NumRecords + ((KDMap *)opTable)->size();
+     Log("FC::P ...mapped %i FIBBI records from file %s.",NumRecordsInFile,FileName);
+     return 0;
+   };
+
   KDMap *KDM       = (KDMap *)opTable;
   int RecordSize   = KEYSIZE + DATASIZE;
   int NumRecords   = 0; 
@@ -498,10 +540,12 @@ int FIBBICache::PreLoad(const char *FileName)
   /* the most recent file from which we preloaded, and the number */
   /* of records preloaded, are stored within the class body to    */
   /* allow us to skip dumping the cache back to disk in cases     */
-  /* where that would amount to just rewriting the same cache     */
+  /* where that would amount to just rewriting the same cache.    */
+  /* for files in the old format we do want to rewrite the file   */
+  /* (in the new format), so we record no file name.              */
   /*--------------------------------------------------------------*/
   if (LastFileName) free(LastFileName);
-  LastFileName=strdupEC(FileName);
+  LastFileName=0;
   NumRecordsInFile=RecordsRead;
 
   Log("FC::P ...successfully preloaded %i FIBBI records.",RecordsRead);
@@ -528,7 +572,7 @@ int FIBBICache::Size(int *pHits, int *pMisses)
   if (pMisses) *pMisses=Misses;
   if (opTable==0) return -1;
   KDMap *KDM = (KDMap *)opTable;
-  return KDM->size();
+  return KDM->size() + (MCF ? MCF->NumRecords : 0);
 
 }
 
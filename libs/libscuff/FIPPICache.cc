@@ -42,6 +42,7 @@
 
 #include "libscuff.h"
 #include "libscuffInternals.h"
+#include "MappedCacheFile.h"
 
 namespace scuff {
 
@@ -94,13 +95,38 @@ typedef std::tr1::unordered_map< KeyStruct,
                                  FIPPIKeyCmp> KeyValueMap;
 #endif
 
+/*--------------------------------------------------------------*/
+/*- the table is partitioned into shards, each of which has its */
+/*- own map, lock, and statistics counters. the padding keeps   */
+/*- the counters of adjacent shards on separate cache lines.    */
+/*--------------------------------------------------------------*/
+typedef struct FIPPICacheShard
+ { KeyValueMap KVM;
+   rwlock Lock;
+   unsigned long Hits, Misses;
+   char Padding[64];
+ } FIPPICacheShard;
+
+// the shard is chosen using bits of the hash above those that 
+// determine the bucket within the shard's own map
+static inline FIPPICacheShard *GetShard(void *opTable, const KeyStruct &K)
+{ unsigned long h = (unsigned long)HashFunction(K.Key);
+  return ((FIPPICacheShard *)opTable) + ( (h>>20) % FIPPICACHE_NUMSHARDS );
+}
+
+static inline void AtomicIncrement(unsigned long *Counter)
+{ __sync_fetch_and_add(Counter, 1); }
+
 /*--------------------------------------------------------------*/
 /*- class constructor ------------------------------------------*/
 /*--------------------------------------------------------------*/
 FIPPICache::FIPPICache()
 {
-  KeyValueMap *KVM=new KeyValueMap;
-  opTable = (void *)KVM;
+  FIPPICacheShard *Shards = new FIPPICacheShard[FIPPICACHE_NUMSHARDS];
+  for(int ns=0; ns<FIPPICACHE_NUMSHARDS; ns++)
+   Shards[ns].Hits=Shards[ns].Misses=0;
+  opTable = (void *)Shards;
+  opMappedFile=0;
   PreloadFileName=0;
   RecordsPreloaded=0;
 }
@@ -113,10 +139,49 @@ FIPPICache::~FIPPICache()
   if (PreloadFileName) 
    free(PreloadFileName);
 
-  KeyValueMap *KVM=(KeyValueMap *)opTable;
-  delete KVM;
+  FIPPICacheShard *Shards=(FIPPICacheShard *)opTable;
+  delete[] Shards;
+
+  if (opMappedFile)
+   delete (MappedCacheFile *)opMappedFile;
 } 
 
+/*--------------------------------------------------------------*/
+/*- table size and statistics ----------------------------------*/
+/*--------------------------------------------------------------*/
+unsigned long FIPPICache::Size()
+{
+  FIPPICacheShard *Shards=(FIPPICacheShard *)opTable;
+  unsigned long Total=0;
+  if (opMappedFile)
+   Total += ((MappedCacheFile *)opMappedFile)->NumRecords;
+  for(int ns=0; ns<FIPPICACHE_NUMSHARDS; ns++)
+   { Shards[ns].Lock.read_lock();
+     Total += Shards[ns].KVM.size();
+     Shards[ns].Lock.read_unlock();
+   };
+  return Total;
+}
+
+void FIPPICache::GetStatistics(unsigned long *Hits, unsigned long *Misses)
+{
+  FIPPICacheShard *Shards=(FIPPICacheShard *)opTable;
+  unsigned long TotalHits=0, TotalMisses=0;
+  for(int ns=0; ns<FIPPICACHE_NUMSHARDS; ns++)
+   { TotalHits   += Shards[ns].Hits;
+     TotalMisses += Shards[ns].Misses;
+   };
+  if (Hits) *Hits=TotalHits;
+  if (Misses) *Misses=TotalMisses;
+}
+
+void FIPPICache::ResetStatistics()
+{
+  FIPPICacheShard *Shards=(FIPPICacheShard *)opTable;
+  for(int ns=0; ns<FIPPICACHE_NUMSHARDS; ns++)
+   Shards[ns].Hits=Shards[ns].Misses=0;
+}
+
 static void inline VecSubFloat(double *V1, double *V2, float *V1mV2)
 { V1mV2[0] = ((float)V1[0]) - ((float)V2[0]);
   V1mV2[1] = ((float)V1[1]) - ((float)V2[1]);
@@ -156,34 +221,54 @@ QIFIPPIData *FIPPICache::GetQIFIPPIData(double **OVa, double **OVb, int ncv)
   VecSubFloat(OVb[2], OVa[0], K.Key+12 );
 
   /***************************************************************/
-  /* look for this key in the cache ******************************/
+  /* look for this key in the cache: first in the memory-mapped  */
+  /* cache file, if any, which is read-only and needs no locking,*/
+  /* then in the in-memory table of records added since.         */
   /***************************************************************/
-  KeyValueMap *KVM=(KeyValueMap *)opTable;
+  FIPPICacheShard *Shard=GetShard(opTable, K);
+  KeyValueMap *KVM=&(Shard->KVM);
+
+  // records in the mapped file are returned in place; callers 
+  // never write to QIFIPPIData structures obtained from the cache
+  QIFIPPIData *QIFD=0;
+  if (opMappedFile)
+   QIFD=const_cast<QIFIPPIData *>( (const QIFIPPIData *)((MappedCacheFile *)opMappedFile)->Lookup(K.Key) );
+  if (QIFD)
+   { AtomicIncrement(&(Shard->Hits));
+     return QIFD;
+   };
 
-  FCLock.read_lock();
+  Shard->Lock.read_lock();
   KeyValueMap::iterator p=KVM->find(K);
-  FCLock.read_unlock();
-
   if ( p != (KVM->end()) )
-   { Hits++;
-     return (QIFIPPIData *)(p->second);
-   }
+   QIFD=p->second;
+  Shard->Lock.read_unlock();
+
+  if (QIFD)
+   { AtomicIncrement(&(Shard->Hits));
+     return QIFD;
+   };
   
   /***************************************************************/
   /* if it was not found, allocate and compute a new QIFIPPIData */
-  /* structure, then add this structure to the cache             */
+  /* structure, then add this structure to the cache. if another */
+  /* thread inserted the same key in the meantime, we discard    */
+  /* our copy and return theirs.                                 */
   /***************************************************************/
-  Misses++;
-  KeyStruct *K2 = (KeyStruct *)mallocEC(sizeof(*K2));
-  memcpy(K2->Key, K.Key, KEYSIZE);
-  QIFIPPIData *QIFD=(QIFIPPIData *)mallocEC(sizeof *QIFD);
+  AtomicIncrement(&(Shard->Misses));
+  QIFD=(QIFIPPIData *)mallocEC(sizeof *QIFD);
   ComputeQIFIPPIData(OVa, OVb, ncv, QIFD);
    
-  FCLock.write_lock();
-  KVM->insert( KeyValuePair(*K2, QIFD) );
-  FCLock.write_unlock();
+  Shard->Lock.write_lock();
+  std::pair<KeyValueMap::iterator, bool> Result
+   = KVM->insert( KeyValuePair(K, QIFD) );
+  QIFIPPIData *Stored=Result.first->second;
+  Shard->Lock.write_unlock();
+
+  if (Stored!=QIFD)
+   free(QIFD);
 
-  return QIFD;
+  return Stored;
 }
 
 /***************************************************************/
@@ -192,8 +277,14 @@ QIFIPPIData *FIPPICache::GetQIFIPPIData(double **OVa, double **OVb, int ncv)
 /* and subsequently pre-loading a FIPPI cache with the content */
 /* of a file created by this storage operation.                */
 /*                                                             */
-/* the file format is pretty simple (and non-portable w.r.t.   */
-/* endianness):                                                */
+/* cache files are written in the memory-mappable format       */
+/* described in MappedCacheFile.h; on preloading, such a file  */
+/* is mapped read-only and queried in place, and records       */
+/* computed thereafter go to the in-memory table. Store() then */
+/* writes a new file containing both sets of records.          */
+/*                                                             */
+/* we can also still preload cache files in the older format,  */
+/* which is pretty simple (and non-portable w.r.t. endianness):*/
 /*  bytes 0--10:   'FIPPICACHE' + 0 (a file signature used as  */
 /*                                   a simple sanity check)    */
 /*  next xx bytes:  first record                               */
@@ -201,13 +292,15 @@ QIFIPPIData *FIPPICache::GetQIFIPPIData(double **OVa, double **OVb, int ncv)
 /*  ...             ...                                        */
 /*                                                             */
 /* where xx is the size of the record; each record consists of */
-/* a search key (15 double values) followed by the content     */
-/* of the QIFIPPIDataRecord for that search key.               */
+/* a search key (15 float values) followed by the content      */
+/* of the QIFIPPIDataRecord for that search key. records from  */
+/* such files are copied into the in-memory table.             */
 /*                                                             */
 /* note: FIPPICF = 'FIPPI cache file'                          */
 /***************************************************************/
 const char FIPPICF_Signature[]="FIPPICACHE";
 #define FIPPICF_SIGSIZE sizeof(FIPPICF_Signature)
+#define FIPPICF_TYPE "FIPPI"
 
 // note that this structure differs from the KeyValuePair structure 
 // defined above in that it contains the actual contents of 
@@ -221,7 +314,8 @@ typedef struct FIPPICF_Record
 
 void FIPPICache::Store(const char *FileName)
 {
-  KeyValueMap *KVM=(KeyValueMap *)opTable;
+  FIPPICacheShard *Shards=(FIPPICacheShard *)opTable;
+  MappedCacheFile *MCF=(MappedCacheFile *)opMappedFile;
 
   if (FileName==0) return;
 
@@ -238,68 +332,99 @@ void FIPPICache::Store(const char *FileName)
   /*--------------------------------------------------------------*/
   if (     PreloadFileName 
        && !strcmp(PreloadFileName, FileName) 
-       && RecordsPreloaded==(KVM->size())
+       && RecordsPreloaded==Size()
      )  
    { Log("FIPPI cache unchanged since reading from %s (skipping cache dump)",FileName);
      return;
    };
 
   /*--------------------------------------------------------------*/
+  /*- collect pointers to the keys and data of all records: those -*/
+  /*- in the mapped file (if any) followed by those in memory     -*/
   /*--------------------------------------------------------------*/
-  /*--------------------------------------------------------------*/
-  FCLock.read_lock();
-
-  KeyValueMap::iterator it;
-  int NumRecords=0;
+  for(int ns=0; ns<FIPPICACHE_NUMSHARDS; ns++)
+   Shards[ns].Lock.read_lock();
+
+  uint64_t NumRecords = MCF ? MCF->NumRecords : 0;
+  for(int ns=0; ns<FIPPICACHE_NUMSHARDS; ns++)
+   NumRecords += Shards[ns].KVM.size();
+
+  const void **Keys = (const void **)mallocEC((NumRecords+1)*sizeof(void *));
+  const void **Data = (const void **)mallocEC((NumRecords+1)*sizeof(void *));
+  uint64_t nr=0;
+  if (MCF)
+   for(; nr<MCF->NumRecords; nr++)
+    { Keys[nr]=MCF->GetKey(nr);
+      Data[nr]=MCF->GetData(nr);
+    };
+  for(int ns=0; ns<FIPPICACHE_NUMSHARDS; ns++)
+   for(KeyValueMap::iterator it=Shards[ns].KVM.begin(); it!=Shards[ns].KVM.end(); it++, nr++)
+    { Keys[nr]=it->first.Key;
+      Data[nr]=it->second;
+    };
 
   /*--------------------------------------------------------------*/
-  /*- try to open the file ---------------------------------------*/
+  /*- write the file ----------------------------------------------*/
   /*--------------------------------------------------------------*/
-  FILE *f=fopen(FileName,"w");
-  if (!f)
-   { fprintf(stderr,"warning: could not open file %s (aborting cache dump)...",FileName);
-     goto done;
-   };
   Log("Writing FIPPI cache to file %s...",FileName);
+  if ( 0==WriteMappedCacheFile(FileName, FIPPICF_TYPE, KEYSIZE, sizeof(QIFIPPIData),
+                               NumRecords, Keys, Data) )
+   Log(" ...wrote %lu FIPPI records.",(unsigned long)NumRecords);
 
-  /*---------------------------------------------------------------------*/
-  /*- write file signature ----------------------------------------------*/
-  /*---------------------------------------------------------------------*/
-  fwrite(FIPPICF_Signature,FIPPICF_SIGSIZE,1,f);
+  free(Keys);
+  free(Data);
 
-  /*---------------------------------------------------------------------*/
-  /*- iterate through the table and write entries to the file one-by-one */
-  /*---------------------------------------------------------------------*/
-  KeyStruct K;
-  QIFIPPIData *QIFD;
-  FIPPICF_Record MyRecord;
-  for ( it = KVM->begin(); it != KVM->end(); it++ ) 
-   { 
-     K=it->first;
-     QIFD=it->second;
-     memcpy(&(MyRecord.K.Key),       K.Key, sizeof(MyRecord.K.Key ));
-     memcpy(&(MyRecord.QIFDBuffer),  QIFD,  sizeof(MyRecord.QIFDBuffer));
-     if ( 1 != fwrite(&(MyRecord),sizeof(MyRecord),1,f ) )
-      break;
-     NumRecords++;
+  for(int ns=0; ns<FIPPICACHE_NUMSHARDS; ns++)
+   Shards[ns].Lock.read_unlock();
+}
+
+/***************************************************************/
+/* preload from a file in the memory-mappable format. the      */
+/* first such file is mapped; records from any subsequent ones */
+/* are copied into the in-memory table.                        */
+/***************************************************************/
+static int PreLoadMapped(const char *FileName, void **popMappedFile, void *opTable)
+{
+  MappedCacheFile *MCF
+   = new MappedCacheFile(FileName, FIPPICF_TYPE, KEYSIZE, sizeof(QIFIPPIData));
+  if (MCF->ErrMsg)
+   { fprintf(stderr,"warning: file %s: %s (skipping cache preload)\n",FileName,MCF->ErrMsg);
+     Log("FIPPI cache file %s: %s (skipping cache preload)",FileName,MCF->ErrMsg);
+     delete MCF;
+     return -1;
    };
+  int NumRecords=MCF->NumRecords;
 
-  /*---------------------------------------------------------------------*/
-  /*- and that's it -----------------------------------------------------*/
-  /*---------------------------------------------------------------------*/
-  fclose(f);
-  Log(" ...wrote %i FIPPI records.",NumRecords);
+  if ( *popMappedFile==0 )
+   { *popMappedFile=(void *)MCF;
+     Log("Mapped %i FIPPI records from file %s.",NumRecords,FileName);
+     return NumRecords;
+   };
 
- done:
-  FCLock.read_unlock();
+  MappedCacheFile *ExistingMCF=(MappedCacheFile *)(*popMappedFile);
+  for(int nr=0; nr<NumRecords; nr++)
+   { KeyStruct K;
+     memcpy(K.Key, MCF->GetKey(nr), KEYSIZE);
+     if ( ExistingMCF->Lookup(K.Key) ) 
+      continue;
+     QIFIPPIData *QIFD=(QIFIPPIData *)mallocEC(sizeof *QIFD);
+     memcpy(QIFD, MCF->GetData(nr), sizeof *QIFD);
+     std::pair<KeyValueMap::iterator, bool> Result
+      = GetShard(opTable,K)->KVM.insert( KeyValuePair(K, QIFD) );
+     if (Result.second==false)
+      free(QIFD);
+   };
+  Log("Preloaded %i FIPPI records from file %s.",NumRecords,FileName);
+  delete MCF;
+  return NumRecords;
 }
 
 void FIPPICache::PreLoad(const char *FileName)
 {
 
-  FCLock.write_lock();
-
-  KeyValueMap *KVM=(KeyValueMap *)opTable;
+  FIPPICacheShard *Shards=(FIPPICacheShard *)opTable;
+  for(int ns=0; ns<FIPPICACHE_NUMSHARDS; ns++)
+   Shards[ns].Lock.write_lock();
 
   /*--------------------------------------------------------------*/
   /*- try to open the file ---------------------------------------*/
@@ -311,6 +436,24 @@ void FIPPICache::PreLoad(const char *FileName)
      goto done;
    };
 
+  /*--------------------------------------------------------------*/
+  /*- files in the current format are mapped ---------------------*/
+  /*--------------------------------------------------------------*/
+  if ( IsMappedCacheFile(FileName) )
+   { fclose(f);
+     int NumRecords=PreLoadMapped(FileName, &opMappedFile, opTable);
+     if (NumRecords>=0)
+      { if (PreloadFileName)
+         free(PreloadFileName);
+        PreloadFileName=strdupEC(FileName);
+        // note: Size() takes shard locks, so we can't call it here
+        RecordsPreloaded=((MappedCacheFile *)opMappedFile)->NumRecords;
+        for(int ns=0; ns<FIPPICACHE_NUMSHARDS; ns++)
+         RecordsPreloaded+=Shards[ns].KVM.size();
+      };
+     goto done;
+   };
+
   /*--------------------------------------------------------------*/
   /*- run through some sanity checks to make sure we have a valid */
   /*- cache file                                                  */
@@ -368,7 +511,7 @@ void FIPPICache::PreLoad(const char *FileName)
   /*- them to the table.                                          */
   /*--------------------------------------------------------------*/
   unsigned int nr;
-  Log("Preloading FIPPI records from file %s...",FileName);
+  Log("Preloading FIPPI records from file %s (old format)...",FileName);
   for(nr=0; nr<NumRecords; nr++)
    { 
      if ( fread(Records+nr, FIPPICF_RECSIZE,1,f) != 1 )
@@ -377,7 +520,8 @@ void FIPPICache::PreLoad(const char *FileName)
 	goto done;
       };
 
-     KVM->insert( KeyValuePair(Records[nr].K, &(Records[nr].QIFDBuffer)) );
+     FIPPICacheShard *Shard=GetShard(opTable, Records[nr].K);
+     Shard->KVM.insert( KeyValuePair(Records[nr].K, &(Records[nr].QIFDBuffer)) );
    };
 
   /*--------------------------------------------------------------*/
@@ -389,14 +533,16 @@ void FIPPICache::PreLoad(const char *FileName)
   // the most recent file from which we preloaded, and the number of 
   // records preloaded, are stored within the class body to allow us 
   // to skip dumping the cache back to disk in cases where that would
-  // amount to just rewriting the same cache file
+  // amount to just rewriting the same cache file. (since the file
+  // is in the old format, we do want to rewrite it.)
   if (PreloadFileName)
    free(PreloadFileName);
-  PreloadFileName=strdupEC(FileName);
-  RecordsPreloaded=NumRecords;
+  PreloadFileName=0;
+  RecordsPreloaded=0;
 
  done:
-  FCLock.write_unlock();
+  for(int ns=0; ns<FIPPICACHE_NUMSHARDS; ns++)
+   Shards[ns].Lock.write_unlock();
 }
 
 /***************************************************************/
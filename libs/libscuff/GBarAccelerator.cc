@@ -22,7 +22,14 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <math.h>
+#include <unistd.h>
+
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
 
 #include <libhrutil.h>
 #include <libMDInterp.h>
@@ -333,6 +340,473 @@ void GetOptimalGridSpacing2D(GBarAccelerator *GBA,
 
 }
 
+/***************************************************************/
+/* evaluate GetOptimalGridSpacing{1D,2D} at a list of sample   */
+/* points, distributed over threads, and min-reduce the        */
+/* results into MinDelta.                                      */
+/* (the sampling routines build small interpolation tables and */
+/*  evaluate GBar by full Ewald summation, so for fine         */
+/*  tolerances they are a sizable part of the setup cost).     */
+/***************************************************************/
+void GetMinGridSpacing1D(GBarAccelerator *GBA, int NumSamples,
+                         double (*xRho)[2], double RelTol,
+                         double MinDelta[2])
+{
+  double *Deltas = new double[2*NumSamples];
+  int NumThreads = GetNumThreads();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int ns=0; ns<NumSamples; ns++)
+   GetOptimalGridSpacing1D(GBA, xRho[ns][0], xRho[ns][1], RelTol, Deltas + 2*ns, 0);
+
+  for(int Mu=0; Mu<2; Mu++)
+   { MinDelta[Mu]=Deltas[Mu];
+     for(int ns=1; ns<NumSamples; ns++)
+      MinDelta[Mu]=fmin(MinDelta[Mu], Deltas[2*ns + Mu]);
+   };
+  delete[] Deltas;
+}
+
+void GetMinGridSpacing2D(GBarAccelerator *GBA, int NumSamples,
+                         double (*xyz)[3], double RelTol,
+                         double MinDelta[3])
+{
+  double *Deltas = new double[3*NumSamples];
+  int NumThreads = GetNumThreads();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int ns=0; ns<NumSamples; ns++)
+   GetOptimalGridSpacing2D(GBA, xyz[ns][0], xyz[ns][1], xyz[ns][2],
+                           RelTol, Deltas + 3*ns, 0);
+
+  for(int Mu=0; Mu<3; Mu++)
+   { MinDelta[Mu]=Deltas[Mu];
+     for(int ns=1; ns<NumSamples; ns++)
+      MinDelta[Mu]=fmin(MinDelta[Mu], Deltas[3*ns + Mu]);
+   };
+  delete[] Deltas;
+}
+
+/***************************************************************/
+/* description of the interpolation grid chosen for a given    */
+/* set of GBarAccelerator parameters                           */
+/***************************************************************/
+#define MAXRHOPOINTS 1000
+typedef struct GBAGrid
+ { int NX[2];                            // grid points in x, y
+   int NRho;                             // grid points in Rho
+   double L[2];                          // table extents in x, y
+   double RhoPoints[MAXRHOPOINTS+1];
+ } GBAGrid;
+
+/***************************************************************/
+/* choose the grid by sampling the optimal grid spacing: the   */
+/* x and y spacings are the smallest over all samples, while   */
+/* the Rho points are chosen adaptively by sampling the        */
+/* optimal spacing at successive values of Rho.                */
+/***************************************************************/
+void SelectGBAGrid(GBarAccelerator *GBA, double RelTol, GBAGrid *Grid)
+{
+  int LDim      = GBA->LDim;
+  double RhoMin = GBA->RhoMin;
+  double RhoMax = GBA->RhoMax;
+  double LMax   = GBA->LMax;
+
+  memset(Grid, 0, sizeof(GBAGrid));
+  Grid->NX[1]=1;
+
+  if (LDim==1)
+   { 
+     double L0 = GBA->LBV[0][0];
+     if ( L0 > LMax )
+      { L0=LMax;
+        Log("  Cutting off interpolation table at L=LMax=%e.",LMax);
+      };
+     Grid->L[0]=L0;
+
+     double xRho[4][2]={ { 0.0*L0, RhoMin}, {-0.5*L0, RhoMin},
+                         { 0.0*L0, RhoMax}, {-0.5*L0, RhoMax} };
+     double MinDelta[2];
+     GetMinGridSpacing1D(GBA, 4, xRho, RelTol, MinDelta);
+
+     int nx = ceil( L0 / MinDelta[0] );
+     if (nx<2) nx=2;
+     Grid->NX[0]=nx;
+
+     double *RhoPoints=Grid->RhoPoints;
+     double MinDeltaRho = (RhoMax-RhoMin) / MAXRHOPOINTS;
+     RhoPoints[0]=RhoMin;
+     int nRho=0;
+     bool Done=false;
+     while(!Done)
+      { 
+        double Rho = RhoPoints[nRho];
+        double xRho2[2][2]={ {0.0*L0, Rho}, {-0.5*L0, Rho} };
+        GetMinGridSpacing1D(GBA, 2, xRho2, RelTol, MinDelta);
+        double DeltaRho = fmax(MinDeltaRho,MinDelta[1]);
+        if (Rho + DeltaRho >= RhoMax || nRho==MAXRHOPOINTS-1)
+         { DeltaRho = RhoMax - Rho;
+           Done=true;
+         };
+        RhoPoints[++nRho] = Rho + DeltaRho;
+      };
+     Grid->NRho = nRho+1;
+   }
+  else // LDim==2
+   {
+     double Lx = GBA->LBV[0][0], Ly=GBA->LBV[1][1];
+     if ( LMax<Lx ) 
+      { Lx=LMax;
+        Log("  Cutting off interpolation table at Lx=LMax=%e.",LMax);
+      };
+     if ( LMax<Ly ) 
+      { Ly=LMax;
+        Log("  Cutting off interpolation table at Ly=LMax=%e.",LMax);
+      };
+     Grid->L[0]=Lx;
+     Grid->L[1]=Ly;
+
+     // the x and y spacings are sampled at four points
+     // in the unit cell at each value of Rho, and the
+     // Rho spacing at each Rho is the smallest of those 
+     double xyz[4][3]={ { 0.0*Lx,  0.0*Ly, RhoMin},
+                        { 0.0*Lx, -0.5*Ly, RhoMin},
+                        {-0.5*Lx,  0.0*Ly, RhoMin},
+                        {-0.5*Lx, -0.5*Ly, RhoMin} };
+     double MinDelta[3], Delta[3];
+     GetMinGridSpacing2D(GBA, 4, xyz, RelTol, MinDelta);
+
+     double *RhoPoints=Grid->RhoPoints;
+     int nRho;
+     RhoPoints[0]=RhoMin;
+     if (RhoMax<=RhoMin)
+      { RhoPoints[1] = RhoMin + MinDelta[0];
+        nRho=2;
+      }
+     else
+      { double MinDeltaRho = (RhoMax-RhoMin) / MAXRHOPOINTS;
+        double DeltaRho = MinDelta[2];
+        nRho=0;
+        bool Done=false;
+        while(!Done)
+         { double Rho = RhoPoints[nRho];
+           DeltaRho = fmax(MinDeltaRho, DeltaRho);
+           if (Rho + DeltaRho >= RhoMax || nRho==MAXRHOPOINTS-1)
+            { DeltaRho = RhoMax - Rho;
+              Done=true;
+            };
+           RhoPoints[++nRho] = Rho + DeltaRho;
+           for(int ns=0; ns<4; ns++) 
+            xyz[ns][2]=RhoPoints[nRho];
+           GetMinGridSpacing2D(GBA, 4, xyz, RelTol, Delta);
+           MinDelta[0]=fmin(MinDelta[0], Delta[0]);
+           MinDelta[1]=fmin(MinDelta[1], Delta[1]);
+           DeltaRho = Delta[2];
+         };
+        nRho++;
+      };
+     Grid->NRho = nRho;
+
+     int nx = ceil( Lx / MinDelta[0] );
+     if (nx<2) nx=2;
+     int ny = ceil( Ly / MinDelta[1] );
+     if (ny<2) ny=2;
+     Grid->NX[0]=nx;
+     Grid->NX[1]=ny;
+   };
+
+}
+
+/***************************************************************/
+/* on-disk storage of GBar interpolation tables.               */
+/*                                                             */
+/* If the environment variable SCUFF_GBAR_CACHE_DIR is set,    */
+/* interpolation tables are written to that directory once     */
+/* they are built, and later requests for a table with the     */
+/* same lattice, wavenumber, Bloch vector, Rho range, and      */
+/* tolerance (in the same run or in subsequent runs) read the  */
+/* table from disk instead of rebuilding it.                   */
+/*                                                             */
+/* Tables for different Bloch vectors cannot be reused, but    */
+/* the interpolation grid chosen for one Bloch vector is a     */
+/* good choice for nearby Bloch vectors, so we also store the  */
+/* grid under a key in which kBloch is rounded to a bin of     */
+/* width 1/GBA_KBLOCH_BINS of the Brillouin zone; a new table  */
+/* whose Bloch vector falls in the same bin as an existing one */
+/* reuses its grid and skips the grid-selection step.          */
+/*                                                             */
+/* Files are named by the hash of the key, and the full key is */
+/* stored alongside the data and compared on reading, so hash  */
+/* collisions are harmless. All files are written under a      */
+/* temporary name and renamed into place, so concurrent runs   */
+/* sharing a cache directory never see partial files.          */
+/***************************************************************/
+#define GBA_CACHE_VERSION 1
+#define GBA_KBLOCH_BINS   16
+
+long JenkinsHash(const char *key, size_t len); // in FIBBICache.cc
+
+typedef struct GBACacheKey
+ { int Version;
+   int LDim;
+   int ExcludeInnerCells;
+   int NMax;
+   double LBV[2][3];
+   double RhoMin, RhoMax;
+   double k[2];
+   double kBloch[2];
+   double RelTol;
+ } GBACacheKey;
+
+void GetGBACacheKey(GBarAccelerator *GBA, double RelTol, bool Binned,
+                    GBACacheKey *Key)
+{
+  memset(Key, 0, sizeof(GBACacheKey));
+  Key->Version           = GBA_CACHE_VERSION;
+  Key->LDim              = GBA->LDim;
+  Key->ExcludeInnerCells = GBA->ExcludeInnerCells ? 1 : 0;
+  Key->NMax              = 0;
+  CheckEnv("SCUFF_GBAR_NMAX",&(Key->NMax),false);
+  for(int nd=0; nd<GBA->LDim; nd++)
+   for(int j=0; j<3; j++)
+    Key->LBV[nd][j] = GBA->LBV[nd][j];
+  Key->RhoMin = GBA->RhoMin;
+  Key->RhoMax = GBA->RhoMax;
+  Key->k[0]   = real(GBA->k);
+  Key->k[1]   = imag(GBA->k);
+  Key->RelTol = RelTol;
+  for(int nd=0; GBA->kBloch && nd<GBA->LDim; nd++)
+   { double kB = GBA->kBloch[nd];
+     if (Binned)
+      kB = (double)lround( kB*GBA->LBV[nd][nd]*GBA_KBLOCH_BINS/(2.0*M_PI) );
+     Key->kBloch[nd] = kB;
+   };
+}
+
+/***************************************************************/
+/* returns the name of the cache file for the given key, or 0  */
+/* if there is no cache directory                              */
+/***************************************************************/
+char *GetGBACacheFileName(GBACacheKey *Key, const char *Suffix)
+{
+  char *CacheDir=getenv("SCUFF_GBAR_CACHE_DIR");
+  if (!CacheDir || CacheDir[0]==0)
+   return 0;
+  unsigned long Hash=(unsigned long)JenkinsHash((const char *)Key, sizeof(GBACacheKey));
+  return vstrdup("%s/GBar_%016lx.%s",CacheDir,Hash,Suffix);
+}
+
+/***************************************************************/
+/* returns true if FileName exists and begins with Key         */
+/***************************************************************/
+bool KeyFileMatches(const char *FileName, GBACacheKey *Key, FILE **pf=0)
+{
+  FILE *f=fopen(FileName,"r");
+  if (!f) return false;
+  GBACacheKey FileKey;
+  bool Match =    fread(&FileKey, sizeof(GBACacheKey), 1, f)==1
+               && memcmp(&FileKey, Key, sizeof(GBACacheKey))==0;
+  if (Match && pf)
+   *pf=f;
+  else
+   fclose(f);
+  return Match;
+}
+
+/***************************************************************/
+/* write Key followed by NumBytes bytes of Data to FileName,   */
+/* via a temporary file                                        */
+/***************************************************************/
+void WriteKeyFile(const char *FileName, GBACacheKey *Key,
+                  void *Data=0, size_t NumBytes=0)
+{
+  char *TmpFileName=vstrdup("%s.tmp%i.%p",FileName,(int)getpid(),(void *)Key);
+  FILE *f=fopen(TmpFileName,"w");
+  bool Failed = (f==0);
+  if (f)
+   { Failed =    fwrite(Key, sizeof(GBACacheKey), 1, f)!=1
+              || (NumBytes>0 && fwrite(Data, NumBytes, 1, f)!=1);
+     if (fclose(f)) Failed=true;
+   };
+  if ( Failed || rename(TmpFileName, FileName) )
+   { Warn("could not write GBar cache file %s",FileName);
+     unlink(TmpFileName);
+   };
+  free(TmpFileName);
+}
+
+/***************************************************************/
+/* attempt to read the interpolation table for GBA from the    */
+/* cache directory; returns true on success.                   */
+/***************************************************************/
+bool ReadGBATable(GBarAccelerator *GBA, double RelTol)
+{
+  GBACacheKey Key;
+  GetGBACacheKey(GBA, RelTol, false, &Key);
+  char *KeyFileName=GetGBACacheFileName(&Key, "key");
+  if (!KeyFileName) 
+   return false;
+
+  bool Success=false;
+  if ( KeyFileMatches(KeyFileName, &Key) )
+   { char *TableFileName=GetGBACacheFileName(&Key, "table");
+     if (GBA->LDim==1)
+      GBA->I2D=new Interp2D(TableFileName);
+     else
+      GBA->I3D=new Interp3D(TableFileName);
+     free(TableFileName);
+     Success=true;
+   };
+  free(KeyFileName);
+  return Success;
+}
+
+void WriteGBATable(GBarAccelerator *GBA, double RelTol)
+{
+  GBACacheKey Key;
+  GetGBACacheKey(GBA, RelTol, false, &Key);
+  char *KeyFileName=GetGBACacheFileName(&Key, "key");
+  if (!KeyFileName)
+   return;
+
+  // the table goes into place before the key file that
+  // certifies it, so readers never find a key without a table
+  char *TableFileName=GetGBACacheFileName(&Key, "table");
+  char *TmpFileName=vstrdup("%s.tmp%i.%p",TableFileName,(int)getpid(),(void *)GBA);
+  if (GBA->I2D) 
+   GBA->I2D->WriteToFile(TmpFileName);
+  else
+   GBA->I3D->WriteToFile(TmpFileName);
+  if ( rename(TmpFileName, TableFileName) )
+   { Warn("could not write GBar cache file %s",TableFileName);
+     unlink(TmpFileName);
+   }
+  else
+   WriteKeyFile(KeyFileName, &Key);
+
+  free(TmpFileName);
+  free(TableFileName);
+  free(KeyFileName);
+}
+
+bool ReadGBAGrid(GBarAccelerator *GBA, double RelTol, GBAGrid *Grid)
+{
+  GBACacheKey Key;
+  GetGBACacheKey(GBA, RelTol, true, &Key);
+  char *FileName=GetGBACacheFileName(&Key, "grid");
+  if (!FileName)
+   return false;
+
+  FILE *f=0;
+  bool Success=false;
+  if ( KeyFileMatches(FileName, &Key, &f) )
+   { Success = fread(Grid, sizeof(GBAGrid), 1, f)==1;
+     fclose(f);
+   };
+  free(FileName);
+  return Success;
+}
+
+void WriteGBAGrid(GBarAccelerator *GBA, double RelTol, GBAGrid *Grid)
+{
+  GBACacheKey Key;
+  GetGBACacheKey(GBA, RelTol, true, &Key);
+  char *FileName=GetGBACacheFileName(&Key, "grid");
+  if (!FileName)
+   return;
+  WriteKeyFile(FileName, &Key, (void *)Grid, sizeof(GBAGrid));
+  free(FileName);
+}
+
+/***************************************************************/
+/* compute GBar values and derivatives at all nodes of the     */
+/* interpolation grid, in the layout expected by the data-table*/
+/* constructors of Interp2D (1D lattices: nodes (x,Rho), 4     */
+/* data values per node) and Interp3D (2D lattices: nodes      */
+/* (x,y,Rho), 8 data values per node), with real parts stored  */
+/* before imaginary parts as in GBarVDPhi2D and GBarVDPhi3D.   */
+/*                                                             */
+/* all nodes with the same Rho share the expensive factors of  */
+/* the Ewald spectral sum, so they are evaluated together by   */
+/* GBarVDEwaldBatch; each Rho plane is split into enough       */
+/* batches to keep all threads busy.                           */
+/***************************************************************/
+double *GetGBarPhiVDTable(GBarAccelerator *GBA,
+                          double *XPoints, int NX,
+                          double *YPoints, int NY,
+                          double *RhoPoints, int NRho)
+{
+  int LDim      = GBA->LDim;
+  int NData     = (LDim==1) ? 4 : 8;
+  int NFun      = 2;
+  int NPerPlane = NX*NY;
+  double *PhiVDTable
+   = (double *)mallocEC(NPerPlane*NRho*NFun*NData*sizeof(double));
+
+  int NumThreads = GetNumThreads();
+  int ChunksPerPlane = (4*NumThreads + NRho - 1) / NRho;
+  if (ChunksPerPlane > NPerPlane) ChunksPerPlane=NPerPlane;
+  int ChunkSize = (NPerPlane + ChunksPerPlane - 1) / ChunksPerPlane;
+  int NumBatches = NRho*ChunksPerPlane;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int nb=0; nb<NumBatches; nb++)
+   { 
+     int nRho = nb / ChunksPerPlane;
+     int p0   = (nb % ChunksPerPlane) * ChunkSize;
+     int p1   = p0 + ChunkSize;
+     if (p1>NPerPlane) p1=NPerPlane;
+     int NP   = p1-p0;
+     if (NP<=0) continue;
+
+     double *X = new double[3*NP], *Y=X+NP, *Z=Y+NP;
+     cdouble *GBarVD = new cdouble[8*NP];
+     for(int np=0; np<NP; np++)
+      { int nx = (p0+np) / NY, ny = (p0+np) % NY;
+        X[np] = XPoints[nx];
+        if (LDim==1)
+         { Y[np] = RhoPoints[nRho];
+           Z[np] = 0.0;
+         }
+        else
+         { Y[np] = YPoints[ny];
+           Z[np] = RhoPoints[nRho];
+         };
+      };
+
+     GBarVDEwaldBatch(NP, X, Y, Z, GBA->k, GBA->kBloch, GBA->LBV, LDim,
+                      -1.0, GBA->ExcludeInnerCells, GBarVD);
+
+     for(int np=0; np<NP; np++)
+      { int nx = (p0+np) / NY, ny = (p0+np) % NY;
+        // node index in the order (x, [y,] Rho), Rho fastest
+        int nNode = nRho + NRho*(ny + NY*nx);
+        double *PhiVD = PhiVDTable + NFun*NData*nNode;
+        if (LDim==1)
+         { int Index[4]={0, 1, 2, 4}; // G, dG/dx, dG/dRho, d2G/dxdRho
+           for(int nd=0; nd<4; nd++)
+            { PhiVD[nd]         = real(GBarVD[Index[nd]*NP + np]);
+              PhiVD[NData + nd] = imag(GBarVD[Index[nd]*NP + np]);
+            };
+         }
+        else
+         for(int nd=0; nd<8; nd++)
+          { PhiVD[nd]         = real(GBarVD[nd*NP + np]);
+            PhiVD[NData + nd] = imag(GBarVD[nd*NP + np]);
+          };
+      };
+
+     delete[] X;
+     delete[] GBarVD;
+   };
+
+  return PhiVDTable;
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -423,49 +897,35 @@ GBarAccelerator *CreateGBarAccelerator(HMatrix *LBasis,
    }
 
   /***************************************************************/
+  /* read the interpolation table from the cache directory if a  */
+  /* table for these parameters was built before; otherwise      */
+  /* choose the interpolation grid (or reuse the grid chosen for */
+  /* a nearby Bloch vector) and build the table.                 */
   /***************************************************************/
-  /***************************************************************/
+  double Time0=Secs();
+  if ( ReadGBATable(GBA, RelTol) )
+   { Log("  Read GBar interpolation table from cache (%.2f s).",Secs()-Time0);
+     return GBA;
+   };
+
+  GBAGrid Grid;
+  bool GridFromCache=ReadGBAGrid(GBA, RelTol, &Grid);
+  if (!GridFromCache)
+   { SelectGBAGrid(GBA, RelTol, &Grid);
+     WriteGBAGrid(GBA, RelTol, &Grid);
+   };
+  double GridTime=Secs()-Time0;
+
+  int nx=Grid.NX[0], ny=Grid.NX[1], nRho=Grid.NRho;
+  double *RhoPoints=Grid.RhoPoints;
+  int NMax;
+  bool HaveNMax=CheckEnv("SCUFF_GBAR_NMAX",&NMax);
+
+  Time0=Secs();
   if (LDim==1)
    {
-      // sample the optimal grid spacing at a few points
-      // in the domain of interest and take the smallest
-      double L0 = GBA->LBV[0][0], MinDelta[2], Delta[2];
-      if ( L0 > LMax )
-       { L0=LMax;
-         Log("  Cutting off interpolation table at L=LMax=%e.",LMax);
-       };
-      GetOptimalGridSpacing1D(GBA,  0.0*L0, RhoMin, RelTol, MinDelta, 0);
-      GetOptimalGridSpacing1D(GBA, -0.5*L0, RhoMin, RelTol, Delta, MinDelta);
-      GetOptimalGridSpacing1D(GBA,  0.0*L0, RhoMax, RelTol, Delta, MinDelta);
-      GetOptimalGridSpacing1D(GBA, -0.5*L0, RhoMax, RelTol, Delta, MinDelta);
-
-      double DeltaX = MinDelta[0];
-      int nx = ceil( L0 / DeltaX );
-      if (nx<2) nx=2;
-      DeltaX = L0 / ((double)(nx-1));
-      double *XPoints = new double[nx];
-      for(int n=0; n<nx; n++)
-       XPoints[n] = ((double)n)*DeltaX - 0.5*L0;
-
-      #define MAXRHOPOINTS 1000
-      double RhoPoints[MAXRHOPOINTS];
-      double MinDeltaRho = (RhoMax-RhoMin) / MAXRHOPOINTS;
-      RhoPoints[0]=RhoMin;
-      int nRho=0;
-      bool Done=false;
-      while(!Done)
-       { 
-         double Rho = RhoPoints[nRho];
-         GetOptimalGridSpacing1D(GBA,  0.0*L0, Rho, RelTol, MinDelta, 0);
-         GetOptimalGridSpacing1D(GBA, -0.5*L0, Rho, RelTol, Delta, MinDelta);
-         double DeltaRho = fmax(MinDeltaRho,MinDelta[1]);
-         if (Rho + DeltaRho >= RhoMax)
-          { DeltaRho = RhoMax - Rho;
-            Done=true;
-          };
-         RhoPoints[++nRho] = Rho + DeltaRho;
-       };
-      nRho++; 
+      double L0 = Grid.L[0];
+      double DeltaX = L0 / ((double)(nx-1));
 
       Log("  Initializing %ix%i interpolation table with ",nx,nRho);
       Log("  X points at [%g:%g:%g] ",0.0,DeltaX,L0);
@@ -474,73 +934,62 @@ GBarAccelerator *CreateGBarAccelerator(HMatrix *LBasis,
        LogC("%.2e, ",RhoPoints[n]);
       LogC("%.2e)",RhoPoints[nRho-1]);
 
-      int NMax;
-      if (CheckEnv("SCUFF_GBAR_NMAX",&NMax))
+      if (HaveNMax)
        { if (nx>NMax) nx=NMax;
          if (nRho>NMax) nRho=NMax;
-       }
+       };
 
+      double *XPoints = new double[nx];
+      for(int n=0; n<nx; n++)
+       XPoints[n] = ((double)n)*DeltaX - 0.5*L0;
+
+      double *PhiVDTable=GetGBarPhiVDTable(GBA, XPoints, nx, 0, 1, RhoPoints, nRho);
       GBA->I3D=0;
-      GBA->I2D=new Interp2D(XPoints, nx, RhoPoints, nRho,
-                            2, GBarVDPhi2D, (void *)GBA, LMDILogLevel);
+      GBA->I2D=new Interp2D(PhiVDTable, XPoints, nx, RhoPoints, nRho,
+                            2, LMDILogLevel);
 
+      free(PhiVDTable);
       delete[] XPoints;
-
    }
   else // LDim==2
    {
-      double Lx = GBA->LBV[0][0], Ly=GBA->LBV[1][1];
-      if ( LMax<Lx ) 
-       { Lx=LMax;
-         Log("  Cutting off interpolation table at Lx=LMax=%e.",LMax);
-       };
-      if ( LMax<Ly ) 
-       { Ly=LMax;
-         Log("  Cutting off interpolation table at Ly=LMax=%e.",LMax);
-       };
+      double Lx = Grid.L[0], Ly = Grid.L[1];
 
-      // estimate the optimal grid spacings at a few points
-      // in the domain of interest and take the smallest
-      double MinDelta[3], Delta[3];
-      GetOptimalGridSpacing2D(GBA,  0.0*Lx,  0.0*Ly, RhoMin, RelTol, MinDelta, 0);
-      GetOptimalGridSpacing2D(GBA,  0.0*Lx, -0.5*Ly, RhoMin, RelTol, Delta, MinDelta);
-      GetOptimalGridSpacing2D(GBA, -0.5*Lx,  0.0*Ly, RhoMin, RelTol, Delta, MinDelta);
-      GetOptimalGridSpacing2D(GBA, -0.5*Lx, -0.5*Ly, RhoMin, RelTol, Delta, MinDelta);
-      if (RhoMax!=RhoMin)
-       { GetOptimalGridSpacing2D(GBA,  0.0*Lx,  0.0*Ly, RhoMax, RelTol, Delta, MinDelta);
-         GetOptimalGridSpacing2D(GBA,  0.0*Lx, -0.5*Ly, RhoMax, RelTol, Delta, MinDelta);
-         GetOptimalGridSpacing2D(GBA, -0.5*Lx,  0.0*Ly, RhoMax, RelTol, Delta, MinDelta);
-         GetOptimalGridSpacing2D(GBA, -0.5*Lx, -0.5*Ly, RhoMax, RelTol, Delta, MinDelta);
+      if (HaveNMax)
+       { if (nx>NMax) nx=NMax;
+         if (ny>NMax) ny=NMax;
+         if (nRho>NMax) 
+          { double RhoA=RhoPoints[0], RhoB=RhoPoints[nRho-1];
+            nRho=NMax;
+            for(int n=0; n<nRho; n++)
+             RhoPoints[n] = RhoA + n*(RhoB-RhoA)/((double)(nRho-1));
+          };
        };
 
-      int nx   = ceil( Lx / MinDelta[0] );
-      if (nx<2) nx=2;
+      Log("  Initializing %ix%ix%i interpolation table",nx,ny,nRho);
 
-      int ny   = ceil( Ly / MinDelta[1] );
-      if (ny<2) ny=2;
+      double *XPoints = new double[nx];
+      for(int n=0; n<nx; n++)
+       XPoints[n] = -0.5*Lx + n*Lx/((double)(nx-1));
+      double *YPoints = new double[ny];
+      for(int n=0; n<ny; n++)
+       YPoints[n] = -0.5*Ly + n*Ly/((double)(ny-1));
 
-      int nRho; 
-      if (RhoMax<=RhoMin)
-       { RhoMax = RhoMin + MinDelta[0];
-         nRho=2;
-       }
-      else
-       { nRho = ceil( (RhoMax-RhoMin) / MinDelta[1] );
-         if (nRho<2) nRho=2;
-       }
+      double *PhiVDTable=GetGBarPhiVDTable(GBA, XPoints, nx, YPoints, ny, RhoPoints, nRho);
+      GBA->I2D=0;
+      GBA->I3D=new Interp3D(PhiVDTable, XPoints, nx, YPoints, ny, RhoPoints, nRho,
+                            2, LMDILogLevel);
 
-      int NMax;
-      if (CheckEnv("SCUFF_GBAR_NMAX",&NMax))
-       { if (nx>NMax) nx=NMax;
-         if (ny>NMax) ny=NMax;
-         if (nRho>NMax) nRho=NMax;
-       }
+      free(PhiVDTable);
+      delete[] XPoints;
+      delete[] YPoints;
+   };
+  double TableTime=Secs()-Time0;
 
-      GBA->I2D=0;
-      GBA->I3D=new Interp3D(-0.5*Lx, 0.5*Lx, nx, -0.5*Ly, 0.5*Ly, ny,
-                            RhoMin, RhoMax, nRho,
-                            2, GBarVDPhi3D, (void *)GBA, LMDILogLevel);
-   }
+  Log("  GBar interpolation table: grid %s in %.2f s, table built in %.2f s.",
+       GridFromCache ? "read from cache" : "selected", GridTime, TableTime);
+
+  WriteGBATable(GBA, RelTol);
 
   return GBA;
    
@@ -619,38 +1068,42 @@ cdouble GetGBarFullEwald(double R[3], GBarAccelerator *GBA,
   int LDim               = GBA->LDim;
   bool ExcludeInnerCells = GBA->ExcludeInnerCells;
 
-  GBarVDEwald(R, k, kBloch, GBA->LBV, LDim, -1.0, ExcludeInnerCells, G);
+  if (ddGBar==0)
+   GBarVDEwald(R, k, kBloch, GBA->LBV, LDim, -1.0, ExcludeInnerCells, G);
+  else
+   { 
+     // finite-differencing to get unmixed second partials; the
+     // center point and its six displacements are evaluated in
+     // a single batch (the points displaced in x and y share the
+     // spectral-sum factors of the center point)
+     double X[7], Y[7], Z[7], Delta[3];
+     for(int np=0; np<7; np++)
+      { X[np]=R[0]; Y[np]=R[1]; Z[np]=R[2]; }
+     for(int Mu=0; Mu<3; Mu++)
+      { Delta[Mu] = (R[Mu]==0.0) ? 1.0e-4 : 1.0e-4*fabs(R[Mu]);
+        double *XYZ = (Mu==0) ? X : (Mu==1) ? Y : Z;
+        XYZ[1 + 2*Mu] += Delta[Mu];
+        XYZ[2 + 2*Mu] -= Delta[Mu];
+      };
 
-  if (dGBar) 
-   { dGBar[0]=G[1];
-     dGBar[1]=G[2];
-     dGBar[2]=G[3];
-   };
+     cdouble GBatch[8*7];
+     GBarVDEwaldBatch(7, X, Y, Z, k, kBloch, GBA->LBV, LDim,
+                      -1.0, ExcludeInnerCells, GBatch);
+     for(int ns=0; ns<8; ns++)
+      G[ns]=GBatch[7*ns + 0];
 
-  if (ddGBar)
-   { 
      ddGBar[3*0 + 1] = ddGBar[3*1 + 0] = G[4];
      ddGBar[3*0 + 2] = ddGBar[3*2 + 0] = G[5];
      ddGBar[3*1 + 2] = ddGBar[3*2 + 1] = G[6];
-    
-     // finite-differencing to get unmixed second partials
      for(int Mu=0; Mu<3; Mu++)
-      { 
-         double Delta = (R[Mu]==0.0) ? 1.0e-4 : 1.0e-4*fabs(R[Mu]);
-         double RR[3];
-         RR[0]=R[0]; RR[1]=R[1]; RR[2]=R[2]; 
-
-         RR[Mu] += Delta;
-         cdouble Gp[8];
-         GBarVDEwald(RR, k, kBloch, GBA->LBV, LDim, -1.0, ExcludeInnerCells, Gp);
-
-         RR[Mu] -= 2.0*Delta;
-         cdouble Gm[8];
-         GBarVDEwald(RR, k, kBloch, GBA->LBV, LDim, -1.0, ExcludeInnerCells, Gm);
-
-         ddGBar[3*Mu + Mu] = (Gp[0] + Gm[0] - 2.0*G[0]) / (Delta*Delta);
-      };
+      ddGBar[3*Mu + Mu] = (GBatch[1+2*Mu] + GBatch[2+2*Mu] - 2.0*G[0]) 
+                          / (Delta[Mu]*Delta[Mu]);
+   };
 
+  if (dGBar) 
+   { dGBar[0]=G[1];
+     dGBar[1]=G[2];
+     dGBar[2]=G[3];
    };
 
   return G[0];
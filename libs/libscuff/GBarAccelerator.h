@@ -39,6 +39,14 @@ void GBarVDEwald(double *R, cdouble k, double *kBloch,
                  double (*LBV)[3], int LDim,
                  double E, bool ExcludeInnerCells, cdouble *GBarVD);
 
+// batched version: GBarVD[ns*NumPoints + np] = component #ns 
+// of GBarVD at the point (X[np], Y[np], Z[np])
+void GBarVDEwaldBatch(int NumPoints, double *X, double *Y, double *Z,
+                      cdouble k, double *kBloch,
+                      double (*LBV)[3], int LDim,
+                      double E, bool ExcludeInnerCells,
+                      cdouble *GBarVD);
+
 /***************************************************************/
 /* interpolation-based acceleration of periodic GF evaluation  */
 /***************************************************************/
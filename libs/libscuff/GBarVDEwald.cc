@@ -602,6 +602,9 @@ void AddGFull(double R[3], cdouble k, double kBloch[2],
  
 }
 
+void AddGShortTerm(double *R, double L[2], cdouble PhaseFactor,
+                   cdouble k, double E, cdouble *Sum);
+
 /***************************************************************/
 /* add the contribution of a single direct lattice vector L    */
 /* to the direct-lattice sum, where L = n1*L1 + n2*L2.         */
@@ -660,6 +663,17 @@ void AddGShort(double *R, cdouble k, double *kBloch,
 
   cdouble PhaseFactor=exp( II * (kBloch[0]*L[0] + kBloch[1]*L[1]) ) / (8.0*M_PI);
 
+  AddGShortTerm(R, L, PhaseFactor, k, E, Sum);
+}
+
+/***************************************************************/
+/* the point-dependent part of AddGShort: add the contribution */
+/* of the lattice cell L, whose phase factor is                */
+/* PhaseFactor = exp(i kBloch.L)/(8 pi), to Sum.               */
+/***************************************************************/
+void AddGShortTerm(double *R, double L[2], cdouble PhaseFactor,
+                   cdouble k, double E, cdouble *Sum)
+{
   double RmL[3], rml2, rml, rml3, rml4, rml5, rml6, rml7;
   cdouble g2p, g3p, g2m, g3m, g4, ggPgg, ggMgg, Term;
 
@@ -995,4 +1009,509 @@ void GBarVDEwald(double *R, cdouble k, double *kBloch0,
 
 } 
 
+/***************************************************************/
+/* Batched evaluation of GBar and its derivatives at many      */
+/* displacement vectors at once.                               */
+/*                                                             */
+/* Inputs and outputs are in structure-of-arrays layout:       */
+/*                                                             */
+/*  X[np], Y[np], Z[np]         = coordinates of point #np     */
+/*  GBarVD[ns*NumPoints + np]   = component #ns of GBarVD      */
+/*                                (as in GBarVDEwald) at #np   */
+/*                                                             */
+/* The results agree with those of GBarVDEwald point by point  */
+/* (each point stops accumulating lattice shells as soon as    */
+/* its own sums have converged), but the work is organized     */
+/* around the lattice rather than the points:                  */
+/*                                                             */
+/*  -- quantities that depend only on the lattice vector (the  */
+/*     Bloch phase of each direct-lattice cell, and P-G and Q  */
+/*     for each reciprocal-lattice vector) are computed once   */
+/*     per batch rather than once per point;                   */
+/*                                                             */
+/*  -- the plane-wave factors exp(i(P-G).R) of the spectral    */
+/*     sum are computed for all points in a loop over the      */
+/*     coordinate arrays that the compiler can vectorize;      */
+/*                                                             */
+/*  -- the remaining factors of the spectral sum depend only   */
+/*     on z (2D lattices) or Rho (1D lattices), and they are   */
+/*     computed once per distinct value of that coordinate in  */
+/*     the batch. On an interpolation grid, every plane (2D)   */
+/*     or line (1D) of grid points shares a single value, so   */
+/*     nearly all the erfc and exponential-integral            */
+/*     evaluations of the spectral sum are eliminated.         */
+/***************************************************************/
+typedef struct EwaldBatch
+ { 
+   int NP;                 // number of points
+   double *X, *Y, *Z;      // point coordinates
+   double *Rho;            // distance from lattice axis (1D)
+   double *E;              // Ewald parameter at each point
+   int NU;                 // number of distinct values of z (2D) or Rho (1D)
+   double *UValue;         // the distinct values
+   double *UE;             // Ewald parameter for each distinct value (1D)
+   int *UIndex;            // UIndex[np] = index of point's value in UValue
+   bool *Active;           // true for points whose sums have not converged
+   bool *UActive;          // true for values belonging to an active point
+   int *ConvergedIters;
+   cdouble *Sum, *LastSum; // NSUM values per point, stored point by point
+   double *CosTheta, *SinTheta;
+ } EwaldBatch;
+
+typedef struct ValueIndex 
+ { double Value;
+   int Index;
+ } ValueIndex;
+
+static int CompareValueIndex(const void *p1, const void *p2)
+{ 
+  double V1=((const ValueIndex *)p1)->Value, V2=((const ValueIndex *)p2)->Value;
+  return (V1<V2) ? -1 : (V1>V2) ? 1 : 0;
+}
+
+/***************************************************************/
+/* group points by (exactly) equal values of Values[np]        */
+/***************************************************************/
+static void GetDistinctValues(EwaldBatch *B, double *Values)
+{
+  int NP=B->NP;
+  ValueIndex *VI = new ValueIndex[NP];
+  for(int np=0; np<NP; np++)
+   { VI[np].Value=Values[np];
+     VI[np].Index=np;
+   };
+  qsort(VI, NP, sizeof(ValueIndex), CompareValueIndex);
+
+  B->NU=0;
+  for(int n=0; n<NP; n++)
+   { if ( n==0 || VI[n].Value!=VI[n-1].Value )
+      { B->UValue[B->NU] = VI[n].Value;
+        B->UE[B->NU]     = B->E[VI[n].Index];
+        B->NU++;
+      };
+     B->UIndex[VI[n].Index] = B->NU-1;
+   };
+  delete[] VI;
+}
+
+/***************************************************************/
+/* mark active the distinct values that belong to active points*/
+/***************************************************************/
+static void UpdateUActive(EwaldBatch *B)
+{ 
+  for(int nu=0; nu<B->NU; nu++)
+   B->UActive[nu]=false;
+  for(int np=0; np<B->NP; np++)
+   if (B->Active[np])
+    B->UActive[B->UIndex[np]]=true;
+}
+
+/***************************************************************/
+/* CosTheta[np] + i*SinTheta[np] = exp(i*(Kx*X[np] + Ky*Y[np]))*/
+/* this loop is written for the vectorizer: no branches, unit  */
+/* stride, and math-library calls with vector variants.        */
+/***************************************************************/
+static void GetPlaneWaveFactors(EwaldBatch *B, double Kx, double Ky)
+{
+  int NP=B->NP;
+  double *X=B->X, *Y=B->Y, *CosTheta=B->CosTheta, *SinTheta=B->SinTheta;
+#ifdef USE_OPENMP
+#pragma omp simd
+#endif
+  for(int np=0; np<NP; np++)
+   { double Theta = Kx*X[np] + Ky*Y[np];
+     CosTheta[np] = cos(Theta);
+     SinTheta[np] = sin(Theta);
+   };
+}
+
+/***************************************************************/
+/* per-point convergence test after a shell of lattice vectors */
+/* has been added; points that have converged are deactivated. */
+/* returns the number of points still active.                  */
+/***************************************************************/
+static int UpdateConvergence(EwaldBatch *B)
+{
+  int NumActive=0;
+  for(int np=0; np<B->NP; np++)
+   { 
+     if (!B->Active[np]) continue;
+
+     cdouble *Sum=B->Sum + NSUM*np, *LastSum=B->LastSum + NSUM*np;
+     double MaxRelDelta=0.0, MaxAbsDelta=0.0;
+     for(int ns=0; ns<NSUM; ns++)
+      { double Delta=abs(Sum[ns]-LastSum[ns]);
+        if ( Delta>MaxAbsDelta )
+         MaxAbsDelta=Delta;
+        double AbsSum=abs(Sum[ns]);
+        if ( AbsSum>0.0 && (Delta > MaxRelDelta*AbsSum) )
+         MaxRelDelta=Delta/AbsSum;
+      };
+     if ( MaxAbsDelta<ABSTOL || MaxRelDelta<RELTOL )
+      B->ConvergedIters[np]++;
+     else
+      B->ConvergedIters[np]=0;
+     memcpy(LastSum,Sum,NSUM*sizeof(cdouble));
+
+     if (B->ConvergedIters[np]>=3)
+      B->Active[np]=false;
+     else
+      NumActive++;
+   };
+  return NumActive;
+}
+
+static void ResetConvergence(EwaldBatch *B)
+{ 
+  for(int np=0; np<B->NP; np++)
+   { B->Active[np]=true;
+     B->ConvergedIters[np]=0;
+   };
+  memcpy(B->LastSum, B->Sum, NSUM*B->NP*sizeof(cdouble));
+}
+
+/***************************************************************/
+/* batched version of GetGBarNearby                            */
+/***************************************************************/
+static void AddGShortBatch(EwaldBatch *B, cdouble k, double *kBloch,
+                           int n1, int n2, double (*LBV)[3], int LDim)
+{
+  double L[2];
+  if (LDim==1)
+   { L[0] = n1*LBV[0][0];
+     L[1] = n1*LBV[0][1];
+   }
+  else
+   { L[0] = n1*LBV[0][0] + n2*LBV[1][0];
+     L[1] = n1*LBV[0][1] + n2*LBV[1][1];
+   };
+  cdouble PhaseFactor=exp( II * (kBloch[0]*L[0] + kBloch[1]*L[1]) ) / (8.0*M_PI);
+
+  for(int np=0; np<B->NP; np++)
+   { if (!B->Active[np]) continue;
+     double R[3];
+     R[0]=B->X[np];
+     R[1]=B->Y[np];
+     R[2]=B->Z[np];
+     if (B->E[np]==0.0)
+      AddGShort(R, k, kBloch, n1, n2, LBV, LDim, 0.0, B->Sum + NSUM*np);
+     else
+      AddGShortTerm(R, L, PhaseFactor, k, B->E[np], B->Sum + NSUM*np);
+   };
+}
+
+static void GetGBarNearbyBatch(EwaldBatch *B, cdouble k, double *kBloch,
+                               double (*LBV)[3], int LDim,
+                               bool ExcludeInnerCells)
+{ 
+  memset(B->Sum, 0, NSUM*B->NP*sizeof(cdouble));
+  for(int np=0; np<B->NP; np++)
+   B->Active[np]=true;
+
+  if (LDim==1)
+   { 
+     for (int n1=-NFIRSTROUND; n1<=NFIRSTROUND; n1++)
+      if ( !ExcludeInnerCells || abs(n1)>1 )
+       AddGShortBatch(B, k, kBloch, n1, 0, LBV, LDim);
+   }
+  else
+   { 
+     for (int n1=-NFIRSTROUND; n1<=NFIRSTROUND; n1++)
+      for (int n2=-NFIRSTROUND; n2<=NFIRSTROUND; n2++)
+       if ( !ExcludeInnerCells || abs(n1)>1 || abs(n2)>1 )
+        AddGShortBatch(B, k, kBloch, n1, n2, LBV, LDim);
+   };
+
+  ResetConvergence(B);
+  int NumActive=B->NP;
+  for(int NN=NFIRSTROUND+1; NumActive>0 && NN<=NMAX; NN++)
+   {  
+     if (LDim==1)
+      { AddGShortBatch(B, k, kBloch,  NN, 0, LBV, LDim);
+        AddGShortBatch(B, k, kBloch, -NN, 0, LBV, LDim);
+      }
+     else
+      { for(int n=-NN; n<NN; n++)
+         { AddGShortBatch(B, k, kBloch,   n,  NN, LBV, LDim);
+           AddGShortBatch(B, k, kBloch,  NN,  -n, LBV, LDim);
+           AddGShortBatch(B, k, kBloch,  -n, -NN, LBV, LDim);
+           AddGShortBatch(B, k, kBloch, -NN,   n, LBV, LDim);
+         };
+      };
+     NumActive=UpdateConvergence(B);
+   };
+}
+
+/***************************************************************/
+/* batched versions of AddGLong2D and AddGLong1D.              */
+/* EEF, GT are workspaces with room for 2*NU values.           */
+/* returns true if a singularity was encountered.              */
+/***************************************************************/
+static bool AddGLong2DBatch(EwaldBatch *B, cdouble k, double P[2],
+                            int n1, int n2, double Gamma[3][3],
+                            cdouble *EEF)
+{ 
+  double PmG[2];
+  PmG[0] = P[0] - n1*Gamma[0][0] - n2*Gamma[1][0];
+  PmG[1] = P[1] - n1*Gamma[0][1] - n2*Gamma[1][1];
+
+  cdouble Q = sqrt ( PmG[0]*PmG[0] + PmG[1]*PmG[1] - k*k );
+  if ( abs(Q) < 1.0e-4*abs(k) )
+   return true;
+
+  double E=B->E[0];
+  UpdateUActive(B);
+  for(int nu=0; nu<B->NU; nu++)
+   if (B->UActive[nu])
+    GetEEF(B->UValue[nu], E, Q, EEF + 2*nu + 0, EEF + 2*nu + 1);
+
+  GetPlaneWaveFactors(B, PmG[0], PmG[1]);
+
+  for(int np=0; np<B->NP; np++)
+   { 
+     if (!B->Active[np]) continue;
+
+     cdouble PreFactor = cdouble(B->CosTheta[np], B->SinTheta[np]) / Q;
+     cdouble PEEF      = PreFactor*EEF[2*B->UIndex[np] + 0];
+     cdouble PEEFPrime = PreFactor*EEF[2*B->UIndex[np] + 1];
+
+     cdouble *GBarVD = B->Sum + NSUM*np;
+     GBarVD[0] += PEEF;
+     GBarVD[1] += II*PmG[0]*PEEF;
+     GBarVD[2] += II*PmG[1]*PEEF;
+     GBarVD[3] += PEEFPrime;
+     GBarVD[4] += -PmG[0]*PmG[1]*PEEF;
+     GBarVD[5] += II*PmG[0]*PEEFPrime;
+     GBarVD[6] += II*PmG[1]*PEEFPrime;
+     GBarVD[7] += -PmG[0]*PmG[1]*PEEFPrime;
+   };
+
+  return false;
+}
+
+static bool AddGLong1DBatch(EwaldBatch *B, cdouble k, double P[2],
+                            int m, double Gamma[3][3], cdouble *GT)
+{
+  double PmG[2];
+  PmG[0] = P[0] - m*Gamma[0][0];
+  PmG[1] = P[1] - m*Gamma[0][1];
+  if (PmG[1]!=0.0)
+   ErrExit("1D lattice vectors must point in the x direction");
+
+  // GT[3*nu + 0,1,2] = GLongTwiddle, dGLT/dRho, d^2GLT/dRho^2 
+  bool Singular=false;
+  UpdateUActive(B);
+  for(int nu=0; nu<B->NU && !Singular; nu++)
+   if (B->UActive[nu])
+    { cdouble *G=GT + 3*nu;
+      G[0]=GetGLongTwiddle1D(PmG[0], B->UValue[nu], k, B->UE[nu], G+1, Singular);
+    };
+  if (Singular) 
+   return true;
+
+  GetPlaneWaveFactors(B, PmG[0], PmG[1]);
+
+  for(int np=0; np<B->NP; np++)
+   { 
+     if (!B->Active[np]) continue;
+
+     double Rho     = B->Rho[np];
+     cdouble *G     = GT + 3*B->UIndex[np];
+     cdouble ExpFac = cdouble(B->CosTheta[np], B->SinTheta[np]);
+
+     cdouble GTE       = ExpFac * G[0];
+     cdouble dGTdRho   = ExpFac * G[1];
+     cdouble dGT2dRho2 = Rho==0.0 ? 0.0 : ExpFac*(G[2] - G[1]/Rho);
+     double YOverRho   = (Rho==0.0) ? 0.0 : B->Y[np]/Rho;
+     double ZOverRho   = (Rho==0.0) ? 0.0 : B->Z[np]/Rho;
+
+     cdouble *GBarVD = B->Sum + NSUM*np;
+     GBarVD[0] += GTE;
+     GBarVD[1] += II*PmG[0] * GTE;
+     GBarVD[2] += YOverRho * dGTdRho;
+     GBarVD[3] += ZOverRho * dGTdRho;
+     GBarVD[4] += II*PmG[0] * YOverRho * dGTdRho;
+     GBarVD[5] += II*PmG[0] * ZOverRho * dGTdRho;
+     GBarVD[6] += YOverRho * ZOverRho * dGT2dRho2;
+     GBarVD[7] += II*PmG[0] * YOverRho * ZOverRho * dGT2dRho2;
+   };
+
+  return false;
+}
+
+/***************************************************************/
+/* batched version of GetGBarDistant; returns true if a        */
+/* singularity was encountered                                 */
+/***************************************************************/
+static bool GetGBarDistantBatch(EwaldBatch *B, cdouble k, double *kBloch,
+                                double Gamma[3][3], int LDim)
+{
+  memset(B->Sum, 0, NSUM*B->NP*sizeof(cdouble));
+  if (B->E[0]==0.0) return false;
+  for(int np=0; np<B->NP; np++)
+   B->Active[np]=true;
+
+  cdouble *Work = new cdouble[3*B->NU];
+  bool Singular=false;
+
+  if (LDim==1)
+   { for (int m=-NFIRSTROUND; m<=NFIRSTROUND && !Singular; m++)
+      Singular=AddGLong1DBatch(B, k, kBloch, m, Gamma, Work);
+   }
+  else
+   { for (int m1=-NFIRSTROUND; m1<=NFIRSTROUND && !Singular; m1++)
+      for (int m2=-NFIRSTROUND; m2<=NFIRSTROUND && !Singular; m2++)
+       Singular=AddGLong2DBatch(B, k, kBloch, m1, m2, Gamma, Work);
+   };
+
+  ResetConvergence(B);
+  int NumActive=B->NP;
+  for(int NN=NFIRSTROUND+1; !Singular && NumActive>0 && NN<=NMAX; NN++)
+   {  
+     if (LDim==1)
+      { Singular =    AddGLong1DBatch(B, k, kBloch,  NN, Gamma, Work)
+                   || AddGLong1DBatch(B, k, kBloch, -NN, Gamma, Work);
+      }
+     else
+      { for(int m=-NN; m<NN && !Singular; m++)
+         Singular =    AddGLong2DBatch(B, k, kBloch,   m,  NN, Gamma, Work)
+                    || AddGLong2DBatch(B, k, kBloch,  NN,  -m, Gamma, Work)
+                    || AddGLong2DBatch(B, k, kBloch,  -m, -NN, Gamma, Work)
+                    || AddGLong2DBatch(B, k, kBloch, -NN,   m, Gamma, Work);
+      };
+     if (!Singular)
+      NumActive=UpdateConvergence(B);
+   };
+
+  delete[] Work;
+  if (Singular) 
+   return true;
+
+  double PreFactor;
+  if (LDim==1)
+   PreFactor = sqrt(Gamma[0][0]*Gamma[0][0] + Gamma[0][1]*Gamma[0][1]);
+  else
+   PreFactor = (Gamma[0][0]*Gamma[1][1] - Gamma[0][1]*Gamma[1][0])/(16.0*M_PI*M_PI);
+  for(int n=0; n<NSUM*B->NP; n++)
+   B->Sum[n] *= PreFactor;
+
+  return false;
+}
+
+/***************************************************************/
+/* entry point                                                 */
+/***************************************************************/
+void GBarVDEwaldBatch(int NumPoints, double *X, double *Y, double *Z,
+                      cdouble k, double *kBloch0,
+                      double (*LBV)[3], int LDim,
+                      double E0, bool ExcludeInnerCells,
+                      cdouble *GBarVD)
+{
+  if (NumPoints<=0) return;
+
+  if (k==0.0)
+   { memset(GBarVD, 0, NSUM*NumPoints*sizeof(cdouble));
+     return;
+   };
+
+  double kBloch[3]={0.0, 0.0, 0.0};
+  memcpy(kBloch, kBloch0, LDim*sizeof(double));
+
+  /***************************************************************/
+  /* allocate workspace and get the reciprocal lattice and the   */
+  /* Ewald parameter; in the 1D case the optimal Ewald parameter */
+  /* depends on Rho, but in both cases it is the same for all    */
+  /* points sharing the value of z or Rho that groups them.      */
+  /***************************************************************/
+  EwaldBatch MyB, *B=&MyB;
+  int NP = B->NP   = NumPoints;
+  B->X              = X;
+  B->Y              = Y;
+  B->Z              = Z;
+  B->Rho            = new double[NP];
+  B->E              = new double[NP];
+  B->UValue         = new double[NP];
+  B->UE             = new double[NP];
+  B->UIndex         = new int[NP];
+  B->Active         = new bool[NP];
+  B->UActive        = new bool[NP];
+  B->ConvergedIters = new int[NP];
+  B->Sum            = new cdouble[NSUM*NP];
+  B->LastSum        = new cdouble[NSUM*NP];
+  B->CosTheta       = new double[NP];
+  B->SinTheta       = new double[NP];
+
+  double Gamma[3][3];
+  for(int np=0; np<NP; np++)
+   { double R[3], EOpt;
+     R[0]=X[np]; R[1]=Y[np]; R[2]=Z[np];
+     GetRLBasis(LDim, LBV, Gamma, k, &EOpt, R, B->Rho + np);
+     B->E[np] = (E0==-1.0) ? EOpt : E0;
+   };
+  GetDistinctValues(B, LDim==1 ? B->Rho : Z);
+
+  /***************************************************************/
+  /* distant (spectral) sum first, since it can fail; if it does,*/
+  /* fall back to the point-by-point routine, which handles the  */
+  /* singular case by displacing kBloch                          */
+  /***************************************************************/
+  bool Singular = GetGBarDistantBatch(B, k, kBloch, Gamma, LDim);
+  if (Singular)
+   { 
+     for(int np=0; np<NP; np++)
+      { double R[3];
+        cdouble PointVD[NSUM];
+        R[0]=X[np]; R[1]=Y[np]; R[2]=Z[np];
+        GBarVDEwald(R, k, kBloch0, LBV, LDim, E0, ExcludeInnerCells, PointVD);
+        for(int ns=0; ns<NSUM; ns++)
+         GBarVD[ns*NP + np] = PointVD[ns];
+      };
+   }
+  else
+   { 
+     for(int np=0; np<NP; np++)
+      for(int ns=0; ns<NSUM; ns++)
+       GBarVD[ns*NP + np] = B->Sum[NSUM*np + ns];
+
+     GetGBarNearbyBatch(B, k, kBloch, LBV, LDim, ExcludeInnerCells);
+     for(int np=0; np<NP; np++)
+      for(int ns=0; ns<NSUM; ns++)
+       GBarVD[ns*NP + np] += B->Sum[NSUM*np + ns];
+
+     /*--------------------------------------------------------------*/
+     /* subtract off the contributions of the inner grid cells to    */
+     /* the distant sum                                              */
+     /*--------------------------------------------------------------*/
+     if (ExcludeInnerCells)
+      { 
+        int n2Mult = (LDim==2) ? 1 : 0;
+        for(int np=0; np<NP; np++)
+         { double R[3];
+           R[0]=X[np]; R[1]=Y[np]; R[2]=Z[np];
+           cdouble GLongInner[NSUM];
+           memset(GLongInner,0,NSUM*sizeof(cdouble));
+           for(int n1=-1; n1<=1; n1++)
+            for(int n2=-1*n2Mult; n2<=1*n2Mult; n2++)
+             AddGLongRealSpace(R, k, kBloch, n1, n2, LBV, LDim, B->E[np], GLongInner);
+           for(int ns=0; ns<NSUM; ns++)
+            GBarVD[ns*NP + np] -= GLongInner[ns];
+         };
+      };
+   };
+
+  delete[] B->Rho;
+  delete[] B->E;
+  delete[] B->UValue;
+  delete[] B->UE;
+  delete[] B->UIndex;
+  delete[] B->Active;
+  delete[] B->UActive;
+  delete[] B->ConvergedIters;
+  delete[] B->Sum;
+  delete[] B->LastSum;
+  delete[] B->CosTheta;
+  delete[] B->SinTheta;
+}
+
+
 } // namespace scuff
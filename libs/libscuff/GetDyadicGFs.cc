@@ -54,31 +54,71 @@ namespace scuff {
 /*      and destination points can be different, and we have   */
 /*       X[nx,0:2] = destination point                         */
 /*       X[nx,3:5] = source points                             */
+/*                                                             */
+/* RFBuffers, if non-NULL, points to two HMatrix pointers that */
+/* the routine uses (allocating or resizing them as necessary) */
+/* to hold the reduced fields at the source and destination    */
+/* points; callers that evaluate DGFs many times with the same */
+/* number of evaluation points, for example in Brillouin-zone  */
+/* integrations, may keep them between calls. Concurrent calls */
+/* must pass different buffers.                                */
 /***************************************************************/
 HMatrix *RWGGeometry::GetDyadicGFs(cdouble Omega, double *kBloch,
                                    HMatrix *XMatrix, HMatrix *M,
                                    HMatrix *GMatrix,
-                                   bool ScatteringOnly)
+                                   bool ScatteringOnly,
+                                   HMatrix **RFBuffers)
+{ 
+  return GetDyadicGFs(Omega, kBloch, XMatrix, M, 0, GMatrix,
+                      ScatteringOnly, RFBuffers);
+}
+
+/***************************************************************/
+/* same as above, but using a compressed BEM matrix that has   */
+/* already been assembled and LU-factorized                    */
+/***************************************************************/
+HMatrix *RWGGeometry::GetDyadicGFs(cdouble Omega, double *kBloch,
+                                   HMatrix *XMatrix,
+                                   CompressedBEMMatrix *CM,
+                                   HMatrix *GMatrix,
+                                   bool ScatteringOnly,
+                                   HMatrix **RFBuffers)
+{ 
+  return GetDyadicGFs(Omega, kBloch, XMatrix, 0, CM, GMatrix,
+                      ScatteringOnly, RFBuffers);
+}
+
+/***************************************************************/
+/* internal routine that does the work for the two above; on   */
+/* entry exactly one of M, CM is non-NULL.                     */
+/***************************************************************/
+HMatrix *RWGGeometry::GetDyadicGFs(cdouble Omega, double *kBloch,
+                                   HMatrix *XMatrix, HMatrix *M,
+                                   CompressedBEMMatrix *CM,
+                                   HMatrix *GMatrix,
+                                   bool ScatteringOnly,
+                                   HMatrix **RFBuffers)
 { 
   int NBF = TotalBFs;
   int NX  = XMatrix->NR;
   Log("Getting DGFs at %i eval points...",NX);
 
   /*--------------------------------------------------------------*/
-  /* allocate storage for RFSource, RFDest matrices. I keep these */
-  /* on hand as statically-allocated buffers on the assumption    */
-  /* that the routine will be called many times with the same     */
-  /* number of evaluation points, for example in Brillouin-zone   */
-  /* integrations                                                 */
+  /* get storage for RFSource, RFDest matrices, either from the   */
+  /* caller's buffers or allocated for this call only. (These     */
+  /* used to be static buffers, which broke concurrent calls from */
+  /* separate Brillouin-zone integration workspaces.)             */
   /*--------------------------------------------------------------*/
-  static HMatrix *RFSource=0, *RFDest=0;
-  if ( RFSource==0 || RFSource->NR!=NBF || RFSource->NC!=(6*NX) )
-   { 
-     if (RFSource) delete RFSource;
-     if (RFDest)   delete RFDest;
-     RFSource=new HMatrix(NBF, 6*NX, LHM_COMPLEX);
-     RFDest=new HMatrix(NBF, 6*NX, LHM_COMPLEX);
-   };
+  HMatrix *MyRFBuffers[2]={0,0};
+  bool OwnBuffers = (RFBuffers==0);
+  if (OwnBuffers)
+   RFBuffers=MyRFBuffers;
+  for(int n=0; n<2; n++)
+   if ( RFBuffers[n]==0 || RFBuffers[n]->NR!=NBF || RFBuffers[n]->NC!=(6*NX) )
+    { if (RFBuffers[n]) delete RFBuffers[n];
+      RFBuffers[n]=new HMatrix(NBF, 6*NX, LHM_COMPLEX);
+    };
+  HMatrix *RFSource=RFBuffers[0], *RFDest=RFBuffers[1];
 
   /*--------------------------------------------------------------*/
   /*- allocate an output matrix of the right size if necessary   -*/
@@ -118,7 +158,10 @@ HMatrix *RWGGeometry::GetDyadicGFs(cdouble Omega, double *kBloch,
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   Log(" LUSolving...");
-  M->LUSolve(RFSource);
+  if (CM)
+   CM->LUSolve(RFSource);
+  else
+   M->LUSolve(RFSource);
 
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
@@ -187,6 +230,11 @@ HMatrix *RWGGeometry::GetDyadicGFs(cdouble Omega, double *kBloch,
        };
    };
 
+  if (OwnBuffers)
+   { delete RFSource;
+     delete RFDest;
+   };
+
   return GMatrix;
 
 }
@@ -28,6 +28,8 @@
 #include <string.h>
 #include <math.h>
 #include <ctype.h>
+#include <vector>
+#include <algorithm>
 
 #include <libhrutil.h>
 #include <libTriInt.h>
@@ -136,6 +138,250 @@ void GetDistanceToBF(double X0[3], RWGSurface *S, int ne)
 }
 #endif
 
+/***************************************************************/
+/* thresholds and cubature orders used to compute the reduced  */
+/* fields of a single basis function at a single point.        */
+/***************************************************************/
+typedef struct RFOptions
+ { double rRelOuterThreshold, rRelInnerThreshold;
+   int LowOrder, HighOrder;
+   bool NewMethod;
+ } RFOptions;
+
+/***************************************************************/
+/* compute the reduced fields GC[0..5] = {G, C} of basis       */
+/* function #ne on surface #ns at the point X, choosing the    */
+/* cubature scheme according to the distance from X to the     */
+/* basis function                                              */
+/***************************************************************/
+static void GetPointEdgeRF(RWGGeometry *G, int ns, int ne, double X[3],
+                           cdouble k, GBarAccelerator *GBA,
+                           RFOptions *Opts, cdouble GC[6])
+{
+  RWGSurface *S = G->Surfaces[ns];
+  RWGEdge *E    = S->Edges[ne];
+
+  RFIData MyData, *Data=&MyData;
+  Data->X0        = X;
+  Data->k         = k;
+  Data->GBA       = GBA;
+  Data->RLBasis   = G->RLBasis;
+  Data->RLVolume  = G->RLVolume;
+  Data->NewMethod = Opts->NewMethod;
+
+  double rRel = VecDistance(X, E->Centroid) / E->Radius;
+  const int IDim=12;
+  if (rRel >= Opts->rRelOuterThreshold)
+   { 
+     GetBFCubature2(G, ns, ne, RFIntegrand, (void *)Data,
+                    IDim, Opts->LowOrder, (double *)GC);
+   }
+  else if (rRel>=Opts->rRelInnerThreshold)
+   { 
+     GetBFCubature2(G, ns, ne, RFIntegrand, (void *)Data,
+                    IDim, Opts->HighOrder, (double *)GC);
+   }
+  else
+   { 
+     GetReducedFields_Nearby(S, ne, X, k, GC+0, GC+3);
+     GC[3] /= (-II*k);
+     GC[4] /= (-II*k);
+     GC[5] /= (-II*k);
+
+     if (GBA)
+      { cdouble GC1[6], GC2[6];
+        int Order=4;
+        GetBFCubature2(G, ns, ne, RFIntegrand, (void *)Data,
+                       IDim, Order, (double *)GC1);
+        Data->GBA = 0;
+        GetBFCubature2(G, ns, ne, RFIntegrand, (void *)Data,
+                       IDim, Order, (double *)GC2);
+        for(int Mu=0; Mu<6; Mu++) 
+         GC[Mu] += (GC1[Mu] - GC2[Mu]);
+      };
+   };
+}
+
+/***************************************************************/
+/* reduced fields of a single basis function at a single point,*/
+/* with the default cubature thresholds and orders; this is    */
+/* used for the near-field contributions in the fast multipole */
+/* field evaluation (MLFMAMatrix::GetFields).                  */
+/***************************************************************/
+void GetReducedFields(RWGGeometry *G, int ns, int ne, double X[3],
+                      cdouble k, cdouble GC[6])
+{
+  RFOptions Opts;
+  Opts.rRelOuterThreshold=4.0;
+  Opts.rRelInnerThreshold=1.0;
+  Opts.LowOrder=7;
+  Opts.HighOrder=20;
+  Opts.NewMethod=false;
+  GetPointEdgeRF(G, ns, ne, X, k, 0, &Opts, GC);
+}
+
+/***************************************************************/
+/* stamp the reduced fields of basis function #nbf (and #nbf+1 */
+/* for non-PEC surfaces) at point #nx into RFMatrix            */
+/***************************************************************/
+static void StampRFEntries(HMatrix *RFMatrix, int nbf, int nx, bool IsPEC,
+                           double Sign, cdouble k, cdouble ZRel, cdouble GC[6])
+{
+  /***************************************************/
+  /*                                                 */
+  /* E = ik*Z0 * Zr * k*g + ik*n*c                   */
+  /*   = ik*Z0 * Zr * k*g - ik*Z0*nScuff*c           */
+  /* H =        -ik * k*c + (ik/(Z0*Zr)) * n*c       */
+  /*   =        -ik * k*c - (ik/Zr) *nScuff*c        */
+  /***************************************************/
+  cdouble *GG=GC+0, *CC=GC+3;
+  cdouble EKFactor =      Sign*II*k*ZRel*ZVAC;
+  cdouble HKFactor = -1.0*Sign*II*k;
+  cdouble ENFactor = -1.0*Sign*II*k*ZVAC;
+  cdouble HNFactor = -1.0*Sign*II*k/ZRel;
+
+  RFMatrix->SetEntry(nbf, 6*nx + 0, EKFactor * GG[0] );
+  RFMatrix->SetEntry(nbf, 6*nx + 1, EKFactor * GG[1] );
+  RFMatrix->SetEntry(nbf, 6*nx + 2, EKFactor * GG[2] );
+  RFMatrix->SetEntry(nbf, 6*nx + 3, HKFactor * CC[0] );
+  RFMatrix->SetEntry(nbf, 6*nx + 4, HKFactor * CC[1] );
+  RFMatrix->SetEntry(nbf, 6*nx + 5, HKFactor * CC[2] );
+
+  if ( !IsPEC )
+   { RFMatrix->SetEntry(nbf+1, 6*nx + 0, ENFactor * CC[0] );
+     RFMatrix->SetEntry(nbf+1, 6*nx + 1, ENFactor * CC[1] );
+     RFMatrix->SetEntry(nbf+1, 6*nx + 2, ENFactor * CC[2] );
+     RFMatrix->SetEntry(nbf+1, 6*nx + 3, HNFactor * GG[0] );
+     RFMatrix->SetEntry(nbf+1, 6*nx + 4, HNFactor * GG[1] );
+     RFMatrix->SetEntry(nbf+1, 6*nx + 5, HNFactor * GG[2] );
+   };
+}
+
+/***************************************************************/
+/* Batched evaluation of far-zone reduced fields.              */
+/*                                                             */
+/* The evaluation points are classified by region once, then   */
+/* sorted by region and by position along a Morton (Z-order)   */
+/* curve and split into clusters of at most RF_CLUSTERSIZE     */
+/* points lying in the same region. If a cluster lies entirely */
+/* in the far zone of a basis function (as judged from its     */
+/* bounding sphere), the low-order cubature samples of the     */
+/* basis function, which are computed once for all points, are */
+/* applied to all points in the cluster at once in a loop over */
+/* flat arrays of real numbers that the compiler can vectorize.*/
+/* Otherwise we fall back to GetPointEdgeRF() point by point.  */
+/***************************************************************/
+#define RF_CLUSTERSIZE 64
+#define RF_EDGEBLOCK   64
+#define RF_SAMPLESIZE  7 // X[3], W*b[3], W*Divb
+
+typedef struct RFCluster
+ { int Region;
+   int Start, Num;      // range within the sorted list of points
+   double Center[3], Radius;
+ } RFCluster;
+
+typedef struct RFSortKey
+ { int Region;
+   unsigned long long Morton;
+   int nx;
+   bool operator<(const RFSortKey &K) const
+    { if (Region!=K.Region) return Region<K.Region;
+      return Morton<K.Morton;
+    }
+ } RFSortKey;
+
+static unsigned long long GetMortonKey(const double X[3], const double XMin[3], double Scale)
+{
+  unsigned int I[3];
+  for(int d=0; d<3; d++)
+   { double t = (X[d]-XMin[d])*Scale;
+     if (t<0.0) t=0.0;
+     if (t>2097151.0) t=2097151.0;
+     I[d] = (unsigned int)t;
+   };
+  unsigned long long Key=0;
+  for(int Bit=20; Bit>=0; Bit--)
+   for(int d=0; d<3; d++)
+    Key = (Key<<1) | ((I[d]>>Bit) & 1);
+  return Key;
+}
+
+static void CollectRFSample(double X[3], double b[3], double Divb,
+                            void *UserData, double W, double *Integral)
+{
+  (void) Integral;
+  std::vector<double> *Samples = (std::vector<double> *)UserData;
+  Samples->push_back(X[0]);
+  Samples->push_back(X[1]);
+  Samples->push_back(X[2]);
+  Samples->push_back(W*b[0]);
+  Samples->push_back(W*b[1]);
+  Samples->push_back(W*b[2]);
+  Samples->push_back(W*Divb);
+}
+
+/***************************************************************/
+/* accumulate, for NP points with coordinates PX, PY, PZ, the  */
+/* sums over cubature samples of                               */
+/*  Acc[ 0.. 5] = Phi*b          (re, im for x,y,z)            */
+/*  Acc[ 6..11] = Divb*Grad Phi                                */
+/*  Acc[12..17] = b x Grad Phi                                 */
+/* each stored as a contiguous array of length NP.             */
+/***************************************************************/
+static void AddFarFieldSamples(const double *Samples, int NumSamples, cdouble k,
+                               int NP, const double *PX, const double *PY,
+                               const double *PZ, double *Acc)
+{
+  double kr=real(k), ki=imag(k);
+  const double OneOver4Pi = 1.0/(4.0*M_PI);
+  for(int ns=0; ns<NumSamples; ns++)
+   { const double *Sample = Samples + RF_SAMPLESIZE*ns;
+     double Yx=Sample[0], Yy=Sample[1], Yz=Sample[2];
+     double bx=Sample[3], by=Sample[4], bz=Sample[5], Divb=Sample[6];
+#ifdef USE_OPENMP
+#pragma omp simd
+#endif
+     for(int np=0; np<NP; np++)
+      { double Rx=Yx-PX[np], Ry=Yy-PY[np], Rz=Yz-PZ[np];
+        double r2=Rx*Rx + Ry*Ry + Rz*Rz, r=sqrt(r2);
+        double Mag=exp(-ki*r)*OneOver4Pi/r;
+        double PhiR=Mag*cos(kr*r), PhiI=Mag*sin(kr*r);
+        // Psi = Phi*(ikr-1)/r^2
+        double a=-ki*r-1.0, c=kr*r;
+        double PsiR=(PhiR*a - PhiI*c)/r2, PsiI=(PhiR*c + PhiI*a)/r2;
+        double dGR[3]={Rx*PsiR, Ry*PsiR, Rz*PsiR};
+        double dGI[3]={Rx*PsiI, Ry*PsiI, Rz*PsiI};
+
+        Acc[ 0*NP+np] += bx*PhiR;  Acc[ 1*NP+np] += bx*PhiI;
+        Acc[ 2*NP+np] += by*PhiR;  Acc[ 3*NP+np] += by*PhiI;
+        Acc[ 4*NP+np] += bz*PhiR;  Acc[ 5*NP+np] += bz*PhiI;
+
+        Acc[ 6*NP+np] += Divb*dGR[0];  Acc[ 7*NP+np] += Divb*dGI[0];
+        Acc[ 8*NP+np] += Divb*dGR[1];  Acc[ 9*NP+np] += Divb*dGI[1];
+        Acc[10*NP+np] += Divb*dGR[2];  Acc[11*NP+np] += Divb*dGI[2];
+
+        Acc[12*NP+np] += by*dGR[2] - bz*dGR[1];  Acc[13*NP+np] += by*dGI[2] - bz*dGI[1];
+        Acc[14*NP+np] += bz*dGR[0] - bx*dGR[2];  Acc[15*NP+np] += bz*dGI[0] - bx*dGI[2];
+        Acc[16*NP+np] += bx*dGR[1] - by*dGR[0];  Acc[17*NP+np] += bx*dGI[1] - by*dGI[0];
+      };
+   };
+}
+
+/***************************************************************/
+/* the new reduced-field method (RFIData::NewMethod) is used   */
+/* if the environment variable SCUFF_NEW_RFMETHOD is set to 1  */
+/***************************************************************/
+static bool GetUseNewRFMethod()
+{
+  char *s = getenv("SCUFF_NEW_RFMETHOD");
+  if(s && s[0]=='1')
+   { printf("Using new RF method.\n");
+     return true;
+   };
+  return false;
+}
+
 /***************************************************************/
 /* RFMatrix is a matrix of "reduced fields", i.e. a matrix     */
 /* whose columns may be dot-producted with the KN vector (BEM  */
@@ -144,10 +390,15 @@ void GetDistanceToBF(double X0[3], RWGSurface *S, int ne)
 /* More specifically, for Mu=0...5, the (6*nx + Mu)th column   */
 /* of RFMatrix is dotted into KN to yield the Muth component   */
 /* of the field six-vector F=\{ E \choose H \}.                */
+/*                                                             */
+/* If RegionIndices is non-NULL, it must contain the region    */
+/* index of each evaluation point, as returned by              */
+/* GetRegionIndex(); otherwise the points are classified here. */
 /***************************************************************/
 HMatrix *RWGGeometry::GetRFMatrix(cdouble Omega, double *kBloch0,
                                   HMatrix *XMatrix, HMatrix *RFMatrix,
-                                  bool MinuskBloch, int ColumnOffset)
+                                  bool MinuskBloch, int ColumnOffset,
+                                  int *RegionIndices)
 {
   double *kBloch=kBloch0;
   double kBlochBuffer[3];
@@ -179,21 +430,22 @@ HMatrix *RWGGeometry::GetRFMatrix(cdouble Omega, double *kBloch0,
   /***************************************************************/
   /***************************************************************/
   /***************************************************************/
-  double rRelOuterThreshold=4.0;
-  double rRelInnerThreshold=1.0;
-  int LowOrder=7;
-  int HighOrder=20;
+  RFOptions MyOpts, *Opts=&MyOpts;
+  Opts->rRelOuterThreshold=4.0;
+  Opts->rRelInnerThreshold=1.0;
+  Opts->LowOrder=7;
+  Opts->HighOrder=20;
   char *s1=getenv("SCUFF_RREL_OUTER_THRESHOLD");
   char *s2=getenv("SCUFF_RREL_INNER_THRESHOLD");
   char *s3=getenv("SCUFF_LOWORDER");
   char *s4=getenv("SCUFF_HIGHORDER");
-  if (s1) sscanf(s1,"%le",&rRelOuterThreshold);
-  if (s2) sscanf(s2,"%le",&rRelInnerThreshold);
-  if (s3) sscanf(s3,"%i",&LowOrder);
-  if (s4) sscanf(s4,"%i",&HighOrder);
+  if (s1) sscanf(s1,"%le",&(Opts->rRelOuterThreshold));
+  if (s2) sscanf(s2,"%le",&(Opts->rRelInnerThreshold));
+  if (s3) sscanf(s3,"%i",&(Opts->LowOrder));
+  if (s4) sscanf(s4,"%i",&(Opts->HighOrder));
   if (s1||s2||s3||s4)
    Log("({O,I}rRelThreshold | LowOrder | HighOrder)=(%e,%e,%i,%i)",
-       rRelOuterThreshold,rRelInnerThreshold,LowOrder,HighOrder);
+       Opts->rRelOuterThreshold,Opts->rRelInnerThreshold,Opts->LowOrder,Opts->HighOrder);
 
   /***************************************************************/
   /***************************************************************/
@@ -226,131 +478,179 @@ HMatrix *RWGGeometry::GetRFMatrix(cdouble Omega, double *kBloch0,
   /***************************************************************/
   /***************************************************************/
 /*!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
-  static bool Initialized=false, UseNewMethod=false;
-  if (Initialized==false)
-   { Initialized=true;
-     char *s = getenv("SCUFF_NEW_RFMETHOD");
-     if(s && s[0]=='1')
-      { printf("Using new RF method.\n");
-        UseNewMethod=true;
-      };
-   };
+  // initialized exactly once even if the first calls are concurrent
+  static const bool UseNewMethod=GetUseNewRFMethod();
 /*!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+  Opts->NewMethod=UseNewMethod;
+  // the batched far-zone path handles only the nonperiodic Green's
+  // function with fixed-order (non-adaptive) cubature
+  bool AdaptiveLowOrder = (Opts->LowOrder==0 || Opts->LowOrder==21 || Opts->LowOrder==78);
+  bool Batched = (RegionGBAs==0 && !UseNewMethod && !AdaptiveLowOrder);
 
-  /***************************************************************/
-  /***************************************************************/
-  /***************************************************************/
-  int NENX=NE*NX;
-#ifndef USE_OPENMP
-  if (LogLevel>SCUFF_VERBOSELOGGING)
-   Log("Computing RFMatrix entries at %i points",NX);
-#else
   int NumThreads=GetNumThreads();
   if (LogLevel>SCUFF_VERBOSELOGGING)
    Log("Computing RFMatrix entries (%i threads) at %i points",NumThreads,NX);
-#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+
+  /***************************************************************/
+  /* classify all evaluation points by region, then sort them    */
+  /* into clusters                                               */
+  /***************************************************************/
+  double *XX = new double[3*NX];
+  for(int nx=0; nx<NX; nx++)
+   for(int Mu=0; Mu<3; Mu++)
+    XX[3*nx+Mu] = XMatrix->GetEntryD(nx, ColumnOffset+Mu);
+
+  int *MyRegionIndices=0;
+  if (RegionIndices==0)
+   { RegionIndices = MyRegionIndices = new int[NX];
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,64), num_threads(NumThreads)
 #endif
-  for(int nenx=0; nenx<NENX; nenx++)
-   { 
-     int nx     = nenx / NE;
-     int neFull = nenx % NE;
-
-     int ns, ne, nbf;
-     RWGSurface *S = ResolveEdge(neFull, &ns, &ne, &nbf);
-     RWGEdge *E    = S->Edges[ne];
-
-     double X[3];
-     X[0]=XMatrix->GetEntryD(nx,ColumnOffset+0);
-     X[1]=XMatrix->GetEntryD(nx,ColumnOffset+1);
-     X[2]=XMatrix->GetEntryD(nx,ColumnOffset+2);
-     int RegionIndex = GetRegionIndex(X);
-     if (RegionIndex==-1) continue; // inside a closed PEC surface
-   
-     double Sign=0.0;
-     if      (Surfaces[ns]->RegionIndices[0]==RegionIndex) 
-      Sign=+1.0;
-     else if (Surfaces[ns]->RegionIndices[1]==RegionIndex)
-      Sign=-1.0;
-     else 
-      continue;
-   
-     cdouble k    = ks[RegionIndex];
-     cdouble ZRel = ZRels[RegionIndex];
-
-     /*--------------------------------------------------------------*/
-     /*--------------------------------------------------------------*/
-     /*--------------------------------------------------------------*/
-     cdouble GC[6];
-     RFIData MyData, *Data=&MyData;
-     Data->X0  = X;
-     Data->k   = ks[RegionIndex];
-     Data->GBA = RegionGBAs ? RegionGBAs[RegionIndex] : 0;
-     Data->RLBasis = RLBasis;
-     Data->RLVolume= RLVolume;
-     Data->NewMethod = UseNewMethod;
-
-     double rRel = VecDistance(X, E->Centroid) / E->Radius;
-     const int IDim=12;
-     if (rRel >= rRelOuterThreshold)
-      { 
-        GetBFCubature2(this, ns, ne, RFIntegrand, (void *)Data,
-                       IDim, LowOrder, (double *)GC);
-      }
-     else if (rRel>=rRelInnerThreshold)
-      { 
-        GetBFCubature2(this, ns, ne, RFIntegrand, (void *)Data,
-                       IDim, HighOrder, (double *)GC);
-      }
-     else
-      { 
-        GetReducedFields_Nearby(S, ne, X, k, GC+0, GC+3);
-        GC[3] /= (-II*k);
-        GC[4] /= (-II*k);
-        GC[5] /= (-II*k);
-
-        if (RegionGBAs)
-         { cdouble GC1[6], GC2[6];
-           int Order=4;
-           GetBFCubature2(this, ns, ne, RFIntegrand, (void *)Data,
-                          IDim, Order, (double *)GC1);
-           Data->GBA = 0;
-           GetBFCubature2(this, ns, ne, RFIntegrand, (void *)Data,
-                          IDim, Order, (double *)GC2);
-           for(int Mu=0; Mu<6; Mu++) 
-            GC[Mu] += (GC1[Mu] - GC2[Mu]);
-         };
+     for(int nx=0; nx<NX; nx++)
+      RegionIndices[nx]=GetRegionIndex(XX + 3*nx);
+   };
+
+  double XMin[3]={HUGE_VAL, HUGE_VAL, HUGE_VAL}, XMax[3]={-HUGE_VAL, -HUGE_VAL, -HUGE_VAL};
+  for(int nx=0; nx<NX; nx++)
+   for(int Mu=0; Mu<3; Mu++)
+    { XMin[Mu] = fmin(XMin[Mu], XX[3*nx+Mu]);
+      XMax[Mu] = fmax(XMax[Mu], XX[3*nx+Mu]);
+    };
+  double Extent=fmax(XMax[0]-XMin[0], fmax(XMax[1]-XMin[1], XMax[2]-XMin[2]));
+  double Scale = (Extent>0.0) ? 2097151.0/Extent : 0.0;
+
+  std::vector<RFSortKey> Keys;
+  Keys.reserve(NX);
+  for(int nx=0; nx<NX; nx++)
+   { if (RegionIndices[nx]==-1) continue; // inside a closed PEC surface
+     RFSortKey Key;
+     Key.Region = RegionIndices[nx];
+     Key.Morton = GetMortonKey(XX+3*nx, XMin, Scale);
+     Key.nx     = nx;
+     Keys.push_back(Key);
+   };
+  std::sort(Keys.begin(), Keys.end());
+
+  std::vector<RFCluster> Clusters;
+  for(int Start=0, NK=Keys.size(); Start<NK; )
+   { RFCluster C;
+     C.Region=Keys[Start].Region;
+     C.Start=Start;
+     C.Num=0;
+     while( Start+C.Num<NK && C.Num<RF_CLUSTERSIZE && Keys[Start+C.Num].Region==C.Region )
+      C.Num++;
+     double CMin[3]={HUGE_VAL, HUGE_VAL, HUGE_VAL}, CMax[3]={-HUGE_VAL, -HUGE_VAL, -HUGE_VAL};
+     for(int n=0; n<C.Num; n++)
+      for(int Mu=0; Mu<3; Mu++)
+       { CMin[Mu] = fmin(CMin[Mu], XX[3*Keys[Start+n].nx+Mu]);
+         CMax[Mu] = fmax(CMax[Mu], XX[3*Keys[Start+n].nx+Mu]);
+       };
+     for(int Mu=0; Mu<3; Mu++)
+      C.Center[Mu] = 0.5*(CMin[Mu]+CMax[Mu]);
+     C.Radius=0.0;
+     for(int n=0; n<C.Num; n++)
+      C.Radius = fmax(C.Radius, VecDistance(C.Center, XX+3*Keys[Start+n].nx));
+     Clusters.push_back(C);
+     Start+=C.Num;
+   };
+
+  /***************************************************************/
+  /* low-order cubature samples for all basis functions, used    */
+  /* for clusters in their far zones                             */
+  /***************************************************************/
+  std::vector< std::vector<double> > EdgeSamples(Batched ? NE : 0);
+  if (Batched)
+   {
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,64), num_threads(NumThreads)
+#endif
+     for(int neFull=0; neFull<NE; neFull++)
+      { int ns, ne;
+        double Dummy;
+        ResolveEdge(neFull, &ns, &ne);
+        GetBFCubature2(this, ns, ne, CollectRFSample, (void *)&(EdgeSamples[neFull]),
+                       0, Opts->LowOrder, &Dummy);
       };
+   };
 
-     /***************************************************/
-     /*                                                 */
-     /* E = ik*Z0 * Zr * k*g + ik*n*c                   */
-     /*   = ik*Z0 * Zr * k*g - ik*Z0*nScuff*c           */
-     /* H =        -ik * k*c + (ik/(Z0*Zr)) * n*c       */
-     /*   =        -ik * k*c - (ik/Zr) *nScuff*c        */
-     /***************************************************/
-     cdouble *GG=GC+0, *CC=GC+3;
-     cdouble EKFactor =      Sign*II*k*ZRel*ZVAC;
-     cdouble HKFactor = -1.0*Sign*II*k;
-     cdouble ENFactor = -1.0*Sign*II*k*ZVAC;
-     cdouble HNFactor = -1.0*Sign*II*k/ZRel;
-
-     RFMatrix->SetEntry(nbf, 6*nx + 0, EKFactor * GG[0] );
-     RFMatrix->SetEntry(nbf, 6*nx + 1, EKFactor * GG[1] );
-     RFMatrix->SetEntry(nbf, 6*nx + 2, EKFactor * GG[2] );
-     RFMatrix->SetEntry(nbf, 6*nx + 3, HKFactor * CC[0] );
-     RFMatrix->SetEntry(nbf, 6*nx + 4, HKFactor * CC[1] );
-     RFMatrix->SetEntry(nbf, 6*nx + 5, HKFactor * CC[2] );
-
-     if ( !(S->IsPEC) )
-      { RFMatrix->SetEntry(nbf+1, 6*nx + 0, ENFactor * CC[0] );
-        RFMatrix->SetEntry(nbf+1, 6*nx + 1, ENFactor * CC[1] );
-        RFMatrix->SetEntry(nbf+1, 6*nx + 2, ENFactor * CC[2] );
-        RFMatrix->SetEntry(nbf+1, 6*nx + 3, HNFactor * GG[0] );
-        RFMatrix->SetEntry(nbf+1, 6*nx + 4, HNFactor * GG[1] );
-        RFMatrix->SetEntry(nbf+1, 6*nx + 5, HNFactor * GG[2] );
+  /***************************************************************/
+  /* loop over (cluster, block of edges) pairs; distinct tasks   */
+  /* write to disjoint sets of RFMatrix entries                  */
+  /***************************************************************/
+  int NumClusters   = Clusters.size();
+  int NumEdgeBlocks = (NE + RF_EDGEBLOCK - 1) / RF_EDGEBLOCK;
+  int NumTasks      = NumClusters * NumEdgeBlocks;
+  int NumBatched=0;
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads), reduction(+:NumBatched)
+#endif
+  for(int nt=0; nt<NumTasks; nt++)
+   { 
+     RFCluster *C = &(Clusters[nt / NumEdgeBlocks]);
+     int neStart  = RF_EDGEBLOCK*(nt % NumEdgeBlocks);
+     int neStop   = neStart + RF_EDGEBLOCK;
+     if (neStop>NE) neStop=NE;
+
+     int RegionIndex = C->Region;
+     cdouble k       = ks[RegionIndex];
+     cdouble ZRel    = ZRels[RegionIndex];
+     GBarAccelerator *GBA = RegionGBAs ? RegionGBAs[RegionIndex] : 0;
+
+     int NP=C->Num;
+     std::vector<double> P(3*NP), Acc(18*NP);
+     for(int np=0; np<NP; np++)
+      for(int Mu=0; Mu<3; Mu++)
+       P[Mu*NP + np] = XX[3*Keys[C->Start+np].nx + Mu];
+
+     for(int neFull=neStart; neFull<neStop; neFull++)
+      { 
+        int ns, ne, nbf;
+        RWGSurface *S = ResolveEdge(neFull, &ns, &ne, &nbf);
+        RWGEdge *E    = S->Edges[ne];
+
+        double Sign=0.0;
+        if      (S->RegionIndices[0]==RegionIndex) 
+         Sign=+1.0;
+        else if (S->RegionIndices[1]==RegionIndex)
+         Sign=-1.0;
+        else 
+         continue;
+
+        double rRelMin = (VecDistance(C->Center, E->Centroid) - C->Radius) / E->Radius;
+        if ( Batched && rRelMin >= Opts->rRelOuterThreshold )
+         { 
+           std::vector<double> &Samples = EdgeSamples[neFull];
+           std::fill(Acc.begin(), Acc.end(), 0.0);
+           AddFarFieldSamples(&(Samples[0]), Samples.size()/RF_SAMPLESIZE, k,
+                              NP, &(P[0]), &(P[NP]), &(P[2*NP]), &(Acc[0]));
+           cdouble k2=k*k, ik=II*k;
+           for(int np=0; np<NP; np++)
+            { cdouble GC[6];
+              for(int Mu=0; Mu<3; Mu++)
+               { cdouble PhiB (Acc[(2*Mu+0)*NP+np],  Acc[(2*Mu+1)*NP+np]);
+                 cdouble DdG  (Acc[(6+2*Mu)*NP+np],  Acc[(7+2*Mu)*NP+np]);
+                 cdouble BxdG (Acc[(12+2*Mu)*NP+np], Acc[(13+2*Mu)*NP+np]);
+                 GC[Mu]   = PhiB - DdG/k2;
+                 GC[3+Mu] = BxdG/(-1.0*ik);
+               };
+              StampRFEntries(RFMatrix, nbf, Keys[C->Start+np].nx, S->IsPEC,
+                             Sign, k, ZRel, GC);
+            };
+           NumBatched++;
+         }
+        else
+         for(int np=0; np<NP; np++)
+          { int nx=Keys[C->Start+np].nx;
+            cdouble GC[6];
+            GetPointEdgeRF(this, ns, ne, XX+3*nx, k, GBA, Opts, GC);
+            StampRFEntries(RFMatrix, nbf, nx, S->IsPEC, Sign, k, ZRel, GC);
+          };
       };
+   };
 
-   }; // for(int nenx=0; nenx<NENX; nenx++)
+  if (LogLevel>SCUFF_VERBOSELOGGING)
+   Log(" %i clusters, %i/%i cluster-edge pairs batched",
+         NumClusters, NumBatched, NumClusters*NE);
 
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
@@ -362,6 +662,8 @@ HMatrix *RWGGeometry::GetRFMatrix(cdouble Omega, double *kBloch0,
      free(RegionGBAs);
    };
 
+  if (MyRegionIndices) delete[] MyRegionIndices;
+  delete[] XX;
   delete[] ZRels;
   delete[] ks;
 
@@ -410,20 +712,80 @@ HMatrix *RWGGeometry::GetFields(IncField *IFList, HVector *KN,
    UpdateIncFields(IFList, Omega, kBloch);
 
   /***************************************************************/
-  /* get contributions of surface currents if present ************/
+  /* classify evaluation points by region once; the region       */
+  /* indices are shared by the scattered- and incident-field     */
+  /* calculations                                                */
   /***************************************************************/
-  if (KN)
+  int *RegionIndices = new int[NX];
+  int NumThreads=GetNumThreads();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,64), num_threads(NumThreads)
+#endif
+  for(int nx=0; nx<NX; nx++)
+   { double X[3];
+     XMatrix->GetEntriesD(nx,"0:2",X);
+     RegionIndices[nx]=GetRegionIndex(X);
+   };
+
+  /***************************************************************/
+  /* get contributions of surface currents if present, either by */
+  /* fast multipole expansions (if FieldsFMMTol is positive) or  */
+  /* via the RFMatrix. in the latter case the points are         */
+  /* processed in chunks to bound the size of the RFMatrix for   */
+  /* large field maps; the chunk size may be set with the        */
+  /* environment variable SCUFF_GETFIELDS_CHUNKSIZE.             */
+  /***************************************************************/
+  bool UseFMM = (KN && FieldsFMMTol>0.0);
+  if (UseFMM && (LDim>0 || Substrate || (UseHRWGFunctions && NumMMJs>0)))
+   UseFMM=false;
+  for(int ns=0; UseFMM && ns<NumSurfaces; ns++)
+   if (Surfaces[ns]->SurfaceZeta)
+    UseFMM=false;
+  static bool WarnedFMM=false;
+  if (KN && FieldsFMMTol>0.0 && !UseFMM && !WarnedFMM)
+   { Warn("fast multipole field evaluation not supported for this geometry");
+     WarnedFMM=true;
+   };
+
+  if (UseFMM)
+   { 
+     MLFMAMatrix FMM(this, FieldsFMMTol);
+     FMM.Assemble(Omega, false);
+     FMM.GetFields(KN, XMatrix, FMatrix, RegionIndices);
+   }
+  else if (KN)
    {
-     HMatrix *RFMatrix = GetRFMatrix(Omega, kBloch, XMatrix, 0, true);
+     int ChunkSize = (1<<24) / (6*TotalBFs);
+     CheckEnv("SCUFF_GETFIELDS_CHUNKSIZE", &ChunkSize);
+     if (ChunkSize<1) ChunkSize=1;
+     if (ChunkSize>NX) ChunkSize=NX;
+
      HMatrix KNMatrix(1, TotalBFs, LHM_COMPLEX, LHM_NORMAL, (void *)KN->ZV);
-     HMatrix *FMatrixT = new HMatrix(1, 6*NX, LHM_COMPLEX);
-     KNMatrix.Multiply(RFMatrix, FMatrixT);
-     for(int nx=0; nx<NX; nx++)
-      for(int Mu=0; Mu<6; Mu++)
-       FMatrix->SetEntry(nx, Mu, FMatrixT->GetEntry(0, 6*nx + Mu));
+     HMatrix *XChunk=0, *RFMatrix=0, *FMatrixT=0;
+     for(int nxStart=0; nxStart<NX; nxStart+=ChunkSize)
+      { 
+        int NXC = (nxStart + ChunkSize > NX) ? NX-nxStart : ChunkSize;
+        if (XChunk==0 || XChunk->NR!=NXC)
+         { if (XChunk) delete XChunk;
+           if (FMatrixT) delete FMatrixT;
+           XChunk   = new HMatrix(NXC, 3, LHM_REAL);
+           FMatrixT = new HMatrix(1, 6*NXC, LHM_COMPLEX);
+         };
+        for(int nxc=0; nxc<NXC; nxc++)
+         for(int Mu=0; Mu<3; Mu++)
+          XChunk->SetEntry(nxc, Mu, XMatrix->GetEntryD(nxStart+nxc, Mu));
+
+        RFMatrix=GetRFMatrix(Omega, kBloch, XChunk, RFMatrix, true, 0,
+                             RegionIndices + nxStart);
+        KNMatrix.Multiply(RFMatrix, FMatrixT);
+        for(int nxc=0; nxc<NXC; nxc++)
+         for(int Mu=0; Mu<6; Mu++)
+          FMatrix->SetEntry(nxStart+nxc, Mu, FMatrixT->GetEntry(0, 6*nxc + Mu));
+      };
 
-     delete RFMatrix;
-     delete FMatrixT;
+     if (XChunk) delete XChunk;
+     if (RFMatrix) delete RFMatrix;
+     if (FMatrixT) delete FMatrixT;
    };
 
   /***************************************************************/
@@ -432,11 +794,11 @@ HMatrix *RWGGeometry::GetFields(IncField *IFList, HVector *KN,
   if (IFList)
    for(int nx=0; nx<NX; nx++)
     { 
-      double X[3];
-      XMatrix->GetEntriesD(nx,"0:2",X);
-      int RegionIndex = GetRegionIndex(X);
+      int RegionIndex = RegionIndices[nx];
       if (RegionIndex==-1) continue; // inside a closed PEC surface
 
+      double X[3];
+      XMatrix->GetEntriesD(nx,"0:2",X);
       for(IncField *IF=IFList; IF; IF=IF->Next)
        if ( IF->RegionIndex == RegionIndex )
         { cdouble EH[6];
@@ -446,6 +808,8 @@ HMatrix *RWGGeometry::GetFields(IncField *IFList, HVector *KN,
         };
     };
 
+  delete[] RegionIndices;
+
   return FMatrix;
          
 }
@@ -0,0 +1,1761 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * MLFMAMatrix.cc -- multilevel fast multipole matrix-vector products
+ *                -- with the BEM matrix of compact geometries
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <libhmat.h>
+#include <libhrutil.h>
+#include <libSpherical.h>
+#include <libTriInt.h>
+
+#include "libscuff.h"
+#include "libscuffInternals.h"
+#include "MLFMAMatrix.h"
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+#ifdef USE_OPENMP
+#  include <omp.h>
+#endif
+
+#define II cdouble(0,1)
+
+// far-field interactions through lossy media are dropped between
+// cells for which the green's function has decayed by exp(-MLFMA_DAMPING)
+#define MLFMA_DAMPING 40.0
+
+// order of the cubature rule used to compute radiation patterns
+#define MLFMA_TCRORDER 7
+
+namespace scuff {
+
+/***************************************************************/
+/* an octree cell. each cell holds a contiguous range of edges */
+/* and basis functions in tree ordering.                       */
+/*                                                             */
+/* NearBlocks lists the near-field blocks involving a leaf     */
+/* cell: nb>=0 for blocks with this cell as row cell, ~nb for  */
+/* blocks with this cell as column cell. FarLinks lists the    */
+/* multipole translations with this cell as destination.       */
+/***************************************************************/
+typedef struct MLFMACell
+ { double Center[3], Radius;
+   int Level, Parent;
+   int Kids[8], NumKids;
+   int FirstEdge, LastEdge;
+   int BFOffset, NumBFs;
+   int UpKey, DownKey;         // keys of child->parent, parent->child translations
+   int PCell;                  // preconditioner cell containing this cell
+   std::vector<int> NearBlocks;
+   std::vector<int> FarLinks;
+ } MLFMACell;
+
+typedef struct MLFMAEdge
+ { double X[3];
+   int ns, ne;
+   int BF;                     // index of first basis function in tree ordering
+ } MLFMAEdge;
+
+typedef struct MLFMANearBlock
+ { int A, B;
+   HMatrix *M;
+ } MLFMANearBlock;
+
+typedef struct MLFMALink
+ { int Src, Dest, Key;
+ } MLFMALink;
+
+/***************************************************************/
+/* a translation between the spherical-wave expansions about   */
+/* the centers of two cells. translations depend only on the   */
+/* levels and relative position of the cells, so translations  */
+/* with equal keys are identical.                              */
+/*                                                             */
+/* each translation is carried out in three O(L^3) steps:      */
+/* a rotation taking the displacement D=Center(Src)-Center(Dest)*/
+/* to the +z axis, a coaxial translation by |D|, and the       */
+/* inverse rotation. rotations depend only on the direction of */
+/* D and coaxial translations only on its length and the       */
+/* levels, so both are shared among many keys.                 */
+/***************************************************************/
+typedef struct MLFMAKey
+ { int WaveType, LevelSrc, LevelDest;
+   int Rotation, Axial;
+ } MLFMAKey;
+
+typedef struct MLFMARotation
+ { double Theta, Phi;          // direction of D
+ } MLFMARotation;
+
+typedef struct MLFMAAxial
+ { int WaveType, LevelSrc, LevelDest;
+   double Distance;
+ } MLFMAAxial;
+
+/***************************************************************/
+/* per-region data. the potentials of ND scalar densities are  */
+/* expanded about each cell: densities 0,1,2 are the cartesian */
+/* components of the electric current K and density 3 is its   */
+/* divergence; densities 4..7 are the same for the magnetic    */
+/* current N (absent if all surfaces in the region are PEC).   */
+/*                                                             */
+/* the radiation pattern of the RWG function on each edge,     */
+/* with respect to the regular waves R_{lm} about the center of*/
+/* its leaf cell, is stored as 7 arrays of length (L+1)^2:     */
+/*  Pattern[0..2] = \int f * R                                 */
+/*  Pattern[3]    = \int (div f) * R                           */
+/*  Pattern[4..6] = \int f \times \nabla R                     */
+/***************************************************************/
+typedef struct MLFMARegion
+ { int nr;
+   cdouble k, kFMM, iEpsOmega, iMuOmega, ZRel;
+   int ND;
+   int L[MLFMA_MAXLEVELS];
+   std::vector<int> Sign;              // per edge: +-1, or 0 if not in region
+   std::vector<char> CellActive;
+   std::vector<char> LinkActive;
+   std::vector<cdouble *> Patterns;    // per edge
+   std::vector<cdouble *> Q, Loc;      // per cell
+   std::vector<cdouble *> Rotations;   // per rotation
+   std::vector<cdouble *> Axials;      // per coaxial translation
+ } MLFMARegion;
+
+typedef struct MLFMAData
+ {
+   std::vector<MLFMACell> Cells;       // parents before children
+   std::vector< std::vector<int> > LevelCells;
+   std::vector<int> Leaves;
+   int NumLevels;
+   double FineUnit;                    // half the side of the finest cells
+
+   std::vector<MLFMAEdge> Edges;       // tree ordering
+   int *Perm;                          // tree ordering -> BEM ordering
+
+   std::vector<MLFMANearBlock> NearBlocks;
+   std::vector<MLFMALink> Links;
+   std::vector<MLFMAKey> Keys;
+   std::vector<MLFMARotation> Rotations;
+   std::vector<MLFMAAxial> Axials;
+   std::map<unsigned long long, int> KeyMap, RotationMap, AxialMap;
+   std::vector<MLFMARegion *> Regions;
+
+   // preconditioner blocks: the tree-ordered indices of the
+   // basis functions in each block, and the position of each
+   // basis function within its block
+   std::vector< std::vector<int> > PBFs;
+   std::vector<HMatrix *> PBlocks;
+   std::vector<int> BFPBlock, BFPIndex;
+
+   // wavenumbers and prefactors for the (up to two) regions
+   // shared by each pair of surfaces; index is 2*(nsa*NS + nsb) + nr
+   int NS;
+   int *NumCommonRegions;
+   cdouble *k, *PreFac1, *PreFac2, *PreFac3;
+
+   double NumNearEntries;
+
+ } MLFMAData;
+
+static bool IsLeaf(MLFMACell *C) { return C->NumKids==0; }
+
+/***************************************************************/
+/* recursive construction of the octree over the edge list     */
+/* [First, Last).                                              */
+/***************************************************************/
+static bool LowerThan(const MLFMAEdge &E, int Axis, double Value)
+ { return E.X[Axis] < Value; }
+
+static int BuildCell(RWGGeometry *G, MLFMAData *D, int First, int Last,
+                     double Center[3], double Size, int Level, int Parent,
+                     int LeafSize, int *BFOffset)
+{
+  int nc = D->Cells.size();
+  D->Cells.push_back(MLFMACell());
+  MLFMACell *C=&(D->Cells[nc]);
+  memcpy(C->Center, Center, 3*sizeof(double));
+  C->Level     = Level;
+  C->Parent    = Parent;
+  C->NumKids   = 0;
+  C->FirstEdge = First;
+  C->LastEdge  = Last;
+  C->BFOffset  = *BFOffset;
+  C->UpKey = C->DownKey = -1;
+  C->PCell     = -1;
+  if (Level+1 > D->NumLevels) D->NumLevels=Level+1;
+
+  int NumBFs=0;
+  double Radius=0.0;
+  for(int n=First; n<Last; n++)
+   { RWGSurface *S=G->Surfaces[D->Edges[n].ns];
+     NumBFs += S->IsPEC ? 1 : 2;
+     double R=VecDistance(D->Edges[n].X, Center) + S->GetEdgeByIndex(D->Edges[n].ne)->Radius;
+     if (R>Radius) Radius=R;
+   };
+  C->NumBFs = NumBFs;
+  C->Radius = Radius;
+
+  if ( NumBFs<=LeafSize || (Last-First)<2 || Level==MLFMA_MAXLEVELS-1 )
+   { for(int n=First; n<Last; n++)
+      { D->Edges[n].BF = *BFOffset;
+        *BFOffset += G->Surfaces[D->Edges[n].ns]->IsPEC ? 1 : 2;
+      };
+     return nc;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- sort the edges into octants: split on x, then split each    */
+  /*- half on y, then each quarter on z                           */
+  /*--------------------------------------------------------------*/
+  int Bounds[9];
+  Bounds[0]=First;
+  Bounds[8]=Last;
+  std::vector<MLFMAEdge>::iterator E0=D->Edges.begin();
+  Bounds[4] = std::partition(E0+Bounds[0], E0+Bounds[8],
+                             [Center](const MLFMAEdge &E){ return LowerThan(E,0,Center[0]); }) - E0;
+  for(int h=0; h<2; h++)
+   Bounds[4*h+2] = std::partition(E0+Bounds[4*h], E0+Bounds[4*h+4],
+                                  [Center](const MLFMAEdge &E){ return LowerThan(E,1,Center[1]); }) - E0;
+  for(int q=0; q<4; q++)
+   Bounds[2*q+1] = std::partition(E0+Bounds[2*q], E0+Bounds[2*q+2],
+                                  [Center](const MLFMAEdge &E){ return LowerThan(E,2,Center[2]); }) - E0;
+
+  int Kids[8], NumKids=0;
+  for(int o=0; o<8; o++)
+   { if (Bounds[o+1]==Bounds[o]) continue;
+     double KidCenter[3];
+     KidCenter[0] = Center[0] + ( (o&4) ? 0.25 : -0.25 )*Size;
+     KidCenter[1] = Center[1] + ( (o&2) ? 0.25 : -0.25 )*Size;
+     KidCenter[2] = Center[2] + ( (o&1) ? 0.25 : -0.25 )*Size;
+     Kids[NumKids++]=BuildCell(G, D, Bounds[o], Bounds[o+1], KidCenter,
+                               0.5*Size, Level+1, nc, LeafSize, BFOffset);
+   };
+
+  // D->Cells may have been reallocated by the recursive calls
+  C=&(D->Cells[nc]);
+  C->NumKids=NumKids;
+  memcpy(C->Kids, Kids, NumKids*sizeof(int));
+  return nc;
+}
+
+/***************************************************************/
+/* get the index of the translation from cell Src to cell Dest,*/
+/* adding new entries to the key, rotation, and coaxial tables */
+/* if necessary.                                               */
+/*                                                             */
+/* the translation for displacement -D differs from that for   */
+/* +D only by signs (-1)^{l+l'}, so only one of the two is     */
+/* stored; the return value is ~Index if the translation uses  */
+/* the reflected displacement.                                 */
+/***************************************************************/
+static int LookUp(std::map<unsigned long long,int> &Map, unsigned long long Key, int Size)
+{
+  std::map<unsigned long long,int>::iterator it=Map.find(Key);
+  if (it!=Map.end())
+   return it->second;
+  Map[Key]=Size;
+  return Size;
+}
+
+static long GCD(long a, long b)
+{ while(b) { long t=a%b; a=b; b=t; }
+  return a;
+}
+
+static int GetKey(MLFMAData *D, int WaveType, int Src, int Dest)
+{
+  MLFMACell *CS=&(D->Cells[Src]), *CD=&(D->Cells[Dest]);
+  double DV[3];
+  VecSub(CS->Center, CD->Center, DV);
+
+  // cell centers lie on a grid of spacing FineUnit
+  long Offset[3];
+  for(int i=0; i<3; i++)
+   Offset[i] = lround(DV[i]/D->FineUnit);
+  bool Reflect
+   = (Offset[0]<0) || (Offset[0]==0 && Offset[1]<0)
+                   || (Offset[0]==0 && Offset[1]==0 && Offset[2]<0);
+  if (Reflect)
+   for(int i=0; i<3; i++)
+    { Offset[i]*=-1;
+      DV[i]*=-1.0;
+    };
+
+  unsigned long long Levels = WaveType==LS_REGULAR ? 1 : 0;
+  Levels |= ((unsigned long long)CS->Level) << 1;
+  Levels |= ((unsigned long long)CD->Level) << 5;
+
+  unsigned long long Key=Levels;
+  for(int i=0; i<3; i++)
+   Key |= ((unsigned long long)(Offset[i] + (1L<<17))) << (9 + 18*i);
+  int Index=LookUp(D->KeyMap, Key, D->Keys.size());
+  if (Index < (int)D->Keys.size())
+   return Reflect ? ~Index : Index;
+
+  // rotations are shared by all displacements in the same direction
+  long Divisor=GCD(labs(Offset[0]), GCD(labs(Offset[1]), labs(Offset[2])));
+  unsigned long long RotationKey=0;
+  for(int i=0; i<3; i++)
+   RotationKey |= ((unsigned long long)(Offset[i]/Divisor + (1L<<17))) << (18*i);
+  int Rotation=LookUp(D->RotationMap, RotationKey, D->Rotations.size());
+  if (Rotation==(int)D->Rotations.size())
+   { MLFMARotation Rot;
+     double r;
+     CoordinateC2S(DV, &r, &(Rot.Theta), &(Rot.Phi));
+     D->Rotations.push_back(Rot);
+   };
+
+  // coaxial translations by all displacements of the same length
+  unsigned long long Length2=0;
+  for(int i=0; i<3; i++)
+   Length2 += Offset[i]*Offset[i];
+  int Axial=LookUp(D->AxialMap, Levels | (Length2<<9), D->Axials.size());
+  if (Axial==(int)D->Axials.size())
+   { MLFMAAxial Ax;
+     Ax.WaveType  = WaveType;
+     Ax.LevelSrc  = CS->Level;
+     Ax.LevelDest = CD->Level;
+     Ax.Distance  = VecNorm(DV);
+     D->Axials.push_back(Ax);
+   };
+
+  MLFMAKey K;
+  K.WaveType  = WaveType;
+  K.LevelSrc  = CS->Level;
+  K.LevelDest = CD->Level;
+  K.Rotation  = Rotation;
+  K.Axial     = Axial;
+  D->Keys.push_back(K);
+  return Reflect ? ~Index : Index;
+}
+
+static int KeyIndex(int Key) { return Key<0 ? ~Key : Key; }
+
+/***************************************************************/
+/* true if interactions between cells A and B through region R */
+/* are negligible because of losses in the medium              */
+/***************************************************************/
+static bool IsDamped(MLFMARegion *R, MLFMACell *A, MLFMACell *B)
+{
+  double Gap = VecDistance(A->Center, B->Center) - A->Radius - B->Radius;
+  return imag(R->k)*Gap > MLFMA_DAMPING;
+}
+
+static bool Admissible(MLFMAData *D, double Eta, int A, int B)
+{
+  MLFMACell *CA=&(D->Cells[A]), *CB=&(D->Cells[B]);
+  if ( CA->Radius + CB->Radius >= Eta*VecDistance(CA->Center, CB->Center) )
+   return false;
+
+  for(size_t nr=0; nr<D->Regions.size(); nr++)
+   { MLFMARegion *R=D->Regions[nr];
+     if ( !R->CellActive[A] || !R->CellActive[B] || IsDamped(R, CA, CB) )
+      continue;
+     if ( R->L[CA->Level] > MLFMA_MAXL || R->L[CB->Level] > MLFMA_MAXL )
+      return false;
+   };
+  return true;
+}
+
+/***************************************************************/
+/* dual traversal of the tree to sort all pairs of cells into  */
+/* near-field blocks and far-field (multipole) links.          */
+/***************************************************************/
+static void AddNearBlock(MLFMAData *D, int A, int B)
+{
+  MLFMANearBlock NB;
+  NB.A=A;
+  NB.B=B;
+  NB.M=0;
+  int nb=D->NearBlocks.size();
+  D->NearBlocks.push_back(NB);
+  D->Cells[A].NearBlocks.push_back(nb);
+  if (B!=A)
+   D->Cells[B].NearBlocks.push_back(~nb);
+}
+
+static void AddFarLinks(MLFMAData *D, int A, int B)
+{
+  MLFMALink Link;
+  Link.Src=B; Link.Dest=A; Link.Key=GetKey(D, LS_OUTGOING, B, A);
+  D->Cells[A].FarLinks.push_back(D->Links.size());
+  D->Links.push_back(Link);
+  Link.Src=A; Link.Dest=B; Link.Key=GetKey(D, LS_OUTGOING, A, B);
+  D->Cells[B].FarLinks.push_back(D->Links.size());
+  D->Links.push_back(Link);
+}
+
+static void Traverse(MLFMAData *D, double Eta, int A, int B)
+{
+  MLFMACell *CA=&(D->Cells[A]), *CB=&(D->Cells[B]);
+  if (A==B)
+   { if (IsLeaf(CA))
+      AddNearBlock(D, A, A);
+     else
+      for(int i=0; i<CA->NumKids; i++)
+       for(int j=i; j<CA->NumKids; j++)
+        Traverse(D, Eta, CA->Kids[i], CA->Kids[j]);
+     return;
+   };
+
+  if ( Admissible(D, Eta, A, B) )
+   { AddFarLinks(D, A, B);
+     return;
+   };
+
+  // split the coarser cell, or both cells if they are on the
+  // same level; this keeps most far pairs on a single level and
+  // so limits the number of distinct translations
+  bool SplitA = !IsLeaf(CA) && ( IsLeaf(CB) || CA->Level <= CB->Level );
+  bool SplitB = !IsLeaf(CB) && ( IsLeaf(CA) || CB->Level <= CA->Level );
+  if ( !SplitA && !SplitB )
+   AddNearBlock(D, A, B);
+  else if ( SplitA && SplitB )
+   for(int i=0; i<CA->NumKids; i++)
+    for(int j=0; j<CB->NumKids; j++)
+     Traverse(D, Eta, CA->Kids[i], CB->Kids[j]);
+  else if (SplitA)
+   for(int i=0; i<CA->NumKids; i++)
+    Traverse(D, Eta, CA->Kids[i], B);
+  else
+   for(int j=0; j<CB->NumKids; j++)
+    Traverse(D, Eta, A, CB->Kids[j]);
+}
+
+/***************************************************************/
+/* regular (WaveType=LS_REGULAR) or outgoing (LS_OUTGOING)     */
+/* spherical waves R_{lm}(X) = z_l(k|X|) Y_{lm}(X) for l<=L,   */
+/* with z_l=j_l or h_l, and their cartesian gradients          */
+/* GradR[i*P + Alpha], P=(L+1)^2. Workspace must have room for */
+/* 3*(L+2)+2*P cdoubles.                                       */
+/***************************************************************/
+static void GetSphericalWaves(int L, cdouble k, double X[3], int WaveType,
+                              cdouble *R, cdouble *GradR, cdouble *Workspace)
+{
+  int P=(L+1)*(L+1);
+  cdouble *Rad=Workspace, *dRad=Rad + (L+2), *Ylm=dRad + (L+2), *dYlm=Ylm + P;
+
+  double r, Theta, Phi;
+  CoordinateC2S(X, &r, &Theta, &Phi);
+  if (r==0.0) r=1.0e-12;
+  // GetYlmDerivArray clamps Theta in the same way
+  if ( Theta < 1.0e-6 ) Theta=1.0e-6;
+  if ( fabs(M_PI-Theta) < 1.0e-6 ) Theta=M_PI-1.0e-6;
+
+  GetRadialFunctions(L, k, r, WaveType, Rad, dRad);
+  GetYlmDerivArray(L, Theta, Phi, Ylm, dYlm);
+
+  double CT=cos(Theta), ST=sin(Theta), CP=cos(Phi), SP=sin(Phi);
+  double rHat[3]     = { ST*CP, ST*SP,  CT };
+  double ThetaHat[3] = { CT*CP, CT*SP, -ST };
+  double PhiHat[3]   = {   -SP,    CP, 0.0 };
+  for(int Alpha=0, l=0; l<=L; l++)
+   for(int m=-l; m<=l; m++, Alpha++)
+    { R[Alpha] = Rad[l]*Ylm[Alpha];
+      cdouble dr     = dRad[l]*Ylm[Alpha];
+      cdouble dTheta = Rad[l]*dYlm[Alpha] / r;
+      cdouble dPhi   = Rad[l]*II*((double)m)*Ylm[Alpha] / (r*ST);
+      for(int i=0; i<3; i++)
+       GradR[i*P + Alpha] = dr*rHat[i] + dTheta*ThetaHat[i] + dPhi*PhiHat[i];
+    };
+}
+
+/***************************************************************/
+/* compute the radiation pattern of the RWG function on edge E */
+/* with respect to the regular waves about the center X0 of    */
+/* its leaf cell.                                              */
+/***************************************************************/
+static void GetRadiationPattern(RWGSurface *S, int ne, double X0[3],
+                                cdouble k, int L, cdouble *W)
+{
+  int P=(L+1)*(L+1);
+  memset(W, 0, 7*P*sizeof(cdouble));
+
+  cdouble *R         = new cdouble[4*P + 3*(L+2) + 2*P];
+  cdouble *GradR     = R + P;
+  cdouble *Workspace = GradR + 3*P;
+
+  int NumPts;
+  double *TCR=GetTCR(MLFMA_TCRORDER, &NumPts);
+
+  RWGEdge *E=S->GetEdgeByIndex(ne);
+  for(int PM=0; PM<2; PM++)
+   { int np    = PM==0 ? E->iPPanel : E->iMPanel;
+     int iQ    = PM==0 ? E->PIndex  : E->MIndex;
+     if (np==-1) continue;
+     double Sign = PM==0 ? 1.0 : -1.0;
+
+     RWGPanel *Panel=S->Panels[np];
+     double *V0 = S->Vertices + 3*Panel->VI[0];
+     double *V1 = S->Vertices + 3*Panel->VI[1];
+     double *V2 = S->Vertices + 3*Panel->VI[2];
+     double *Q  = S->Vertices + 3*Panel->VI[iQ];
+
+     // the RWG prefactor L/(2A) cancels the jacobian 2A
+     for(int n=0; n<NumPts; n++)
+      { double u=TCR[3*n], v=TCR[3*n+1], w=Sign*E->Length*TCR[3*n+2];
+        double X[3], XmX0[3], F[3];
+        for(int i=0; i<3; i++)
+         { X[i]    = V0[i] + u*(V1[i]-V0[i]) + v*(V2[i]-V0[i]);
+           XmX0[i] = X[i] - X0[i];
+           F[i]    = w*(X[i] - Q[i]);
+         };
+        GetSphericalWaves(L, k, XmX0, LS_REGULAR, R, GradR, Workspace);
+        for(int Alpha=0; Alpha<P; Alpha++)
+         { cdouble dR[3]={GradR[Alpha], GradR[P+Alpha], GradR[2*P+Alpha]};
+           W[0*P+Alpha] += F[0]*R[Alpha];
+           W[1*P+Alpha] += F[1]*R[Alpha];
+           W[2*P+Alpha] += F[2]*R[Alpha];
+           W[3*P+Alpha] += 2.0*w*R[Alpha];
+           W[4*P+Alpha] += F[1]*dR[2] - F[2]*dR[1];
+           W[5*P+Alpha] += F[2]*dR[0] - F[0]*dR[2];
+           W[6*P+Alpha] += F[0]*dR[1] - F[1]*dR[0];
+         };
+      };
+   };
+
+  delete[] R;
+}
+
+/***************************************************************/
+/* choose the spherical-wave order for each level of the tree  */
+/* from the maximum cell radius at that level: enough orders   */
+/* to resolve the oscillations of the kernel over the cell,    */
+/* plus enough to reach the requested tolerance given the      */
+/* separation criterion. levels needing L>MLFMA_MAXL cannot    */
+/* take part in multipole translations.                        */
+/*                                                             */
+/* in lossy media the regular waves grow like exp(Im k r)      */
+/* while the outgoing waves decay, so an expansion about a     */
+/* cell of radius R loses about exp(2 Im k R) to cancellation; */
+/* levels at which this exceeds the tolerance are excluded in  */
+/* the same way, so that those interactions fall back to       */
+/* direct evaluation.                                          */
+/***************************************************************/
+static void ChooseOrders(MLFMAData *D, MLFMARegion *R, double Tol, double Eta)
+{
+  int LStatic = (int)ceil( log(Tol) / log(Eta) );
+  double d0   = -log10(Tol);
+  for(int Level=0; Level<MLFMA_MAXLEVELS; Level++)
+   { double RMax=0.0;
+     if (Level<D->NumLevels)
+      for(size_t n=0; n<D->LevelCells[Level].size(); n++)
+       RMax=fmax(RMax, D->Cells[D->LevelCells[Level][n]].Radius);
+     double kD = abs(R->kFMM)*2.0*RMax;
+     int L = (int)ceil( kD + 1.8*pow(d0,2.0/3.0)*cbrt(kD) );
+     if (L<LStatic) L=LStatic;
+     if ( DBL_EPSILON*exp(2.0*fabs(imag(R->kFMM))*RMax) > Tol )
+      L=MLFMA_MAXL+1;
+     R->L[Level] = (L>MLFMA_MAXL) ? MLFMA_MAXL+1 : L;
+   };
+}
+
+/***************************************************************/
+/* nodes and weights of the N-point Gauss-Legendre rule on     */
+/* [-1,1]                                                      */
+/***************************************************************/
+static void GetGaussLegendreRule(int N, double *x, double *w)
+{
+  for(int i=0; i<N; i++)
+   { double z=cos(M_PI*(i+0.75)/(N+0.5)), dP=1.0;
+     for(int Iter=0; Iter<100; Iter++)
+      { double P0=1.0, P1=z;
+        for(int n=2; n<=N; n++)
+         { double P2 = ( (2*n-1)*z*P1 - (n-1)*P0 ) / ((double)n);
+           P0=P1;
+           P1=P2;
+         };
+        dP = N*(z*P1 - P0)/(z*z - 1.0);
+        double Delta = P1/dP;
+        z -= Delta;
+        if ( fabs(Delta) < 1.0e-15 ) break;
+      };
+     x[i]=z;
+     w[i]=2.0/((1.0-z*z)*dP*dP);
+   };
+}
+
+/***************************************************************/
+/* blocks of the rotation matrix for spherical harmonics of    */
+/* degree l<=L:                                                */
+/*                                                             */
+/*  Y_{lm}(R^{-1} x) = \sum_{m'} Rot^l_{m,m'} Y_{lm'}(x)        */
+/*                                                             */
+/* where R^{-1} = Rz(Phi)*Ry(Theta) takes the z axis into the  */
+/* direction (Theta,Phi). block l is stored row-major at offset*/
+/* l(4l^2-1)/3. the blocks are computed by quadrature over the */
+/* sphere, which is exact for a rule of degree 2L.             */
+/***************************************************************/
+static int RotationOffset(int l) { return l*(4*l*l-1)/3; }
+
+static cdouble *GetRotation(MLFMARotation *Rot, int L)
+{
+  int P=(L+1)*(L+1);
+  cdouble *Block = new cdouble[RotationOffset(L+1)];
+  memset(Block, 0, RotationOffset(L+1)*sizeof(cdouble));
+
+  int NT=L+1, NP=2*L+1;
+  double *xGL=new double[2*NT], *wGL=xGL+NT;
+  GetGaussLegendreRule(NT, xGL, wGL);
+  cdouble *Y=new cdouble[2*P], *YRot=Y+P;
+
+  double CT=cos(Rot->Theta), ST=sin(Rot->Theta);
+  double CP=cos(Rot->Phi),   SP=sin(Rot->Phi);
+  for(int nt=0; nt<NT; nt++)
+   for(int np=0; np<NP; np++)
+    { double Theta = acos(xGL[nt]), Phi=2.0*M_PI*np/((double)NP);
+      double Weight = wGL[nt]*2.0*M_PI/((double)NP);
+      GetYlmArray(L, Theta, Phi, Y);
+
+      // X = R^{-1} x = Rz(Phi)*Ry(Theta) x
+      double x[3], X[3], Xp[3];
+      x[0]=sin(Theta)*cos(Phi); x[1]=sin(Theta)*sin(Phi); x[2]=cos(Theta);
+      Xp[0] =  CT*x[0] + ST*x[2];
+      Xp[1] =  x[1];
+      Xp[2] = -ST*x[0] + CT*x[2];
+      X[0]  =  CP*Xp[0] - SP*Xp[1];
+      X[1]  =  SP*Xp[0] + CP*Xp[1];
+      X[2]  =  Xp[2];
+      double r, ThetaRot, PhiRot;
+      CoordinateC2S(X, &r, &ThetaRot, &PhiRot);
+      GetYlmArray(L, ThetaRot, PhiRot, YRot);
+
+      for(int l=0; l<=L; l++)
+       { cdouble *B=Block + RotationOffset(l);
+         int l2=l*l + l;
+         for(int m=-l; m<=l; m++)
+          { cdouble WY=Weight*YRot[l2+m];
+            for(int mp=-l; mp<=l; mp++)
+             B[(m+l)*(2*l+1) + (mp+l)] += WY*conj(Y[l2+mp]);
+          };
+       };
+    };
+
+  delete[] Y;
+  delete[] xGL;
+  return Block;
+}
+
+/***************************************************************/
+/* coaxial translation by Distance along +z from an expansion  */
+/* of order LS to one of order LD. only coefficients with the  */
+/* same m are coupled; the block for each m (|m|<=min(LS,LD))  */
+/* has rows l=|m|..LS and columns l'=|m|..LD and the blocks are*/
+/* stored consecutively in order of increasing m.              */
+/***************************************************************/
+static cdouble *GetAxial(MLFMAAxial *Ax, cdouble k, int LS, int LD, double *Table)
+{
+  HMatrix *T = new HMatrix( (LS+1)*(LS+1), (LD+1)*(LD+1), LHM_COMPLEX);
+  double DV[3]={0.0, 0.0, Ax->Distance};
+  GetScalarTranslationMatrix(DV, k, LS, LD, Ax->WaveType, T, Table);
+
+  int MMax = LS<LD ? LS : LD;
+  size_t Size=0;
+  for(int m=-MMax; m<=MMax; m++)
+   Size += (LS-abs(m)+1)*(LD-abs(m)+1);
+  cdouble *Axial = new cdouble[Size], *A=Axial;
+  for(int m=-MMax; m<=MMax; m++)
+   for(int ls=abs(m); ls<=LS; ls++)
+    for(int ld=abs(m); ld<=LD; ld++)
+     *(A++) = T->GetEntry( LM2ALPHA(ls,m), LM2ALPHA(ld,m) );
+
+  delete T;
+  return Axial;
+}
+
+/***************************************************************/
+/* Dest[c*PD + b] += \sum_a T_{ab} Src[c*PS + a] for each of  */
+/* the ND densities c, where T is the translation matrix for   */
+/* Key, applied as rotation + coaxial translation + inverse    */
+/* rotation                                                    */
+/***************************************************************/
+static void Translate(MLFMAData *D, MLFMARegion *R, int Key,
+                      cdouble *Src, cdouble *Dest, int ND)
+{
+  MLFMAKey *K   = &(D->Keys[KeyIndex(Key)]);
+  bool Reflect  = (Key<0);
+  int LS=R->L[K->LevelSrc], LD=R->L[K->LevelDest];
+  int PS=(LS+1)*(LS+1), PD=(LD+1)*(LD+1);
+  int MMax = LS<LD ? LS : LD;
+  cdouble *Rot  = R->Rotations[K->Rotation];
+  cdouble *Axial= R->Axials[K->Axial];
+
+  cdouble W1[(MLFMA_MAXL+1)*(MLFMA_MAXL+1)], W2[(MLFMA_MAXL+1)*(MLFMA_MAXL+1)];
+  for(int c=0; c<ND; c++)
+   { cdouble *S=Src + c*PS, *T=Dest + c*PD;
+
+     // rotate the displacement onto the z axis
+     for(int l=0; l<=LS; l++)
+      { cdouble *B=Rot + RotationOffset(l);
+        int l2=l*l+l, N=2*l+1;
+        double Sign = (Reflect && l%2) ? -1.0 : 1.0;
+        for(int mp=-l; mp<=l; mp++)
+         W1[l2+mp]=0.0;
+        for(int m=-l; m<=l; m++)
+         { cdouble Sm=Sign*S[l2+m], *Row=B + (m+l)*N + l;
+           for(int mp=-l; mp<=l; mp++)
+            W1[l2+mp] += Sm*Row[mp];
+         };
+      };
+
+     // coaxial translation
+     memset(W2, 0, PD*sizeof(cdouble));
+     cdouble *A=Axial;
+     for(int m=-MMax; m<=MMax; m++)
+      for(int ls=abs(m); ls<=LS; ls++)
+       { cdouble W=W1[ls*ls+ls+m];
+         for(int ld=abs(m); ld<=LD; ld++)
+          W2[ld*ld+ld+m] += W*(*(A++));
+       };
+
+     // and back
+     for(int l=0; l<=LD; l++)
+      { cdouble *B=Rot + RotationOffset(l);
+        int l2=l*l+l, N=2*l+1;
+        double Sign = (Reflect && l%2) ? -1.0 : 1.0;
+        for(int m=-l; m<=l; m++)
+         { cdouble Sum=0.0, *Row=B + (m+l)*N + l;
+           for(int mp=-l; mp<=l; mp++)
+            Sum += W2[l2+mp]*conj(Row[mp]);
+           T[l2+m] += Sign*Sum;
+         };
+      };
+   };
+}
+
+/***************************************************************/
+/* fill in the near-field block for the edges of cells A and B */
+/* (in tree ordering). for diagonal blocks only edge pairs on  */
+/* or above the diagonal are computed.                         */
+/***************************************************************/
+static void GetNearBlock(RWGGeometry *G, MLFMAData *D, GetEEIArgStruct *Args,
+                         MLFMANearBlock *NB)
+{
+  MLFMACell *CA=&(D->Cells[NB->A]), *CB=&(D->Cells[NB->B]);
+  HMatrix *M = NB->M = new HMatrix(CA->NumBFs, CB->NumBFs, LHM_COMPLEX);
+  bool Symmetric = (NB->A==NB->B);
+  cdouble *GC=Args->GC;
+
+  for(int na=CA->FirstEdge; na<CA->LastEdge; na++)
+   for(int nb=(Symmetric ? na : CB->FirstEdge); nb<CB->LastEdge; nb++)
+    { MLFMAEdge *Ea=&(D->Edges[na]), *Eb=&(D->Edges[nb]);
+      int nsab = Ea->ns*D->NS + Eb->ns;
+      if (D->NumCommonRegions[nsab]==0)
+       continue;
+
+      cdouble MB[4]={0.0, 0.0, 0.0, 0.0};
+      Args->Sa  = G->Surfaces[Ea->ns];
+      Args->Sb  = G->Surfaces[Eb->ns];
+      Args->nea = Ea->ne;
+      Args->neb = Eb->ne;
+      for(int nr=0; nr<D->NumCommonRegions[nsab]; nr++)
+       { int Index = 2*nsab + nr;
+         Args->k = D->k[Index];
+         GetEdgeEdgeInteractions(Args);
+         MB[0] += D->PreFac1[Index]*GC[0];
+         MB[1] += D->PreFac2[Index]*GC[1];
+         MB[2] += D->PreFac2[Index]*GC[1];
+         MB[3] += D->PreFac3[Index]*GC[0];
+       };
+
+      int NRA = Args->Sa->IsPEC ? 1 : 2, NRB = Args->Sb->IsPEC ? 1 : 2;
+      int ra  = Ea->BF - CA->BFOffset, cb = Eb->BF - CB->BFOffset;
+      for(int i=0; i<NRA; i++)
+       for(int j=0; j<NRB; j++)
+        { M->SetEntry(ra+i, cb+j, MB[2*i+j]);
+          if (Symmetric)
+           M->SetEntry(cb+j, ra+i, MB[2*i+j]);
+        };
+    };
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+static void DestroyRegion(MLFMARegion *R)
+{
+  for(size_t n=0; n<R->Patterns.size(); n++)
+   if (R->Patterns[n]) delete[] R->Patterns[n];
+  for(size_t n=0; n<R->Q.size(); n++)
+   { if (R->Q[n])   delete[] R->Q[n];
+     if (R->Loc[n]) delete[] R->Loc[n];
+   };
+  for(size_t n=0; n<R->Rotations.size(); n++)
+   if (R->Rotations[n]) delete[] R->Rotations[n];
+  for(size_t n=0; n<R->Axials.size(); n++)
+   if (R->Axials[n]) delete[] R->Axials[n];
+  delete R;
+}
+
+static void ClearData(MLFMAData *D)
+{
+  for(size_t n=0; n<D->NearBlocks.size(); n++)
+   if (D->NearBlocks[n].M) delete D->NearBlocks[n].M;
+  for(size_t n=0; n<D->Regions.size(); n++)
+   DestroyRegion(D->Regions[n]);
+  for(size_t n=0; n<D->PBlocks.size(); n++)
+   delete D->PBlocks[n];
+  D->Cells.clear();
+  D->LevelCells.clear();
+  D->Leaves.clear();
+  D->Edges.clear();
+  D->NearBlocks.clear();
+  D->Links.clear();
+  D->Keys.clear();
+  D->Rotations.clear();
+  D->Axials.clear();
+  D->KeyMap.clear();
+  D->RotationMap.clear();
+  D->AxialMap.clear();
+  D->Regions.clear();
+  D->PBFs.clear();
+  D->PBlocks.clear();
+  D->NumLevels=0;
+  D->NumNearEntries=0.0;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+MLFMAMatrix::MLFMAMatrix(RWGGeometry *_G, double _Tol, int _LeafSize)
+ : G(_G), Tol(_Tol), LeafSize(_LeafSize)
+{
+  if (G->LDim>0)
+   ErrExit("MLFMA matrices not supported for periodic geometries");
+  if (G->Substrate)
+   ErrExit("MLFMA matrices not supported for geometries with substrates");
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   if (G->Surfaces[ns]->SurfaceZeta)
+    ErrExit("MLFMA matrices not supported for surfaces with finite conductivity");
+  if (RWGGeometry::UseHRWGFunctions && G->NumMMJs>0)
+   ErrExit("MLFMA matrices not supported for multi-material junctions");
+
+  Eta=MLFMA_DEFAULT_ETA;
+  PBlockSize=MLFMA_DEFAULT_PBLOCKSIZE;
+  CheckEnv("SCUFF_MLFMA_TOL",        &Tol);
+  CheckEnv("SCUFF_MLFMA_LEAFSIZE",   &LeafSize);
+  CheckEnv("SCUFF_MLFMA_ETA",        &Eta);
+  CheckEnv("SCUFF_MLFMA_PBLOCKSIZE", &PBlockSize);
+  if (Tol<=0.0 || Tol>=1.0) Tol=MLFMA_DEFAULT_TOL;
+  if (LeafSize<=0) LeafSize=MLFMA_DEFAULT_LEAFSIZE;
+  if (Eta<=0.0 || Eta>=1.0) Eta=MLFMA_DEFAULT_ETA;
+  if (PBlockSize<LeafSize) PBlockSize=LeafSize;
+
+  N=G->TotalBFs;
+  Omega=0.0;
+  HaveMatrix=false;
+
+  int NS=G->NumSurfaces;
+  MLFMAData *D = new MLFMAData;
+  D->NumLevels        = 0;
+  D->NumNearEntries   = 0.0;
+  D->Perm             = (int *)mallocEC(N*sizeof(int));
+  D->NS               = NS;
+  D->NumCommonRegions = (int *)mallocEC(NS*NS*sizeof(int));
+  D->k                = (cdouble *)mallocEC(4*2*NS*NS*sizeof(cdouble));
+  D->PreFac1          = D->k + 2*NS*NS;
+  D->PreFac2          = D->k + 4*NS*NS;
+  D->PreFac3          = D->k + 6*NS*NS;
+  Data=(void *)D;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+MLFMAMatrix::~MLFMAMatrix()
+{
+  MLFMAData *D=(MLFMAData *)Data;
+  ClearData(D);
+  free(D->Perm);
+  free(D->NumCommonRegions);
+  free(D->k);
+  delete D;
+}
+
+/***************************************************************/
+/* (re)build the octree and compute the near-field blocks, the */
+/* radiation patterns, and the translation matrices at         */
+/* frequency Omega. The tree is rebuilt on every call so that  */
+/* geometrical transformations applied since the last call are */
+/* accounted for. If NeedMatrix is false, only the data needed */
+/* by GetFields() are computed.                                */
+/***************************************************************/
+void MLFMAMatrix::Assemble(cdouble _Omega, bool NeedMatrix)
+{
+  MLFMAData *D=(MLFMAData *)Data;
+  double Time0=Secs();
+  Omega=_Omega;
+  HaveMatrix=NeedMatrix;
+  ClearData(D);
+
+  /*--------------------------------------------------------------*/
+  /*- build the octree -------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  double XMin[3]={ HUGE_VAL,  HUGE_VAL,  HUGE_VAL};
+  double XMax[3]={-HUGE_VAL, -HUGE_VAL, -HUGE_VAL};
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   for(int ne=0; ne<G->Surfaces[ns]->NumEdges; ne++)
+    { MLFMAEdge E;
+      memcpy(E.X, G->Surfaces[ns]->GetEdgeByIndex(ne)->Centroid, 3*sizeof(double));
+      E.ns=ns;
+      E.ne=ne;
+      E.BF=0;
+      D->Edges.push_back(E);
+      for(int i=0; i<3; i++)
+       { XMin[i]=fmin(XMin[i], E.X[i]);
+         XMax[i]=fmax(XMax[i], E.X[i]);
+       };
+    };
+  double Center[3], Size=0.0;
+  for(int i=0; i<3; i++)
+   { Center[i] = 0.5*(XMin[i] + XMax[i]);
+     Size      = fmax(Size, XMax[i]-XMin[i]);
+   };
+  Size = (Size==0.0) ? 1.0 : 1.000001*Size;
+
+  int BFOffset=0;
+  BuildCell(G, D, 0, D->Edges.size(), Center, Size, 0, -1, LeafSize, &BFOffset);
+  D->FineUnit = Size / ((double)(1<<D->NumLevels));
+
+  D->LevelCells.resize(D->NumLevels);
+  int NumCells=D->Cells.size();
+  for(int nc=0; nc<NumCells; nc++)
+   { MLFMACell *C=&(D->Cells[nc]);
+     D->LevelCells[C->Level].push_back(nc);
+     if (IsLeaf(C)) D->Leaves.push_back(nc);
+   };
+
+  int NumEdges=D->Edges.size();
+  for(int n=0; n<NumEdges; n++)
+   { MLFMAEdge *E=&(D->Edges[n]);
+     int Offset=G->BFIndexOffset[E->ns];
+     if (G->Surfaces[E->ns]->IsPEC)
+      D->Perm[E->BF] = Offset + E->ne;
+     else
+      { D->Perm[E->BF]   = Offset + 2*E->ne;
+        D->Perm[E->BF+1] = Offset + 2*E->ne + 1;
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- precompute region data for all surface pairs (near field)  -*/
+  /*- and for each region (far field)                            -*/
+  /*--------------------------------------------------------------*/
+  G->UpdateCachedEpsMuValues(Omega);
+  int NS=D->NS;
+  for(int nsa=0; nsa<NS; nsa++)
+   for(int nsb=0; nsb<NS; nsb++)
+    { int nsab=nsa*NS+nsb, CRIndices[2];
+      double Signs[2];
+      D->NumCommonRegions[nsab]
+       =CountCommonRegions(G->Surfaces[nsa], G->Surfaces[nsb], CRIndices, Signs);
+      for(int nr=0; nr<D->NumCommonRegions[nsab]; nr++)
+       { cdouble Eps = G->EpsTF[ CRIndices[nr] ];
+         cdouble Mu  = G->MuTF[ CRIndices[nr] ];
+         int Index   = 2*nsab + nr;
+         D->k[Index]       = csqrt2(Eps*Mu)*Omega;
+         D->PreFac1[Index] =  Signs[nr]*II*Mu*Omega;
+         D->PreFac2[Index] = -Signs[nr]*II*D->k[Index];
+         D->PreFac3[Index] = -Signs[nr]*II*Eps*Omega;
+       };
+    };
+
+  for(int nr=0; nr<G->NumRegions; nr++)
+   { cdouble Eps = G->EpsTF[nr], Mu = G->MuTF[nr];
+     if (Eps==0.0 || Mu==0.0) continue;
+
+     MLFMARegion *R = new MLFMARegion;
+     R->nr        = nr;
+     R->k         = csqrt2(Eps*Mu)*Omega;
+     R->iEpsOmega = II*Eps*Omega;
+     R->iMuOmega  = II*Mu*Omega;
+     // the relative impedance is the principal root (Re ZRel > 0);
+     // csqrt2 would flip its sign in lossy media, where Im(Mu/Eps)<0
+     R->ZRel      = sqrt(Mu/Eps);
+     // the spherical-wave routines treat purely imaginary
+     // wavenumbers with different normalizations, so we
+     // give them a negligible real part
+     R->kFMM      = R->k;
+     if (real(R->kFMM)==0.0)
+      R->kFMM += 1.0e-8*abs(R->k);
+
+     R->ND=4;
+     R->Sign.resize(NumEdges, 0);
+     R->CellActive.resize(NumCells, 0);
+     bool Empty=true;
+     for(int n=0; n<NumEdges; n++)
+      { RWGSurface *S=G->Surfaces[D->Edges[n].ns];
+        if (S->RegionIndices[0]==nr)
+         R->Sign[n]=+1;
+        else if (!S->IsPEC && S->RegionIndices[1]==nr)
+         R->Sign[n]=-1;
+        if (R->Sign[n]==0) continue;
+        if (!S->IsPEC) R->ND=8;
+        Empty=false;
+      };
+     if (Empty)
+      { delete R;
+        continue;
+      };
+     for(int nc=0; nc<NumCells; nc++)
+      { MLFMACell *C=&(D->Cells[nc]);
+        for(int n=C->FirstEdge; n<C->LastEdge && !R->CellActive[nc]; n++)
+         if (R->Sign[n]!=0) R->CellActive[nc]=1;
+      };
+     ChooseOrders(D, R, Tol, Eta);
+     D->Regions.push_back(R);
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- sort cell pairs into near and far interactions and set up  -*/
+  /*- the translations between parents and children              -*/
+  /*--------------------------------------------------------------*/
+  if (NeedMatrix)
+   Traverse(D, Eta, 0, 0);
+  for(int nc=1; nc<NumCells; nc++)
+   { MLFMACell *C=&(D->Cells[nc]);
+     C->UpKey   = GetKey(D, LS_REGULAR, nc, C->Parent);
+     if (NeedMatrix)
+      C->DownKey = GetKey(D, LS_REGULAR, C->Parent, nc);
+   };
+
+  int NumLinks=D->Links.size(), NumKeys=D->Keys.size();
+  int NumThreads=GetNumThreads();
+  Log("Assembling MLFMA %s at Omega=%s (%i cells, %i levels, %i near blocks, %i far pairs)",
+       NeedMatrix ? "matrix" : "field expansions",
+       z2s(Omega),NumCells,D->NumLevels,D->NearBlocks.size(),NumLinks/2);
+
+  /*--------------------------------------------------------------*/
+  /*- near-field blocks ------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  int NumNearBlocks=D->NearBlocks.size();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int nb=0; nb<NumNearBlocks; nb++)
+   { GetEEIArgStruct MyEEIArgs, *EEIArgs=&MyEEIArgs;
+     InitGetEEIArgs(EEIArgs);
+     GetNearBlock(G, D, EEIArgs, &(D->NearBlocks[nb]));
+   };
+  for(int nb=0; nb<NumNearBlocks; nb++)
+   { MLFMANearBlock *NB=&(D->NearBlocks[nb]);
+     D->NumNearEntries += (NB->A==NB->B ? 1.0 : 2.0)*NB->M->NR*NB->M->NC;
+   };
+  double Time1=Secs();
+
+  /*--------------------------------------------------------------*/
+  /*- far field: for each region, the set of translations we     -*/
+  /*- actually need, their matrices, and the radiation patterns  -*/
+  /*--------------------------------------------------------------*/
+  double NumTEntries=0.0;
+  for(size_t nr=0; nr<D->Regions.size(); nr++)
+   { MLFMARegion *R=D->Regions[nr];
+     int ND=R->ND;
+
+     std::vector<char> NeedKey(NumKeys, 0);
+     R->LinkActive.resize(NumLinks, 0);
+     for(int nl=0; nl<NumLinks; nl++)
+      { MLFMALink *Link=&(D->Links[nl]);
+        MLFMACell *CS=&(D->Cells[Link->Src]), *CD=&(D->Cells[Link->Dest]);
+        if ( R->CellActive[Link->Src] && R->CellActive[Link->Dest] && !IsDamped(R, CS, CD) )
+         R->LinkActive[nl]=NeedKey[KeyIndex(Link->Key)]=1;
+      };
+     for(int nc=1; nc<NumCells; nc++)
+      { MLFMACell *C=&(D->Cells[nc]);
+        if ( R->CellActive[nc] && R->L[C->Level-1]<=MLFMA_MAXL )
+         { NeedKey[KeyIndex(C->UpKey)]=1;
+           if (NeedMatrix)
+            NeedKey[KeyIndex(C->DownKey)]=1;
+         };
+      };
+
+     // each rotation is computed to the highest order at which
+     // it is used; coaxial translations for each (LSrc, LDest) pair
+     // share a table of angular coefficients
+     int NumRotations=D->Rotations.size(), NumAxials=D->Axials.size();
+     std::vector<int> RotationL(NumRotations, -1);
+     std::vector<char> NeedAxial(NumAxials, 0);
+     for(int nk=0; nk<NumKeys; nk++)
+      if (NeedKey[nk])
+       { MLFMAKey *K=&(D->Keys[nk]);
+         int L=std::max(R->L[K->LevelSrc], R->L[K->LevelDest]);
+         RotationL[K->Rotation]=std::max(RotationL[K->Rotation], L);
+         NeedAxial[K->Axial]=1;
+       };
+
+     R->Rotations.resize(NumRotations, 0);
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+     for(int nrot=0; nrot<NumRotations; nrot++)
+      if (RotationL[nrot]>=0)
+       R->Rotations[nrot]=GetRotation(&(D->Rotations[nrot]), RotationL[nrot]);
+
+     std::map<int, std::vector<int> > AxialsByTable;
+     for(int na=0; na<NumAxials; na++)
+      if (NeedAxial[na])
+       { int LS=R->L[D->Axials[na].LevelSrc], LD=R->L[D->Axials[na].LevelDest];
+         AxialsByTable[LS*(MLFMA_MAXL+2)+LD].push_back(na);
+       };
+     R->Axials.resize(NumAxials, 0);
+     int NumNeededAxials=0, NumNeededRotations=0;
+     std::map<int, std::vector<int> >::iterator it;
+     for(it=AxialsByTable.begin(); it!=AxialsByTable.end(); it++)
+      { std::vector<int> &List=it->second;
+        int LS=R->L[D->Axials[List[0]].LevelSrc];
+        int LD=R->L[D->Axials[List[0]].LevelDest];
+        double *Table=CreateScalarTranslationTable(LS, LD);
+        int NumList=List.size();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+        for(int n=0; n<NumList; n++)
+         R->Axials[List[n]]=GetAxial(&(D->Axials[List[n]]), R->kFMM, LS, LD, Table);
+        delete[] Table;
+        NumNeededAxials+=NumList;
+        for(int m=-std::min(LS,LD); m<=std::min(LS,LD); m++)
+         NumTEntries += NumList*(LS-abs(m)+1)*(LD-abs(m)+1);
+      };
+     for(int nrot=0; nrot<NumRotations; nrot++)
+      if (RotationL[nrot]>=0)
+       { NumNeededRotations++;
+         NumTEntries += RotationOffset(RotationL[nrot]+1);
+       };
+
+     // expansion coefficients for all cells that can take part
+     // in translations
+     R->Q.resize(NumCells, 0);
+     R->Loc.resize(NumCells, 0);
+     for(int nc=0; nc<NumCells; nc++)
+      { int L=R->L[D->Cells[nc].Level];
+        if ( !R->CellActive[nc] || L>MLFMA_MAXL ) continue;
+        R->Q[nc]   = new cdouble[ND*(L+1)*(L+1)];
+        if (NeedMatrix)
+         R->Loc[nc] = new cdouble[ND*(L+1)*(L+1)];
+      };
+
+     // radiation patterns of the edges in each leaf
+     R->Patterns.resize(NumEdges, 0);
+     int NumLeaves=D->Leaves.size();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+     for(int nl=0; nl<NumLeaves; nl++)
+      { MLFMACell *C=&(D->Cells[D->Leaves[nl]]);
+        int L=R->L[C->Level];
+        if ( R->Q[D->Leaves[nl]]==0 ) continue;
+        for(int n=C->FirstEdge; n<C->LastEdge; n++)
+         { if (R->Sign[n]==0) continue;
+           R->Patterns[n] = new cdouble[7*(L+1)*(L+1)];
+           GetRadiationPattern(G->Surfaces[D->Edges[n].ns], D->Edges[n].ne,
+                               C->Center, R->kFMM, L, R->Patterns[n]);
+         };
+      };
+
+     char LStr[200]="";
+     for(int Level=0; Level<D->NumLevels; Level++)
+      { int L=R->L[Level];
+        snprintf(LStr+strlen(LStr), 200-strlen(LStr), L>MLFMA_MAXL ? " -" : " %i", L);
+      };
+     Log(" region %i: k=%s, L ={%s }, %i rotations, %i coaxial translations",
+          R->nr,z2s(R->k),LStr,NumNeededRotations,NumNeededAxials);
+   };
+
+  if (!NeedMatrix)
+   { Log("...assembled in %.1f s (field evaluation only)", Secs()-Time0);
+     return;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- preconditioner: LU-factorized diagonal blocks of the near  -*/
+  /*- field matrix. each surface with at most PBlockSize basis   -*/
+  /*- functions gets a single block; larger surfaces are divided -*/
+  /*- among the largest octree cells with at most PBlockSize     -*/
+  /*- basis functions. (blocks cutting through closed dielectric -*/
+  /*- surfaces make very poor preconditioners for PMCHWT)        -*/
+  /*--------------------------------------------------------------*/
+  // cells are stored parents-first, so after marking the
+  // preconditioner cells a single forward sweep hands their
+  // indices down to their descendants
+  std::vector<int> Stack(1,0);
+  while(!Stack.empty())
+   { int nc=Stack.back();
+     Stack.pop_back();
+     MLFMACell *C=&(D->Cells[nc]);
+     if ( C->NumBFs<=PBlockSize || IsLeaf(C) )
+      C->PCell=nc;
+     else
+      for(int nk=0; nk<C->NumKids; nk++)
+       Stack.push_back(C->Kids[nk]);
+   };
+  for(int nc=1; nc<NumCells; nc++)
+   if (D->Cells[nc].PCell==-1)
+    D->Cells[nc].PCell=D->Cells[D->Cells[nc].Parent].PCell;
+
+  D->BFPBlock.resize(N);
+  D->BFPIndex.resize(N);
+  std::vector<int> SurfaceBlock(G->NumSurfaces, -1);
+  std::map<std::pair<int,int>, int> CellSurfaceBlock;
+  for(size_t nl=0; nl<D->Leaves.size(); nl++)
+   { MLFMACell *C=&(D->Cells[D->Leaves[nl]]);
+     for(int n=C->FirstEdge; n<C->LastEdge; n++)
+      { int ns=D->Edges[n].ns;
+        RWGSurface *S=G->Surfaces[ns];
+        int *np;
+        if (S->NumBFs<=PBlockSize)
+         np=&(SurfaceBlock[ns]);
+        else
+         { std::pair<int,int> Key(C->PCell, ns);
+           if (CellSurfaceBlock.find(Key)==CellSurfaceBlock.end())
+            CellSurfaceBlock[Key]=-1;
+           np=&(CellSurfaceBlock[Key]);
+         };
+        if (*np==-1)
+         { *np=D->PBFs.size();
+           D->PBFs.push_back(std::vector<int>());
+         };
+        for(int nbf=0; nbf<(S->IsPEC ? 1 : 2); nbf++)
+         { int BF=D->Edges[n].BF + nbf;
+           D->BFPBlock[BF]=*np;
+           D->BFPIndex[BF]=D->PBFs[*np].size();
+           D->PBFs[*np].push_back(BF);
+         };
+      };
+   };
+
+  int NumPBlocks=D->PBFs.size();
+  for(int np=0; np<NumPBlocks; np++)
+   { int NBF=D->PBFs[np].size();
+     D->PBlocks.push_back(new HMatrix(NBF, NBF, LHM_COMPLEX));
+   };
+  for(int nb=0; nb<NumNearBlocks; nb++)
+   { MLFMANearBlock *NB=&(D->NearBlocks[nb]);
+     int OffsetA=D->Cells[NB->A].BFOffset, OffsetB=D->Cells[NB->B].BFOffset;
+     for(int nr=0; nr<NB->M->NR; nr++)
+      for(int nc=0; nc<NB->M->NC; nc++)
+       { int BFA=OffsetA+nr, BFB=OffsetB+nc;
+         int np=D->BFPBlock[BFA];
+         if (D->BFPBlock[BFB]!=np) continue;
+         cdouble Entry=NB->M->GetEntry(nr,nc);
+         D->PBlocks[np]->SetEntry(D->BFPIndex[BFA], D->BFPIndex[BFB], Entry);
+         D->PBlocks[np]->SetEntry(D->BFPIndex[BFB], D->BFPIndex[BFA], Entry);
+       };
+   };
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int np=0; np<NumPBlocks; np++)
+   D->PBlocks[np]->LUFactorize();
+
+  Log("...assembled in %.1f s (near field %.1f s): near field %.2f %%, translations %.1f MB",
+       Secs()-Time0, Time1-Time0, 100.0*GetNearFieldFraction(),
+       NumTEntries*sizeof(cdouble)/1048576.0);
+}
+
+/***************************************************************/
+/* Y = M*X in tree ordering                                    */
+/***************************************************************/
+static void ApplyNearField(MLFMAData *D, cdouble *X, cdouble *Y)
+{
+  int NumLeaves=D->Leaves.size();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(GetNumThreads())
+#endif
+  for(int nl=0; nl<NumLeaves; nl++)
+   { MLFMACell *C=&(D->Cells[D->Leaves[nl]]);
+     cdouble *YC=Y + C->BFOffset;
+     for(size_t n=0; n<C->NearBlocks.size(); n++)
+      { int nb=C->NearBlocks[n];
+        if (nb>=0)
+         { // this cell is the row cell
+           MLFMANearBlock *NB=&(D->NearBlocks[nb]);
+           HMatrix *M=NB->M;
+           cdouble *XC=X + D->Cells[NB->B].BFOffset;
+           for(int c=0; c<M->NC; c++)
+            { cdouble *Col=M->ZM + c*M->NR;
+              for(int r=0; r<M->NR; r++)
+               YC[r] += Col[r]*XC[c];
+            };
+         }
+        else
+         { // this cell is the column cell: use the transpose
+           MLFMANearBlock *NB=&(D->NearBlocks[~nb]);
+           HMatrix *M=NB->M;
+           cdouble *XC=X + D->Cells[NB->A].BFOffset;
+           for(int c=0; c<M->NC; c++)
+            { cdouble *Col=M->ZM + c*M->NR, Sum=0.0;
+              for(int r=0; r<M->NR; r++)
+               Sum += Col[r]*XC[r];
+              YC[c] += Sum;
+            };
+         };
+      };
+   };
+}
+
+/***************************************************************/
+/* aggregation of the (tree-ordered) surface-current vector X  */
+/* into the outgoing-wave expansions Q of all cells in region  */
+/* R; the regular-wave expansions Loc, if present, are zeroed. */
+/***************************************************************/
+static void Aggregate(RWGGeometry *G, MLFMAData *D, MLFMARegion *R, cdouble *X)
+{
+  int NumCells=D->Cells.size(), NumLeaves=D->Leaves.size();
+  int NumThreads=GetNumThreads();
+  int ND=R->ND;
+  cdouble ik=II*R->k;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int nc=0; nc<NumCells; nc++)
+   { if (R->Q[nc]==0) continue;
+     int L=R->L[D->Cells[nc].Level], P=(L+1)*(L+1);
+     memset(R->Q[nc], 0, ND*P*sizeof(cdouble));
+     if (R->Loc[nc])
+      memset(R->Loc[nc], 0, ND*P*sizeof(cdouble));
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- expansions of the leaf cells from the radiation patterns   -*/
+  /*- of their edges                                             -*/
+  /*--------------------------------------------------------------*/
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int nl=0; nl<NumLeaves; nl++)
+   { int nc=D->Leaves[nl];
+     MLFMACell *C=&(D->Cells[nc]);
+     cdouble *Q=R->Q[nc];
+     if (Q==0) continue;
+     int L=R->L[C->Level], P=(L+1)*(L+1);
+     for(int n=C->FirstEdge; n<C->LastEdge; n++)
+      { cdouble *W=R->Patterns[n];
+        if (W==0) continue;
+        bool IsPEC = G->Surfaces[D->Edges[n].ns]->IsPEC;
+        cdouble XK = ik*((double)R->Sign[n])*X[D->Edges[n].BF];
+        cdouble XN = IsPEC ? 0.0 : ik*((double)R->Sign[n])*X[D->Edges[n].BF+1];
+        // \int f(y) j_l(k|y|) conj(Y_{lm}(y)) = (-1)^m W_{l,-m}
+        for(int Alpha=0, l=0; l<=L; l++)
+         for(int m=-l; m<=l; m++, Alpha++)
+          { int AlphaBar=LM2ALPHA(l,-m);
+            double Sign = (m%2) ? -1.0 : 1.0;
+            for(int c=0; c<4; c++)
+             { cdouble WW=Sign*W[c*P + AlphaBar];
+               Q[c*P + Alpha] += WW*XK;
+               if (ND==8)
+                Q[(4+c)*P + Alpha] += WW*XN;
+             };
+          };
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- upward pass: children to parents, finest level first       -*/
+  /*--------------------------------------------------------------*/
+  for(int Level=D->NumLevels-2; Level>=0; Level--)
+   { int NumLevelCells=D->LevelCells[Level].size();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+     for(int n=0; n<NumLevelCells; n++)
+      { int nc=D->LevelCells[Level][n];
+        MLFMACell *C=&(D->Cells[nc]);
+        if (R->Q[nc]==0) continue;
+        for(int nk=0; nk<C->NumKids; nk++)
+         { int Kid=C->Kids[nk];
+           if (R->Q[Kid])
+            Translate(D, R, D->Cells[Kid].UpKey, R->Q[Kid], R->Q[nc], ND);
+         };
+      };
+   };
+}
+
+static void ApplyFarField(RWGGeometry *G, MLFMAData *D, MLFMARegion *R,
+                          cdouble *X, cdouble *Y)
+{
+  int NumCells=D->Cells.size(), NumLeaves=D->Leaves.size();
+  int NumThreads=GetNumThreads();
+  int ND=R->ND;
+  cdouble k2=R->k*R->k;
+
+  /*--------------------------------------------------------------*/
+  /*- aggregation and upward pass                                -*/
+  /*--------------------------------------------------------------*/
+  Aggregate(G, D, R, X);
+
+  /*--------------------------------------------------------------*/
+  /*- outgoing-to-regular translations between far pairs         -*/
+  /*--------------------------------------------------------------*/
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int nc=0; nc<NumCells; nc++)
+   { MLFMACell *C=&(D->Cells[nc]);
+     for(size_t n=0; n<C->FarLinks.size(); n++)
+      { int nl=C->FarLinks[n];
+        if (!R->LinkActive[nl]) continue;
+        MLFMALink *Link=&(D->Links[nl]);
+        Translate(D, R, Link->Key, R->Q[Link->Src], R->Loc[nc], ND);
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- downward pass: parents to children, coarsest level first   -*/
+  /*--------------------------------------------------------------*/
+  for(int Level=1; Level<D->NumLevels; Level++)
+   { int NumLevelCells=D->LevelCells[Level].size();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+     for(int n=0; n<NumLevelCells; n++)
+      { int nc=D->LevelCells[Level][n];
+        int Parent=D->Cells[nc].Parent;
+        if (R->Loc[nc] && R->Loc[Parent])
+         Translate(D, R, D->Cells[nc].DownKey, R->Loc[Parent], R->Loc[nc], ND);
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- disaggregation: test the regular-wave expansions in each   -*/
+  /*- leaf against the RWG functions of its edges                -*/
+  /*--------------------------------------------------------------*/
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads)
+#endif
+  for(int nl=0; nl<NumLeaves; nl++)
+   { int nc=D->Leaves[nl];
+     MLFMACell *C=&(D->Cells[nc]);
+     cdouble *Loc=R->Loc[nc];
+     if (Loc==0) continue;
+     int L=R->L[C->Level], P=(L+1)*(L+1);
+     for(int n=C->FirstEdge; n<C->LastEdge; n++)
+      { cdouble *W=R->Patterns[n];
+        if (W==0) continue;
+
+        // GA = \int f.A, GD = \int (div f) Phi, CA = \int f.(curl A)
+        cdouble GA[2]={0.0,0.0}, GD[2]={0.0,0.0}, CA[2]={0.0,0.0};
+        for(int t=0; t<ND/4; t++)
+         { cdouble *LocT=Loc + 4*t*P;
+           for(int Beta=0; Beta<P; Beta++)
+            { GA[t] +=  W[0*P+Beta]*LocT[0*P+Beta]
+                      + W[1*P+Beta]*LocT[1*P+Beta]
+                      + W[2*P+Beta]*LocT[2*P+Beta];
+              GD[t] +=  W[3*P+Beta]*LocT[3*P+Beta];
+              CA[t] +=  W[4*P+Beta]*LocT[0*P+Beta]
+                      + W[5*P+Beta]*LocT[1*P+Beta]
+                      + W[6*P+Beta]*LocT[2*P+Beta];
+            };
+         };
+
+        double Sign = (double)R->Sign[n];
+        int BF=D->Edges[n].BF;
+        Y[BF] += Sign*( R->iMuOmega*(GA[0] - GD[0]/k2) + CA[1] );
+        if ( !G->Surfaces[D->Edges[n].ns]->IsPEC )
+         Y[BF+1] += Sign*( CA[0] - R->iEpsOmega*(GA[1] - GD[1]/k2) );
+      };
+   };
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void MLFMAMatrix::Apply(HVector *X, HVector *Y)
+{
+  MLFMAData *D=(MLFMAData *)Data;
+  if (D->Cells.size()==0 || !HaveMatrix)
+   ErrExit("%s:%i: MLFMA matrix must be assembled before use",__FILE__,__LINE__);
+
+  cdouble *XT=new cdouble[2*N], *YT=XT+N;
+  for(int n=0; n<N; n++)
+   { XT[n]=X->GetEntry(D->Perm[n]);
+     YT[n]=0.0;
+   };
+
+  ApplyNearField(D, XT, YT);
+  for(size_t nr=0; nr<D->Regions.size(); nr++)
+   ApplyFarField(G, D, D->Regions[nr], XT, YT);
+
+  for(int n=0; n<N; n++)
+   Y->SetEntry(D->Perm[n], YT[n]);
+  delete[] XT;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void MLFMAMatrix::Precondition(HVector *X)
+{
+  MLFMAData *D=(MLFMAData *)Data;
+  if (D->Cells.size()==0 || !HaveMatrix)
+   ErrExit("%s:%i: MLFMA matrix must be assembled before use",__FILE__,__LINE__);
+  cdouble *XT=new cdouble[N];
+  for(int n=0; n<N; n++)
+   XT[n]=X->GetEntry(D->Perm[n]);
+
+  int NumPBlocks=D->PBFs.size();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(GetNumThreads())
+#endif
+  for(int np=0; np<NumPBlocks; np++)
+   { std::vector<int> &BFs=D->PBFs[np];
+     int NBF=BFs.size();
+     HVector XBlock(NBF, LHM_COMPLEX);
+     for(int n=0; n<NBF; n++)
+      XBlock.SetEntry(n, XT[BFs[n]]);
+     D->PBlocks[np]->LUSolve(&XBlock);
+     for(int n=0; n<NBF; n++)
+      XT[BFs[n]]=XBlock.GetEntry(n);
+   };
+
+  for(int n=0; n<N; n++)
+   X->SetEntry(D->Perm[n], XT[n]);
+  delete[] XT;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+double MLFMAMatrix::GetNearFieldFraction()
+{
+  MLFMAData *D=(MLFMAData *)Data;
+  return D->NumNearEntries / ( ((double)N)*((double)N) );
+}
+
+/***************************************************************/
+/* potentials at a point due to the ND densities of region R:  */
+/* for t=0 (K) and t=1 (N), A[t][i] = vector potential,        */
+/* GradD[t][i] = gradient of the potential of the divergence,  */
+/* CurlA[t][i] = curl of A                                     */
+/***************************************************************/
+typedef struct MLFMAPotentials
+ { cdouble A[2][3], GradD[2][3], CurlA[2][3];
+ } MLFMAPotentials;
+
+// add the contributions of the outgoing-wave expansion Q of
+// order L about X0 to the potentials at X
+static void AddExpansionPotentials(MLFMARegion *R, cdouble *Q, int L,
+                                   double X0[3], double X[3],
+                                   cdouble *Workspace, MLFMAPotentials *Pot)
+{
+  int P=(L+1)*(L+1);
+  cdouble *O=Workspace, *GradO=O+P, *WaveWorkspace=GradO+3*P;
+  double XmX0[3];
+  VecSub(X, X0, XmX0);
+  GetSphericalWaves(L, R->kFMM, XmX0, LS_OUTGOING, O, GradO, WaveWorkspace);
+
+  for(int t=0; t<R->ND/4; t++)
+   { cdouble *QT=Q + 4*t*P;
+     cdouble A[3]={0.0,0.0,0.0}, GradD[3]={0.0,0.0,0.0}, GradA[3][3];
+     memset(GradA, 0, 9*sizeof(cdouble));
+     for(int Alpha=0; Alpha<P; Alpha++)
+      { cdouble dO[3]={GradO[Alpha], GradO[P+Alpha], GradO[2*P+Alpha]};
+        for(int i=0; i<3; i++)
+         { A[i]     += QT[i*P+Alpha]*O[Alpha];
+           GradD[i] += QT[3*P+Alpha]*dO[i];
+           for(int j=0; j<3; j++)
+            GradA[j][i] += QT[i*P+Alpha]*dO[j]; // d_j A_i
+         };
+      };
+     for(int i=0; i<3; i++)
+      { Pot->A[t][i]     += A[i];
+        Pot->GradD[t][i] += GradD[i];
+      };
+     Pot->CurlA[t][0] += GradA[1][2] - GradA[2][1];
+     Pot->CurlA[t][1] += GradA[2][0] - GradA[0][2];
+     Pot->CurlA[t][2] += GradA[0][1] - GradA[1][0];
+   };
+}
+
+/***************************************************************/
+/* add the scattered fields at the points XMatrix due to the   */
+/* surface currents KN to FMatrix.                             */
+/*                                                             */
+/* the fields are obtained from the potentials as in           */
+/* GetRFMatrix:                                                */
+/*  E =  ik*Z0*Zr*GK - ik*Z0*CN,    H = -ik*CK - (ik/Zr)*GN    */
+/* with G = A + (grad D)/k^2 and C = (curl A)/(-ik) for the    */
+/* K and N currents.                                           */
+/***************************************************************/
+HMatrix *MLFMAMatrix::GetFields(HVector *KN, HMatrix *XMatrix, HMatrix *FMatrix,
+                                int *RegionIndices)
+{
+  MLFMAData *D=(MLFMAData *)Data;
+  if (D->Cells.size()==0)
+   ErrExit("%s:%i: MLFMA matrix must be assembled before use",__FILE__,__LINE__);
+
+  int NX=XMatrix->NR;
+  if (FMatrix==0 || FMatrix->NR!=NX || FMatrix->NC!=6)
+   { if (FMatrix)
+      { Warn("wrong-size FMatrix passed to MLFMAMatrix::GetFields; reallocating");
+        delete FMatrix;
+      };
+     FMatrix=new HMatrix(NX, 6, LHM_COMPLEX);
+     FMatrix->Zero();
+   };
+
+  int NumThreads=GetNumThreads();
+  int *MyRegionIndices=0;
+  if (RegionIndices==0)
+   { RegionIndices = MyRegionIndices = new int[NX];
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,64), num_threads(NumThreads)
+#endif
+     for(int nx=0; nx<NX; nx++)
+      { double X[3];
+        XMatrix->GetEntriesD(nx,"0:2",X);
+        RegionIndices[nx]=G->GetRegionIndex(X);
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- aggregate the currents in each region ----------------------*/
+  /*--------------------------------------------------------------*/
+  cdouble *XT=new cdouble[N];
+  for(int n=0; n<N; n++)
+   XT[n]=KN->GetEntry(D->Perm[n]);
+
+  std::vector<int> RegionData(G->NumRegions, -1);
+  for(size_t nr=0; nr<D->Regions.size(); nr++)
+   { Aggregate(G, D, D->Regions[nr], XT);
+     RegionData[D->Regions[nr]->nr]=nr;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- for each point, descend the tree from the root: cells that -*/
+  /*- are far enough away contribute through their expansions,   -*/
+  /*- and edges in leaf cells that are not contribute directly.  -*/
+  /*--------------------------------------------------------------*/
+  int PMax=(MLFMA_MAXL+1)*(MLFMA_MAXL+1);
+  int WorkspaceSize=4*PMax + 3*(MLFMA_MAXL+2) + 2*PMax;
+  int ChunkSize=256, NumChunks=(NX+ChunkSize-1)/ChunkSize;
+  double NumExpansions=0.0, NumDirect=0.0;
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic,1), num_threads(NumThreads), reduction(+:NumExpansions,NumDirect)
+#endif
+  for(int nChunk=0; nChunk<NumChunks; nChunk++)
+   { 
+     cdouble *Workspace=new cdouble[WorkspaceSize];
+     std::vector<int> Stack;
+     int nxMax = std::min(NX, (nChunk+1)*ChunkSize);
+     for(int nx=nChunk*ChunkSize; nx<nxMax; nx++)
+      { 
+        if (RegionIndices[nx]<0 || RegionData[RegionIndices[nx]]==-1)
+         continue;
+        MLFMARegion *R=D->Regions[RegionData[RegionIndices[nx]]];
+        cdouble k=R->k, ik=II*k;
+
+        double X[3];
+        XMatrix->GetEntriesD(nx,"0:2",X);
+
+        MLFMAPotentials Pot;
+        memset(&Pot, 0, sizeof(Pot));
+        cdouble EH[6]={0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+        Stack.clear();
+        Stack.push_back(0);
+        while(!Stack.empty())
+         { int nc=Stack.back();
+           Stack.pop_back();
+           if (!R->CellActive[nc]) continue;
+
+           MLFMACell *C=&(D->Cells[nc]);
+           double Distance=VecDistance(X, C->Center);
+           if ( imag(k)*(Distance - C->Radius) > MLFMA_DAMPING )
+            continue;
+
+           if ( R->Q[nc] && C->Radius < Eta*Distance )
+            { AddExpansionPotentials(R, R->Q[nc], R->L[C->Level], C->Center, X,
+                                     Workspace, &Pot);
+              NumExpansions+=1.0;
+            }
+           else if (IsLeaf(C))
+            { for(int n=C->FirstEdge; n<C->LastEdge; n++)
+               { if (R->Sign[n]==0) continue;
+                 MLFMAEdge *E=&(D->Edges[n]);
+                 bool IsPEC=G->Surfaces[E->ns]->IsPEC;
+                 cdouble XK = ((double)R->Sign[n])*XT[E->BF];
+                 cdouble XN = IsPEC ? 0.0 : ((double)R->Sign[n])*XT[E->BF+1];
+                 cdouble GC[6];
+                 GetReducedFields(G, E->ns, E->ne, X, k, GC);
+                 for(int i=0; i<3; i++)
+                  { EH[i]   += ik*R->ZRel*ZVAC*GC[i]*XK - ik*ZVAC*GC[3+i]*XN;
+                    EH[3+i] += -1.0*ik*GC[3+i]*XK - ik*GC[i]*XN/R->ZRel;
+                  };
+                 NumDirect+=1.0;
+               };
+            }
+           else
+            for(int nk=0; nk<C->NumKids; nk++)
+             Stack.push_back(C->Kids[nk]);
+         };
+
+        cdouble k2=k*k;
+        for(int i=0; i<3; i++)
+         { cdouble GK = Pot.A[0][i] + Pot.GradD[0][i]/k2;
+           cdouble GN = Pot.A[1][i] + Pot.GradD[1][i]/k2;
+           cdouble CK = Pot.CurlA[0][i] / (-1.0*ik);
+           cdouble CN = Pot.CurlA[1][i] / (-1.0*ik);
+           EH[i]   += ik*R->ZRel*ZVAC*GK - ik*ZVAC*CN;
+           EH[3+i] += -1.0*ik*CK - ik*GN/R->ZRel;
+         };
+
+        for(int Mu=0; Mu<6; Mu++)
+         FMatrix->AddEntry(nx, Mu, EH[Mu]);
+      };
+     delete[] Workspace;
+   };
+
+  if (G->LogLevel>=SCUFF_VERBOSELOGGING)
+   Log("MLFMA fields at %i points: %.0f expansion evaluations, %.0f direct edge contributions",
+        NX,NumExpansions,NumDirect);
+
+  delete[] XT;
+  if (MyRegionIndices) delete[] MyRegionIndices;
+  return FMatrix;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+MLFMAMatrix *RWGGeometry::AllocateMLFMAMatrix(double Tol)
+{
+  return new MLFMAMatrix(this, Tol);
+}
+
+MLFMAMatrix *RWGGeometry::AssembleMLFMAMatrix(cdouble Omega, MLFMAMatrix *M)
+{
+  if (M==0)
+   M=AllocateMLFMAMatrix();
+  M->Assemble(Omega);
+  return M;
+}
+
+} // namespace scuff
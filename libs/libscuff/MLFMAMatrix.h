@@ -0,0 +1,138 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * MLFMAMatrix.h -- multilevel fast multipole representation of the
+ *               -- BEM matrix, for use with iterative solvers
+ */
+
+#ifndef MLFMA_MATRIX_H
+#define MLFMA_MATRIX_H
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include <libhmat.h>
+
+namespace scuff {
+
+class RWGGeometry; // forward declaration
+
+#define MLFMA_DEFAULT_TOL        1.0e-3
+#define MLFMA_DEFAULT_LEAFSIZE   32
+#define MLFMA_DEFAULT_ETA        0.5
+#define MLFMA_DEFAULT_PBLOCKSIZE 1024
+#define MLFMA_MAXL               30
+#define MLFMA_MAXLEVELS          16
+
+/***************************************************************/
+/* An MLFMAMatrix computes matrix-vector products with the BEM */
+/* matrix of a compact geometry in O(N log N) time without     */
+/* ever storing the full matrix.                               */
+/*                                                             */
+/* Basis functions are sorted into an octree according to the  */
+/* centroids of their edges; octree cells are subdivided until */
+/* they contain at most LeafSize basis functions. A dual       */
+/* traversal of the tree splits all pairs of leaf cells into   */
+/* near pairs, whose interactions are computed once by         */
+/* GetEdgeEdgeInteractions() and stored as dense blocks, and   */
+/* far pairs, which are handled at the coarsest possible level */
+/* of the tree by multipole expansions. Two cells A, B with    */
+/* centers separated by D and enclosing spheres of radii RA,RB */
+/* interact via multipoles if (RA+RB) < Eta*D.                 */
+/*                                                             */
+/* The far-field interactions through each region are handled  */
+/* by expanding the scalar Helmholtz potentials of the x,y,z   */
+/* components and divergence of the electric and magnetic      */
+/* surface currents in spherical waves about the cell centers: */
+/* expansions are aggregated from leaf cells to their parents, */
+/* translated from outgoing to regular waves between far       */
+/* pairs, and disaggregated from parents to their children     */
+/* before being tested against the RWG functions in each leaf. */
+/* The spherical-wave order at each level of the tree is       */
+/* chosen from the size of the cells and the tolerance Tol.    */
+/* Each translation is done in O(L^3) operations as a rotation */
+/* onto the z axis, a coaxial translation, and the inverse     */
+/* rotation.                                                   */
+/*                                                             */
+/* Precondition() applies the inverse of the block-diagonal    */
+/* part of the near-field matrix, with one block for each      */
+/* surface with at most PBlockSize basis functions; larger     */
+/* surfaces are split among octree cells of at most PBlockSize */
+/* basis functions.                                            */
+/*                                                             */
+/* GetFields() uses the same tree to compute the scattered    */
+/* fields of a given surface-current vector at many points: in */
+/* each region, the currents are aggregated into outgoing-wave */
+/* expansions about the cell centers, which are evaluated      */
+/* directly at each evaluation point X for the coarsest cells  */
+/* with Radius < Eta*|X-Center|; the contributions of edges in */
+/* leaf cells too close to X are computed by cubature as in    */
+/* GetRFMatrix(). For field evaluation alone, Assemble() may   */
+/* be called with NeedMatrix=false, which skips the near-field */
+/* blocks, the far-pair translations, and the preconditioner.  */
+/*                                                             */
+/* Environment variables SCUFF_MLFMA_TOL, SCUFF_MLFMA_LEAFSIZE,*/
+/* SCUFF_MLFMA_ETA, and SCUFF_MLFMA_PBLOCKSIZE override the    */
+/* corresponding parameters.                                   */
+/***************************************************************/
+class MLFMAMatrix
+ {
+public:
+   MLFMAMatrix(RWGGeometry *G, double Tol=MLFMA_DEFAULT_TOL,
+               int LeafSize=MLFMA_DEFAULT_LEAFSIZE);
+   ~MLFMAMatrix();
+
+   // (re)build the tree and precompute all frequency-dependent
+   // quantities; must be called again after geometrical
+   // transformations
+   void Assemble(cdouble Omega, bool NeedMatrix=true);
+
+   // Y = M*X, with M the BEM matrix
+   void Apply(HVector *X, HVector *Y);
+
+   // X <- P^{-1} X, with P the block-diagonal near-field preconditioner
+   void Precondition(HVector *X);
+
+   // number of stored near-field matrix entries relative to the dense matrix
+   double GetNearFieldFraction();
+
+   // add the scattered fields at the points XMatrix (NX x 3) due to
+   // the surface currents KN to FMatrix (NX x 6); RegionIndices, if
+   // non-NULL, holds the region index of each point
+   HMatrix *GetFields(HVector *KN, HMatrix *XMatrix, HMatrix *FMatrix=0,
+                      int *RegionIndices=0);
+
+// private data fields
+// private:
+   RWGGeometry *G;
+   int N;
+   double Tol;
+   int LeafSize;
+   double Eta;
+   int PBlockSize;
+   cdouble Omega;
+   bool HaveMatrix;
+
+   void *Data;
+ };
+
+} // namespace scuff
+#endif // #ifndef MLFMA_MATRIX_H
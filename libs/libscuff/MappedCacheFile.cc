@@ -0,0 +1,250 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * MappedCacheFile.cc -- read-only memory-mapped key/value cache files
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <libhrutil.h>
+
+#include "MappedCacheFile.h"
+
+namespace scuff {
+
+long JenkinsHash(const char *key, size_t len); // in FIBBICache.cc
+
+#define MCF_HEADERSIZE sizeof(MCFHeader)
+
+static size_t PadTo8(size_t n) { return (n+7) & ~((size_t)7); }
+
+static uint64_t GetBucket(const void *Key, size_t KeySize, uint64_t NumBuckets)
+{ return ((uint64_t)JenkinsHash( (const char *)Key, KeySize )) % NumBuckets; }
+
+/***************************************************************/
+/* open and map a cache file, checking that its header matches */
+/* what the caller expects                                     */
+/***************************************************************/
+MappedCacheFile::MappedCacheFile(const char *pFileName, const char *Type,
+                                 size_t pKeySize, size_t pDataSize)
+{
+  FileName=strdupEC(pFileName);
+  KeySize=pKeySize;
+  DataSize=pDataSize;
+  RecordSize=PadTo8(KeySize) + PadTo8(DataSize);
+  NumRecords=NumBuckets=0;
+  BucketIndex=0;
+  Records=0;
+  Map=0;
+  MapSize=0;
+  ErrMsg=0;
+
+  int fd=open(FileName, O_RDONLY);
+  if (fd<0)
+   { ErrMsg="could not open file";
+     return;
+   };
+
+  struct stat fileStats;
+  if ( fstat(fd, &fileStats) || ((size_t)fileStats.st_size) < MCF_HEADERSIZE )
+   { ErrMsg="invalid cache file";
+     close(fd);
+     return;
+   };
+  MapSize=fileStats.st_size;
+
+  Map=mmap(0, MapSize, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (Map==MAP_FAILED)
+   { Map=0;
+     ErrMsg="could not map file";
+     return;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- sanity checks ----------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  const MCFHeader *Header=(const MCFHeader *)Map;
+  if ( strncmp(Header->Signature, MCF_SIGNATURE, sizeof(Header->Signature)) )
+   ErrMsg="invalid cache file";
+  else if ( Header->ByteOrder!=MCF_BYTEORDER )
+   ErrMsg="cache file was written on a machine with different byte order";
+  else if ( Header->Version!=MCF_VERSION )
+   ErrMsg="unsupported cache file version";
+  else if ( strncmp(Header->Type, Type, sizeof(Header->Type)) )
+   ErrMsg="cache file has wrong type";
+  else if ( Header->KeySize!=KeySize || Header->DataSize!=DataSize )
+   ErrMsg="cache file has wrong record size";
+  else if ( Header->NumBuckets==0 )
+   ErrMsg="invalid cache file";
+  else if ( MapSize != MCF_HEADERSIZE
+                       + (Header->NumBuckets+1)*sizeof(uint64_t)
+                       + Header->NumRecords*RecordSize )
+   ErrMsg="cache file has incorrect size";
+  if (ErrMsg)
+   { munmap(Map, MapSize);
+     Map=0;
+     return;
+   };
+
+  NumRecords  = Header->NumRecords;
+  NumBuckets  = Header->NumBuckets;
+  BucketIndex = (const uint64_t *)( ((const char *)Map) + MCF_HEADERSIZE );
+  Records     = (const char *)(BucketIndex + NumBuckets + 1);
+
+  // we will be hopping around the file pseudorandomly
+  madvise(Map, MapSize, MADV_RANDOM);
+}
+
+MappedCacheFile::~MappedCacheFile()
+{
+  if (Map) munmap(Map, MapSize);
+  free(FileName);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+const void *MappedCacheFile::GetKey(uint64_t n)
+{ return Records + n*RecordSize; }
+
+const void *MappedCacheFile::GetData(uint64_t n)
+{ return Records + n*RecordSize + PadTo8(KeySize); }
+
+const void *MappedCacheFile::Lookup(const void *Key)
+{
+  if (NumRecords==0) return 0;
+
+  uint64_t b=GetBucket(Key, KeySize, NumBuckets);
+  for(uint64_t n=BucketIndex[b]; n<BucketIndex[b+1]; n++)
+   if ( !memcmp(Key, GetKey(n), KeySize) )
+    return GetData(n);
+
+  return 0;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+bool IsMappedCacheFile(const char *FileName)
+{
+  FILE *f=fopen(FileName,"r");
+  if (!f) return false;
+  char Signature[16];
+  bool Result = ( fread(Signature, sizeof(Signature), 1, f)==1
+                  && !strncmp(Signature, MCF_SIGNATURE, sizeof(Signature))
+                );
+  fclose(f);
+  return Result;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int WriteMappedCacheFile(const char *FileName, const char *Type,
+                         size_t KeySize, size_t DataSize,
+                         uint64_t NumRecords,
+                         const void **Keys, const void **Data)
+{
+  /*--------------------------------------------------------------*/
+  /*- sort records into buckets (counting sort) ------------------*/
+  /*--------------------------------------------------------------*/
+  uint64_t NumBuckets=1;
+  while( NumBuckets < NumRecords )
+   NumBuckets*=2;
+
+  uint64_t *BucketIndex = (uint64_t *)mallocEC((NumBuckets+1)*sizeof(uint64_t));
+  uint64_t *Buckets     = (uint64_t *)mallocEC((NumRecords+1)*sizeof(uint64_t));
+  uint64_t *Order       = (uint64_t *)mallocEC((NumRecords+1)*sizeof(uint64_t));
+  memset(BucketIndex, 0, (NumBuckets+1)*sizeof(uint64_t));
+  for(uint64_t n=0; n<NumRecords; n++)
+   { Buckets[n]=GetBucket(Keys[n], KeySize, NumBuckets);
+     BucketIndex[Buckets[n]+1]++;
+   };
+  for(uint64_t b=0; b<NumBuckets; b++)
+   BucketIndex[b+1]+=BucketIndex[b];
+  uint64_t *Fill = (uint64_t *)mallocEC(NumBuckets*sizeof(uint64_t));
+  memcpy(Fill, BucketIndex, NumBuckets*sizeof(uint64_t));
+  for(uint64_t n=0; n<NumRecords; n++)
+   Order[ Fill[Buckets[n]]++ ] = n;
+  free(Fill);
+  free(Buckets);
+
+  /*--------------------------------------------------------------*/
+  /*- write to a temporary file in the same directory, then      -*/
+  /*- rename it into place                                       -*/
+  /*--------------------------------------------------------------*/
+  char *TmpFileName=vstrdup("%s.tmp%i",FileName,(int)getpid());
+  FILE *f=fopen(TmpFileName,"w");
+  if (!f)
+   { Log("warning: could not open file %s (aborting cache dump)",TmpFileName);
+     free(TmpFileName); free(BucketIndex); free(Order);
+     return 1;
+   };
+
+  MCFHeader Header;
+  memset(&Header, 0, sizeof(Header));
+  strncpy(Header.Signature, MCF_SIGNATURE, sizeof(Header.Signature)-1);
+  strncpy(Header.Type, Type, sizeof(Header.Type)-1);
+  Header.Version    = MCF_VERSION;
+  Header.ByteOrder  = MCF_BYTEORDER;
+  Header.KeySize    = KeySize;
+  Header.DataSize   = DataSize;
+  Header.NumRecords = NumRecords;
+  Header.NumBuckets = NumBuckets;
+
+  size_t PaddedKeySize=PadTo8(KeySize), PaddedDataSize=PadTo8(DataSize);
+  char *Record=(char *)mallocEC(PaddedKeySize + PaddedDataSize);
+  memset(Record, 0, PaddedKeySize + PaddedDataSize);
+
+  bool Failed = ( fwrite(&Header, sizeof(Header), 1, f)!=1 )
+              || ( fwrite(BucketIndex, sizeof(uint64_t), NumBuckets+1, f)!=NumBuckets+1 );
+  for(uint64_t n=0; !Failed && n<NumRecords; n++)
+   { memcpy(Record,                 Keys[Order[n]], KeySize);
+     memcpy(Record + PaddedKeySize, Data[Order[n]], DataSize);
+     Failed = ( fwrite(Record, PaddedKeySize + PaddedDataSize, 1, f)!=1 );
+   };
+  if ( fclose(f) )
+   Failed=true;
+
+  free(Record);
+  free(BucketIndex);
+  free(Order);
+
+  if ( Failed || rename(TmpFileName, FileName) )
+   { Log("warning: could not write cache file %s",FileName);
+     unlink(TmpFileName);
+     free(TmpFileName);
+     return 1;
+   };
+
+  free(TmpFileName);
+  return 0;
+}
+
+} // namespace scuff
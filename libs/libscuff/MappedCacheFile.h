@@ -0,0 +1,108 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * MappedCacheFile.h -- read-only memory-mapped key/value cache files,
+ *                   -- used for FIPPI and FIBBI cache storage
+ */
+#ifndef MAPPEDCACHEFILE_H
+#define MAPPEDCACHEFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace scuff {
+
+/***************************************************************/
+/* On-disk layout (all integers in native byte order, which is */
+/* recorded in the header and checked on opening):             */
+/*                                                             */
+/*  MCFHeader        (64 bytes)                                */
+/*  bucket index     (NumBuckets+1 uint64_t values; records in */
+/*                    bucket b are numbered Index[b]...        */
+/*                    Index[b+1]-1)                            */
+/*  records          (NumRecords records, each of RecordSize   */
+/*                    bytes: the key, padded to a multiple of  */
+/*                    8 bytes, followed by the data)           */
+/*                                                             */
+/* records are sorted by bucket, and the bucket of a key is    */
+/* JenkinsHash(key) mod NumBuckets, so lookups touch only the  */
+/* pages of one bucket. since the file is mapped read-only and */
+/* shared, any number of processes on a node can use the same  */
+/* physical pages; and since files are only ever replaced (by  */
+/* atomic rename), never modified in place, existing mappings  */
+/* remain valid while a new version of the file is written.    */
+/***************************************************************/
+#define MCF_SIGNATURE  "SCUFF_MCF"
+#define MCF_VERSION    1
+#define MCF_BYTEORDER  0x01020304
+
+typedef struct MCFHeader
+ { char Signature[16];      // MCF_SIGNATURE
+   char Type[16];           // e.g. "FIPPI" or "FIBBI"
+   uint32_t Version;        // MCF_VERSION
+   uint32_t ByteOrder;      // MCF_BYTEORDER as written by the creator
+   uint32_t KeySize;        // in bytes, before padding
+   uint32_t DataSize;       // in bytes
+   uint64_t NumRecords;
+   uint64_t NumBuckets;
+ } MCFHeader;
+
+class MappedCacheFile
+ {
+public:
+   // map an existing file; on failure, ErrMsg is non-NULL
+   MappedCacheFile(const char *FileName, const char *Type,
+                   size_t KeySize, size_t DataSize);
+   ~MappedCacheFile();
+
+   // return a pointer to the data stored for Key, or NULL
+   const void *Lookup(const void *Key);
+
+   // pointers to the key and data of the nth record
+   const void *GetKey(uint64_t n);
+   const void *GetData(uint64_t n);
+
+   char *FileName;
+   uint64_t NumRecords;
+   const char *ErrMsg;
+
+private:
+   size_t KeySize, DataSize, RecordSize;
+   uint64_t NumBuckets;
+   const uint64_t *BucketIndex;
+   const char *Records;
+   void *Map;
+   size_t MapSize;
+ };
+
+// check whether FileName starts with the MCF signature
+bool IsMappedCacheFile(const char *FileName);
+
+// write NumRecords (key,data) pairs to a new cache file, which
+// is first written under a temporary name and then atomically
+// renamed to FileName. returns 0 on success.
+int WriteMappedCacheFile(const char *FileName, const char *Type,
+                         size_t KeySize, size_t DataSize,
+                         uint64_t NumRecords,
+                         const void **Keys, const void **Data);
+
+} // namespace scuff
+
+#endif // MAPPEDCACHEFILE_H
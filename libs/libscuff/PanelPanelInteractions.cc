@@ -349,6 +349,125 @@ void GetPPIs_Cubature(GetPPIArgStruct *Args,
 
 }
 
+/***************************************************************/
+/* extract the vertices of panels npa, npb (the latter         */
+/* displaced by Args->Displacement if that is nonzero), detect */
+/* common vertices, and measure the relative distance between  */
+/* the panels. returns the number of common vertices.          */
+/***************************************************************/
+static int GetPanelPairGeometry(GetPPIArgStruct *Args, double **Va, double **Vb,
+                                double VbDisplaced[3][3], double *rRel)
+{
+  RWGSurface *Sa       = Args->Sa;
+  RWGSurface *Sb       = Args->Sb;
+  int npa              = Args->npa;
+  int npb              = Args->npb;
+  double *Displacement = Args->Displacement;
+  RWGPanel *Pa         = Sa->Panels[npa];
+  RWGPanel *Pb         = Sb->Panels[npb];
+
+  if (Displacement==0)
+   return AssessPanelPair(Sa,npa,Sb,npb,rRel,Va,Vb);
+
+  Va[0] = Sa->Vertices + 3*Pa->VI[0];
+  Va[1] = Sa->Vertices + 3*Pa->VI[1];
+  Va[2] = Sa->Vertices + 3*Pa->VI[2];
+
+  VecScaleAdd(Sb->Vertices + 3*Pb->VI[0], 1.0, Displacement, VbDisplaced[0]);
+  VecScaleAdd(Sb->Vertices + 3*Pb->VI[1], 1.0, Displacement, VbDisplaced[1]);
+  VecScaleAdd(Sb->Vertices + 3*Pb->VI[2], 1.0, Displacement, VbDisplaced[2]);
+  Vb[0] = VbDisplaced[0];
+  Vb[1] = VbDisplaced[1];
+  Vb[2] = VbDisplaced[2];
+
+  double DC[3]; // 'delta centroid' 
+  DC[0] = Pa->Centroid[0] - Pb->Centroid[0] - Displacement[0];
+  DC[1] = Pa->Centroid[1] - Pb->Centroid[1] - Displacement[1];
+  DC[2] = Pa->Centroid[2] - Pb->Centroid[2] - Displacement[2];
+
+  double rMax = fmax(Pa->Radius, Pb->Radius);
+  *rRel = VecNorm(DC) / rMax; 
+
+  return AssessPanelPair(Va, Vb, rMax);
+}
+
+/***************************************************************/
+/* returns true if the panels are far enough apart that        */
+/* GetPanelPanelInteractions() evaluates their integrals by    */
+/* non-desingularized cubature at all wavenumbers. (used to    */
+/* keep panel pairs whose relative distance lies within        */
+/* roundoff of DESINGULARIZATION_RADIUS from borrowing the     */
+/* integrals of a translate that fell on the other side.)      */
+/***************************************************************/
+bool IsDistantPanelPair(GetPPIArgStruct *Args)
+{
+  double *Va[3], *Vb[3];
+  double VbDisplaced[3][3];
+  double rRel;
+  GetPanelPairGeometry(Args, Va, Vb, VbDisplaced, &rRel);
+  return rRel > DESINGULARIZATION_RADIUS;
+}
+
+/***************************************************************/
+/* if the panel-panel integrals for the current panel pair at  */
+/* wavenumber k are to be computed by straightforward (non-    */
+/* desingularized) cubature, return PPIALG_LOCUBATURE or       */
+/* PPIALG_HOCUBATURE to indicate the order of the cubature     */
+/* rule; otherwise return -1. this choice does not depend on   */
+/* the source vertices.                                        */
+/***************************************************************/
+static int GetCubatureAlgorithm(GetPPIArgStruct *Args, cdouble k,
+                                GBarAccelerator *GBA, double rRel, int ncv)
+{
+  /***************************************************************/
+  /* if the panels are far apart, or if we have an interpolator, */
+  /* then just use simple low-order non-desingularized cubature  */
+  /***************************************************************/
+  if ( GBA || (rRel > DESINGULARIZATION_RADIUS) )
+   return PPIALG_LOCUBATURE;
+
+  /***************************************************************/
+  /* if we are in the short-wavelength regime and there are no   */
+  /* common vertices then we use high-order non-adaptive cubature*/
+  /***************************************************************/
+  RWGPanel *Pa = Args->Sa->Panels[Args->npa];
+  RWGPanel *Pb = Args->Sb->Panels[Args->npb];
+  double kR=abs(k*fmax(Pa->Radius, Pb->Radius));
+  if ( kR>SWTHRESHOLD && ncv==0 )
+   return PPIALG_HOCUBATURE;
+
+  return -1;
+}
+
+/***************************************************************/
+/* step 3 of the desingularization method (see below): add the */
+/* contributions of the singular terms, obtained from the      */
+/* k-independent data in QDFD, to the panel-panel integrals H  */
+/***************************************************************/
+static void AddDesingularizedTerms(cdouble k, QDFIPPIData *QDFD, cdouble *H)
+{
+  // note: PF[n] = (ik)^n / (4\pi)
+  cdouble ik=II*k; 
+  cdouble OOIK2=1.0/(ik*ik);
+  cdouble PF[5];
+  PF[0]=1.0/(4.0*M_PI);
+  PF[1]=ik*PF[0];
+  PF[2]=ik*PF[1];
+  PF[3]=ik*PF[2];
+  PF[4]=ik*PF[3];
+
+  // add contributions to panel-panel integrals
+  H[0] +=  PF[0]*AA0*( QDFD->hDotRM1 + OOIK2*QDFD->hNablaRM1)
+          +PF[1]*AA1*( QDFD->hDotR0  + OOIK2*QDFD->hNablaR0 )
+          +PF[2]*AA2*( QDFD->hDotR1  + OOIK2*QDFD->hNablaR1 )
+          +PF[3]*AA3*( QDFD->hDotR2  + OOIK2*QDFD->hNablaR2 );
+  
+  H[1] +=  PF[0]*BB0*QDFD->hTimesRM3
+          +PF[2]*BB2*QDFD->hTimesRM1
+          +PF[3]*BB3*QDFD->hTimesR0 
+          +PF[4]*BB4*QDFD->hTimesR1;
+}
+
 /***************************************************************/
 /* calculate integrals over a single pair of triangles using   */
 /* one of several different methods based on how near the two  */
@@ -368,7 +487,6 @@ void GetPanelPanelInteractions(GetPPIArgStruct *Args)
   cdouble k                 = Args->k;
   int NumGradientComponents = Args->NumGradientComponents;
   int NumTorqueAxes         = Args->NumTorqueAxes;
-  double *Displacement      = Args->Displacement;
   cdouble *H                = Args->H;
   cdouble *GradH            = Args->GradH;
   cdouble *dHdT             = Args->dHdT;
@@ -384,42 +502,17 @@ void GetPanelPanelInteractions(GetPPIArgStruct *Args)
   double *Va[3], *Vb[3];
   double VbDisplaced[3][3];
   double rRel; 
-  int ncv;
-
-  if (Displacement==0)
-   ncv=AssessPanelPair(Sa,npa,Sb,npb,&rRel,Va,Vb);
-  else 
-   { 
-     Va[0] = Sa->Vertices + 3*Pa->VI[0];
-     Va[1] = Sa->Vertices + 3*Pa->VI[1];
-     Va[2] = Sa->Vertices + 3*Pa->VI[2];
-
-     VecScaleAdd(Sb->Vertices + 3*Pb->VI[0], 1.0, Displacement, VbDisplaced[0]);
-     VecScaleAdd(Sb->Vertices + 3*Pb->VI[1], 1.0, Displacement, VbDisplaced[1]);
-     VecScaleAdd(Sb->Vertices + 3*Pb->VI[2], 1.0, Displacement, VbDisplaced[2]);
-     Vb[0] = VbDisplaced[0];
-     Vb[1] = VbDisplaced[1];
-     Vb[2] = VbDisplaced[2];
-     Qb    = VbDisplaced[iQb];
-
-     double DC[3]; // 'delta centroid' 
-     DC[0] = Pa->Centroid[0] - Pb->Centroid[0] - Displacement[0];
-     DC[1] = Pa->Centroid[1] - Pb->Centroid[1] - Displacement[1];
-     DC[2] = Pa->Centroid[2] - Pb->Centroid[2] - Displacement[2];
-
-     double rMax = fmax(Pa->Radius, Pb->Radius);
-     rRel = VecNorm(DC) / rMax; 
-
-     ncv=AssessPanelPair(Va, Vb, rMax);
-   };
+  int ncv=GetPanelPairGeometry(Args, Va, Vb, VbDisplaced, &rRel);
+  if (Args->Displacement)
+   Qb = VbDisplaced[iQb];
 
   /***************************************************************/
-  /* if the panels are far apart, or if we have an interpolator, */
-  /* then just use simple low-order non-desingularized cubature  */
+  /* use low- or high-order cubature if the panels are far apart */
   /***************************************************************/
-  if ( Args->GBA || (rRel > DESINGULARIZATION_RADIUS) )
-   { Args->WhichAlgorithm=PPIALG_LOCUBATURE;
-     GetPPIs_Cubature(Args, 0, 0, Va, Qa, Vb, Qb);
+  int CubatureAlgorithm=GetCubatureAlgorithm(Args, k, Args->GBA, rRel, ncv);
+  if (CubatureAlgorithm!=-1)
+   { Args->WhichAlgorithm=CubatureAlgorithm;
+     GetPPIs_Cubature(Args, 0, CubatureAlgorithm==PPIALG_HOCUBATURE, Va, Qa, Vb, Qb);
      return;
    };
 
@@ -430,16 +523,6 @@ void GetPanelPanelInteractions(GetPPIArgStruct *Args)
   int InSWRegime = kR > SWTHRESHOLD;
   int InVerySWRegime = kR > VERYSWTHRESHOLD;
 
-  /***************************************************************/
-  /* if we are in the short-wavelength regime and there are no   */
-  /* common vertices then we use high-order non-adaptive cubature*/
-  /***************************************************************/
-  if ( InSWRegime && ncv==0 )
-   { Args->WhichAlgorithm=PPIALG_HOCUBATURE;
-     GetPPIs_Cubature(Args, 0, 1, Va, Qa, Vb, Qb);
-     return; 
-   };
-
   /***************************************************************/
   /* if we are in the short-wavelength regime and there are 1 or */
   /* 2 common vertices, or if we are in any regime and there are */
@@ -531,26 +614,7 @@ void GetPanelPanelInteractions(GetPPIArgStruct *Args)
    GetQDFIPPIData(Va, Qa, Vb, Qb, ncv, &GlobalFIPPICache, QDFD);
 
   // step 3
-  // note: PF[n] = (ik)^n / (4\pi)
-  cdouble ik=II*k; 
-  cdouble OOIK2=1.0/(ik*ik);
-  cdouble PF[5];
-  PF[0]=1.0/(4.0*M_PI);
-  PF[1]=ik*PF[0];
-  PF[2]=ik*PF[1];
-  PF[3]=ik*PF[2];
-  PF[4]=ik*PF[3];
-
-  // add contributions to panel-panel integrals
-  H[0] +=  PF[0]*AA0*( QDFD->hDotRM1 + OOIK2*QDFD->hNablaRM1)
-          +PF[1]*AA1*( QDFD->hDotR0  + OOIK2*QDFD->hNablaR0 )
-          +PF[2]*AA2*( QDFD->hDotR1  + OOIK2*QDFD->hNablaR1 )
-          +PF[3]*AA3*( QDFD->hDotR2  + OOIK2*QDFD->hNablaR2 );
-  
-  H[1] +=  PF[0]*BB0*QDFD->hTimesRM3
-          +PF[2]*BB2*QDFD->hTimesRM1
-          +PF[3]*BB3*QDFD->hTimesR0 
-          +PF[4]*BB4*QDFD->hTimesR1;
+  AddDesingularizedTerms(k, QDFD, H);
 
   // restore derivative integrals as necessary 
   if (NumGradientComponents>0)
@@ -579,6 +643,316 @@ void GetPanelPanelInteractions(GetPPIArgStruct *Args,
    memcpy(dHdT, Args->dHdT, 2*Args->NumTorqueAxes*sizeof(cdouble));
 }
 
+/***************************************************************/
+/* compute the moments of the kernel over panels Va, Vb needed */
+/* for the contractions in GetPanelPanelInteractions() below,  */
+/* for the NumKs wavenumbers k[nk] with kernel accelerators    */
+/* GBA[nk], using the cubature rule TCR. the cubature points,  */
+/* distances and polynomial factors are shared by all k; only  */
+/* the kernel itself is evaluated separately for each k. on    */
+/* return, M[18*nk + ...] are the moments for k[nk].           */
+/***************************************************************/
+static void GetPPIMoments(double **Va, double *Ca, double **Vb, double *Cb,
+                          double *TCR, int NumPts, bool ForceFullEwald,
+                          int NumKs, cdouble *k, GBarAccelerator **GBA,
+                          cdouble *M)
+{
+  double A[3], B[3], AP[3], BP[3];
+  VecSub(Va[1], Va[0], A);
+  VecSub(Va[2], Va[0], B);
+  VecSub(Vb[1], Vb[0], AP);
+  VecSub(Vb[2], Vb[0], BP);
+
+  cdouble ik[PPI_MAXKS];
+  for(int nk=0; nk<NumKs; nk++)
+   ik[nk]=II*k[nk];
+
+  memset(M, 0, 18*NumKs*sizeof(cdouble));
+  for(int np=0, ncp=0; np<NumPts; np++)
+   { 
+     double u=TCR[ncp++];
+     double v=TCR[ncp++];
+     double w=TCR[ncp++];
+
+     double X[3], x[3];
+     for(int Mu=0; Mu<3; Mu++)
+      { X[Mu] = Va[0][Mu] + u*A[Mu] + v*B[Mu];
+        x[Mu] = X[Mu] - Ca[Mu];
+      };
+
+     // inner integrals: \int G, \int xp G, \int Grad G, \int xp x Grad G
+     cdouble IG[PPI_MAXKS], IxpG[PPI_MAXKS][3], IdG[PPI_MAXKS][3], IxpxdG[PPI_MAXKS][3];
+     for(int nk=0; nk<NumKs; nk++)
+      { IG[nk]=0.0;
+        for(int Mu=0; Mu<3; Mu++)
+         IxpG[nk][Mu]=IdG[nk][Mu]=IxpxdG[nk][Mu]=0.0;
+      };
+     for(int npp=0, ncpp=0; npp<NumPts; npp++)
+      { 
+        double up=TCR[ncpp++];
+        double vp=TCR[ncpp++];
+        double wp=TCR[ncpp++];
+
+        double XP[3], xp[3], R[3];
+        for(int Mu=0; Mu<3; Mu++)
+         { XP[Mu] = Vb[0][Mu] + up*AP[Mu] + vp*BP[Mu];
+           xp[Mu] = XP[Mu] - Cb[Mu];
+           R[Mu]  = X[Mu] - XP[Mu];
+         };
+        double r=VecNorm(R);
+
+        for(int nk=0; nk<NumKs; nk++)
+         { cdouble G, dG[3];
+           if (GBA[nk])
+            G=GetGBar(R, GBA[nk], dG, 0, ForceFullEwald);
+           else
+            { G = exp(ik[nk]*r) / (4.0*M_PI*r);
+              if ( !IsFinite(real(G)) ) G=0.0;
+              cdouble Psi = G * (ik[nk] - 1.0/r) / r;
+              dG[0]=R[0]*Psi;
+              dG[1]=R[1]*Psi;
+              dG[2]=R[2]*Psi;
+            };
+           G*=wp;
+           dG[0]*=wp;
+           dG[1]*=wp;
+           dG[2]*=wp;
+
+           IG[nk] += G;
+           for(int Mu=0; Mu<3; Mu++)
+            { IxpG[nk][Mu] += xp[Mu]*G;
+              IdG[nk][Mu]  += dG[Mu];
+            };
+           IxpxdG[nk][0] += xp[1]*dG[2] - xp[2]*dG[1];
+           IxpxdG[nk][1] += xp[2]*dG[0] - xp[0]*dG[2];
+           IxpxdG[nk][2] += xp[0]*dG[1] - xp[1]*dG[0];
+         };
+
+      }; // for(npp=ncpp=0; npp<NumPts; npp++)
+
+     /*--------------------------------------------------------------*/
+     /*- accumulate contributions to outer integrals                 */
+     /*--------------------------------------------------------------*/
+     for(int nk=0; nk<NumKs; nk++)
+      { cdouble *MK=M + 18*nk;
+        MK[0] += w*IG[nk];
+        for(int Mu=0; Mu<3; Mu++)
+         { MK[1+Mu]  += w*x[Mu]*IG[nk];
+           MK[4+Mu]  += w*IxpG[nk][Mu];
+           MK[7]     += w*x[Mu]*IxpG[nk][Mu];
+           MK[8]     += w*x[Mu]*IxpxdG[nk][Mu];
+           MK[12+Mu] += w*IxpxdG[nk][Mu];
+           MK[15+Mu] += w*IdG[nk][Mu];
+         };
+        MK[9]  += w*(IdG[nk][1]*x[2] - IdG[nk][2]*x[1]);
+        MK[10] += w*(IdG[nk][2]*x[0] - IdG[nk][0]*x[2]);
+        MK[11] += w*(IdG[nk][0]*x[1] - IdG[nk][1]*x[0]);
+      };
+
+   }; // for(np=ncp=0; np<NumPts; np++)
+}
+
+/***************************************************************/
+/* compute the panel-panel integrals for panels npa, npb for   */
+/* several choices of the source vertices (iQa, iQb) and       */
+/* (optionally) several wavenumbers at once.                   */
+/*                                                             */
+/* bit 3*iQa+iQb of VertexMask is set if the integrals for     */
+/* that pair of source vertices are needed. if Args->NumKs is  */
+/* nonzero, the integrals are computed for wavenumbers         */
+/* Args->Ks[nk] with kernel accelerators Args->GBAs[nk]        */
+/* (nk=0..NumKs-1), and otherwise for Args->k and Args->GBA    */
+/* alone (NumKs=1). on return, H[18*nk + 2*(3*iQa+iQb) + 0,1]  */
+/* are the quantities H[0,1] that GetPanelPanelInteractions()  */
+/* would have computed for wavenumber #nk and that pair of     */
+/* source vertices (entries for pairs that were not requested  */
+/* are left untouched), and Args->WhichAlgorithms[nk] is the   */
+/* algorithm used for wavenumber #nk.                          */
+/*                                                             */
+/* for panel pairs handled by straightforward cubature this is */
+/* much cheaper than separate calls for each vertex pair: the  */
+/* integrands are linear in each of Qa, Qb, so we evaluate the */
+/* kernel just once at each pair of cubature points and        */
+/* accumulate a handful of moments from which the integrals    */
+/* for all vertex pairs follow by simple contractions. panel   */
+/* pairs that need singularity handling are done one vertex    */
+/* pair at a time, but with the k-independent FIPPI data for   */
+/* the desingularization method looked up just once for all k. */
+/*                                                             */
+/* derivatives (NumGradientComponents, NumTorqueAxes) are not  */
+/* supported by this routine.                                  */
+/***************************************************************/
+void GetPanelPanelInteractions(GetPPIArgStruct *Args, int VertexMask, cdouble *H)
+{
+  RWGSurface *Sa = Args->Sa;
+  RWGSurface *Sb = Args->Sb;
+  RWGPanel *Pa   = Sa->Panels[Args->npa];
+  RWGPanel *Pb   = Sb->Panels[Args->npb];
+
+  int NumKs=Args->NumKs;
+  cdouble *k=Args->Ks;
+  GBarAccelerator **GBA=Args->GBAs;
+  if (NumKs==0)
+   { NumKs=1;
+     k=&(Args->k);
+     GBA=&(Args->GBA);
+   }
+  else if (NumKs>PPI_MAXKS)
+   ErrExit("%s:%i: too many wavenumbers (%i)",__FILE__,__LINE__,NumKs);
+
+  double *Va[3], *Vb[3];
+  double VbDisplaced[3][3];
+  double rRel;
+  int ncv=GetPanelPairGeometry(Args, Va, Vb, VbDisplaced, &rRel);
+
+  double *Qa[3], *Qb[3];
+  for(int i=0; i<3; i++)
+   { Qa[i] = Sa->Vertices + 3*Pa->VI[i];
+     Qb[i] = Args->Displacement ? VbDisplaced[i] : Sb->Vertices + 3*Pb->VI[i];
+   };
+
+  /***************************************************************/
+  /* sort the wavenumbers according to the algorithm we use      */
+  /***************************************************************/
+  int NumLO=0, NumHO=0, NumNear=0;
+  int LOIndex[PPI_MAXKS], HOIndex[PPI_MAXKS], NearIndex[PPI_MAXKS];
+  cdouble kLO[PPI_MAXKS], kHO[PPI_MAXKS];
+  GBarAccelerator *GBALO[PPI_MAXKS], *GBAHO[PPI_MAXKS];
+  for(int nk=0; nk<NumKs; nk++)
+   { int Algorithm=GetCubatureAlgorithm(Args, k[nk], GBA[nk], rRel, ncv);
+     Args->WhichAlgorithms[nk]=Algorithm;
+     if (Algorithm==PPIALG_LOCUBATURE)
+      { LOIndex[NumLO]=nk; kLO[NumLO]=k[nk]; GBALO[NumLO]=GBA[nk]; NumLO++; }
+     else if (Algorithm==PPIALG_HOCUBATURE)
+      { HOIndex[NumHO]=nk; kHO[NumHO]=k[nk]; GBAHO[NumHO]=GBA[nk]; NumHO++; }
+     else
+      NearIndex[NumNear++]=nk;
+   };
+
+  /***************************************************************/
+  /* panel pairs that need singularity handling: one vertex pair */
+  /* at a time                                                   */
+  /***************************************************************/
+  if (NumNear>0)
+   { 
+     GetPPIArgStruct MyNearArgs, *NearArgs=&MyNearArgs;
+     memcpy(NearArgs, Args, sizeof(GetPPIArgStruct));
+     NearArgs->NumGradientComponents=0;
+     NearArgs->NumTorqueAxes=0;
+     NearArgs->GBA=0;
+     NearArgs->NumKs=0;
+
+     for(int iQa=0; iQa<3; iQa++)
+      for(int iQb=0; iQb<3; iQb++)
+       { 
+         if ( !(VertexMask & (1<<(3*iQa+iQb))) ) continue;
+         NearArgs->iQa=iQa;
+         NearArgs->iQb=iQb;
+
+         QDFIPPIData MyQDFD, *QDFD=0;
+         for(int n=0; n<NumNear; n++)
+          { int nk=NearIndex[n];
+            cdouble *HH = H + 18*nk + 2*(3*iQa+iQb);
+            NearArgs->k = k[nk];
+
+            double kR=abs(k[nk]*fmax(Pa->Radius, Pb->Radius));
+            if ( ncv==3 || ( ncv>0 && (kR>SWTHRESHOLD || Args->ForceTaylorDuffy) ) )
+             { // taylor-duffy 
+               GetPanelPanelInteractions(NearArgs);
+               HH[0] = NearArgs->H[0];
+               HH[1] = NearArgs->H[1];
+             }
+            else
+             { // desingularization: the FIPPI data are the same for all k
+               if (QDFD==0)
+                { QDFD=&MyQDFD;
+                  GetQDFIPPIData(Va, Qa[iQa], Vb, Qb[iQb], ncv,
+                                 Args->opFC ? Args->opFC : &GlobalFIPPICache, QDFD);
+                };
+               GetPPIs_Cubature(NearArgs, 1, 0, Va, Qa[iQa], Vb, Qb[iQb]);
+               HH[0] = NearArgs->H[0];
+               HH[1] = NearArgs->H[1];
+               AddDesingularizedTerms(k[nk], QDFD, HH);
+               NearArgs->WhichAlgorithm=PPIALG_DESING;
+             };
+            Args->WhichAlgorithms[nk]=NearArgs->WhichAlgorithm;
+          };
+       };
+   };
+
+  if (NumLO==0 && NumHO==0)
+   return;
+
+  /***************************************************************/
+  /* to avoid loss of precision in the contractions below we     */
+  /* measure X and XP from the centroids of their panels:        */
+  /*  x = X-Ca, xp = XP-Cb, F = x-qa, FP = xp-qb                 */
+  /* with qa=Qa-Ca, qb=Qb-Cb. then                               */
+  /*  H[0] = \int (F.FP + 4/(ik)^2) G                            */
+  /*       = M[7] - qb.M[1..3] - qa.M[4..6]                      */
+  /*              + (qa.qb + 4/(ik)^2)*M[0]                      */
+  /*  H[1] = \int (F x FP).Grad G                                */
+  /*       = M[8] - qb.M[9..11] - qa.M[12..14]                   */
+  /*              + (qa x qb).M[15..17]                          */
+  /* with the moments                                            */
+  /*  M[0]      = \int G                                         */
+  /*  M[1..3]   = \int x G                                       */
+  /*  M[4..6]   = \int xp G                                      */
+  /*  M[7]      = \int (x.xp) G                                  */
+  /*  M[8]      = \int (x x xp).Grad G                           */
+  /*  M[9..11]  = \int (Grad G) x x                              */
+  /*  M[12..14] = \int xp x (Grad G)                             */
+  /*  M[15..17] = \int Grad G                                    */
+  /***************************************************************/
+  double Ca[3], Cb[3];
+  for(int Mu=0; Mu<3; Mu++)
+   { Ca[Mu] = (Va[0][Mu] + Va[1][Mu] + Va[2][Mu])/3.0;
+     Cb[Mu] = (Vb[0][Mu] + Vb[1][Mu] + Vb[2][Mu])/3.0;
+   };
+
+  cdouble M[18*PPI_MAXKS];
+  for(int Order=0; Order<2; Order++)
+   { 
+     int NumOKs         = Order==0 ? NumLO : NumHO;
+     int *Index         = Order==0 ? LOIndex : HOIndex;
+     cdouble *kO        = Order==0 ? kLO : kHO;
+     GBarAccelerator **GBAO = Order==0 ? GBALO : GBAHO;
+     if (NumOKs==0) continue;
+
+     int NumPts;
+     double *TCR=GetTCR(Order==0 ? 4 : 20, &NumPts);
+     GetPPIMoments(Va, Ca, Vb, Cb, TCR, NumPts, Args->ForceFullEwald,
+                   NumOKs, kO, GBAO, M);
+
+     /***************************************************************/
+     /* contract the moments to get the integrals for each pair of  */
+     /* source vertices                                             */
+     /***************************************************************/
+     for(int iQa=0; iQa<3; iQa++)
+      for(int iQb=0; iQb<3; iQb++)
+       { if ( !(VertexMask & (1<<(3*iQa+iQb))) ) continue;
+         double qa[3], qb[3], qaxqb[3];
+         VecSub(Qa[iQa], Ca, qa);
+         VecSub(Qb[iQb], Cb, qb);
+         VecCross(qa, qb, qaxqb);
+         double qadqb=VecDot(qa,qb);
+
+         for(int n=0; n<NumOKs; n++)
+          { cdouble *MK = M + 18*n;
+            cdouble *HH = H + 18*Index[n] + 2*(3*iQa+iQb);
+            cdouble ik  = II*kO[n];
+            HH[0] = MK[7] + (qadqb + 4.0/(ik*ik))*MK[0];
+            HH[1] = MK[8];
+            for(int Mu=0; Mu<3; Mu++)
+             { HH[0] -= qb[Mu]*MK[1+Mu] + qa[Mu]*MK[4+Mu];
+               HH[1] += qaxqb[Mu]*MK[15+Mu] - qb[Mu]*MK[9+Mu] - qa[Mu]*MK[12+Mu];
+             };
+          };
+       };
+   };
+
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
@@ -592,6 +966,7 @@ void InitGetPPIArgs(GetPPIArgStruct *Args)
   Args->Displacement=0;
   Args->GBA=0;
   Args->ForceFullEwald=false;
+  Args->NumKs=0;
 }
 
 } // namespace scuff
@@ -35,6 +35,8 @@
 #include <BZIntegration.h> // needed for GetRLBasis
 
 #include "libscuff.h"
+#include "libscuffInternals.h"
+#include "EquivalentPanelPairs.h"
 
 namespace scuff {
 
@@ -49,6 +51,7 @@ bool RWGGeometry::UseHRWGFunctions=false;
 bool RWGGeometry::UseHighKTaylorDuffy=true;
 bool RWGGeometry::UseTaylorDuffyV2P0=true;
 bool RWGGeometry::DisableCache=false;
+double RWGGeometry::FieldsFMMTol=0.0;
 
 /***********************************************************************/
 /* subroutine to parse the MEDIUM...ENDMEDIUM section in a .scuffgeo   */
@@ -401,6 +404,7 @@ RWGGeometry::RWGGeometry(const char *pGeoFileName, int pLogLevel)
 
   RWGGeometry::DisableCache=CheckEnv("SCUFF_DISABLE_CACHE");
   RWGGeometry::UseHRWGFunctions=CheckEnv("SCUFF_HALF_RWG");
+  CheckEnv("SCUFF_FIELDS_FMMTOL", &RWGGeometry::FieldsFMMTol);
 
   if (CheckEnv("SCUFF_ABORT_ON_FPE"))
    {
@@ -786,6 +790,7 @@ RWGGeometry::RWGGeometry(const char *pGeoFileName, int pLogLevel)
   if (!CheckEnv("SCUFF_IGNORE_EEPS"))
    for(int ns=0; ns<NumSurfaces; ns++)
     EEPTables.push_back( vector<EquivalentEdgePairTable *>(NumSurfaces, NULL) );
+  EPPTables.assign(NumSurfaces, NULL);
 
   /***************************************************************/
   /***************************************************************/
@@ -795,6 +800,12 @@ RWGGeometry::RWGGeometry(const char *pGeoFileName, int pLogLevel)
   if (UseHRWGFunctions)
    DetectMultiMaterialJunctions();
 
+  /***************************************************************/
+  /***************************************************************/
+  /***************************************************************/
+  BMInterpolator=0;
+  KBIMBStore=0;
+
   /***************************************************************/
   /***************************************************************/
   /***************************************************************/
@@ -838,6 +849,14 @@ RWGGeometry::~RWGGeometry()
     DestroyFIBBICache(FIBBICaches[ns]);
   free(FIBBICaches);
 
+  DestroyKBIMBStore(KBIMBStore);
+
+  for(size_t nsa=0; nsa<EEPTables.size(); nsa++)
+   for(size_t nsb=0; nsb<EEPTables[nsa].size(); nsb++)
+    if (EEPTables[nsa][nsb]) delete EEPTables[nsa][nsb];
+  for(size_t ns=0; ns<EPPTables.size(); ns++)
+   if (EPPTables[ns]) delete EPPTables[ns];
+
 }
 
 /***************************************************************/
@@ -0,0 +1,409 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * ResultStore.cc -- append-only binary store of frequency-sweep results
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <vector>
+
+#include <string>
+#ifdef HAVE_CXX11
+#include <unordered_map>
+#elif defined(HAVE_TR1)
+#include <tr1/unordered_map>
+#else
+#include <map>
+#endif
+
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "ResultStore.h"
+
+namespace scuff {
+
+/***************************************************************/
+/* the in-memory index maps the byte string of a record key    */
+/* to the position of the record's values in ValueBuffer       */
+/***************************************************************/
+#ifdef HAVE_CXX11
+typedef std::unordered_map<std::string, size_t> RSIndex;
+#elif defined(HAVE_TR1)
+typedef std::tr1::unordered_map<std::string, size_t> RSIndex;
+#else
+typedef std::map<std::string, size_t> RSIndex;
+#endif
+
+typedef struct RSKey
+ { uint64_t ContextHash;
+   uint64_t TagHash;
+   double Omega[2];
+   double kBloch[2];
+ } RSKey;
+
+/***************************************************************/
+/* utility routines ********************************************/
+/***************************************************************/
+static uint64_t HashString(const char *s)
+{ return HashBytes(s, strlen(s)); }
+
+// round to the precision of the '%e' format used in text output files
+static double Canonicalize(double x)
+{
+  char Buffer[32];
+  snprintf(Buffer,32,"%e",x);
+  return strtod(Buffer,0);
+}
+
+static uint64_t RecordChecksum(RSRecordHeader *Header, double *Values)
+{
+  uint64_t SavedChecksum=Header->Checksum;
+  Header->Checksum=0;
+  uint64_t Checksum=HashBytes(Header, sizeof(RSRecordHeader));
+  Checksum=HashBytes(Values, Header->NumValues*sizeof(double), Checksum);
+  Header->Checksum=SavedChecksum;
+  return Checksum;
+}
+
+static uint64_t RecordDataSize(const void *Header)
+{ return ((const RSRecordHeader *)Header)->NumValues*sizeof(double); }
+
+static void InitRecordHeader(RSRecordHeader *Header,
+                             uint64_t ContextHash, int NumValues, int LDim,
+                             const char *Tag, cdouble Omega, double *kBloch)
+{
+  memset(Header, 0, sizeof(*Header));
+  Header->Magic       = RS_MAGIC;
+  Header->NumValues   = NumValues;
+  Header->ContextHash = ContextHash;
+  Header->TagHash     = HashString(Tag ? Tag : "");
+  Header->Omega[0]    = Canonicalize(real(Omega));
+  Header->Omega[1]    = Canonicalize(imag(Omega));
+  for(int d=0; d<LDim && kBloch; d++)
+   Header->kBloch[d]  = Canonicalize(kBloch[d]);
+}
+
+static std::string GetKey(RSRecordHeader *Header)
+{
+  RSKey Key;
+  memset(&Key, 0, sizeof(Key));
+  Key.ContextHash = Header->ContextHash;
+  Key.TagHash     = Header->TagHash;
+  Key.Omega[0]    = Header->Omega[0] + 0.0; // +0.0 maps -0.0 to 0.0
+  Key.Omega[1]    = Header->Omega[1] + 0.0;
+  Key.kBloch[0]   = Header->kBloch[0] + 0.0;
+  Key.kBloch[1]   = Header->kBloch[1] + 0.0;
+  return std::string( (const char *)&Key, sizeof(Key) );
+}
+
+/***************************************************************/
+/* open the file, writing a new header if it is empty or       */
+/* validating the existing header otherwise, and read in the   */
+/* index                                                       */
+/***************************************************************/
+ResultStore::ResultStore(const char *pFileName, uint64_t pContextHash,
+                         int pNumValues, int pLDim)
+{
+  FileName        = strdupEC(pFileName);
+  ContextHash     = pContextHash;
+  NumValues       = pNumValues;
+  LDim            = pLDim;
+  Disabled        = false;
+  ScannedSize     = sizeof(RSHeader);
+  Index           = (void *)(new RSIndex);
+  ValueBuffer     = 0;
+  ValueBufferSize = 0;
+  Hits=Misses=Writes=0;
+
+  RSHeader Header;
+  memset(&Header, 0, sizeof(Header));
+  strncpy(Header.Common.Signature, RS_SIGNATURE, sizeof(Header.Common.Signature)-1);
+  Header.Common.Version   = RS_VERSION;
+  Header.Common.ByteOrder = RS_BYTEORDER;
+  fd=OpenStoreFile(FileName, "result store", false, &Header, sizeof(Header));
+  if (fd<0)
+   { Disabled=true;
+     return;
+   };
+
+  LockFile(fd, F_RDLCK);
+  RefreshIndex();
+  LockFile(fd, F_UNLCK);
+
+  Log("Result store %s: %i records for this calculation",FileName,GetNumRecords());
+}
+
+ResultStore::~ResultStore()
+{
+  if (fd>=0)
+   close(fd);
+  Log("Result store %s: %lu hits, %lu misses, %lu writes",FileName,Hits,Misses,Writes);
+  free(FileName);
+  delete (RSIndex *)Index;
+  if (ValueBuffer)
+   free(ValueBuffer);
+}
+
+int ResultStore::GetNumRecords()
+{ return (int)( ((RSIndex *)Index)->size() ); }
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void ResultStore::AddToIndex(RSRecordHeader *Header, double *Values)
+{
+  RSIndex *RSI = (RSIndex *)Index;
+  std::string Key=GetKey(Header);
+  if ( RSI->count(Key) )
+   return;
+
+  size_t Slot=RSI->size();
+  if (Slot==ValueBufferSize)
+   { ValueBufferSize = (ValueBufferSize==0) ? 64 : 2*ValueBufferSize;
+     ValueBuffer = (double *)reallocEC(ValueBuffer, ValueBufferSize*NumValues*sizeof(double));
+   };
+  memcpy(ValueBuffer + Slot*NumValues, Values, NumValues*sizeof(double));
+  (*RSI)[Key]=Slot;
+}
+
+/***************************************************************/
+/* callback for ScanStoreRecords: read and validate the values  */
+/* of one record, and index them if they belong to this        */
+/* calculation                                                 */
+/***************************************************************/
+static bool ReadRecord(void *UserData, void *RecordHeader, off_t Offset)
+{
+  ResultStore *RS        = (ResultStore *)UserData;
+  RSRecordHeader *Header = (RSRecordHeader *)RecordHeader;
+
+  ssize_t DataSize = RecordDataSize(Header);
+  std::vector<double> Values(Header->NumValues + 1);
+  if (    pread(RS->fd, &(Values[0]), DataSize, Offset + sizeof(RSRecordHeader)) != DataSize
+       || RecordChecksum(Header, &(Values[0])) != Header->Checksum
+     ) return false;
+
+  if ( Header->ContextHash==RS->ContextHash && ((int)Header->NumValues)==RS->NumValues )
+   RS->AddToIndex(Header, &(Values[0]));
+  return true;
+}
+
+/***************************************************************/
+/* bring the in-memory index up to date with the file, which   */
+/* may have been appended to by other processes. must be       */
+/* called with a lock held. returns the size of the file, which*/
+/* exceeds ScannedSize if the last record is incomplete.       */
+/***************************************************************/
+off_t ResultStore::RefreshIndex()
+{
+  return ScanStoreRecords(fd, &ScannedSize, RS_MAGIC, sizeof(RSRecordHeader),
+                          RecordDataSize, ReadRecord, (void *)this);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+bool ResultStore::Lookup0(const char *Tag, cdouble Omega, double *kBloch, double *Values)
+{
+  if (Disabled) return false;
+
+  RSRecordHeader Header;
+  InitRecordHeader(&Header, ContextHash, NumValues, LDim, Tag, Omega, kBloch);
+  std::string Key=GetKey(&Header);
+  RSIndex *RSI = (RSIndex *)Index;
+
+  // on a miss, check for records appended by other processes
+  RSIndex::iterator it=RSI->find(Key);
+  if ( it==RSI->end() )
+   { struct stat st;
+     fstat(fd, &st);
+     if ( st.st_size > ScannedSize )
+      { LockFile(fd, F_RDLCK);
+        RefreshIndex();
+        LockFile(fd, F_UNLCK);
+        it=RSI->find(Key);
+      };
+   };
+
+  if ( it==RSI->end() )
+   { Misses++;
+     return false;
+   };
+
+  memcpy(Values, ValueBuffer + (it->second)*NumValues, NumValues*sizeof(double));
+  Hits++;
+  return true;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void ResultStore::Append0(const char *Tag, cdouble Omega, double *kBloch, double *Values,
+                          bool Sync)
+{
+  if (Disabled) return;
+
+  RSRecordHeader Header;
+  InitRecordHeader(&Header, ContextHash, NumValues, LDim, Tag, Omega, kBloch);
+  Header.Checksum=RecordChecksum(&Header, Values);
+
+  LockFile(fd, F_WRLCK);
+  off_t FileSize=RefreshIndex();
+
+  /*--------------------------------------------------------------*/
+  /*- another process may have beaten us to it -------------------*/
+  /*--------------------------------------------------------------*/
+  if ( ((RSIndex *)Index)->count(GetKey(&Header)) )
+   { LockFile(fd, F_UNLCK);
+     return;
+   };
+
+  if ( AppendStoreRecord(fd, FileName, "result store", FileSize, &ScannedSize,
+                         &Header, sizeof(Header), Values, RecordDataSize(&Header), Sync)
+     )
+   { AddToIndex(&Header, Values);
+     Writes++;
+   };
+
+  LockFile(fd, F_UNLCK);
+}
+
+/***************************************************************/
+/* the index is shared by all threads, so the entry points are */
+/* serialized when several kBloch points are being evaluated   */
+/* concurrently.                                               */
+/***************************************************************/
+bool ResultStore::Lookup(const char *Tag, cdouble Omega, double *kBloch, double *Values)
+{
+  bool Found;
+#ifdef USE_OPENMP
+#pragma omp critical(ResultStore)
+#endif
+  Found=Lookup0(Tag, Omega, kBloch, Values);
+  return Found;
+}
+
+void ResultStore::Append(const char *Tag, cdouble Omega, double *kBloch, double *Values)
+{
+#ifdef USE_OPENMP
+#pragma omp critical(ResultStore)
+#endif
+  Append0(Tag, Omega, kBloch, Values);
+}
+
+/***************************************************************/
+/* one-time import of the results in a text output file, so    */
+/* that runs begun before the store existed can be resumed     */
+/***************************************************************/
+int ResultStore::Import(const char *TextFileName, bool WithErrors)
+{
+  if (Disabled) return 0;
+
+  FILE *f=fopen(TextFileName,"r");
+  if (!f) return 0;
+
+  int NumColumns  = (WithErrors ? 2 : 1)*NumValues;
+  double *Numbers = new double[1 + LDim + NumColumns];
+  double *Values  = new double[NumValues];
+  char Line[10000];
+  int NumImported=0, LineNum=0;
+  while( fgets(Line,10000,f) )
+   {
+     LineNum++;
+     char *Tokens[100];
+     int NumTokens=Tokenize(Line, Tokens, 100);
+     if ( NumTokens==0 || Tokens[0][0]=='#' )
+      continue;
+     if ( NumTokens != 2 + LDim + NumColumns )
+      { Log("Result store %s: skipping line %i of %s (wrong number of columns)",
+             FileName,LineNum,TextFileName);
+        continue;
+      };
+
+     bool Valid=true;
+     for(int nt=1; Valid && nt<NumTokens; nt++)
+      { char *EndPtr;
+        Numbers[nt-1]=strtod(Tokens[nt], &EndPtr);
+        Valid = (*EndPtr==0);
+      };
+     if (!Valid)
+      continue;
+
+     for(int nv=0; nv<NumValues; nv++)
+      Values[nv] = Numbers[1 + LDim + (WithErrors ? 2*nv : nv)];
+
+     double *kBloch = (LDim>0) ? Numbers+1 : 0;
+     int NumRecords = GetNumRecords();
+     Append0(Tokens[0], Numbers[0], kBloch, Values, false);
+     if (GetNumRecords() > NumRecords)
+      NumImported++;
+   };
+  fclose(f);
+  fsync(fd);
+  delete[] Numbers;
+  delete[] Values;
+
+  if (NumImported>0)
+   Log("Result store %s: imported %i records from %s",FileName,NumImported,TextFileName);
+  return NumImported;
+}
+
+/***************************************************************/
+/* hash of everything about a geometry that affects the        */
+/* results computed for it: the meshes (including any          */
+/* displacements or rotations applied in the .scuffgeo file),  */
+/* the material in each region, and the lattice                */
+/***************************************************************/
+uint64_t GetGeometryHash(RWGGeometry *G)
+{
+  uint64_t Hash=HashBytes(&(G->NumSurfaces), sizeof(int));
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   { RWGSurface *S=G->Surfaces[ns];
+     int Ints[6];
+     Ints[0]=S->NumVertices;
+     Ints[1]=S->NumPanels;
+     Ints[2]=S->NumBFs;
+     Ints[3]=S->IsPEC ? 1 : 0;
+     Ints[4]=S->RegionIndices[0];
+     Ints[5]=S->RegionIndices[1];
+     Hash=HashBytes(Ints, 6*sizeof(int), Hash);
+     Hash=HashBytes(S->Vertices, 3*S->NumVertices*sizeof(double), Hash);
+   };
+
+  for(int nr=0; nr<G->NumRegions; nr++)
+   Hash=HashBytes(G->RegionMPs[nr]->Name, strlen(G->RegionMPs[nr]->Name)+1, Hash);
+
+  if (G->LBasis)
+   Hash=HashBytes(G->LBasis->DM, G->LBasis->NR*G->LBasis->NC*sizeof(double), Hash);
+
+  return Hash;
+}
+
+} // namespace scuff
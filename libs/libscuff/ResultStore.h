@@ -0,0 +1,146 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * ResultStore.h -- append-only binary store of frequency-sweep results,
+ *               -- used by the application codes to resume interrupted
+ *               -- runs and to skip (Omega, kBloch) points that have
+ *               -- already been computed
+ */
+
+#ifndef RESULT_STORE_H
+#define RESULT_STORE_H
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <libhrutil.h>
+
+#include "StoreFile.h"
+
+namespace scuff {
+
+class RWGGeometry; // forward declaration
+
+/***************************************************************/
+/* A ResultStore is a file of fixed-length records, each       */
+/* holding NumValues doubles computed at one point of a sweep  */
+/* and keyed by                                                */
+/*                                                             */
+/*  (ContextHash, Tag, Omega, kBloch)                          */
+/*                                                             */
+/* where ContextHash identifies the calculation (the caller    */
+/* typically combines GetGeometryHash() with a hash of its own */
+/* options) and Tag is the name of the geometrical             */
+/* transformation. The file layout is                          */
+/*                                                             */
+/*  RSHeader          (64 bytes)                               */
+/*  record 0:  RSRecordHeader, then NumValues doubles          */
+/*  record 1:  ...                                             */
+/*                                                             */
+/* As for the T-block store (TBlockStore.h), records are only  */
+/* ever appended, under an exclusive POSIX lock (StoreFile.h), */
+/* and carry a checksum; a record torn by a crash is discarded */
+/* by the next writer. Records with a different ContextHash or */
+/* NumValues are skipped, so several calculations may share a  */
+/* file.                                                       */
+/*                                                             */
+/* The store keeps an in-memory hash index of all records (and */
+/* their values), so Lookup() is O(1) and touches the file     */
+/* only to pick up records appended by other processes.        */
+/*                                                             */
+/* Frequencies and Bloch vectors are rounded to the 7          */
+/* significant digits of the '%e' format before hashing, so    */
+/* that keys read back from text output files by Import()      */
+/* match keys computed at run time. "Omega" is whichever       */
+/* frequency variable the caller uses (scuff-cas3D passes the  */
+/* real Matsubara frequency Xi); Import() stores the frequency */
+/* column of a text file as a real number.                     */
+/***************************************************************/
+#define RS_SIGNATURE  "SCUFF_RESULTS"
+#define RS_VERSION    1
+#define RS_BYTEORDER  0x01020304
+#define RS_MAGIC      0x53544C52  // 'RLTS'
+
+typedef struct RSHeader
+ { StoreFileHeader Common;  // RS_SIGNATURE, RS_VERSION, RS_BYTEORDER
+   char Padding[40];
+ } RSHeader;
+
+typedef struct RSRecordHeader
+ { uint32_t Magic;          // RS_MAGIC
+   uint32_t NumValues;
+   uint64_t ContextHash;
+   uint64_t TagHash;
+   double Omega[2];         // real and imaginary parts
+   double kBloch[2];        // zero for compact geometries
+   uint64_t Checksum;       // of the values and the rest of the header
+ } RSRecordHeader;
+
+class ResultStore
+ {
+public:
+   ResultStore(const char *FileName, uint64_t ContextHash,
+               int NumValues, int LDim=0);
+   ~ResultStore();
+
+   // fetch the values stored for this point; returns true on success
+   bool Lookup(const char *Tag, cdouble Omega, double *kBloch, double *Values);
+
+   // add values for this point (no-op if already present)
+   void Append(const char *Tag, cdouble Omega, double *kBloch, double *Values);
+
+   // add a record for each line of a text output file of the form
+   //  Tag Omega [kx [ky]] v1 [e1] v2 [e2] ...
+   // where the error columns ei are present if WithErrors is true;
+   // returns the number of records added (not thread-safe; call
+   // before starting a sweep)
+   int Import(const char *TextFileName, bool WithErrors=false);
+
+   int GetNumRecords();
+
+// private data fields
+// private:
+   char *FileName;
+   int fd;
+   bool Disabled;
+   uint64_t ContextHash;
+   int NumValues, LDim;
+   off_t ScannedSize;        // end of the last valid record we know about
+   void *Index;              // maps record keys to offsets in ValueBuffer
+   double *ValueBuffer;
+   size_t ValueBufferSize;   // number of records ValueBuffer can hold
+   unsigned long Hits, Misses, Writes;
+
+   off_t RefreshIndex();
+   void AddToIndex(RSRecordHeader *Header, double *Values);
+   bool Lookup0(const char *Tag, cdouble Omega, double *kBloch, double *Values);
+   void Append0(const char *Tag, cdouble Omega, double *kBloch, double *Values,
+                bool Sync=true);
+ };
+
+// hash of the mesh topology, materials, and lattice of a geometry
+uint64_t GetGeometryHash(RWGGeometry *G);
+
+} // namespace scuff
+#endif // #ifndef RESULT_STORE_H
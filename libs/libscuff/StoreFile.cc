@@ -0,0 +1,182 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * StoreFile.cc -- file-level routines shared by the append-only
+ *              -- on-disk stores
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <vector>
+
+#include <libhrutil.h>
+
+#include "StoreFile.h"
+
+namespace scuff {
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+uint64_t HashBytes(const void *Data, size_t Size, uint64_t Hash)
+{
+  // 64-bit FNV-1a
+  const unsigned char *p=(const unsigned char *)Data;
+  if (Hash==0) Hash=14695981039346656037ULL;
+  for(size_t n=0; n<Size; n++)
+   { Hash ^= p[n];
+     Hash *= 1099511628211ULL;
+   };
+  return Hash;
+}
+
+int LockFile(int fd, short Type)
+{
+  struct flock fl;
+  memset(&fl, 0, sizeof(fl));
+  fl.l_type=Type;           // F_RDLCK, F_WRLCK, or F_UNLCK
+  fl.l_whence=SEEK_SET;
+  fl.l_start=0;
+  fl.l_len=0;               // whole file
+  return fcntl(fd, Type==F_UNLCK ? F_SETLK : F_SETLKW, &fl);
+}
+
+/***************************************************************/
+/* open the file, writing a new header if it is empty or       */
+/* validating the existing header otherwise                    */
+/***************************************************************/
+int OpenStoreFile(const char *FileName, const char *Description,
+                  bool ReadOnly, void *Header, size_t HeaderSize)
+{
+  int fd=open(FileName, ReadOnly ? O_RDONLY : (O_RDWR|O_CREAT), 0664);
+  if (fd<0)
+   { if (!ReadOnly)
+      Warn("could not open %s %s (disabling)",Description,FileName);
+     return -1;
+   };
+
+  LockFile(fd, ReadOnly ? F_RDLCK : F_WRLCK);
+
+  StoreFileHeader *SFH=(StoreFileHeader *)Header;
+  StoreFileHeader Expected=*SFH;
+
+  const char *ErrMsg=0;
+  struct stat st;
+  fstat(fd, &st);
+  if (st.st_size==0 && !ReadOnly)
+   { if ( pwrite(fd, Header, HeaderSize, 0) != (ssize_t)HeaderSize )
+      ErrMsg="could not write file";
+   }
+  else if ( pread(fd, Header, HeaderSize, 0) != (ssize_t)HeaderSize )
+   ErrMsg="invalid file";
+  else if ( strncmp(SFH->Signature, Expected.Signature, sizeof(SFH->Signature)) )
+   ErrMsg="invalid file";
+  else if ( SFH->ByteOrder!=Expected.ByteOrder )
+   ErrMsg="file was written on a machine with different byte order";
+  else if ( SFH->Version!=Expected.Version )
+   ErrMsg="unsupported file version";
+
+  LockFile(fd, F_UNLCK);
+
+  if (ErrMsg)
+   { Warn("%s %s: %s (disabling)",Description,FileName,ErrMsg);
+     close(fd);
+     return -1;
+   };
+
+  return fd;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+off_t ScanStoreRecords(int fd, off_t *ScannedSize,
+                       uint32_t Magic, size_t RecordHeaderSize,
+                       StoreDataSizeFunc GetDataSize,
+                       StoreRecordFunc AddRecord, void *UserData)
+{
+  struct stat st;
+  fstat(fd, &st);
+  off_t FileSize=st.st_size;
+
+  // every record header begins with its magic number
+  std::vector<char> Buffer(RecordHeaderSize);
+  void *RecordHeader=(void *)&(Buffer[0]);
+  while( *ScannedSize + (off_t)RecordHeaderSize <= FileSize )
+   { off_t Offset=*ScannedSize;
+     if (    pread(fd, RecordHeader, RecordHeaderSize, Offset) != (ssize_t)RecordHeaderSize
+          || *((uint32_t *)RecordHeader) != Magic
+        ) break;
+     off_t RecordSize = RecordHeaderSize + GetDataSize(RecordHeader);
+     if (    Offset + RecordSize > FileSize
+          || !AddRecord(UserData, RecordHeader, Offset)
+        ) break;
+     *ScannedSize += RecordSize;
+   };
+
+  return FileSize;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+bool AppendStoreRecord(int fd, const char *FileName, const char *Description,
+                       off_t FileSize, off_t *ScannedSize,
+                       const void *RecordHeader, size_t RecordHeaderSize,
+                       const void *Data, size_t DataSize, bool Sync)
+{
+  off_t Offset=*ScannedSize;
+
+  /*--------------------------------------------------------------*/
+  /*- discard an incomplete record left by an interrupted writer  */
+  /*--------------------------------------------------------------*/
+  if ( FileSize > Offset )
+   { Log("%s %s: discarding incomplete record",Description,FileName);
+     if ( ftruncate(fd, Offset) )
+      Warn("%s %s: could not truncate file",Description,FileName);
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- append the new record; with Sync, it is on disk before the  */
+  /*- caller releases the lock, so a crash loses at most that one */
+  /*--------------------------------------------------------------*/
+  if (    pwrite(fd, RecordHeader, RecordHeaderSize, Offset) != (ssize_t)RecordHeaderSize
+       || pwrite(fd, Data, DataSize, Offset + RecordHeaderSize) != (ssize_t)DataSize
+     )
+   { Warn("%s %s: could not write record",Description,FileName);
+     if ( ftruncate(fd, Offset) )
+      Warn("%s %s: could not truncate file",Description,FileName);
+     return false;
+   };
+
+  if (Sync)
+   fsync(fd);
+  *ScannedSize += RecordHeaderSize + DataSize;
+  return true;
+}
+
+} // namespace scuff
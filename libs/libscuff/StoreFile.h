@@ -0,0 +1,97 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * StoreFile.h -- file-level routines shared by the append-only
+ *             -- on-disk stores (ResultStore.h, TBlockStore.h)
+ */
+
+#ifndef STOREFILE_H
+#define STOREFILE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace scuff {
+
+/***************************************************************/
+/* A store file is a fixed-size file header, which begins with */
+/* a StoreFileHeader, followed by any number of records, each  */
+/* of which is a fixed-size record header, beginning with a    */
+/* 32-bit magic number, followed by a variable amount of data. */
+/*                                                             */
+/* Records are only ever appended, under an exclusive POSIX    */
+/* lock on the whole file. A writer that dies in mid-append    */
+/* leaves a tail that does not scan as a complete record; it   */
+/* is discarded by the next writer.                            */
+/*                                                             */
+/* The Description argument of the routines below ("result    */
+/* store", "T-block store") is used in messages.               */
+/***************************************************************/
+typedef struct StoreFileHeader
+ { char Signature[16];
+   uint32_t Version;
+   uint32_t ByteOrder;      // as written by the creator
+ } StoreFileHeader;
+
+// 64-bit FNV-1a hash, optionally continuing from a previous hash
+uint64_t HashBytes(const void *Data, size_t Size, uint64_t Hash=0);
+
+// lock or unlock the whole file; Type is F_RDLCK, F_WRLCK, or F_UNLCK
+int LockFile(int fd, short Type);
+
+// open (or, if ReadOnly is false, create) a store file. Header
+// points to HeaderSize bytes beginning with a StoreFileHeader; if
+// the file is empty, Header is written to it, and otherwise the
+// existing header is read into Header after checking its
+// signature, byte order, and version against those passed in.
+// returns the file descriptor, or -1 on failure.
+int OpenStoreFile(const char *FileName, const char *Description,
+                  bool ReadOnly, void *Header, size_t HeaderSize);
+
+// ScanStoreRecords reads each complete record header following
+// *ScannedSize, calls AddRecord with it and the offset of the
+// record, and advances *ScannedSize past the record. it stops
+// at the end of the file, at a header with the wrong magic number
+// or whose data extend beyond the end of the file, or when
+// AddRecord returns false. must be called with a lock held;
+// returns the size of the file, which exceeds *ScannedSize if
+// the last record is incomplete.
+typedef uint64_t (*StoreDataSizeFunc)(const void *RecordHeader);
+typedef bool (*StoreRecordFunc)(void *UserData, void *RecordHeader, off_t Offset);
+
+off_t ScanStoreRecords(int fd, off_t *ScannedSize,
+                       uint32_t Magic, size_t RecordHeaderSize,
+                       StoreDataSizeFunc GetDataSize,
+                       StoreRecordFunc AddRecord, void *UserData);
+
+// append a record at *ScannedSize, first discarding any incomplete
+// record left beyond it (FileSize is the value returned by
+// ScanStoreRecords); if Sync is true, the record is flushed to disk
+// before returning. on success, *ScannedSize is advanced past the
+// new record and true is returned; on failure the file is truncated
+// back to *ScannedSize. must be called with an exclusive lock held.
+bool AppendStoreRecord(int fd, const char *FileName, const char *Description,
+                       off_t FileSize, off_t *ScannedSize,
+                       const void *RecordHeader, size_t RecordHeaderSize,
+                       const void *Data, size_t DataSize, bool Sync=false);
+
+} // namespace scuff
+
+#endif // STOREFILE_H
@@ -33,11 +33,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <map>
+#include <vector>
 #include <libhmat.h>
 #include <libhrutil.h>
 
 #include "libscuff.h"
 #include "libscuffInternals.h"
+#include "EquivalentPanelPairs.h"
 
 #include "cmatheval.h"
 
@@ -89,13 +92,448 @@ int CountCommonRegions(RWGSurface *Sa, RWGSurface *Sb,
 
 }
 
+/***************************************************************/
+/* GSSITile is a thread-local dense buffer into which a thread */
+/* stamps the matrix elements for a contiguous range of rows   */
+/* (i.e. a contiguous range of edges on Sa) of the output      */
+/* block; once the whole tile has been computed it is added to */
+/* the output matrix in a single pass over the columns of the  */
+/* tile, instead of via one HMatrix::AddEntry call per matrix  */
+/* element.                                                    */
+/*                                                             */
+/* the buffer is stored in column-major order like the HMatrix */
+/* itself, so for matrices with normal storage each column of  */
+/* the tile is a contiguous run of memory in both the buffer   */
+/* and the output matrix. for each row we track the range of  */
+/* columns actually touched, so that in the symmetric case we  */
+/* never write to entries below the diagonal.                  */
+/***************************************************************/
+class GSSITile
+ {
+public:
+   GSSITile(HMatrix *pM, int MaxRows, int pColOffset, int pNumCols)
+    { M=pM;
+      ColOffset=pColOffset;
+      NumCols=pNumCols;
+      NumRows=MaxRows;
+      RowOffset=0;
+      Buffer=(cdouble *)mallocEC( ((size_t)NumRows)*NumCols*sizeof(cdouble) );
+      YMin=(int *)mallocEC(2*NumRows*sizeof(int));
+      YMax=YMin + NumRows;
+      Reset(0,0);
+    };
+
+   ~GSSITile()
+    { free(Buffer);
+      free(YMin);
+    };
+
+   // begin a new tile covering rows RowOffset...RowOffset+NumRows-1
+   // of the output matrix
+   void Reset(int pRowOffset, int pNumRows)
+    { RowOffset=pRowOffset;
+      NumRows=pNumRows;
+      size_t NumEntries=((size_t)NumRows)*NumCols;
+      for(size_t n=0; n<NumEntries; n++)
+       Buffer[n]=0.0;
+      for(int nr=0; nr<NumRows; nr++)
+       { YMin[nr]=NumCols; YMax[nr]=-1; }
+    };
+
+   // X, Y are absolute row and column indices in the output matrix
+   void Add(int X, int Y, cdouble Entry)
+    { int nr = X - RowOffset, nc = Y - ColOffset;
+      Buffer[ nr + ((size_t)nc)*NumRows ] += Entry;
+      if (nc<YMin[nr]) YMin[nr]=nc;
+      if (nc>YMax[nr]) YMax[nr]=nc;
+    };
+
+   // add the contents of the tile to the output matrix
+   void Flush()
+    { 
+      if (M->StorageType==LHM_NORMAL)
+       { size_t NR=M->NR;
+         for(int nc=0; nc<NumCols; nc++)
+          { cdouble *BCol = Buffer + ((size_t)nc)*NumRows;
+            size_t Offset = RowOffset + ((size_t)(ColOffset+nc))*NR;
+            if (M->RealComplex==LHM_COMPLEX)
+             { cdouble *MCol = M->ZM + Offset;
+               for(int nr=0; nr<NumRows; nr++)
+                if ( YMin[nr]<=nc && nc<=YMax[nr] )
+                 MCol[nr] += BCol[nr];
+             }
+            else
+             { double *MCol = M->DM + Offset;
+               for(int nr=0; nr<NumRows; nr++)
+                if ( YMin[nr]<=nc && nc<=YMax[nr] )
+                 MCol[nr] += real(BCol[nr]);
+             };
+          };
+       }
+      else
+       { // packed storage: let HMatrix handle the index bookkeeping
+         for(int nr=0; nr<NumRows; nr++)
+          for(int nc=YMin[nr]; nc<=YMax[nr]; nc++)
+           M->AddEntry(RowOffset+nr, ColOffset+nc, Buffer[nr + ((size_t)nc)*NumRows]);
+       };
+    };
+
+private:
+   HMatrix *M;
+   int RowOffset, NumRows, ColOffset, NumCols;
+   cdouble *Buffer;
+   int *YMin, *YMax;
+ };
+
+/***************************************************************/
+/* split the rows of the output block (edges on Sa) into       */
+/* NumTasks contiguous ranges containing roughly equal numbers */
+/* of edge pairs, and return the range for task #nt.           */
+/***************************************************************/
+static void GetTaskRowRange(int nt, int NumTasks, int NEa, int NEb,
+                            bool Symmetric, int *neaStart, int *neaStop)
+{
+  double TotalPairs=0.0;
+  for(int nea=0; nea<NEa; nea++)
+   TotalPairs += Symmetric ? (NEb-nea) : NEb;
+
+  double Start = TotalPairs*((double)nt)/((double)NumTasks);
+  double Stop  = TotalPairs*((double)(nt+1))/((double)NumTasks);
+
+  *neaStart=*neaStop=NEa;
+  double Pairs=0.0;
+  for(int nea=0; nea<NEa; nea++)
+   { if ( *neaStart==NEa && Pairs>=Start ) *neaStart=nea;
+     if ( Pairs>=Stop ) { *neaStop=nea; break; }
+     Pairs += Symmetric ? (NEb-nea) : NEb;
+   };
+  if (nt==NumTasks-1) *neaStop=NEa;
+  if (*neaStop<*neaStart) *neaStop=*neaStart;
+}
+
+/***************************************************************/
+/* the constant prefactors that multiply the G and C integrals */
+/* returned by GetEdgeEdgeInteractions() for a given medium    */
+/***************************************************************/
+static void GetGSSIPreFactors(cdouble Omega, cdouble Eps, cdouble Mu,
+                              double Sign, cdouble *k, cdouble PreFac[3])
+{
+  *k = csqrt2(Eps*Mu)*Omega;
+  PreFac[0] =  Sign*II*Mu*Omega;
+  PreFac[1] = -Sign*II*(*k);
+  PreFac[2] = -Sign*II*Eps*Omega;
+}
+
+/***************************************************************/
+/* add the contribution of one medium to the matrix elements   */
+/* between the basis functions of two edges, given the G and C */
+/* integrals for the edge pair. X, Y are the indices of the    */
+/* first row and column; which of the (up to four) entries are */
+/* present depends on whether the surfaces are PEC. SkipLower  */
+/* omits the (X+1,Y) entry, which lies below the diagonal for  */
+/* diagonal edge pairs in symmetric blocks.                    */
+/***************************************************************/
+template<class Sink>
+static void StampGC(Sink *S, int X, int Y, bool SaIsPEC, bool SbIsPEC,
+                    bool SkipLower, cdouble PreFac[3], cdouble G, cdouble C)
+{
+  if (S==0) return;
+  S->Add( X, Y, PreFac[0]*G );
+  if (!SbIsPEC)
+   S->Add( X, Y+1, PreFac[1]*C );
+  if (!SaIsPEC && !SkipLower)
+   S->Add( X+1, Y, PreFac[1]*C );
+  if (!SaIsPEC && !SbIsPEC)
+   S->Add( X+1, Y+1, PreFac[2]*G );
+}
+
+template<class Sink>
+static void StampEEIs(Sink *B, Sink **GradB, Sink **dBdTheta,
+                      int NumGradientComponents, int NumTorqueAxes,
+                      int X, int Y, bool SaIsPEC, bool SbIsPEC, bool SkipLower,
+                      cdouble PreFac[3], cdouble *GC, cdouble *GradGC, cdouble *dGCdT)
+{
+  StampGC(B, X, Y, SaIsPEC, SbIsPEC, SkipLower, PreFac, GC[0], GC[1]);
+
+  for(int Mu=0; Mu<NumGradientComponents; Mu++)
+   StampGC(GradB[Mu], X, Y, SaIsPEC, SbIsPEC, SkipLower, PreFac,
+           GradGC[2*Mu+0], GradGC[2*Mu+1]);
+
+  for(int Mu=0; Mu<NumTorqueAxes; Mu++)
+   StampGC(dBdTheta[Mu], X, Y, SaIsPEC, SbIsPEC, SkipLower, PreFac,
+           dGCdT[2*Mu+0], dGCdT[2*Mu+1]);
+}
+
+/***************************************************************/
+/* Panel-pair-centric assembly. Each panel carries up to three */
+/* RWG edges, so the matrix elements for the edge pairs on a   */
+/* given pair of panels involve the same panel-panel integral  */
+/* with up to 9 different pairs of source vertices (iQa,iQb).  */
+/* Instead of computing each edge pair as a sum of four        */
+/* independent panel-panel interactions, we loop over panel    */
+/* pairs and get the integrals for all vertex pairs at once    */
+/* (see GetPanelPanelInteractions(Args, VertexMask, H)), then  */
+/* stamp the contributions of each panel pair into all edge    */
+/* pairs it touches.                                           */
+/*                                                             */
+/* This is used whenever no derivatives are requested; it may */
+/* be disabled by setting SCUFF_PANELPAIR_ASSEMBLY=0.          */
+/*                                                             */
+/* For the interactions of a surface with itself, panel pairs  */
+/* that are translates of other panel pairs (see               */
+/* EquivalentPanelPairs.h) are not computed separately: the    */
+/* integrals for one pair in each class are computed before    */
+/* the threads start, and every pair in the class reads its    */
+/* integrals from there. This is not done when the kernel is  */
+/* evaluated by a GBarAccelerator, whose interpolation of the  */
+/* lattice sum is not exactly translation-invariant (it        */
+/* depends on where the displacement falls in the unit cell).  */
+/* It may be disabled by setting SCUFF_PANELPAIR_DEDUP=0.      */
+/***************************************************************/
+typedef struct PanelEdge
+ { int ne;        // index of edge
+   int iQ;        // index within the panel of the source/sink vertex
+   double Sign;   // +1 (-1) if the panel is the positive (negative) panel
+ } PanelEdge;
+
+static int GetPanelPairAssembly()
+{
+  int PanelPairAssembly=1;
+  CheckEnv("SCUFF_PANELPAIR_ASSEMBLY", &PanelPairAssembly);
+  return PanelPairAssembly;
+}
+
+static bool UsePanelPairAssembly()
+{
+  // initialized exactly once even if the first calls are concurrent
+  static const int PanelPairAssembly=GetPanelPairAssembly();
+  return PanelPairAssembly!=0;
+}
+
+static int GetPanelPairDedup()
+{
+  int PanelPairDedup=1;
+  CheckEnv("SCUFF_PANELPAIR_DEDUP", &PanelPairDedup);
+  return PanelPairDedup;
+}
+
+static bool UsePanelPairDedup()
+{
+  static const int PanelPairDedup=GetPanelPairDedup();
+  return PanelPairDedup!=0;
+}
+
+// the equivalent-panel-pair table for surface S, created on first
+// use; identical surfaces share a table
+static EquivalentPanelPairTable *GetEPPTable(RWGGeometry *G, RWGSurface *S)
+{
+  int ns=S->Index;
+  if ( ns<0 || ns>=G->NumSurfaces || G->Surfaces[ns]!=S )
+   return 0;
+  if (G->Mate[ns]!=-1)
+   ns=G->Mate[ns];
+
+  EquivalentPanelPairTable *EPPT;
+#ifdef USE_OPENMP
+#pragma omp critical(EPPTables)
+#endif
+  { if (G->EPPTables[ns]==0)
+     G->EPPTables[ns]
+      = new EquivalentPanelPairTable(G->Surfaces[ns],
+                                     GetStandardEPPTFilePath(G->Surfaces[ns]));
+    EPPT=G->EPPTables[ns];
+  }
+  return EPPT->NumParents>0 ? EPPT : 0;
+}
+
+// PanelEdges[np] is the list of edges on panel #np
+template<class PanelEdgeMap>
+static void AddPanelEdges(RWGSurface *S, int ne, PanelEdgeMap &PanelEdges)
+{
+  RWGEdge *E=S->Edges[ne];
+  PanelEdge PE;
+  PE.ne   = ne;
+  PE.iQ   = E->PIndex;
+  PE.Sign = 1.0;
+  PanelEdges[E->iPPanel].push_back(PE);
+  if (E->iMPanel!=-1)
+   { PE.iQ   = E->MIndex;
+     PE.Sign = -1.0;
+     PanelEdges[E->iMPanel].push_back(PE);
+   };
+}
+
+/***************************************************************/
+/* set up PPIArgs so that the integrals for all media are      */
+/* computed in a single batch; Medium[n] is the medium for the */
+/* nth wavenumber in the batch, and the return value is the    */
+/* number of wavenumbers. (see the note on k==0 in             */
+/* GetEdgeEdgeInteractions().)                                 */
+/***************************************************************/
+static int InitPanelPairPPIArgs(GetSSIArgStruct *Args, int NumMedia,
+                                cdouble *k, GBarAccelerator **GBA,
+                                GetPPIArgStruct *PPIArgs, int Medium[2])
+{
+  InitGetPPIArgs(PPIArgs);
+  PPIArgs->Sa           = Args->Sa;
+  PPIArgs->Sb           = Args->Sb;
+  PPIArgs->Displacement = Args->Displacement;
+  int NumKs=0;
+  for(int nm=0; nm<NumMedia; nm++)
+   if ( k[nm]!=0.0 )
+    { PPIArgs->Ks[NumKs]   = k[nm];
+      PPIArgs->GBAs[NumKs] = GBA[nm];
+      Medium[NumKs++]      = nm;
+    };
+  PPIArgs->NumKs=NumKs;
+  return NumKs;
+}
+
+/***************************************************************/
+/* compute the integrals for all vertex pairs of each parent   */
+/* pair in the equivalent-panel-pair table. on return,         */
+/* ParentH + 18*NumKs*n holds the integrals for parent #n, in  */
+/* the layout of GetPanelPanelInteractions(Args, Mask, H), and */
+/* ParentIsDistant[n] says whether parent #n was integrated    */
+/* without desingularization.                                  */
+/***************************************************************/
+static cdouble *GetParentPanelPairIntegrals(GetSSIArgStruct *Args,
+                                            EquivalentPanelPairTable *EPPT,
+                                            int NumMedia, cdouble *k,
+                                            GBarAccelerator **GBA,
+                                            bool **ParentIsDistant)
+{
+  GetPPIArgStruct MyPPIArgs, *PPIArgs=&MyPPIArgs;
+  int Medium[2];
+  int NumKs=InitPanelPairPPIArgs(Args, NumMedia, k, GBA, PPIArgs, Medium);
+  if (NumKs==0)
+   return 0;
+
+  int NumParents=EPPT->NumParents;
+  cdouble *ParentH=(cdouble *)mallocEC(((size_t)NumParents)*18*NumKs*sizeof(cdouble));
+  bool *IsDistant=(bool *)mallocEC(NumParents*sizeof(bool));
+#ifdef USE_OPENMP
+  int NumThreads=GetNumThreads();
+#pragma omp parallel for schedule(dynamic,64), num_threads(NumThreads)
+#endif
+  for(int n=0; n<NumParents; n++)
+   { GetPPIArgStruct MyParentArgs=*PPIArgs;
+     MyParentArgs.npa=EPPT->Parents[2*n+0];
+     MyParentArgs.npb=EPPT->Parents[2*n+1];
+     GetPanelPanelInteractions(&MyParentArgs, 0x1FF, ParentH + ((size_t)n)*18*NumKs);
+     IsDistant[n]=IsDistantPanelPair(&MyParentArgs);
+   };
+  *ParentIsDistant=IsDistant;
+  return ParentH;
+}
+
+/***************************************************************/
+/* add the contributions of all panel pairs to the matrix      */
+/* elements between edges neaStart..neaStop-1 on Sa and all    */
+/* edges on Sb. SbPanelEdges[npb] lists the edges on panel npb */
+/* of Sb. if EPPT is nonzero, the integrals for panel pairs    */
+/* with a parent in that table are taken from ParentH instead  */
+/* of being computed, unless the pair and its parent lie on    */
+/* opposite sides of the desingularization radius (which can   */
+/* happen by roundoff for pairs right at that radius).         */
+/* PanelPairCounts[0,1] count the panel pairs that were        */
+/* computed and taken from ParentH.                            */
+/***************************************************************/
+static void AddPanelPairInteractions(GetSSIArgStruct *Args,
+                                     int neaStart, int neaStop,
+                                     std::vector< std::vector<PanelEdge> > &SbPanelEdges,
+                                     int NumMedia, cdouble *k, cdouble PreFac[2][3],
+                                     GBarAccelerator **GBA, GSSITile **Tiles,
+                                     EquivalentPanelPairTable *EPPT, cdouble *ParentH,
+                                     bool *ParentIsDistant,
+                                     unsigned *PPIAlgorithmCount,
+                                     unsigned long PanelPairCounts[2])
+{
+  RWGSurface *Sa = Args->Sa;
+  RWGSurface *Sb = Args->Sb;
+  bool Symmetric = Args->Symmetric;
+  int RowsPerEdge = Args->SaIsPEC ? 1 : 2;
+  int ColsPerEdge = Args->SbIsPEC ? 1 : 2;
+
+  std::map<int, std::vector<PanelEdge> > SaPanelEdges;
+  for(int nea=neaStart; nea<neaStop; nea++)
+   AddPanelEdges(Sa, nea, SaPanelEdges);
+
+  GetPPIArgStruct MyPPIArgs, *PPIArgs=&MyPPIArgs;
+  int Medium[2];
+  int NumKs=InitPanelPairPPIArgs(Args, NumMedia, k, GBA, PPIArgs, Medium);
+  if (NumKs==0)
+   return;
+
+  cdouble H[2*18];
+  std::map<int, std::vector<PanelEdge> >::iterator it;
+  for(it=SaPanelEdges.begin(); it!=SaPanelEdges.end(); it++)
+   { 
+     std::vector<PanelEdge> &AEdges = it->second;
+     PPIArgs->npa = it->first;
+
+     for(int npb=0; npb<Sb->NumPanels; npb++)
+      { 
+        std::vector<PanelEdge> &BEdges = SbPanelEdges[npb];
+
+        // figure out which pairs of source vertices we need
+        int VertexMask=0;
+        for(size_t na=0; na<AEdges.size(); na++)
+         for(size_t nb=0; nb<BEdges.size(); nb++)
+          if ( !Symmetric || BEdges[nb].ne>=AEdges[na].ne )
+           VertexMask |= 1<<(3*AEdges[na].iQ + BEdges[nb].iQ);
+        if (VertexMask==0)
+         continue;
+
+        PPIArgs->npb = npb;
+        int nParent = EPPT ? EPPT->GetParent(it->first, npb) : -1;
+        if (     nParent!=-1
+             &&  IsDistantPanelPair(PPIArgs)!=ParentIsDistant[nParent] )
+         nParent=-1;
+        if (nParent==-1)
+         { GetPanelPanelInteractions(PPIArgs, VertexMask, H);
+           PanelPairCounts[0]++;
+         }
+        else
+         { memcpy(H, ParentH + ((size_t)nParent)*18*NumKs, 18*NumKs*sizeof(cdouble));
+           PanelPairCounts[1]++;
+         };
+
+        for(size_t na=0; na<AEdges.size(); na++)
+         for(size_t nb=0; nb<BEdges.size(); nb++)
+          { int nea=AEdges[na].ne, neb=BEdges[nb].ne;
+            if ( Symmetric && neb<nea ) continue;
+
+            double GPreFac = AEdges[na].Sign * BEdges[nb].Sign
+                              * Sa->Edges[nea]->Length * Sb->Edges[neb]->Length;
+            int X = Args->RowOffset + RowsPerEdge*nea;
+            int Y = Args->ColOffset + ColsPerEdge*neb;
+            for(int n=0; n<NumKs; n++)
+             { int nm=Medium[n];
+               cdouble *HH = H + 18*n + 2*(3*AEdges[na].iQ + BEdges[nb].iQ);
+               StampGC(Tiles[nm], X, Y, Args->SaIsPEC, Args->SbIsPEC,
+                       Symmetric && (nea==neb), PreFac[nm],
+                       GPreFac*HH[0], GPreFac*HH[1]/(II*k[nm]));
+               if (nParent==-1)
+                PPIAlgorithmCount[PPIArgs->WhichAlgorithms[n]]++;
+             };
+          };
+      };
+   };
+}
+
 /***************************************************************/
 /***************************************************************/
 /***************************************************************/
 typedef struct ThreadData
  { 
    GetSSIArgStruct *Args;
+   bool PanelPairMode;
+   EquivalentPanelPairTable *EPPT;
+   cdouble *ParentH;
+   bool *ParentIsDistant;
    unsigned PPIAlgorithmCount[NUMPPIALGORITHMS];
+   unsigned long PanelPairCounts[2];
    int nt, NumTasks;
 
  } ThreadData;
@@ -121,6 +559,7 @@ void *GSSIThread(void *data)
   bool Symmetric       = Args->Symmetric;
   double *Displacement = Args->Displacement;
   HMatrix *B           = Args->B;
+  HMatrix *B2          = Args->B2;
   HMatrix **GradB      = Args->GradB;
   HMatrix **dBdTheta   = Args->dBdTheta;
   cdouble EpsA         = Args->EpsA;
@@ -159,137 +598,150 @@ void *GSSIThread(void *data)
   /* precompute the constant prefactors that multiply the        */
   /* integrals returned by GetEdgeEdgeInteractions()             */
   /***************************************************************/
-  cdouble kA, PreFac1A, PreFac2A, PreFac3A;
-  cdouble kB, PreFac1B, PreFac2B, PreFac3B;
-
-  kA=csqrt2(EpsA*MuA)*Omega;
-  PreFac1A =  SignA*II*MuA*Omega;
-  PreFac2A = -SignA*II*kA;
-  PreFac3A = -SignA*II*EpsA*Omega;
-
+  cdouble kA, PreFacA[3];
+  cdouble kB=0.0, PreFacB[3]={0.0,0.0,0.0};
+  GetGSSIPreFactors(Omega, EpsA, MuA, SignA, &kA, PreFacA);
   if (EpsB!=0.0)
-   { 
-     kB=csqrt2(EpsB*MuB)*Omega;
-     PreFac1B =  SignB*II*MuB*Omega;
-     PreFac2B = -SignB*II*kB;
-     PreFac3B = -SignB*II*EpsB*Omega;
-   };
+   GetGSSIPreFactors(Omega, EpsB, MuB, SignB, &kB, PreFacB);
 
   /***************************************************************/
   /* loop over all internal edges on both objects.               */
   /***************************************************************/
   int nea, NEa=Sa->NumEdges;
   int neb, NEb=Sb->NumEdges;
-  int X, Y, Mu, nt=0;
+  int X, Y, Mu;
   int NumGradientComponents = GradB ? 3 : 0;
   int nebStart = Symmetric ? 1 : 0;
-  for(nea=0; nea<NEa; nea++)
+
+  /***************************************************************/
+  /* this task handles a contiguous range of edges on Sa, which  */
+  /* we process in tiles of at most TileEdges edges; the tile    */
+  /* size is chosen to keep the buffers for all output matrices  */
+  /* within a couple of megabytes, unless overridden by the      */
+  /* environment.                                                */
+  /***************************************************************/
+  int neaStart, neaStop;
+  GetTaskRowRange(TD->nt, TD->NumTasks, NEa, NEb, Symmetric,
+                  &neaStart, &neaStop);
+  TD->PanelPairCounts[0]=TD->PanelPairCounts[1]=0;
+  if (neaStop==neaStart)
+   { memset(TD->PPIAlgorithmCount, 0, NUMPPIALGORITHMS*sizeof(unsigned));
+     return 0;
+   };
+
+  int RowsPerEdge = SaIsPEC ? 1 : 2;
+  int ColsPerEdge = SbIsPEC ? 1 : 2;
+  int NumMatrices = 1 + NumGradientComponents + NumTorqueAxes;
+  int TileEdges = (2<<20) / (NumMatrices*Sb->NumBFs*RowsPerEdge*sizeof(cdouble));
+  CheckEnv("SCUFF_GSSI_TILESIZE", &TileEdges);
+  if (TileEdges<1) TileEdges=1;
+  if (TileEdges>(neaStop-neaStart)) TileEdges=neaStop-neaStart;
+
+  int MaxRows=RowsPerEdge*TileEdges;
+  GSSITile *BTile = new GSSITile(B, MaxRows, ColOffset, Sb->NumBFs);
+  GSSITile *B2Tile = B2 ? new GSSITile(B2, MaxRows, ColOffset, Sb->NumBFs) : 0;
+  GSSITile *MediumTiles[2]={BTile, B2Tile ? B2Tile : BTile};
+  GSSITile *GradBTiles[3]={0,0,0}, **dBdThetaTiles=0;
+  for(Mu=0; Mu<NumGradientComponents; Mu++)
+   if (GradB[Mu]) 
+    GradBTiles[Mu] = new GSSITile(GradB[Mu], MaxRows, ColOffset, Sb->NumBFs);
+  if (NumTorqueAxes>0)
+   { dBdThetaTiles = new GSSITile *[NumTorqueAxes];
+     for(Mu=0; Mu<NumTorqueAxes; Mu++)
+      dBdThetaTiles[Mu] = new GSSITile(dBdTheta[Mu], MaxRows, ColOffset, Sb->NumBFs);
+   };
+
+  /***************************************************************/
+  /* setup for panel-pair-centric assembly                       */
+  /***************************************************************/
+  std::vector< std::vector<PanelEdge> > SbPanelEdges;
+  int NumMedia = (EpsB!=0.0) ? 2 : 1;
+  cdouble kAB[2], PreFacAB[2][3];
+  GBarAccelerator *GBAAB[2];
+  if (TD->PanelPairMode)
+   { SbPanelEdges.resize(Sb->NumPanels);
+     for(neb=0; neb<NEb; neb++)
+      AddPanelEdges(Sb, neb, SbPanelEdges);
+     kAB[0]=kA;
+     kAB[1]=kB;
+     memcpy(PreFacAB[0], PreFacA, 3*sizeof(cdouble));
+     memcpy(PreFacAB[1], PreFacB, 3*sizeof(cdouble));
+     GBAAB[0]=Args->GBA1;
+     GBAAB[1]=Args->GBA2;
+   };
+
+  for(int neaTile=neaStart; neaTile<neaStop; neaTile+=TileEdges)
+   {
+     int neaTileStop = neaTile + TileEdges;
+     if (neaTileStop>neaStop) neaTileStop=neaStop;
+
+     int TileRowOffset = RowOffset + RowsPerEdge*neaTile;
+     int TileRows      = RowsPerEdge*(neaTileStop-neaTile);
+     BTile->Reset(TileRowOffset, TileRows);
+     if (B2Tile) B2Tile->Reset(TileRowOffset, TileRows);
+     for(Mu=0; Mu<NumGradientComponents; Mu++)
+      if (GradBTiles[Mu]) GradBTiles[Mu]->Reset(TileRowOffset, TileRows);
+     for(Mu=0; Mu<NumTorqueAxes; Mu++)
+      dBdThetaTiles[Mu]->Reset(TileRowOffset, TileRows);
+
+     if (TD->PanelPairMode)
+      { if (G->LogLevel>=SCUFF_VERBOSE2)
+         LogPercent(neaTile, NEa);
+        AddPanelPairInteractions(Args, neaTile, neaTileStop, SbPanelEdges,
+                                 NumMedia, kAB, PreFacAB, GBAAB, MediumTiles,
+                                 TD->EPPT, TD->ParentH, TD->ParentIsDistant,
+                                 GetEEIArgs->PPIAlgorithmCount, TD->PanelPairCounts);
+      }
+     else
+  for(nea=neaTile; nea<neaTileStop; nea++)
    for(neb=nebStart*nea; neb<NEb; neb++)
     { 
-      nt++;
-      if (nt==TD->NumTasks) nt=0;
-      if (nt!=TD->nt) continue;
-
       if (G->LogLevel>=SCUFF_VERBOSE2 && (neb==nebStart*nea) )
        LogPercent(nea, NEa);
 
+      X = RowOffset + RowsPerEdge*nea;
+      Y = ColOffset + ColsPerEdge*neb;
+      bool SkipLower = Symmetric && (nea==neb);
+
+      GetEEIArgs->nea  = nea;
+      GetEEIArgs->neb  = neb;
+
+      /*--------------------------------------------------------------*/
+      /*- if both media are present and no derivatives are needed,    */
+      /*- get the contributions of both media in a single call that  */
+      /*- shares the geometric parts of the panel-panel integrals    */
+      /*--------------------------------------------------------------*/
+      if (EpsB!=0.0 && NumGradientComponents==0 && NumTorqueAxes==0)
+       { GetEEIArgs->NumKs   = 2;
+         GetEEIArgs->Ks[0]   = kA;
+         GetEEIArgs->Ks[1]   = kB;
+         GetEEIArgs->GBAs[0] = Args->GBA1;
+         GetEEIArgs->GBAs[1] = Args->GBA2;
+         GetEdgeEdgeInteractions(GetEEIArgs);
+         GetEEIArgs->NumKs   = 0;
+
+         cdouble *GCs=GetEEIArgs->GCs;
+         StampEEIs(BTile, GradBTiles, dBdThetaTiles, 0, 0,
+                   X, Y, SaIsPEC, SbIsPEC, SkipLower, PreFacA, GCs+0, GradGC, dGCdT);
+         StampEEIs(MediumTiles[1], GradBTiles, dBdThetaTiles, 0, 0,
+                   X, Y, SaIsPEC, SbIsPEC, SkipLower, PreFacB, GCs+2, GradGC, dGCdT);
+         continue;
+       };
+
       /*--------------------------------------------------------------*/
       /*- contributions of first medium (EpsA, MuA)  -----------------*/
       /*--------------------------------------------------------------*/
-      GetEEIArgs->nea  = nea;
-      GetEEIArgs->neb  = neb;
       GetEEIArgs->k    = kA;
       GetEEIArgs->GBA  = Args->GBA1;
       GetEdgeEdgeInteractions(GetEEIArgs);
 
-      if ( SaIsPEC && SbIsPEC )
-       { 
-         X=RowOffset + nea;
-         Y=ColOffset + neb;  
-
-         B->AddEntry( X, Y, PreFac1A*GC[0] );
-
-         for(Mu=0; Mu<NumGradientComponents; Mu++)
-          if (GradB[Mu]) GradB[Mu]->AddEntry( X, Y, PreFac1A*GradGC[2*Mu+0]);
-
-         for(Mu=0; Mu<NumTorqueAxes; Mu++)
-          dBdTheta[Mu]->AddEntry( X, Y, PreFac1A*dGCdT[2*Mu+0]);
-
-       }
-      else if ( SaIsPEC && !SbIsPEC )
-       { 
-         X=RowOffset + nea;
-         Y=ColOffset + 2*neb;  
-
-         B->AddEntry( X, Y,   PreFac1A*GC[0] );
-         B->AddEntry( X, Y+1, PreFac2A*GC[1] );
-
-         for(Mu=0; Mu<NumGradientComponents; Mu++)
-          { if (!GradB[Mu]) continue;
-            GradB[Mu]->AddEntry( X, Y,   PreFac1A*GradGC[2*Mu+0]);
-            GradB[Mu]->AddEntry( X, Y+1, PreFac2A*GradGC[2*Mu+1]);
-          };
-
-         for(Mu=0; Mu<NumTorqueAxes; Mu++)
-          { dBdTheta[Mu]->AddEntry( X, Y, PreFac1A*dGCdT[2*Mu+0]);
-            dBdTheta[Mu]->AddEntry( X, Y+1, PreFac2A*dGCdT[2*Mu+1]);
-          };
-       }
-      else if ( !SaIsPEC && SbIsPEC )
-       {
-         X=RowOffset + 2*nea;
-         Y=ColOffset + neb;  
-
-         B->AddEntry( X,   Y, PreFac1A*GC[0] );
-         B->AddEntry( X+1, Y, PreFac2A*GC[1] );
-
-         for(Mu=0; Mu<NumGradientComponents; Mu++)
-          { if (!GradB[Mu]) continue;
-            GradB[Mu]->AddEntry( X, Y,   PreFac1A*GradGC[2*Mu+0]);
-            GradB[Mu]->AddEntry( X+1, Y, PreFac2A*GradGC[2*Mu+1]);
-          };
-
-         for(Mu=0; Mu<NumTorqueAxes; Mu++)
-          { dBdTheta[Mu]->AddEntry( X, Y,   PreFac1A*dGCdT[2*Mu+0]);
-            dBdTheta[Mu]->AddEntry( X+1, Y, PreFac2A*dGCdT[2*Mu+1]);
-          };
-       }
-      else if ( !SaIsPEC && !SbIsPEC )
-       { 
-         X=RowOffset + 2*nea;
-         Y=ColOffset + 2*neb;
-
-         B->AddEntry( X, Y,   PreFac1A*GC[0]);
-         B->AddEntry( X, Y+1, PreFac2A*GC[1]);
-         if ( !Symmetric || (nea!=neb) )
-          B->AddEntry( X+1, Y, PreFac2A*GC[1]);
-         B->AddEntry( X+1, Y+1, PreFac3A*GC[0]);
-
-         for(Mu=0; Mu<NumGradientComponents; Mu++)
-          { 
-            if (!GradB[Mu]) continue;
-            GradB[Mu]->AddEntry( X, Y,   PreFac1A*GradGC[2*Mu+0]);
-            GradB[Mu]->AddEntry( X, Y+1, PreFac2A*GradGC[2*Mu+1]);
-            if ( !Symmetric || (nea!=neb) )
-             GradB[Mu]->AddEntry( X+1, Y, PreFac2A*GradGC[2*Mu+1]);
-            GradB[Mu]->AddEntry( X+1, Y+1, PreFac3A*GradGC[2*Mu+0]);
-          };
-
-         for(Mu=0; Mu<NumTorqueAxes; Mu++)
-          { 
-            dBdTheta[Mu]->AddEntry( X, Y,   PreFac1A*dGCdT[2*Mu+0]);
-            dBdTheta[Mu]->AddEntry( X, Y+1, PreFac2A*dGCdT[2*Mu+1]);
-            if ( !Symmetric || (nea!=neb) )
-             dBdTheta[Mu]->AddEntry( X+1, Y, PreFac2A*dGCdT[2*Mu+1]);
-            dBdTheta[Mu]->AddEntry( X+1, Y+1, PreFac3A*dGCdT[2*Mu+0]);
-          };
-
-       }; // if ( OaIsPEC && ObIsPEC ) ... else ... 
+      StampEEIs(BTile, GradBTiles, dBdThetaTiles, NumGradientComponents, NumTorqueAxes,
+                X, Y, SaIsPEC, SbIsPEC, SkipLower, PreFacA, GC, GradGC, dGCdT);
 
       /*--------------------------------------------------------------*/
       /*- contributions of second medium if present.                  */
-      /*- note this case we already know we are in the fourth case    */
-      /*- of the above if...else statement.                           */
+      /*- note that in this case we already know that neither        */
+      /*- surface is PEC.                                             */
       /*--------------------------------------------------------------*/
       if (EpsB!=0.0)
        { 
@@ -297,36 +749,33 @@ void *GSSIThread(void *data)
          GetEEIArgs->GBA = Args->GBA2;
          GetEdgeEdgeInteractions(GetEEIArgs);
 
-         X=RowOffset + 2*nea;
-         Y=ColOffset + 2*neb;
-
-         B->AddEntry( X, Y,   PreFac1B*GC[0]);
-         B->AddEntry( X, Y+1, PreFac2B*GC[1]);
-         if ( !Symmetric || (nea!=neb) )
-          B->AddEntry( X+1, Y, PreFac2B*GC[1]);
-         B->AddEntry( X+1, Y+1, PreFac3B*GC[0]);
-
-         for(Mu=0; Mu<NumGradientComponents; Mu++)
-          { 
-            if (!GradB[Mu]) continue;
-            GradB[Mu]->AddEntry( X, Y,   PreFac1B*GradGC[2*Mu+0]);
-            GradB[Mu]->AddEntry( X, Y+1, PreFac2B*GradGC[2*Mu+1]);
-            if ( !Symmetric || (nea!=neb) )
-             GradB[Mu]->AddEntry( X+1, Y, PreFac2B*GradGC[2*Mu+1]);
-            GradB[Mu]->AddEntry( X+1, Y+1, PreFac3B*GradGC[2*Mu+0]);
-          };
-
-         for(Mu=0; Mu<NumTorqueAxes; Mu++)
-          { 
-            dBdTheta[Mu]->AddEntry( X, Y,   PreFac1B*dGCdT[2*Mu+0]);
-            dBdTheta[Mu]->AddEntry( X, Y+1, PreFac2B*dGCdT[2*Mu+1]);
-            if ( !Symmetric || (nea!=neb) )
-             dBdTheta[Mu]->AddEntry( X+1, Y, PreFac2B*dGCdT[2*Mu+1]);
-            dBdTheta[Mu]->AddEntry( X+1, Y+1, PreFac3B*dGCdT[2*Mu+0]);
-          };
+         StampEEIs(MediumTiles[1], GradBTiles, dBdThetaTiles, NumGradientComponents, NumTorqueAxes,
+                   X, Y, SaIsPEC, SbIsPEC, SkipLower, PreFacB, GC, GradGC, dGCdT);
        }; // if (EpsB!=0.0)
 
-    }; // for(nea=0; nea<NEa; nea++), for(neb=nebStart*nea; neb<NEb; neb++) ... 
+    }; // for(nea=neaTile; nea<neaTileStop; nea++), for(neb=nebStart*nea; neb<NEb; neb++) ...
+
+     /*--------------------------------------------------------------*/
+     /*- add the finished tile to the output matrices. tiles owned   */
+     /*- by different tasks cover disjoint sets of rows, so no       */
+     /*- locking is needed here.                                     */
+     /*--------------------------------------------------------------*/
+     BTile->Flush();
+     if (B2Tile) B2Tile->Flush();
+     for(Mu=0; Mu<NumGradientComponents; Mu++)
+      if (GradBTiles[Mu]) GradBTiles[Mu]->Flush();
+     for(Mu=0; Mu<NumTorqueAxes; Mu++)
+      dBdThetaTiles[Mu]->Flush();
+
+   }; // for(int neaTile=neaStart; neaTile<neaStop; neaTile+=TileEdges)
+
+  delete BTile;
+  if (B2Tile) delete B2Tile;
+  for(Mu=0; Mu<NumGradientComponents; Mu++)
+   if (GradBTiles[Mu]) delete GradBTiles[Mu];
+  for(Mu=0; Mu<NumTorqueAxes; Mu++)
+   delete dBdThetaTiles[Mu];
+  if (dBdThetaTiles) delete[] dBdThetaTiles;
 
   memcpy(TD->PPIAlgorithmCount, GetEEIArgs->PPIAlgorithmCount, NUMPPIALGORITHMS*sizeof(unsigned));
   return 0;
@@ -430,17 +879,16 @@ void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
   RWGSurface  *Sa = Args->Sa;
   RWGSurface  *Sb = Args->Sb;
 
-  /*--------------------------------------------------------------*/
-  /*- make sure the cached epsilon and mu values for all regions  */
-  /*- are up-to-date for the present frequency                    */
-  /*--------------------------------------------------------------*/
-  G->UpdateCachedEpsMuValues(Omega);
-
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
   /*--------------------------------------------------------------*/
+  if ( Args->B2 && (Args->GradB || Args->dBdTheta) )
+   ErrExit("%s:%i: B2 may not be combined with GradB or dBdTheta",__FILE__,__LINE__);
+
   if ( Args->Accumulate==false )
    { Args->B->ZeroBlock(Args->RowOffset, Sa->NumBFs, Args->ColOffset, Sb->NumBFs);
+     if (Args->B2)
+      Args->B2->ZeroBlock(Args->RowOffset, Sa->NumBFs, Args->ColOffset, Sb->NumBFs);
      if (Args->GradB && Args->GradB[0])
       Args->GradB[0]->ZeroBlock(Args->RowOffset, Sa->NumBFs, Args->ColOffset, Sb->NumBFs);
      if (Args->GradB && Args->GradB[1])
@@ -465,12 +913,16 @@ void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
   if (NumCommonRegions==0)
    return;
 
-  Args->EpsA  = G->EpsTF[ CommonRegions[0] ];
-  Args->MuA   = G->MuTF[  CommonRegions[0] ];
+  /*--------------------------------------------------------------*/
+  /*- note: epsilon and mu are evaluated here for this call only, */
+  /*- not read from the geometry's cached G->EpsTF, G->MuTF       */
+  /*- arrays, so that several threads may assemble BEM matrices   */
+  /*- for the same geometry at different frequencies at once.     */
+  /*--------------------------------------------------------------*/
+  G->RegionMPs[ CommonRegions[0] ]->GetEpsMu(Omega, &(Args->EpsA), &(Args->MuA));
   Args->SignA = Signs[0];
   if ( NumCommonRegions==2 )
-   { Args->EpsB = G->EpsTF[ CommonRegions[1] ];
-     Args->MuB  = G->MuTF[  CommonRegions[1] ];
+   { G->RegionMPs[ CommonRegions[1] ]->GetEpsMu(Omega, &(Args->EpsB), &(Args->MuB));
      Args->SignB = Signs[1];
    }
   else
@@ -494,11 +946,37 @@ void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
   /***************************************************************/
   /* fire off threads ********************************************/
   /***************************************************************/
-  GlobalFIPPICache.Hits=GlobalFIPPICache.Misses=0;
+  GlobalFIPPICache.ResetStatistics();
+
+  bool PanelPairMode =    UsePanelPairAssembly()
+                       && Args->GradB==0 && Args->NumTorqueAxes==0;
+
+  /*--------------------------------------------------------------*/
+  /*- for a surface interacting with itself, get the integrals of */
+  /*- the parent pairs of all classes of equivalent panel pairs   */
+  /*--------------------------------------------------------------*/
+  EquivalentPanelPairTable *EPPT=0;
+  cdouble *ParentH=0;
+  bool *ParentIsDistant=0;
+  if (     PanelPairMode && Sa==Sb && UsePanelPairDedup()
+       &&  Args->GBA1==0 && Args->GBA2==0 )
+   EPPT=GetEPPTable(G, Sa);
+  if (EPPT)
+   { cdouble k[2], PreFac[3];
+     GetGSSIPreFactors(Omega, Args->EpsA, Args->MuA, Args->SignA, k+0, PreFac);
+     k[1]=0.0;
+     if (Args->EpsB!=0.0)
+      GetGSSIPreFactors(Omega, Args->EpsB, Args->MuB, Args->SignB, k+1, PreFac);
+     GBarAccelerator *GBA[2]={Args->GBA1, Args->GBA2};
+     ParentH=GetParentPanelPairIntegrals(Args, EPPT, Args->EpsB!=0.0 ? 2 : 1, k, GBA,
+                                         &ParentIsDistant);
+     if (ParentH==0) EPPT=0;
+   };
 
   int nt, NumTasks, NumThreads = GetNumThreads();
   unsigned PPIAlgorithmCount[NUMPPIALGORITHMS];  
   memset(PPIAlgorithmCount, 0, NUMPPIALGORITHMS*sizeof(unsigned));
+  unsigned long PanelPairCounts[2]={0,0};
 
 #ifdef USE_PTHREAD
   ThreadData *TDs = new ThreadData[NumThreads], *TD;
@@ -509,15 +987,23 @@ void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
      TD->nt=nt;
      TD->NumTasks=NumThreads;
      TD->Args=Args;
+     TD->PanelPairMode=PanelPairMode;
+     TD->EPPT=EPPT;
+     TD->ParentH=ParentH;
+     TD->ParentIsDistant=ParentIsDistant;
      if (nt+1 == NumThreads)
        GSSIThread((void *)TD);
      else
        pthread_create( &(Threads[nt]), 0, GSSIThread, (void *)TD);
    }
-  for(nt=0; nt<NumThreads-1; nt++)
-   { pthread_join(Threads[nt],0);
+  for(nt=0; nt<NumThreads; nt++)
+   { if (nt+1 < NumThreads)
+      pthread_join(Threads[nt],0);
+     TD=&(TDs[nt]);
      for(int n=0; n<NUMPPIALGORITHMS; n++)
       PPIAlgorithmCount[n] += TD->PPIAlgorithmCount[n];
+     PanelPairCounts[0] += TD->PanelPairCounts[0];
+     PanelPairCounts[1] += TD->PanelPairCounts[1];
    };
   delete[] Threads;
   delete[] TDs;
@@ -541,14 +1027,26 @@ void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
      TD1.nt=nt;
      TD1.NumTasks=NumTasks;
      TD1.Args=Args;
+     TD1.PanelPairMode=PanelPairMode;
+     TD1.EPPT=EPPT;
+     TD1.ParentH=ParentH;
+     TD1.ParentIsDistant=ParentIsDistant;
      GSSIThread((void *)&TD1);
-     for(int n=0; n<NUMPPIALGORITHMS; n++)
-      PPIAlgorithmCount[n] += TD1.PPIAlgorithmCount[n];
+#ifdef USE_OPENMP
+#pragma omp critical(GSSICounts)
+#endif
+     { for(int n=0; n<NUMPPIALGORITHMS; n++)
+        PPIAlgorithmCount[n] += TD1.PPIAlgorithmCount[n];
+       PanelPairCounts[0] += TD1.PanelPairCounts[0];
+       PanelPairCounts[1] += TD1.PanelPairCounts[1];
+     };
    };
 #endif
 
   if (G->LogLevel>=SCUFF_VERBOSE2)
-   { Log("  %i/%i cache hits/misses",GlobalFIPPICache.Hits,GlobalFIPPICache.Misses);
+   { unsigned long Hits, Misses;
+     GlobalFIPPICache.GetStatistics(&Hits, &Misses);
+     Log("  %lu/%lu cache hits/misses",Hits,Misses);
      Log("  PPIs: LOC(%u), HOC(%u), TD(%u), HK(%u), D(%u)",
             PPIAlgorithmCount[PPIALG_LOCUBATURE],
             PPIAlgorithmCount[PPIALG_HOCUBATURE],
@@ -557,6 +1055,17 @@ void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
             PPIAlgorithmCount[PPIALG_DESING]);
    };
 
+  if (EPPT)
+   { unsigned long NumPairs=PanelPairCounts[0]+PanelPairCounts[1];
+     // each parent was computed once, up front
+     long NumSaved=((long)PanelPairCounts[1]) - EPPT->NumParents;
+     if (NumSaved<0) NumSaved=0;
+     Log(" surface %s: %li/%lu panel pairs (%.0f %%) saved by equivalent-pair reuse",
+          Sa->Label, NumSaved, NumPairs, NumPairs==0 ? 0.0 : 100.0*((double)NumSaved)/((double)NumPairs));
+     free(ParentH);
+     free(ParentIsDistant);
+   };
+
   /***************************************************************/
   /* 20120526 handle objects with finite surface conductivity    */
   /***************************************************************/
@@ -578,6 +1087,10 @@ void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args)
      for(int nr=1; nr<N; nr++)
       for(int nc=0; nc<nr; nc++)
        Args->B->SetEntry(nr,nc,Args->B->GetEntry(nc,nr));
+     if (Args->B2 && Args->B2->StorageType==LHM_NORMAL)
+      for(int nr=1; nr<N; nr++)
+       for(int nc=0; nc<nr; nc++)
+        Args->B2->SetEntry(nr,nc,Args->B2->GetEntry(nc,nr));
      if (G->LogLevel>=SCUFF_VERBOSE2)
       Log("...done with symmetry...");
    };
@@ -700,6 +1213,7 @@ void InitGetSSIArgs(GetSSIArgStruct *Args)
 
   Args->GradB=0;
   Args->dBdTheta=0;
+  Args->B2=0;
 
   Args->Accumulate=false;
 
@@ -0,0 +1,356 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * SweepSolver.cc -- block-diagonal factorization plus low-rank
+ *                -- (Sherman-Morrison-Woodbury) update for solving
+ *                -- the BEM system over geometrical-transformation
+ *                -- sweeps
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <libhmat.h>
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "SweepSolver.h"
+
+namespace scuff {
+
+/***************************************************************/
+/* adaptive cross approximation with partial pivoting of the   */
+/* dense MxN matrix B. On return, *pU and *pVT are the MxR and */
+/* RxN factors, or NULL if B vanishes identically.             */
+/***************************************************************/
+static void ACADenseBlock(HMatrix *B, double Tol, HMatrix **pU, HMatrix **pVT)
+{
+  int M=B->NR, N=B->NC;
+  int MaxRank = (M < N ? M : N);
+  std::vector<bool> RowUsed(M, false);
+  std::vector<cdouble> Us, Vs; // Us[k*M + m], Vs[k*N + n]
+  std::vector<cdouble> Row(N), Col(M);
+
+  double Norm2=0.0;
+  int Rank=0, iStar=0;
+  while( Rank<MaxRank )
+   {
+     /*--------------------------------------------------------------*/
+     /*- get residual of row iStar and choose column pivot          -*/
+     /*--------------------------------------------------------------*/
+     for(int n=0; n<N; n++)
+      Row[n] = B->GetEntry(iStar, n);
+     for(int k=0; k<Rank; k++)
+      { cdouble Uki = Us[k*M + iStar];
+        for(int n=0; n<N; n++)
+         Row[n] -= Uki*Vs[k*N + n];
+      };
+     RowUsed[iStar]=true;
+
+     int jStar=0;
+     for(int n=1; n<N; n++)
+      if ( abs(Row[n]) > abs(Row[jStar]) )
+       jStar=n;
+
+     if ( abs(Row[jStar])==0.0 )
+      { iStar=-1;
+        for(int m=0; m<M && iStar==-1; m++)
+         if (!RowUsed[m]) iStar=m;
+        if (iStar==-1) break;
+        continue;
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- get residual of column jStar                               -*/
+     /*--------------------------------------------------------------*/
+     cdouble Pivot=Row[jStar];
+     for(int n=0; n<N; n++)
+      Row[n]/=Pivot;
+     for(int m=0; m<M; m++)
+      Col[m] = B->GetEntry(m, jStar);
+     for(int k=0; k<Rank; k++)
+      { cdouble Vkj = Vs[k*N + jStar];
+        for(int m=0; m<M; m++)
+         Col[m] -= Vkj*Us[k*M + m];
+      };
+
+     /*--------------------------------------------------------------*/
+     /*- update the Frobenius norm of the approximant               -*/
+     /*--------------------------------------------------------------*/
+     double uu=0.0, vv=0.0;
+     for(int m=0; m<M; m++) uu+=norm(Col[m]);
+     for(int n=0; n<N; n++) vv+=norm(Row[n]);
+     cdouble Cross=0.0;
+     for(int k=0; k<Rank; k++)
+      { cdouble uku=0.0, vkv=0.0;
+        for(int m=0; m<M; m++) uku += conj(Us[k*M+m])*Col[m];
+        for(int n=0; n<N; n++) vkv += conj(Vs[k*N+n])*Row[n];
+        Cross += uku*vkv;
+      };
+     Norm2 += uu*vv + 2.0*real(Cross);
+
+     Us.insert(Us.end(), Col.begin(), Col.end());
+     Vs.insert(Vs.end(), Row.begin(), Row.end());
+     Rank++;
+
+     if ( sqrt(uu*vv) <= Tol*sqrt(fabs(Norm2)) )
+      break;
+
+     iStar=-1;
+     for(int m=0; m<M; m++)
+      if ( !RowUsed[m] && (iStar==-1 || abs(Col[m]) > abs(Col[iStar])) )
+       iStar=m;
+     if (iStar==-1) break;
+   };
+
+  if (Rank==0)
+   { *pU=*pVT=0;
+     return;
+   };
+
+  HMatrix *U  = new HMatrix(M, Rank, B->RealComplex);
+  HMatrix *VT = new HMatrix(Rank, N, B->RealComplex);
+  for(int k=0; k<Rank; k++)
+   { for(int m=0; m<M; m++)
+      U->SetEntry(m, k, Us[k*M + m]);
+     for(int n=0; n<N; n++)
+      VT->SetEntry(k, n, Vs[k*N + n]);
+   };
+  *pU=U;
+  *pVT=VT;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+SweepSolver::SweepSolver(RWGGeometry *_G, int _RealComplex,
+                         bool _AdjointLower, double _Tol)
+ : G(_G), RealComplex(_RealComplex), AdjointLower(_AdjointLower), Tol(_Tol)
+{
+  if (G->LDim>0)
+   ErrExit("sweep solver not supported for periodic geometries");
+  if (RWGGeometry::UseHRWGFunctions && G->NumMMJs>0)
+   ErrExit("sweep solver not supported for multi-material junctions");
+
+  CheckEnv("SCUFF_SWEEPSOLVER_TOL", &Tol);
+  if (Tol<=0.0) Tol=SWEEPSOLVER_DEFAULT_TOL;
+
+  N  = G->TotalBFs;
+  NS = G->NumSurfaces;
+  DLU    = (HMatrix **)mallocEC(NS*sizeof(HMatrix *));
+  OwnDLU = (bool *)mallocEC(NS*sizeof(bool));
+  R=0;
+  Y=Z=K=0;
+  Factorized=false;
+}
+
+SweepSolver::~SweepSolver()
+{
+  for(int ns=0; ns<NS; ns++)
+   if (OwnDLU[ns] && DLU[ns]) delete DLU[ns];
+  free(DLU);
+  free(OwnDLU);
+  if (Y) delete Y;
+  if (Z) delete Z;
+  if (K) delete K;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+void SweepSolver::SetTBlock(int ns, HMatrix *T, HMatrix *T2)
+{
+  if (OwnDLU[ns] && DLU[ns]) delete DLU[ns];
+  DLU[ns]=0;
+  OwnDLU[ns]=false;
+  Factorized=false;
+
+  int nsMate=G->Mate[ns];
+  if (nsMate!=-1)
+   { if (DLU[nsMate]==0)
+      ErrExit("%s:%i: T block %i set before its mate %i",__FILE__,__LINE__,ns,nsMate);
+     DLU[ns]=DLU[nsMate];
+     return;
+   };
+
+  int NBF=G->Surfaces[ns]->NumBFs;
+  DLU[ns] = new HMatrix(NBF, NBF, RealComplex);
+  DLU[ns]->InsertBlock(T, 0, 0);
+  if (T2) DLU[ns]->AddBlock(T2, 0, 0);
+  OwnDLU[ns]=true;
+  Log(" SweepSolver: LU-factorizing T%i (%ix%i)",ns+1,NBF,NBF);
+  if (DLU[ns]->LUFactorize())
+   Warn("LU factorization of T%i failed",ns+1);
+}
+
+void SweepSolver::SetTBlocks(HMatrix **TBlocks)
+{
+  for(int ns=0; ns<NS; ns++)
+   SetTBlock(ns, TBlocks[ns]);
+}
+
+/***************************************************************/
+/* replace X with D^{-1} X by block-wise solves                */
+/***************************************************************/
+static void SolveDiagonal(RWGGeometry *G, HMatrix **DLU, HMatrix *X)
+{
+  for(int ns=0; ns<G->NumSurfaces; ns++)
+   { int Offset=G->BFIndexOffset[ns];
+     int NBF=G->Surfaces[ns]->NumBFs;
+     HMatrix *XS = new HMatrix(NBF, X->NC, X->RealComplex);
+     X->ExtractBlock(Offset, 0, XS);
+     DLU[ns]->LUSolve(XS);
+     X->InsertBlock(XS, Offset, 0);
+     delete XS;
+   };
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int SweepSolver::Factorize(HMatrix **UBlocks)
+{
+  double Time0=Secs();
+  for(int ns=0; ns<NS; ns++)
+   if (DLU[ns]==0)
+    ErrExit("%s:%i: Factorize called before T block %i was set",__FILE__,__LINE__,ns);
+
+  /*--------------------------------------------------------------*/
+  /*- compress the above-diagonal blocks --------------------------*/
+  /*--------------------------------------------------------------*/
+  int NumBlocks=NS*(NS-1)/2;
+  std::vector<HMatrix *> P(NumBlocks), QT(NumBlocks);
+  int NewR=0;
+  for(int nb=0, ns=0; ns<NS; ns++)
+   for(int nsp=ns+1; nsp<NS; nsp++, nb++)
+    { ACADenseBlock(UBlocks[nb], Tol, &(P[nb]), &(QT[nb]));
+      int Rank = P[nb] ? P[nb]->NC : 0;
+      Log(" SweepSolver: U(%i,%i) has rank %i (%ix%i)",
+            ns+1,nsp+1,Rank,UBlocks[nb]->NR,UBlocks[nb]->NC);
+      NewR += 2*Rank;
+    };
+
+  /*--------------------------------------------------------------*/
+  /*- assemble the factors W and Z of the off-diagonal part; each -*/
+  /*- block contributes P*QT above the diagonal and its transpose -*/
+  /*- (adjoint) QT^T*P^T below.                                   -*/
+  /*--------------------------------------------------------------*/
+  if (Y) delete Y;
+  if (Z) delete Z;
+  if (K) delete K;
+  Y=Z=K=0;
+  R=NewR;
+  if (R>0)
+   { Y = new HMatrix(N, R, RealComplex);
+     Z = new HMatrix(R, N, RealComplex);
+     int Col=0;
+     for(int nb=0, ns=0; ns<NS; ns++)
+      for(int nsp=ns+1; nsp<NS; nsp++, nb++)
+       { if (P[nb]==0) continue;
+         int Rank=P[nb]->NC;
+         int Offset=G->BFIndexOffset[ns], OffsetP=G->BFIndexOffset[nsp];
+         Y->InsertBlock(P[nb], Offset, Col);
+         Z->InsertBlock(QT[nb], Col, OffsetP);
+         Col+=Rank;
+         if (AdjointLower)
+          { Y->InsertBlockAdjoint(QT[nb], OffsetP, Col);
+            Z->InsertBlockAdjoint(P[nb], Col, Offset);
+          }
+         else
+          { Y->InsertBlockTranspose(QT[nb], OffsetP, Col);
+            Z->InsertBlockTranspose(P[nb], Col, Offset);
+          };
+         Col+=Rank;
+       };
+
+     /*--------------------------------------------------------------*/
+     /*- Y = D^{-1} W, K = 1 + Z*Y ----------------------------------*/
+     /*--------------------------------------------------------------*/
+     SolveDiagonal(G, DLU, Y);
+     K = new HMatrix(R, R, RealComplex);
+     Z->Multiply(Y, K);
+     for(int r=0; r<R; r++)
+      K->AddEntry(r, r, 1.0);
+   };
+
+  for(int nb=0; nb<NumBlocks; nb++)
+   { if (P[nb])  delete P[nb];
+     if (QT[nb]) delete QT[nb];
+   };
+
+  int Info = K ? K->LUFactorize() : 0;
+  Factorized=true;
+  Log(" SweepSolver: factorized %ix%i capacitance matrix (N=%i) in %.1f s",R,R,N,Secs()-Time0);
+  return Info;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int SweepSolver::LUSolve(HMatrix *X)
+{
+  if (!Factorized)
+   ErrExit("%s:%i: LUSolve called before Factorize",__FILE__,__LINE__);
+  if (X->NR!=N || X->RealComplex!=RealComplex)
+   ErrExit("%s:%i: invalid matrix passed to LUSolve",__FILE__,__LINE__);
+
+  SolveDiagonal(G, DLU, X);
+  if (R==0)
+   return 0;
+
+  HMatrix *ZX = new HMatrix(R, X->NC, RealComplex);
+  Z->Multiply(X, ZX);
+  K->LUSolve(ZX);
+  HMatrix *YZX = new HMatrix(N, X->NC, RealComplex);
+  Y->Multiply(ZX, YZX);
+  X->Add(YZX, -1.0);
+  delete YZX;
+  delete ZX;
+  return 0;
+}
+
+int SweepSolver::LUSolve(HVector *X)
+{
+  if (X->RealComplex!=RealComplex)
+   ErrExit("%s:%i: invalid vector passed to LUSolve",__FILE__,__LINE__);
+  if (RealComplex==LHM_COMPLEX)
+   { HMatrix XMatrix(X->N, 1, X->ZV);
+     return LUSolve(&XMatrix);
+   };
+  HMatrix XMatrix(X->N, 1, X->DV);
+  return LUSolve(&XMatrix);
+}
+
+/***************************************************************/
+/* log |det M| - \sum_s log |det T_s| = log |det K|            */
+/***************************************************************/
+double SweepSolver::GetLogDetRatio()
+{
+  if (!Factorized)
+   ErrExit("%s:%i: GetLogDetRatio called before Factorize",__FILE__,__LINE__);
+  double LogDet=0.0;
+  for(int r=0; r<R; r++)
+   LogDet += log( abs(K->GetEntry(r,r)) );
+  return LogDet;
+}
+
+} // namespace scuff
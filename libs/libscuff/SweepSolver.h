@@ -0,0 +1,109 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * SweepSolver.h -- direct solver for the BEM system that reuses the
+ *               -- factorizations of the diagonal blocks over a
+ *               -- sweep of geometrical transformations
+ */
+
+#ifndef SWEEP_SOLVER_H
+#define SWEEP_SOLVER_H
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#include <libhmat.h>
+
+namespace scuff {
+
+class RWGGeometry; // forward declaration
+
+#define SWEEPSOLVER_DEFAULT_TOL 1.0e-8
+
+/***************************************************************/
+/* A SweepSolver solves the BEM system for a geometry whose    */
+/* matrix is split into diagonal blocks T_s (one per surface), */
+/* which do not change under geometrical transformations, and  */
+/* off-diagonal blocks U_{st}, which do.                       */
+/*                                                             */
+/* SetTBlocks() LU-factorizes the T blocks, which need only be */
+/* done once per frequency. Factorize() then compresses each   */
+/* above-diagonal block by adaptive cross approximation (ACA)  */
+/* with relative tolerance Tol, U_{st} = P_{st} Q_{st}, so the */
+/* full matrix is M = D + W*Z with D=diag(T_s) and W, Z of     */
+/* width R = twice the total rank of the U blocks. The blocks  */
+/* below the diagonal are the transposes of those above it, or */
+/* the adjoints if AdjointLower is true (which matches the way */
+/* the caller stamps blocks into a dense matrix).              */
+/*                                                             */
+/* LUSolve() then uses the Sherman-Morrison-Woodbury formula   */
+/*  M^{-1} = D^{-1} - D^{-1} W K^{-1} Z D^{-1},                */
+/*  K      = 1 + Z D^{-1} W,                                   */
+/* so each new transformation costs only the solves with the   */
+/* already-factorized T blocks and the factorization of the    */
+/* RxR matrix K (the Schur complement of the coupling), rather */
+/* than a full O(N^3) factorization. Since det M = det D det K,*/
+/* GetLogDetRatio() returns log |det M / prod_s det T_s| at    */
+/* no further cost.                                            */
+/***************************************************************/
+class SweepSolver
+ {
+public:
+   SweepSolver(RWGGeometry *G, int RealComplex=LHM_COMPLEX,
+               bool AdjointLower=false, double Tol=SWEEPSOLVER_DEFAULT_TOL);
+   ~SweepSolver();
+
+   // LU-factorize the diagonal block for surface ns, which is
+   // T, plus T2 if T2 is non-null. Surfaces with a mate reuse
+   // the factorization of their mate, which must be set first.
+   void SetTBlock(int ns, HMatrix *T, HMatrix *T2=0);
+   void SetTBlocks(HMatrix **TBlocks);
+
+   // compress the above-diagonal blocks, ordered as
+   // (0,1), (0,2), ..., (0,NS-1), (1,2), ..., and factorize K
+   int Factorize(HMatrix **UBlocks);
+
+   int LUSolve(HMatrix *X);
+   int LUSolve(HVector *X);
+
+   double GetLogDetRatio();
+
+   // R, the number of columns of W
+   int GetRank() { return R; }
+
+// private data fields
+// private:
+   RWGGeometry *G;
+   int N, NS, RealComplex;
+   bool AdjointLower;
+   double Tol;
+
+   HMatrix **DLU;   // DLU[ns] = LU factorization of T block
+   bool *OwnDLU;
+   int R;
+   HMatrix *Y;      // D^{-1} W   (N x R)
+   HMatrix *Z;      //            (R x N)
+   HMatrix *K;      // LU-factorized capacitance matrix
+   bool Factorized;
+ };
+
+} // namespace scuff
+#endif // #ifndef SWEEP_SOLVER_H
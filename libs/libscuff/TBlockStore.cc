@@ -0,0 +1,590 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * TBlockStore.cc -- persistent on-disk store of diagonal BEM matrix
+ *                -- blocks, shared between processes
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <libhrutil.h>
+
+#include "libscuff.h"
+#include "TBlockStore.h"
+#include "StoreFile.h"
+
+namespace scuff {
+
+long JenkinsHash(const char *key, size_t len); // in FIBBICache.cc
+
+/***************************************************************/
+/* in-memory index entry for one record in a container         */
+/***************************************************************/
+typedef struct TBSEntry
+ { TBSRecordHeader Header;
+   off_t Offset;     // of the record header within the file
+   bool Bad;         // true if the data failed checksum validation
+ } TBSEntry;
+
+/***************************************************************/
+/* one container file                                          */
+/***************************************************************/
+typedef struct TBlockStore
+ { char *FileName;
+   int fd;
+   bool ReadOnly, Disabled;
+   uint32_t NumBFs;
+   uint64_t MeshHash;
+   off_t ScannedSize;  // end of the last valid record we know about
+   std::vector<TBSEntry> Entries;
+   unsigned long Hits, Interpolated, Misses, Writes, Evicted;
+ } TBlockStore;
+
+static std::map<std::string, TBlockStore *> TBlockStores;
+
+/***************************************************************/
+/* utility routines ********************************************/
+/***************************************************************/
+static bool SameFloat(double x, double y)
+{ return x==y || fabs(x-y) <= 1.0e-12*fmax(fabs(x),fabs(y)); }
+
+static bool SameKey(const TBSRecordHeader *H1, const TBSRecordHeader *H2,
+                    bool CompareOmega)
+{
+  return    H1->RealComplex  == H2->RealComplex
+         && H1->Flags        == H2->Flags
+         && H1->MaterialHash == H2->MaterialHash
+         && H1->DataSize     == H2->DataSize
+         && SameFloat(H1->kBloch[0], H2->kBloch[0])
+         && SameFloat(H1->kBloch[1], H2->kBloch[1])
+         && (    !CompareOmega
+              || (    SameFloat(H1->Omega[0], H2->Omega[0])
+                   && SameFloat(H1->Omega[1], H2->Omega[1])
+                 )
+            );
+}
+
+static uint64_t GetMeshHash(RWGSurface *S)
+{
+  double TotalArea=0.0;
+  for(int np=0; np<S->NumPanels; np++)
+   TotalArea+=S->Panels[np]->Area;
+  char Str[200];
+  snprintf(Str,200,"%i %i %i %i %.8e",
+           S->NumVertices, S->NumPanels, S->NumEdges, S->NumBFs, TotalArea);
+  return (uint64_t)JenkinsHash(Str, strlen(Str));
+}
+
+/***************************************************************/
+/* (re)open the container file, writing a new header if the    */
+/* file is empty, or validating the existing header otherwise. */
+/***************************************************************/
+static void OpenContainer(TBlockStore *TBS)
+{
+  TBS->Entries.clear();
+  TBS->ScannedSize=sizeof(TBSHeader);
+
+  TBSHeader Header;
+  memset(&Header, 0, sizeof(Header));
+  strncpy(Header.Common.Signature, TBS_SIGNATURE, sizeof(Header.Common.Signature)-1);
+  Header.Common.Version   = TBS_VERSION;
+  Header.Common.ByteOrder = TBS_BYTEORDER;
+  Header.NumBFs           = TBS->NumBFs;
+  Header.MeshHash         = TBS->MeshHash;
+  TBS->fd=OpenStoreFile(TBS->FileName, "T-block store", TBS->ReadOnly,
+                        &Header, sizeof(Header));
+  if (TBS->fd<0)
+   { TBS->Disabled=true;
+     return;
+   };
+
+  if ( Header.NumBFs!=TBS->NumBFs || Header.MeshHash!=TBS->MeshHash )
+   { Warn("T-block store %s: file was written for a different mesh (disabling)",
+           TBS->FileName);
+     close(TBS->fd);
+     TBS->fd=-1;
+     TBS->Disabled=true;
+   };
+}
+
+/***************************************************************/
+/* callbacks for ScanStoreRecords; the data of each record are */
+/* only read (and checksummed) when the record is used         */
+/***************************************************************/
+static uint64_t RecordDataSize(const void *Header)
+{ return ((const TBSRecordHeader *)Header)->DataSize; }
+
+static bool AddEntry(void *UserData, void *RecordHeader, off_t Offset)
+{
+  TBlockStore *TBS=(TBlockStore *)UserData;
+  TBSEntry E;
+  E.Header = *((TBSRecordHeader *)RecordHeader);
+  E.Offset = Offset;
+  E.Bad    = false;
+  TBS->Entries.push_back(E);
+  return true;
+}
+
+/***************************************************************/
+/* bring the in-memory index up to date with the file, which   */
+/* may have been appended to or replaced by other processes.   */
+/* must be called with a lock held. returns the size of the    */
+/* file, which exceeds TBS->ScannedSize if the last record is  */
+/* incomplete.                                                 */
+/***************************************************************/
+static off_t RefreshIndex(TBlockStore *TBS)
+{
+  struct stat PathStat, FDStat;
+  if (    stat(TBS->FileName, &PathStat)==0
+       && fstat(TBS->fd, &FDStat)==0
+       && PathStat.st_ino!=FDStat.st_ino
+     )
+   { // the file was compacted and replaced by another process
+     short LockType = TBS->ReadOnly ? F_RDLCK : F_WRLCK;
+     close(TBS->fd);
+     OpenContainer(TBS);
+     if (TBS->Disabled) return 0;
+     LockFile(TBS->fd, LockType);
+   };
+
+  return ScanStoreRecords(TBS->fd, &(TBS->ScannedSize), TBS_MAGIC, sizeof(TBSRecordHeader),
+                          RecordDataSize, AddEntry, (void *)TBS);
+}
+
+/***************************************************************/
+/* fetch (creating if necessary) the store for surface #ns     */
+/***************************************************************/
+static TBlockStore *GetTBlockStore(RWGGeometry *G, int ns, bool ForWriting)
+{
+  char *Dir = getenv("SCUFF_TBLOCK_PATH");
+  bool ReadOnly=false;
+  if (Dir==0)
+   { Dir = getenv("SCUFF_TBLOCK_READPATH");
+     ReadOnly=true;
+   };
+  if (Dir==0 || (ReadOnly && ForWriting))
+   return 0;
+
+  RWGSurface *S=G->Surfaces[ns];
+  char *FileBase=GetFileBase(S->MeshFileName);
+  char *FileName;
+  if (S->MeshTag != -1)
+   FileName=vstrdup("%s/%s_%i.tblocks",Dir,FileBase,S->MeshTag);
+  else
+   FileName=vstrdup("%s/%s.tblocks",Dir,FileBase);
+
+  std::string Key(FileName);
+  if (TBlockStores.count(Key))
+   { free(FileName);
+     TBlockStore *TBS=TBlockStores[Key];
+     return TBS->Disabled ? 0 : TBS;
+   };
+
+  TBlockStore *TBS = new TBlockStore;
+  TBS->FileName=FileName;
+  TBS->ReadOnly=ReadOnly;
+  TBS->Disabled=false;
+  TBS->NumBFs=S->NumBFs;
+  TBS->MeshHash=GetMeshHash(S);
+  TBS->Hits=TBS->Interpolated=TBS->Misses=TBS->Writes=TBS->Evicted=0;
+  OpenContainer(TBS);
+  TBlockStores[Key]=TBS;
+  return TBS->Disabled ? 0 : TBS;
+}
+
+/***************************************************************/
+/* the part of the record key other than the frequency         */
+/***************************************************************/
+static void InitRecordHeader(RWGGeometry *G, int ns, cdouble Omega,
+                             double *kBloch, int RealComplex,
+                             TBSRecordHeader *H)
+{
+  memset(H, 0, sizeof(*H));
+  H->Magic=TBS_MAGIC;
+  H->RealComplex=RealComplex;
+
+  RWGSurface *S=G->Surfaces[ns];
+  int nr1=S->RegionIndices[0];
+  int nr2=S->RegionIndices[1];
+  if (G->RegionMPs[nr1]->Zeroed)
+   H->Flags |= TBS_EXTERIOR_ZEROED;
+  if (nr2!=-1 && G->RegionMPs[nr2]->Zeroed)
+   H->Flags |= TBS_INTERIOR_ZEROED;
+
+  char MatStr[200];
+  snprintf(MatStr,200,"%s|%s",G->RegionMPs[nr1]->Name,
+                              nr2==-1 ? "PEC" : G->RegionMPs[nr2]->Name);
+  H->MaterialHash=(uint64_t)JenkinsHash(MatStr, strlen(MatStr));
+
+  H->Omega[0]=real(Omega);
+  H->Omega[1]=imag(Omega);
+  if (G->LDim>=1) H->kBloch[0]=kBloch[0];
+  if (G->LDim>=2) H->kBloch[1]=kBloch[1];
+
+  size_t NBF=S->NumBFs;
+  H->DataSize = NBF*NBF*(RealComplex==LHM_COMPLEX ? sizeof(cdouble) : sizeof(double));
+}
+
+/***************************************************************/
+/* read and validate the data for one record; must be called   */
+/* with a lock held                                            */
+/***************************************************************/
+static bool ReadRecordData(TBlockStore *TBS, TBSEntry *E, void *Buffer)
+{
+  if (E->Bad) return false;
+  off_t DataOffset = E->Offset + sizeof(TBSRecordHeader);
+  size_t DataSize  = E->Header.DataSize;
+  if (    pread(TBS->fd, Buffer, DataSize, DataOffset) != (ssize_t)DataSize
+       || HashBytes(Buffer, DataSize) != E->Header.Checksum
+     )
+   { Warn("T-block store %s: record at frequency %s failed validation (ignoring)",
+           TBS->FileName,z2s(cdouble(E->Header.Omega[0],E->Header.Omega[1])));
+     E->Bad=true;
+     return false;
+   };
+  return true;
+}
+
+static void TouchRecord(TBlockStore *TBS, TBSEntry *E)
+{
+  if (TBS->ReadOnly) return;
+  E->Header.LastUsed=(uint64_t)time(0);
+  off_t Offset = E->Offset + offsetof(TBSRecordHeader, LastUsed);
+  if ( pwrite(TBS->fd, &(E->Header.LastUsed), sizeof(uint64_t), Offset)!=sizeof(uint64_t) )
+   Warn("T-block store %s: could not update record",TBS->FileName);
+}
+
+static void LogStatistics(TBlockStore *TBS, const char *What)
+{
+  Log("T-block store %s: %s (%lu hits, %lu interpolated, %lu misses, %lu writes, %lu evicted)",
+       TBS->FileName,What,TBS->Hits,TBS->Interpolated,TBS->Misses,TBS->Writes,TBS->Evicted);
+}
+
+/***************************************************************/
+/* look for two records of the same key at frequencies Omega1, */
+/* Omega2 such that Omega lies on the line segment between     */
+/* them, with |Omega2-Omega1| <= InterpTol*|Omega|; if there   */
+/* are several such pairs, choose the closest.                 */
+/***************************************************************/
+static bool FindInterpolationPair(TBlockStore *TBS, TBSRecordHeader *Key,
+                                  double InterpTol, int *i1, int *i2, double *w)
+{
+  cdouble Omega(Key->Omega[0], Key->Omega[1]);
+  double MaxSep = InterpTol*abs(Omega);
+  double BestSep=HUGE_VAL;
+  int NE=TBS->Entries.size();
+  for(int n1=0; n1<NE; n1++)
+   { TBSEntry *E1=&(TBS->Entries[n1]);
+     if ( E1->Bad || !SameKey(&(E1->Header), Key, false) ) continue;
+     cdouble Omega1(E1->Header.Omega[0], E1->Header.Omega[1]);
+     for(int n2=n1+1; n2<NE; n2++)
+      { TBSEntry *E2=&(TBS->Entries[n2]);
+        if ( E2->Bad || !SameKey(&(E2->Header), Key, false) ) continue;
+        cdouble Omega2(E2->Header.Omega[0], E2->Header.Omega[1]);
+        double Sep=abs(Omega2-Omega1);
+        if ( Sep==0.0 || Sep>MaxSep || Sep>=BestSep ) continue;
+        double d1=abs(Omega-Omega1), d2=abs(Omega2-Omega);
+        if ( d1+d2 > Sep*(1.0+1.0e-10) ) continue; // not between them
+        BestSep=Sep;
+        *i1=n1;
+        *i2=n2;
+        *w=d1/Sep;
+      };
+   };
+  return BestSep<HUGE_VAL;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+static bool ReadTBlock0(RWGGeometry *G, int ns, cdouble Omega, double *kBloch,
+                        HMatrix *M, int RowOffset, int ColOffset)
+{
+  TBlockStore *TBS=GetTBlockStore(G, ns, false);
+  if (!TBS) return false;
+
+  int NBF=G->Surfaces[ns]->NumBFs;
+  TBSRecordHeader Key;
+  InitRecordHeader(G, ns, Omega, kBloch, M->RealComplex, &Key);
+
+  double InterpTol=0.0;
+  CheckEnv("SCUFF_TBLOCK_INTERPTOL", &InterpTol);
+
+  /*--------------------------------------------------------------*/
+  /*- read directly into M if we can, otherwise into a temporary  */
+  /*--------------------------------------------------------------*/
+  HMatrix *B=0;
+  if (    RowOffset==0 && ColOffset==0 && M->NR==NBF && M->NC==NBF
+       && M->StorageType==LHM_NORMAL
+     )
+   B=M;
+  else
+   B=new HMatrix(NBF, NBF, M->RealComplex);
+  void *Buffer = (M->RealComplex==LHM_COMPLEX) ? ((void *)B->ZM) : ((void *)B->DM);
+
+  LockFile(TBS->fd, TBS->ReadOnly ? F_RDLCK : F_WRLCK);
+  RefreshIndex(TBS);
+  if (TBS->Disabled)
+   { if (B!=M) delete B;
+     return false;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- exact match ------------------------------------------------*/
+  /*--------------------------------------------------------------*/
+  bool Success=false;
+  const char *What="miss";
+  for(size_t n=0; n<TBS->Entries.size() && !Success; n++)
+   { TBSEntry *E=&(TBS->Entries[n]);
+     if ( !SameKey(&(E->Header), &Key, true) ) continue;
+     if ( (Success=ReadRecordData(TBS, E, Buffer)) )
+      { TouchRecord(TBS, E);
+        TBS->Hits++;
+        What="hit";
+      };
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- interpolation between neighboring frequencies --------------*/
+  /*--------------------------------------------------------------*/
+  int i1=0, i2=0;
+  double w=0.0;
+  if ( !Success && InterpTol>0.0
+       && FindInterpolationPair(TBS, &Key, InterpTol, &i1, &i2, &w)
+     )
+   { HMatrix *B2=new HMatrix(NBF, NBF, M->RealComplex);
+     void *Buffer2 = (M->RealComplex==LHM_COMPLEX) ? ((void *)B2->ZM) : ((void *)B2->DM);
+     TBSEntry *E1=&(TBS->Entries[i1]), *E2=&(TBS->Entries[i2]);
+     if ( ReadRecordData(TBS, E1, Buffer) && ReadRecordData(TBS, E2, Buffer2) )
+      { size_t N2=((size_t)NBF)*NBF;
+        if (M->RealComplex==LHM_COMPLEX)
+         for(size_t n=0; n<N2; n++)
+          B->ZM[n] = (1.0-w)*B->ZM[n] + w*B2->ZM[n];
+        else
+         for(size_t n=0; n<N2; n++)
+          B->DM[n] = (1.0-w)*B->DM[n] + w*B2->DM[n];
+        TouchRecord(TBS, E1);
+        TouchRecord(TBS, E2);
+        TBS->Interpolated++;
+        Success=true;
+        What="interpolated";
+      };
+     delete B2;
+   };
+
+  LockFile(TBS->fd, F_UNLCK);
+
+  if (!Success)
+   TBS->Misses++;
+  else if (B!=M)
+   M->InsertBlock(B, RowOffset, ColOffset);
+  if (B!=M) delete B;
+
+  char WhatStr[100];
+  snprintf(WhatStr,100,"%s at Omega=%s",What,z2s(Omega));
+  LogStatistics(TBS, WhatStr);
+  return Success;
+}
+
+static bool MoreRecentlyUsed(const TBSEntry &E1, const TBSEntry &E2)
+{ return E1.Header.LastUsed > E2.Header.LastUsed; }
+
+/***************************************************************/
+/* rewrite the container keeping only the most recently used   */
+/* records whose total size fits within MaxSize. must be called*/
+/* with an exclusive lock held; on return the lock is held on  */
+/* the new file, and the return value is its size (FileSize,   */
+/* the size of the old file, if compaction failed).            */
+/***************************************************************/
+static off_t CompactContainer(TBlockStore *TBS, off_t MaxSize, off_t FileSize)
+{
+  std::vector<TBSEntry> Keep;
+  for(size_t n=0; n<TBS->Entries.size(); n++)
+   if (!TBS->Entries[n].Bad)
+    Keep.push_back(TBS->Entries[n]);
+
+  std::stable_sort(Keep.begin(), Keep.end(), MoreRecentlyUsed);
+
+  off_t Size=sizeof(TBSHeader);
+  size_t NumKeep=0;
+  while( NumKeep<Keep.size()
+         && Size + (off_t)(sizeof(TBSRecordHeader) + Keep[NumKeep].Header.DataSize) <= MaxSize
+       )
+   Size += sizeof(TBSRecordHeader) + Keep[NumKeep++].Header.DataSize;
+
+  char *TmpFileName=vstrdup("%s.tmp%i",TBS->FileName,(int)getpid());
+  int fdNew=open(TmpFileName, O_RDWR|O_CREAT|O_TRUNC, 0664);
+  bool Failed = (fdNew<0);
+
+  TBSHeader Header;
+  if (!Failed)
+   Failed = (    pread(TBS->fd, &Header, sizeof(Header), 0) != sizeof(Header)
+              || pwrite(fdNew, &Header, sizeof(Header), 0) != sizeof(Header) );
+
+  off_t Offset=sizeof(TBSHeader);
+  std::vector<char> Record;
+  for(size_t n=0; !Failed && n<NumKeep; n++)
+   { size_t RecordSize = sizeof(TBSRecordHeader) + Keep[n].Header.DataSize;
+     Record.resize(RecordSize);
+     Failed = (    pread(TBS->fd, &(Record[0]), RecordSize, Keep[n].Offset) != (ssize_t)RecordSize
+                || pwrite(fdNew, &(Record[0]), RecordSize, Offset) != (ssize_t)RecordSize );
+     Offset+=RecordSize;
+   };
+  if (fdNew>=0 && close(fdNew)) Failed=true;
+
+  if ( Failed || rename(TmpFileName, TBS->FileName) )
+   { Warn("T-block store %s: could not compact file",TBS->FileName);
+     unlink(TmpFileName);
+     free(TmpFileName);
+     return FileSize;
+   };
+  free(TmpFileName);
+
+  TBS->Evicted += TBS->Entries.size() - NumKeep;
+  Log("T-block store %s: evicted %lu least-recently-used records",
+       TBS->FileName, (unsigned long)(TBS->Entries.size() - NumKeep));
+
+  // switch to the new file; this drops our lock on the old one,
+  // after which any process waiting on it will notice that the
+  // file has been replaced and reopen it
+  close(TBS->fd);
+  OpenContainer(TBS);
+  if (TBS->Disabled) return 0;
+  LockFile(TBS->fd, F_WRLCK);
+  return RefreshIndex(TBS);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+static void WriteTBlock0(RWGGeometry *G, int ns, cdouble Omega, double *kBloch,
+                         HMatrix *M, int RowOffset, int ColOffset)
+{
+  TBlockStore *TBS=GetTBlockStore(G, ns, true);
+  if (!TBS) return;
+
+  int NBF=G->Surfaces[ns]->NumBFs;
+  TBSRecordHeader Header;
+  InitRecordHeader(G, ns, Omega, kBloch, M->RealComplex, &Header);
+
+  HMatrix *B=0;
+  if (    RowOffset==0 && ColOffset==0 && M->NR==NBF && M->NC==NBF
+       && M->StorageType==LHM_NORMAL
+     )
+   B=M;
+  else
+   { B=new HMatrix(NBF, NBF, M->RealComplex);
+     M->ExtractBlock(RowOffset, ColOffset, B);
+   };
+  void *Buffer = (M->RealComplex==LHM_COMPLEX) ? ((void *)B->ZM) : ((void *)B->DM);
+  Header.Checksum=HashBytes(Buffer, Header.DataSize);
+  Header.LastUsed=(uint64_t)time(0);
+
+  LockFile(TBS->fd, F_WRLCK);
+  off_t FileSize=RefreshIndex(TBS);
+  if (TBS->Disabled)
+   { if (B!=M) delete B;
+     return;
+   };
+
+  /*--------------------------------------------------------------*/
+  /*- another process may have beaten us to it -------------------*/
+  /*--------------------------------------------------------------*/
+  bool Exists=false;
+  for(size_t n=0; n<TBS->Entries.size() && !Exists; n++)
+   Exists = !TBS->Entries[n].Bad && SameKey(&(TBS->Entries[n].Header), &Header, true);
+
+  /*--------------------------------------------------------------*/
+  /*- make room if the new record would exceed the size limit     */
+  /*--------------------------------------------------------------*/
+  off_t RecordSize = sizeof(TBSRecordHeader) + Header.DataSize;
+  int MaxSizeMB=0;
+  CheckEnv("SCUFF_TBLOCK_MAXSIZE", &MaxSizeMB);
+  off_t MaxSize = ((off_t)MaxSizeMB) << 20;
+  if ( !Exists && MaxSize>0 && TBS->ScannedSize + RecordSize > MaxSize )
+   FileSize=CompactContainer(TBS, MaxSize - RecordSize, FileSize);
+
+  /*--------------------------------------------------------------*/
+  /*- append the new record, discarding any incomplete record     */
+  /*- left by an interrupted writer                               */
+  /*--------------------------------------------------------------*/
+  bool Written=false;
+  if (!Exists && !TBS->Disabled)
+   { off_t Offset=TBS->ScannedSize;
+     if ( AppendStoreRecord(TBS->fd, TBS->FileName, "T-block store",
+                            FileSize, &(TBS->ScannedSize),
+                            &Header, sizeof(Header), Buffer, Header.DataSize)
+        )
+      { AddEntry((void *)TBS, (void *)&Header, Offset);
+        TBS->Writes++;
+        Written=true;
+      };
+   };
+
+  if (!TBS->Disabled)
+   LockFile(TBS->fd, F_UNLCK);
+  if (B!=M) delete B;
+
+  char WhatStr[100];
+  snprintf(WhatStr,100,"%s at Omega=%s",Written ? "wrote" : "already present",z2s(Omega));
+  LogStatistics(TBS, WhatStr);
+}
+
+/***************************************************************/
+/* The store keeps its index in memory, so the entry points    */
+/* are serialized when matrix blocks are being assembled for   */
+/* several kBloch points concurrently.                         */
+/***************************************************************/
+bool ReadTBlock(RWGGeometry *G, int ns, cdouble Omega, double *kBloch,
+                HMatrix *M, int RowOffset, int ColOffset)
+{
+  bool Success;
+#ifdef USE_OPENMP
+#pragma omp critical(TBlockStore)
+#endif
+  Success=ReadTBlock0(G, ns, Omega, kBloch, M, RowOffset, ColOffset);
+  return Success;
+}
+
+void WriteTBlock(RWGGeometry *G, int ns, cdouble Omega, double *kBloch,
+                 HMatrix *M, int RowOffset, int ColOffset)
+{
+#ifdef USE_OPENMP
+#pragma omp critical(TBlockStore)
+#endif
+  WriteTBlock0(G, ns, Omega, kBloch, M, RowOffset, ColOffset);
+}
+
+} // namespace scuff
@@ -0,0 +1,110 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * TBlockStore.h -- persistent on-disk store of diagonal BEM matrix
+ *               -- blocks ('T-blocks'), one container file per mesh
+ */
+#ifndef TBLOCKSTORE_H
+#define TBLOCKSTORE_H
+
+#include <stdint.h>
+#include <libhmat.h>
+
+#include "StoreFile.h"
+
+namespace scuff {
+
+class RWGGeometry;
+
+/***************************************************************/
+/* The store is enabled by setting SCUFF_TBLOCK_PATH (read and */
+/* write) or SCUFF_TBLOCK_READPATH (read only) to a directory. */
+/* All T-blocks for a given mesh live in a single container    */
+/* file, MeshName[_MeshTag].tblocks, in that directory:        */
+/*                                                             */
+/*  TBSHeader         (64 bytes; identifies the mesh)          */
+/*  record 0:  TBSRecordHeader, then DataSize bytes of matrix  */
+/*  record 1:  ...                                             */
+/*                                                             */
+/* Records are only ever appended (under an exclusive POSIX    */
+/* record lock on the file, so any number of processes on any  */
+/* number of nodes may share a container) and carry a checksum */
+/* of their data, which is verified on every read. A record    */
+/* torn by a crash during writing is detected and discarded by */
+/* the next writer. Each process keeps an in-memory index of   */
+/* the records, which it refreshes whenever the file grows.    */
+/*                                                             */
+/* Other environment variables:                                */
+/*                                                             */
+/*  SCUFF_TBLOCK_MAXSIZE=N   limit each container to N MB; when*/
+/*                           an append would exceed this, the  */
+/*                           least-recently-used records are   */
+/*                           evicted and the file is rewritten */
+/*                           and atomically renamed into place */
+/*                                                             */
+/*  SCUFF_TBLOCK_INTERPTOL=x if there is no record at exactly  */
+/*                           the requested frequency, but      */
+/*                           there are records at frequencies  */
+/*                           on either side of it with         */
+/*                           relative separation <= x, return  */
+/*                           the linear interpolation between  */
+/*                           them (default: 0 = never)         */
+/***************************************************************/
+#define TBS_SIGNATURE  "SCUFF_TBS"
+#define TBS_VERSION    1
+#define TBS_BYTEORDER  0x01020304
+#define TBS_MAGIC      0x4B4C4254  // 'TBLK'
+
+typedef struct TBSHeader
+ { StoreFileHeader Common;  // TBS_SIGNATURE, TBS_VERSION, TBS_BYTEORDER
+   uint32_t NumBFs;         // dimension of the T-blocks for this mesh
+   uint32_t Reserved;
+   uint64_t MeshHash;       // hash of the mesh topology and geometry
+   char Padding[24];
+ } TBSHeader;
+
+typedef struct TBSRecordHeader
+ { uint32_t Magic;          // TBS_MAGIC
+   uint32_t RealComplex;    // LHM_REAL or LHM_COMPLEX
+   uint32_t Flags;          // TBS_INTERIOR_ZEROED etc.
+   uint32_t Reserved;
+   double Omega[2];         // real and imaginary parts
+   double kBloch[2];        // zero for compact geometries
+   uint64_t MaterialHash;   // hash of the names of the adjoining materials
+   uint64_t DataSize;       // in bytes
+   uint64_t Checksum;       // of the data
+   uint64_t LastUsed;       // time (in seconds) of last write or read
+ } TBSRecordHeader;
+
+#define TBS_INTERIOR_ZEROED 1
+#define TBS_EXTERIOR_ZEROED 2
+
+// try to fill in the diagonal block of M for surface #ns from the
+// store; returns true on success
+bool ReadTBlock(RWGGeometry *G, int ns, cdouble Omega, double *kBloch,
+                HMatrix *M, int RowOffset, int ColOffset);
+
+// add the diagonal block of M for surface #ns to the store
+void WriteTBlock(RWGGeometry *G, int ns, cdouble Omega, double *kBloch,
+                 HMatrix *M, int RowOffset, int ColOffset);
+
+} // namespace scuff
+
+#endif // TBLOCKSTORE_H
@@ -51,6 +51,11 @@
 #include "GBarAccelerator.h"
 #include "PFTOptions.h"
 #include "EquivalentEdgePairs.h"
+#include "CompressedBEMMatrix.h"
+#include "BEMMatrixInterpolator.h"
+#include "MLFMAMatrix.h"
+#include "SweepSolver.h"
+#include "ResultStore.h"
 
 namespace scuff {
 
@@ -340,6 +345,7 @@ typedef struct MMJData
  } MMJData;
 
 class EquivalentEdgePairTable; // forward declaration
+class EquivalentPanelPairTable; // forward declaration
 
 /*************************** ***********************************/
 /* an RWGGeometry is a collection of regions with interfaces   */
@@ -361,8 +367,20 @@ class RWGGeometry
    /*- assembling the BEM matrix and RHS vector                    */
    /*--------------------------------------------------------------*/
    HMatrix *AllocateBEMMatrix(bool PureImagFreq = false, bool Packed = false);
-   HMatrix *AssembleBEMMatrix(cdouble Omega, double *kBloch, HMatrix *M = NULL);
-   HMatrix *AssembleBEMMatrix(cdouble Omega, HMatrix *M = NULL);
+   HMatrix *AssembleBEMMatrix(cdouble Omega, double *kBloch, HMatrix *M = NULL,
+                              bool UpdateEpsMuCache = true);
+   HMatrix *AssembleBEMMatrix(cdouble Omega, HMatrix *M = NULL,
+                              bool UpdateEpsMuCache = true);
+
+   /* hierarchically-compressed (H-matrix) BEM matrix for large */
+   /* compact geometries; see CompressedBEMMatrix.h             */
+   CompressedBEMMatrix *AllocateCompressedBEMMatrix(double ACATol=CBM_DEFAULT_ACATOL);
+   CompressedBEMMatrix *AssembleCompressedBEMMatrix(cdouble Omega, CompressedBEMMatrix *M=0);
+
+   /* multilevel fast multipole matrix-vector products for large */
+   /* compact geometries; see MLFMAMatrix.h                      */
+   MLFMAMatrix *AllocateMLFMAMatrix(double Tol=MLFMA_DEFAULT_TOL);
+   MLFMAMatrix *AssembleMLFMAMatrix(cdouble Omega, MLFMAMatrix *M=0);
 
    HVector *AllocateRHSVector(bool PureImagFreq = false );
    HVector *AssembleRHSVector(cdouble Omega, double *kBloch,
@@ -390,7 +408,17 @@ class RWGGeometry
    HMatrix *GetDyadicGFs(cdouble Omega, double *kBloch,
                          HMatrix *XMatrix, HMatrix *M,
                          HMatrix *GMatrix=0, 
-                         bool ScatteringOnly=false);
+                         bool ScatteringOnly=false,
+                         HMatrix **RFBuffers=0);
+   HMatrix *GetDyadicGFs(cdouble Omega, double *kBloch,
+                         HMatrix *XMatrix, CompressedBEMMatrix *CM,
+                         HMatrix *GMatrix=0,
+                         bool ScatteringOnly=false,
+                         HMatrix **RFBuffers=0);
+   HMatrix *GetDyadicGFs(cdouble Omega, double *kBloch,
+                         HMatrix *XMatrix, HMatrix *M,
+                         CompressedBEMMatrix *CM, HMatrix *GMatrix,
+                         bool ScatteringOnly, HMatrix **RFBuffers);
 
    // these next two are legacy interfaces which will be
    // removed in future versions
@@ -503,15 +531,17 @@ class RWGGeometry
                                void *ABMBCache=0, bool CacheTranspose=false,
                                int NumTorqueAxes=0, HMatrix **dMdT=0,
                                double *GammaMatrix=0);
+   void AssembleSelfBlocks(int ns, cdouble Omega, double *kBloch,
+                           HMatrix *TExt, HMatrix *TInt);
    void *CreateABMBAccelerator(int nsa, int nsb, bool PureImagFreq=false,
-                               bool NeedZDerivative=false);
+                               bool NeedZDerivative=false, bool Verbose=true);
    void DestroyABMBAccelerator(void *Accelerator);
    void ApplyMMJTransformation(HMatrix *M, HVector *RHS);
 
    // helper function for GetFields, GetDyadicGFs, GetSRFluxTrace
    HMatrix *GetRFMatrix(cdouble Omega, double *kBloch, HMatrix *XMatrix,
                         HMatrix *RFMatrix=0, bool MinuskBloch=false,
-                        int ColumnOffset=0);
+                        int ColumnOffset=0, int *RegionIndices=0);
 
    // helper function for accelerating periodic GF calculations
    GBarAccelerator *CreateRegionGBA(int nr, cdouble Omega, double *kBloch, int ns1, int ns2);
@@ -562,6 +592,16 @@ class RWGGeometry
 
    void **FIBBICaches;
 
+   /* bounded store of kBloch-independent inner-cell matrix blocks */
+   /* for PBC geometries, used by AssembleBEMMatrixBlock whenever  */
+   /* the caller does not supply an accelerator of its own         */
+   void *KBIMBStore;
+
+   /* if non-NULL, AssembleBEMMatrix interpolates the BEM matrix   */
+   /* in frequency instead of assembling it whenever the frequency */
+   /* is in range; see BEMMatrixInterpolator.h                     */
+   BEMMatrixInterpolator *BMInterpolator;
+
    /**************************************************************/
    /* LDim=0 for compact geometries.                             */
    /* For geometries with D-dimensional Bloch-periodicity,       */
@@ -612,6 +652,11 @@ class RWGGeometry
    // EEPTables[nsa][nsb] = equivalent edge-pair table for surfaces (nsa,nsb) 
    std::vector < std::vector< EquivalentEdgePairTable *> > EEPTables;
 
+   // EPPTables[ns] = equivalent panel-pair table for surface ns (created
+   // lazily by GetSurfaceSurfaceInteractions; identical surfaces share
+   // the table of their mate)
+   std::vector< EquivalentPanelPairTable *> EPPTables;
+
    /* SurfaceMoved[i] = 1 if surface #i was moved on the most   */
    /* recent call to Transform(). Otherwise SurfaceMoved[i]=0.  */
    int *SurfaceMoved;
@@ -631,6 +676,11 @@ class RWGGeometry
    static bool UseHighKTaylorDuffy;
    static bool UseTaylorDuffyV2P0;
    static bool DisableCache;
+
+   // if positive, GetFields() computes scattered fields with
+   // multipole expansions (MLFMAMatrix::GetFields) to this
+   // relative tolerance, for geometries that support it
+   static double FieldsFMMTol;
  };
 
 /***************************************************************/
@@ -64,6 +64,7 @@ namespace scuff {
 /*--------------------------------------------------------------*/
 /*- GetPanelPanelInteractions() --------------------------------*/
 /*--------------------------------------------------------------*/
+#define PPI_MAXKS 4 // max number of wavenumbers in a batch
 typedef struct GetPPIArgStruct
  { 
    // input fields to be filled in by caller
@@ -91,6 +92,17 @@ typedef struct GetPPIArgStruct
    GBarAccelerator *GBA;
    bool ForceFullEwald;
 
+   // optional batch of wavenumbers: if NumKs>0, routines that
+   // support batching compute the integrals for each of the
+   // wavenumbers Ks[nk] (with kernel accelerators GBAs[nk]),
+   // sharing all geometric and k-independent work, and ignore
+   // the k and GBA fields above. (currently only the
+   // VertexMask form of GetPanelPanelInteractions() does this.)
+   int NumKs;
+   cdouble Ks[PPI_MAXKS];
+   GBarAccelerator *GBAs[PPI_MAXKS];
+   int WhichAlgorithms[PPI_MAXKS];
+
    // output fields filled in by routine
    // note: H[0] = HPlus ( = HDot + (1/(ik)^2) * HNabla )
    // note: H[1] = HTimes
@@ -110,6 +122,9 @@ void GetPanelPanelInteractions(GetPPIArgStruct *Args,
                                cdouble *H,
                                cdouble *GradH,
                                cdouble *dHdT);
+void GetPanelPanelInteractions(GetPPIArgStruct *Args,
+                               int VertexMask, cdouble *H);
+bool IsDistantPanelPair(GetPPIArgStruct *Args);
 
 /*--------------------------------------------------------------*/
 /*- GetEdgeEdgeInteractions() ----------------------------------*/
@@ -147,6 +162,16 @@ typedef struct GetEEIArgStruct
    // algorithms were invoked 
    unsigned PPIAlgorithmCount[NUMPPIALGORITHMS];
 
+   // optional batch of wavenumbers: if NumKs>0, the edge-edge
+   // interactions are computed for each of the wavenumbers Ks[nk]
+   // (with kernel accelerators GBAs[nk]) with all geometric work
+   // shared, and returned in GCs[2*nk + 0,1]; the k and GBA
+   // fields above are ignored, and derivatives are not supported
+   int NumKs;
+   cdouble Ks[PPI_MAXKS];
+   GBarAccelerator *GBAs[PPI_MAXKS];
+   cdouble GCs[2*PPI_MAXKS];
+
    // output fields filled in by routine
    //  GC[0] = <f_a|G|f_b>
    //  GC[1] = <f_a|C|f_b>
@@ -254,6 +279,12 @@ typedef struct GetSSIArgStruct
    HMatrix **GradB;
    HMatrix **dBdTheta;
 
+   // if this is nonzero, the contributions of the second
+   // common region (EpsB, MuB) are written to B2 instead of B;
+   // this allows both blocks to be computed in a single pass
+   // over edge pairs. (not supported with GradB or dBdTheta.)
+   HMatrix *B2;
+
    // additional fields used internally that may be ignored by 
    // the caller both before and after the call
    double SignA, SignB;
@@ -267,6 +298,9 @@ void InitGetSSIArgs(GetSSIArgStruct *Args);
 void GetSurfaceSurfaceInteractions(GetSSIArgStruct *Args);
 void AddSurfaceZetaContributionToBEMMatrix(GetSSIArgStruct *Args);
 
+// in AssembleBEMMatrix.cc
+void DestroyKBIMBStore(void *Store);
+
 /***************************************************************/
 /* 2. definition of data structures and methods for working    */
 /*    with frequency-independent panel-panel integrals (FIPPIs)*/
@@ -319,7 +353,14 @@ void GetQDFIPPIData(double **Va, double *Qa, double **Vb, double *Qb,
 /* and retrieval of QIFIPPIData structures for many panel pairs.*/
 /* i am encapsulating this as its own separate class to allow   */
 /* easy experimentation with various implementations.           */
+/*                                                              */
+/* the table is split into FIPPICACHE_NUMSHARDS independent     */
+/* sub-tables, selected by bits of the key hash, each with its  */
+/* own readers/writer lock and hit/miss counters, so that       */
+/* concurrent lookups from many threads rarely contend.         */
 /*--------------------------------------------------------------*/
+#define FIPPICACHE_NUMSHARDS 64
+
 class FIPPICache
  { 
   public:
@@ -335,7 +376,11 @@ class FIPPICache
     // look up an entry 
     QIFIPPIData *GetQIFIPPIData(double **OVa, double **OVb, int ncv);
 
-    int Hits, Misses;
+    // total number of records, and hit/miss statistics
+    // accumulated since the last call to ResetStatistics()
+    unsigned long Size();
+    void GetStatistics(unsigned long *Hits, unsigned long *Misses);
+    void ResetStatistics();
 
   private:
 
@@ -346,7 +391,8 @@ class FIPPICache
     // implementation 
     void *opTable;
 
-    rwlock FCLock;
+    // opaque pointer to a read-only memory-mapped cache file, if any
+    void *opMappedFile;
 
     char *PreloadFileName;
     unsigned int RecordsPreloaded;
@@ -391,6 +437,16 @@ int NumCommonVertices(RWGSurface *Sa, int npa, RWGSurface *Sb, int npb);
 int CanonicallyOrderVertices(double **Va, double **Vb, int ncv,
                              double **OVa, double **OVb);
 
+/****************************************************************/
+/*- 4. Reduced fields of single basis functions (GetFields.cc)  */
+/*-                                                             */
+/*- GC[0..2] and GC[3..5] are the "G" and "C" reduced fields of */
+/*- basis function #ne on surface #ns at the point X, as they   */
+/*- are stamped into the RFMatrix by GetRFMatrix().             */
+/****************************************************************/
+void GetReducedFields(RWGGeometry *G, int ns, int ne, double X[3],
+                      cdouble k, cdouble GC[6]);
+
 } // namespace scuff
 
 #endif //LIBSCUFFINTERNALS_H
@@ -0,0 +1,112 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * benchmark-FIPPICache.cc -- micro-benchmark for concurrent lookups
+ *                         -- in the FIPPI cache
+ *
+ * usage: benchmark-FIPPICache [--NumPairs 1000] [--NumLookups 10000000]
+ *
+ * the cache is first populated with NumPairs random panel pairs,
+ * after which NumLookups lookups (all hits) are timed for thread
+ * counts 1, 2, 4, ... up to the maximum available.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "libscuffInternals.h"
+
+using namespace scuff;
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+  InitializeLog(argv[0]);
+
+  int NumPairs=1000;
+  int NumLookups=10000000;
+  OptStruct OSArray[]=
+   { {"NumPairs",   PA_INT, 1, 1, (void *)&NumPairs,   0, "number of distinct panel pairs"},
+     {"NumLookups", PA_INT, 1, 1, (void *)&NumLookups, 0, "number of lookups per thread count"},
+     {0,0,0,0,0,0,0}
+   };
+  ProcessOptions(argc, argv, OSArray);
+
+  /*--------------------------------------------------------------*/
+  /*- random non-touching panel pairs: panel a in the unit cube,  */
+  /*- panel b displaced by 3 units along z                        */
+  /*--------------------------------------------------------------*/
+  srand48(0);
+  double *VBuffer = (double *)mallocEC(NumPairs*18*sizeof(double));
+  for(int n=0; n<NumPairs*18; n++)
+   VBuffer[n] = drand48() + ( (n%18)>=9 && (n%3)==2 ? 3.0 : 0.0 );
+
+  FIPPICache *FC = new FIPPICache();
+
+  /*--------------------------------------------------------------*/
+  /*- populate the cache (all misses) ----------------------------*/
+  /*--------------------------------------------------------------*/
+  double Time=Secs();
+  for(int np=0; np<NumPairs; np++)
+   { double *V=VBuffer + 18*np;
+     double *Va[3]={V+0, V+3, V+6}, *Vb[3]={V+9, V+12, V+15};
+     FC->GetQIFIPPIData(Va, Vb, 0);
+   };
+  Time=Secs()-Time;
+  printf("populated cache with %lu records in %.2f s\n",FC->Size(),Time);
+
+  /*--------------------------------------------------------------*/
+  /*- time lookups at increasing thread counts -------------------*/
+  /*--------------------------------------------------------------*/
+  int MaxThreads=GetNumThreads();
+  printf("#threads   time (s)   Mlookups/s   speedup\n");
+  double Rate1=0.0;
+  for(int NumThreads=1; NumThreads<=MaxThreads; NumThreads*=2)
+   {
+     FC->ResetStatistics();
+     Time=Secs();
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(static), num_threads(NumThreads)
+#endif
+     for(int nl=0; nl<NumLookups; nl++)
+      { double *V=VBuffer + 18*(nl%NumPairs);
+        double *Va[3]={V+0, V+3, V+6}, *Vb[3]={V+9, V+12, V+15};
+        FC->GetQIFIPPIData(Va, Vb, 0);
+      };
+     Time=Secs()-Time;
+
+     unsigned long Hits, Misses;
+     FC->GetStatistics(&Hits, &Misses);
+     if ( (int)Hits!=NumLookups || Misses!=0 )
+      ErrExit("unexpected statistics: %lu hits, %lu misses",Hits,Misses);
+
+     double Rate = 1.0e-6*NumLookups/Time;
+     if (NumThreads==1) Rate1=Rate;
+     printf("%8i   %8.3f   %10.2f   %7.2f\n",NumThreads,Time,Rate,Rate/Rate1);
+   };
+
+  delete FC;
+  free(VBuffer);
+  printf("Thank you for your support.\n");
+}
@@ -0,0 +1,159 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-BZIWorkspaces.cc -- SCUFF-EM unit test for concurrent
+ *                            -- Brillouin-zone integration
+ *
+ * the LDOS above a periodic PEC plate is integrated over the
+ * Brillouin zone with one BEM workspace and with several, with
+ * each workspace assembling its own BEM matrix and computing
+ * DGFs with its own reduced-field buffers; the results must agree.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "BZIntegration.h"
+
+using namespace scuff;
+
+#define MAXWORKSPACES 4
+
+/***************************************************************/
+/* data for the BZ integrand: one BEM matrix, DGF matrix, and  */
+/* pair of reduced-field buffers per workspace                 */
+/***************************************************************/
+typedef struct BZIData
+ { RWGGeometry *G;
+   HMatrix *XMatrix;
+   HMatrix *M[MAXWORKSPACES];
+   HMatrix *GMatrix[MAXWORKSPACES];
+   HMatrix *RFBuffers[2*MAXWORKSPACES];
+ } BZIData;
+
+/***************************************************************/
+/* electric and magnetic LDOS at each evaluation point         */
+/***************************************************************/
+void LDOSIntegrand(void *UserData, int nw, cdouble Omega, double *kBloch,
+                   double *BZIntegrand)
+{
+  BZIData *Data    = (BZIData *)UserData;
+  RWGGeometry *G   = Data->G;
+  HMatrix *XMatrix = Data->XMatrix;
+  HMatrix *M       = Data->M[nw];
+  HMatrix *GMatrix = Data->GMatrix[nw];
+
+  // workspaces run concurrently, so don't touch the shared eps/mu cache
+  G->AssembleBEMMatrix(Omega, kBloch, M, false);
+  M->LUFactorize();
+  G->GetDyadicGFs(Omega, kBloch, XMatrix, M, GMatrix, true,
+                  Data->RFBuffers + 2*nw);
+
+  for(int nx=0; nx<XMatrix->NR; nx++)
+   { BZIntegrand[2*nx+0] = imag(   GMatrix->GetEntry(nx, 0)
+                                 + GMatrix->GetEntry(nx, 4)
+                                 + GMatrix->GetEntry(nx, 8) );
+     BZIntegrand[2*nx+1] = imag(   GMatrix->GetEntry(nx, 9)
+                                 + GMatrix->GetEntry(nx, 13)
+                                 + GMatrix->GetEntry(nx, 17) );
+   };
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+  InstallHRSignalHandler();
+  SetLogFileName("scuff-unit-tests.log");
+  Log("SCUFF-EM BZI workspace unit tests running on %s",GetHostName());
+
+  RWGGeometry *G = new RWGGeometry("PECPlate_40.scuffgeo");
+
+  double XValues[3][3] = { {  0.1,  0.20, 0.5 },
+                           {  0.3, -0.10, 1.0 },
+                           { -0.2,  0.25, 0.3 } };
+  HMatrix *XMatrix = new HMatrix(3, 3);
+  for(int nx=0; nx<3; nx++)
+   for(int i=0; i<3; i++)
+    XMatrix->SetEntry(nx, i, XValues[nx][i]);
+
+  BZIData MyData, *Data=&MyData;
+  Data->G       = G;
+  Data->XMatrix = XMatrix;
+  for(int nw=0; nw<MAXWORKSPACES; nw++)
+   { Data->M[nw]       = G->AllocateBEMMatrix();
+     Data->GMatrix[nw] = new HMatrix(XMatrix->NR, 18, LHM_COMPLEX);
+     Data->RFBuffers[2*nw+0] = Data->RFBuffers[2*nw+1] = 0;
+   };
+
+  /***************************************************************/
+  /* integrate with 1 and with MAXWORKSPACES workspaces          */
+  /***************************************************************/
+  cdouble Omega = 1.0;
+  int FDim = 2*XMatrix->NR;
+  double *Integrals[2];
+  for(int n=0; n<2; n++)
+   {
+     GetBZIArgStruct *BZIArgs = InitBZIArgs();
+     BZIArgs->BZIFuncW      = LDOSIntegrand;
+     BZIArgs->UserData      = (void *)Data;
+     BZIArgs->FDim          = FDim;
+     BZIArgs->BZIMethod     = BZI_CC;
+     BZIArgs->Order         = 5;
+     BZIArgs->NumWorkspaces = (n==0) ? 1 : MAXWORKSPACES;
+     UpdateBZIArgs(BZIArgs, G->RLBasis, G->RLVolume);
+
+     Integrals[n] = new double[FDim];
+     GetBZIntegral(BZIArgs, Omega, Integrals[n]);
+     Log("%i workspaces: %i BZ samples",BZIArgs->NumWorkspaces,BZIArgs->NumCalls);
+   };
+
+  /***************************************************************/
+  /***************************************************************/
+  /***************************************************************/
+  int PassedTests=0, TotalTests=0;
+  for(int nf=0; nf<FDim; nf++)
+   { TotalTests++;
+     double MyRD = RD(Integrals[0][nf], Integrals[1][nf]);
+     Log("Point %i %cLDOS: {1,%i workspaces,RD}={%+.8e,%+.8e,%.1e}...",
+          nf/2, (nf%2) ? 'M' : 'E', MAXWORKSPACES,
+          Integrals[0][nf], Integrals[1][nf], MyRD);
+     if (MyRD < 1.0e-8)
+      { PassedTests++;
+        LogC("PASSED");
+      }
+     else
+      LogC("FAILED");
+   };
+
+  Log("%i/%i tests successfully passed.",PassedTests,TotalTests);
+  printf("%i/%i tests successfully passed.\n",PassedTests,TotalTests);
+
+  int FailedTests=TotalTests - PassedTests;
+  if (FailedTests>0)
+   abort();
+
+  return 0;
+
+}
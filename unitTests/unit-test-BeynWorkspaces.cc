@@ -0,0 +1,188 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-BeynWorkspaces.cc -- SCUFF-EM unit test for Beyn's
+ *                             -- method with concurrent contour points
+ *
+ * the Beyn contour integrals for a dispersive silicon sphere are
+ * computed with one BEM workspace and with several, starting from
+ * the same random seed; since each contour point is assembled at
+ * a different frequency, this checks that concurrent BEM-matrix
+ * assemblies for the same geometry don't interfere. it also checks
+ * that those assemblies leave the geometry's shared eps/mu cache
+ * (StoredOmega, EpsTF, MuTF) untouched, since writing it from
+ * several threads at once is a data race.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "libBeyn.h"
+
+using namespace scuff;
+
+#define MAXWORKSPACES 4
+#define RANDSEED      1
+
+/***************************************************************/
+/* data for the Beyn function: one BEM matrix per workspace    */
+/***************************************************************/
+typedef struct BFData
+ { RWGGeometry *G;
+   HMatrix *MW[MAXWORKSPACES];
+ } BFData;
+
+void BeynFunc(cdouble Omega, void *UserData, int nw, HMatrix *VHat, HMatrix *MVHat)
+{
+  BFData *Data = (BFData *)UserData;
+  HMatrix *M   = Data->MW[nw];
+
+  Data->G->AssembleBEMMatrix(Omega, M, false);
+  if (MVHat)
+   M->Multiply(VHat, MVHat);
+  else
+   { M->LUFactorize();
+     M->LUSolve(VHat);
+   };
+}
+
+/***************************************************************/
+/* max |A_{ij} - B_{ij}| / max |A_{ij}|                        */
+/***************************************************************/
+double MaxRelDiff(HMatrix *A, HMatrix *B)
+{
+  double MaxDiff=0.0, MaxA=0.0;
+  for(int nr=0; nr<A->NR; nr++)
+   for(int nc=0; nc<A->NC; nc++)
+    { MaxDiff = fmax(MaxDiff, abs(A->GetEntry(nr,nc) - B->GetEntry(nr,nc)));
+      MaxA    = fmax(MaxA,    abs(A->GetEntry(nr,nc)));
+    };
+  return MaxA==0.0 ? MaxDiff : MaxDiff/MaxA;
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+  InstallHRSignalHandler();
+  SetLogFileName("scuff-unit-tests.log");
+  Log("SCUFF-EM Beyn workspace unit tests running on %s",GetHostName());
+
+  RWGGeometry *G = new RWGGeometry("SiSphere_255.scuffgeo");
+
+  BFData MyData, *Data=&MyData;
+  Data->G = G;
+  for(int nw=0; nw<MAXWORKSPACES; nw++)
+   Data->MW[nw] = G->AllocateBEMMatrix();
+
+  /***************************************************************/
+  /* fill the eps/mu cache at a frequency off the contour; the   */
+  /* BEM assemblies below must not overwrite it                  */
+  /***************************************************************/
+  cdouble CacheOmega = cdouble(0.37, 0.0);
+  G->UpdateCachedEpsMuValues(CacheOmega);
+  cdouble *CachedEps = new cdouble[G->NumRegions];
+  cdouble *CachedMu  = new cdouble[G->NumRegions];
+  for(int nr=0; nr<G->NumRegions; nr++)
+   { CachedEps[nr] = G->EpsTF[nr];
+     CachedMu[nr]  = G->MuTF[nr];
+   };
+
+  /***************************************************************/
+  /* run Beyn's method on the same contour with 1 and with       */
+  /* MAXWORKSPACES workspaces                                    */
+  /***************************************************************/
+  cdouble Omega0 = cdouble(1.0, -0.1);
+  double R=0.2;
+  int N=8, L=4;
+  BeynSolver *Solvers[2];
+  int NumModes[2];
+  for(int n=0; n<2; n++)
+   { Solvers[n] = CreateBeynSolver(G->TotalBFs, L, (n==0) ? 1 : MAXWORKSPACES);
+     ReRandomize(Solvers[n], RANDSEED);
+     NumModes[n] = BeynSolve(Solvers[n], BeynFunc, (void *)Data, Omega0, R, N);
+     Log("%i workspaces: %i modes",Solvers[n]->NumWorkspaces,NumModes[n]);
+   };
+
+  /***************************************************************/
+  /***************************************************************/
+  /***************************************************************/
+  int PassedTests=0, TotalTests=0;
+
+  double RDA0 = MaxRelDiff(Solvers[0]->A0, Solvers[1]->A0);
+  double RDA1 = MaxRelDiff(Solvers[0]->A1, Solvers[1]->A1);
+  const char *Names[2] = {"A0", "A1"};
+  double RDs[2]        = {RDA0, RDA1};
+  for(int n=0; n<2; n++)
+   { TotalTests++;
+     Log("%s: {1,%i workspaces} relative difference %.1e...",
+          Names[n], MAXWORKSPACES, RDs[n]);
+     if (RDs[n] < 1.0e-10)
+      { PassedTests++;
+        LogC("PASSED");
+      }
+     else
+      LogC("FAILED");
+   };
+
+  TotalTests++;
+  Log("Number of modes: {%i,%i}...",NumModes[0],NumModes[1]);
+  bool SameModes = (NumModes[0]==NumModes[1]);
+  for(int nm=0; SameModes && nm<NumModes[0]; nm++)
+   { cdouble w0 = Solvers[0]->Eigenvalues->GetEntry(nm);
+     cdouble w1 = Solvers[1]->Eigenvalues->GetEntry(nm);
+     Log(" mode %i: %s, %s",nm,CD2S(w0),CD2S(w1));
+     if ( abs(w0-w1) > 1.0e-8*abs(w0) )
+      SameModes=false;
+   };
+  if (SameModes)
+   { PassedTests++;
+     LogC("PASSED");
+   }
+  else
+   LogC("FAILED");
+
+  TotalTests++;
+  Log("Eps/mu cache after concurrent assembly: Omega=%s...",CD2S(G->StoredOmega));
+  bool CacheIntact = (G->StoredOmega==CacheOmega);
+  for(int nr=0; CacheIntact && nr<G->NumRegions; nr++)
+   if ( G->EpsTF[nr]!=CachedEps[nr] || G->MuTF[nr]!=CachedMu[nr] )
+    CacheIntact=false;
+  if (CacheIntact)
+   { PassedTests++;
+     LogC("PASSED");
+   }
+  else
+   LogC("FAILED");
+
+  Log("%i/%i tests successfully passed.",PassedTests,TotalTests);
+  printf("%i/%i tests successfully passed.\n",PassedTests,TotalTests);
+
+  int FailedTests=TotalTests - PassedTests;
+  if (FailedTests>0)
+   abort();
+
+  return 0;
+
+}
@@ -0,0 +1,168 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-CompressedBEM.cc -- SCUFF-EM unit tests for the
+ *                            -- H-matrix representation of the BEM matrix
+ *
+ * matrix-vector products and linear solves computed with a
+ * CompressedBEMMatrix are compared against the dense BEM matrix,
+ * and the compressed matrix is checked to take less storage
+ * than the dense matrix.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "CompressedBEMMatrix.h"
+
+using namespace scuff;
+
+#define NUMRHS    4
+#define LEAFSIZE  64
+
+/***************************************************************/
+/* relative Frobenius-norm deviation of X from XRef            */
+/***************************************************************/
+double RelDiff(HMatrix *XRef, HMatrix *X)
+{
+  double Num=0.0, Den=0.0;
+  for(int nr=0; nr<XRef->NR; nr++)
+   for(int nc=0; nc<XRef->NC; nc++)
+    { Num += norm( X->GetEntry(nr,nc) - XRef->GetEntry(nr,nc) );
+      Den += norm( XRef->GetEntry(nr,nc) );
+    };
+  return Den==0.0 ? sqrt(Num) : sqrt(Num/Den);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+  InstallHRSignalHandler();
+  SetLogFileName("scuff-unit-tests.log");
+  Log("SCUFF-EM compressed BEM matrix unit tests running on %s",GetHostName());
+
+  #define NUMCASES 2
+  const char *GeoFileNames[NUMCASES] = { "PECSpheres_255.scuffgeo",
+                                         "SiSpheres_255.scuffgeo"
+                                       };
+  double OmegaValues[NUMCASES] = { 1.0, 0.3 };
+
+  #define NUMTOLS 2
+  double TolValues[NUMTOLS] = { 1.0e-4, 1.0e-6 };
+
+  // the errors in products and solutions may exceed the ACA
+  // tolerance by a modest factor
+  #define ERRFACTOR 10.0
+
+  int PassedTests=0, TotalTests=0;
+  for(int nCase=0; nCase<NUMCASES; nCase++)
+   {
+     Log("Testing geometry %s",GeoFileNames[nCase]);
+     RWGGeometry *G = new RWGGeometry(GeoFileNames[nCase]);
+     cdouble Omega = OmegaValues[nCase];
+     int N = G->TotalBFs;
+
+     /*--------------------------------------------------------------*/
+     /*- dense reference: Y = M*X and Z = M \ X for random X        -*/
+     /*--------------------------------------------------------------*/
+     HMatrix *X = new HMatrix(N, NUMRHS, LHM_COMPLEX);
+     srand48(1);
+     for(int nr=0; nr<N; nr++)
+      for(int nc=0; nc<NUMRHS; nc++)
+       X->SetEntry(nr, nc, cdouble(2.0*drand48()-1.0, 2.0*drand48()-1.0));
+
+     HMatrix *M    = G->AssembleBEMMatrix(Omega);
+     HMatrix *YRef = new HMatrix(N, NUMRHS, LHM_COMPLEX);
+     M->Multiply(X, YRef);
+     HMatrix *ZRef = new HMatrix(X);
+     M->LUFactorize();
+     M->LUSolve(ZRef);
+
+     for(int nTol=0; nTol<NUMTOLS; nTol++)
+      {
+        double Tol=TolValues[nTol];
+        CompressedBEMMatrix *CM = new CompressedBEMMatrix(G, Tol, LEAFSIZE);
+        CM->Assemble(Omega);
+
+        TotalTests++;
+        double Ratio=CM->GetCompressionRatio();
+        Log("Tol %.0e: compression ratio %.3f...",Tol,Ratio);
+        if (Ratio<1.0)
+         { PassedTests++;
+           LogC("PASSED");
+         }
+        else
+         LogC("FAILED");
+
+        TotalTests++;
+        HMatrix *Y = new HMatrix(N, NUMRHS, LHM_COMPLEX);
+        CM->Apply(X, Y);
+        double RD=RelDiff(YRef, Y);
+        Log("Tol %.0e: Apply relative difference %.2e...",Tol,RD);
+        if (RD<ERRFACTOR*Tol)
+         { PassedTests++;
+           LogC("PASSED");
+         }
+        else
+         LogC("FAILED");
+
+        TotalTests++;
+        HMatrix *Z = new HMatrix(X);
+        CM->LUFactorize();
+        CM->LUSolve(Z);
+        RD=RelDiff(ZRef, Z);
+        Log("Tol %.0e: LUSolve relative difference %.2e...",Tol,RD);
+        if (RD<ERRFACTOR*Tol)
+         { PassedTests++;
+           LogC("PASSED");
+         }
+        else
+         LogC("FAILED");
+
+        delete Z;
+        delete Y;
+        delete CM;
+      };
+
+     delete ZRef;
+     delete YRef;
+     delete M;
+     delete X;
+     delete G;
+   };
+
+  /***************************************************************/
+  /***************************************************************/
+  /***************************************************************/
+  Log("%i/%i tests successfully passed.",PassedTests,TotalTests);
+  printf("%i/%i tests successfully passed.\n",PassedTests,TotalTests);
+
+  int FailedTests=TotalTests - PassedTests;
+  if (FailedTests>0)
+   abort();
+
+  return 0;
+
+}
@@ -0,0 +1,153 @@
+/* Copyright (C) 2005-2011 M. T. Homer Reid
+ *
+ * This file is part of SCUFF-EM.
+ *
+ * SCUFF-EM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SCUFF-EM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * unit-test-FMMFields.cc -- SCUFF-EM unit tests for scattered fields
+ *                        -- computed by multipole expansions
+ *
+ * the fields computed with RWGGeometry::FieldsFMMTol > 0 are
+ * compared against the RFMatrix reference path at points inside
+ * and outside lossy spheres, for several tolerances.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libhrutil.h>
+#include "libscuff.h"
+#include "libIncField.h"
+
+using namespace scuff;
+
+#define NUMPOINTS 40
+
+/***************************************************************/
+/* rms relative deviation of the six field components of FFMM  */
+/* from those of FRef over rows nx0..nx0+NX-1                  */
+/***************************************************************/
+double RMSRelDiff(HMatrix *FRef, HMatrix *FFMM, int nx0, int NX)
+{
+  double Num=0.0, Den=0.0;
+  for(int nx=nx0; nx<nx0+NX; nx++)
+   for(int Mu=0; Mu<6; Mu++)
+    { Num += norm( FFMM->GetEntry(nx,Mu) - FRef->GetEntry(nx,Mu) );
+      Den += norm( FRef->GetEntry(nx,Mu) );
+    };
+  return Den==0.0 ? sqrt(Num) : sqrt(Num/Den);
+}
+
+/***************************************************************/
+/***************************************************************/
+/***************************************************************/
+int main(int argc, char *argv[])
+{
+  InstallHRSignalHandler();
+  SetLogFileName("scuff-unit-tests.log");
+  Log("SCUFF-EM FMM field unit tests running on %s",GetHostName());
+
+  /***************************************************************/
+  /* incident field and evaluation points: NUMPOINTS inside and  */
+  /* NUMPOINTS outside the unit sphere                           */
+  /***************************************************************/
+  cdouble E0[3]  = { 1.0, 0.0, 0.0 };
+  double nHat[3] = { 0.0, 0.0, 1.0 };
+  PlaneWave *PW = new PlaneWave(E0, nHat);
+
+  HMatrix *XMatrix = new HMatrix(2*NUMPOINTS, 3);
+  srand48(1);
+  for(int nx=0; nx<2*NUMPOINTS; nx++)
+   { double r = (nx<NUMPOINTS) ? 0.1 + 0.75*drand48() : 1.2 + 3.0*drand48();
+     double CT=2.0*drand48()-1.0, ST=sqrt(1.0-CT*CT), Phi=2.0*M_PI*drand48();
+     XMatrix->SetEntry(nx, 0, r*ST*cos(Phi));
+     XMatrix->SetEntry(nx, 1, r*ST*sin(Phi));
+     XMatrix->SetEntry(nx, 2, r*CT);
+   };
+
+  /***************************************************************/
+  /* loop over geometries, frequencies, and tolerances           */
+  /***************************************************************/
+  #define NUMCASES 2
+  const char *GeoFileNames[NUMCASES] = { "SiO2Sphere_501.scuffgeo",
+                                         "GoldSphere_501.scuffgeo"
+                                       };
+  double OmegaValues[NUMCASES] = { 0.3, 1.0 };
+
+  #define NUMTOLS 2
+  double TolValues[NUMTOLS] = { 1.0e-3, 1.0e-5 };
+
+  int PassedTests=0, TotalTests=0;
+  for(int nCase=0; nCase<NUMCASES; nCase++)
+   {
+     Log("Testing geometry %s",GeoFileNames[nCase]);
+     RWGGeometry *G = new RWGGeometry(GeoFileNames[nCase]);
+     cdouble Omega = OmegaValues[nCase];
+
+     HMatrix *M  = G->AssembleBEMMatrix(Omega);
+     M->LUFactorize();
+     HVector *KN = G->AssembleRHSVector(Omega, PW);
+     M->LUSolve(KN);
+
+     RWGGeometry::FieldsFMMTol=0.0;
+     HMatrix *FRef = G->GetFields(0, KN, Omega, XMatrix);
+
+     for(int nTol=0; nTol<NUMTOLS; nTol++)
+      {
+        double Tol=TolValues[nTol];
+        RWGGeometry::FieldsFMMTol=Tol;
+        HMatrix *FFMM = G->GetFields(0, KN, Omega, XMatrix);
+        for(int nSide=0; nSide<2; nSide++)
+         {
+           TotalTests++;
+           double RD=RMSRelDiff(FRef, FFMM, nSide*NUMPOINTS, NUMPOINTS);
+           Log("Tol %.0e, %s points: RMS relative difference %.2e...",
+                Tol, nSide==0 ? "interior" : "exterior", RD);
+           if (RD<Tol)
+            { PassedTests++;
+              LogC("PASSED");
+            }
+           else
+            LogC("FAILED");
+         };
+        delete FFMM;
+      };
+     RWGGeometry::FieldsFMMTol=0.0;
+
+     delete FRef;
+     delete KN;
+     delete M;
+     delete G;
+   };
+
+  delete XMatrix;
+  delete PW;
+
+  /***************************************************************/
+  /***************************************************************/
+  /***************************************************************/
+  Log("%i/%i tests successfully passed.",PassedTests,TotalTests);
+  printf("%i/%i tests successfully passed.\n",PassedTests,TotalTests);
+
+  int FailedTests=TotalTests - PassedTests;
+  if (FailedTests>0)
+   abort();
+
+  return 0;
+
+}